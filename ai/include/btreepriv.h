@@ -58,6 +58,7 @@ struct btree { // 62 Bytes -> 64B
 } __attribute__ ((packed));
 
 // Aerospike Index local list ... this is to optimize for space for the high selectivity index.
+// Digests are kept sorted (memcmp order) - see ai_arr_find().
 typedef struct {
 	uint8_t    capacity;
 	uint8_t    used;
@@ -25,6 +25,8 @@
 
 #pragma once
 
+#include <string.h>
+
 #include "ai_obj.h"
 #include "bt.h"
 
@@ -32,6 +34,29 @@ int u160Cmp (void *s1, void *s2);
 int llCmp   (void *s1, void *s2);
 int ylCmp   (void *s1, void *s2);
 
+/* Inline forms of the above - for hot paths that know the tree's key type,
+ * and so needn't call through btr->cmp. */
+static inline int u160CmpInline(void *s1, void *s2) {
+	char *p1 = (char *)s1;
+	char *p2 = (char *)s2;
+	uint128 x1, x2;
+	memcpy(&x1, p1 + 4, 16);
+	memcpy(&x2, p2 + 4, 16);
+	if (x1 == x2) {
+		uint32 u1;
+		memcpy(&u1, p1, 4);
+		uint32 u2;
+		memcpy(&u2, p2, 4);
+		return u1 == u2 ? 0 : (u1 > u2) ? 1 : -1;
+	} else return             (x1 > x2) ? 1 : -1;
+}
+
+static inline int llCmpInline(void *s1, void *s2) {
+	long l1 = (long)((llk *)s1)->key;
+	long l2 = (long)((llk *)s2)->key;
+	return l1 == l2 ? 0 : (l1 > l2) ? 1 : -1;
+}
+
 char *createBTKey(ai_obj *key, bool *med, uint32 *ksize, bt *btr, btk_t *btk);
 void  destroyBTKey(char *btkey, bool  med);
 
@@ -37,13 +37,20 @@
 #include "fabric/partition.h"
 
 #include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_hash_math.h>
 #include <citrusleaf/cf_clock.h>
 #include <citrusleaf/cf_digest.h>
 #include <citrusleaf/cf_ll.h>
 
 #include "fault.h"
 
-#define AI_ARR_MAX_USED 32
+/*
+ * Digests in an ai_arr are kept sorted, so lookups are a binary search and
+ * the array stays worth using well past the point a linear scan would not.
+ * Must not exceed the largest power of 2 within AI_ARR_MAX_SIZE, so that the
+ * array flips to a btree before it would need to expand past that.
+ */
+#define AI_ARR_MAX_USED 128
 
 /*
  *  Global determining whether to use array rather than B-Tree.
@@ -105,18 +112,33 @@ ai_arr_size(ai_arr *arr)
 }
 
 /*
- * Finds the digest in the AI array.
+ * Binary search of the (sorted) AI array.
  * Returns
  *      idx if found
  *      -1  if not found
+ * If not found, *ins_idx (if not NULL) is set to where the digest belongs.
  */
 static int
-ai_arr_find(ai_arr *arr, cf_digest *dig)
+ai_arr_find(ai_arr *arr, cf_digest *dig, int *ins_idx)
 {
-	for (int i = 0; i < arr->used; i++) {
-		if (0 == cf_digest_compare(dig, (cf_digest *)&arr->data[i * CF_DIGEST_KEY_SZ])) {
-			return i;
+	int lo = 0;
+	int hi = arr->used;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = memcmp(dig, &arr->data[mid * CF_DIGEST_KEY_SZ], CF_DIGEST_KEY_SZ);
+
+		if (cmp == 0) {
+			return mid;
 		}
+		if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	if (ins_idx) {
+		*ins_idx = lo;
 	}
 	return -1;
 }
@@ -146,17 +168,17 @@ ai_arr_shrink(ai_arr *arr)
 static ai_arr *
 ai_arr_delete(ai_arr *arr, cf_digest *dig, bool *notfound)
 {
-	int idx = ai_arr_find(arr, dig);
+	int idx = ai_arr_find(arr, dig, NULL);
 	// Nothing to delete
 	if (idx < 0) {
 		*notfound = true;
 		return arr;
 	}
 	if (idx != arr->used - 1) {
-		int dest_offset = idx * CF_DIGEST_KEY_SZ;
-		int src_offset = (arr->used - 1) * CF_DIGEST_KEY_SZ;
-		// move last element
-		memcpy(&arr->data[dest_offset], &arr->data[src_offset], CF_DIGEST_KEY_SZ);
+		// close the gap to keep the array sorted
+		memmove(&arr->data[idx * CF_DIGEST_KEY_SZ],
+				&arr->data[(idx + 1) * CF_DIGEST_KEY_SZ],
+				(arr->used - 1 - idx) * CF_DIGEST_KEY_SZ);
 	}
 	arr->used--;
 	return ai_arr_shrink(arr);
@@ -193,7 +215,8 @@ ai_arr_expand(ai_arr *arr)
 static ai_arr *
 ai_arr_insert(ai_arr *arr, cf_digest *dig, bool *found)
 {
-	int idx = ai_arr_find(arr, dig);
+	int ins_idx = 0;
+	int idx = ai_arr_find(arr, dig, &ins_idx);
 	// already found
 	if (idx >= 0) {
 		*found = true;
@@ -205,7 +228,12 @@ ai_arr_insert(ai_arr *arr, cf_digest *dig, bool *found)
 	if (!arr) {
 		return NULL;
 	}
-	memcpy(&arr->data[arr->used * CF_DIGEST_KEY_SZ], dig, CF_DIGEST_KEY_SZ);
+	if (ins_idx != arr->used) {
+		memmove(&arr->data[(ins_idx + 1) * CF_DIGEST_KEY_SZ],
+				&arr->data[ins_idx * CF_DIGEST_KEY_SZ],
+				(arr->used - ins_idx) * CF_DIGEST_KEY_SZ);
+	}
+	memcpy(&arr->data[ins_idx * CF_DIGEST_KEY_SZ], dig, CF_DIGEST_KEY_SZ);
 	arr->used++;
 	return arr;
 }
@@ -455,12 +483,28 @@ reduced_iRem(bt *ibtr, ai_obj *acol, ai_obj *apk)
 	return AS_SINDEX_OK;
 }
 
+// Ordered string keys are mostly zeros for short strings - hash all the bytes.
+static inline uint64_t
+ordered_key_hash(as_sindex_metadata *imd, const cf_digest *key)
+{
+	return cf_hash_fnv32((const uint8_t *)key, CF_DIGEST_KEY_SZ) % imd->nprts;
+}
+
+static inline cf_digest *
+range_key(as_sindex_metadata *imd, as_sindex_bin_data *b)
+{
+	return imd->str_ordered ? &b->ordered : &b->digest;
+}
+
 int
 ai_btree_key_hash_from_sbin(as_sindex_metadata *imd, as_sindex_bin_data *b)
 {
 	uint64_t u;
 
 	if (C_IS_DG(imd->sktype)) {
+		if (imd->str_ordered) {
+			return (int)ordered_key_hash(imd, &b->ordered);
+		}
 		char *x = (char *) &b->digest; // x += 4;
 		u = ((* (uint128 *) x) % imd->nprts);
 	} else {
@@ -476,6 +520,9 @@ ai_btree_key_hash(as_sindex_metadata *imd, void *skey)
 	uint64_t u;
 
 	if (C_IS_DG(imd->sktype)) {
+		if (imd->str_ordered) {
+			return (int)ordered_key_hash(imd, (cf_digest *)skey);
+		}
 		char *x = (char *) ((cf_digest *)skey); // x += 4;
 		u = ((* (uint128 *) x) % imd->nprts);
 	} else {
@@ -651,12 +698,12 @@ get_recl(as_sindex_metadata *imd, ai_obj *afk, as_sindex_qctx *qctx)
  *        -1 in case of failure
  */
 static int
-get_numeric_range_recl(as_sindex_metadata *imd, uint64_t begk, uint64_t endk, as_sindex_qctx *qctx)
+get_range_recl(as_sindex_metadata *imd, ai_obj *begk, ai_obj *endk, as_sindex_qctx *qctx)
 {
 	ai_obj sfk;
-	init_ai_objLong(&sfk, qctx->new_ibtr ? begk : qctx->bkey->l);
+	ai_objClone(&sfk, qctx->new_ibtr ? begk : qctx->bkey);
 	ai_obj efk;
-	init_ai_objLong(&efk, endk);
+	ai_objClone(&efk, endk);
 	as_sindex_pmetadata *pimd = &imd->pimd[qctx->pimd_idx];
 	bool fullrng              = qctx->new_ibtr;
 	int ret                   = 0;
@@ -726,14 +773,23 @@ ai_btree_query(as_sindex_metadata *imd, as_sindex_range *srange, as_sindex_qctx
 		ai_obj afk;
 		init_ai_obj(&afk);
 		if (C_IS_DG(imd->sktype)) {
-			init_ai_objFromDigest(&afk, &srange->start.digest);
+			init_ai_objFromDigest(&afk, range_key(imd, &srange->start));
 		}
 		else {
 			init_ai_objLong(&afk, srange->start.u.i64);
 		}
 		err = get_recl(imd, &afk, qctx);
 	} else {                // RANGE LOOKUP
-		err = get_numeric_range_recl(imd, srange->start.u.i64, srange->end.u.i64, qctx);
+		ai_obj sfk, efk;
+		if (C_IS_DG(imd->sktype)) { // only ordered string keys get here
+			init_ai_objFromDigest(&sfk, &srange->start.ordered);
+			init_ai_objFromDigest(&efk, &srange->end.ordered);
+		}
+		else {
+			init_ai_objLong(&sfk, srange->start.u.i64);
+			init_ai_objLong(&efk, srange->end.u.i64);
+		}
+		err = get_range_recl(imd, &sfk, &efk, qctx);
 	}
 	return (err ? AS_SINDEX_ERR_NO_MEMORY :
 			(qctx->n_bdigs >= qctx->bsize) ? AS_SINDEX_CONTINUE : AS_SINDEX_OK);
@@ -1040,6 +1096,9 @@ ai_btree_defrag_list(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, cf_ll *
 				if (reduced_iRem(pimd->ibtr, acol, &apk) == AS_SINDEX_OK) {
 					success++;
 				}
+				if (imd->si->covering) {
+					as_sindex_covering_drop(imd->si, &(dt->acol_digs[i].dig));
+				}
 				after += pimd->ibtr->msize + pimd->ibtr->nsize;
 			}
 			dt->num -= 1;
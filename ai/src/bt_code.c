@@ -225,28 +225,48 @@ static inline int _log2(unsigned int a, int nbits) {
 }
 #endif
 
+/* Called with a > 0 on every step of every in-node search - the bit loop in
+ * real_log2() was the costliest part of the search. */
 static inline int _log2(unsigned int a, int nbits) {
-	return real_log2(a, nbits);
+	(void)nbits;
+	return (int)(sizeof(unsigned int) * 8) - 1 - __builtin_clz(a);
 }
 
-static int findkindex(bt *btr, bt_n *x, bt_data_t k, int *r, btIterator *iter) {
-    if (x->n == 0) return -1;
-    int b, tr;
-    int *rr = r ? r : &tr ; /* rr: key is greater than current entry */
+/* Body of findkindex(), inlined per key type so the common trees - long
+ * index keys and digest node keys - compare inline rather than calling
+ * through btr->cmp on every step. */
+static inline __attribute__((always_inline)) int
+findkindex_cmp(bt *btr, bt_n *x, bt_data_t k, int *rr, bt_cmp_t cmp) {
+    int b;
     int  i  = 0;
     int  a  = x->n - 1;
     while (a > 0) {
         b            = _log2(a, (int)btr->nbits);
         int slot     = (1 << b) + i;
         bt_data_t k2 = KEYS(btr, x, slot);
-        if ((*rr = btr->cmp(k, k2)) < 0) {
+        if ((*rr = cmp(k, k2)) < 0) {
             a        = (1 << b) - 1;
         } else {
             a       -= (1 << b);
             i       |= (1 << b);
         }
     }
-    if ((*rr = btr->cmp(k, KEYS(btr, x, i))) < 0)  i--;
+    if ((*rr = cmp(k, KEYS(btr, x, i))) < 0)  i--;
+    return i;
+}
+
+static int findkindex(bt *btr, bt_n *x, bt_data_t k, int *r, btIterator *iter) {
+    if (x->n == 0) return -1;
+    int tr;
+    int *rr = r ? r : &tr ; /* rr: key is greater than current entry */
+    int  i;
+    if (btr->cmp == llCmp) {
+        i = findkindex_cmp(btr, x, k, rr, llCmpInline);
+    } else if (btr->cmp == u160Cmp) {
+        i = findkindex_cmp(btr, x, k, rr, u160CmpInline);
+    } else {
+        i = findkindex_cmp(btr, x, k, rr, btr->cmp);
+    }
     if (iter) { iter->bln->in = iter->bln->ik = (i > 0) ? i : 0; }
     return i;
 }
@@ -38,30 +38,11 @@
 
 /* COMPARE COMPARE COMPARE COMPARE COMPARE COMPARE COMPARE COMPARE */
 int u160Cmp(void *s1, void *s2) {
-	char *p1 = (char *)s1;
-	char *p2 = (char *)s2;
-	uint128 x1, x2;
-	memcpy(&x1, p1 + 4, 16);
-	memcpy(&x2, p2 + 4, 16);
-	if (x1 == x2) {
-		uint32 u1;
-		memcpy(&u1, p1, 4);
-		uint32 u2;
-		memcpy(&u2, p2, 4);
-		return u1 == u2 ? 0 : (u1 > u2) ? 1 : -1;
-	} else return             (x1 > x2) ? 1 : -1;
-}
-
-static inline int LCmp(void *s1, void *s2) {
-	llk   *ll1 = (llk *)s1;
-	llk   *ll2 = (llk *)s2;
-	long   l1  = ll1->key;
-	long   l2  = ll2->key;
-	return l1 == l2 ? 0 : (l1 > l2) ? 1 : -1;
+	return u160CmpInline(s1, s2);
 }
 
 int llCmp(void *s1, void *s2) {
-	return LCmp(s1, s2);
+	return llCmpInline(s1, s2);
 }
 
 static inline int YCmp(void *s1, void *s2) {
@@ -69,7 +50,7 @@ static inline int YCmp(void *s1, void *s2) {
 	ylk     *yl2 = (ylk *)s2;
 	uint160  y1  = yl1->key;
 	uint160  y2  = yl2->key;
-	return u160Cmp(&y1, &y2);
+	return u160CmpInline(&y1, &y2);
 }
 int ylCmp(void *s1, void *s2) {
 	return YCmp(s1, s2);
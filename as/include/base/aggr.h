@@ -23,6 +23,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "aerospike/as_rec.h"
 #include "aerospike/as_result.h"
@@ -40,6 +41,7 @@ struct udf_record_s;
 
 typedef struct {
 	as_stream_status                    (* ostream_write) (void *, as_val *);
+	as_stream_status                    (* ostream_write_batch) (void *, as_val **, uint32_t); // optional - takes ownership of vals
 	void                                (* set_error)     (void *, int);
 	struct as_partition_reservation_s * (* ptn_reserve)   (void *, struct as_namespace_s *, uint32_t, struct as_partition_reservation_s *);
 	void                                (* ptn_release)   (void *, struct as_partition_reservation_s *);
@@ -51,4 +53,15 @@ typedef struct {
 	const as_aggr_hooks     * aggr_hooks;
 } as_aggr_call;
 
+#define AS_AGGR_MAX_LANES 16
+
+// One stream run, in its own Lua state, over part of a request's records.
+typedef struct {
+	cf_ll                     recl;
+	void                    * udata; // hooks' context - must be safe to use alongside other lanes'
+	as_result                 result;
+	int                       ret;
+} as_aggr_lane;
+
 int as_aggr_process(struct as_namespace_s *ns, as_aggr_call *ag_call, cf_ll *ap_recl, void *udata, as_result *ap_res);
+void as_aggr_process_lanes(struct as_namespace_s *ns, as_aggr_call *ag_call, as_aggr_lane *lanes, uint32_t n_lanes);
@@ -49,4 +49,18 @@
 #define ASD_QUERY_SENDPACKET_FINISHED(arg1)
 #define ASD_SINDEX_MSGRANGE_STARTING(arg1,arg2)
 #define ASD_SINDEX_MSGRANGE_FINISHED(arg1,arg2)
+#define ASD_TRANS_TSVC_STARTING(arg1,arg2,arg3)
+#define ASD_TRANS_READ_STARTING(arg1,arg2)
+#define ASD_TRANS_READ_FINISHED(arg1,arg2,arg3)
+#define ASD_TRANS_WRITE_STARTING(arg1,arg2)
+#define ASD_TRANS_WRITE_FINISHED(arg1,arg2,arg3)
+#define ASD_SSD_READ_STARTING(arg1,arg2,arg3)
+#define ASD_SSD_READ_FINISHED(arg1,arg2,arg3)
+#define ASD_SSD_FLUSH_STARTING(arg1,arg2,arg3)
+#define ASD_SSD_FLUSH_FINISHED(arg1,arg2,arg3)
+#define ASD_SSD_DEFRAG_WBLOCK(arg1,arg2,arg3)
+#define ASD_MIGRATE_RECORD_SEND(arg1,arg2,arg3)
+#define ASD_MIGRATE_RECORD_RECEIVE(arg1,arg2,arg3)
+#define ASD_NSUP_REDUCE_STARTING(arg1,arg2)
+#define ASD_NSUP_REDUCE_FINISHED(arg1,arg2,arg3)
 #endif
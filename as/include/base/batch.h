@@ -22,14 +22,25 @@
 
 #pragma once
 
+#include "base/predexp.h"
 #include "base/transaction.h"
 #include "dynbuf.h"
 
 typedef struct as_batch_shared_s as_batch_shared;
 
+// Batch sub-transactions on one partition, queued as a single transaction so
+// they share a partition reservation and storage can merge their reads.
+typedef struct as_batch_group_s {
+	struct as_namespace_s* ns;
+	uint32_t pid;
+	uint32_t n_trs;
+	as_transaction trs[];
+} as_batch_group;
+
 int as_batch_init();
 int as_batch_queue_task(as_transaction* tr);
 void as_batch_add_result(as_transaction* tr, uint16_t n_bins, as_bin** bins, as_msg_op** ops);
+void as_batch_add_made_result(as_transaction* tr, cf_dyn_buf* db);
 void as_batch_add_proxy_result(as_batch_shared* shared, uint32_t index, cf_digest* digest, cl_msg* cmsg, size_t size);
 void as_batch_add_error(as_batch_shared* shared, uint32_t index, int result_code);
 int as_batch_threads_resize(uint32_t threads);
@@ -38,3 +49,4 @@ int as_batch_unused_buffers();
 void as_batch_destroy();
 
 as_file_handle* as_batch_get_fd_h(as_batch_shared* shared);
+predexp_eval_t* as_batch_get_predexp(const as_batch_shared* shared);
@@ -0,0 +1,60 @@
+/*
+ * capture.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+/*
+ * Client traffic capture, for replay with tools/replay/asreplay. One in
+ * sample-rate client requests is appended to a trace file as it arrives, with
+ * its arrival time. Optionally, user keys are replaced by their digests.
+ *
+ * Trace file format (integers little-endian):
+ *   header:  char magic[8] "ASCAPT01", uint64_t start time (ms since epoch)
+ *   records: uint64_t offset (us since start), uint32_t size, then the proto
+ *            message as it was on the wire (uncompressed), header included
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "dynbuf.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_proto_s;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_capture_sample(const struct as_proto_s* proto, uint64_t now_ns);
+void as_capture_start(char* params, cf_dyn_buf* db);
+void as_capture_stop(cf_dyn_buf* db);
@@ -0,0 +1,85 @@
+/*
+ * cdc.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+/*
+ * Change data capture. On the master, each committed write or delete appends
+ * a compact change entry to its partition's ring. Consumers page through a
+ * ring with the "cdc" info command, resuming from the sequence number they
+ * were last given.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_namespace_s;
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	AS_CDC_OP_WRITE,
+	AS_CDC_OP_DELETE
+} as_cdc_op;
+
+typedef struct as_cdc_entry_s {
+	cf_digest	keyd;
+	uint16_t	generation; // 0 for deletes
+	uint8_t		op; // as_cdc_op
+	uint8_t		unused;
+	uint64_t	last_update_time; // for deletes, time of delete
+	uint64_t	seq;
+} as_cdc_entry;
+
+typedef struct as_cdc_ring_s {
+	pthread_mutex_t	lock;
+	uint64_t		next_seq;
+	as_cdc_entry*	entries; // cdc-ring-size entries
+} as_cdc_ring;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_cdc_init(struct as_namespace_s* ns);
+void as_cdc_write(struct as_namespace_s* ns, uint32_t pid, const cf_digest* keyd, uint16_t generation, uint64_t last_update_time, as_cdc_op op);
+void as_cdc_info(struct as_namespace_s* ns, uint32_t pid, uint64_t from, uint32_t max, cf_dyn_buf* db);
@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #include "aerospike/as_msgpack.h"
+#include "citrusleaf/cf_byte_order.h"
 
 #include "base/datamodel.h"
 #include "base/proto.h"
@@ -71,6 +72,7 @@ typedef struct cdt_modify_data_s {
 	as_bin *b;
 	as_bin *result;
 	cf_ll_buf *alloc_buf;
+	cf_ll_buf *result_alloc_buf; // NULL means results go on the heap
 
 	int ret_code;
 } cdt_modify_data;
@@ -140,6 +142,85 @@ calc_index(int64_t index, uint32_t max_index)
 {
 	return index < 0 ? (int64_t)max_index + index : index;
 }
+
+// Same as as_unpack_size(), but scalars - most elements - are skipped inline.
+static inline int64_t
+cdt_unpack_size(as_unpacker *pk)
+{
+	if (pk->offset >= pk->length) {
+		return -1;
+	}
+
+	const uint8_t *p = pk->buffer + pk->offset;
+	uint64_t left = (uint64_t)(pk->length - pk->offset);
+	uint8_t type = *p;
+	uint64_t sz;
+
+	if (type < 0x80 || type >= 0xe0) { // fixint
+		sz = 1;
+	}
+	else if ((type & 0xe0) == 0xa0) { // fixstr
+		sz = 1 + (type & 0x1f);
+	}
+	else {
+		switch (type) {
+		case 0xc0: // nil
+		case 0xc2: // false
+		case 0xc3: // true
+			sz = 1;
+			break;
+		case 0xcc: // uint8
+		case 0xd0: // int8
+			sz = 2;
+			break;
+		case 0xcd: // uint16
+		case 0xd1: // int16
+			sz = 3;
+			break;
+		case 0xca: // float
+		case 0xce: // uint32
+		case 0xd2: // int32
+			sz = 5;
+			break;
+		case 0xcb: // double
+		case 0xcf: // uint64
+		case 0xd3: // int64
+			sz = 9;
+			break;
+		case 0xc4: // bin8
+		case 0xd9: // str8
+			if (left < 2) {
+				return -1;
+			}
+			sz = 2 + (uint64_t)p[1];
+			break;
+		case 0xc5: // bin16
+		case 0xda: // str16
+			if (left < 3) {
+				return -1;
+			}
+			sz = 3 + (uint64_t)cf_swap_from_be16(*(const uint16_t *)(p + 1));
+			break;
+		case 0xc6: // bin32
+		case 0xdb: // str32
+			if (left < 5) {
+				return -1;
+			}
+			sz = 5 + (uint64_t)cf_swap_from_be32(*(const uint32_t *)(p + 1));
+			break;
+		default: // containers and extensions
+			return as_unpack_size(pk);
+		}
+	}
+
+	if (sz > left) {
+		return -1;
+	}
+
+	pk->offset += (int)sz;
+
+	return (int64_t)sz;
+}
 uint64_t calc_count(uint64_t index, uint64_t input_count, uint32_t max_index);
 void calc_index_count_multi(int64_t in_index, uint64_t in_count, uint32_t ele_count, uint32_t *out_index, uint32_t *out_count);
 bool calc_index_count(int64_t in_index, uint64_t in_count, uint32_t ele_count, uint32_t *out_index, uint32_t *out_count, bool is_multi);
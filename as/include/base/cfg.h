@@ -66,6 +66,7 @@ struct as_namespace_s;
 
 #define MAX_DEMARSHAL_THREADS 256
 #define MAX_BATCH_THREADS 256
+#define MAX_NSUP_THREADS 128
 #define MAX_TLS_SPECS 10
 
 // Declare bools with PAD_BOOL so they can't share a 4-byte space with other
@@ -95,14 +96,17 @@ typedef struct as_config_s {
 
 	// Normally hidden:
 
+	PAD_BOOL		accept_shards; // one SO_REUSEPORT listener per demarshal thread
 	// Note - advertise-ipv6 affects a cf_socket_ee.c global, so can't be here.
 	cf_topo_auto_pin auto_pin;
 	int				n_batch_threads;
 	uint32_t		batch_max_buffers_per_queue; // maximum number of buffers allowed in a buffer queue at any one time, fail batch if full
 	uint32_t		batch_max_requests; // maximum count of database requests in a single batch
+	uint32_t		batch_max_sub_in_flight; // maximum queued sub-transactions per batch, 0 means no limit
 	uint32_t		batch_max_unused_buffers; // maximum number of buffers allowed in buffer pool at any one time
 	uint32_t		batch_priority; // number of records between an enforced context switch, used by old batch only
 	uint32_t		n_batch_index_threads;
+	uint32_t		busy_poll_us; // SO_BUSY_POLL for client connections, 0 means off
 	int				clock_skew_max_ms; // maximum allowed skew between this node's physical clock and the physical component of its hybrid clock
 	char			cluster_name[AS_CLUSTER_NAME_SZ];
 	as_clustering_config clustering_config;
@@ -120,11 +124,14 @@ typedef struct as_config_s {
 	uint32_t		nsup_delete_sleep; // sleep this many microseconds between generating delete transactions, default 0
 	uint32_t		nsup_period;
 	PAD_BOOL		nsup_startup_evict;
+	uint32_t		n_nsup_threads;
+	PAD_BOOL		numa_partitions; // route transactions to the NUMA node owning their partition
 	int				proto_fd_idle_ms; // after this many milliseconds, connections are aborted unless transaction is in progress
 	int				proto_slow_netio_sleep_ms; // dynamic only
 	uint32_t		query_bsize;
 	uint64_t		query_buf_size; // dynamic only
 	uint32_t		query_bufpool_size;
+	uint32_t		query_cursor_ttl; // seconds a paginated query's cursor is held
 	PAD_BOOL		query_in_transaction_thr;
 	uint32_t		query_long_q_max_size;
 	PAD_BOOL		query_enable_histogram;
@@ -139,7 +146,9 @@ typedef struct as_config_s {
 	uint32_t		query_threshold;
 	uint64_t		query_untracked_time_ms;
 	uint32_t		query_worker_threads;
+	uint32_t		n_record_locks; // 0 means size automatically from CPU count
 	PAD_BOOL		run_as_daemon;
+	uint32_t		scan_aggr_parallelism; // concurrent Lua streams per aggregation scan partition
 	uint32_t		scan_max_active; // maximum number of active scans allowed
 	uint32_t		scan_max_done; // maximum number of finished scans kept for monitoring
 	uint32_t		scan_max_udf_transactions; // maximum number of active transactions per UDF background scan
@@ -152,6 +161,8 @@ typedef struct as_config_s {
 	uint64_t		transaction_max_ns;
 	uint32_t		transaction_pending_limit; // 0 means no limit
 	uint32_t		n_transaction_queues;
+	uint32_t		transaction_queue_batch_ratio; // regular transactions served per batch sub-transaction, 0 means batch shares the regular queues
+	bool			transaction_queue_stealing;
 	uint32_t		transaction_retry_ms;
 	uint32_t		n_transaction_threads_per_queue;
 	char*			work_directory;
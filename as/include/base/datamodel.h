@@ -39,6 +39,8 @@
 #include "citrusleaf/cf_digest.h"
 
 #include "arenax.h"
+#include "compression.h"
+#include "counter.h"
 #include "dynbuf.h"
 #include "hist.h"
 #include "hist_track.h"
@@ -49,7 +51,10 @@
 #include "vmapx.h"
 
 #include "base/cfg.h"
+#include "base/cdc.h"
+#include "base/hot_keys.h"
 #include "base/proto.h"
+#include "base/quota.h"
 #include "base/rec_props.h"
 #include "base/transaction_policy.h"
 #include "base/truncate.h"
@@ -143,6 +148,7 @@ typedef enum {
 	AS_PARTICLE_TYPE_RUBY_BLOB = 10,
 	AS_PARTICLE_TYPE_PHP_BLOB = 11,
 	AS_PARTICLE_TYPE_ERLANG_BLOB = 12,
+	AS_PARTICLE_TYPE_HLL = 18,
 	AS_PARTICLE_TYPE_MAP = 19,
 	AS_PARTICLE_TYPE_LIST = 20,
 	AS_PARTICLE_TYPE_GEOJSON = 23,
@@ -166,6 +172,8 @@ typedef struct as_particle_s {
 #define AS_BIN_STATE_RECYCLE_ME		2 // was - hidden bin
 #define AS_BIN_STATE_INUSE_OTHER	3
 #define AS_BIN_STATE_INUSE_FLOAT	4
+#define AS_BIN_STATE_INUSE_SHORT_STRING	5
+#define AS_BIN_STATE_INUSE_PACKED	6 // like OTHER, but particle is inside the as_bin_space block
 
 typedef struct as_particle_iparticle_s {
 	uint8_t		version: 4;		// now unused - and can't be used in single-bin config
@@ -173,6 +181,16 @@ typedef struct as_particle_iparticle_s {
 	uint8_t		data[];
 } __attribute__ ((__packed__)) as_particle_iparticle;
 
+// Strings this short are stored in the as_bin's particle pointer, when the
+// particle would otherwise be allocated (i.e. data-in-memory). Unused bytes
+// are zeroed, so equal values have equal "pointers".
+#define AS_SHORT_STRING_MAX_SZ 7
+
+typedef struct as_short_string_s {
+	uint8_t		sz;
+	uint8_t		data[AS_SHORT_STRING_MAX_SZ];
+} __attribute__ ((__packed__)) as_short_string;
+
 /* Particle function declarations */
 
 static inline bool
@@ -204,14 +222,15 @@ extern int as_bin_particle_stack_from_pickled(as_bin *b, cf_ll_buf *particles_ll
 extern int as_bin_particle_compare_from_pickled(const as_bin *b, uint8_t **p_pickled);
 extern uint32_t as_bin_particle_client_value_size(const as_bin *b);
 extern uint32_t as_bin_particle_to_client(const as_bin *b, as_msg_op *op);
+extern uint32_t as_bin_particle_client_value_ptr(const as_bin *b, const uint8_t **p_value);
 extern uint32_t as_bin_particle_pickled_size(const as_bin *b);
 extern uint32_t as_bin_particle_to_pickled(const as_bin *b, uint8_t *pickled);
 
 // Different for CDTs - the operations may return results, so we don't use the
 // normal APIs and particle table functions.
 extern int as_bin_cdt_read_from_client(const as_bin *b, as_msg_op *op, as_bin *result);
-extern int as_bin_cdt_alloc_modify_from_client(as_bin *b, as_msg_op *op, as_bin *result);
-extern int as_bin_cdt_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, as_msg_op *op, as_bin *result);
+extern int as_bin_cdt_alloc_modify_from_client(as_bin *b, as_msg_op *op, as_bin *result, cf_ll_buf *results_llb);
+extern int as_bin_cdt_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, as_msg_op *op, as_bin *result, cf_ll_buf *results_llb);
 
 // as_val:
 extern int as_bin_particle_replace_from_asval(as_bin *b, const as_val *val);
@@ -236,6 +255,16 @@ extern void as_bin_particle_integer_set(as_bin *b, int64_t i);
 // string:
 extern uint32_t as_bin_particle_string_ptr(const as_bin *b, char **p_value);
 
+// blob (and string):
+extern uint32_t as_bin_particle_blob_ptr(const as_bin *b, uint8_t **p_value);
+extern int as_bin_particle_append_in_place(as_bin *b, const as_msg_op *op, uint32_t *p_old_sz);
+extern void as_bin_particle_append_unwind(as_bin *b, uint32_t old_sz);
+
+// blob - like CDTs, bit operations don't use the normal APIs:
+extern int as_bin_bits_read_from_client(const as_bin *b, const as_msg_op *op, as_bin *result);
+extern int as_bin_bits_alloc_modify_from_client(as_bin *b, const as_msg_op *op, bool in_place);
+extern int as_bin_bits_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, const as_msg_op *op, bool in_place);
+
 // geojson:
 typedef void * geo_region_t;
 #define MAX_REGION_CELLS    32
@@ -245,14 +274,24 @@ extern bool as_particle_geojson_match(as_particle *p, uint64_t cellid, geo_regio
 extern bool as_particle_geojson_match_asval(const as_val *val, uint64_t cellid, geo_region_t region, bool is_strict);
 char const *as_geojson_mem_jsonstr(const as_particle *p, size_t *p_jsonsz);
 
+// hll - like CDTs, operations don't use the normal APIs:
+extern int as_bin_hll_alloc_modify_from_client(as_bin *b, const as_msg_op *op);
+extern int as_bin_hll_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, const as_msg_op *op);
+extern int as_bin_hll_read_from_client(const as_bin *b, const as_msg_op *op, as_bin *result);
+
 // list:
 struct cdt_payload_s;
 struct rollback_alloc_s;
 extern void as_bin_particle_list_get_packed_val(const as_bin *b, struct cdt_payload_s *packed);
 extern int as_bin_cdt_packed_read(const as_bin *b, as_msg_op *op, as_bin *result);
-extern int as_bin_cdt_packed_modify(as_bin *b, as_msg_op *op, as_bin *result, cf_ll_buf *particles_llb);
+extern int as_bin_cdt_packed_modify(as_bin *b, as_msg_op *op, as_bin *result, cf_ll_buf *particles_llb, cf_ll_buf *results_llb);
 extern as_particle *packed_list_simple_create_empty(struct rollback_alloc_s *alloc_buf);
 
+// map:
+extern uint32_t as_bin_particle_map_indexed_flat_size(const as_bin *b);
+extern uint32_t as_bin_particle_map_to_indexed_flat(const as_bin *b, uint8_t *flat);
+extern as_val *as_bin_particle_map_to_lazy_asval(const as_bin *b);
+
 
 /* as_bin
  * A bin container - null name means unused */
@@ -390,14 +429,26 @@ as_bin_set_all_empty(as_storage_rd *rd) {
 static inline bool
 as_bin_is_embedded_particle(const as_bin *b) {
 	return ((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_INTEGER ||
-			((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_FLOAT;
+			((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_FLOAT ||
+			((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_SHORT_STRING;
 }
 
+static inline bool
+as_bin_is_short_string(const as_bin *b) {
+	return ((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_SHORT_STRING;
+}
+
+// Only external particles are destroyed individually.
 static inline bool
 as_bin_is_external_particle(const as_bin *b) {
 	return ((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_OTHER;
 }
 
+static inline bool
+as_bin_is_packed_particle(const as_bin *b) {
+	return ((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_PACKED;
+}
+
 static inline as_particle *
 as_bin_get_particle(as_bin *b) {
 	return as_bin_is_embedded_particle(b) ? &b->iparticle : b->particle;
@@ -412,7 +463,10 @@ as_bin_get_particle_type(const as_bin *b) {
 			return AS_PARTICLE_TYPE_INTEGER;
 		case AS_BIN_STATE_INUSE_FLOAT:
 			return AS_PARTICLE_TYPE_FLOAT;
+		case AS_BIN_STATE_INUSE_SHORT_STRING:
+			return AS_PARTICLE_TYPE_STRING;
 		case AS_BIN_STATE_INUSE_OTHER:
+		case AS_BIN_STATE_INUSE_PACKED:
 			return b->particle->metadata;
 		default:
 			return AS_PARTICLE_TYPE_NULL;
@@ -430,6 +484,7 @@ extern void as_bin_init(as_namespace *ns, as_bin *b, const char *name);
 extern void as_bin_copy(as_namespace *ns, as_bin *to, const as_bin *from);
 extern int as_storage_rd_load_n_bins(as_storage_rd *rd);
 extern int as_storage_rd_load_bins(as_storage_rd *rd, as_bin *stack_bins);
+extern int as_storage_rd_load_bins_named(as_storage_rd *rd, as_bin *stack_bins, cf_vector *bin_names);
 extern uint16_t as_bin_inuse_count(as_storage_rd *rd);
 extern void as_bin_get_all_p(as_storage_rd *rd, as_bin **bin_ptrs);
 extern as_bin *as_bin_get_by_id(as_storage_rd *rd, uint32_t id);
@@ -443,6 +498,7 @@ extern int32_t as_bin_get_index(as_storage_rd *rd, const char *name);
 extern int32_t as_bin_get_index_from_buf(as_storage_rd *rd, const uint8_t *name, size_t len);
 extern void as_bin_destroy(as_storage_rd *rd, uint16_t i);
 extern void as_bin_allocate_bin_space(as_storage_rd *rd, int32_t delta);
+extern as_bin_space *as_bin_space_pack(as_bin *bins, uint16_t n_bins);
 
 
 typedef enum {
@@ -559,6 +615,14 @@ typedef struct as_index_tree_shared_s {
 
 	// Offset into as_index_tree struct's variable-sized data.
 	uint32_t		sprigs_offset;
+
+	// Keep a digest hash per sprig so point lookups skip the tree walk.
+	bool			hash_index;
+
+	// Sets whose records every tree also lists, so set scans and truncates
+	// skip the tree walk - a bit per set-ID, none unless configured.
+	bool			set_lists;
+	uint64_t		listed_sets[(AS_SET_MAX_COUNT + 1) / 64];
 } as_index_tree_shared;
 
 
@@ -594,9 +658,23 @@ struct as_namespace_s {
 	as_set*			sets_cfg_array;
 	uint32_t		sets_cfg_count;
 
+	// Parallel to sets_cfg_array - compression dictionary file paths.
+	char**			sets_cfg_dict_files;
+
+	// Loaded compression dictionaries, indexed by set-id.
+	cf_compression_dict* compression_dicts[AS_SET_MAX_COUNT + 1];
+
 	// Configuration flags relevant for warm restart.
 	uint32_t		xmem_flags;
 
+	// Index arena stage placement.
+	bool			index_huge_pages;
+	bool			index_numa_interleave;
+
+	// Community edition warm restart - index snapshot written on shutdown.
+	char*			index_snapshot_file;
+	uint64_t		index_snapshot_random; // device signature at snapshot time
+
 	//--------------------------------------------
 	// Cold-start.
 	//
@@ -612,6 +690,7 @@ struct as_namespace_s {
 	uint32_t		cold_start_record_add_count;
 	cf_atomic32		cold_start_threshold_void_time;
 	uint32_t		cold_start_max_void_time;
+	linear_hist*	cold_start_evict_hist; // void-times of records loaded so far
 
 	//--------------------------------------------
 	// Memory management.
@@ -636,6 +715,7 @@ struct as_namespace_s {
 	uint64_t		ssd_size; // discovered (and rounded) size of drive
 	int				storage_last_avail_pct; // most recently calculated available percent
 	int				storage_max_write_q; // storage_max_write_cache is converted to this
+	int				storage_shadow_max_write_q; // storage_shadow_max_write_cache is converted to this
 	uint32_t		saved_defrag_sleep; // restore after defrag at startup is done
 	uint32_t		defrag_lwm_size; // storage_defrag_lwm_pct % of storage_write_block_size
 
@@ -644,12 +724,39 @@ struct as_namespace_s {
 	cf_atomic32		n_reads_from_cache;
 	cf_atomic32		n_reads_from_device;
 
+	// Blocks whose checksum didn't match, on read, cold start or verify.
+	cf_atomic64		n_device_checksum_errors;
+
+	// For data-not-in-memory, we optionally cache records read from device.
+	cf_atomic64		read_cache_used_bytes;
+
+	// For data-not-in-memory, we optionally keep hot records attached to index.
+	cf_atomic64		hot_tier_used_bytes;
+
 	//--------------------------------------------
 	// Truncate records.
 	//
 
 	as_truncate		truncate;
 
+	//--------------------------------------------
+	// Hot key sampling.
+	//
+
+	as_hot_keys		hot_keys;
+
+	//--------------------------------------------
+	// Throughput quotas.
+	//
+
+	as_quota		quota; // quota-ops-per-sec & quota-bytes-per-sec
+
+	//--------------------------------------------
+	// Change data capture.
+	//
+
+	as_cdc_ring*	cdc_rings; // per partition - NULL if cdc-ring-size is 0
+
 	//--------------------------------------------
 	// Secondary index.
 	//
@@ -660,6 +767,7 @@ struct as_namespace_s {
 	cf_shash*		sindex_set_binid_hash;
 	cf_shash*		sindex_iname_hash;
 	uint32_t		binid_has_sindex[AS_BINID_HAS_SINDEX_SIZE];
+	cf_atomic64		n_sindex_gc_pending; // records destroyed since last sindex gc
 
 	//--------------------------------------------
 	// Configuration.
@@ -676,8 +784,10 @@ struct as_namespace_s {
 	PAD_BOOL		ns_allow_nonxdr_writes; // namespace-level flag to allow nonxdr writes or not
 	PAD_BOOL		ns_allow_xdr_writes; // namespace-level flag to allow xdr writes or not
 
+	uint32_t		cdc_ring_size; // change entries per partition - 0 means disabled
 	uint32_t		cold_start_evict_ttl;
 	conflict_resolution_pol conflict_resolution_policy;
+	PAD_BOOL		contiguous_records; // data-in-memory records kept in one allocation
 	PAD_BOOL		data_in_index; // with single-bin, allows warm restart for data-in-memory (with storage-engine device)
 	PAD_BOOL		disallow_null_setname;
 	PAD_BOOL		batch_sub_benchmarks_enabled;
@@ -687,20 +797,26 @@ struct as_namespace_s {
 	PAD_BOOL		write_benchmarks_enabled;
 	PAD_BOOL		proxy_hist_enabled;
 	uint32_t		evict_hist_buckets;
+	PAD_BOOL		evict_lru; // evict records not accessed since last eviction
 	uint32_t		evict_tenths_pct;
 	uint32_t		hwm_disk_pct;
 	uint32_t		hwm_memory_pct;
+	uint32_t		hot_key_sample_rate; // 1 in N transactions - 0 means disabled
 	uint64_t		max_ttl;
 	uint32_t		migrate_order;
 	uint32_t		migrate_retransmit_ms;
 	uint32_t		migrate_sleep;
+	uint32_t		migrate_target_latency_ms; // 0 means static migrate-sleep only
 	cf_atomic32		obj_size_hist_max; // TODO - doesn't need to be atomic, really.
 	uint32_t		rack_id;
+	PAD_BOOL		rack_local_reads; // reads may go to an in-sync replica in our rack
 	as_read_consistency_level read_consistency_level;
+	uint32_t		response_compression_threshold; // 0 means never compress
 	PAD_BOOL		single_bin; // restrict the namespace to objects with exactly one bin
 	uint32_t		stop_writes_pct;
 	uint32_t		tomb_raider_eligible_age; // relevant only for enterprise edition
 	uint32_t		tomb_raider_period; // relevant only for enterprise edition
+	uint32_t		truncate_delete_sleep; // microseconds per deleted record
 	as_write_commit_level write_commit_level;
 	cf_vector		xdr_dclist_v;
 
@@ -715,6 +831,11 @@ struct as_namespace_s {
 	PAD_BOOL		storage_data_in_memory;
 
 	PAD_BOOL		storage_cold_start_empty;
+	uint32_t		storage_cold_start_threads; // 0 means one per device
+	PAD_BOOL		storage_commit_to_device; // writes don't return until on device
+	cf_compression_method storage_compression;
+	uint32_t		storage_compression_level; // 0 means codec's default
+	PAD_BOOL		storage_defrag_adaptive; // defrag-sleep is then only the baseline pace
 	uint32_t		storage_defrag_lwm_pct;
 	uint32_t		storage_defrag_queue_min;
 	uint32_t		storage_defrag_sleep;
@@ -724,13 +845,23 @@ struct as_namespace_s {
 	PAD_BOOL		storage_enable_osync;
 	uint64_t		storage_flush_max_us;
 	uint64_t		storage_fsync_max_us;
+	uint32_t		storage_hot_record_age; // seconds, 0 means don't separate hot records
+	uint64_t		storage_hot_tier_size; // 0 means no hot tier
+	uint32_t		storage_io_uring_depth; // 0 means synchronous device writes
 	uint64_t		storage_max_write_cache;
 	uint32_t		storage_min_avail_pct;
+	PAD_BOOL		storage_persist_map_index; // ordered maps keep indexes on device
+	PAD_BOOL		storage_persistent_memory; // devices are mapped - data copied in and out, no block I/O
 	cf_atomic32 	storage_post_write_queue; // number of swbs/device held after writing to device
+	uint64_t		storage_read_cache_size; // 0 means no read cache
+	uint64_t		storage_shadow_max_write_cache; // wblocks written to device but not yet to shadow
 	uint32_t		storage_tomb_raider_sleep; // relevant only for enterprise edition
+	uint32_t		storage_write_shards; // open swbs (and locks) per device for writes
 	uint32_t		storage_write_threads;
+	PAD_BOOL		storage_zoned; // devices are zoned - forces one write thread
 
 	uint32_t		sindex_num_partitions;
+	PAD_BOOL		sindex_deferred_updates; // writes queue sindex ops for workers
 
 	PAD_BOOL		geo2dsphere_within_strict;
 	uint16_t		geo2dsphere_within_min_level;
@@ -792,6 +923,12 @@ struct as_namespace_s {
 	cf_atomic_int	migrate_record_retransmits;
 	cf_atomic_int	migrate_record_receives;
 
+	// Adaptive migration pacing (see migrate-target-latency-ms):
+	uint64_t		migrate_pace_check_ms;
+	uint64_t		migrate_pace_n_over;
+	uint64_t		migrate_pace_n_total;
+	cf_atomic32		migrate_pace_sleep; // extra usec per record
+
 	// From-client transaction stats.
 
 	cf_atomic64		n_client_tsvc_error;
@@ -801,14 +938,18 @@ struct as_namespace_s {
 	cf_atomic64		n_client_proxy_error;
 	cf_atomic64		n_client_proxy_timeout;
 
-	cf_atomic64		n_client_read_success;
-	cf_atomic64		n_client_read_error;
-	cf_atomic64		n_client_read_timeout;
-	cf_atomic64		n_client_read_not_found;
+	// Hottest counters are sharded - read via cf_counter_get().
+	cf_counter		n_client_read_success;
+	cf_counter		n_client_read_error;
+	cf_counter		n_client_read_timeout;
+	cf_counter		n_client_read_not_found;
+	cf_atomic64		n_client_read_prole; // subset of all the above - served by a prole
+	cf_atomic64		n_client_proxy_read_rack_local;
+	cf_atomic64		n_client_proxy_read_off_rack;
 
-	cf_atomic64		n_client_write_success;
-	cf_atomic64		n_client_write_error;
-	cf_atomic64		n_client_write_timeout;
+	cf_counter		n_client_write_success;
+	cf_counter		n_client_write_error;
+	cf_counter		n_client_write_timeout;
 
 	// Subset of n_client_write_... above, respectively.
 	cf_atomic64		n_xdr_write_success;
@@ -842,6 +983,20 @@ struct as_namespace_s {
 	cf_atomic64		n_batch_sub_read_error;
 	cf_atomic64		n_batch_sub_read_timeout;
 	cf_atomic64		n_batch_sub_read_not_found;
+	cf_atomic64		n_batch_sub_read_filtered_out;
+
+	cf_atomic64		n_batch_sub_write_success;
+	cf_atomic64		n_batch_sub_write_error;
+	cf_atomic64		n_batch_sub_write_timeout;
+
+	cf_atomic64		n_batch_sub_delete_success;
+	cf_atomic64		n_batch_sub_delete_error;
+	cf_atomic64		n_batch_sub_delete_timeout;
+	cf_atomic64		n_batch_sub_delete_not_found;
+
+	cf_atomic64		n_batch_sub_udf_complete;
+	cf_atomic64		n_batch_sub_udf_error;
+	cf_atomic64		n_batch_sub_udf_timeout;
 
 	// Internal-UDF sub-transaction stats.
 
@@ -891,6 +1046,14 @@ struct as_namespace_s {
 	cf_atomic64		n_scan_udf_bg_error;
 	cf_atomic64		n_scan_udf_bg_abort;
 
+	cf_atomic64		n_scan_count_complete;
+	cf_atomic64		n_scan_count_error;
+	cf_atomic64		n_scan_count_abort;
+
+	cf_atomic64		n_scan_delete_complete;
+	cf_atomic64		n_scan_delete_error;
+	cf_atomic64		n_scan_delete_abort;
+
 	// Query stats.
 
 	cf_atomic64		query_reqs;
@@ -926,7 +1089,7 @@ struct as_namespace_s {
 	// Special errors that deserve their own counters:
 
 	cf_atomic64		n_fail_xdr_forbidden;
-	cf_atomic64		n_fail_key_busy;
+	cf_counter		n_fail_key_busy;
 	cf_atomic64		n_fail_generation;
 	cf_atomic64		n_fail_record_too_big;
 
@@ -941,12 +1104,14 @@ struct as_namespace_s {
 	cf_hist_track*	udf_hist;
 	cf_hist_track*	query_hist;
 	histogram*		query_rec_count_hist;
+	histogram*		response_compression_hist; // compressed size, % of original
 
 	PAD_BOOL		read_hist_active;
 	PAD_BOOL		write_hist_active;
 	PAD_BOOL		udf_hist_active;
 	PAD_BOOL		query_hist_active;
 	PAD_BOOL		query_rec_count_hist_active;
+	PAD_BOOL		response_compression_hist_active;
 
 	// Activate-by-config histograms.
 
@@ -1035,10 +1200,12 @@ struct as_set_s {
 	cf_atomic64		n_bytes_memory;		// for data-in-memory only - sets's total record data size
 	cf_atomic64		stop_writes_count;	// restrict number of records in a set
 	uint64_t		truncate_lut;		// records with last-update-time less than this are truncated
+	as_quota		quota;				// set-quota-ops-per-sec & set-quota-bytes-per-sec
 	cf_atomic32		disable_eviction;	// don't evict anything in this set (note - expiration still works)
 	cf_atomic32		enable_xdr;			// white-list (AS_SET_ENABLE_XDR_TRUE) or black-list (AS_SET_ENABLE_XDR_FALSE) a set for XDR replication
 	uint32_t		n_sindexes;
-	uint8_t padding[12];
+	uint8_t			enable_index;		// keep a per-partition list of the set's records
+	uint8_t padding[19];
 };
 
 static inline bool
@@ -0,0 +1,82 @@
+/*
+ * hot_keys.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Sampled heavy-hitter tracking per namespace. One in hot-key-sample-rate
+ * single-record transactions feeds a small Space-Saving sketch of digests, and
+ * per-set counters. Reported through the "hot-keys" info command and ticker.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_namespace_s;
+struct as_transaction_s;
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define AS_HOT_KEYS_CAPACITY 32
+
+typedef struct as_hot_key_s {
+	cf_digest	keyd;
+	uint16_t	set_id;
+	uint64_t	count;
+	uint64_t	error; // Space-Saving overestimate inherited from evicted key
+	uint64_t	bytes;
+} as_hot_key;
+
+typedef struct as_hot_keys_s {
+	pthread_mutex_t	lock;
+	uint64_t		start_ms;
+	uint32_t		n_keys;
+	as_hot_key		keys[AS_HOT_KEYS_CAPACITY];
+	uint64_t		set_counts[1024]; // AS_SET_MAX_COUNT + 1 - set-id 0 is no set
+} as_hot_keys;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_hot_keys_init(as_hot_keys* hk);
+void as_hot_keys_sample(struct as_namespace_s* ns, const struct as_transaction_s* tr);
+void as_hot_keys_info(struct as_namespace_s* ns, cf_dyn_buf* db);
+void as_hot_keys_ticker(struct as_namespace_s* ns);
@@ -84,7 +84,7 @@ typedef struct as_index_s {
 	// an as_bin, but only 4 bits get used (for the iparticle state). The other
 	// 4 bits are used for replication state and index flags.
 	uint8_t repl_state: 2;
-	uint8_t unused_flag: 1;
+	uint8_t accessed: 1; // set by transactions, cleared by evict-lru nsup
 	uint8_t key_stored: 1;
 	uint8_t single_bin_state: 4; // used indirectly, only in single-bin mode
 
@@ -251,6 +251,9 @@ typedef struct as_index_tree_s {
 	// later use multiple arenas per namespace.
 	cf_arenax				*arena;
 
+	// Records of listed sets - NULL unless the namespace lists any sets.
+	struct as_index_set_list_s	*set_list;
+
 	// Variable length data, dependent on configuration.
 	uint8_t					data[];
 } as_index_tree;
@@ -262,13 +265,19 @@ typedef struct as_index_tree_s {
 
 typedef struct as_lock_pair_s {
 	// Note: reduce_lock's scope is always inside of lock's scope.
-	pthread_mutex_t	lock;        // insert, delete vs. insert, delete, get
+	pthread_rwlock_t lock;       // insert, delete (write) vs. get (read)
 	pthread_mutex_t	reduce_lock; // insert, delete vs. reduce
 } as_lock_pair;
 
 typedef struct as_sprig_s {
 	cf_arenax_handle	root_h;
 	uint64_t			n_elements;
+
+	// Optional open-addressing hash over the tree's elements, for point
+	// lookups - NULL unless the namespace configures partition-tree-hash.
+	uint64_t			*hash_slots;
+	uint32_t			hash_mask;
+	uint32_t			hash_n_used;
 } as_sprig;
 
 static inline as_lock_pair *
@@ -290,6 +299,7 @@ tree_sprigs(as_index_tree *tree)
 
 void as_index_tree_gc_init();
 int as_index_tree_gc_queue_size();
+uint64_t as_index_tree_gc_backlog();
 
 as_index_tree *as_index_tree_create(as_index_tree_shared *shared, cf_arenax *arena);
 as_index_tree *as_index_tree_resume(as_index_tree_shared *shared, cf_arenax *arena, as_treex *treex);
@@ -301,14 +311,27 @@ typedef void (*as_index_reduce_fn) (as_index_ref *value, void *udata);
 
 void as_index_reduce(as_index_tree *tree, as_index_reduce_fn cb, void *udata);
 void as_index_reduce_partial(as_index_tree *tree, uint64_t sample_count, as_index_reduce_fn cb, void *udata);
+void as_index_reduce_range(as_index_tree *tree, const cf_digest *high, const cf_digest *low, as_index_reduce_fn cb, void *udata);
 
 void as_index_reduce_live(as_index_tree *tree, as_index_reduce_fn cb, void *udata);
 void as_index_reduce_partial_live(as_index_tree *tree, uint64_t sample_count, as_index_reduce_fn cb, void *udata);
+void as_index_reduce_range_live(as_index_tree *tree, const cf_digest *high, const cf_digest *low, as_index_reduce_fn cb, void *udata);
 
 int as_index_exists(as_index_tree *tree, cf_digest *keyd);
 int as_index_get_vlock(as_index_tree *tree, cf_digest *keyd, as_index_ref *index_ref);
 int as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd, as_index_ref *index_ref);
 int as_index_delete(as_index_tree *tree, cf_digest *keyd);
+bool as_index_relocate(as_index_tree *tree, const cf_digest *keyd, cf_arenax_handle r_h);
+
+void as_index_set_list_add(as_index_tree *tree, const as_index_ref *r_ref);
+bool as_index_reduce_set(as_index_tree *tree, uint16_t set_id, as_index_reduce_fn cb, void *udata);
+bool as_index_reduce_set_live(as_index_tree *tree, uint16_t set_id, as_index_reduce_fn cb, void *udata);
+
+static inline bool
+as_index_set_is_listed(const as_index_tree_shared *shared, uint16_t set_id)
+{
+	return (shared->listed_sets[set_id >> 6] & (1UL << (set_id & 63))) != 0;
+}
 
 #define as_index_reserve(_r) cf_atomic32_incr(&(_r->rc))
 #define as_index_release(_r) cf_atomic32_decr(&(_r->rc))
@@ -327,6 +350,8 @@ typedef struct as_index_sprig_s {
 
 	as_lock_pair	*pair;
 	as_sprig		*sprig;
+
+	struct as_index_set_list_s *set_list;
 } as_index_sprig;
 
 #define SENTINEL_H 0
@@ -335,3 +360,6 @@ typedef struct as_index_sprig_s {
 
 // Flag to indicate full index reduce.
 #define AS_REDUCE_ALL (-1L)
+
+void as_index_sprig_hash_insert(as_index_sprig *isprig, const cf_digest *keyd, cf_arenax_handle r_h);
+void as_index_set_list_insert(struct as_index_set_list_s *list, as_index *r, cf_arenax_handle r_h);
@@ -70,17 +70,23 @@ typedef void (*as_job_slice_fn)(struct as_job_s* _job, struct as_partition_reser
 typedef void (*as_job_finish_fn)(struct as_job_s* _job);
 typedef void (*as_job_destroy_fn)(struct as_job_s* _job);
 typedef void (*as_job_info_fn)(struct as_job_s* _job, struct as_mon_jobstat_s* stat);
+typedef void (*as_job_indexed_slice_fn)(struct as_job_s* _job, uint32_t slice_ix);
+typedef bool (*as_job_busy_fn)(struct as_job_s* _job);
 
 typedef struct as_job_vtable_s {
-	as_job_slice_fn		slice_fn;
-	as_job_finish_fn	finish_fn;
-	as_job_destroy_fn	destroy_fn;
-	as_job_info_fn		info_mon_fn;
+	as_job_slice_fn			slice_fn;
+	as_job_finish_fn		finish_fn;
+	as_job_destroy_fn		destroy_fn;
+	as_job_info_fn			info_mon_fn;
+	as_job_indexed_slice_fn	indexed_slice_fn; // only needed for RSV_DEVICE and RSV_LISTED
+	as_job_busy_fn			busy_fn; // optional - next slice is parked while busy
 } as_job_vtable;
 
 typedef enum {
 	RSV_WRITE	= 0,
-	RSV_MIGRATE	= 1
+	RSV_MIGRATE	= 1,
+	RSV_DEVICE	= 2, // slices are storage devices - job reserves partitions
+	RSV_LISTED	= 3 // slices are listed by the job - job reserves partitions
 } as_job_rsv_type;
 
 // Same as cf_queue_priority scheme, so no internal conversion needed:
@@ -120,8 +126,15 @@ typedef struct as_job_s {
 	pthread_mutex_t				requeue_lock;
 	int							priority;
 	cf_atomic32					active_rc;
-	volatile int				next_pid;
+	volatile int				next_pid; // or next slice index, for indexed slices
+	uint32_t					n_listed; // number of RSV_LISTED slices
 	volatile int				abandoned;
+	bool						parked; // next slice waits for as_job_resume()
+
+	// Budget - token bucket shared by all the job's slices:
+	pthread_mutex_t				throttle_lock;
+	volatile uint32_t			rps; // 0 means unthrottled
+	uint64_t					throttle_due_us;
 
 	// For tracking:
 	uint64_t					start_ms;
@@ -139,6 +152,9 @@ void as_job_destroy(as_job* _job);
 void as_job_info(as_job* _job, struct as_mon_jobstat_s* stat);
 void as_job_active_reserve(as_job* _job);
 void as_job_active_release(as_job* _job);
+void as_job_resume(as_job* _job);
+void as_job_set_rps(as_job* _job, uint32_t rps);
+void as_job_throttle(as_job* _job);
 
 //----------------------------------------------------------
 // as_job_manager - class header.
@@ -163,6 +179,7 @@ void as_job_manager_abandon_job(as_job_manager* mgr, as_job* _job, int reason);
 bool as_job_manager_abort_job(as_job_manager* mgr, uint64_t trid);
 int as_job_manager_abort_all_jobs(as_job_manager* mgr);
 bool as_job_manager_change_job_priority(as_job_manager* mgr, uint64_t trid, int priority);
+bool as_job_manager_change_job_rps(as_job_manager* mgr, uint64_t trid, uint32_t rps);
 void as_job_manager_limit_active_jobs(as_job_manager* mgr, uint32_t max_active);
 void as_job_manager_limit_finished_jobs(as_job_manager* mgr, uint32_t max_done);
 void as_job_manager_resize_thread_pool(as_job_manager* mgr, uint32_t n_threads);
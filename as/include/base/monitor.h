@@ -60,6 +60,7 @@ typedef struct as_mon_jobstat_s {
 	char		ns[AS_ID_NAMESPACE_SZ];
 	char		set[AS_SET_NAME_MAX_SIZE];
 	uint32_t	priority;
+	uint32_t	rps; // 0 means unthrottled
 	char		status[64];
 	float		progress_pct;
 	uint64_t	run_time;
@@ -76,6 +77,7 @@ typedef struct as_mon_cb_s {
 
 	// Per transaction
 	int (*set_priority)	(uint64_t trid, uint32_t priority);
+	int (*set_rps)		(uint64_t trid, uint32_t rps);
 	int (*kill)			(uint64_t trid);
 	int (*suspend)		(uint64_t trid);
 
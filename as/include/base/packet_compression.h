@@ -22,12 +22,26 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+struct as_file_handle_s;
+struct as_namespace_s;
+
 typedef enum compression_type_e {
-	COMPRESSION_ZLIB = 1
+	COMPRESSION_NONE = 0,
+	COMPRESSION_ZLIB = 1,
+	COMPRESSION_LZ4 = 2,
+	COMPRESSION_ZSTD = 3
 } compression_type;
 
+/**
+ * Get the compression type of a proto message type.
+ * @return COMPRESSION_NONE if the message type isn't compressed
+ */
+compression_type
+as_packet_compression_type(uint8_t proto_type);
+
 /**
  * Function to decompress the given data
  * Expected arguments
@@ -79,3 +93,19 @@ as_compress(int argc, uint8_t *argv[]);
  */
 int
 as_packet_compression(uint8_t *buf, size_t buf_sz, uint8_t **compressed_packet, size_t *compressed_packet_sz);
+
+/*
+ * Function to compress a whole response packet (as_proto header included) for
+ * a client connection which sent compressed requests, using the same type of
+ * compression. Only packets of at least the namespace's threshold are
+ * compressed, and only if that makes them smaller.
+ * Input : fd_h - Client connection. - Input
+ *     ns - Namespace for threshold and statistics, may be NULL. - Input
+ *     packet - Pointer to packet to be compressed. - Input
+ *     packet_sz - Size of packet to be compressed. - Input
+ *     compressed_packet_sz : Size of the compressed packet. - Output
+ * Returns the compressed packet, which caller must free, or NULL if the
+ * original packet should be sent.
+ */
+uint8_t *
+as_packet_compress_response(const struct as_file_handle_s *fd_h, struct as_namespace_s *ns, const uint8_t *packet, size_t packet_sz, size_t *compressed_packet_sz);
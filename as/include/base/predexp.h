@@ -39,17 +39,26 @@ typedef struct predexp_var_s as_predexp_var_t;
 // Arguments to predicate expressions
 typedef struct predexp_args_s {
 	as_namespace*		ns;		// always present
-	as_record*			md;		// always present
+	as_record*			md;		// NULL during digest phase
 	as_predexp_var_t*	vl;		// always present
-	as_storage_rd*		rd;		// NULL during metadata phase
+	as_storage_rd*		rd;		// NULL during metadata and digest phases
+	const cf_digest*	keyd;	// only used during digest phase
 } predexp_args_t;
 
 extern predexp_eval_t* predexp_build(as_msg_field* pfp);
 
+// Called with only a digest - before the record is even looked up.
+extern bool predexp_matches_digest(predexp_eval_t* eval, as_namespace* ns,
+								   const cf_digest* keyd);
+
 // Called with NULL rd
 extern bool predexp_matches_metadata(predexp_eval_t* eval,
 									 predexp_args_t* argsp);
 
+// False if the metadata phase decides every record - the record phase can
+// then be skipped.
+extern bool predexp_needs_record(predexp_eval_t* eval);
+
 // Called with both ndx and rd.
 extern bool predexp_matches_record(predexp_eval_t* eval,
 								   predexp_args_t* argsp);
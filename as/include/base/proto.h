@@ -30,6 +30,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "aerospike/as_val.h"
 #include "citrusleaf/cf_digest.h"
@@ -75,6 +76,7 @@ struct as_transaction_s;
 #define AS_PROTO_RESULT_FAIL_ELEMENT_NOT_FOUND		23
 #define AS_PROTO_RESULT_FAIL_ELEMENT_EXISTS			24
 #define AS_PROTO_RESULT_FAIL_ENTERPRISE_ONLY		25	// attempting enterprise functionality on community build
+#define AS_PROTO_RESULT_FAIL_FILTERED_OUT			27	// batch row's record didn't match the predicate expression
 
 // Security result codes. Must be <= 255, to fit in one byte. Defined here to
 // ensure no overlap with other result codes.
@@ -100,6 +102,8 @@ struct as_transaction_s;
 	// Permission errors.
 #define AS_SEC_ERR_NOT_AUTHENTICATED	80	// socket not authenticated
 #define AS_SEC_ERR_ROLE_VIOLATION		81	// role (privilege) violation
+	// Quota errors.
+#define AS_PROTO_RESULT_FAIL_QUOTA_EXCEEDED	83	// namespace or set throughput quota exceeded
 
 // UDF Errors (100 - 109)
 #define AS_PROTO_RESULT_FAIL_UDF_EXECUTION     100
@@ -151,9 +155,11 @@ struct as_transaction_s;
 #define PROTO_TYPE_INFO					1 // ascii-format message for determining server info
 #define PROTO_TYPE_SECURITY				2
 #define PROTO_TYPE_AS_MSG				3
-#define PROTO_TYPE_AS_MSG_COMPRESSED	4
+#define PROTO_TYPE_AS_MSG_COMPRESSED	4 // zlib
 #define PROTO_TYPE_INTERNAL_XDR			5
-#define PROTO_TYPE_MAX					6 // if you see 6, it's illegal
+#define PROTO_TYPE_AS_MSG_COMPRESSED_LZ4	6
+#define PROTO_TYPE_AS_MSG_COMPRESSED_ZSTD	7
+#define PROTO_TYPE_MAX					8 // if you see 8, it's illegal
 
 #define PROTO_SIZE_MAX (128 * 1024 * 1024) // used simply for validation, as we've been corrupting msgp's
 
@@ -192,9 +198,14 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_TYPE_TRID					7
 #define AS_MSG_FIELD_TYPE_SCAN_OPTIONS			8
 #define AS_MSG_FIELD_TYPE_SOCKET_TIMEOUT		9
+#define AS_MSG_FIELD_TYPE_SCAN_PARTITIONS		11
+#define AS_MSG_FIELD_TYPE_SCAN_SAMPLE_COUNT		12
+#define AS_MSG_FIELD_TYPE_SCAN_COUNT			13
 
 #define AS_MSG_FIELD_TYPE_INDEX_NAME			21
 #define	AS_MSG_FIELD_TYPE_INDEX_RANGE			22
+#define AS_MSG_FIELD_TYPE_QUERY_MAX_RECORDS		23
+#define AS_MSG_FIELD_TYPE_QUERY_CURSOR			24
 #define AS_MSG_FIELD_TYPE_INDEX_TYPE			26
 
 // UDF RANGE: 30-39
@@ -207,6 +218,7 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_TYPE_BATCH					41
 #define AS_MSG_FIELD_TYPE_BATCH_WITH_SET		42
 #define AS_MSG_FIELD_TYPE_PREDEXP				43
+#define AS_MSG_FIELD_TYPE_BATCH_WRITE			44
 
 	/* NB: field_sz is sizeof(type) + sizeof(data) */
 	uint32_t field_sz; // get the data size through the accessor function, don't worry, it's a small macro
@@ -235,6 +247,91 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_BIT_BATCH				0x00010000
 #define AS_MSG_FIELD_BIT_BATCH_WITH_SET		0x00020000
 #define AS_MSG_FIELD_BIT_PREDEXP			0x00040000
+#define AS_MSG_FIELD_BIT_BATCH_WRITE		0x00080000
+#define AS_MSG_FIELD_BIT_SCAN_PARTITIONS	0x00100000
+#define AS_MSG_FIELD_BIT_QUERY_MAX_RECORDS	0x00200000
+#define AS_MSG_FIELD_BIT_QUERY_CURSOR		0x00400000
+#define AS_MSG_FIELD_BIT_SCAN_SAMPLE_COUNT	0x00800000
+#define AS_MSG_FIELD_BIT_SCAN_COUNT			0x01000000
+
+#define AS_MSG_FIELD_N_BITS					25
+
+// Position of a field type's AS_MSG_FIELD_BIT_* flag, or -1 if it has none.
+static inline int
+as_msg_field_type_ix(uint8_t type)
+{
+	switch (type) {
+	case AS_MSG_FIELD_TYPE_NAMESPACE:
+		return 0;
+	case AS_MSG_FIELD_TYPE_SET:
+		return 1;
+	case AS_MSG_FIELD_TYPE_KEY:
+		return 2;
+	case AS_MSG_FIELD_TYPE_DIGEST_RIPE:
+		return 3;
+	case AS_MSG_FIELD_TYPE_DIGEST_RIPE_ARRAY:
+		return 4;
+	case AS_MSG_FIELD_TYPE_TRID:
+		return 5;
+	case AS_MSG_FIELD_TYPE_SCAN_OPTIONS:
+		return 6;
+	case AS_MSG_FIELD_TYPE_SOCKET_TIMEOUT:
+		return 7;
+	case AS_MSG_FIELD_TYPE_INDEX_NAME:
+		return 8;
+	case AS_MSG_FIELD_TYPE_INDEX_RANGE:
+		return 9;
+	case AS_MSG_FIELD_TYPE_INDEX_TYPE:
+		return 10;
+	case AS_MSG_FIELD_TYPE_UDF_FILENAME:
+		return 11;
+	case AS_MSG_FIELD_TYPE_UDF_FUNCTION:
+		return 12;
+	case AS_MSG_FIELD_TYPE_UDF_ARGLIST:
+		return 13;
+	case AS_MSG_FIELD_TYPE_UDF_OP:
+		return 14;
+	case AS_MSG_FIELD_TYPE_QUERY_BINLIST:
+		return 15;
+	case AS_MSG_FIELD_TYPE_BATCH:
+		return 16;
+	case AS_MSG_FIELD_TYPE_BATCH_WITH_SET:
+		return 17;
+	case AS_MSG_FIELD_TYPE_PREDEXP:
+		return 18;
+	case AS_MSG_FIELD_TYPE_BATCH_WRITE:
+		return 19;
+	case AS_MSG_FIELD_TYPE_SCAN_PARTITIONS:
+		return 20;
+	case AS_MSG_FIELD_TYPE_QUERY_MAX_RECORDS:
+		return 21;
+	case AS_MSG_FIELD_TYPE_QUERY_CURSOR:
+		return 22;
+	case AS_MSG_FIELD_TYPE_SCAN_SAMPLE_COUNT:
+		return 23;
+	case AS_MSG_FIELD_TYPE_SCAN_COUNT:
+		return 24;
+	default:
+		return -1;
+	}
+}
+
+// Scan partitions field - a sequence of entries, each a partition (or part of
+// one) to scan: a 2 byte pid, a flags byte, then the digests the flags say are
+// present. A partition is scanned in descending digest order - the high digest
+// is where to resume (exclusive), the low one where to stop (inclusive).
+#define AS_MSG_SCAN_PARTITION_HIGH		0x01
+#define AS_MSG_SCAN_PARTITION_LOW		0x02
+
+// Scan sample count field - an 8 byte number of records to sample, spread
+// evenly over all the cluster's partitions. Overrides the options' sample-pct.
+
+// Scan count field - asks for a count instead of records. The value is empty,
+// or a bin name whose distinct values to estimate. Each node responds with a
+// single map - "count", "matched", "sampled" and maybe "distinct".
+
+// Query pagination fields - a 4 byte page size, and an 8 byte cursor token. A
+// page's fin carries the token to resume with, unless the query is done.
 
 // as_msg ops
 
@@ -246,12 +343,14 @@ typedef struct as_msg_field_s {
 #define AS_MSG_OP_CDT_MODIFY 4
 
 #define AS_MSG_OP_INCR 5			// arithmetically add a value to an existing value, works only on integers
-// Unused - 6
-// Unused - 7
-// Unused - 8
+#define AS_MSG_OP_HLL_ADD 6			// add the value to an HLL bin's distinct count, creating the bin if need be
+#define AS_MSG_OP_HLL_MERGE 7		// merge an HLL value into an HLL bin, creating the bin if need be
+#define AS_MSG_OP_HLL_COUNT 8		// read an HLL bin's distinct count estimate as an integer
 #define AS_MSG_OP_APPEND 9			// append a value to an existing value, works on strings and blobs
 #define AS_MSG_OP_PREPEND 10		// prepend a value to an existing value, works on strings and blobs
 #define AS_MSG_OP_TOUCH 11			// touch a value without doing anything else to it - will increment the generation
+#define AS_MSG_OP_BITS_READ 12		// read bits of a blob - see as_bits_optype
+#define AS_MSG_OP_BITS_MODIFY 13	// modify bits or a byte range of a blob - see as_bits_optype
 
 #define AS_MSG_OP_MC_INCR 129		// Memcache-compatible version of the increment command
 #define AS_MSG_OP_MC_APPEND 130		// append the value to an existing value, works only strings for now
@@ -267,6 +366,8 @@ typedef struct as_msg_field_s {
     || (op) == AS_MSG_OP_MC_PREPEND \
     )
 
+#define OP_IS_HLL_MODIFY(op) ((op) == AS_MSG_OP_HLL_ADD || (op) == AS_MSG_OP_HLL_MERGE)
+
 #define OP_IS_TOUCH(op) ((op) == AS_MSG_OP_TOUCH || (op) == AS_MSG_OP_MC_TOUCH)
 
 typedef struct as_msg_op_s {
@@ -356,11 +457,12 @@ typedef struct cl_msg_s {
 #define AS_MSG_INFO3_UPDATE_ONLY		(1 << 3) // update existing record only, do not create new record
 #define AS_MSG_INFO3_CREATE_OR_REPLACE	(1 << 4) // completely replace existing record, or create new record
 #define AS_MSG_INFO3_REPLACE_ONLY		(1 << 5) // completely replace existing record, do not create new record
-// (Note:  Bit 6 is unused.)
-// (Note:  Bit 7 is unused.)
+#define AS_MSG_INFO3_SCAN_RESUME		(1 << 6) // scan response - partition (in generation) may be resumed after digest
+#define AS_MSG_INFO3_PARTITION_DONE		(1 << 7) // scan response - partition (in generation) is finished, see result code
 
+#define AS_MSG_FIELD_SCAN_STORAGE_ORDER			(0x01) // read records in device order, not partition by partition
 #define AS_MSG_FIELD_SCAN_UNUSED_2					(0x02) // was - whether to send ldt bin data back to the client
-#define AS_MSG_FIELD_SCAN_DISCONNECTED_JOB			(0x04) // for sproc jobs that won't be sending results back to the client [UNUSED]
+#define AS_MSG_FIELD_SCAN_SHARED					(0x04) // attach to a concurrent scan of the same set, if any
 #define AS_MSG_FIELD_SCAN_FAIL_ON_CLUSTER_CHANGE	(0x08) // if we should fail when cluster is migrating or cluster changes
 #define AS_MSG_FIELD_SCAN_PRIORITY(__cl_byte)		((0xF0 & __cl_byte)>>4) // 4 bit value indicating the scan priority
 
@@ -473,6 +575,16 @@ as_proto_wrapped_is_valid(const as_proto *proto, size_t size)
 			as_proto_size_get(proto) == size;
 }
 
+// Response whose big string and blob values are sent from where they are.
+#define AS_MSG_IN_PLACE_MIN_SZ (64 * 1024)
+#define AS_MSG_MAX_IOVS 64
+
+typedef struct as_msg_iov_reply_s {
+	uint8_t *buf; // header runs, interleaved in iovs with the values
+	uint32_t n_iovs;
+	struct iovec iovs[AS_MSG_MAX_IOVS];
+} as_msg_iov_reply;
+
 void as_proto_swap(as_proto *m);
 void as_msg_swap_header(as_msg *m);
 void as_msg_swap_field(as_msg_field *mf);
@@ -489,6 +601,10 @@ cl_msg *as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 		uint32_t void_time, as_msg_op **ops, struct as_bin_s **bins,
 		uint16_t bin_count, struct as_namespace_s *ns, cl_msg *msgp_in,
 		size_t *msg_sz_in, uint64_t trid);
+bool as_msg_make_response_iov(as_msg_iov_reply *reply, uint32_t result_code,
+		uint32_t generation, uint32_t void_time, as_msg_op **ops,
+		struct as_bin_s **bins, uint16_t bin_count, struct as_namespace_s *ns,
+		uint64_t trid);
 int32_t as_msg_make_response_bufbuilder(cf_buf_builder **bb_r,
 		struct as_storage_rd_s *rd, bool no_bin_data, bool include_key,
 		bool skip_empty_records, cf_vector *select_bins);
@@ -497,12 +613,16 @@ cl_msg *as_msg_make_val_response(bool success, const as_val *val,
 		uint64_t trid, size_t *p_msg_sz);
 void as_msg_make_val_response_bufbuilder(const as_val *val,
 		cf_buf_builder **bb_r, uint32_t val_sz, bool);
+void as_msg_make_pid_status_bufbuilder(cf_buf_builder **bb_r, uint32_t pid,
+		const cf_digest *resume_keyd, uint32_t result_code);
 
 int as_msg_send_reply(struct as_file_handle_s *fd_h, uint32_t result_code,
 		uint32_t generation, uint32_t void_time, as_msg_op **ops,
 		struct as_bin_s **bins, uint16_t bin_count, struct as_namespace_s *ns,
 		uint64_t trid);
 int as_msg_send_ops_reply(struct as_file_handle_s *fd_h, cf_dyn_buf *db);
+int as_msg_send_iov_reply(struct as_file_handle_s *fd_h,
+		as_msg_iov_reply *reply);
 bool as_msg_send_fin(cf_socket *sock, uint32_t result_code);
 size_t as_msg_send_fin_timeout(cf_socket *sock, uint32_t result_code,
 		int32_t timeout);
@@ -520,10 +640,12 @@ typedef struct as_netio_s {
 	uint32_t                   offset;
 	uint32_t                   seq;
 	bool                       slow;
+	bool                       compressed; // bb_r holds a whole compressed packet
 	uint64_t                   start_time;
 } as_netio;
 
 void as_netio_init();
+void as_netio_compress(as_netio *io, struct as_namespace_s *ns);
 int as_netio_send(as_netio *io, bool slow, bool blocking);
 
 #define AS_NETIO_OK        0
@@ -647,4 +769,24 @@ typedef enum as_cdt_optype_e {
 
 } as_cdt_optype;
 
+// Bit op values are big-endian - a 1 byte as_bits_optype, a 4 byte offset and
+// a 4 byte size, then any argument bytes. Offset and size are in bits, except
+// for AS_BITS_OP_WRITE where they're in bytes. Bit 0 is the most significant
+// bit of byte 0.
+typedef enum as_bits_optype_e {
+	// Modify - SET and WRITE extend the blob (zero-filled) if need be, and
+	// create the bin if it doesn't exist.
+	AS_BITS_OP_WRITE	= 0,	// args - size bytes
+	AS_BITS_OP_SET		= 1,	// args - size bits, left-aligned
+	AS_BITS_OP_OR		= 2,	// args - size bits, left-aligned
+	AS_BITS_OP_XOR		= 3,	// args - size bits, left-aligned
+	AS_BITS_OP_AND		= 4,	// args - size bits, left-aligned
+	AS_BITS_OP_LSHIFT	= 5,	// args - 4 byte shift, zero-filled
+	AS_BITS_OP_RSHIFT	= 6,	// args - 4 byte shift, zero-filled
+
+	// Read.
+	AS_BITS_OP_GET		= 50,	// result - blob of size bits, left-aligned
+	AS_BITS_OP_COUNT	= 51	// result - integer count of set bits
+} as_bits_optype;
+
 #define AS_CDT_OP_LIST_LAST	AS_CDT_OP_LIST_GET_RANGE
@@ -0,0 +1,89 @@
+/*
+ * quota.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Per-namespace and per-set throughput quotas. Each quota is a pair of
+ * lock-free token buckets - ops/sec and request bytes/sec - holding at most
+ * one second's worth of tokens. Client and batch sub-transactions are charged
+ * in tsvc, and rejected with AS_PROTO_RESULT_FAIL_QUOTA_EXCEEDED when either
+ * their set's or their namespace's bucket is empty.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_namespace_s;
+struct as_transaction_s;
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef struct as_quota_bucket_s {
+	uint64_t	rate; // tokens per second - 0 means unlimited
+	int64_t		milli_tokens; // thousandths, so a millisecond refills 'rate'
+	uint64_t	last_ms;
+} as_quota_bucket;
+
+typedef struct as_quota_s {
+	as_quota_bucket	ops;
+	as_quota_bucket	bytes;
+	uint64_t		n_rejected;
+} as_quota;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_quota_set_rate(as_quota_bucket* b, uint64_t rate);
+bool as_quota_admit(struct as_namespace_s* ns, const struct as_transaction_s* tr);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline uint64_t
+as_quota_get_rate(const as_quota_bucket* b)
+{
+	return __atomic_load_n(&b->rate, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t
+as_quota_n_rejected(const as_quota* q)
+{
+	return __atomic_load_n(&q->n_rejected, __ATOMIC_RELAXED);
+}
@@ -46,6 +46,7 @@ struct as_transaction_s;
 
 void as_scan_init();
 int as_scan(struct as_transaction_s *tr, struct as_namespace_s *ns);
+int as_scan_verify(struct as_namespace_s *ns, const char* set_name, uint32_t rps, uint64_t* p_trid);
 void as_scan_limit_active_jobs(uint32_t max_active);
 void as_scan_limit_finished_jobs(uint32_t max_done);
 void as_scan_resize_thread_pool(uint32_t n_threads);
@@ -56,3 +57,4 @@ struct as_mon_jobstat_s* as_scan_get_jobstat_all(int* size);
 int as_scan_abort(uint64_t trid);
 int as_scan_abort_all();
 int as_scan_change_job_priority(uint64_t trid, uint32_t priority);
+int as_scan_change_job_rps(uint64_t trid, uint32_t rps);
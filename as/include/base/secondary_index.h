@@ -37,6 +37,7 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_ll.h"
+#include "citrusleaf/cf_queue.h"
 
 #include "dynbuf.h"
 #include "hist.h"
@@ -52,6 +53,7 @@
  */
 // **************************************************************************************************
 #define AS_SINDEX_MAX_STRING_KSIZE 2048
+#define AS_SINDEX_STR_PREFIX_SZ    19 // string bytes held in an ordered string key
 #define AS_SINDEX_MAX_GEOJSON_KSIZE (1024 * 1024)
 #define OLD_SINDEX_SMD_KEY_SIZE    AS_ID_INAME_SZ + AS_ID_NAMESPACE_SZ
 #define SINDEX_SMD_KEY_SIZE        (AS_ID_NAMESPACE_SZ + AS_SET_NAME_MAX_SIZE + AS_SINDEX_MAX_PATH_LENGTH + 1 + 2 + 2)
@@ -62,6 +64,11 @@
 #define AS_SINDEX_MAX_DEPTH        10
 #define AS_SINDEX_TYPE_STR_SIZE    20 // LIST / MAPKEYS / MAPVALUES / DEFAULT(NONE)
 #define AS_SINDEXDATA_STR_SIZE     AS_SINDEX_MAX_PATH_LENGTH + 1 + 8 // binpath + separator (,) + keytype (string/numeric)
+#define AS_SINDEX_DELTA_BATCH_SZ   256 // deferred ops applied per pimd lock hold
+#define AS_SINDEX_MAX_COVERING_BINS 8
+#define AS_SINDEX_COVERING_N_BUCKETS (16 * 1024)
+#define AS_SINDEX_COVERING_MAX_ENTRY_SZ 1024 // bigger records aren't copied
+#define AS_SINDEX_COVERING_STR_SIZE (AS_SINDEX_MAX_COVERING_BINS * AS_ID_BIN_SZ) // bin names + separators (,)
 #define AS_INDEX_KEYS_ARRAY_QUEUE_HIGHWATER  512
 #define AS_INDEX_KEYS_PER_ARR      51
 // **************************************************************************************************
@@ -202,6 +209,10 @@ typedef struct as_sindex_stat_s {
 	cf_atomic64        lookup_num_records;
 	cf_atomic64        lookup_errs;
 
+	//	--covering stats
+	cf_atomic64        covering_hits;
+	cf_atomic64        covering_mem_used;
+
 	histogram *       _query_rcnt_hist;       // Histogram to track record counts from queries
 	histogram *       _query_diff_hist;       // Histogram to track the false positives found by queries
 } as_sindex_stat;
@@ -220,6 +231,8 @@ typedef struct as_sindex_config_s {
 typedef struct as_sindex_physical_metadata_s {
 	pthread_rwlock_t    slock;
 	struct btree       *ibtr;
+	cf_queue           *deltas;        // Deferred ops, NULL unless ns defers updates
+	uint32_t            deltas_queued; // Waiting in g_sindex_delta_q
 } as_sindex_pmetadata;
 
 
@@ -252,6 +265,10 @@ typedef struct as_sindex_metadata_s {
 	int                   path_length;
 	char                * path_str;
 	int                   nprts;   // Aerospike Index Number of Index partitions	
+	char                * covering_str; // Bins copied into the index, comma separated, or NULL
+	uint16_t              covering_binids[AS_SINDEX_MAX_COVERING_BINS];
+	int                   n_covering;
+	bool                  str_ordered; // String keys are ordered prefixes, not digests
 } as_sindex_metadata;
 
 /*
@@ -278,6 +295,9 @@ typedef struct as_sindex_s {
 
 	as_sindex_stat               stats;
 	as_sindex_config             config;
+
+	// Digest -> copy of covered bins, NULL unless imd has covering bins.
+	cf_shash                    *covering;
 } as_sindex;
 
 // **************************************************************************************************
@@ -331,6 +351,7 @@ typedef struct as_sindex_bin_data_s {
 		int64_t  i64;
 	} u;
 	cf_digest         digest;
+	cf_digest         ordered; // String key for an ordered string index
 } as_sindex_bin_data;
 
 // Caution: Using this will waste 12 bytes per long type skey 
@@ -509,6 +530,10 @@ bool                        as_sindex_delete_checker(as_namespace *ns, as_sindex
 as_particle_type            as_sindex_pktype(as_sindex_metadata * imd);
 extern const char         * as_sindex_ktype_str(as_sindex_ktype type);
 extern as_sindex_ktype      as_sindex_ktype_from_string(const char * type_str);
+extern void                 as_sindex_string_to_skey(const as_sindex_metadata *imd, const char *str,
+							uint32_t len, cf_digest *skey);
+extern void                 as_sindex_string_to_ordered_skey(const char *str, uint32_t len,
+							cf_digest *skey);
 int                         as_sindex_arr_lookup_by_set_binid_lockfree(as_namespace * ns, 
 							const char *set, int binid, as_sindex ** si_arr);
 void                        as_sindex_delete_set(as_namespace * ns, char * set_name);
@@ -651,11 +676,39 @@ do {                                            \
 // **************************************************************************************************
 extern void as_sindex_init_smd();
 extern void as_sindex_imd_to_smd_key(const as_sindex_metadata *imd, char *smd_key);
+extern void as_sindex_imd_to_smd_value(const as_sindex_metadata *imd, char *smd_value);
 extern bool as_sindex_delete_imd_to_smd_key(as_namespace *ns, as_sindex_metadata *imd, char *smd_key);
 extern int  as_sindex_smd_accept_cb(char *module, as_smd_item_list_t *items, void *udata, 
 						uint32_t accept_opt);
 // **************************************************************************************************
 
+/*
+ * APIs for covering bins
+ */
+// **************************************************************************************************
+typedef struct as_sindex_covering_entry_s as_sindex_covering_entry;
+
+extern bool as_sindex_covers_bins(as_sindex *si, cf_vector *binlist, bool no_bin_data);
+extern void as_sindex_covering_put(as_sindex *si, as_storage_rd *rd);
+extern as_sindex_covering_entry *as_sindex_covering_get(as_sindex *si, as_index *r);
+extern bool as_sindex_covering_load_rd(as_sindex_covering_entry *e, as_storage_rd *rd, as_bin *bins);
+extern void as_sindex_covering_release(as_sindex_covering_entry *e);
+extern void as_sindex_covering_drop(as_sindex *si, cf_digest *keyd);
+extern void as_sindex_covering_destroy(cf_shash *covering);
+// **************************************************************************************************
+
+/*
+ * APIs for deferred updates
+ */
+// **************************************************************************************************
+typedef struct as_sindex_delta_work_s {
+	as_sindex * si; // reserved
+	uint32_t    pimd_ix;
+} as_sindex_delta_work;
+
+extern void as_sindex_apply_deltas(as_sindex *si, uint32_t pimd_ix);
+// **************************************************************************************************
+
 /*
  * QUERY MACROS
  */
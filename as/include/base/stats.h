@@ -56,10 +56,14 @@ typedef struct as_stats_s {
 
 	// Demarshal stats.
 	uint64_t		reaper_count; // not in ticker - incremented only in reaper thread
+	cf_atomic64		proto_pipelined_requests; // not in ticker
 
 	// Info stats.
 	cf_atomic64		info_complete;
 
+	// Transaction service stats.
+	cf_atomic64		n_tsvc_steals; // not in ticker
+
 	// Proxy stats.
 	uint64_t		proxy_retry; // not in ticker - incremented only in proxy retransmit thread
 
@@ -79,12 +83,18 @@ typedef struct as_stats_s {
 	cf_atomic64		batch_index_huge_buffers; // not in ticker
 	cf_atomic64		batch_index_created_buffers; // not in ticker
 	cf_atomic64		batch_index_destroyed_buffers; // not in ticker
+	cf_atomic64		batch_index_adaptive_buffers; // not in ticker
+	cf_atomic64		batch_index_sent_buffers; // not in ticker
 
 	// "Old" batch stats.
 	cf_atomic64		batch_initiate; // not in ticker
 	cf_atomic64		batch_errors; // not in ticker
 	cf_atomic64		batch_timeout; // not in ticker
 
+	// UDF stats - for sizing the mod-lua state cache.
+	cf_atomic64		udf_lua_in_flight; // not in ticker - not just a statistic
+	cf_atomic64		udf_lua_in_flight_max; // not in ticker
+
 	// Query & secondary index stats.
 	cf_atomic64		query_false_positives;
 	cf_atomic64		sindex_gc_timedout; // number of times sindex gc iteration timed out waiting for partition lock
@@ -111,6 +121,9 @@ typedef struct as_stats_s {
 	histogram*		batch_index_hist;
 	bool			batch_index_hist_active; // automatically activated
 
+	histogram*		batch_index_fill_hist; // % of buffer capacity used, per batch
+	bool			batch_index_fill_hist_active; // automatically activated
+
 	histogram*		info_hist;
 
 	histogram*		svc_demarshal_hist;
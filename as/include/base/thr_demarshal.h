@@ -44,3 +44,4 @@ extern cf_serv_cfg g_service_bind;
 extern cf_tls_info *g_service_tls;
 
 void thr_demarshal_rearm(as_file_handle *fd_h);
+bool as_demarshal_set_threads(uint32_t n_threads);
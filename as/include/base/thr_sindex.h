@@ -42,6 +42,7 @@
 
 #define SINDEX_GC_QUEUE_HIGHWATER  10
 #define SINDEX_GC_NUM_OBJS_PER_ARR 20
+#define SINDEX_DELTA_THREADS       4
 
 typedef struct acol_digest_t {
 	cf_digest dig;
@@ -62,6 +63,7 @@ extern pthread_rwlock_t sindex_rwlock;
 extern cf_queue *g_sindex_populate_q;
 extern cf_queue *g_sindex_destroy_q;
 extern cf_queue *g_sindex_populateall_done_q;
+extern cf_queue *g_sindex_delta_q;
 extern bool      g_sindex_boot_done;
 
 void as_sindex_thr_init();
@@ -76,3 +78,4 @@ int as_sbld_list(char* name, cf_dyn_buf* db);
 as_mon_jobstat* as_sbld_get_jobstat(uint64_t trid);
 as_mon_jobstat* as_sbld_get_jobstat_all(int* size);
 int as_sbld_abort(uint64_t trid);
+int as_sbld_change_job_rps(uint64_t trid, uint32_t rps);
@@ -26,6 +26,7 @@
 // Includes.
 //
 
+#include <stdbool.h>
 #include <stdint.h>
 
 
@@ -51,5 +52,7 @@ struct as_transaction_s;
 void as_tsvc_init();
 void as_tsvc_enqueue(struct as_transaction_s *tr);
 void as_tsvc_set_threads_per_queue(uint32_t n_threads);
+bool as_tsvc_set_n_queues(uint32_t n_queues);
 int as_tsvc_queue_get_size();
 void as_tsvc_process_transaction(struct as_transaction_s *tr);
+bool as_tsvc_numa_remote(const struct as_transaction_s *tr);
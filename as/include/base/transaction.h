@@ -104,6 +104,10 @@ typedef struct as_file_handle_s {
 	as_proto	proto_hdr;
 	as_proto	*proto;
 	uint64_t	proto_unread;
+	uint8_t		*stash;			// bytes read ahead, past the last request
+	uint32_t	stash_off;
+	uint32_t	stash_sz;
+	uint8_t		compression;	// compression_type of client's requests, applied to responses
 	void		*security_filter;
 } as_file_handle;
 
@@ -148,6 +152,7 @@ typedef enum {
 } transaction_origin;
 
 struct as_batch_shared_s;
+struct as_batch_group_s;
 struct iudf_origin_s;
 
 typedef struct as_transaction_s {
@@ -169,6 +174,7 @@ typedef struct as_transaction_s {
 		as_file_handle*				proto_fd_h;
 		cf_node						proxy_node;
 		struct as_batch_shared_s*	batch_shared;
+		struct as_batch_group_s*	batch_group;
 		struct iudf_origin_s*		iudf_orig;
 	} from;
 
@@ -198,6 +204,11 @@ typedef struct as_transaction_s {
 	uint32_t	void_time;
 	uint64_t	last_update_time;
 
+	// Field table - valid only while fields_msgp is msgp.
+	const cl_msg*	fields_msgp;
+	uint32_t		fields_found; // AS_MSG_FIELD_BIT_* flags
+	as_msg_field*	fields[AS_MSG_FIELD_N_BITS];
+
 } as_transaction;
 
 #define AS_TRANSACTION_HEAD_SIZE (offsetof(as_transaction, rsv))
@@ -205,6 +216,7 @@ typedef struct as_transaction_s {
 // 'from_flags' bits - set before queuing transaction head:
 #define FROM_FLAG_BATCH_SUB		0x0001
 #define FROM_FLAG_RESTART		0x0002
+#define FROM_FLAG_BATCH_GROUP	0x0004
 
 // 'flags' bits - set in transaction body after queuing:
 #define AS_TRANSACTION_FLAG_SINDEX_TOUCHED	0x01
@@ -222,6 +234,7 @@ void as_transaction_init_from_rw(as_transaction *tr, struct rw_request_s *rw);
 void as_transaction_init_head_from_rw(as_transaction *tr, struct rw_request_s *rw);
 
 bool as_transaction_set_msg_field_flag(as_transaction *tr, uint8_t type);
+void as_transaction_decode_fields(as_transaction *tr);
 bool as_transaction_demarshal_prepare(as_transaction *tr);
 void as_transaction_proxyee_prepare(as_transaction *tr);
 
@@ -237,6 +250,12 @@ as_transaction_is_batch_sub(const as_transaction *tr)
 	return (tr->from_flags & FROM_FLAG_BATCH_SUB) != 0;
 }
 
+static inline bool
+as_transaction_is_batch_group(const as_transaction *tr)
+{
+	return (tr->from_flags & FROM_FLAG_BATCH_GROUP) != 0;
+}
+
 static inline bool
 as_transaction_has_set(const as_transaction *tr)
 {
@@ -312,6 +331,54 @@ as_transaction_has_predexp(const as_transaction *tr)
 	return (tr->msg_fields & AS_MSG_FIELD_BIT_PREDEXP) != 0;
 }
 
+static inline bool
+as_transaction_has_scan_partitions(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_SCAN_PARTITIONS) != 0;
+}
+
+static inline bool
+as_transaction_has_scan_sample_count(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_SCAN_SAMPLE_COUNT) != 0;
+}
+
+static inline bool
+as_transaction_has_scan_count(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_SCAN_COUNT) != 0;
+}
+
+static inline bool
+as_transaction_has_query_max_records(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_QUERY_MAX_RECORDS) != 0;
+}
+
+static inline bool
+as_transaction_has_query_cursor(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_QUERY_CURSOR) != 0;
+}
+
+// O(1) equivalent of as_msg_field_get() - falls back to walking the fields if
+// the table doesn't describe the current message.
+static inline as_msg_field *
+as_transaction_field_get(const as_transaction *tr, uint8_t type)
+{
+	if (tr->fields_msgp != tr->msgp) {
+		return as_msg_field_get(&tr->msgp->msg, type);
+	}
+
+	int ix = as_msg_field_type_ix(type);
+
+	if (ix < 0 || (tr->fields_found & (1U << ix)) == 0) {
+		return NULL;
+	}
+
+	return tr->fields[ix];
+}
+
 // For now it's not worth storing the trid in the as_transaction struct since we
 // only parse it from the msg once per transaction anyway.
 static inline uint64_t
@@ -321,7 +388,7 @@ as_transaction_trid(const as_transaction *tr)
 		return 0;
 	}
 
-	as_msg_field *f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_TRID);
+	as_msg_field *f = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_TRID);
 
 	return cf_swap_from_be64(*(uint64_t*)f->data);
 }
@@ -59,6 +59,8 @@ typedef struct as_truncate_s {
 	cf_shash* startup_set_hash; // relevant only for enterprise edition
 	truncate_state state;
 	pthread_mutex_t state_lock;
+	uint16_t set_id; // listed set to truncate, or INVALID_SET_ID for all
+	uint16_t restart_set_id;
 	cf_atomic32 n_threads_running;
 	cf_atomic32 pid;
 	cf_atomic64 n_records_this_run;
@@ -0,0 +1,49 @@
+/*
+ * udf_native.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Native (C) UDFs - functions compiled into the server, looked up by module
+ * and function name ahead of Lua. Register them at startup, before
+ * transactions are serviced - lookups take no lock.
+ *
+ * A native function must poll as_timer_timedout() on the timer it's passed
+ * if it may run long - unlike Lua, it can't be interrupted.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "aerospike/as_list.h"
+#include "aerospike/as_rec.h"
+#include "aerospike/as_result.h"
+#include "aerospike/as_timer.h"
+
+typedef int (* udf_native_fn)(as_rec *rec, as_list *args, as_result *result,
+		as_timer *timer);
+
+/*****************************************************************************
+ * FUNCTIONS
+ *****************************************************************************/
+bool          udf_native_register(const char *module, const char *function, udf_native_fn fn);
+udf_native_fn udf_native_get(const char *module, const char *function);
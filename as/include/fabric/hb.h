@@ -54,6 +54,11 @@
  */
 #define AS_HB_MAX_INTERVALS_MISSED_MIN 3
 
+/**
+ * Maximum configurable phi threshold.
+ */
+#define AS_HB_PHI_THRESHOLD_MAX 16
+
 /**
  * Heartbeat modes.
  */
@@ -220,6 +225,13 @@ typedef struct as_hb_config_s
 	 */
 	uint32_t max_intervals_missed;
 
+	/**
+	 * Suspicion level (phi) above which a node is considered expired, based on
+	 * its observed pulse inter-arrival times. Zero disables the phi-accrual
+	 * detector, leaving only the fixed timeout.
+	 */
+	uint32_t phi_threshold;
+
 	/**
 	 * The ttl for multicast packets. Set to zero for default TTL.
 	 */
@@ -404,6 +416,8 @@ int as_hb_tx_interval_set(uint32_t new_interval);
 
 int as_hb_max_intervals_missed_set(uint32_t new_max);
 
+int as_hb_phi_threshold_set(uint32_t new_threshold);
+
 uint32_t as_hb_node_timeout_get();
 
 bool as_hb_max_cluster_size_isvalid(uint32_t max_cluster_size);
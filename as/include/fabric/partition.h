@@ -54,7 +54,20 @@ struct as_namespace_s;
 // Typedefs & constants.
 //
 
-#define AS_PARTITIONS 4096
+// Keys hash to a partition by the low bits of the digest. Clients assume 4096
+// partitions unless they ask (info "partitions"), and devices and cluster
+// peers must agree, so only change this for a whole deployment, with devices
+// erased. Sprig bits must follow the partition bits in the first 3 digest
+// bytes, hence the range.
+#ifndef AS_PARTITION_BITS
+#define AS_PARTITION_BITS 12
+#endif
+
+#if AS_PARTITION_BITS < 12 || AS_PARTITION_BITS > 16
+#error "AS_PARTITION_BITS must be 12 to 16"
+#endif
+
+#define AS_PARTITIONS (1 << AS_PARTITION_BITS)
 #define AS_PARTITION_MASK (AS_PARTITIONS - 1)
 
 #define VERSION_FAMILY_BITS 4
@@ -80,6 +93,7 @@ typedef struct as_partition_s {
 	pthread_mutex_t lock;
 
 	uint32_t id;
+	uint32_t route_seq; // odd while routing state is being changed
 
 	struct as_index_tree_s* vp;
 
@@ -99,12 +113,19 @@ typedef struct as_partition_s {
 	bool immigrators[AS_CLUSTER_SZ];
 
 	cf_node working_master;
+	cf_node rack_local_node; // in-sync replica in our rack, if rack aware
 
 	uint32_t n_dupl;
 	cf_node dupls[AS_CLUSTER_SZ];
 
 	uint32_t n_witnesses;
 	cf_node witnesses[AS_CLUSTER_SZ];
+
+	// Client transaction count, and its values at the last two rebalances -
+	// used to migrate the busiest partitions first.
+	cf_atomic64 n_tx;
+	uint64_t n_tx_base;
+	uint64_t n_tx_prev_base;
 } as_partition;
 
 typedef struct as_partition_reservation_s {
@@ -154,11 +175,13 @@ void as_partition_freeze(as_partition* p);
 uint32_t as_partition_get_other_replicas(as_partition* p, cf_node* nv);
 
 cf_node as_partition_writable_node(struct as_namespace_s* ns, uint32_t pid);
-cf_node as_partition_proxyee_redirect(struct as_namespace_s* ns, uint32_t pid);
+cf_node as_partition_proxyee_redirect(struct as_namespace_s* ns, uint32_t pid, bool is_read, cf_node src);
+bool as_partition_is_rack_local(const struct as_namespace_s* ns, cf_node node);
 
 void as_partition_get_replicas_prole_str(cf_dyn_buf* db); // deprecate in "six months"
 void as_partition_get_replicas_master_str(cf_dyn_buf* db);
 void as_partition_get_replicas_all_str(cf_dyn_buf* db);
+bool as_partition_get_replicas_delta_str(cf_dyn_buf* db, uint64_t since);
 
 void as_partition_get_replica_stats(struct as_namespace_s* ns, repl_stats* p_stats);
 
@@ -257,6 +280,22 @@ contains_self(const cf_node* nodes, uint32_t n_nodes)
 	return contains_node(nodes, n_nodes, g_config.self_node);
 }
 
+// Changes to routing state - replicas, pending immigrations, working master,
+// duplicates and tree - must be made within the partition lock, between these
+// calls. Write and read reservations rely on this to skip the lock.
+static inline void
+as_partition_route_change_begin(as_partition* p)
+{
+	__atomic_store_n(&p->route_seq, p->route_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+as_partition_route_change_end(as_partition* p)
+{
+	__atomic_store_n(&p->route_seq, p->route_seq + 1, __ATOMIC_RELEASE);
+}
+
 #define AS_PARTITION_ID_UNDEF ((uint16_t)0xFFFF)
 
 #define AS_PARTITION_RESERVATION_INIT(__rsv) \
@@ -267,6 +306,14 @@ contains_self(const cf_node* nodes, uint32_t n_nodes)
 
 #define VERSION_AS_STRING(v_ptr) (as_partition_version_as_string(v_ptr).s)
 
+// Client transactions since the rebalance before last - covers the period
+// before the current rebalance, even if that was itself a short one.
+static inline uint64_t
+as_partition_heat(const as_partition* p)
+{
+	return (uint64_t)cf_atomic64_get(p->n_tx) - p->n_tx_prev_base;
+}
+
 
 //==========================================================
 // Public API - client view replica maps.
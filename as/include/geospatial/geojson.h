@@ -21,8 +21,6 @@
 
 #include <string>
 
-#include <jansson.h>
-
 #include <s2cellid.h>
 #include <s2region.h>
 
@@ -40,13 +38,6 @@ public:
 	virtual double earth_radius_meters() {
 		return 6371000.0;		// Wikipedia, mean radius.
 	}
-
-	void set_json(json_t * i_jsonp) { m_jsonp = i_jsonp; }
-
-	json_t * get_json() { return m_jsonp; }
-
-private:
-	json_t * m_jsonp;
 };
 
 void parse(GeometryHandler & geohand, std::string const & geostr);
@@ -37,6 +37,13 @@ extern bool geo_parse(as_namespace * ns,
 					  size_t bufsz,
 					  uint64_t * cellidp,
 					  geo_region_t * regionp);
+
+// As geo_parse() with no namespace, but a region returned belongs to a
+// per-thread cache and must not be destroyed by the caller.
+extern bool geo_parse_cached(const char * buf,
+							 size_t bufsz,
+							 uint64_t * cellidp,
+							 geo_region_t * regionp);
 	
 extern bool geo_region_cover(as_namespace * ns,
 							 geo_region_t region,
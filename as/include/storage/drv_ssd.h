@@ -35,6 +35,7 @@
 #include "citrusleaf/cf_queue.h"
 
 #include "hist.h"
+#include "mpmc_queue.h"
 
 #include "fabric/partition.h"
 
@@ -48,6 +49,8 @@ struct as_namespace_s;
 struct as_rec_props_s;
 struct as_storage_rd_s;
 struct drv_ssd_s;
+struct hot_tier_s;
+struct read_cache_s;
 
 
 //==========================================================
@@ -68,6 +71,7 @@ struct drv_ssd_s;
 // 2 - minimum storage increment (RBLOCK_SIZE) from 512 to 128 bytes
 
 #define MAX_SSD_THREADS 20
+#define MAX_SSD_WRITE_SHARDS 32
 
 
 //------------------------------------------------
@@ -100,9 +104,26 @@ typedef struct {
 	uint32_t			wblock_id;
 	uint32_t			pos;
 	uint8_t				*buf;
+	uint64_t			io_start_ns;	// for benchmarks of asynchronous flushes
+	uint32_t			committed_pos;	// commit-to-device - bytes known on device
+	bool				committing;		// commit-to-device - device write in flight
 } ssd_write_buf;
 
 
+//------------------------------------------------
+// Shadow buffer - a copy of a wblock that's been
+// written to its device, waiting to be written to
+// the shadow device. Lets the swb go as soon as
+// the device write is done.
+//
+typedef struct {
+	uint32_t			wblock_id;
+	uint64_t			queued_ns;		// when the device write completed
+	uint8_t				*buf;
+	uint64_t			io_start_ns;	// for benchmarks of asynchronous flushes
+} ssd_shadow_buf;
+
+
 //------------------------------------------------
 // Per-wblock information.
 //
@@ -110,7 +131,9 @@ typedef struct ssd_wblock_state_s {
 	pthread_mutex_t		LOCK;		// transactions, write_worker, and defrag all are interested in wblock_state
 	uint32_t			state;		// for now just a defrag flag
 	cf_atomic32			inuse_sz;	// number of bytes currently used in the wblock
+	uint32_t			write_sec;	// when last opened for writing - approximates age of its records
 	ssd_write_buf		*swb;		// pending writes for the wblock, also treated as a cache for reads
+	uint8_t				defrag_bucket;	// defrag queue bucket with its live entry, if any
 } ssd_wblock_state;
 
 // wblock state
@@ -139,6 +162,71 @@ typedef enum {
 } e_free_to;
 
 
+//------------------------------------------------
+// Sources of swbs - on zoned devices, each fills its
+// own zone so every zone is written sequentially.
+//
+typedef enum {
+	SWB_STREAM_WRITE,
+	SWB_STREAM_HOT,
+	SWB_STREAM_DEFRAG,
+
+	N_SWB_STREAMS
+} e_swb_stream;
+
+typedef struct ssd_zone_cursor_s {
+	uint32_t			next_wblock_id;
+	uint32_t			n_wblocks_left;	// in the stream's open zone
+} ssd_zone_cursor;
+
+// I/O scheduler classes, most urgent first.
+typedef enum {
+	SSD_IO_CLIENT_READ,
+	SSD_IO_FLUSH,
+	SSD_IO_MIGRATE,
+	SSD_IO_SCAN,
+	SSD_IO_DEFRAG,
+
+	SSD_IO_N_CLASSES
+} ssd_io_class;
+
+// Defrag queue - wblocks are bucketed by how full they are, and the emptiest
+// are defragged first. A queued wblock that empties further is queued again in
+// its new bucket, leaving a stale entry behind to be skipped.
+#define SSD_DEFRAG_N_BUCKETS	100 // by percent of wblock in use
+#define SSD_DEFRAG_NO_BUCKET	0xFF
+
+typedef struct ssd_defrag_q_s {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;					// signaled as wblocks are queued
+	uint32_t			n_wblocks;				// queued, excluding stale entries
+	uint32_t			n_bucket_wblocks[SSD_DEFRAG_N_BUCKETS];
+	cf_queue			*buckets[SSD_DEFRAG_N_BUCKETS];
+} ssd_defrag_q;
+
+// Device I/O issued and not yet completed, for one class of I/O.
+typedef struct ssd_io_depth_s {
+	cf_atomic32			n_in_flight;
+	cf_atomic32			peak;			// since last ticker
+} ssd_io_depth;
+
+
+//------------------------------------------------
+// Write shard - writers are spread over a device's
+// shards by thread, so they don't all contend for
+// one lock.
+//
+typedef struct ssd_write_shard_s {
+	pthread_mutex_t		lock;			// protects writes to the shard's swbs
+	ssd_write_buf		*current_swb;	// swb currently being filled by writes
+	ssd_write_buf		*hot_swb;		// swb currently being filled by writes of hot records
+
+	// Used only by the maintenance thread, to flush inactive swbs.
+	uint32_t			prev_flush_size;
+	uint32_t			prev_flush_hot_size;
+} ssd_write_shard;
+
+
 //------------------------------------------------
 // Per-device information.
 //
@@ -151,26 +239,36 @@ typedef struct drv_ssd_s
 
 	uint32_t		running;
 
-	pthread_mutex_t	write_lock;			// lock protects writes to current swb
-	ssd_write_buf	*current_swb;		// swb currently being filled by writes
+	uint32_t		n_write_shards;
+	ssd_write_shard	write_shards[MAX_SSD_WRITE_SHARDS];
 
 	pthread_mutex_t	defrag_lock;		// lock protects writes to defrag swb
 	ssd_write_buf	*defrag_swb;		// swb currently being filled by defrag
 
+	pthread_mutex_t	commit_lock;		// commit-to-device - protects swb commit state
+	pthread_cond_t	commit_cond;		// commit-to-device - signals swb commits done
+
 	cf_queue		*fd_q;				// queue of open fds
 	cf_queue		*shadow_fd_q;		// queue of open fds on shadow, if any
 
 	cf_queue		*free_wblock_q;		// IDs of free wblocks
-	cf_queue		*defrag_wblock_q;	// IDs of wblocks to defrag
+	ssd_defrag_q	*defrag_q;			// IDs of wblocks to defrag, emptiest first
 
-	cf_queue		*swb_write_q;		// pointers to swbs ready to write
-	cf_queue		*swb_shadow_q;		// pointers to swbs ready to write to shadow, if any
+	cf_mpmc_queue	*swb_write_q;		// pointers to swbs ready to write
+	cf_queue		*shadow_buf_q;		// pointers to shadow bufs ready to write to shadow, if any
+	cf_queue		*shadow_buf_free_q;	// pointers to shadow bufs free and waiting
 	cf_queue		*swb_free_q;		// pointers to swbs free and waiting
 	cf_queue		*post_write_q;		// pointers to swbs that have been written but are cached
 
-	cf_atomic64		n_defrag_wblock_reads;	// total number of wblocks added to the defrag_wblock_q
+	cf_atomic64		n_defrag_wblock_reads;	// total number of wblocks added to the defrag_q
 	cf_atomic64		n_defrag_wblock_writes;	// total number of swbs added to the swb_write_q by defrag
 	cf_atomic64		n_wblock_writes;		// total number of swbs added to the swb_write_q by writes
+	cf_atomic64		shadow_lag_ns;			// age of the last shadow buf written to shadow
+	cf_atomic64		n_defrag_wblocks_done;	// total number of wblocks defrag has finished with
+
+	uint32_t		defrag_target_rate;		// adaptive defrag wblocks/sec, 0 means unthrottled
+	uint64_t		ticker_prev_defrag_done;	// for ticker's actual defrag rate
+	uint64_t		ticker_prev_us;
 
 	volatile uint64_t n_tomb_raider_reads;	// relevant for enterprise edition only
 
@@ -191,20 +289,36 @@ typedef struct drv_ssd_s
 
 	uint64_t		header_size;
 
-	uint32_t		cold_start_block_counter;		// large blocks read
-	uint64_t		record_add_older_counter;		// records not inserted due to better existing one
-	uint64_t		record_add_expired_counter;		// records not inserted due to expiration
-	uint64_t		record_add_max_ttl_counter;		// records not inserted due to max-ttl
-	uint64_t		record_add_replace_counter;		// records reinserted
-	uint64_t		record_add_unique_counter;		// records inserted
-	uint64_t		record_add_sigfail_counter;
+	cf_atomic32		cold_start_block_counter;		// large blocks read
+	cf_atomic64		record_add_older_counter;		// records not inserted due to better existing one
+	cf_atomic64		record_add_expired_counter;		// records not inserted due to expiration
+	cf_atomic64		record_add_max_ttl_counter;		// records not inserted due to max-ttl
+	cf_atomic64		record_add_replace_counter;		// records reinserted
+	cf_atomic64		record_add_unique_counter;		// records inserted
+	cf_atomic64		record_add_sigfail_counter;
+
+	uint64_t		load_next_offset;	// next cold start range to sweep
+	uint64_t		load_end_offset;	// cold start sweep stops here
 
 	ssd_alloc_table	*alloc_table;
 
+	// Zoned devices only - zone_n_wblocks is 0 if device isn't zoned.
+	uint32_t		zone_n_wblocks;		// wblocks spanned by each zone
+	uint32_t		zone_capacity;		// wblocks writable in each zone
+	uint32_t		first_zone_id;		// first zone used for data
+	uint32_t		n_zones;
+	pthread_mutex_t	zone_lock;			// protects free_wblock_q zone order, zone_n_free
+	uint32_t		*zone_n_free;		// freed wblocks awaiting their zone's reset
+	cf_queue		*zone_sweep_q;		// IDs of mostly empty zones to defrag
+	ssd_zone_cursor	zone_cursors[N_SWB_STREAMS];
+
+	// Persistent memory only - pmem_base is NULL if device isn't mapped.
+	uint8_t			*pmem_base;			// whole device, mapped shared
+	bool			pmem_sync;			// mapped with MAP_SYNC - flush cache lines, not msync
+
 	pthread_t		maintenance_thread;
 	pthread_t		write_worker_thread[MAX_SSD_THREADS];
 	pthread_t		shadow_worker_thread;
-	pthread_t		load_device_thread;
 	pthread_t		defrag_thread;
 
 	histogram		*hist_read;
@@ -212,6 +326,13 @@ typedef struct drv_ssd_s
 	histogram		*hist_write;
 	histogram		*hist_shadow_write;
 	histogram		*hist_fsync;
+	histogram		*hist_read_size;
+
+	ssd_io_depth	read_depth;			// client reads
+	ssd_io_depth	large_read_depth;	// defrag and sweep reads
+	ssd_io_depth	write_depth;		// wblock writes
+
+	cf_atomic32		io_in_flight[SSD_IO_N_CLASSES]; // I/O scheduler's view
 } drv_ssd;
 
 
@@ -227,6 +348,16 @@ typedef struct drv_ssds_s
 	// load a record.
 	bool get_state_from_storage[AS_PARTITIONS];
 
+	// Protects devices' cold start ranges while loader threads sweep them.
+	pthread_mutex_t		load_lock;
+
+	// Shared by all devices - keyed by file_id. NULL if not configured.
+	struct read_cache_s	*read_cache;
+
+	// Shared by all devices - hot records attached to index. NULL if not
+	// configured.
+	struct hot_tier_s	*hot_tier;
+
 	int					n_ssds;
 	drv_ssd				ssds[];
 } drv_ssds;
@@ -237,11 +368,31 @@ typedef struct drv_ssds_s
 //
 
 #define SSD_BLOCK_MAGIC		0x037AF200
+#define SSD_CHUNK_MAGIC		0x037AF201
 #define LENGTH_BASE			offsetof(struct drv_ssd_block_s, keyd)
 
+// Compressed blocks have compression = tag | dictionary set-id << 8 | method.
+// The tag distinguishes them from old blocks with a (deprecated) signature
+// here. Their data[] is a uint32_t compressed size then the compressed image
+// of the uncompressed data[], which is data_size bytes.
+//
+// Blocks are now written with a CRC32C of the whole block, skipping the
+// checksum itself. Uncompressed blocks have compression = SSD_CHECKSUM_TAG and
+// the checksum in data_size. Compressed blocks have SSD_COMPRESSION_CRC_TAG in
+// place of SSD_COMPRESSION_TAG, and the checksum follows the compressed size
+// in data[]. Blocks written before checksums can still be read.
+#define SSD_COMPRESSION_TAG			0xC0000000
+#define SSD_CHECKSUM_TAG			0xC1000000
+#define SSD_COMPRESSION_CRC_TAG		0xC2000000
+#define SSD_CHUNKED_TAG				0xC3000000
+#define SSD_COMPRESSION_TAG_MASK	0xFF000000
+#define SSD_COMPRESSION_SET_ID(_c)	(((_c) >> 8) & 0xFFFF)
+#define SSD_COMPRESSION_METHOD(_c)	((_c) & 0xFF)
+
 // Per-record metadata on device.
 typedef struct drv_ssd_block_s {
-	uint64_t		sig;			// deprecated
+	uint32_t		compression;	// 0 if not compressed
+	uint32_t		data_size;		// compressed blocks only
 	uint32_t		magic;
 	uint32_t		length;			// total after this field - this struct's pointer + 16
 	cf_digest		keyd;
@@ -253,8 +404,58 @@ typedef struct drv_ssd_block_s {
 	uint8_t			data[];
 } __attribute__ ((__packed__)) drv_ssd_block;
 
+static inline bool
+ssd_block_is_compressed(const drv_ssd_block *block)
+{
+	uint32_t tag = block->compression & SSD_COMPRESSION_TAG_MASK;
+
+	return tag == SSD_COMPRESSION_TAG || tag == SSD_COMPRESSION_CRC_TAG;
+}
+
+// Records too big for a wblock are split into chunks, each a block of its own
+// with SSD_CHUNK_MAGIC, the record's metadata, its chunk index in n_bins and
+// its data size in bins_offset. The chunks' data concatenated is the record's
+// (possibly compressed) block, checksummed as usual. The index points at the
+// record's head - a block with compression = SSD_CHUNKED_TAG, the checksum in
+// data_size, and a chunk table as data[].
+typedef struct ssd_chunk_ref_s {
+	uint64_t		rblock_id;
+	uint32_t		n_rblocks;
+	uint32_t		file_id;
+} __attribute__ ((__packed__)) ssd_chunk_ref;
+
+typedef struct ssd_chunk_table_s {
+	uint32_t		size;			// of the record's block
+	uint32_t		n_chunks;
+	ssd_chunk_ref	refs[];
+} __attribute__ ((__packed__)) ssd_chunk_table;
+
+static inline bool
+ssd_block_is_chunked(const drv_ssd_block *block)
+{
+	return (block->compression & SSD_COMPRESSION_TAG_MASK) == SSD_CHUNKED_TAG;
+}
+
+// Bytes before a compressed block's compressed image.
+static inline uint32_t
+ssd_block_compressed_header_size(const drv_ssd_block *block)
+{
+	return (block->compression & SSD_COMPRESSION_TAG_MASK) ==
+			SSD_COMPRESSION_CRC_TAG ?
+					sizeof(drv_ssd_block) + (2 * sizeof(uint32_t)) :
+					sizeof(drv_ssd_block) + sizeof(uint32_t);
+}
+
+// Checksums - verify returns true for blocks written without a checksum.
+void ssd_block_set_checksum(drv_ssd_block *block);
+bool ssd_block_verify_checksum(const drv_ssd_block *block, uint32_t max_size);
+
+// Result is a pooled I/O buffer - free with cf_io_buf_free(result, *p_size).
+drv_ssd_block *ssd_block_decompress(struct as_namespace_s *ns, const drv_ssd_block *block, uint32_t *p_size);
+
 // Warm restart.
 void ssd_resume_devices(drv_ssds *ssds);
+bool ssd_chunks_add_inuse(drv_ssd *ssd, uint64_t rblock_id, uint32_t n_rblocks);
 
 // Tomb raider.
 void ssd_cold_start_adjust_cenotaph(struct as_namespace_s *ns, const drv_ssd_block *block, struct as_index_s *r);
@@ -327,6 +528,24 @@ static inline uint32_t RBLOCK_ID_TO_WBLOCK_ID(drv_ssd *ssd, uint64_t rblock_id)
 #define LO_IO_MIN_SIZE 512
 #define HI_IO_MIN_SIZE 4096
 
+// The index flags a chunked record by adding this to its head's n_rblocks -
+// it's more rblocks than any single block can have (a maximal wblock's).
+#define SSD_CHUNKED_N_RBLOCKS	((1024 * 1024) / RBLOCK_SIZE)
+
+static inline bool
+ssd_n_rblocks_is_chunked(uint32_t n_rblocks)
+{
+	return n_rblocks > SSD_CHUNKED_N_RBLOCKS;
+}
+
+// Size of the block the index points at - for a chunked record, its head.
+static inline uint32_t
+ssd_head_n_rblocks(uint32_t n_rblocks)
+{
+	return ssd_n_rblocks_is_chunked(n_rblocks) ?
+			n_rblocks - SSD_CHUNKED_N_RBLOCKS : n_rblocks;
+}
+
 // Round bytes down to a multiple of device's minimum IO operation size.
 static inline uint64_t BYTES_DOWN_TO_IO_MIN(drv_ssd *ssd, uint64_t bytes) {
 	return bytes & -ssd->io_min_size;
@@ -0,0 +1,64 @@
+/*
+ * hot_tier.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Per-namespace hot tier, for data-not-in-memory namespaces. Records read from
+ * device keep a copy of their (uncompressed) device block attached to the
+ * index via r->dim - unused otherwise for these namespaces - so rereading a
+ * hot record needs neither a device read nor a lookup. Entries are evicted by
+ * CLOCK (second chance) when the configured byte budget is exceeded.
+ *
+ * Callers must hold the record lock for get/put/detach. Eviction only takes
+ * records whose lock it can get without waiting, so it never blocks a reader
+ * and never deadlocks against the caller's own record lock.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_index_s;
+struct as_namespace_s;
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef struct hot_tier_s hot_tier;
+
+
+//==========================================================
+// Public API.
+//
+
+hot_tier* hot_tier_create(struct as_namespace_s* ns);
+
+const uint8_t* hot_tier_get(hot_tier* tier, struct as_index_s* r);
+void hot_tier_put(hot_tier* tier, struct as_index_s* r, const uint8_t* data, uint32_t size);
+void* hot_tier_detach(hot_tier* tier, struct as_index_s* r, const uint8_t** p_data);
+void hot_tier_remove(hot_tier* tier, struct as_index_s* r);
@@ -0,0 +1,59 @@
+/*
+ * read_cache.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Per-namespace cache of records read from device, for data-not-in-memory
+ * namespaces. Entries are keyed by (file_id, rblock_id) and evicted by CLOCK
+ * (second chance) when the configured byte budget is exceeded.
+ *
+ * Callers must hold the record lock for get/put, and must remove an entry
+ * whenever its rblocks are freed, so a key never refers to stale data.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_namespace_s;
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef struct read_cache_s read_cache;
+
+
+//==========================================================
+// Public API.
+//
+
+read_cache* read_cache_create(struct as_namespace_s* ns);
+
+uint8_t* read_cache_get(read_cache* cache, uint32_t file_id, uint64_t rblock_id, uint32_t size);
+void read_cache_put(read_cache* cache, uint32_t file_id, uint64_t rblock_id, const uint8_t* data, uint32_t size);
+void read_cache_remove(read_cache* cache, uint32_t file_id, uint64_t rblock_id);
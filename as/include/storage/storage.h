@@ -28,6 +28,7 @@
 
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
+#include "citrusleaf/cf_vector.h"
 
 #include "base/rec_props.h"
 
@@ -35,6 +36,8 @@
 // Forward declarations.
 struct as_bin_s;
 struct as_index_s;
+struct as_index_ref_s;
+struct as_index_tree_s;
 struct as_partition_s;
 struct as_namespace_s;
 struct drv_ssd_s;
@@ -48,6 +51,13 @@ typedef enum {
 	AS_NUM_STORAGE_ENGINES
 } as_storage_type;
 
+// Whose device reads a thread makes - background classes yield to clients.
+typedef enum {
+	AS_STORAGE_IO_CLIENT	= 0, // default
+	AS_STORAGE_IO_MIGRATE	= 1,
+	AS_STORAGE_IO_SCAN		= 2  // scans and other background jobs
+} as_storage_io_class;
+
 typedef struct as_storage_rd_s {
 	struct as_index_s		*r;
 	struct as_namespace_s	*ns;
@@ -69,6 +79,7 @@ typedef struct as_storage_rd_s {
 	// Specific to storage type AS_STORAGE_ENGINE_SSD:
 	struct drv_ssd_block_s	*block;
 	uint8_t					*must_free_block;
+	uint32_t				must_free_size; // non-zero if must_free_block is a pooled I/O buffer
 	struct drv_ssd_s		*ssd;
 } as_storage_rd;
 
@@ -92,9 +103,24 @@ extern int as_storage_record_close(as_storage_rd *rd);
 // Called within as_storage_rd usage cycle.
 extern int as_storage_record_load_n_bins(as_storage_rd *rd);
 extern int as_storage_record_load_bins(as_storage_rd *rd);
+extern int as_storage_record_load_bins_named(as_storage_rd *rd, cf_vector *bin_names); // skips unpacking other bins
+extern int as_storage_record_load_multi(struct as_namespace_s *ns, as_storage_rd **rds, uint32_t n_rds); // coalesces device reads
+extern void as_storage_record_revalidate(as_storage_rd *rd); // drops data loaded before the record changed
+extern bool as_storage_record_verify(as_storage_rd *rd); // rereads from device, bypassing caches
 extern bool as_storage_record_size_and_check(as_storage_rd *rd);
 extern int as_storage_record_write(as_storage_rd *rd);
 
+// Sweep a device's records in physical order. The tree function returns the
+// index tree to validate a partition's records against, or NULL to skip them.
+// The record function gets each current record locked, with its rd open and
+// loaded - it must close the rd and release the record, and may return false
+// to stop the sweep.
+typedef struct as_index_tree_s* (*as_storage_sweep_tree_fn)(void *udata, uint32_t pid);
+typedef bool (*as_storage_sweep_record_fn)(void *udata, struct as_index_ref_s *r_ref, as_storage_rd *rd);
+
+extern uint32_t as_storage_n_devices(struct as_namespace_s *ns); // 0 if records aren't on devices
+extern bool as_storage_sweep_device(struct as_namespace_s *ns, uint32_t device_ix, as_storage_sweep_tree_fn tree_fn, as_storage_sweep_record_fn record_fn, void *udata);
+
 // Storage capacity monitoring.
 extern void as_storage_wait_for_defrag();
 extern bool as_storage_overloaded(struct as_namespace_s *ns); // returns true if write queue is too backed up
@@ -128,6 +154,10 @@ extern void as_storage_record_set_rec_props(as_storage_rd *rd, uint8_t* rec_prop
 // Called only at shutdown to flush all device write-queues.
 extern void as_storage_shutdown();
 
+// Class of the calling thread's device reads.
+extern void as_storage_set_io_class(as_storage_io_class io_class);
+extern as_storage_io_class as_storage_get_io_class();
+
 
 //------------------------------------------------
 // AS_STORAGE_ENGINE_MEMORY functions.
@@ -159,9 +189,16 @@ extern int as_storage_record_close_ssd(as_storage_rd *rd);
 
 extern int as_storage_record_load_n_bins_ssd(as_storage_rd *rd);
 extern int as_storage_record_load_bins_ssd(as_storage_rd *rd);
+extern int as_storage_record_load_bins_named_ssd(as_storage_rd *rd, cf_vector *bin_names);
+extern int as_storage_record_load_multi_ssd(as_storage_rd **rds, uint32_t n_rds);
+extern void as_storage_record_revalidate_ssd(as_storage_rd *rd);
+extern bool as_storage_record_verify_ssd(as_storage_rd *rd);
 extern bool as_storage_record_size_and_check_ssd(as_storage_rd *rd);
 extern int as_storage_record_write_ssd(as_storage_rd *rd);
 
+extern uint32_t as_storage_n_devices_ssd(struct as_namespace_s *ns);
+extern bool as_storage_sweep_device_ssd(struct as_namespace_s *ns, uint32_t device_ix, as_storage_sweep_tree_fn tree_fn, as_storage_sweep_record_fn record_fn, void *udata);
+
 extern void as_storage_wait_for_defrag_ssd(struct as_namespace_s *ns);
 extern bool as_storage_overloaded_ssd(struct as_namespace_s *ns);
 extern bool as_storage_has_space_ssd(struct as_namespace_s *ns);
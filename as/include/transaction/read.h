@@ -27,6 +27,7 @@
 //
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "base/cfg.h"
 #include "base/transaction.h"
@@ -38,6 +39,7 @@
 //
 
 transaction_status as_read_start(as_transaction* tr);
+void as_read_start_multi(as_transaction** trs, uint32_t n_trs);
 
 static inline bool
 as_read_must_duplicate_resolve(const as_transaction* tr)
@@ -29,6 +29,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "citrusleaf/cf_digest.h"
+
 #include "msg.h"
 #include "node.h"
 
@@ -39,6 +41,7 @@
 // Forward declarations.
 //
 
+struct as_partition_reservation_s;
 struct as_transaction_s;
 struct rw_request_s;
 
@@ -52,3 +55,5 @@ void repl_write_setup_rw(struct rw_request_s* rw, struct as_transaction_s* tr, r
 void repl_write_reset_rw(struct rw_request_s* rw, struct as_transaction_s* tr, repl_write_done_cb cb);
 void repl_write_handle_op(cf_node node, msg* m);
 void repl_write_handle_ack(cf_node node, msg* m);
+void repl_write_send_drops(struct as_partition_reservation_s* rsv, const cf_digest* keyds, uint32_t n_keyds);
+void repl_write_handle_drops(cf_node node, msg* m);
@@ -39,6 +39,7 @@
 #include "dynbuf.h"
 #include "msg.h"
 #include "node.h"
+#include "obj_pool.h"
 
 #include "base/proto.h"
 #include "base/rec_props.h"
@@ -184,7 +185,7 @@ rw_request_release(rw_request* rw)
 {
 	if (cf_rc_release(rw) == 0) {
 		rw_request_destroy(rw);
-		cf_rc_free(rw);
+		cf_pool_rc_free(rw);
 	}
 }
 
@@ -75,6 +75,7 @@ typedef enum {
 #define RW_OP_WRITE_ACK 2
 #define RW_OP_DUP 3
 #define RW_OP_DUP_ACK 4
+#define RW_OP_DROPS 5 // batched replica drops, not acked
 
 #define RW_INFO_XDR				0x0001
 #define RW_INFO_UNUSED_2		0x0002 // was RW_INFO_MIGRATE
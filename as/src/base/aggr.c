@@ -22,6 +22,7 @@
 
 #include "base/aggr.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -46,6 +47,8 @@
 #define AS_AGGR_ERR  -1
 #define AS_AGGR_OK    0
 
+#define AGGR_OUT_BATCH_SZ 64 // output values handed to ostream_write_batch at once
+
 /*
  * Aggregation Stream Object
  */
@@ -65,6 +68,11 @@ typedef struct {
 	// Module Data
 	as_aggr_call          * call;   // Aggregation info
 	void                  * udata;  // Execution context
+
+	// Output batch
+	as_val                * out_vals[AGGR_OUT_BATCH_SZ];
+	uint32_t                n_out_vals;
+	as_stream_status        out_status;
 } aggr_state;
 
 static as_partition_reservation *
@@ -241,11 +249,46 @@ const as_stream_hooks istream_hooks = {
  * Aggregation Output Stream
  */
 // **************************************************************************************************
+static void
+ostream_flush(aggr_state *astate)
+{
+	if (astate->n_out_vals == 0) {
+		return;
+	}
+
+	as_stream_status status = astate->call->aggr_hooks->ostream_write_batch(
+			astate->udata, astate->out_vals, astate->n_out_vals);
+
+	astate->n_out_vals = 0;
+
+	if (status != AS_STREAM_OK) {
+		astate->out_status = status;
+	}
+}
+
+// Buffers values if the caller can take them in batches - saves per-value
+// locking of the response buffer.
 as_stream_status
 ostream_write(const as_stream *s, as_val *val)
 {
 	aggr_state *astate = (aggr_state *)as_stream_source(s);
-	return astate->call->aggr_hooks->ostream_write(astate->udata, val);
+	const as_aggr_hooks *hooks = astate->call->aggr_hooks;
+
+	if (!hooks->ostream_write_batch) {
+		return hooks->ostream_write(astate->udata, val);
+	}
+
+	if (!val) {
+		return astate->out_status;
+	}
+
+	astate->out_vals[astate->n_out_vals++] = val;
+
+	if (astate->n_out_vals == AGGR_OUT_BATCH_SZ) {
+		ostream_flush(astate);
+	}
+
+	return astate->out_status;
 }
 
 const as_stream_hooks ostream_hooks = {
@@ -305,7 +348,9 @@ as_aggr_process(as_namespace *ns, as_aggr_call * ag_call, cf_ll * ap_recl, void
 		.udata           = udata,
 		.rec_open        = false,
 		.rsv             = &tr.rsv,
-		.ns              = ns
+		.ns              = ns,
+		.n_out_vals      = 0,
+		.out_status      = AS_STREAM_OK
 	};
 
 	if (!astate.iter) {
@@ -332,6 +377,74 @@ as_aggr_process(as_namespace *ns, as_aggr_call * ag_call, cf_ll * ap_recl, void
 	};
 	int ret = as_module_apply_stream(&mod_lua, &ctx, ag_call->def.filename, ag_call->def.function, &istream, ag_call->def.arglist, &ostream, ap_res);
 
+	ostream_flush(&astate);
 	acleanup(&astate);
 	return ret;
 }
+
+
+/*
+ * Aggregation Lanes
+ */
+// **************************************************************************************************
+typedef struct {
+	as_namespace          * ns;
+	as_aggr_call          * call;
+	as_aggr_lane          * lane;
+} aggr_lane_ctx;
+
+static void
+lane_process(aggr_lane_ctx *ctx)
+{
+	ctx->lane->ret = as_aggr_process(ctx->ns, ctx->call, &ctx->lane->recl, ctx->lane->udata, &ctx->lane->result);
+}
+
+static void *
+run_lane(void *udata)
+{
+	lane_process((aggr_lane_ctx *)udata);
+	return NULL;
+}
+
+// Runs each non-empty lane's stream concurrently - lane 0 on the caller's
+// thread, the others on their own. Lua states come from mod_lua's cache, so
+// each concurrent stream gets a state of its own. Returns when all are done,
+// leaving the caller to merge the lanes' results in lane order.
+void
+as_aggr_process_lanes(as_namespace *ns, as_aggr_call *ag_call, as_aggr_lane *lanes, uint32_t n_lanes)
+{
+	aggr_lane_ctx ctxs[AS_AGGR_MAX_LANES];
+	pthread_t threads[AS_AGGR_MAX_LANES];
+	bool started[AS_AGGR_MAX_LANES] = { false };
+
+	for (uint32_t i = 0; i < n_lanes; i++) {
+		lanes[i].ret = 0;
+		ctxs[i] = (aggr_lane_ctx){ .ns = ns, .call = ag_call, .lane = &lanes[i] };
+	}
+
+	for (uint32_t i = 1; i < n_lanes; i++) {
+		if (cf_ll_size(&lanes[i].recl) == 0) {
+			continue;
+		}
+
+		if (pthread_create(&threads[i], NULL, run_lane, &ctxs[i]) == 0) {
+			started[i] = true;
+		}
+		else {
+			cf_warning(AS_AGGR, "failed to create aggregation lane thread - running inline");
+		}
+	}
+
+	if (cf_ll_size(&lanes[0].recl) != 0) {
+		lane_process(&ctxs[0]);
+	}
+
+	for (uint32_t i = 1; i < n_lanes; i++) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		}
+		else if (cf_ll_size(&lanes[i].recl) != 0) {
+			lane_process(&ctxs[i]);
+		}
+	}
+}
@@ -36,6 +36,7 @@
 
 #include "citrusleaf/alloc.h"
 
+#include "coarse_clock.h"
 #include "daemon.h"
 #include "fault.h"
 #include "hardware.h"
@@ -176,6 +177,7 @@ extern void as_nsup_start();
 static void write_pidfile(char *pidfile);
 static void validate_directory(const char *path, const char *log_tag);
 static void validate_smd_directory();
+static uint64_t log_startup_phase(const char *phase, uint64_t start_ms);
 
 
 //==========================================================
@@ -348,27 +350,40 @@ main(int argc, char **argv)
 	// starting worker threads, etc. (But no communication with other server
 	// nodes or clients yet.)
 
+	uint64_t phase_ms = cf_getms();
+
+	cf_coarse_clock_init();		// cached clock for the transaction path
 	as_json_init();				// Jansson JSON API used by System Metadata
 	as_smd_init();				// System Metadata first - others depend on it
 	as_index_tree_gc_init();	// thread to purge dropped index trees
 	as_sindex_thr_init();		// defrag secondary index (ok during population)
 
+	phase_ms = log_startup_phase("system metadata", phase_ms);
+
 	// Initialize namespaces. Each namespace decides here whether it will do a
 	// warm or cold start. Index arenas, partition structures and index tree
 	// structures are initialized. Secondary index system metadata is restored.
 	as_namespaces_init(cold_start_cmd, instance);
 
+	phase_ms = log_startup_phase("namespaces", phase_ms);
+
 	// Initialize the storage system. For cold starts, this includes reading
-	// all the objects off the drives. This may block for a long time. The
-	// defrag subsystem starts operating at the end of this call.
+	// all the objects off the drives, and populating secondary indexes as they
+	// are read. This may block for a long time. The defrag subsystem starts
+	// operating at the end of this call.
 	as_storage_init();
 
+	phase_ms = log_startup_phase("storage", phase_ms);
+
 	// Migrate memory to correct NUMA node (includes restored index arenas).
 	cf_topo_migrate_memory();
 
-	// Populate all secondary indexes. This may block for a long time.
+	// Populate all secondary indexes after warm restart - cold starts did it
+	// while loading. This may block for a long time.
 	as_sindex_boot_populateall();
 
+	phase_ms = log_startup_phase("secondary indexes", phase_ms);
+
 	cf_info(AS_AS, "initializing services...");
 
 	as_netio_init();
@@ -390,10 +405,14 @@ main(int argc, char **argv)
 	as_xdr_init();				// cross data-center replication
 	as_mon_init();				// monitor
 
+	phase_ms = log_startup_phase("services", phase_ms);
+
 	// Wait for enough available storage. We've been defragging all along, but
 	// here we wait until it's enough. This may block for a long time.
 	as_storage_wait_for_defrag();
 
+	log_startup_phase("defrag", phase_ms);
+
 	// Start subsystems. At this point we may begin communicating with other
 	// cluster nodes, and ultimately with clients.
 
@@ -414,6 +433,9 @@ main(int argc, char **argv)
 	// Log a service-ready message.
 	cf_info(AS_AS, "service ready: soon there will be cake!");
 
+	// If configured, logging goes asynchronous from here on.
+	cf_fault_async_start();
+
 	//--------------------------------------------
 	// Startup is done. This thread will now wait
 	// quietly for a shutdown signal.
@@ -517,3 +539,14 @@ validate_smd_directory()
 	strcpy(smd_path + len, SMD_DIR_NAME);
 	validate_directory(smd_path, "system metadata");
 }
+
+// Returns the time the next phase starts.
+static uint64_t
+log_startup_phase(const char *phase, uint64_t start_ms)
+{
+	uint64_t now_ms = cf_getms();
+
+	cf_info(AS_AS, "startup: %s took %lu ms", phase, now_ms - start_ms);
+
+	return now_ms;
+}
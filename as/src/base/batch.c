@@ -31,14 +31,21 @@
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
+#include "base/packet_compression.h"
+#include "base/predexp.h"
 #include "base/proto.h"
 #include "base/security.h"
 #include "base/stats.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
+#include "fabric/partition.h"
+#include "storage/storage.h"
 #include "hardware.h"
+#include "hist.h"
+#include "obj_pool.h"
 #include "socket.h"
 #include <errno.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 //---------------------------------------------------------
@@ -48,6 +55,9 @@
 #define BATCH_BLOCK_SIZE (1024 * 128) // 128K
 #define BATCH_MAX_TRANSACTION_SIZE (1024 * 1024 * 10) // 10MB
 #define BATCH_REPEAT_SIZE 25  // index(4),digest(20) and repeat(1)
+#define BATCH_RESULTS_PER_BUFFER 16 // aim for buffers this many average results big
+#define BATCH_MAX_ADAPTIVE_SIZE (1024 * 1024) // 1M
+#define BATCH_MAX_GROUP_SIZE 64 // sub-transactions sharing a partition reservation
 
 //---------------------------------------------------------
 // TYPES
@@ -75,16 +85,40 @@ typedef struct {
 	uint8_t data[];
 } __attribute__((__packed__)) as_batch_buffer;
 
+// Sub-transaction held back so it can be queued with others on its partition,
+// and so the batch doesn't flood the transaction queues.
+typedef struct {
+	as_namespace* ns;
+	uint32_t pid;
+	uint32_t row;
+	cl_msg* msgp;
+	uint32_t msg_fields;
+	uint32_t batch_index;
+	cf_digest keyd;
+	bool group;
+} as_batch_pending;
+
 struct as_batch_shared_s {
 	pthread_mutex_t lock;
 	cf_queue* response_queue;
 	as_file_handle* fd_h;
+	as_namespace* ns; // of first key - decides response compression
 	cl_msg* msgp;
 	as_batch_buffer* buffer;
 	uint64_t start;
 	uint32_t tran_count_response;
 	uint32_t tran_count;
 	uint32_t tran_max;
+	uint64_t result_bytes; // reserved so far - average sizes new buffers
+	uint64_t sent_bytes;
+	uint64_t sent_capacity;
+	uint64_t benchmark_time;
+	predexp_eval_t* predexp; // applied to every read row, if present
+	as_batch_pending* pending; // sub-transactions not yet queued, in queue order
+	uint32_t n_pending;
+	uint32_t next_pending;
+	uint32_t n_released; // sub-transactions queued from pending
+	uint32_t n_done_base; // tran_count when pending was first released
 	int result_code;
 	bool bad_response_fd;
 };
@@ -178,13 +212,29 @@ as_batch_send_buffer(as_batch_shared* shared, as_batch_buffer* buffer)
 		return;
 	}
 
+	shared->sent_bytes += buffer->size;
+	shared->sent_capacity += buffer->capacity;
+	cf_atomic64_incr(&g_stats.batch_index_sent_buffers);
+
 	// Send buffer block to client socket.
 	buffer->proto.version = PROTO_VERSION;
 	buffer->proto.type = PROTO_TYPE_AS_MSG;
 	buffer->proto.sz = buffer->size;
 	as_proto_swap(&buffer->proto);
 
-	int status = as_batch_send(&shared->fd_h->sock, (uint8_t*)&buffer->proto, sizeof(as_proto) + buffer->size, MSG_NOSIGNAL | MSG_MORE);
+	uint8_t* packet = (uint8_t*)&buffer->proto;
+	size_t packet_sz = sizeof(as_proto) + buffer->size;
+	size_t compressed_sz;
+	uint8_t* compressed = as_packet_compress_response(shared->fd_h, shared->ns, packet, packet_sz, &compressed_sz);
+	int status;
+
+	if (compressed) {
+		status = as_batch_send(&shared->fd_h->sock, compressed, compressed_sz, MSG_NOSIGNAL | MSG_MORE);
+		cf_free(compressed);
+	}
+	else {
+		status = as_batch_send(&shared->fd_h->sock, packet, packet_sz, MSG_NOSIGNAL | MSG_MORE);
+	}
 
 	if (status) {
 		// Socket error. Release shared->fd_h after all sub-transactions are
@@ -232,6 +282,12 @@ as_batch_send_final(as_batch_shared* shared)
 		G_HIST_ACTIVATE_INSERT_DATA_POINT(batch_index_hist, shared->start);
 	}
 
+	if (shared->sent_capacity != 0) {
+		g_stats.batch_index_fill_hist_active = true;
+		histogram_insert_raw(g_stats.batch_index_fill_hist,
+				(shared->sent_bytes * 100) / shared->sent_capacity);
+	}
+
 	// Check final return code in order to update statistics.
 	if (status == 0 && shared->result_code == 0) {
 		cf_atomic64_incr(&g_stats.batch_index_complete);
@@ -253,8 +309,14 @@ as_batch_free(as_batch_shared* shared, as_batch_queue* batch_queue)
 	pthread_mutex_destroy(&shared->lock);
 
 	// Release memory
+	if (shared->pending) {
+		cf_free(shared->pending);
+	}
+	if (shared->predexp) {
+		predexp_destroy(shared->predexp);
+	}
 	cf_free(shared->msgp);
-	cf_free(shared);
+	cf_pool_free(shared);
 
 	// It's critical that this count is decremented after the transaction is
 	// completely finished with the queue because "shutdown threads" relies
@@ -273,6 +335,8 @@ as_batch_worker(void* udata)
 	as_batch_shared* shared;
 	as_batch_buffer* buffer;
 
+	cf_thread_set_role("batch");
+
 	while (cf_queue_pop(response_queue, &response, CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
 		// Check if this thread task should end.
 		shared = response.shared;
@@ -434,18 +498,46 @@ as_batch_buffer_create(uint32_t size)
 	return buffer;
 }
 
+// Returns the size of a buffer big enough for several more of this batch's
+// results, so large records don't each end up in a mostly empty pool buffer.
+// Never less than the pool buffer size - pool buffers can't shrink.
+static uint32_t
+as_batch_adaptive_size(as_batch_shared* shared, uint32_t size)
+{
+	if (shared->tran_count == 0) {
+		return size;
+	}
+
+	uint64_t avg = shared->result_bytes / shared->tran_count;
+	uint64_t n_left = shared->tran_max - shared->tran_count + 1;
+	uint64_t want = avg * (n_left < BATCH_RESULTS_PER_BUFFER ? n_left : BATCH_RESULTS_PER_BUFFER);
+
+	if (want > BATCH_MAX_ADAPTIVE_SIZE) {
+		want = BATCH_MAX_ADAPTIVE_SIZE;
+	}
+
+	return want > size ? (uint32_t)want : size;
+}
+
 static uint8_t*
 as_batch_buffer_pop(as_batch_shared* shared, uint32_t size)
 {
 	as_batch_buffer* buffer;
 	uint32_t mem_size = size + batch_buffer_pool.header_size;
+	uint32_t adaptive_size = as_batch_adaptive_size(shared, size) + batch_buffer_pool.header_size;
 
 	if (mem_size > batch_buffer_pool.buffer_size) {
 		// Requested size is greater than fixed buffer size.
 		// Allocate new buffer, but don't put back into pool.
-		buffer = as_batch_buffer_create(mem_size);
+		buffer = as_batch_buffer_create(adaptive_size);
 		cf_atomic64_incr(&g_stats.batch_index_huge_buffers);
 	}
+	else if (adaptive_size > batch_buffer_pool.buffer_size) {
+		// This batch's results are big - a bigger buffer means fewer, fuller
+		// sends. Like huge buffers, it's freed rather than pooled after use.
+		buffer = as_batch_buffer_create(adaptive_size);
+		cf_atomic64_incr(&g_stats.batch_index_adaptive_buffers);
+	}
 	else {
 		// Pop existing buffer from queue.
 		// The extra lock here is unavoidable.
@@ -498,6 +590,7 @@ as_batch_reserve(as_batch_shared* shared, uint32_t size, int result_code, as_bat
 
 	pthread_mutex_lock(&shared->lock);
 	*complete = (++shared->tran_count == shared->tran_max);
+	shared->result_bytes += size;
 	buffer = shared->buffer;
 
 	if (! buffer) {
@@ -536,9 +629,165 @@ as_batch_reserve(as_batch_shared* shared, uint32_t size, int result_code, as_bat
 	return data;
 }
 
+static int
+as_batch_pending_compare(const void* pa, const void* pb)
+{
+	const as_batch_pending* a = (const as_batch_pending*)pa;
+	const as_batch_pending* b = (const as_batch_pending*)pb;
+
+	if (a->ns != b->ns) {
+		// Unknown namespaces first - they just get an error.
+		uint32_t a_ix = a->ns ? a->ns->id : 0;
+		uint32_t b_ix = b->ns ? b->ns->id : 0;
+
+		return a_ix < b_ix ? -1 : 1;
+	}
+
+	if (a->pid != b->pid) {
+		return a->pid < b->pid ? -1 : 1;
+	}
+
+	// Keep request order within a partition.
+	return a->row < b->row ? -1 : (a->row > b->row ? 1 : 0);
+}
+
+static inline void
+as_batch_pending_to_tr(as_transaction* tr, const as_batch_pending* p)
+{
+	tr->msgp = p->msgp;
+	tr->msg_fields = p->msg_fields;
+	tr->from_data.batch_index = p->batch_index;
+	tr->keyd = p->keyd;
+}
+
+// Returns the end of the unit starting at begin - a run of keys on the same
+// partition that will be queued as one transaction, or a lone key.
+static uint32_t
+as_batch_pending_unit_end(const as_batch_pending* pending, uint32_t begin, uint32_t n_pending)
+{
+	const as_batch_pending* first = &pending[begin];
+	uint32_t end = begin + 1;
+
+	if (! first->group) {
+		return end;
+	}
+
+	while (end < n_pending && end - begin < BATCH_MAX_GROUP_SIZE && pending[end].group &&
+			pending[end].ns == first->ns && pending[end].pid == first->pid) {
+		end++;
+	}
+
+	return end;
+}
+
+static void
+as_batch_queue_pending(as_transaction* tr, as_batch_pending* pending, uint32_t n_pending)
+{
+	uint32_t i = 0;
+
+	while (i < n_pending) {
+		as_batch_pending* first = &pending[i];
+		uint32_t n = as_batch_pending_unit_end(pending, i, n_pending) - i;
+
+		as_batch_group* group = n == 1 ? NULL :
+				cf_malloc(sizeof(as_batch_group) + sizeof(as_transaction) * n);
+
+		if (! group) {
+			// Lone key, or no memory - queue sub-transactions one by one.
+			for (uint32_t j = 0; j < n; j++) {
+				as_batch_pending_to_tr(tr, &first[j]);
+				as_tsvc_enqueue(tr);
+			}
+
+			i += n;
+			continue;
+		}
+
+		group->ns = first->ns;
+		group->pid = first->pid;
+		group->n_trs = n;
+
+		for (uint32_t j = 0; j < n; j++) {
+			as_transaction_copy_head(&group->trs[j], tr);
+			as_batch_pending_to_tr(&group->trs[j], &first[j]);
+		}
+
+		// Queue the group as one transaction - the head is only a carrier.
+		as_transaction gtr;
+
+		as_transaction_copy_head(&gtr, tr);
+		as_batch_pending_to_tr(&gtr, first);
+		gtr.from_flags |= FROM_FLAG_BATCH_GROUP;
+		gtr.from.batch_group = group;
+
+		as_tsvc_enqueue(&gtr);
+
+		i += n;
+	}
+}
+
+// Queue as many held back sub-transactions as batch-max-sub-in-flight allows.
+// Caller must guarantee shared outlives the call - once the last ones are
+// queued, shared may be freed as soon as the lock is released.
+static void
+as_batch_release_pending(as_batch_shared* shared)
+{
+	uint32_t max_in_flight = g_config.batch_max_sub_in_flight;
+
+	pthread_mutex_lock(&shared->lock);
+
+	uint32_t begin = shared->next_pending;
+	uint32_t end = begin;
+
+	if (max_in_flight == 0) {
+		end = shared->n_pending;
+	}
+	else {
+		uint32_t n_done = shared->tran_count - shared->n_done_base;
+		uint32_t n_in_flight = shared->n_released > n_done ? shared->n_released - n_done : 0;
+
+		// Always release whole units - a unit may overshoot the cap.
+		while (end < shared->n_pending && n_in_flight + (end - begin) < max_in_flight) {
+			end = as_batch_pending_unit_end(shared->pending, end, shared->n_pending);
+		}
+	}
+
+	uint32_t n = end - begin;
+	as_batch_pending* release = n == 0 ? NULL : cf_malloc(sizeof(as_batch_pending) * n);
+
+	if (! release) {
+		pthread_mutex_unlock(&shared->lock);
+		return; // nothing to do, or try again on the next result
+	}
+
+	memcpy(release, &shared->pending[begin], sizeof(as_batch_pending) * n);
+	shared->next_pending = end;
+	shared->n_released += n;
+
+	as_transaction tr;
+	as_transaction_init_head(&tr, 0, 0);
+
+	tr.origin = FROM_BATCH;
+	tr.from_flags |= FROM_FLAG_BATCH_SUB;
+	tr.from.batch_shared = shared;
+	tr.start_time = shared->start;
+	tr.benchmark_time = shared->benchmark_time;
+
+	pthread_mutex_unlock(&shared->lock);
+
+	as_batch_queue_pending(&tr, release, n);
+	cf_free(release);
+}
+
 static inline void
 as_batch_transaction_end(as_batch_shared* shared, as_batch_buffer* buffer, bool complete)
 {
+	// Our result keeps the batch alive until its buffer is complete. Checking
+	// outside the lock may miss a release - a later result will do it.
+	if (shared->next_pending < shared->n_pending) {
+		as_batch_release_pending(shared);
+	}
+
 	// This flush can only be triggered when the buffer is full.
 	as_batch_buffer_complete(shared, buffer);
 
@@ -663,6 +912,7 @@ as_batch_queue_task(as_transaction* btr)
 	as_msg_field* mf = (as_msg_field*)bmsg->data;
 	as_msg_field* end;
 	as_msg_field* bf = 0;
+	as_msg_field* pf = NULL;
 
 	for (int i = 0; i < bmsg->n_fields; i++) {
 		if ((uint8_t*)mf >= limit) {
@@ -672,9 +922,13 @@ as_batch_queue_task(as_transaction* btr)
 		as_msg_swap_field(mf);
 		end = as_msg_field_get_next(mf);
 
-		if (mf->type == AS_MSG_FIELD_TYPE_BATCH || mf->type == AS_MSG_FIELD_TYPE_BATCH_WITH_SET) {
+		if (mf->type == AS_MSG_FIELD_TYPE_BATCH || mf->type == AS_MSG_FIELD_TYPE_BATCH_WITH_SET ||
+				mf->type == AS_MSG_FIELD_TYPE_BATCH_WRITE) {
 			bf = mf;
 		}
+		else if (mf->type == AS_MSG_FIELD_TYPE_PREDEXP) {
+			pf = mf;
+		}
 		mf = end;
 	}
 
@@ -683,6 +937,9 @@ as_batch_queue_task(as_transaction* btr)
 		return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_PARAMETER);
 	}
 
+	// Batch writes apply the parent's write policy to every row.
+	bool is_write = bf->type == AS_MSG_FIELD_TYPE_BATCH_WRITE;
+
 	// Parse batch field
 	uint8_t* data = bf->data;
 	uint32_t tran_count = cf_swap_from_be32(*(uint32_t*)data);
@@ -698,19 +955,32 @@ as_batch_queue_task(as_transaction* btr)
 		return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_BATCH_MAX_REQUESTS);
 	}
 
-	// Initialize shared data
-	as_batch_shared* shared = cf_malloc(sizeof(as_batch_shared));
+	// A predicate expression filters read rows - built once, shared by all.
+	predexp_eval_t* predexp = NULL;
 
-	if (! shared) {
-		cf_warning(AS_BATCH, "Batch shared malloc failed");
-		return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_UNKNOWN);
+	if (pf) {
+		if (is_write) {
+			cf_warning(AS_BATCH, "Batch writes do not support predexp filters");
+			return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_PARAMETER);
+		}
+
+		if (! (predexp = predexp_build(pf))) {
+			cf_warning(AS_BATCH, "Batch predexp build failed");
+			return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_PARAMETER);
+		}
 	}
 
+	// Initialize shared data
+	as_batch_shared* shared = cf_pool_alloc(sizeof(as_batch_shared));
+
 	memset(shared, 0, sizeof(as_batch_shared));
 
 	if (pthread_mutex_init(&shared->lock, NULL)) {
 		cf_warning(AS_BATCH, "Failed to initialize batch lock");
-		cf_free(shared);
+		if (predexp) {
+			predexp_destroy(predexp);
+		}
+		cf_pool_free(shared);
 		return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_UNKNOWN);
 	}
 
@@ -718,6 +988,8 @@ as_batch_queue_task(as_transaction* btr)
 	shared->fd_h = btr->from.proto_fd_h;
 	shared->msgp = btr->msgp;
 	shared->tran_max = tran_count;
+	shared->benchmark_time = btr->benchmark_time;
+	shared->predexp = predexp;
 
 	// Find batch queue to send transaction responses.
 	as_batch_queue* batch_queue = &batch_queues[queue_index];
@@ -731,7 +1003,10 @@ as_batch_queue_task(as_transaction* btr)
 
 		if (! batch_queue) {
 			cf_warning(AS_BATCH, "Failed to find active batch queue that is not full");
-			cf_free(shared);
+			if (predexp) {
+				predexp_destroy(predexp);
+			}
+			cf_pool_free(shared);
 			return as_batch_send_error(btr, AS_PROTO_RESULT_FAIL_BATCH_QUEUES_FULL);
 		}
 	}
@@ -754,8 +1029,12 @@ as_batch_queue_task(as_transaction* btr)
 	as_msg_op* op;
 	uint32_t tran_row = 0;
 	uint8_t info = *data++;  // allow transaction inline.
+	as_namespace* row_ns = NULL;
+	as_namespace* group_ns = NULL;
+	as_batch_pending* pending = NULL;
+	uint32_t n_pending = 0;
 
-	bool allow_inline = (g_config.n_namespaces_in_memory != 0 && info);
+	bool allow_inline = (g_config.n_namespaces_in_memory != 0 && info && ! is_write);
 	bool check_inline = (allow_inline && g_config.n_namespaces_not_in_memory != 0);
 	bool should_inline = (allow_inline && g_config.n_namespaces_not_in_memory == 0);
 
@@ -794,12 +1073,12 @@ as_batch_queue_task(as_transaction* btr)
 
 			out->msg.header_sz = sizeof(as_msg);
 			out->msg.info1 = in->info1;
-			out->msg.info2 = 0;
-			out->msg.info3 = 0;
+			out->msg.info2 = is_write ? (bmsg->info2 | AS_MSG_INFO2_WRITE) : 0;
+			out->msg.info3 = is_write ? (bmsg->info3 & ~AS_MSG_INFO3_LAST) : 0;
 			out->msg.unused = 0;
 			out->msg.result_code = 0;
-			out->msg.generation = 0;
-			out->msg.record_ttl = 0;
+			out->msg.generation = is_write ? bmsg->generation : 0; // already swapped
+			out->msg.record_ttl = is_write ? bmsg->record_ttl : 0; // already swapped
 			out->msg.transaction_ttl = bmsg->transaction_ttl; // already swapped
 			// n_fields/n_ops is in exact same place on both input/output, but the value still
 			// needs to be swapped.
@@ -816,10 +1095,19 @@ as_batch_queue_task(as_transaction* btr)
 			data += sizeof(cl_msg);
 			mf = (as_msg_field*)data;
 			as_msg_swap_field(mf);
+			as_namespace* ns = as_namespace_get_bymsgfield(mf);
+
+			if (! shared->ns) {
+				// Set before the first sub-transaction is queued.
+				shared->ns = ns;
+			}
 			if (check_inline) {
-				as_namespace* ns = as_namespace_get_bymsgfield(mf);
 				should_inline = ns && ns->storage_data_in_memory;
 			}
+			row_ns = ns;
+			// Only device reads are worth grouping by partition.
+			group_ns = (ns && ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+					! ns->storage_data_in_memory) ? ns : NULL;
 			mf = as_msg_field_get_next(mf);
 			data = (uint8_t*)mf;
 
@@ -829,8 +1117,9 @@ as_batch_queue_task(as_transaction* btr)
 					goto TranEnd;
 				}
 
-				if (mf->type == AS_MSG_FIELD_TYPE_SET) {
-					as_transaction_set_msg_field_flag(&tr, AS_MSG_FIELD_TYPE_SET);
+				// Write rows may also carry a key to store, or a UDF call.
+				if (mf->type == AS_MSG_FIELD_TYPE_SET || is_write) {
+					as_transaction_set_msg_field_flag(&tr, mf->type);
 				}
 
 				as_msg_swap_field(mf);
@@ -869,13 +1158,47 @@ as_batch_queue_task(as_transaction* btr)
 			as_tsvc_process_transaction(&tr);
 		}
 		else {
-			// Queue transaction to be processed by a transaction thread.
-			as_tsvc_enqueue(&tr);
+			if (! pending) {
+				pending = cf_malloc(sizeof(as_batch_pending) * (tran_count - tran_row));
+			}
+
+			if (pending) {
+				as_batch_pending* p = &pending[n_pending++];
+
+				p->ns = row_ns;
+				p->pid = as_partition_getid(&tr.keyd);
+				p->row = tran_row;
+				p->msgp = tr.msgp;
+				p->msg_fields = tr.msg_fields;
+				p->batch_index = tr.from_data.batch_index;
+				p->keyd = tr.keyd;
+				p->group = group_ns && (is_write || (tr.msgp->msg.info1 & AS_MSG_INFO1_READ) != 0);
+			}
+			else {
+				// Queue transaction to be processed by a transaction thread.
+				as_tsvc_enqueue(&tr);
+			}
 		}
 		tran_row++;
 	}
 
 TranEnd:
+	if (pending) {
+		// Sort so sub-transactions on the same partition are adjacent. Storage
+		// orders each group's reads by device and offset.
+		qsort(pending, n_pending, sizeof(as_batch_pending), as_batch_pending_compare);
+
+		pthread_mutex_lock(&shared->lock);
+		shared->pending = pending;
+		shared->n_pending = n_pending;
+		shared->n_done_base = shared->tran_count;
+		pthread_mutex_unlock(&shared->lock);
+
+		// Unreleased rows keep shared alive through the call. The rest are
+		// released as results come in.
+		as_batch_release_pending(shared);
+	}
+
 	if (tran_row < tran_count) {
 		// Mismatch between tran_count and actual data.  Terminate transaction.
 		cf_warning(AS_BATCH, "Batch keys mismatch. Expected %u Received %u", tran_count, tran_row);
@@ -982,6 +1305,20 @@ as_batch_add_result(as_transaction* tr, uint16_t n_bins, as_bin** bins,
 	as_batch_transaction_end(shared, buffer, complete);
 }
 
+// For batch writes - db holds the response made for a single-record client,
+// if there is more to it than the result code and metadata.
+void
+as_batch_add_made_result(as_transaction* tr, cf_dyn_buf* db)
+{
+	if (db && db->used_sz != 0) {
+		as_batch_add_proxy_result(tr->from.batch_shared, tr->from_data.batch_index,
+				&tr->keyd, (cl_msg*)db->buf, db->used_sz);
+	}
+	else {
+		as_batch_add_result(tr, 0, NULL, NULL);
+	}
+}
+
 void
 as_batch_add_proxy_result(as_batch_shared* shared, uint32_t index, cf_digest* digest, cl_msg* cmsg, size_t proxy_size)
 {
@@ -1158,3 +1495,9 @@ as_batch_get_fd_h(as_batch_shared* shared)
 {
 	return shared->fd_h;
 }
+
+predexp_eval_t*
+as_batch_get_predexp(const as_batch_shared* shared)
+{
+	return shared->predexp;
+}
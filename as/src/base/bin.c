@@ -40,6 +40,31 @@
 #include "storage/storage.h"
 
 
+//==========================================================
+// Typedefs & constants.
+//
+
+// Records with fewer bins than this are just scanned.
+#define MIN_HINTED_BINS 16
+
+
+//==========================================================
+// Globals.
+//
+
+// Per thread, the slot at which each bin-id was last found in a wide record.
+// Records written with the same bins share a layout, so hints mostly hit.
+static __thread uint16_t *g_bin_slot_hints = NULL;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static int32_t find_bin_index(as_storage_rd *rd, uint32_t id);
+static void unpack_bins(as_storage_rd *rd);
+
+
 //==========================================================
 // Inlines & macros.
 //
@@ -267,6 +292,27 @@ as_storage_rd_load_bins(as_storage_rd *rd, as_bin *stack_bins)
 }
 
 
+// - As as_storage_rd_load_bins(), but if data is not in memory, bins not named
+//   in bin_names aren't loaded. For callers that will only look at these.
+int
+as_storage_rd_load_bins_named(as_storage_rd *rd, as_bin *stack_bins,
+		cf_vector *bin_names)
+{
+	if (rd->ns->storage_data_in_memory) {
+		return as_storage_rd_load_bins(rd, stack_bins);
+	}
+
+	rd->bins = stack_bins;
+	as_bin_set_all_empty(rd);
+
+	if (rd->record_on_device && ! rd->ignore_record_on_device) {
+		return as_storage_record_load_bins_named(rd, bin_names);
+	}
+
+	return 0;
+}
+
+
 uint16_t
 as_bin_inuse_count(as_storage_rd *rd)
 {
@@ -292,19 +338,9 @@ as_bin_get_all_p(as_storage_rd *rd, as_bin **bin_ptrs)
 as_bin *
 as_bin_get_by_id(as_storage_rd *rd, uint32_t id)
 {
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return b;
-		}
-	}
+	int32_t i = find_bin_index(rd, id);
 
-	return NULL;
+	return i < 0 ? NULL : &rd->bins[i];
 }
 
 
@@ -338,19 +374,7 @@ as_bin_get_from_buf(as_storage_rd *rd, const uint8_t *name, size_t len)
 		return NULL;
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return b;
-		}
-	}
-
-	return NULL;
+	return as_bin_get_by_id(rd, id);
 }
 
 
@@ -464,17 +488,13 @@ as_bin_get_or_create(as_storage_rd *rd, const char *name)
 	as_bin *b;
 
 	if (cf_vmapx_get_index(ns->p_bin_name_vmap, name, &id) == CF_VMAPX_OK) {
-		for (i = 0; i < rd->n_bins; i++) {
-			b = &rd->bins[i];
-
-			if (! as_bin_inuse(b)) {
-				break;
-			}
+		int32_t found_i = find_bin_index(rd, id);
 
-			if ((uint32_t)b->id == id) {
-				return b;
-			}
+		if (found_i >= 0) {
+			return &rd->bins[found_i];
 		}
+
+		i = as_bin_inuse_count(rd);
 	}
 	else {
 		if (cf_vmapx_count(ns->p_bin_name_vmap) >= BIN_NAMES_QUOTA) {
@@ -524,17 +544,13 @@ as_bin_get_or_create_from_buf(as_storage_rd *rd, const uint8_t *name,
 
 	if (cf_vmapx_get_index_w_len(ns->p_bin_name_vmap, (const char *)name, len,
 			&id) == CF_VMAPX_OK) {
-		for (i = 0; i < rd->n_bins; i++) {
-			b = &rd->bins[i];
+		int32_t found_i = find_bin_index(rd, id);
 
-			if (! as_bin_inuse(b)) {
-				break;
-			}
-
-			if ((uint32_t)b->id == id) {
-				return b;
-			}
+		if (found_i >= 0) {
+			return &rd->bins[found_i];
 		}
+
+		i = as_bin_inuse_count(rd);
 	}
 	else {
 		if (cf_vmapx_count(ns->p_bin_name_vmap) >= BIN_NAMES_QUOTA) {
@@ -579,19 +595,7 @@ as_bin_get_index(as_storage_rd *rd, const char *name)
 		return -1;
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return (int32_t)i;
-		}
-	}
-
-	return -1;
+	return find_bin_index(rd, id);
 }
 
 
@@ -608,19 +612,7 @@ as_bin_get_index_from_buf(as_storage_rd *rd, const uint8_t *name, size_t len)
 		return -1;
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return (int32_t)i;
-		}
-	}
-
-	return -1;
+	return find_bin_index(rd, id);
 }
 
 
@@ -653,6 +645,9 @@ as_bin_allocate_bin_space(as_storage_rd *rd, int32_t delta)
 	}
 	// else - there were bins before.
 
+	// Packed particles can't survive a realloc of the block they live in.
+	unpack_bins(rd);
+
 	uint16_t new_n_bins = (uint16_t)((int32_t)rd->n_bins + delta);
 
 	if (delta < 0) {
@@ -683,3 +678,120 @@ as_bin_allocate_bin_space(as_storage_rd *rd, int32_t delta)
 		rd->bins = NULL;
 	}
 }
+
+
+// Makes a single block holding the bins followed by their particles. External
+// particles are copied in and freed, bins are left pointing into the block.
+as_bin_space *
+as_bin_space_pack(as_bin *bins, uint16_t n_bins)
+{
+	size_t size = sizeof(as_bin_space) + (n_bins * sizeof(as_bin));
+
+	for (uint16_t i = 0; i < n_bins; i++) {
+		as_bin *b = &bins[i];
+
+		if (as_bin_is_external_particle(b) || as_bin_is_packed_particle(b)) {
+			size += as_bin_particle_size(b);
+		}
+	}
+
+	as_bin_space *bin_space = (as_bin_space *)cf_malloc_ns(size);
+
+	cf_assert(bin_space, AS_RECORD, "alloc failed");
+
+	uint8_t *at = (uint8_t *)&bin_space->bins[n_bins];
+
+	for (uint16_t i = 0; i < n_bins; i++) {
+		as_bin *b = &bins[i];
+
+		if (! (as_bin_is_external_particle(b) || as_bin_is_packed_particle(b))) {
+			continue;
+		}
+
+		uint32_t particle_size = as_bin_particle_size(b);
+
+		memcpy(at, b->particle, particle_size);
+
+		if (as_bin_is_external_particle(b)) {
+			as_bin_particle_destroy(b, true);
+		}
+
+		b->particle = (as_particle *)at;
+		as_bin_state_set(b, AS_BIN_STATE_INUSE_PACKED);
+
+		at += particle_size;
+	}
+
+	memcpy(bin_space->bins, bins, n_bins * sizeof(as_bin));
+	bin_space->n_bins = n_bins;
+
+	return bin_space;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Never called if single-bin. Returns -1 if the bin isn't in use.
+static int32_t
+find_bin_index(as_storage_rd *rd, uint32_t id)
+{
+	bool use_hints = rd->n_bins >= MIN_HINTED_BINS;
+
+	if (use_hints) {
+		if (! g_bin_slot_hints) {
+			g_bin_slot_hints = cf_calloc(MAX_BIN_NAMES, sizeof(uint16_t));
+		}
+
+		uint16_t hint = g_bin_slot_hints[id];
+
+		if (hint < rd->n_bins) {
+			as_bin *b = &rd->bins[hint];
+
+			if (as_bin_inuse(b) && (uint32_t)b->id == id) {
+				return (int32_t)hint;
+			}
+		}
+	}
+
+	for (uint16_t i = 0; i < rd->n_bins; i++) {
+		as_bin *b = &rd->bins[i];
+
+		if (! as_bin_inuse(b)) {
+			break;
+		}
+
+		if ((uint32_t)b->id == id) {
+			if (use_hints) {
+				g_bin_slot_hints[id] = i;
+			}
+
+			return (int32_t)i;
+		}
+	}
+
+	return -1;
+}
+
+
+// Gives any packed particles their own allocations.
+static void
+unpack_bins(as_storage_rd *rd)
+{
+	for (uint16_t i = 0; i < rd->n_bins; i++) {
+		as_bin *b = &rd->bins[i];
+
+		if (! as_bin_is_packed_particle(b)) {
+			continue;
+		}
+
+		uint32_t particle_size = as_bin_particle_size(b);
+		as_particle *p = (as_particle *)cf_malloc_ns(particle_size);
+
+		memcpy(p, b->particle, particle_size);
+
+		b->particle = p;
+		as_bin_state_set(b, AS_BIN_STATE_INUSE_OTHER);
+	}
+}
@@ -0,0 +1,398 @@
+/*
+ * capture.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+//==========================================================
+// Includes.
+//
+
+#include "base/capture.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_byte_order.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "cf_str.h"
+#include "dynbuf.h"
+#include "fault.h"
+
+#include "base/proto.h"
+#include "base/thr_info.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CAPTURE_MAGIC "ASCAPT01"
+
+#define DEFAULT_MAX_MB 1024
+
+typedef struct capture_file_header_s {
+	char magic[8];
+	uint64_t start_ms;
+} __attribute__ ((__packed__)) capture_file_header;
+
+typedef struct capture_record_header_s {
+	uint64_t offset_us;
+	uint32_t sz;
+} __attribute__ ((__packed__)) capture_record_header;
+
+
+//==========================================================
+// Globals.
+//
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* g_file = NULL;
+
+// Read without the lock on the sampling path.
+static volatile bool g_active = false;
+
+static uint32_t g_sample_rate;
+static bool g_hash_keys;
+static uint64_t g_start_ns;
+static uint64_t g_max_bytes;
+static uint64_t g_n_bytes;
+static uint64_t g_n_captured;
+
+static __thread uint32_t g_n_skipped = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint8_t* hash_keys(const as_proto* proto, uint32_t* p_sz);
+static void close_file(void);
+
+
+//==========================================================
+// Public API.
+//
+
+// Called as each complete (decompressed) client request arrives. Proto header
+// is in host order, the rest is as received.
+void
+as_capture_sample(const as_proto* proto, uint64_t now_ns)
+{
+	if (! g_active) {
+		return;
+	}
+
+	if (++g_n_skipped < g_sample_rate) {
+		return;
+	}
+
+	g_n_skipped = 0;
+
+	uint8_t* buf;
+	uint32_t sz;
+
+	if (g_hash_keys && proto->type == PROTO_TYPE_AS_MSG) {
+		if (! (buf = hash_keys(proto, &sz))) {
+			return; // malformed - transaction will fail anyway
+		}
+	}
+	else {
+		sz = (uint32_t)(sizeof(as_proto) + proto->sz);
+		buf = cf_malloc(sz);
+		memcpy(buf, proto, sz);
+	}
+
+	// Back to wire order.
+	as_proto* out_proto = (as_proto*)buf;
+
+	out_proto->sz = sz - sizeof(as_proto);
+	*(uint64_t*)out_proto = cf_swap_to_be64(
+			((uint64_t)out_proto->version << 56) |
+			((uint64_t)out_proto->type << 48) | out_proto->sz);
+
+	pthread_mutex_lock(&g_lock);
+
+	if (g_file) {
+		capture_record_header rh = {
+				.offset_us = (now_ns - g_start_ns) / 1000,
+				.sz = sz
+		};
+
+		if (fwrite(&rh, sizeof(rh), 1, g_file) != 1 ||
+				fwrite(buf, sz, 1, g_file) != 1) {
+			cf_warning(AS_INFO, "capture write failed - stopping capture");
+			close_file();
+		}
+		else {
+			g_n_bytes += sizeof(rh) + sz;
+			g_n_captured++;
+
+			if (g_n_bytes >= g_max_bytes) {
+				cf_info(AS_INFO, "capture reached max size - stopping capture");
+				close_file();
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&g_lock);
+
+	cf_free(buf);
+}
+
+// capture-start:file=<path>[;sample-rate=<N>][;hash-keys=<bool>][;max-mb=<N>]
+void
+as_capture_start(char* params, cf_dyn_buf* db)
+{
+	char path[256];
+	int path_len = (int)sizeof(path);
+
+	if (as_info_parameter_get(params, "file", path, &path_len) != 0 ||
+			path_len == 0) {
+		cf_warning(AS_INFO, "capture-start: missing or invalid file");
+		cf_dyn_buf_append_string(db, "ERROR::file");
+		return;
+	}
+
+	char val_str[32];
+	int val_str_len = (int)sizeof(val_str);
+	uint32_t sample_rate = 1;
+
+	if (as_info_parameter_get(params, "sample-rate", val_str,
+			&val_str_len) == 0 &&
+			(cf_str_atoi_u32(val_str, &sample_rate) != 0 ||
+					sample_rate == 0)) {
+		cf_warning(AS_INFO, "capture-start: invalid sample-rate");
+		cf_dyn_buf_append_string(db, "ERROR::sample-rate");
+		return;
+	}
+
+	bool hash = false;
+
+	val_str_len = (int)sizeof(val_str);
+
+	if (as_info_parameter_get(params, "hash-keys", val_str,
+			&val_str_len) == 0) {
+		if (strcmp(val_str, "true") == 0) {
+			hash = true;
+		}
+		else if (strcmp(val_str, "false") != 0) {
+			cf_warning(AS_INFO, "capture-start: invalid hash-keys");
+			cf_dyn_buf_append_string(db, "ERROR::hash-keys");
+			return;
+		}
+	}
+
+	uint32_t max_mb = DEFAULT_MAX_MB;
+
+	val_str_len = (int)sizeof(val_str);
+
+	if (as_info_parameter_get(params, "max-mb", val_str, &val_str_len) == 0 &&
+			(cf_str_atoi_u32(val_str, &max_mb) != 0 || max_mb == 0)) {
+		cf_warning(AS_INFO, "capture-start: invalid max-mb");
+		cf_dyn_buf_append_string(db, "ERROR::max-mb");
+		return;
+	}
+
+	pthread_mutex_lock(&g_lock);
+
+	if (g_file) {
+		pthread_mutex_unlock(&g_lock);
+		cf_dyn_buf_append_string(db, "ERROR::capture-in-progress");
+		return;
+	}
+
+	FILE* file = fopen(path, "wb");
+
+	if (! file) {
+		pthread_mutex_unlock(&g_lock);
+		cf_warning(AS_INFO, "capture-start: can't open %s: %s", path,
+				cf_strerror(errno));
+		cf_dyn_buf_append_string(db, "ERROR::open-failed");
+		return;
+	}
+
+	capture_file_header fh = { .start_ms = cf_clock_getabsolute() };
+
+	memcpy(fh.magic, CAPTURE_MAGIC, sizeof(fh.magic));
+
+	if (fwrite(&fh, sizeof(fh), 1, file) != 1) {
+		fclose(file);
+		pthread_mutex_unlock(&g_lock);
+		cf_dyn_buf_append_string(db, "ERROR::write-failed");
+		return;
+	}
+
+	g_file = file;
+	g_sample_rate = sample_rate;
+	g_hash_keys = hash;
+	g_start_ns = cf_getns();
+	g_max_bytes = (uint64_t)max_mb * 1024 * 1024;
+	g_n_bytes = sizeof(fh);
+	g_n_captured = 0;
+	g_active = true;
+
+	pthread_mutex_unlock(&g_lock);
+
+	cf_info(AS_INFO, "capture started - file %s sample-rate %u hash-keys %s",
+			path, sample_rate, hash ? "true" : "false");
+
+	cf_dyn_buf_append_string(db, "ok");
+}
+
+void
+as_capture_stop(cf_dyn_buf* db)
+{
+	pthread_mutex_lock(&g_lock);
+
+	if (! g_file) {
+		pthread_mutex_unlock(&g_lock);
+		cf_dyn_buf_append_string(db, "ERROR::no-capture-in-progress");
+		return;
+	}
+
+	uint64_t n_captured = g_n_captured;
+
+	close_file();
+
+	pthread_mutex_unlock(&g_lock);
+
+	cf_info(AS_INFO, "capture stopped - %lu requests", n_captured);
+
+	cf_dyn_buf_append_string(db, "requests=");
+	cf_dyn_buf_append_uint64(db, n_captured);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Copy the message, dropping user key fields. A message with a key but no
+// digest gets a digest field, so it still addresses the same record.
+static uint8_t*
+hash_keys(const as_proto* proto, uint32_t* p_sz)
+{
+	if (proto->sz < sizeof(as_msg)) {
+		return NULL;
+	}
+
+	const as_msg* m = (const as_msg*)proto->data;
+	const uint8_t* p = m->data;
+	const uint8_t* end = proto->data + proto->sz;
+	uint16_t n_fields = cf_swap_from_be16(m->n_fields);
+
+	const as_msg_field* set_f = NULL;
+	bool has_digest = false;
+
+	for (uint16_t i = 0; i < n_fields; i++) {
+		const as_msg_field* f = (const as_msg_field*)p;
+
+		if (p + sizeof(as_msg_field) > end) {
+			return NULL;
+		}
+
+		uint32_t field_sz = cf_swap_from_be32(f->field_sz);
+
+		if (field_sz == 0 || p + sizeof(uint32_t) + field_sz > end) {
+			return NULL;
+		}
+
+		if (f->type == AS_MSG_FIELD_TYPE_SET) {
+			set_f = f;
+		}
+		else if (f->type == AS_MSG_FIELD_TYPE_DIGEST_RIPE) {
+			has_digest = true;
+		}
+
+		p += sizeof(uint32_t) + field_sz;
+	}
+
+	const uint8_t* ops = p;
+	uint32_t digest_field_sz = sizeof(as_msg_field) + sizeof(cf_digest);
+	uint32_t max_sz = (uint32_t)(sizeof(as_proto) + proto->sz) +
+			digest_field_sz;
+	uint8_t* buf = cf_malloc(max_sz);
+
+	memcpy(buf, proto, sizeof(as_proto) + sizeof(as_msg));
+
+	uint8_t* out = buf + sizeof(as_proto) + sizeof(as_msg);
+	uint16_t n_out_fields = 0;
+
+	p = m->data;
+
+	for (uint16_t i = 0; i < n_fields; i++) {
+		const as_msg_field* f = (const as_msg_field*)p;
+		uint32_t f_sz = sizeof(uint32_t) + cf_swap_from_be32(f->field_sz);
+
+		if (f->type == AS_MSG_FIELD_TYPE_KEY) {
+			if (! has_digest) {
+				uint32_t key_sz = cf_swap_from_be32(f->field_sz) - 1;
+				uint32_t set_sz = set_f ?
+						cf_swap_from_be32(set_f->field_sz) - 1 : 0;
+				as_msg_field* df = (as_msg_field*)out;
+
+				df->field_sz = cf_swap_to_be32(1 + sizeof(cf_digest));
+				df->type = AS_MSG_FIELD_TYPE_DIGEST_RIPE;
+				cf_digest_compute2(set_f ? set_f->data : NULL, set_sz,
+						f->data, key_sz, (cf_digest*)df->data);
+
+				out += digest_field_sz;
+				n_out_fields++;
+			}
+		}
+		else {
+			memcpy(out, p, f_sz);
+			out += f_sz;
+			n_out_fields++;
+		}
+
+		p += f_sz;
+	}
+
+	memcpy(out, ops, (size_t)(end - ops));
+	out += end - ops;
+
+	((as_msg*)(buf + sizeof(as_proto)))->n_fields =
+			cf_swap_to_be16(n_out_fields);
+
+	*p_sz = (uint32_t)(out - buf);
+
+	return buf;
+}
+
+// Caller holds the lock.
+static void
+close_file(void)
+{
+	g_active = false;
+
+	fclose(g_file);
+	g_file = NULL;
+}
@@ -0,0 +1,179 @@
+/*
+ * cdc.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+//==========================================================
+// Includes.
+//
+
+#include "base/cdc.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+
+#include "base/datamodel.h"
+#include "fabric/partition.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Most entries returned by one info request.
+#define MAX_INFO_ENTRIES (64 * 1024)
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void append_entry(const as_cdc_entry* e, cf_dyn_buf* db);
+
+
+//==========================================================
+// Public API.
+//
+
+// Caller checks cdc-ring-size is non-zero.
+void
+as_cdc_init(as_namespace* ns)
+{
+	ns->cdc_rings = cf_malloc(sizeof(as_cdc_ring) * AS_PARTITIONS);
+
+	// Sequence numbers start from the wall clock, so a consumer's offset from
+	// a previous life of this node (or from another node) is recognizable as
+	// a gap rather than silently aliasing new entries.
+	uint64_t first_seq = cf_clock_getabsolute() << 16;
+
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		as_cdc_ring* ring = &ns->cdc_rings[pid];
+
+		pthread_mutex_init(&ring->lock, NULL);
+		ring->next_seq = first_seq;
+		ring->entries = cf_malloc(sizeof(as_cdc_entry) * ns->cdc_ring_size);
+	}
+
+	cf_info(AS_NAMESPACE, "{%s} cdc rings use %lu bytes", ns->name,
+			(uint64_t)AS_PARTITIONS *
+					(sizeof(as_cdc_ring) +
+							sizeof(as_cdc_entry) * ns->cdc_ring_size));
+}
+
+// Called on master only, after the record is done.
+void
+as_cdc_write(as_namespace* ns, uint32_t pid, const cf_digest* keyd,
+		uint16_t generation, uint64_t last_update_time, as_cdc_op op)
+{
+	if (! ns->cdc_rings) {
+		return;
+	}
+
+	as_cdc_ring* ring = &ns->cdc_rings[pid];
+
+	pthread_mutex_lock(&ring->lock);
+
+	uint64_t seq = ring->next_seq++;
+	as_cdc_entry* e = &ring->entries[seq & (ns->cdc_ring_size - 1)];
+
+	e->keyd = *keyd;
+	e->generation = generation;
+	e->op = (uint8_t)op;
+	e->unused = 0;
+	e->last_update_time = last_update_time;
+	e->seq = seq;
+
+	pthread_mutex_unlock(&ring->lock);
+}
+
+// Appends "next=<seq>:gap=<bool>", then ";<digest>,<gen>,<lut>,<w|d>" per
+// entry from 'from' on. Consumers pass 'next' back as 'from'. A gap means
+// entries were lost (overwritten, or from another node or process) and the
+// consumer must catch up some other way, e.g. a scan by last-update-time.
+void
+as_cdc_info(as_namespace* ns, uint32_t pid, uint64_t from, uint32_t max,
+		cf_dyn_buf* db)
+{
+	as_cdc_ring* ring = &ns->cdc_rings[pid];
+
+	if (max == 0 || max > MAX_INFO_ENTRIES) {
+		max = MAX_INFO_ENTRIES;
+	}
+
+	pthread_mutex_lock(&ring->lock);
+
+	uint64_t next_seq = ring->next_seq;
+	uint64_t oldest_seq = next_seq > ns->cdc_ring_size ?
+			next_seq - ns->cdc_ring_size : 0;
+	bool gap = false;
+
+	if (from < oldest_seq || from > next_seq) {
+		from = oldest_seq;
+		gap = true;
+	}
+
+	uint64_t end = next_seq - from > max ? from + max : next_seq;
+
+	cf_dyn_buf_append_string(db, "next=");
+	cf_dyn_buf_append_uint64(db, end);
+	cf_dyn_buf_append_string(db, gap ? ":gap=true" : ":gap=false");
+
+	for (uint64_t seq = from; seq < end; seq++) {
+		append_entry(&ring->entries[seq & (ns->cdc_ring_size - 1)], db);
+	}
+
+	pthread_mutex_unlock(&ring->lock);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+append_entry(const as_cdc_entry* e, cf_dyn_buf* db)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	cf_dyn_buf_append_char(db, ';');
+
+	for (uint32_t b = 0; b < CF_DIGEST_KEY_SZ; b++) {
+		cf_dyn_buf_append_char(db, hex[e->keyd.digest[b] >> 4]);
+		cf_dyn_buf_append_char(db, hex[e->keyd.digest[b] & 0xF]);
+	}
+
+	cf_dyn_buf_append_char(db, ',');
+	cf_dyn_buf_append_uint32(db, e->generation);
+	cf_dyn_buf_append_char(db, ',');
+	cf_dyn_buf_append_uint64(db, e->last_update_time);
+	cf_dyn_buf_append_char(db, ',');
+	cf_dyn_buf_append_char(db, e->op == AS_CDC_OP_DELETE ? 'd' : 'w');
+}
@@ -674,7 +674,7 @@ rollback_alloc_from_msgpack(rollback_alloc *alloc_buf, as_bin *b,
 
 int
 as_bin_cdt_packed_modify(as_bin *b, as_msg_op *op, as_bin *result,
-		cf_ll_buf *particles_llb)
+		cf_ll_buf *particles_llb, cf_ll_buf *results_llb)
 {
 	cdt_process_state state;
 
@@ -686,6 +686,7 @@ as_bin_cdt_packed_modify(as_bin *b, as_msg_op *op, as_bin *result,
 		.b = b,
 		.result = result,
 		.alloc_buf = particles_llb,
+		.result_alloc_buf = results_llb,
 		.ret_code = AS_PROTO_RESULT_OK,
 	};
 
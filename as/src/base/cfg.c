@@ -43,6 +43,7 @@
 
 #include "bits.h"
 #include "cf_str.h"
+#include "compression.h"
 #include "dynbuf.h"
 #include "fault.h"
 #include "hardware.h"
@@ -53,9 +54,12 @@
 #include "olock.h"
 #include "socket.h"
 #include "tls.h"
+#include "uring.h"
 
+#include "base/aggr.h"
 #include "base/datamodel.h"
 #include "base/proto.h"
+#include "base/quota.h"
 #include "base/secondary_index.h"
 #include "base/security_config.h"
 #include "base/thr_demarshal.h"
@@ -99,6 +103,7 @@ void cfg_serv_spec_std_to_access(const cf_serv_spec* spec, cf_addr_list* access)
 void cfg_serv_spec_alt_to_access(const cf_serv_spec* spec, cf_addr_list* access);
 void cfg_add_mesh_seed_addr_port(char* addr, cf_ip_port port, bool tls);
 as_set* cfg_add_set(as_namespace* ns);
+void cfg_add_set_dict_file(as_namespace* ns, as_set* p_set, char* file_name);
 void cfg_add_storage_file(as_namespace* ns, char* file_name);
 void cfg_add_storage_device(as_namespace* ns, char* device_name, char* shadow_name);
 uint32_t cfg_obj_size_hist_max(uint32_t hist_max);
@@ -150,9 +155,11 @@ cfg_set_defaults()
 	c->nsup_delete_sleep = 100; // 100 microseconds means a delete rate of 10k TPS
 	c->nsup_period = 120; // run nsup once every 2 minutes
 	c->nsup_startup_evict = true;
+	c->n_nsup_threads = 1;
 	c->proto_fd_idle_ms = 60000; // 1 minute reaping of proto file descriptors
 	c->proto_slow_netio_sleep_ms = 1; // 1 ms sleep between retry for slow queries
 	c->run_as_daemon = true; // set false only to run in debugger & see console output
+	c->scan_aggr_parallelism = 1;
 	c->scan_max_active = 100;
 	c->scan_max_done = 100;
 	c->scan_max_udf_transactions = 32;
@@ -259,14 +266,17 @@ typedef enum {
 	CASE_SERVICE_CLIENT_FD_MAX, // renamed
 	CASE_SERVICE_PROTO_FD_MAX,
 	// Normally hidden:
+	CASE_SERVICE_ACCEPT_SHARDS,
 	CASE_SERVICE_ADVERTISE_IPV6,
 	CASE_SERVICE_AUTO_PIN,
 	CASE_SERVICE_BATCH_THREADS,
 	CASE_SERVICE_BATCH_MAX_BUFFERS_PER_QUEUE,
 	CASE_SERVICE_BATCH_MAX_REQUESTS,
+	CASE_SERVICE_BATCH_MAX_SUB_IN_FLIGHT,
 	CASE_SERVICE_BATCH_MAX_UNUSED_BUFFERS,
 	CASE_SERVICE_BATCH_PRIORITY,
 	CASE_SERVICE_BATCH_INDEX_THREADS,
+	CASE_SERVICE_BUSY_POLL_US,
 	CASE_SERVICE_CLOCK_SKEW_MAX_MS,
 	CASE_SERVICE_CLUSTER_NAME,
 	CASE_SERVICE_ENABLE_BENCHMARKS_FABRIC,
@@ -276,6 +286,7 @@ typedef enum {
 	CASE_SERVICE_HIST_TRACK_SLICE,
 	CASE_SERVICE_HIST_TRACK_THRESHOLDS,
 	CASE_SERVICE_INFO_THREADS,
+	CASE_SERVICE_LOG_ASYNC,
 	CASE_SERVICE_LOG_LOCAL_TIME,
 	CASE_SERVICE_LOG_MILLIS,
 	CASE_SERVICE_MIGRATE_MAX_NUM_INCOMING,
@@ -285,9 +296,12 @@ typedef enum {
 	CASE_SERVICE_NSUP_DELETE_SLEEP,
 	CASE_SERVICE_NSUP_PERIOD,
 	CASE_SERVICE_NSUP_STARTUP_EVICT,
+	CASE_SERVICE_NSUP_THREADS,
+	CASE_SERVICE_NUMA_PARTITIONS,
 	CASE_SERVICE_PROTO_FD_IDLE_MS,
 	CASE_SERVICE_QUERY_BATCH_SIZE,
 	CASE_SERVICE_QUERY_BUFPOOL_SIZE,
+	CASE_SERVICE_QUERY_CURSOR_TTL,
 	CASE_SERVICE_QUERY_IN_TRANSACTION_THREAD,
 	CASE_SERVICE_QUERY_LONG_Q_MAX_SIZE,
 	CASE_SERVICE_QUERY_PRE_RESERVE_PARTITIONS,
@@ -301,7 +315,9 @@ typedef enum {
 	CASE_SERVICE_QUERY_THRESHOLD,
 	CASE_SERVICE_QUERY_UNTRACKED_TIME_MS,
 	CASE_SERVICE_QUERY_WORKER_THREADS,
+	CASE_SERVICE_RECORD_LOCKS,
 	CASE_SERVICE_RUN_AS_DAEMON,
+	CASE_SERVICE_SCAN_AGGR_PARALLELISM,
 	CASE_SERVICE_SCAN_MAX_ACTIVE,
 	CASE_SERVICE_SCAN_MAX_DONE,
 	CASE_SERVICE_SCAN_MAX_UDF_TRANSACTIONS,
@@ -313,6 +329,8 @@ typedef enum {
 	CASE_SERVICE_TICKER_INTERVAL,
 	CASE_SERVICE_TRANSACTION_MAX_MS,
 	CASE_SERVICE_TRANSACTION_PENDING_LIMIT,
+	CASE_SERVICE_TRANSACTION_QUEUE_BATCH_RATIO,
+	CASE_SERVICE_TRANSACTION_QUEUE_STEALING,
 	CASE_SERVICE_TRANSACTION_QUEUES,
 	CASE_SERVICE_TRANSACTION_RETRY_MS,
 	CASE_SERVICE_TRANSACTION_THREADS_PER_QUEUE,
@@ -358,7 +376,6 @@ typedef enum {
 	CASE_SERVICE_NSUP_QUEUE_ESCAPE,
 	CASE_SERVICE_NSUP_REDUCE_PRIORITY,
 	CASE_SERVICE_NSUP_REDUCE_SLEEP,
-	CASE_SERVICE_NSUP_THREADS,
 	CASE_SERVICE_PAXOS_MAX_CLUSTER_SIZE,
 	CASE_SERVICE_PAXOS_PROTOCOL,
 	CASE_SERVICE_PAXOS_RECOVERY_POLICY,
@@ -443,6 +460,7 @@ typedef enum {
 	CASE_NETWORK_HEARTBEAT_MESH_SEED_ADDRESS_PORT,
 	CASE_NETWORK_HEARTBEAT_INTERVAL,
 	CASE_NETWORK_HEARTBEAT_TIMEOUT,
+	CASE_NETWORK_HEARTBEAT_PHI_THRESHOLD,
 	// Normally hidden:
 	CASE_NETWORK_HEARTBEAT_MTU,
 	CASE_NETWORK_HEARTBEAT_MCAST_TTL, // renamed
@@ -517,9 +535,11 @@ typedef enum {
 	CASE_NAMESPACE_FORWARD_XDR_WRITES,
 	CASE_NAMESPACE_ALLOW_NONXDR_WRITES,
 	CASE_NAMESPACE_ALLOW_XDR_WRITES,
+	CASE_NAMESPACE_CDC_RING_SIZE,
 	// Normally hidden:
 	CASE_NAMESPACE_COLD_START_EVICT_TTL,
 	CASE_NAMESPACE_CONFLICT_RESOLUTION_POLICY,
+	CASE_NAMESPACE_CONTIGUOUS_RECORDS,
 	CASE_NAMESPACE_DATA_IN_INDEX,
 	CASE_NAMESPACE_DISALLOW_NULL_SETNAME,
 	CASE_NAMESPACE_ENABLE_BENCHMARKS_BATCH_SUB,
@@ -529,18 +549,29 @@ typedef enum {
 	CASE_NAMESPACE_ENABLE_BENCHMARKS_WRITE,
 	CASE_NAMESPACE_ENABLE_HIST_PROXY,
 	CASE_NAMESPACE_EVICT_HIST_BUCKETS,
+	CASE_NAMESPACE_EVICT_LRU,
 	CASE_NAMESPACE_EVICT_TENTHS_PCT,
 	CASE_NAMESPACE_HIGH_WATER_DISK_PCT,
 	CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT,
+	CASE_NAMESPACE_HOT_KEY_SAMPLE_RATE,
+	CASE_NAMESPACE_INDEX_HUGE_PAGES,
+	CASE_NAMESPACE_INDEX_NUMA_INTERLEAVE,
+	CASE_NAMESPACE_INDEX_SNAPSHOT_FILE,
 	CASE_NAMESPACE_MAX_TTL,
 	CASE_NAMESPACE_MIGRATE_ORDER,
 	CASE_NAMESPACE_MIGRATE_RETRANSMIT_MS,
 	CASE_NAMESPACE_MIGRATE_SLEEP,
+	CASE_NAMESPACE_MIGRATE_TARGET_LATENCY_MS,
 	CASE_NAMESPACE_OBJ_SIZE_HIST_MAX,
+	CASE_NAMESPACE_PARTITION_TREE_HASH,
 	CASE_NAMESPACE_PARTITION_TREE_LOCKS,
 	CASE_NAMESPACE_PARTITION_TREE_SPRIGS,
+	CASE_NAMESPACE_QUOTA_BYTES_PER_SEC,
+	CASE_NAMESPACE_QUOTA_OPS_PER_SEC,
 	CASE_NAMESPACE_RACK_ID,
+	CASE_NAMESPACE_RACK_LOCAL_READS,
 	CASE_NAMESPACE_READ_CONSISTENCY_LEVEL_OVERRIDE,
+	CASE_NAMESPACE_RESPONSE_COMPRESSION_THRESHOLD,
 	CASE_NAMESPACE_SET_BEGIN,
 	CASE_NAMESPACE_SINDEX_BEGIN,
 	CASE_NAMESPACE_GEO2DSPHERE_WITHIN_BEGIN,
@@ -548,6 +579,7 @@ typedef enum {
 	CASE_NAMESPACE_STOP_WRITES_PCT,
 	CASE_NAMESPACE_TOMB_RAIDER_ELIGIBLE_AGE,
 	CASE_NAMESPACE_TOMB_RAIDER_PERIOD,
+	CASE_NAMESPACE_TRUNCATE_DELETE_SLEEP,
 	CASE_NAMESPACE_WRITE_COMMIT_LEVEL_OVERRIDE,
 	// Deprecated:
 	CASE_NAMESPACE_ALLOW_VERSIONS,
@@ -587,6 +619,11 @@ typedef enum {
 	CASE_NAMESPACE_STORAGE_DEVICE_DATA_IN_MEMORY,
 	// Normally hidden:
 	CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_EMPTY,
+	CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_THREADS,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMMIT_TO_DEVICE,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LEVEL,
+	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_ADAPTIVE,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LWM_PCT,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_QUEUE_MIN,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_SLEEP,
@@ -596,11 +633,20 @@ typedef enum {
 	CASE_NAMESPACE_STORAGE_DEVICE_ENABLE_OSYNC,
 	CASE_NAMESPACE_STORAGE_DEVICE_FLUSH_MAX_MS,
 	CASE_NAMESPACE_STORAGE_DEVICE_FSYNC_MAX_SEC,
+	CASE_NAMESPACE_STORAGE_DEVICE_HOT_RECORD_AGE,
+	CASE_NAMESPACE_STORAGE_DEVICE_HOT_TIER_SIZE,
+	CASE_NAMESPACE_STORAGE_DEVICE_IO_URING_DEPTH,
 	CASE_NAMESPACE_STORAGE_DEVICE_MAX_WRITE_CACHE,
 	CASE_NAMESPACE_STORAGE_DEVICE_MIN_AVAIL_PCT,
+	CASE_NAMESPACE_STORAGE_DEVICE_PERSIST_MAP_INDEX,
+	CASE_NAMESPACE_STORAGE_DEVICE_PERSISTENT_MEMORY,
 	CASE_NAMESPACE_STORAGE_DEVICE_POST_WRITE_QUEUE,
+	CASE_NAMESPACE_STORAGE_DEVICE_READ_CACHE_SIZE,
+	CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_MAX_WRITE_CACHE,
 	CASE_NAMESPACE_STORAGE_DEVICE_TOMB_RAIDER_SLEEP,
+	CASE_NAMESPACE_STORAGE_DEVICE_WRITE_SHARDS,
 	CASE_NAMESPACE_STORAGE_DEVICE_WRITE_THREADS,
+	CASE_NAMESPACE_STORAGE_DEVICE_ZONED,
 	// Deprecated:
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_MAX_BLOCKS,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_PERIOD,
@@ -610,9 +656,19 @@ typedef enum {
 	CASE_NAMESPACE_STORAGE_DEVICE_SIGNATURE,
 	CASE_NAMESPACE_STORAGE_DEVICE_WRITE_SMOOTHING_PERIOD,
 
+	// Namespace storage device compression options (value tokens):
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_NONE,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LZ4,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_ZSTD,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_ZLIB,
+
 	// Namespace set options:
+	CASE_NAMESPACE_SET_COMPRESSION_DICTIONARY,
 	CASE_NAMESPACE_SET_DISABLE_EVICTION,
+	CASE_NAMESPACE_SET_ENABLE_INDEX,
 	CASE_NAMESPACE_SET_ENABLE_XDR,
+	CASE_NAMESPACE_SET_QUOTA_BYTES_PER_SEC,
+	CASE_NAMESPACE_SET_QUOTA_OPS_PER_SEC,
 	CASE_NAMESPACE_SET_STOP_WRITES_COUNT,
 	// Deprecated:
 	CASE_NAMESPACE_SET_EVICT_HWM_COUNT,
@@ -634,6 +690,7 @@ typedef enum {
 
 	// Namespace sindex options:
 	CASE_NAMESPACE_SINDEX_NUM_PARTITIONS,
+	CASE_NAMESPACE_SINDEX_DEFERRED_UPDATES,
 
 	// Namespace geo2dsphere within options:
 	CASE_NAMESPACE_GEO2DSPHERE_WITHIN_STRICT,
@@ -746,14 +803,17 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "pidfile",						CASE_SERVICE_PIDFILE },
 		{ "client-fd-max",					CASE_SERVICE_CLIENT_FD_MAX },
 		{ "proto-fd-max",					CASE_SERVICE_PROTO_FD_MAX },
+		{ "accept-shards",					CASE_SERVICE_ACCEPT_SHARDS },
 		{ "advertise-ipv6",					CASE_SERVICE_ADVERTISE_IPV6 },
 		{ "auto-pin",						CASE_SERVICE_AUTO_PIN },
 		{ "batch-threads",					CASE_SERVICE_BATCH_THREADS },
 		{ "batch-max-buffers-per-queue",	CASE_SERVICE_BATCH_MAX_BUFFERS_PER_QUEUE },
 		{ "batch-max-requests",				CASE_SERVICE_BATCH_MAX_REQUESTS },
+		{ "batch-max-sub-in-flight",		CASE_SERVICE_BATCH_MAX_SUB_IN_FLIGHT },
 		{ "batch-max-unused-buffers",		CASE_SERVICE_BATCH_MAX_UNUSED_BUFFERS },
 		{ "batch-priority",					CASE_SERVICE_BATCH_PRIORITY },
 		{ "batch-index-threads",			CASE_SERVICE_BATCH_INDEX_THREADS },
+		{ "busy-poll-us",					CASE_SERVICE_BUSY_POLL_US },
 		{ "clock-skew-max-ms",				CASE_SERVICE_CLOCK_SKEW_MAX_MS },
 		{ "cluster-name",					CASE_SERVICE_CLUSTER_NAME },
 		{ "enable-benchmarks-fabric",		CASE_SERVICE_ENABLE_BENCHMARKS_FABRIC },
@@ -763,6 +823,7 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "hist-track-slice",				CASE_SERVICE_HIST_TRACK_SLICE },
 		{ "hist-track-thresholds",			CASE_SERVICE_HIST_TRACK_THRESHOLDS },
 		{ "info-threads",					CASE_SERVICE_INFO_THREADS },
+		{ "log-async",						CASE_SERVICE_LOG_ASYNC },
 		{ "log-local-time",					CASE_SERVICE_LOG_LOCAL_TIME },
 		{ "log-millis",						CASE_SERVICE_LOG_MILLIS},
 		{ "migrate-max-num-incoming",		CASE_SERVICE_MIGRATE_MAX_NUM_INCOMING },
@@ -772,9 +833,12 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "nsup-delete-sleep",				CASE_SERVICE_NSUP_DELETE_SLEEP },
 		{ "nsup-period",					CASE_SERVICE_NSUP_PERIOD },
 		{ "nsup-startup-evict",				CASE_SERVICE_NSUP_STARTUP_EVICT },
+		{ "nsup-threads",					CASE_SERVICE_NSUP_THREADS },
+		{ "numa-partitions",				CASE_SERVICE_NUMA_PARTITIONS },
 		{ "proto-fd-idle-ms",				CASE_SERVICE_PROTO_FD_IDLE_MS },
 		{ "query-batch-size",				CASE_SERVICE_QUERY_BATCH_SIZE },
 		{ "query-bufpool-size",				CASE_SERVICE_QUERY_BUFPOOL_SIZE },
+		{ "query-cursor-ttl",				CASE_SERVICE_QUERY_CURSOR_TTL },
 		{ "query-in-transaction-thread",	CASE_SERVICE_QUERY_IN_TRANSACTION_THREAD },
 		{ "query-long-q-max-size",			CASE_SERVICE_QUERY_LONG_Q_MAX_SIZE },
 		{ "query-pre-reserve-partitions",   CASE_SERVICE_QUERY_PRE_RESERVE_PARTITIONS },
@@ -788,7 +852,9 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "query-threshold", 				CASE_SERVICE_QUERY_THRESHOLD },
 		{ "query-untracked-time-ms",		CASE_SERVICE_QUERY_UNTRACKED_TIME_MS },
 		{ "query-worker-threads",			CASE_SERVICE_QUERY_WORKER_THREADS },
+		{ "record-locks",					CASE_SERVICE_RECORD_LOCKS },
 		{ "run-as-daemon",					CASE_SERVICE_RUN_AS_DAEMON },
+		{ "scan-aggr-parallelism",			CASE_SERVICE_SCAN_AGGR_PARALLELISM },
 		{ "scan-max-active",				CASE_SERVICE_SCAN_MAX_ACTIVE },
 		{ "scan-max-done",					CASE_SERVICE_SCAN_MAX_DONE },
 		{ "scan-max-udf-transactions",		CASE_SERVICE_SCAN_MAX_UDF_TRANSACTIONS },
@@ -800,6 +866,8 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "ticker-interval",				CASE_SERVICE_TICKER_INTERVAL },
 		{ "transaction-max-ms",				CASE_SERVICE_TRANSACTION_MAX_MS },
 		{ "transaction-pending-limit",		CASE_SERVICE_TRANSACTION_PENDING_LIMIT },
+		{ "transaction-queue-batch-ratio",	CASE_SERVICE_TRANSACTION_QUEUE_BATCH_RATIO },
+		{ "transaction-queue-stealing",		CASE_SERVICE_TRANSACTION_QUEUE_STEALING },
 		{ "transaction-queues",				CASE_SERVICE_TRANSACTION_QUEUES },
 		{ "transaction-retry-ms",			CASE_SERVICE_TRANSACTION_RETRY_MS },
 		{ "transaction-threads-per-queue",	CASE_SERVICE_TRANSACTION_THREADS_PER_QUEUE },
@@ -842,7 +910,6 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "nsup-queue-lwm",					CASE_SERVICE_NSUP_QUEUE_LWM },
 		{ "nsup-reduce-priority",			CASE_SERVICE_NSUP_REDUCE_PRIORITY },
 		{ "nsup-reduce-sleep",				CASE_SERVICE_NSUP_REDUCE_SLEEP },
-		{ "nsup-threads",					CASE_SERVICE_NSUP_THREADS },
 		{ "paxos-max-cluster-size",			CASE_SERVICE_PAXOS_MAX_CLUSTER_SIZE },
 		{ "paxos-protocol",					CASE_SERVICE_PAXOS_PROTOCOL },
 		{ "paxos-recovery-policy",			CASE_SERVICE_PAXOS_RECOVERY_POLICY },
@@ -930,6 +997,7 @@ const cfg_opt NETWORK_HEARTBEAT_OPTS[] = {
 		{ "mesh-seed-address-port",			CASE_NETWORK_HEARTBEAT_MESH_SEED_ADDRESS_PORT },
 		{ "interval",						CASE_NETWORK_HEARTBEAT_INTERVAL },
 		{ "timeout",						CASE_NETWORK_HEARTBEAT_TIMEOUT },
+		{ "phi-threshold",					CASE_NETWORK_HEARTBEAT_PHI_THRESHOLD },
 		{ "mtu",							CASE_NETWORK_HEARTBEAT_MTU },
 		{ "mcast-ttl",						CASE_NETWORK_HEARTBEAT_MCAST_TTL },
 		{ "multicast-ttl",					CASE_NETWORK_HEARTBEAT_MULTICAST_TTL },
@@ -1006,8 +1074,10 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "ns-forward-xdr-writes",			CASE_NAMESPACE_FORWARD_XDR_WRITES },
 		{ "allow-nonxdr-writes",			CASE_NAMESPACE_ALLOW_NONXDR_WRITES },
 		{ "allow-xdr-writes",				CASE_NAMESPACE_ALLOW_XDR_WRITES },
+		{ "cdc-ring-size",					CASE_NAMESPACE_CDC_RING_SIZE },
 		{ "cold-start-evict-ttl",			CASE_NAMESPACE_COLD_START_EVICT_TTL },
 		{ "conflict-resolution-policy",		CASE_NAMESPACE_CONFLICT_RESOLUTION_POLICY },
+		{ "contiguous-records",				CASE_NAMESPACE_CONTIGUOUS_RECORDS },
 		{ "data-in-index",					CASE_NAMESPACE_DATA_IN_INDEX },
 		{ "disallow-null-setname",			CASE_NAMESPACE_DISALLOW_NULL_SETNAME },
 		{ "enable-benchmarks-batch-sub",	CASE_NAMESPACE_ENABLE_BENCHMARKS_BATCH_SUB },
@@ -1017,18 +1087,29 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "enable-benchmarks-write",		CASE_NAMESPACE_ENABLE_BENCHMARKS_WRITE },
 		{ "enable-hist-proxy",				CASE_NAMESPACE_ENABLE_HIST_PROXY },
 		{ "evict-hist-buckets",				CASE_NAMESPACE_EVICT_HIST_BUCKETS },
+		{ "evict-lru",						CASE_NAMESPACE_EVICT_LRU },
 		{ "evict-tenths-pct",				CASE_NAMESPACE_EVICT_TENTHS_PCT },
 		{ "high-water-disk-pct",			CASE_NAMESPACE_HIGH_WATER_DISK_PCT },
 		{ "high-water-memory-pct",			CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT },
+		{ "hot-key-sample-rate",			CASE_NAMESPACE_HOT_KEY_SAMPLE_RATE },
+		{ "index-huge-pages",				CASE_NAMESPACE_INDEX_HUGE_PAGES },
+		{ "index-numa-interleave",			CASE_NAMESPACE_INDEX_NUMA_INTERLEAVE },
+		{ "index-snapshot-file",			CASE_NAMESPACE_INDEX_SNAPSHOT_FILE },
 		{ "max-ttl",						CASE_NAMESPACE_MAX_TTL },
 		{ "migrate-order",					CASE_NAMESPACE_MIGRATE_ORDER },
 		{ "migrate-retransmit-ms",			CASE_NAMESPACE_MIGRATE_RETRANSMIT_MS },
 		{ "migrate-sleep",					CASE_NAMESPACE_MIGRATE_SLEEP },
+		{ "migrate-target-latency-ms",		CASE_NAMESPACE_MIGRATE_TARGET_LATENCY_MS },
 		{ "obj-size-hist-max",				CASE_NAMESPACE_OBJ_SIZE_HIST_MAX },
+		{ "partition-tree-hash",			CASE_NAMESPACE_PARTITION_TREE_HASH },
 		{ "partition-tree-locks",			CASE_NAMESPACE_PARTITION_TREE_LOCKS },
 		{ "partition-tree-sprigs",			CASE_NAMESPACE_PARTITION_TREE_SPRIGS },
+		{ "quota-bytes-per-sec",			CASE_NAMESPACE_QUOTA_BYTES_PER_SEC },
+		{ "quota-ops-per-sec",				CASE_NAMESPACE_QUOTA_OPS_PER_SEC },
 		{ "rack-id",						CASE_NAMESPACE_RACK_ID },
+		{ "rack-local-reads",				CASE_NAMESPACE_RACK_LOCAL_READS },
 		{ "read-consistency-level-override", CASE_NAMESPACE_READ_CONSISTENCY_LEVEL_OVERRIDE },
+		{ "response-compression-threshold",	CASE_NAMESPACE_RESPONSE_COMPRESSION_THRESHOLD },
 		{ "set",							CASE_NAMESPACE_SET_BEGIN },
 		{ "sindex",							CASE_NAMESPACE_SINDEX_BEGIN },
 		{ "geo2dsphere-within",				CASE_NAMESPACE_GEO2DSPHERE_WITHIN_BEGIN },
@@ -1036,6 +1117,7 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "stop-writes-pct",				CASE_NAMESPACE_STOP_WRITES_PCT },
 		{ "tomb-raider-eligible-age",		CASE_NAMESPACE_TOMB_RAIDER_ELIGIBLE_AGE },
 		{ "tomb-raider-period",				CASE_NAMESPACE_TOMB_RAIDER_PERIOD },
+		{ "truncate-delete-sleep",			CASE_NAMESPACE_TRUNCATE_DELETE_SLEEP },
 		{ "write-commit-level-override",	CASE_NAMESPACE_WRITE_COMMIT_LEVEL_OVERRIDE },
 		{ "allow-versions",					CASE_NAMESPACE_ALLOW_VERSIONS },
 		{ "demo-read-multiplier",			CASE_NAMESPACE_DEMO_READ_MULTIPLIER },
@@ -1078,6 +1160,11 @@ const cfg_opt NAMESPACE_STORAGE_DEVICE_OPTS[] = {
 		{ "memory-all",						CASE_NAMESPACE_STORAGE_DEVICE_MEMORY_ALL },
 		{ "data-in-memory",					CASE_NAMESPACE_STORAGE_DEVICE_DATA_IN_MEMORY },
 		{ "cold-start-empty",				CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_EMPTY },
+		{ "cold-start-threads",				CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_THREADS },
+		{ "commit-to-device",				CASE_NAMESPACE_STORAGE_DEVICE_COMMIT_TO_DEVICE },
+		{ "compression",					CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION },
+		{ "compression-level",				CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LEVEL },
+		{ "defrag-adaptive",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_ADAPTIVE },
 		{ "defrag-lwm-pct",					CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LWM_PCT },
 		{ "defrag-queue-min",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_QUEUE_MIN },
 		{ "defrag-sleep",					CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_SLEEP },
@@ -1087,11 +1174,20 @@ const cfg_opt NAMESPACE_STORAGE_DEVICE_OPTS[] = {
 		{ "enable-osync",					CASE_NAMESPACE_STORAGE_DEVICE_ENABLE_OSYNC },
 		{ "flush-max-ms",					CASE_NAMESPACE_STORAGE_DEVICE_FLUSH_MAX_MS },
 		{ "fsync-max-sec",					CASE_NAMESPACE_STORAGE_DEVICE_FSYNC_MAX_SEC },
+		{ "hot-record-age",					CASE_NAMESPACE_STORAGE_DEVICE_HOT_RECORD_AGE },
+		{ "hot-tier-size",					CASE_NAMESPACE_STORAGE_DEVICE_HOT_TIER_SIZE },
+		{ "io-uring-depth",					CASE_NAMESPACE_STORAGE_DEVICE_IO_URING_DEPTH },
 		{ "max-write-cache",				CASE_NAMESPACE_STORAGE_DEVICE_MAX_WRITE_CACHE },
 		{ "min-avail-pct",					CASE_NAMESPACE_STORAGE_DEVICE_MIN_AVAIL_PCT },
+		{ "persist-map-index",				CASE_NAMESPACE_STORAGE_DEVICE_PERSIST_MAP_INDEX },
+		{ "persistent-memory",				CASE_NAMESPACE_STORAGE_DEVICE_PERSISTENT_MEMORY },
 		{ "post-write-queue",				CASE_NAMESPACE_STORAGE_DEVICE_POST_WRITE_QUEUE },
+		{ "read-cache-size",				CASE_NAMESPACE_STORAGE_DEVICE_READ_CACHE_SIZE },
+		{ "shadow-max-write-cache",			CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_MAX_WRITE_CACHE },
 		{ "tomb-raider-sleep",				CASE_NAMESPACE_STORAGE_DEVICE_TOMB_RAIDER_SLEEP },
+		{ "write-shards",					CASE_NAMESPACE_STORAGE_DEVICE_WRITE_SHARDS },
 		{ "write-threads",					CASE_NAMESPACE_STORAGE_DEVICE_WRITE_THREADS },
+		{ "zoned",							CASE_NAMESPACE_STORAGE_DEVICE_ZONED },
 		{ "defrag-max-blocks",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_MAX_BLOCKS },
 		{ "defrag-period",					CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_PERIOD },
 		{ "load-at-startup",				CASE_NAMESPACE_STORAGE_DEVICE_LOAD_AT_STARTUP },
@@ -1102,9 +1198,20 @@ const cfg_opt NAMESPACE_STORAGE_DEVICE_OPTS[] = {
 		{ "}",								CASE_CONTEXT_END }
 };
 
+const cfg_opt NAMESPACE_STORAGE_DEVICE_COMPRESSION_OPTS[] = {
+		{ "none",							CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_NONE },
+		{ "lz4",							CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LZ4 },
+		{ "zstd",							CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_ZSTD },
+		{ "zlib",							CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_ZLIB }
+};
+
 const cfg_opt NAMESPACE_SET_OPTS[] = {
+		{ "set-compression-dictionary",		CASE_NAMESPACE_SET_COMPRESSION_DICTIONARY },
 		{ "set-disable-eviction",			CASE_NAMESPACE_SET_DISABLE_EVICTION },
+		{ "set-enable-index",				CASE_NAMESPACE_SET_ENABLE_INDEX },
 		{ "set-enable-xdr",					CASE_NAMESPACE_SET_ENABLE_XDR },
+		{ "set-quota-bytes-per-sec",		CASE_NAMESPACE_SET_QUOTA_BYTES_PER_SEC },
+		{ "set-quota-ops-per-sec",			CASE_NAMESPACE_SET_QUOTA_OPS_PER_SEC },
 		{ "set-stop-writes-count",			CASE_NAMESPACE_SET_STOP_WRITES_COUNT },
 		{ "set-evict-hwm-count",			CASE_NAMESPACE_SET_EVICT_HWM_COUNT },
 		{ "set-evict-hwm-pct",				CASE_NAMESPACE_SET_EVICT_HWM_PCT },
@@ -1129,6 +1236,7 @@ const cfg_opt NAMESPACE_SI_OPTS[] = {
 
 const cfg_opt NAMESPACE_SINDEX_OPTS[] = {
 		{ "num-partitions",					CASE_NAMESPACE_SINDEX_NUM_PARTITIONS },
+		{ "deferred-updates",				CASE_NAMESPACE_SINDEX_DEFERRED_UPDATES },
 		{ "}",								CASE_CONTEXT_END }
 };
 
@@ -1247,6 +1355,7 @@ const int NUM_NAMESPACE_READ_CONSISTENCY_OPTS		= sizeof(NAMESPACE_READ_CONSISTEN
 const int NUM_NAMESPACE_WRITE_COMMIT_OPTS			= sizeof(NAMESPACE_WRITE_COMMIT_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_STORAGE_OPTS				= sizeof(NAMESPACE_STORAGE_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_STORAGE_DEVICE_OPTS			= sizeof(NAMESPACE_STORAGE_DEVICE_OPTS) / sizeof(cfg_opt);
+const int NUM_NAMESPACE_STORAGE_DEVICE_COMPRESSION_OPTS	= sizeof(NAMESPACE_STORAGE_DEVICE_COMPRESSION_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_SET_OPTS					= sizeof(NAMESPACE_SET_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_SET_ENABLE_XDR_OPTS			= sizeof(NAMESPACE_SET_ENABLE_XDR_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_SI_OPTS						= sizeof(NAMESPACE_SI_OPTS) / sizeof(cfg_opt);
@@ -2091,6 +2200,9 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_PROTO_FD_MAX:
 				c->n_proto_fd_max = cfg_int_no_checks(&line);
 				break;
+			case CASE_SERVICE_ACCEPT_SHARDS:
+				c->accept_shards = cfg_bool(&line);
+				break;
 			case CASE_SERVICE_ADVERTISE_IPV6:
 				cf_socket_set_advertise_ipv6(cfg_bool(&line));
 				break;
@@ -2120,6 +2232,9 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_BATCH_MAX_REQUESTS:
 				c->batch_max_requests = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_BATCH_MAX_SUB_IN_FLIGHT:
+				c->batch_max_sub_in_flight = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_BATCH_MAX_UNUSED_BUFFERS:
 				c->batch_max_unused_buffers = cfg_u32_no_checks(&line);
 				break;
@@ -2129,6 +2244,9 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_BATCH_INDEX_THREADS:
 				c->n_batch_index_threads = cfg_u32(&line, 1, MAX_BATCH_THREADS);
 				break;
+			case CASE_SERVICE_BUSY_POLL_US:
+				c->busy_poll_us = cfg_u32(&line, 0, 1000);
+				break;
 			case CASE_SERVICE_CLOCK_SKEW_MAX_MS:
 				c->clock_skew_max_ms = cfg_u32_no_checks(&line);
 				break;
@@ -2157,6 +2275,9 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_INFO_THREADS:
 				c->n_info_threads = cfg_int_no_checks(&line);
 				break;
+			case CASE_SERVICE_LOG_ASYNC:
+				cf_fault_log_async(cfg_bool(&line));
+				break;
 			case CASE_SERVICE_LOG_LOCAL_TIME:
 				cf_fault_use_local_time(cfg_bool(&line));
 				break;
@@ -2184,6 +2305,12 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_NSUP_STARTUP_EVICT:
 				c->nsup_startup_evict = cfg_bool(&line);
 				break;
+			case CASE_SERVICE_NSUP_THREADS:
+				c->n_nsup_threads = cfg_u32(&line, 1, MAX_NSUP_THREADS);
+				break;
+			case CASE_SERVICE_NUMA_PARTITIONS:
+				c->numa_partitions = cfg_bool(&line);
+				break;
 			case CASE_SERVICE_PROTO_FD_IDLE_MS:
 				c->proto_fd_idle_ms = cfg_int_no_checks(&line);
 				break;
@@ -2193,6 +2320,9 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_QUERY_BUFPOOL_SIZE:
 				c->query_bufpool_size = cfg_u32(&line, 1, UINT32_MAX);
 				break;
+			case CASE_SERVICE_QUERY_CURSOR_TTL:
+				c->query_cursor_ttl = cfg_u32(&line, 1, UINT32_MAX);
+				break;
 			case CASE_SERVICE_QUERY_IN_TRANSACTION_THREAD:
 				c->query_in_transaction_thr = cfg_bool(&line);
 				break;
@@ -2232,9 +2362,15 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_QUERY_WORKER_THREADS:
 				c->query_worker_threads = cfg_u32(&line, 1, AS_QUERY_MAX_WORKER_THREADS);
 				break;
+			case CASE_SERVICE_RECORD_LOCKS:
+				c->n_record_locks = cfg_u32_power_of_2(&line, 0, OLOCK_MAX_LOCKS);
+				break;
 			case CASE_SERVICE_RUN_AS_DAEMON:
 				c->run_as_daemon = cfg_bool_no_value_is_true(&line);
 				break;
+			case CASE_SERVICE_SCAN_AGGR_PARALLELISM:
+				c->scan_aggr_parallelism = cfg_u32(&line, 1, AS_AGGR_MAX_LANES);
+				break;
 			case CASE_SERVICE_SCAN_MAX_ACTIVE:
 				c->scan_max_active = cfg_u32(&line, 0, 200);
 				break;
@@ -2268,6 +2404,12 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_TRANSACTION_PENDING_LIMIT:
 				c->transaction_pending_limit = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_TRANSACTION_QUEUE_BATCH_RATIO:
+				c->transaction_queue_batch_ratio = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_TRANSACTION_QUEUE_STEALING:
+				c->transaction_queue_stealing = cfg_bool(&line);
+				break;
 			case CASE_SERVICE_TRANSACTION_QUEUES:
 				c->n_transaction_queues = cfg_u32(&line, 1, MAX_TRANSACTION_QUEUES);
 				break;
@@ -2350,7 +2492,6 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_NSUP_QUEUE_LWM:
 			case CASE_SERVICE_NSUP_REDUCE_PRIORITY:
 			case CASE_SERVICE_NSUP_REDUCE_SLEEP:
-			case CASE_SERVICE_NSUP_THREADS:
 			case CASE_SERVICE_PAXOS_MAX_CLUSTER_SIZE:
 			case CASE_SERVICE_PAXOS_PROTOCOL:
 			case CASE_SERVICE_PAXOS_RECOVERY_POLICY:
@@ -2593,6 +2734,9 @@ as_config_init(const char* config_file)
 			case CASE_NETWORK_HEARTBEAT_TIMEOUT:
 				c->hb_config.max_intervals_missed = cfg_u32(&line, AS_HB_MAX_INTERVALS_MISSED_MIN, UINT_MAX);
 				break;
+			case CASE_NETWORK_HEARTBEAT_PHI_THRESHOLD:
+				c->hb_config.phi_threshold = cfg_u32(&line, 0, AS_HB_PHI_THRESHOLD_MAX);
+				break;
 			case CASE_NETWORK_HEARTBEAT_MTU:
 				c->hb_config.override_mtu = cfg_u32_no_checks(&line);
 				break;
@@ -2846,6 +2990,9 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_ALLOW_XDR_WRITES:
 				ns->ns_allow_xdr_writes = cfg_bool(&line);
 				break;
+			case CASE_NAMESPACE_CDC_RING_SIZE:
+				ns->cdc_ring_size = cfg_u32_power_of_2(&line, 0, 1024 * 1024);
+				break;
 			case CASE_NAMESPACE_COLD_START_EVICT_TTL:
 				ns->cold_start_evict_ttl = cfg_u32_no_checks(&line);
 				break;
@@ -2863,6 +3010,9 @@ as_config_init(const char* config_file)
 					break;
 				}
 				break;
+			case CASE_NAMESPACE_CONTIGUOUS_RECORDS:
+				ns->contiguous_records = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_DATA_IN_INDEX:
 				ns->data_in_index = cfg_bool(&line);
 				break;
@@ -2890,6 +3040,9 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_EVICT_HIST_BUCKETS:
 				ns->evict_hist_buckets = cfg_u32(&line, 100, 10000000);
 				break;
+			case CASE_NAMESPACE_EVICT_LRU:
+				ns->evict_lru = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_EVICT_TENTHS_PCT:
 				ns->evict_tenths_pct = cfg_u32_no_checks(&line);
 				break;
@@ -2899,6 +3052,18 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT:
 				ns->hwm_memory_pct = cfg_u32(&line, 0, 100);
 				break;
+			case CASE_NAMESPACE_HOT_KEY_SAMPLE_RATE:
+				ns->hot_key_sample_rate = cfg_u32_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_INDEX_HUGE_PAGES:
+				ns->index_huge_pages = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_INDEX_NUMA_INTERLEAVE:
+				ns->index_numa_interleave = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_INDEX_SNAPSHOT_FILE:
+				ns->index_snapshot_file = cfg_strdup_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_MAX_TTL:
 				ns->max_ttl = cfg_seconds(&line, 1, MAX_ALLOWED_TTL);
 				break;
@@ -2911,18 +3076,33 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_MIGRATE_SLEEP:
 				ns->migrate_sleep = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_MIGRATE_TARGET_LATENCY_MS:
+				ns->migrate_target_latency_ms = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_OBJ_SIZE_HIST_MAX:
 				ns->obj_size_hist_max = cfg_obj_size_hist_max(cfg_u32_no_checks(&line));
 				break;
+			case CASE_NAMESPACE_PARTITION_TREE_HASH:
+				ns->tree_shared.hash_index = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_PARTITION_TREE_LOCKS:
 				ns->tree_shared.n_lock_pairs = cfg_u32_power_of_2(&line, 1, 256);
 				break;
 			case CASE_NAMESPACE_PARTITION_TREE_SPRIGS:
 				ns->tree_shared.n_sprigs = cfg_u32_power_of_2(&line, 16, 4096);
 				break;
+			case CASE_NAMESPACE_QUOTA_BYTES_PER_SEC:
+				as_quota_set_rate(&ns->quota.bytes, cfg_u64_no_checks(&line));
+				break;
+			case CASE_NAMESPACE_QUOTA_OPS_PER_SEC:
+				as_quota_set_rate(&ns->quota.ops, cfg_u64_no_checks(&line));
+				break;
 			case CASE_NAMESPACE_RACK_ID:
 				ns->rack_id = cfg_u32(&line, 0, MAX_RACK_ID);
 				break;
+			case CASE_NAMESPACE_RACK_LOCAL_READS:
+				ns->rack_local_reads = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_READ_CONSISTENCY_LEVEL_OVERRIDE:
 				switch (cfg_find_tok(line.val_tok_1, NAMESPACE_READ_CONSISTENCY_OPTS, NUM_NAMESPACE_READ_CONSISTENCY_OPTS)) {
 				case CASE_NAMESPACE_READ_CONSISTENCY_ALL:
@@ -2940,6 +3120,9 @@ as_config_init(const char* config_file)
 					break;
 				}
 				break;
+			case CASE_NAMESPACE_RESPONSE_COMPRESSION_THRESHOLD:
+				ns->response_compression_threshold = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_SET_BEGIN:
 				p_set = cfg_add_set(ns);
 				cfg_strcpy(&line, p_set->name, AS_SET_NAME_MAX_SIZE);
@@ -2965,6 +3148,9 @@ as_config_init(const char* config_file)
 				cfg_enterprise_only(&line);
 				ns->tomb_raider_period = cfg_seconds_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_TRUNCATE_DELETE_SLEEP:
+				ns->truncate_delete_sleep = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_WRITE_COMMIT_LEVEL_OVERRIDE:
 				switch (cfg_find_tok(line.val_tok_1, NAMESPACE_WRITE_COMMIT_OPTS, NUM_NAMESPACE_WRITE_COMMIT_OPTS)) {
 				case CASE_NAMESPACE_WRITE_COMMIT_ALL:
@@ -2996,6 +3182,9 @@ as_config_init(const char* config_file)
 				cfg_begin_context(&state, NAMESPACE_SI);
 				break;
 			case CASE_CONTEXT_END:
+				if (ns->contiguous_records && ! (ns->storage_data_in_memory && ! ns->single_bin)) {
+					cf_crash_nostack(AS_CFG, "ns %s contiguous-records can't be true unless data-in-memory is true and single-bin is false", ns->name);
+				}
 				if (ns->data_in_index && ! (ns->single_bin && ns->storage_data_in_memory && ns->storage_type == AS_STORAGE_ENGINE_SSD)) {
 					cf_crash_nostack(AS_CFG, "ns %s data-in-index can't be true unless storage-engine is device and both single-bin and data-in-memory are true", ns->name);
 				}
@@ -3005,8 +3194,16 @@ as_config_init(const char* config_file)
 				if (ns->tree_shared.n_lock_pairs > ns->tree_shared.n_sprigs) {
 					cf_crash_nostack(AS_CFG, "ns %s partition-tree-locks can't be > partition-tree-sprigs", ns->name);
 				}
+				if (ns->index_snapshot_file && (ns->storage_data_in_memory || ns->storage_type != AS_STORAGE_ENGINE_SSD)) {
+					cf_crash_nostack(AS_CFG, "ns %s index-snapshot-file can't be configured unless storage-engine is device and data-in-memory is false", ns->name);
+				}
+				if (ns->storage_hot_tier_size != 0 && ns->storage_read_cache_size != 0) {
+					cf_crash_nostack(AS_CFG, "ns %s can't configure both hot-tier-size and read-cache-size", ns->name);
+				}
 				if (ns->storage_data_in_memory) {
 					ns->storage_post_write_queue = 0; // override default (or configuration mistake)
+					ns->storage_read_cache_size = 0; // configuration mistake
+					ns->storage_hot_tier_size = 0; // configuration mistake
 					c->n_namespaces_in_memory++;
 				}
 				else {
@@ -3051,6 +3248,42 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_EMPTY:
 				ns->storage_cold_start_empty = cfg_bool(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_THREADS:
+				ns->storage_cold_start_threads = cfg_u32(&line, 0, 256);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COMMIT_TO_DEVICE:
+				ns->storage_commit_to_device = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION:
+				switch (cfg_find_tok(line.val_tok_1, NAMESPACE_STORAGE_DEVICE_COMPRESSION_OPTS, NUM_NAMESPACE_STORAGE_DEVICE_COMPRESSION_OPTS)) {
+				case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_NONE:
+					ns->storage_compression = CF_COMPRESSION_NONE;
+					break;
+				case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LZ4:
+					ns->storage_compression = CF_COMPRESSION_LZ4;
+					break;
+				case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_ZSTD:
+					ns->storage_compression = CF_COMPRESSION_ZSTD;
+					break;
+				case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_ZLIB:
+					ns->storage_compression = CF_COMPRESSION_ZLIB;
+					break;
+				case CASE_NOT_FOUND:
+				default:
+					cfg_unknown_val_tok_1(&line);
+					break;
+				}
+				if (! cf_compression_is_available(ns->storage_compression)) {
+					cf_crash_nostack(AS_CFG, "line %d :: server not built with %s compression support",
+							line.num, cf_compression_method_str(ns->storage_compression));
+				}
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LEVEL:
+				ns->storage_compression_level = cfg_u32(&line, 0, 22);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_ADAPTIVE:
+				ns->storage_defrag_adaptive = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LWM_PCT:
 				ns->storage_defrag_lwm_pct = cfg_u32_no_checks(&line);
 				break;
@@ -3078,22 +3311,49 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_STORAGE_DEVICE_FSYNC_MAX_SEC:
 				ns->storage_fsync_max_us = cfg_u64_no_checks(&line) * 1000000;
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_HOT_RECORD_AGE:
+				ns->storage_hot_record_age = cfg_seconds_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_HOT_TIER_SIZE:
+				ns->storage_hot_tier_size = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_IO_URING_DEPTH:
+				ns->storage_io_uring_depth = cfg_u32(&line, 0, CF_URING_MAX_DEPTH);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_MAX_WRITE_CACHE:
 				ns->storage_max_write_cache = cfg_u64_no_checks(&line);
 				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_MIN_AVAIL_PCT:
 				ns->storage_min_avail_pct = cfg_u32(&line, 0, 100);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_PERSIST_MAP_INDEX:
+				ns->storage_persist_map_index = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_PERSISTENT_MEMORY:
+				ns->storage_persistent_memory = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_POST_WRITE_QUEUE:
 				ns->storage_post_write_queue = cfg_u32(&line, 0, 2 * 1024);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_READ_CACHE_SIZE:
+				ns->storage_read_cache_size = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_MAX_WRITE_CACHE:
+				ns->storage_shadow_max_write_cache = cfg_u64_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_TOMB_RAIDER_SLEEP:
 				cfg_enterprise_only(&line);
 				ns->storage_tomb_raider_sleep = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_WRITE_SHARDS:
+				ns->storage_write_shards = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_WRITE_THREADS:
 				ns->storage_write_threads = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_ZONED:
+				ns->storage_zoned = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_MAX_BLOCKS:
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_PERIOD:
 			case CASE_NAMESPACE_STORAGE_DEVICE_LOAD_AT_STARTUP:
@@ -3118,9 +3378,15 @@ as_config_init(const char* config_file)
 		//
 		case NAMESPACE_SET:
 			switch (cfg_find_tok(line.name_tok, NAMESPACE_SET_OPTS, NUM_NAMESPACE_SET_OPTS)) {
+			case CASE_NAMESPACE_SET_COMPRESSION_DICTIONARY:
+				cfg_add_set_dict_file(ns, p_set, cfg_strdup_no_checks(&line));
+				break;
 			case CASE_NAMESPACE_SET_DISABLE_EVICTION:
 				DISABLE_SET_EVICTION(p_set, cfg_bool(&line));
 				break;
+			case CASE_NAMESPACE_SET_ENABLE_INDEX:
+				p_set->enable_index = cfg_bool(&line) ? 1 : 0;
+				break;
 			case CASE_NAMESPACE_SET_ENABLE_XDR:
 				switch (cfg_find_tok(line.val_tok_1, NAMESPACE_SET_ENABLE_XDR_OPTS, NUM_NAMESPACE_SET_ENABLE_XDR_OPTS)) {
 				case CASE_NAMESPACE_SET_ENABLE_XDR_USE_DEFAULT:
@@ -3138,6 +3404,12 @@ as_config_init(const char* config_file)
 					break;
 				}
 				break;
+			case CASE_NAMESPACE_SET_QUOTA_BYTES_PER_SEC:
+				p_set->quota.bytes.rate = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_SET_QUOTA_OPS_PER_SEC:
+				p_set->quota.ops.rate = cfg_u64_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_SET_STOP_WRITES_COUNT:
 				p_set->stop_writes_count = cfg_u64_no_checks(&line);
 				break;
@@ -3193,6 +3465,9 @@ as_config_init(const char* config_file)
 				// FIXME - minimum should be 1, but currently crashes.
 				ns->sindex_num_partitions = cfg_u32(&line, MIN_PARTITIONS_PER_INDEX, MAX_PARTITIONS_PER_INDEX);
 				break;
+			case CASE_NAMESPACE_SINDEX_DEFERRED_UPDATES:
+				ns->sindex_deferred_updates = cfg_bool(&line);
+				break;
 			case CASE_CONTEXT_END:
 				cfg_end_context(&state);
 				break;
@@ -3565,8 +3840,17 @@ as_config_post_process(as_config* c, const char* config_file)
 		}
 	}
 
+	if (c->numa_partitions && c->auto_pin != CF_TOPO_AUTO_PIN_CPU) {
+		cf_crash_nostack(AS_CFG, "'numa-partitions' requires 'auto-pin cpu'");
+	}
+
 	uint16_t n_cpus = cf_topo_count_cpus();
 
+	if (c->numa_partitions && n_cpus > MAX_TRANSACTION_QUEUES) {
+		cf_crash_nostack(AS_CFG, "'numa-partitions' supports at most %u CPUs",
+				MAX_TRANSACTION_QUEUES);
+	}
+
 	if (c->n_service_threads == 0) {
 		c->n_service_threads = n_cpus;
 	}
@@ -3575,12 +3859,26 @@ as_config_post_process(as_config* c, const char* config_file)
 		// If there's at least one SSD namespace, use CPU count. Otherwise, be
 		// modest - only proxies, internal retries, and background scans & queries
 		// will use these queues & threads.
-		c->n_transaction_queues = g_config.n_namespaces_not_in_memory != 0 ? n_cpus : 4;
+		// With numa-partitions, every CPU needs a queue to route to.
+		c->n_transaction_queues =
+				g_config.n_namespaces_not_in_memory != 0 || c->numa_partitions ?
+						n_cpus : 4;
 	}
 
-	// Allocate and initialize the record locks (olocks). Maybe not the best
-	// place for this, unless we make number of locks configurable.
-	g_record_locks = olock_create(16 * 1024, true);
+	if (c->n_record_locks == 0) {
+		// Scale with cores so transaction threads rarely collide on a lock -
+		// at least the historical 16K, and about 1K per CPU beyond that.
+		uint32_t n_locks = 16 * 1024;
+
+		while (n_locks < (uint32_t)n_cpus * 1024 && n_locks < OLOCK_MAX_LOCKS) {
+			n_locks <<= 1;
+		}
+
+		c->n_record_locks = n_locks;
+	}
+
+	// Allocate and initialize the record locks (olocks).
+	g_record_locks = olock_create(c->n_record_locks, true);
 
 	// Setup performance metrics histograms.
 	cfg_create_all_histograms();
@@ -3799,6 +4097,9 @@ as_config_post_process(as_config* c, const char* config_file)
 		sprintf(hist_name, "{%s}-query-rec-count", ns->name);
 		create_and_check_hist(&ns->query_rec_count_hist, hist_name, HIST_COUNT);
 
+		sprintf(hist_name, "{%s}-response-compression-pct", ns->name);
+		create_and_check_hist(&ns->response_compression_hist, hist_name, HIST_COUNT);
+
 		// Activate-by-config histograms (can't be tracked histograms).
 
 		sprintf(hist_name, "{%s}-proxy", ns->name);
@@ -4353,6 +4654,20 @@ cfg_add_set(as_namespace* ns)
 	return &ns->sets_cfg_array[ns->sets_cfg_count++];
 }
 
+void
+cfg_add_set_dict_file(as_namespace* ns, as_set* p_set, char* file_name)
+{
+	// Lazily allocate temporary dictionary paths array.
+	if (! ns->sets_cfg_dict_files) {
+		size_t array_size = AS_SET_MAX_COUNT * sizeof(char*);
+
+		ns->sets_cfg_dict_files = (char**)cf_malloc(array_size);
+		memset(ns->sets_cfg_dict_files, 0, array_size);
+	}
+
+	ns->sets_cfg_dict_files[p_set - ns->sets_cfg_array] = file_name;
+}
+
 void
 cfg_add_storage_file(as_namespace* ns, char* file_name)
 {
@@ -4443,6 +4758,7 @@ void
 cfg_create_all_histograms()
 {
 	create_and_check_hist(&g_stats.batch_index_hist, "batch-index", HIST_MILLISECONDS);
+	create_and_check_hist(&g_stats.batch_index_fill_hist, "batch-index-buffer-fill-pct", HIST_COUNT);
 	create_and_check_hist(&g_stats.info_hist, "info", HIST_MILLISECONDS);
 	create_and_check_hist(&g_stats.svc_demarshal_hist, "svc-demarshal", HIST_MILLISECONDS);
 	create_and_check_hist(&g_stats.svc_queue_hist, "svc-queue", HIST_MILLISECONDS);
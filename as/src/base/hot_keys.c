@@ -0,0 +1,296 @@
+/*
+ * hot_keys.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+//==========================================================
+// Includes.
+//
+
+#include "base/hot_keys.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "vmapx.h"
+
+#include "base/datamodel.h"
+#include "base/proto.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define N_TICKER_KEYS 3
+
+
+//==========================================================
+// Globals.
+//
+
+static __thread uint32_t g_n_skipped = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint16_t sample_set_id(as_namespace* ns, const as_transaction* tr);
+static void insert_key(as_hot_keys* hk, const cf_digest* keyd, uint16_t set_id, uint32_t weight, uint32_t bytes);
+static uint32_t sorted_top(as_hot_keys* hk, as_hot_key* top, uint32_t n_max, uint64_t* p_elapsed_ms, uint64_t* set_counts);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_hot_keys_init(as_hot_keys* hk)
+{
+	memset(hk, 0, sizeof(as_hot_keys));
+	pthread_mutex_init(&hk->lock, NULL);
+	hk->start_ms = cf_getms();
+}
+
+// Caller checks hot-key-sample-rate is non-zero.
+void
+as_hot_keys_sample(as_namespace* ns, const as_transaction* tr)
+{
+	uint32_t rate = ns->hot_key_sample_rate;
+
+	if (++g_n_skipped < rate) {
+		return;
+	}
+
+	g_n_skipped = 0;
+
+	uint16_t set_id = sample_set_id(ns, tr);
+	uint32_t bytes = (uint32_t)tr->msgp->proto.sz;
+	as_hot_keys* hk = &ns->hot_keys;
+
+	pthread_mutex_lock(&hk->lock);
+
+	insert_key(hk, &tr->keyd, set_id, rate, bytes * rate);
+	hk->set_counts[set_id] += rate;
+
+	pthread_mutex_unlock(&hk->lock);
+}
+
+void
+as_hot_keys_info(as_namespace* ns, cf_dyn_buf* db)
+{
+	as_hot_key top[AS_HOT_KEYS_CAPACITY];
+	uint64_t set_counts[AS_SET_MAX_COUNT + 1];
+	uint64_t elapsed_ms;
+	uint32_t n_top = sorted_top(&ns->hot_keys, top, AS_HOT_KEYS_CAPACITY,
+			&elapsed_ms, set_counts);
+
+	uint64_t elapsed_s = elapsed_ms / 1000 != 0 ? elapsed_ms / 1000 : 1;
+	size_t start_sz = db->used_sz;
+
+	for (uint32_t i = 0; i < n_top; i++) {
+		as_hot_key* key = &top[i];
+
+		cf_dyn_buf_append_string(db, "digest=");
+
+		for (uint32_t b = 0; b < CF_DIGEST_KEY_SZ; b++) {
+			static const char hex[] = "0123456789ABCDEF";
+
+			cf_dyn_buf_append_char(db, hex[key->keyd.digest[b] >> 4]);
+			cf_dyn_buf_append_char(db, hex[key->keyd.digest[b] & 0xF]);
+		}
+
+		const char* set_name = as_namespace_get_set_name(ns, key->set_id);
+
+		cf_dyn_buf_append_string(db, ":set=");
+		cf_dyn_buf_append_string(db, set_name ? set_name : "");
+		cf_dyn_buf_append_string(db, ":ops-per-sec=");
+		cf_dyn_buf_append_uint64(db, key->count / elapsed_s);
+		cf_dyn_buf_append_string(db, ":bytes-per-sec=");
+		cf_dyn_buf_append_uint64(db, key->bytes / elapsed_s);
+		cf_dyn_buf_append_string(db, ":error=");
+		cf_dyn_buf_append_uint64(db, key->error / elapsed_s);
+		cf_dyn_buf_append_char(db, ';');
+	}
+
+	for (uint32_t set_id = 1; set_id <= AS_SET_MAX_COUNT; set_id++) {
+		if (set_counts[set_id] == 0) {
+			continue;
+		}
+
+		const char* set_name = as_namespace_get_set_name(ns,
+				(uint16_t)set_id);
+
+		cf_dyn_buf_append_string(db, "set=");
+		cf_dyn_buf_append_string(db, set_name ? set_name : "");
+		cf_dyn_buf_append_string(db, ":ops-per-sec=");
+		cf_dyn_buf_append_uint64(db, set_counts[set_id] / elapsed_s);
+		cf_dyn_buf_append_char(db, ';');
+	}
+
+	if (db->used_sz != start_sz) {
+		cf_dyn_buf_chomp(db);
+	}
+}
+
+// Logs the hottest keys, then starts a new window.
+void
+as_hot_keys_ticker(as_namespace* ns)
+{
+	as_hot_keys* hk = &ns->hot_keys;
+	as_hot_key top[N_TICKER_KEYS];
+	uint64_t elapsed_ms;
+	uint32_t n_top = sorted_top(hk, top, N_TICKER_KEYS, &elapsed_ms, NULL);
+
+	pthread_mutex_lock(&hk->lock);
+
+	hk->n_keys = 0;
+	memset(hk->set_counts, 0, sizeof(hk->set_counts));
+	hk->start_ms = cf_getms();
+
+	pthread_mutex_unlock(&hk->lock);
+
+	uint64_t elapsed_s = elapsed_ms / 1000 != 0 ? elapsed_ms / 1000 : 1;
+
+	for (uint32_t i = 0; i < n_top; i++) {
+		const char* set_name = as_namespace_get_set_name(ns, top[i].set_id);
+
+		cf_info_digest(AS_INFO, &top[i].keyd, "{%s} hot-key: set %s ops-per-sec %lu bytes-per-sec %lu ",
+				ns->name, set_name ? set_name : "",
+				top[i].count / elapsed_s, top[i].bytes / elapsed_s);
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static uint16_t
+sample_set_id(as_namespace* ns, const as_transaction* tr)
+{
+	if (! as_transaction_has_set(tr)) {
+		return INVALID_SET_ID;
+	}
+
+	as_msg_field* sf = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET);
+	uint32_t set_sz = as_msg_field_get_value_sz(sf);
+	uint32_t idx;
+
+	if (set_sz == 0 || cf_vmapx_get_index_w_len(ns->p_sets_vmap,
+			(const char*)sf->data, set_sz, &idx) != CF_VMAPX_OK) {
+		return INVALID_SET_ID;
+	}
+
+	return (uint16_t)(idx + 1);
+}
+
+// Space-Saving - a new key replaces the minimum and inherits its count as an
+// (over)estimate, so any key with more than 1/CAPACITY of samples is kept.
+static void
+insert_key(as_hot_keys* hk, const cf_digest* keyd, uint16_t set_id,
+		uint32_t weight, uint32_t bytes)
+{
+	as_hot_key* min_key = NULL;
+
+	for (uint32_t i = 0; i < hk->n_keys; i++) {
+		as_hot_key* key = &hk->keys[i];
+
+		if (cf_digest_compare(&key->keyd, keyd) == 0) {
+			key->count += weight;
+			key->bytes += bytes;
+			return;
+		}
+
+		if (! min_key || key->count < min_key->count) {
+			min_key = key;
+		}
+	}
+
+	if (hk->n_keys < AS_HOT_KEYS_CAPACITY) {
+		as_hot_key* key = &hk->keys[hk->n_keys++];
+
+		key->keyd = *keyd;
+		key->set_id = set_id;
+		key->count = weight;
+		key->error = 0;
+		key->bytes = bytes;
+		return;
+	}
+
+	min_key->keyd = *keyd;
+	min_key->set_id = set_id;
+	min_key->error = min_key->count;
+	min_key->count += weight;
+	min_key->bytes = bytes;
+}
+
+// Copies out the n_max highest-count keys, in descending order.
+static uint32_t
+sorted_top(as_hot_keys* hk, as_hot_key* top, uint32_t n_max,
+		uint64_t* p_elapsed_ms, uint64_t* set_counts)
+{
+	as_hot_key keys[AS_HOT_KEYS_CAPACITY];
+
+	pthread_mutex_lock(&hk->lock);
+
+	uint32_t n_keys = hk->n_keys;
+
+	memcpy(keys, hk->keys, sizeof(as_hot_key) * n_keys);
+	*p_elapsed_ms = cf_getms() - hk->start_ms;
+
+	if (set_counts) {
+		memcpy(set_counts, hk->set_counts, sizeof(hk->set_counts));
+	}
+
+	pthread_mutex_unlock(&hk->lock);
+
+	uint32_t n_top = n_keys < n_max ? n_keys : n_max;
+
+	// Selection sort - at most AS_HOT_KEYS_CAPACITY keys.
+	for (uint32_t i = 0; i < n_top; i++) {
+		uint32_t max_i = i;
+
+		for (uint32_t j = i + 1; j < n_keys; j++) {
+			if (keys[j].count > keys[max_i].count) {
+				max_i = j;
+			}
+		}
+
+		as_hot_key tmp = keys[i];
+
+		keys[i] = keys[max_i];
+		keys[max_i] = tmp;
+		top[i] = keys[i];
+	}
+
+	return n_top;
+}
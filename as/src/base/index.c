@@ -32,6 +32,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 #include <xmmintrin.h>
 
 #include "citrusleaf/alloc.h"
@@ -77,6 +78,53 @@ typedef struct as_index_ele_s {
 
 const size_t MAX_STACK_ARRAY_BYTES = 128 * 1024;
 
+// How many elements ahead of the callback a reduce prefetches.
+#define REDUCE_PREFETCH_DISTANCE 8
+
+// A sprig walk touches keyd and the child handles of each element - with
+// arena stages cache line aligned (see cf_arenax_add_stage()), that's exactly
+// one cache line per element.
+COMPILER_ASSERT(sizeof(as_index) == 64);
+
+// Sprig hash slots hold a 32-bit digest hash above a 32-bit arena handle. An
+// empty slot is 0 - handles are never SENTINEL_H.
+#define HASH_MIN_SLOTS 8 // one cache line
+#define HASH_SLOT(_hash, _h) (((uint64_t)(_hash) << 32) | (uint32_t)(_h))
+#define HASH_SLOT_HASH(_slot) ((uint32_t)((_slot) >> 32))
+#define HASH_SLOT_H(_slot) ((cf_arenax_handle)(uint32_t)(_slot))
+
+COMPILER_ASSERT(((uint64_t)CF_ARENAX_MAX_STAGES << ELEMENT_ID_NUM_BITS) <=
+		(1UL << 32));
+
+// Set list slots hold the set-ID above the arena handle - an empty slot is 0.
+#define SET_SLOT(_set_id, _h) (((uint64_t)(_set_id) << 32) | (uint32_t)(_h))
+#define SET_SLOT_SET_ID(_slot) ((uint16_t)((_slot) >> 32))
+#define SET_SLOT_H(_slot) ((cf_arenax_handle)(uint32_t)(_slot))
+
+typedef struct as_index_set_list_s {
+	const as_index_tree_shared *shared;
+
+	pthread_mutex_t	lock;
+	uint64_t		*slots;
+	uint32_t		mask;
+	uint32_t		n_used;
+} as_index_set_list;
+
+// Released trees stay intact this long before they're destroyed, so lock-free
+// partition reservations may still safely look at a tree's reference count.
+#define TREE_GC_GRACE_MS 1000
+
+// Trees are destroyed by a small pool of threads, a slice of sprigs at a time,
+// so big drops progress in parallel and don't queue up behind one tree.
+#define TREE_GC_N_THREADS 4
+#define TREE_GC_SLICE_SPRIGS 64
+
+typedef struct tree_gc_ele_s {
+	as_index_tree	*tree;
+	uint64_t		release_ms;
+	uint32_t		next_sprig; // sprigs before this are already purged
+} tree_gc_ele;
+
 
 //==========================================================
 // Globals.
@@ -84,24 +132,32 @@ const size_t MAX_STACK_ARRAY_BYTES = 128 * 1024;
 
 static cf_queue g_gc_queue;
 
+// Elements in released trees that aren't yet destroyed.
+static cf_atomic64 g_gc_backlog = 0;
+
 
 //==========================================================
 // Forward declarations.
 //
 
 void *run_index_tree_gc(void *unused);
+bool as_index_tree_destroy_slice(as_index_tree *tree, uint32_t *next_sprig);
 void as_index_tree_destroy(as_index_tree *tree);
 void as_index_sprig_done(as_index_sprig *isprig, as_index *r, cf_arenax_handle r_h);
 bool as_index_sprig_invalid_record_done(as_index_sprig *isprig, as_index_ref *index_ref);
 
 uint64_t as_index_sprig_reduce_partial(as_index_sprig *isprig, uint64_t sample_count, as_index_reduce_fn cb, void *udata);
+void as_index_sprig_reduce_range(as_index_sprig *isprig, const cf_digest *high, const cf_digest *low, as_index_reduce_fn cb, void *udata);
+void as_index_sprig_reduce_collected(as_index_sprig *isprig, as_index_ph_array *v_a, as_index_reduce_fn cb, void *udata);
 void as_index_sprig_traverse(as_index_sprig *isprig, cf_arenax_handle r_h, as_index_ph_array *v_a);
+void as_index_sprig_traverse_range(as_index_sprig *isprig, cf_arenax_handle r_h, const cf_digest *high, const cf_digest *low, as_index_ph_array *v_a);
 void as_index_sprig_traverse_purge(as_index_sprig *isprig, cf_arenax_handle r_h);
 
 int as_index_sprig_exists(as_index_sprig *isprig, cf_digest *keyd);
 int as_index_sprig_get_vlock(as_index_sprig *isprig, cf_digest *keyd, as_index_ref *index_ref);
 int as_index_sprig_get_insert_vlock(as_index_sprig *isprig, cf_digest *keyd, as_index_ref *index_ref);
 int as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd);
+bool as_index_sprig_relocate(as_index_sprig *isprig, const cf_digest *keyd, cf_arenax_handle r_h);
 
 int as_index_sprig_search_lockless(as_index_sprig *isprig, cf_digest *keyd, as_index **ret, cf_arenax_handle *ret_h);
 void as_index_sprig_insert_rebalance(as_index_sprig *isprig, as_index *root_parent, as_index_ele *ele);
@@ -109,6 +165,42 @@ void as_index_sprig_delete_rebalance(as_index_sprig *isprig, as_index *root_pare
 void as_index_rotate_left(as_index_ele *a, as_index_ele *b);
 void as_index_rotate_right(as_index_ele *a, as_index_ele *b);
 
+int as_index_sprig_hash_search(as_index_sprig *isprig, cf_digest *keyd, as_index **ret, cf_arenax_handle *ret_h);
+void as_index_sprig_hash_remove(as_index_sprig *isprig, const cf_digest *keyd, cf_arenax_handle r_h);
+void as_index_sprig_hash_move(as_index_sprig *isprig, const cf_digest *keyd, cf_arenax_handle old_h, cf_arenax_handle new_h);
+void as_index_sprig_hash_grow(as_sprig *sprig);
+
+as_index_set_list *as_index_set_list_create(const as_index_tree_shared *shared);
+void as_index_set_list_destroy(as_index_set_list *list);
+void as_index_set_list_remove(as_index_set_list *list, cf_arenax_handle r_h);
+uint64_t as_index_set_list_remove_lockless(as_index_set_list *list, cf_arenax_handle r_h);
+void as_index_set_list_move(as_index_set_list *list, cf_arenax_handle old_h, cf_arenax_handle new_h);
+void as_index_set_list_grow(as_index_set_list *list);
+
+// Same order as cf_digest_compare() - i.e. memcmp() - which sprigs (including
+// those resumed from a snapshot) are sorted by. But the first 8 bytes nearly
+// always decide, so compare them as one word.
+static inline int
+as_index_digest_compare(const cf_digest *d1, const cf_digest *d2)
+{
+	uint64_t p1;
+	uint64_t p2;
+
+	memcpy(&p1, d1->digest, sizeof(p1));
+	memcpy(&p2, d2->digest, sizeof(p2));
+
+	if (p1 != p2) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		p1 = __builtin_bswap64(p1);
+		p2 = __builtin_bswap64(p2);
+#endif
+		return p1 > p2 ? 1 : -1;
+	}
+
+	return memcmp(d1->digest + sizeof(p1), d2->digest + sizeof(p2),
+			CF_DIGEST_KEY_SZ - sizeof(p1));
+}
+
 static inline void
 as_index_sprig_from_i(as_index_tree *tree, as_index_sprig *isprig,
 		uint32_t sprig_i)
@@ -121,17 +213,29 @@ as_index_sprig_from_i(as_index_tree *tree, as_index_sprig *isprig,
 	isprig->arena = tree->arena;
 	isprig->pair = tree_locks(tree) + lock_i;
 	isprig->sprig = tree_sprigs(tree) + sprig_i;
+	isprig->set_list = tree->set_list;
+}
+
+// Get the 12 most significant non-pid bits in the digest, in digest order.
+// The partition-ID is the low AS_PARTITION_BITS of the first (little-endian)
+// 32 bits, so the non-pid bits start with the top of digest[1]. For 12 bits
+// this is the top nibble of digest[1] then all of digest[2].
+static inline uint32_t
+as_index_sprig_bits(const cf_digest *keyd)
+{
+	uint32_t n_hi_bits = 16 - AS_PARTITION_BITS; // non-pid bits in digest[1]
+	uint32_t lo_bits = ((uint32_t)keyd->digest[2] << 8) |
+			(uint32_t)keyd->digest[3];
+
+	return (((uint32_t)keyd->digest[1] >> (8 - n_hi_bits)) <<
+			(12 - n_hi_bits)) | (lo_bits >> (4 + n_hi_bits));
 }
 
 static inline void
 as_index_sprig_from_keyd(as_index_tree *tree, as_index_sprig *isprig,
 		const cf_digest *keyd)
 {
-	// Get the 12 most significant non-pid bits in the digest. Note - this is
-	// hardwired around the way we currently extract the (12 bit) partition-ID
-	// from the digest.
-	uint32_t bits = (((uint32_t)keyd->digest[1] & 0xF0) << 4) |
-			(uint32_t)keyd->digest[2];
+	uint32_t bits = as_index_sprig_bits(keyd);
 
 	uint32_t lock_i = bits >> tree->shared->locks_shift;
 	uint32_t sprig_i = bits >> tree->shared->sprigs_shift;
@@ -141,6 +245,7 @@ as_index_sprig_from_keyd(as_index_tree *tree, as_index_sprig *isprig,
 	isprig->arena = tree->arena;
 	isprig->pair = tree_locks(tree) + lock_i;
 	isprig->sprig = tree_sprigs(tree) + sprig_i;
+	isprig->set_list = tree->set_list;
 }
 
 
@@ -151,7 +256,7 @@ as_index_sprig_from_keyd(as_index_tree *tree, as_index_sprig *isprig,
 void
 as_index_tree_gc_init()
 {
-	cf_queue_init(&g_gc_queue, sizeof(as_index_tree*), 4096, true);
+	cf_queue_init(&g_gc_queue, sizeof(tree_gc_ele), 4096, true);
 
 	pthread_t thread;
 	pthread_attr_t attrs;
@@ -159,8 +264,10 @@ as_index_tree_gc_init()
 	pthread_attr_init(&attrs);
 	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
 
-	if (pthread_create(&thread, &attrs, run_index_tree_gc, NULL) != 0) {
-		cf_crash(AS_INDEX, "failed to create garbage collection thread");
+	for (uint32_t i = 0; i < TREE_GC_N_THREADS; i++) {
+		if (pthread_create(&thread, &attrs, run_index_tree_gc, NULL) != 0) {
+			cf_crash(AS_INDEX, "failed to create garbage collection thread");
+		}
 	}
 }
 
@@ -172,6 +279,13 @@ as_index_tree_gc_queue_size()
 }
 
 
+uint64_t
+as_index_tree_gc_backlog()
+{
+	return cf_atomic64_get(g_gc_backlog);
+}
+
+
 //==========================================================
 // Public API - create/destroy/size a tree.
 //
@@ -190,19 +304,47 @@ as_index_tree_create(as_index_tree_shared *shared, cf_arenax *arena)
 
 	tree->shared = shared;
 	tree->arena = arena;
+	tree->set_list = shared->set_lists ?
+			as_index_set_list_create(shared) : NULL;
 
 	as_lock_pair *pair = tree_locks(tree);
 	as_lock_pair *pair_end = pair + shared->n_lock_pairs;
 
+	// Gets vastly outnumber inserts and deletes - don't let them starve.
+	pthread_rwlockattr_t rwattr;
+
+	pthread_rwlockattr_init(&rwattr);
+	pthread_rwlockattr_setkind_np(&rwattr,
+			PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+
 	while (pair < pair_end) {
-		pthread_mutex_init(&pair->lock, NULL);
+		pthread_rwlock_init(&pair->lock, &rwattr);
 		pthread_mutex_init(&pair->reduce_lock, NULL);
 		pair++;
 	}
 
+	pthread_rwlockattr_destroy(&rwattr);
+
 	// The tree starts empty.
 	memset(tree_sprigs(tree), 0, sprigs_size);
 
+	if (shared->hash_index) {
+		as_sprig *sprig = tree_sprigs(tree);
+		as_sprig *sprig_end = sprig + shared->n_sprigs;
+		size_t slots_size = sizeof(uint64_t) * HASH_MIN_SLOTS;
+
+		while (sprig < sprig_end) {
+			sprig->hash_slots = cf_malloc(slots_size);
+
+			cf_assert(sprig->hash_slots, AS_INDEX,
+					"failed to allocate sprig hash (%lu bytes)", slots_size);
+
+			memset(sprig->hash_slots, 0, slots_size);
+			sprig->hash_mask = HASH_MIN_SLOTS - 1;
+			sprig++;
+		}
+	}
+
 	return tree;
 }
 
@@ -222,7 +364,15 @@ as_index_tree_release(as_index_tree *tree)
 
 	// TODO - call as_index_tree_destroy() directly if tree is empty?
 
-	if (cf_queue_push(&g_gc_queue, &tree) != CF_QUEUE_OK) {
+	tree_gc_ele ele = {
+			.tree = tree,
+			.release_ms = cf_getms(),
+			.next_sprig = 0
+	};
+
+	cf_atomic64_add(&g_gc_backlog, (int64_t)as_index_tree_size(tree));
+
+	if (cf_queue_push(&g_gc_queue, &ele) != CF_QUEUE_OK) {
 		cf_crash(AS_INDEX, "failed push to garbage collection queue");
 	}
 
@@ -282,6 +432,28 @@ as_index_reduce_partial(as_index_tree *tree, uint64_t sample_count,
 }
 
 
+// Make a callback, from outside the tree lock, for every element with digest
+// below high and at or above low, in reduce order - i.e. descending. Either
+// bound may be NULL. A resumed reduce passes the last digest handled as high.
+void
+as_index_reduce_range(as_index_tree *tree, const cf_digest *high,
+		const cf_digest *low, as_index_reduce_fn cb, void *udata)
+{
+	uint32_t shift = tree->shared->sprigs_shift;
+	int first_i = high ?
+			(int)(as_index_sprig_bits(high) >> shift) :
+			(int)tree->shared->n_sprigs - 1;
+	int last_i = low ? (int)(as_index_sprig_bits(low) >> shift) : 0;
+
+	for (int i = first_i; i >= last_i; i--) {
+		as_index_sprig isprig;
+		as_index_sprig_from_i(tree, &isprig, (uint32_t)i);
+
+		as_index_sprig_reduce_range(&isprig, high, low, cb, udata);
+	}
+}
+
+
 //==========================================================
 // Public API - get/insert/delete an element in a tree.
 //
@@ -345,6 +517,33 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 //		 0 - found and deleted
 //		-1 - not found
 // TODO - nobody cares about the return value, make it void?
+// For arena compaction - move an element out of a fenced stage, unless the
+// tree isn't its only holder. Returns true if moved, and the caller retires the
+// old element.
+bool
+as_index_relocate(as_index_tree *tree, const cf_digest *keyd,
+		cf_arenax_handle r_h)
+{
+	as_index_sprig isprig;
+	as_index_sprig_from_keyd(tree, &isprig, keyd);
+
+	pthread_rwlock_wrlock(&isprig.pair->lock);
+
+	// Don't wait out a reduce - the element will be tried again.
+	if (pthread_mutex_trylock(&isprig.pair->reduce_lock) != 0) {
+		pthread_rwlock_unlock(&isprig.pair->lock);
+		return false;
+	}
+
+	bool moved = as_index_sprig_relocate(&isprig, keyd, r_h);
+
+	pthread_mutex_unlock(&isprig.pair->reduce_lock);
+	pthread_rwlock_unlock(&isprig.pair->lock);
+
+	return moved;
+}
+
+
 int
 as_index_delete(as_index_tree *tree, cf_digest *keyd)
 {
@@ -355,6 +554,102 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 }
 
 
+//==========================================================
+// Public API - set lists.
+//
+
+// Call once a record's set-ID is written into its index - no-op unless the
+// set is listed, or if the record is already listed.
+void
+as_index_set_list_add(as_index_tree *tree, const as_index_ref *r_ref)
+{
+	if (tree->set_list) {
+		as_index_set_list_insert(tree->set_list, r_ref->r, r_ref->r_h);
+	}
+}
+
+
+// Make a callback, from outside the list lock, for every element of a listed
+// set - in no particular order. Returns false, without making callbacks, if
+// the set isn't listed - the caller must then reduce the whole tree. Callbacks
+// may still see records no longer in the set (see as_index_set_list_remove()).
+bool
+as_index_reduce_set(as_index_tree *tree, uint16_t set_id,
+		as_index_reduce_fn cb, void *udata)
+{
+	as_index_set_list *list = tree->set_list;
+
+	if (! list || set_id == INVALID_SET_ID ||
+			! as_index_set_is_listed(tree->shared, set_id)) {
+		return false;
+	}
+
+	pthread_mutex_lock(&list->lock);
+
+	// Common to encounter empty lists.
+	if (list->n_used == 0) {
+		pthread_mutex_unlock(&list->lock);
+		return true;
+	}
+
+	// Sized for every listed set - counting this set's records first would
+	// mean a second pass over the slots.
+	size_t sz = sizeof(as_index_ph_array) +
+			(sizeof(as_index_ph) * list->n_used);
+	as_index_ph_array *v_a;
+	uint8_t buf[MAX_STACK_ARRAY_BYTES];
+
+	if (sz > MAX_STACK_ARRAY_BYTES) {
+		v_a = cf_malloc(sz);
+
+		if (! v_a) {
+			cf_warning(AS_INDEX, "set reduce failed to allocate ref array");
+			pthread_mutex_unlock(&list->lock);
+			return true;
+		}
+	}
+	else {
+		v_a = (as_index_ph_array*)buf;
+	}
+
+	v_a->alloc_sz = list->n_used;
+	v_a->pos = 0;
+
+	// Deletes unlist records before releasing them, so reserving here under
+	// the list lock is safe.
+	for (uint32_t i = 0; i <= list->mask; i++) {
+		uint64_t slot = list->slots[i];
+
+		if (slot == 0 || SET_SLOT_SET_ID(slot) != set_id) {
+			continue;
+		}
+
+		cf_arenax_handle r_h = SET_SLOT_H(slot);
+		as_index *r = (as_index*)cf_arenax_resolve(tree->arena, r_h);
+
+		as_index_reserve(r);
+
+		v_a->indexes[v_a->pos].r = r;
+		v_a->indexes[v_a->pos].r_h = r_h;
+		v_a->pos++;
+	}
+
+	pthread_mutex_unlock(&list->lock);
+
+	// Only the destructor and arena are used to release records.
+	as_index_sprig isprig;
+	as_index_sprig_from_i(tree, &isprig, 0);
+
+	as_index_sprig_reduce_collected(&isprig, v_a, cb, udata);
+
+	if (v_a != (as_index_ph_array*)buf) {
+		cf_free(v_a);
+	}
+
+	return true;
+}
+
+
 //==========================================================
 // Local helpers - garbage collection, generic.
 //
@@ -362,21 +657,45 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 void *
 run_index_tree_gc(void *unused)
 {
-	as_index_tree *tree;
+	tree_gc_ele ele;
 
-	while (cf_queue_pop(&g_gc_queue, &tree, CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
-		as_index_tree_destroy(tree);
+	while (cf_queue_pop(&g_gc_queue, &ele, CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
+		uint64_t now = cf_getms();
+
+		if (now < ele.release_ms + TREE_GC_GRACE_MS) {
+			usleep((uint32_t)(ele.release_ms + TREE_GC_GRACE_MS - now) * 1000);
+		}
+
+		if (! as_index_tree_destroy_slice(ele.tree, &ele.next_sprig)) {
+			// Back of the line - let other trees make progress too.
+			if (cf_queue_push(&g_gc_queue, &ele) != CF_QUEUE_OK) {
+				cf_crash(AS_INDEX, "failed push to garbage collection queue");
+			}
+
+			continue;
+		}
+
+		as_index_tree_destroy(ele.tree);
 	}
 
 	return NULL;
 }
 
 
-void
-as_index_tree_destroy(as_index_tree *tree)
+// Purge the next slice of sprigs - returns true when all sprigs are purged.
+bool
+as_index_tree_destroy_slice(as_index_tree *tree, uint32_t *next_sprig)
 {
-	as_sprig* sprig = tree_sprigs(tree);
-	as_sprig* sprig_end = sprig + tree->shared->n_sprigs;
+	uint32_t n_sprigs = tree->shared->n_sprigs;
+	uint32_t end = *next_sprig + TREE_GC_SLICE_SPRIGS;
+
+	if (end > n_sprigs) {
+		end = n_sprigs;
+	}
+
+	as_sprig* sprig = tree_sprigs(tree) + *next_sprig;
+	as_sprig* sprig_end = tree_sprigs(tree) + end;
+	uint64_t n_purged = 0;
 
 	while (sprig < sprig_end) {
 		as_index_sprig isprig;
@@ -386,15 +705,44 @@ as_index_tree_destroy(as_index_tree *tree)
 		isprig.arena = tree->arena;
 		isprig.sprig = sprig;
 
+		n_purged += sprig->n_elements;
+
 		as_index_sprig_traverse_purge(&isprig, isprig.sprig->root_h);
+
 		sprig++;
 	}
 
+	cf_atomic64_sub(&g_gc_backlog, (int64_t)n_purged);
+	*next_sprig = end;
+
+	return end == n_sprigs;
+}
+
+
+// Free everything left once all sprigs are purged.
+void
+as_index_tree_destroy(as_index_tree *tree)
+{
+	as_sprig* sprig = tree_sprigs(tree);
+	as_sprig* sprig_end = sprig + tree->shared->n_sprigs;
+
+	while (sprig < sprig_end) {
+		if (sprig->hash_slots) {
+			cf_free(sprig->hash_slots);
+		}
+
+		sprig++;
+	}
+
+	if (tree->set_list) {
+		as_index_set_list_destroy(tree->set_list);
+	}
+
 	as_lock_pair *pair = tree_locks(tree);
 	as_lock_pair *pair_end = pair + tree->shared->n_lock_pairs;
 
 	while (pair < pair_end) {
-		pthread_mutex_destroy(&pair->lock);
+		pthread_rwlock_destroy(&pair->lock);
 		pthread_mutex_destroy(&pair->reduce_lock);
 		pair++;
 	}
@@ -495,9 +843,85 @@ as_index_sprig_reduce_partial(as_index_sprig *isprig, uint64_t sample_count,
 
 	pthread_mutex_unlock(&isprig->pair->reduce_lock);
 
+	as_index_sprig_reduce_collected(isprig, v_a, cb, udata);
+
+	uint64_t n_reduced = v_a->pos;
+
+	if (v_a != (as_index_ph_array*)buf) {
+		cf_free(v_a);
+	}
+
+	// In reduce-all mode, return 0 so outside loop continues to pass
+	// sample_count = AS_REDUCE_ALL.
+	return reduce_all ? 0 : n_reduced;
+}
+
+
+void
+as_index_sprig_reduce_range(as_index_sprig *isprig, const cf_digest *high,
+		const cf_digest *low, as_index_reduce_fn cb, void *udata)
+{
+	pthread_mutex_lock(&isprig->pair->reduce_lock);
+
+	uint64_t n_elements = isprig->sprig->n_elements;
+
+	if (n_elements == 0) {
+		pthread_mutex_unlock(&isprig->pair->reduce_lock);
+		return;
+	}
+
+	size_t sz = sizeof(as_index_ph_array) + (sizeof(as_index_ph) * n_elements);
+	as_index_ph_array *v_a;
+	uint8_t buf[MAX_STACK_ARRAY_BYTES];
+
+	if (sz > MAX_STACK_ARRAY_BYTES) {
+		v_a = cf_malloc(sz);
+
+		if (! v_a) {
+			cf_warning(AS_INDEX, "index reduce failed to allocate ref array");
+			pthread_mutex_unlock(&isprig->pair->reduce_lock);
+			return;
+		}
+	}
+	else {
+		v_a = (as_index_ph_array*)buf;
+	}
+
+	v_a->alloc_sz = n_elements;
+	v_a->pos = 0;
+
+	as_index_sprig_traverse_range(isprig, isprig->sprig->root_h, high, low,
+			v_a);
+
+	pthread_mutex_unlock(&isprig->pair->reduce_lock);
+
+	as_index_sprig_reduce_collected(isprig, v_a, cb, udata);
+
+	if (v_a != (as_index_ph_array*)buf) {
+		cf_free(v_a);
+	}
+}
+
+
+// Make the callbacks for elements collected (and reserved) by a traverse.
+void
+as_index_sprig_reduce_collected(as_index_sprig *isprig, as_index_ph_array *v_a,
+		as_index_reduce_fn cb, void *udata)
+{
 	uint64_t i;
 
+	for (i = 0; i < REDUCE_PREFETCH_DISTANCE && i < v_a->pos; i++) {
+		_mm_prefetch(v_a->indexes[i].r, _MM_HINT_T0);
+	}
+
 	for (i = 0; i < v_a->pos; i++) {
+		// The traverse likely evicted early elements - get upcoming ones moving
+		// so callbacks don't each stall on a miss.
+		if (i + REDUCE_PREFETCH_DISTANCE < v_a->pos) {
+			_mm_prefetch(v_a->indexes[i + REDUCE_PREFETCH_DISTANCE].r,
+					_MM_HINT_T0);
+		}
+
 		as_index_ref r_ref;
 
 		r_ref.skip_lock = false;
@@ -514,14 +938,6 @@ as_index_sprig_reduce_partial(as_index_sprig *isprig, uint64_t sample_count,
 		// Callback MUST call as_record_done() to unlock and release record.
 		cb(&r_ref, udata);
 	}
-
-	if (v_a != (as_index_ph_array*)buf) {
-		cf_free(v_a);
-	}
-
-	// In reduce-all mode, return 0 so outside loop continues to pass
-	// sample_count = AS_REDUCE_ALL.
-	return reduce_all ? 0 : i;
 }
 
 
@@ -535,6 +951,10 @@ as_index_sprig_traverse(as_index_sprig *isprig, cf_arenax_handle r_h,
 
 	as_index *r = RESOLVE_H(r_h);
 
+	// The right subtree is next after the left one - by then its root should
+	// be in cache. (Sentinel resolves harmlessly.)
+	_mm_prefetch(RESOLVE_H(r->right_h), _MM_HINT_T0);
+
 	as_index_sprig_traverse(isprig, r->left_h, v_a);
 
 	if (v_a->pos >= v_a->alloc_sz) {
@@ -551,6 +971,39 @@ as_index_sprig_traverse(as_index_sprig *isprig, cf_arenax_handle r_h,
 }
 
 
+// Like as_index_sprig_traverse(), but skips subtrees outside [low, high).
+// Note - larger digests are to the left.
+void
+as_index_sprig_traverse_range(as_index_sprig *isprig, cf_arenax_handle r_h,
+		const cf_digest *high, const cf_digest *low, as_index_ph_array *v_a)
+{
+	if (r_h == SENTINEL_H) {
+		return;
+	}
+
+	as_index *r = RESOLVE_H(r_h);
+
+	bool below_high = ! high || as_index_digest_compare(&r->keyd, high) < 0;
+	bool at_or_above_low = ! low || as_index_digest_compare(&r->keyd, low) >= 0;
+
+	if (below_high) {
+		as_index_sprig_traverse_range(isprig, r->left_h, high, low, v_a);
+	}
+
+	if (below_high && at_or_above_low && v_a->pos < v_a->alloc_sz) {
+		as_index_reserve(r);
+
+		v_a->indexes[v_a->pos].r = r;
+		v_a->indexes[v_a->pos].r_h = r_h;
+		v_a->pos++;
+	}
+
+	if (at_or_above_low) {
+		as_index_sprig_traverse_range(isprig, r->right_h, high, low, v_a);
+	}
+}
+
+
 void
 as_index_sprig_traverse_purge(as_index_sprig *isprig, cf_arenax_handle r_h)
 {
@@ -574,11 +1027,11 @@ as_index_sprig_traverse_purge(as_index_sprig *isprig, cf_arenax_handle r_h)
 int
 as_index_sprig_exists(as_index_sprig *isprig, cf_digest *keyd)
 {
-	pthread_mutex_lock(&isprig->pair->lock);
+	pthread_rwlock_rdlock(&isprig->pair->lock);
 
 	int rv = as_index_sprig_search_lockless(isprig, keyd, NULL, NULL);
 
-	pthread_mutex_unlock(&isprig->pair->lock);
+	pthread_rwlock_unlock(&isprig->pair->lock);
 
 	return rv;
 }
@@ -588,19 +1041,19 @@ int
 as_index_sprig_get_vlock(as_index_sprig *isprig, cf_digest *keyd,
 		as_index_ref *index_ref)
 {
-	pthread_mutex_lock(&isprig->pair->lock);
+	pthread_rwlock_rdlock(&isprig->pair->lock);
 
 	int rv = as_index_sprig_search_lockless(isprig, keyd, &index_ref->r,
 			&index_ref->r_h);
 
 	if (rv != 0) {
-		pthread_mutex_unlock(&isprig->pair->lock);
+		pthread_rwlock_unlock(&isprig->pair->lock);
 		return rv;
 	}
 
 	as_index_reserve(index_ref->r);
 
-	pthread_mutex_unlock(&isprig->pair->lock);
+	pthread_rwlock_unlock(&isprig->pair->lock);
 
 	if (! index_ref->skip_lock) {
 		olock_vlock(g_record_locks, keyd, &index_ref->olock);
@@ -629,10 +1082,37 @@ as_index_sprig_get_insert_vlock(as_index_sprig *isprig, cf_digest *keyd,
 	as_index_ele eles[64]; // FIXME - increase this appropriately
 	as_index_ele *ele;
 
+	// Most calls find an existing element - try that under the read lock
+	// first, so updates in a sprig don't serialize behind one another.
+	pthread_rwlock_rdlock(&isprig->pair->lock);
+
+	if (as_index_sprig_search_lockless(isprig, keyd, &index_ref->r,
+			&index_ref->r_h) == 0) {
+		as_index_reserve(index_ref->r);
+
+		pthread_rwlock_unlock(&isprig->pair->lock);
+
+		if (! index_ref->skip_lock) {
+			olock_vlock(g_record_locks, keyd, &index_ref->olock);
+		}
+
+		// Fail if the record is "half created" or deleted.
+		if (as_index_sprig_invalid_record_done(isprig, index_ref)) {
+			return -2;
+		}
+
+		return 0;
+	}
+
+	pthread_rwlock_unlock(&isprig->pair->lock);
+
+	// Not found - search again under the write lock, since another thread may
+	// have inserted it meanwhile.
+
 	do {
 		ele = eles;
 
-		pthread_mutex_lock(&isprig->pair->lock);
+		pthread_rwlock_wrlock(&isprig->pair->lock);
 
 		// Search for the specified element, or a parent to insert it under.
 
@@ -654,12 +1134,12 @@ as_index_sprig_get_insert_vlock(as_index_sprig *isprig, cf_digest *keyd,
 
 			_mm_prefetch(t, _MM_HINT_NTA);
 
-			if ((cmp = cf_digest_compare(keyd, &t->keyd)) == 0) {
+			if ((cmp = as_index_digest_compare(keyd, &t->keyd)) == 0) {
 				// The element already exists, simply return it.
 
 				as_index_reserve(t);
 
-				pthread_mutex_unlock(&isprig->pair->lock);
+				pthread_rwlock_unlock(&isprig->pair->lock);
 
 				if (! index_ref->skip_lock) {
 					olock_vlock(g_record_locks, keyd, &index_ref->olock);
@@ -687,7 +1167,7 @@ as_index_sprig_get_insert_vlock(as_index_sprig *isprig, cf_digest *keyd,
 		if (EBUSY == pthread_mutex_trylock(&isprig->pair->reduce_lock)) {
 			// The tree is being reduced - could take long, unlock so reads and
 			// overwrites aren't blocked.
-			pthread_mutex_unlock(&isprig->pair->lock);
+			pthread_rwlock_unlock(&isprig->pair->lock);
 
 			// Wait until the tree reduce is done...
 			pthread_mutex_lock(&isprig->pair->reduce_lock);
@@ -709,7 +1189,7 @@ as_index_sprig_get_insert_vlock(as_index_sprig *isprig, cf_digest *keyd,
 	if (n_h == 0) {
 		cf_warning(AS_INDEX, "arenax alloc failed");
 		pthread_mutex_unlock(&isprig->pair->reduce_lock);
-		pthread_mutex_unlock(&isprig->pair->lock);
+		pthread_rwlock_unlock(&isprig->pair->lock);
 		return -1;
 	}
 
@@ -748,8 +1228,10 @@ as_index_sprig_get_insert_vlock(as_index_sprig *isprig, cf_digest *keyd,
 
 	isprig->sprig->n_elements++;
 
+	as_index_sprig_hash_insert(isprig, keyd, n_h);
+
 	pthread_mutex_unlock(&isprig->pair->reduce_lock);
-	pthread_mutex_unlock(&isprig->pair->lock);
+	pthread_rwlock_unlock(&isprig->pair->lock);
 
 	if (! index_ref->skip_lock) {
 		olock_vlock(g_record_locks, keyd, &index_ref->olock);
@@ -779,7 +1261,7 @@ as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd)
 	do {
 		ele = eles;
 
-		pthread_mutex_lock(&isprig->pair->lock);
+		pthread_rwlock_wrlock(&isprig->pair->lock);
 
 		root_parent.left_h = isprig->sprig->root_h;
 		root_parent.color = AS_BLACK;
@@ -799,7 +1281,7 @@ as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd)
 
 			_mm_prefetch(r, _MM_HINT_NTA);
 
-			int cmp = cf_digest_compare(keyd, &r->keyd);
+			int cmp = as_index_digest_compare(keyd, &r->keyd);
 
 			if (cmp == 0) {
 				break; // found, we'll be deleting it
@@ -810,7 +1292,7 @@ as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd)
 		}
 
 		if (r_h == SENTINEL_H) {
-			pthread_mutex_unlock(&isprig->pair->lock);
+			pthread_rwlock_unlock(&isprig->pair->lock);
 			return -1; // not found, nothing to delete
 		}
 
@@ -821,7 +1303,7 @@ as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd)
 		if (EBUSY == pthread_mutex_trylock(&isprig->pair->reduce_lock)) {
 			// The tree is being reduced - could take long, unlock so reads and
 			// overwrites aren't blocked.
-			pthread_mutex_unlock(&isprig->pair->lock);
+			pthread_rwlock_unlock(&isprig->pair->lock);
 
 			// Wait until the tree reduce is done...
 			pthread_mutex_lock(&isprig->pair->reduce_lock);
@@ -909,6 +1391,12 @@ as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd)
 		isprig->sprig->root_h = root_parent.left_h;
 	}
 
+	as_index_sprig_hash_remove(isprig, keyd, r_h);
+
+	if (isprig->set_list) {
+		as_index_set_list_remove(isprig->set_list, r_h);
+	}
+
 	// Flag record as deleted.
 	as_index_invalidate_record(r);
 
@@ -918,12 +1406,93 @@ as_index_sprig_delete(as_index_sprig *isprig, cf_digest *keyd)
 	isprig->sprig->n_elements--;
 
 	pthread_mutex_unlock(&isprig->pair->reduce_lock);
-	pthread_mutex_unlock(&isprig->pair->lock);
+	pthread_rwlock_unlock(&isprig->pair->lock);
 
 	return 0;
 }
 
 
+// Caller holds the sprig's lock and reduce lock.
+bool
+as_index_sprig_relocate(as_index_sprig *isprig, const cf_digest *keyd,
+		cf_arenax_handle r_h)
+{
+	cf_arenax_handle parent_h = SENTINEL_H;
+	cf_arenax_handle h = isprig->sprig->root_h;
+	bool is_left = false;
+
+	while (h != r_h) {
+		if (h == SENTINEL_H) {
+			return false; // not in this tree - e.g. dropped, awaiting gc
+		}
+
+		as_index *n = RESOLVE_H(h);
+		int cmp = as_index_digest_compare(keyd, &n->keyd);
+
+		if (cmp == 0) {
+			return false; // the record was deleted and re-created
+		}
+
+		parent_h = h;
+		is_left = cmp > 0;
+		h = is_left ? n->left_h : n->right_h;
+	}
+
+	as_index *r = RESOLVE_H(r_h);
+	as_index_set_list *list = isprig->set_list;
+
+	// Set reduces reserve under the list lock.
+	if (list) {
+		pthread_mutex_lock(&list->lock);
+	}
+
+	// Anyone else using the element reserved it under one of our locks - with
+	// only the tree's reference, nobody else can be looking at it.
+	if (cf_atomic32_get(r->rc) != 1) {
+		if (list) {
+			pthread_mutex_unlock(&list->lock);
+		}
+
+		return false;
+	}
+
+	cf_arenax_handle n_h = cf_arenax_alloc(isprig->arena);
+
+	if (n_h == 0 || cf_arenax_is_fenced(isprig->arena, n_h)) {
+		if (n_h != 0) {
+			cf_arenax_free(isprig->arena, n_h);
+		}
+
+		if (list) {
+			pthread_mutex_unlock(&list->lock);
+		}
+
+		return false;
+	}
+
+	memcpy(RESOLVE_H(n_h), r, sizeof(as_index));
+
+	if (parent_h == SENTINEL_H) {
+		isprig->sprig->root_h = n_h;
+	}
+	else if (is_left) {
+		RESOLVE_H(parent_h)->left_h = n_h;
+	}
+	else {
+		RESOLVE_H(parent_h)->right_h = n_h;
+	}
+
+	as_index_sprig_hash_move(isprig, keyd, r_h, n_h);
+
+	if (list) {
+		as_index_set_list_move(list, r_h, n_h);
+		pthread_mutex_unlock(&list->lock);
+	}
+
+	return true;
+}
+
+
 //==========================================================
 // Local helpers - search/rebalance a sprig.
 //
@@ -932,13 +1501,17 @@ int
 as_index_sprig_search_lockless(as_index_sprig *isprig, cf_digest *keyd,
 		as_index **ret, cf_arenax_handle *ret_h)
 {
+	if (isprig->sprig->hash_slots) {
+		return as_index_sprig_hash_search(isprig, keyd, ret, ret_h);
+	}
+
 	cf_arenax_handle r_h = isprig->sprig->root_h;
 	as_index *r = RESOLVE_H(r_h);
 
 	while (r_h != SENTINEL_H) {
 		_mm_prefetch(r, _MM_HINT_NTA);
 
-		int cmp = cf_digest_compare(keyd, &r->keyd);
+		int cmp = as_index_digest_compare(keyd, &r->keyd);
 
 		if (cmp == 0) {
 			if (ret_h) {
@@ -1267,3 +1840,412 @@ as_index_rotate_right(as_index_ele *a, as_index_ele *b)
 	b->me->right_h = a->me_h;
 	a->parent = b;
 }
+
+
+//==========================================================
+// Local helpers - sprig digest hash.
+//
+
+// The sprig hash shadows the sprig's tree - tree order is still needed by
+// reduce and index snapshots, but point lookups can skip the tree walk. It's
+// linear-probed, never more than 3/4 full, and protected by the same lock as
+// the tree.
+
+static inline uint32_t
+hash_from_keyd(const cf_digest *keyd)
+{
+	// Bytes 0 - 2 pick the partition and sprig, so use bits beyond those.
+	uint32_t hash;
+
+	memcpy(&hash, &keyd->digest[8], sizeof(hash));
+
+	return hash;
+}
+
+
+int
+as_index_sprig_hash_search(as_index_sprig *isprig, cf_digest *keyd,
+		as_index **ret, cf_arenax_handle *ret_h)
+{
+	const as_sprig *sprig = isprig->sprig;
+	uint32_t hash = hash_from_keyd(keyd);
+	uint32_t mask = sprig->hash_mask;
+	uint32_t i = hash & mask;
+
+	while (true) {
+		uint64_t slot = sprig->hash_slots[i];
+
+		if (slot == 0) {
+			return -1; // not found
+		}
+
+		// Only touch the element when the hash matches.
+		if (HASH_SLOT_HASH(slot) == hash) {
+			cf_arenax_handle r_h = HASH_SLOT_H(slot);
+			as_index *r = RESOLVE_H(r_h);
+
+			if (memcmp(keyd, &r->keyd, sizeof(cf_digest)) == 0) {
+				if (ret_h) {
+					*ret_h = r_h;
+				}
+
+				if (ret) {
+					*ret = r;
+				}
+
+				return 0; // found
+			}
+		}
+
+		i = (i + 1) & mask;
+	}
+}
+
+
+// Also used when resuming a tree - no-op if the sprig has no hash.
+void
+as_index_sprig_hash_insert(as_index_sprig *isprig, const cf_digest *keyd,
+		cf_arenax_handle r_h)
+{
+	as_sprig *sprig = isprig->sprig;
+
+	if (! sprig->hash_slots) {
+		return;
+	}
+
+	if ((uint64_t)(sprig->hash_n_used + 1) * 4 >
+			((uint64_t)sprig->hash_mask + 1) * 3) {
+		as_index_sprig_hash_grow(sprig);
+	}
+
+	uint32_t hash = hash_from_keyd(keyd);
+	uint32_t i = hash & sprig->hash_mask;
+
+	while (sprig->hash_slots[i] != 0) {
+		i = (i + 1) & sprig->hash_mask;
+	}
+
+	sprig->hash_slots[i] = HASH_SLOT(hash, r_h);
+	sprig->hash_n_used++;
+}
+
+
+void
+as_index_sprig_hash_remove(as_index_sprig *isprig, const cf_digest *keyd,
+		cf_arenax_handle r_h)
+{
+	as_sprig *sprig = isprig->sprig;
+
+	if (! sprig->hash_slots) {
+		return;
+	}
+
+	uint32_t mask = sprig->hash_mask;
+	uint32_t i = hash_from_keyd(keyd) & mask;
+
+	while (HASH_SLOT_H(sprig->hash_slots[i]) != r_h) {
+		cf_assert(sprig->hash_slots[i] != 0, AS_INDEX,
+				"element missing from sprig hash");
+		i = (i + 1) & mask;
+	}
+
+	// Shift back later slots of the probe run that may occupy the hole, so
+	// searches never stop short at it.
+	uint32_t j = i;
+
+	while (true) {
+		j = (j + 1) & mask;
+
+		uint64_t slot = sprig->hash_slots[j];
+
+		if (slot == 0) {
+			break;
+		}
+
+		uint32_t home = HASH_SLOT_HASH(slot) & mask;
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			sprig->hash_slots[i] = slot;
+			i = j;
+		}
+	}
+
+	sprig->hash_slots[i] = 0;
+	sprig->hash_n_used--;
+}
+
+
+// For an element moved by arena compaction - no-op if the sprig has no hash.
+void
+as_index_sprig_hash_move(as_index_sprig *isprig, const cf_digest *keyd,
+		cf_arenax_handle old_h, cf_arenax_handle new_h)
+{
+	as_sprig *sprig = isprig->sprig;
+
+	if (! sprig->hash_slots) {
+		return;
+	}
+
+	uint32_t hash = hash_from_keyd(keyd);
+	uint32_t i = hash & sprig->hash_mask;
+
+	while (HASH_SLOT_H(sprig->hash_slots[i]) != old_h) {
+		cf_assert(sprig->hash_slots[i] != 0, AS_INDEX,
+				"element missing from sprig hash");
+		i = (i + 1) & sprig->hash_mask;
+	}
+
+	sprig->hash_slots[i] = HASH_SLOT(hash, new_h);
+}
+
+
+void
+as_index_sprig_hash_grow(as_sprig *sprig)
+{
+	uint32_t old_n_slots = sprig->hash_mask + 1;
+	uint64_t *old_slots = sprig->hash_slots;
+
+	uint32_t n_slots = old_n_slots * 2;
+	size_t slots_size = sizeof(uint64_t) * n_slots;
+	uint64_t *slots = cf_malloc(slots_size);
+
+	cf_assert(slots, AS_INDEX, "failed to allocate sprig hash (%lu bytes)",
+			slots_size);
+
+	memset(slots, 0, slots_size);
+
+	uint32_t mask = n_slots - 1;
+
+	// Slots carry their hash, so rehashing doesn't touch elements.
+	for (uint32_t i = 0; i < old_n_slots; i++) {
+		uint64_t slot = old_slots[i];
+
+		if (slot == 0) {
+			continue;
+		}
+
+		uint32_t j = HASH_SLOT_HASH(slot) & mask;
+
+		while (slots[j] != 0) {
+			j = (j + 1) & mask;
+		}
+
+		slots[j] = slot;
+	}
+
+	sprig->hash_slots = slots;
+	sprig->hash_mask = mask;
+
+	cf_free(old_slots);
+}
+
+
+//==========================================================
+// Local helpers - set lists.
+//
+
+// A tree's set list holds the handles of all its records in listed sets, so
+// scanning or truncating a small set needn't walk the whole tree. It's an
+// open-addressing hash on the handle - linear-probed, never more than 3/4
+// full, and protected by its own lock. Lock order is sprig lock, then list
+// lock.
+
+static inline uint32_t
+hash_from_h(cf_arenax_handle r_h)
+{
+	// Handles are dense within a stage - spread them.
+	return (uint32_t)(((uint64_t)r_h * 0x9E3779B97F4A7C15UL) >> 32);
+}
+
+
+as_index_set_list *
+as_index_set_list_create(const as_index_tree_shared *shared)
+{
+	as_index_set_list *list = cf_malloc(sizeof(as_index_set_list));
+	size_t slots_size = sizeof(uint64_t) * HASH_MIN_SLOTS;
+
+	cf_assert(list, AS_INDEX, "failed to allocate set list");
+
+	list->slots = cf_malloc(slots_size);
+
+	cf_assert(list->slots, AS_INDEX, "failed to allocate set list (%lu bytes)",
+			slots_size);
+
+	memset(list->slots, 0, slots_size);
+
+	list->shared = shared;
+	pthread_mutex_init(&list->lock, NULL);
+	list->mask = HASH_MIN_SLOTS - 1;
+	list->n_used = 0;
+
+	return list;
+}
+
+
+void
+as_index_set_list_destroy(as_index_set_list *list)
+{
+	pthread_mutex_destroy(&list->lock);
+	cf_free(list->slots);
+	cf_free(list);
+}
+
+
+// Also used when resuming a tree.
+void
+as_index_set_list_insert(as_index_set_list *list, as_index *r,
+		cf_arenax_handle r_h)
+{
+	uint16_t set_id = as_index_get_set_id(r);
+
+	if (set_id == INVALID_SET_ID ||
+			! as_index_set_is_listed(list->shared, set_id)) {
+		return;
+	}
+
+	pthread_mutex_lock(&list->lock);
+
+	if ((uint64_t)(list->n_used + 1) * 4 > ((uint64_t)list->mask + 1) * 3) {
+		as_index_set_list_grow(list);
+	}
+
+	uint32_t i = hash_from_h(r_h) & list->mask;
+
+	while (list->slots[i] != 0) {
+		// A rescued record may come back in a different set.
+		if (SET_SLOT_H(list->slots[i]) == r_h) {
+			list->slots[i] = SET_SLOT(set_id, r_h);
+			pthread_mutex_unlock(&list->lock);
+			return;
+		}
+
+		i = (i + 1) & list->mask;
+	}
+
+	list->slots[i] = SET_SLOT(set_id, r_h);
+	list->n_used++;
+
+	pthread_mutex_unlock(&list->lock);
+}
+
+
+// No-op if the record isn't listed. Can't go by the record's set-ID - a
+// rescued record's set-ID is cleared but it stays listed, so reducers must
+// still check the set-ID.
+void
+as_index_set_list_remove(as_index_set_list *list, cf_arenax_handle r_h)
+{
+	pthread_mutex_lock(&list->lock);
+	as_index_set_list_remove_lockless(list, r_h);
+	pthread_mutex_unlock(&list->lock);
+}
+
+
+// Caller holds the list lock. Returns the removed slot, or 0 if the record
+// isn't listed.
+uint64_t
+as_index_set_list_remove_lockless(as_index_set_list *list,
+		cf_arenax_handle r_h)
+{
+	uint32_t mask = list->mask;
+	uint32_t i = hash_from_h(r_h) & mask;
+
+	while (SET_SLOT_H(list->slots[i]) != r_h) {
+		if (list->slots[i] == 0) {
+			return 0;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	uint64_t removed = list->slots[i];
+
+	// Shift back later slots of the probe run that may occupy the hole, as for
+	// the sprig hash.
+	uint32_t j = i;
+
+	while (true) {
+		j = (j + 1) & mask;
+
+		uint64_t slot = list->slots[j];
+
+		if (slot == 0) {
+			break;
+		}
+
+		uint32_t home = hash_from_h(SET_SLOT_H(slot)) & mask;
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			list->slots[i] = slot;
+			i = j;
+		}
+	}
+
+	list->slots[i] = 0;
+	list->n_used--;
+
+	return removed;
+}
+
+
+// Caller holds the list lock. For a record moved by arena compaction - no-op
+// if it isn't listed.
+void
+as_index_set_list_move(as_index_set_list *list, cf_arenax_handle old_h,
+		cf_arenax_handle new_h)
+{
+	uint64_t slot = as_index_set_list_remove_lockless(list, old_h);
+
+	if (slot == 0) {
+		return;
+	}
+
+	uint32_t i = hash_from_h(new_h) & list->mask;
+
+	while (list->slots[i] != 0) {
+		i = (i + 1) & list->mask;
+	}
+
+	list->slots[i] = SET_SLOT(SET_SLOT_SET_ID(slot), new_h);
+	list->n_used++;
+}
+
+
+void
+as_index_set_list_grow(as_index_set_list *list)
+{
+	uint32_t old_n_slots = list->mask + 1;
+	uint64_t *old_slots = list->slots;
+
+	uint32_t n_slots = old_n_slots * 2;
+	size_t slots_size = sizeof(uint64_t) * n_slots;
+	uint64_t *slots = cf_malloc(slots_size);
+
+	cf_assert(slots, AS_INDEX, "failed to allocate set list (%lu bytes)",
+			slots_size);
+
+	memset(slots, 0, slots_size);
+
+	uint32_t mask = n_slots - 1;
+
+	for (uint32_t i = 0; i < old_n_slots; i++) {
+		uint64_t slot = old_slots[i];
+
+		if (slot == 0) {
+			continue;
+		}
+
+		uint32_t j = hash_from_h(SET_SLOT_H(slot)) & mask;
+
+		while (slots[j] != 0) {
+			j = (j + 1) & mask;
+		}
+
+		slots[j] = slot;
+	}
+
+	list->slots = slots;
+	list->mask = mask;
+
+	cf_free(old_slots);
+}
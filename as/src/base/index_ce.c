@@ -26,12 +26,25 @@
 
 #include "base/index.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+#include "citrusleaf/cf_vector.h"
+
 #include "arenax.h"
 #include "fault.h"
 
 #include "base/datamodel.h"
 
 
+//==========================================================
+// Forward declarations.
+//
+
+static uint64_t sprig_resume(as_index_sprig *isprig, cf_arenax_handle r_h, cf_vector *invalid_keyds);
+
+
 //==========================================================
 // Public API.
 //
@@ -40,15 +53,56 @@ as_index_tree *
 as_index_tree_resume(as_index_tree_shared *shared, cf_arenax *arena,
 		as_treex *treex)
 {
-	cf_crash(AS_INDEX, "CE code called as_index_tree_resume()");
-	return NULL;
+	as_index_tree *tree = as_index_tree_create(shared, arena);
+
+	// Destructor is for live records - "half created" records left behind by
+	// the previous process were never counted, so must be freed quietly.
+	as_index_tree_shared quiet_shared = *shared;
+
+	quiet_shared.destructor = NULL;
+	quiet_shared.destructor_udata = NULL;
+
+	for (uint32_t i = 0; i < shared->n_sprigs; i++) {
+		as_index_sprig isprig;
+
+		isprig.arena = arena;
+		isprig.sprig = tree_sprigs(tree) + i;
+		isprig.set_list = tree->set_list;
+		isprig.sprig->root_h = treex[i].root_h;
+
+		cf_vector_define(invalid_keyds, sizeof(cf_digest), 0, 0);
+
+		isprig.sprig->n_elements = sprig_resume(&isprig,
+				isprig.sprig->root_h, &invalid_keyds);
+
+		uint32_t n_invalid = cf_vector_size(&invalid_keyds);
+
+		if (n_invalid != 0) {
+			tree->shared = &quiet_shared;
+
+			for (uint32_t j = 0; j < n_invalid; j++) {
+				as_index_delete(tree,
+						(cf_digest*)cf_vector_getp(&invalid_keyds, j));
+			}
+
+			tree->shared = shared;
+		}
+
+		cf_vector_destroy(&invalid_keyds);
+	}
+
+	return tree;
 }
 
 
 void
 as_index_tree_shutdown(as_index_tree *tree, as_treex *treex)
 {
-	// For enterprise version only.
+	as_sprig *sprig = tree_sprigs(tree);
+
+	for (uint32_t i = 0; i < tree->shared->n_sprigs; i++) {
+		treex[i].root_h = sprig[i].root_h;
+	}
 }
 
 
@@ -65,3 +119,53 @@ as_index_reduce_partial_live(as_index_tree *tree, uint64_t sample_count,
 {
 	as_index_reduce_partial(tree, sample_count, cb, udata);
 }
+
+
+void
+as_index_reduce_range_live(as_index_tree *tree, const cf_digest *high,
+		const cf_digest *low, as_index_reduce_fn cb, void *udata)
+{
+	as_index_reduce_range(tree, high, low, cb, udata);
+}
+
+
+bool
+as_index_reduce_set_live(as_index_tree *tree, uint16_t set_id,
+		as_index_reduce_fn cb, void *udata)
+{
+	return as_index_reduce_set(tree, set_id, cb, udata);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Reset reference counts left by the previous process, count elements, rebuild
+// any sprig hash and set list, and collect digests of records that were "half created" at
+// shutdown.
+static uint64_t
+sprig_resume(as_index_sprig *isprig, cf_arenax_handle r_h,
+		cf_vector *invalid_keyds)
+{
+	if (r_h == SENTINEL_H) {
+		return 0;
+	}
+
+	as_index *r = RESOLVE_H(r_h);
+
+	r->rc = 1; // the tree's own reference
+
+	// Invalid records go in too - they're deleted via the tree below.
+	as_index_sprig_hash_insert(isprig, &r->keyd, r_h);
+
+	if (! as_index_is_valid_record(r)) {
+		cf_vector_append(invalid_keyds, &r->keyd);
+	}
+	else if (isprig->set_list) {
+		as_index_set_list_insert(isprig->set_list, r, r_h);
+	}
+
+	return 1 + sprig_resume(isprig, r->left_h, invalid_keyds) +
+			sprig_resume(isprig, r->right_h, invalid_keyds);
+}
@@ -0,0 +1,191 @@
+/*
+ * index_compact.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+//==========================================================
+// Includes.
+//
+
+#include "base/index_compact.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "arenax.h"
+#include "fault.h"
+#include "hardware.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "fabric/partition.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Threads that took an element from a fenced stage just before the fence went
+// up get this long to put it in a tree, before the first scan.
+#define FENCE_GRACE_MS 1000
+
+// Records held by transactions or reduces, and elements in idle threads'
+// caches, are waited for this many times, this long apart.
+#define MAX_SCANS 10
+#define SCAN_INTERVAL_MS 1000
+
+
+//==========================================================
+// Globals.
+//
+
+// One compaction at a time per namespace.
+static bool g_running[AS_NAMESPACE_SZ];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* run_compact(void* udata);
+static bool relocate_cb(cf_arenax_handle h, void* udata);
+
+
+//==========================================================
+// Public API.
+//
+
+// Returns false if this namespace is already compacting.
+bool
+as_index_compact_start(as_namespace* ns)
+{
+	if (__atomic_exchange_n(&g_running[ns->id - 1], true, __ATOMIC_ACQ_REL)) {
+		return false;
+	}
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_compact, ns) != 0) {
+		cf_crash(AS_INDEX, "failed to create index compaction thread");
+	}
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void*
+run_compact(void* udata)
+{
+	as_namespace* ns = (as_namespace*)udata;
+	cf_arenax* arena = ns->arena;
+	uint64_t start_ms = cf_getms();
+
+	cf_thread_set_role("index-compact");
+
+	uint32_t stage_id = cf_arenax_compact_begin(arena);
+
+	if (stage_id == 0) {
+		cf_info(AS_INDEX, "{%s} index arena has no stages worth compacting",
+				ns->name);
+		__atomic_store_n(&g_running[ns->id - 1], false, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	cf_info(AS_INDEX, "{%s} compacting index arena from stage %u", ns->name,
+			stage_id);
+
+	usleep(FENCE_GRACE_MS * 1000);
+
+	uint64_t n_left = 0;
+	bool fenced = true;
+
+	for (uint32_t i = 0; i < MAX_SCANS; i++) {
+		if (i != 0) {
+			usleep(SCAN_INTERVAL_MS * 1000);
+		}
+
+		if (! (fenced = cf_arenax_compact_scan(arena, stage_id, relocate_cb,
+				ns, &n_left)) || n_left == 0) {
+			break;
+		}
+
+		cf_detail(AS_INDEX, "{%s} index compaction waiting on %lu elements",
+				ns->name, n_left);
+	}
+
+	uint32_t n_released = cf_arenax_compact_end(arena, stage_id,
+			fenced && n_left == 0);
+
+	if (n_released != 0) {
+		cf_info(AS_INDEX, "{%s} index compaction released %u stages (%lu bytes) in %lu ms",
+				ns->name, n_released, (uint64_t)n_released * arena->stage_size,
+				cf_getms() - start_ms);
+	}
+	else if (! fenced) {
+		cf_warning(AS_INDEX, "{%s} index compaction abandoned - arena ran out of free elements",
+				ns->name);
+	}
+	else {
+		cf_warning(AS_INDEX, "{%s} index compaction gave up - %lu elements still in use",
+				ns->name, n_left);
+	}
+
+	__atomic_store_n(&g_running[ns->id - 1], false, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+static bool
+relocate_cb(cf_arenax_handle h, void* udata)
+{
+	as_namespace* ns = (as_namespace*)udata;
+	as_index* r = (as_index*)cf_arenax_resolve(ns->arena, h);
+
+	// The element can't be reused while fenced, so its digest is safe to read
+	// even if the record is being deleted.
+	cf_digest keyd = r->keyd;
+
+	as_partition_reservation rsv;
+
+	as_partition_reserve(ns, as_partition_getid(&keyd), &rsv);
+
+	bool moved = as_index_relocate(rsv.tree, &keyd, h);
+
+	as_partition_release(&rsv);
+
+	return moved;
+}
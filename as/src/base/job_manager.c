@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "aerospike/as_string.h"
 #include "citrusleaf/alloc.h"
@@ -41,11 +42,13 @@
 #include "citrusleaf/cf_queue_priority.h"
 
 #include "fault.h"
+#include "hardware.h"
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/monitor.h"
 #include "fabric/partition.h"
+#include "storage/storage.h"
 
 
 //==============================================================================
@@ -54,6 +57,9 @@
 
 static cf_atomic32 g_job_trid = 0;
 
+// Unused budget expires - a throttled job can't save up more than this burst.
+#define THROTTLE_BURST_US (100 * 1000)
+
 
 
 //==============================================================================
@@ -248,6 +254,9 @@ run_pool_thread(void* udata)
 	as_priority_thread_pool* pool = (as_priority_thread_pool*)udata;
 	queue_task qtask;
 
+	cf_thread_set_role("job-pool");
+	as_storage_set_io_class(AS_STORAGE_IO_SCAN);
+
 	// Retrieve tasks from queue and execute.
 	while (cf_queue_priority_pop(pool->dispatch_queue, &qtask,
 			CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
@@ -287,6 +296,10 @@ compare_cb(void* buf, void* task)
 static inline const char* as_job_safe_set_name(as_job* _job);
 static inline float as_job_progress(as_job* _job);
 int as_job_partition_reserve(as_job* _job, int pid, as_partition_reservation* rsv);
+static inline uint32_t as_job_n_indexed_slices(as_job* _job);
+void as_job_indexed_slice(as_job* _job);
+static inline void as_job_requeue_or_park(as_job* _job);
+static inline bool as_job_unpark(as_job* _job);
 
 //----------------------------------------------------------
 // as_job public API.
@@ -308,6 +321,7 @@ as_job_init(as_job* _job, const as_job_vtable* vtable,
 	_job->priority	= safe_priority(priority);
 
 	pthread_mutex_init(&_job->requeue_lock, NULL);
+	pthread_mutex_init(&_job->throttle_lock, NULL);
 }
 
 void
@@ -315,6 +329,11 @@ as_job_slice(void* task)
 {
 	as_job* _job = (as_job*)task;
 
+	if (_job->rsv_type == RSV_DEVICE || _job->rsv_type == RSV_LISTED) {
+		as_job_indexed_slice(_job);
+		return;
+	}
+
 	int pid = _job->next_pid;
 	as_partition_reservation rsv;
 
@@ -335,7 +354,7 @@ as_job_slice(void* task)
 
 	if ((_job->next_pid = pid + 1) < AS_PARTITIONS) {
 		as_job_active_reserve(_job);
-		as_job_manager_requeue_job(_job->mgr, _job);
+		as_job_requeue_or_park(_job);
 	}
 
 	pthread_mutex_unlock(&_job->requeue_lock);
@@ -359,6 +378,7 @@ as_job_destroy(as_job* _job)
 	_job->vtable.destroy_fn(_job);
 
 	pthread_mutex_destroy(&_job->requeue_lock);
+	pthread_mutex_destroy(&_job->throttle_lock);
 	cf_free(_job);
 }
 
@@ -378,6 +398,7 @@ as_job_info(as_job* _job, as_mon_jobstat* stat)
 	stat->run_time			= active_ms;
 	stat->time_since_done	= since_finish_ms;
 	stat->recs_read			= cf_atomic64_get(_job->n_records_read);
+	stat->rps				= _job->rps;
 
 	strcpy(stat->ns, _job->ns->name);
 	strcpy(stat->set, as_job_safe_set_name(_job));
@@ -404,6 +425,69 @@ as_job_active_release(as_job* _job)
 	}
 }
 
+// A busy job's next slice is parked instead of queued, so the job gives up its
+// pool threads - e.g. while its client is slow to take responses. Derived
+// classes call this when the job may no longer be busy.
+void
+as_job_resume(as_job* _job)
+{
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	// Note - abandoning a job unparks it, so parked jobs aren't abandoned.
+	if (_job->parked && ! _job->vtable.busy_fn(_job)) {
+		_job->parked = false;
+		as_job_manager_requeue_job(_job->mgr, _job);
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+}
+
+void
+as_job_set_rps(as_job* _job, uint32_t rps)
+{
+	pthread_mutex_lock(&_job->throttle_lock);
+
+	_job->rps = rps;
+	_job->throttle_due_us = 0; // new rate starts with a fresh bucket
+
+	pthread_mutex_unlock(&_job->throttle_lock);
+}
+
+// Call once per record - paces the job as a whole, however many threads are
+// running its slices. Sleeps outside the lock so slices wait in parallel.
+void
+as_job_throttle(as_job* _job)
+{
+	if (_job->rps == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&_job->throttle_lock);
+
+	uint32_t rps = _job->rps;
+
+	if (rps == 0) {
+		pthread_mutex_unlock(&_job->throttle_lock);
+		return;
+	}
+
+	uint64_t now_us = cf_getus();
+
+	if (_job->throttle_due_us + THROTTLE_BURST_US < now_us) {
+		_job->throttle_due_us = now_us - THROTTLE_BURST_US;
+	}
+
+	uint64_t due_us = _job->throttle_due_us;
+
+	_job->throttle_due_us += 1000000 / rps;
+
+	pthread_mutex_unlock(&_job->throttle_lock);
+
+	if (due_us > now_us) {
+		usleep((useconds_t)(due_us - now_us));
+	}
+}
+
 //----------------------------------------------------------
 // as_job utilities.
 //
@@ -419,6 +503,13 @@ as_job_safe_set_name(as_job* _job)
 static inline float
 as_job_progress(as_job* _job)
 {
+	if (_job->rsv_type == RSV_DEVICE || _job->rsv_type == RSV_LISTED) {
+		uint32_t n_slices = as_job_n_indexed_slices(_job);
+
+		return n_slices == 0 ?
+				100.0f : ((float)(_job->next_pid * 100)) / (float)n_slices;
+	}
+
 	return ((float)(_job->next_pid * 100)) / (float)AS_PARTITIONS;
 }
 
@@ -441,6 +532,65 @@ as_job_partition_reserve(as_job* _job, int pid, as_partition_reservation* rsv)
 	return pid;
 }
 
+static inline uint32_t
+as_job_n_indexed_slices(as_job* _job)
+{
+	return _job->rsv_type == RSV_DEVICE ?
+			as_storage_n_devices(_job->ns) : _job->n_listed;
+}
+
+void
+as_job_indexed_slice(as_job* _job)
+{
+	int n_slices = (int)as_job_n_indexed_slices(_job);
+
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	int slice_ix = _job->next_pid;
+
+	if (_job->abandoned != 0 || slice_ix >= n_slices) {
+		pthread_mutex_unlock(&_job->requeue_lock);
+		as_job_active_release(_job);
+		return;
+	}
+
+	if ((_job->next_pid = slice_ix + 1) < n_slices) {
+		as_job_active_reserve(_job);
+		as_job_requeue_or_park(_job);
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+
+	_job->vtable.indexed_slice_fn(_job, (uint32_t)slice_ix);
+
+	as_job_active_release(_job);
+}
+
+// Call with requeue_lock held - parked slice keeps its active reservation.
+static inline void
+as_job_requeue_or_park(as_job* _job)
+{
+	if (_job->vtable.busy_fn && _job->vtable.busy_fn(_job)) {
+		_job->parked = true;
+	}
+	else {
+		as_job_manager_requeue_job(_job->mgr, _job);
+	}
+}
+
+// Call with requeue_lock held - returns true if a parked slice was taken.
+static inline bool
+as_job_unpark(as_job* _job)
+{
+	if (! _job->parked) {
+		return false;
+	}
+
+	_job->parked = false;
+
+	return true;
+}
+
 
 
 //==============================================================================
@@ -550,7 +700,8 @@ as_job_manager_abandon_job(as_job_manager* mgr, as_job* _job, int reason)
 {
 	pthread_mutex_lock(&_job->requeue_lock);
 	_job->abandoned = reason;
-	bool found = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job);
+	bool found = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job) ||
+			as_job_unpark(_job);
 	pthread_mutex_unlock(&_job->requeue_lock);
 
 	if (found) {
@@ -572,7 +723,8 @@ as_job_manager_abort_job(as_job_manager* mgr, uint64_t trid)
 
 	pthread_mutex_lock(&_job->requeue_lock);
 	_job->abandoned = AS_JOB_FAIL_USER_ABORT;
-	bool found = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job);
+	bool found = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job) ||
+			as_job_unpark(_job);
 	pthread_mutex_unlock(&_job->requeue_lock);
 
 	pthread_mutex_unlock(&mgr->lock);
@@ -608,7 +760,8 @@ as_job_manager_abort_all_jobs(as_job_manager* mgr)
 
 		pthread_mutex_lock(&_job->requeue_lock);
 		_job->abandoned = AS_JOB_FAIL_USER_ABORT;
-		found[i] = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job);
+		found[i] = as_priority_thread_pool_remove_task(&mgr->thread_pool,
+				_job) || as_job_unpark(_job);
 		pthread_mutex_unlock(&_job->requeue_lock);
 	}
 
@@ -646,6 +799,24 @@ as_job_manager_change_job_priority(as_job_manager* mgr, uint64_t trid,
 	return true;
 }
 
+bool
+as_job_manager_change_job_rps(as_job_manager* mgr, uint64_t trid, uint32_t rps)
+{
+	pthread_mutex_lock(&mgr->lock);
+
+	as_job* _job = as_job_manager_find_active(mgr, trid);
+
+	if (! _job) {
+		pthread_mutex_unlock(&mgr->lock);
+		return false;
+	}
+
+	as_job_set_rps(_job, rps);
+
+	pthread_mutex_unlock(&mgr->lock);
+	return true;
+}
+
 void
 as_job_manager_limit_active_jobs(as_job_manager* mgr, uint32_t max_active)
 {
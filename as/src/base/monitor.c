@@ -114,6 +114,7 @@ as_mon_register(const char *module)
 		cb->get_jobstat_all = as_query_get_jobstat_all;
 
 		cb->set_priority    = as_query_set_priority;
+		cb->set_rps         = NULL;
 		cb->kill            = as_query_kill;
 		cb->suspend         = NULL;
 		cb->set_pendingmax  = NULL;
@@ -127,6 +128,7 @@ as_mon_register(const char *module)
 		cb->get_jobstat_all = as_scan_get_jobstat_all;
 
 		cb->set_priority    = as_scan_change_job_priority;
+		cb->set_rps         = as_scan_change_job_rps;
 		cb->kill            = as_scan_abort;
 		cb->suspend         = NULL;
 		cb->set_pendingmax  = NULL;
@@ -140,6 +142,7 @@ as_mon_register(const char *module)
 		cb->get_jobstat_all = as_sbld_get_jobstat_all;
 
 		cb->set_priority    = NULL;
+		cb->set_rps         = as_sbld_change_job_rps;
 		cb->kill            = as_sbld_abort;
 		cb->suspend         = NULL;
 		cb->set_pendingmax  = NULL;
@@ -258,6 +261,53 @@ as_mon_set_priority(const char *module, uint64_t id, uint32_t priority, cf_dyn_b
 	return retval;
 }
 
+/*
+ * Calls the callback function to set the records/sec budget of a job.
+ * A value of zero leaves the job unthrottled.
+ *
+ * Returns
+ * 		AS_MON_OK - On success.
+ * 		AS_MON_ERR - on failure.
+ *
+ */
+int
+as_mon_set_rps(const char *module, uint64_t id, uint32_t rps, cf_dyn_buf *db)
+{
+	int retval = AS_MON_ERR;
+	as_mon * mon_object = as_mon_get_module(module);
+
+	if (!mon_object) {
+		cf_warning(AS_MON, "Failed to find module %s", module);
+		cf_dyn_buf_append_string(db, "ERROR:");
+		cf_dyn_buf_append_int(db, AS_PROTO_RESULT_FAIL_NOT_FOUND);
+		cf_dyn_buf_append_string(db, ":module \"");
+		cf_dyn_buf_append_string(db, module);
+		cf_dyn_buf_append_string(db, "\" not found");
+		return retval;
+	}
+
+	if (mon_object->cb.set_rps) {
+		retval = mon_object->cb.set_rps(id, rps);
+
+		if (retval == AS_MON_OK) {
+			cf_dyn_buf_append_string(db, "OK");
+		}
+		else {
+			cf_dyn_buf_append_string(db, "ERROR:");
+			cf_dyn_buf_append_int(db, AS_PROTO_RESULT_FAIL_NOT_FOUND);
+			cf_dyn_buf_append_string(db, ":job not active");
+		}
+	}
+	else {
+		cf_dyn_buf_append_string(db, "ERROR:");
+		cf_dyn_buf_append_int(db, AS_PROTO_RESULT_FAIL_PARAMETER);
+		cf_dyn_buf_append_string(db, ":set-rps not supported for module \"");
+		cf_dyn_buf_append_string(db, module);
+		cf_dyn_buf_append_string(db, "\"");
+	}
+	return retval;
+}
+
 /*
  * Calls the callback function to populate the stat of a particular job.
  *
@@ -288,6 +338,9 @@ as_mon_populate_jobstat(as_mon_jobstat * job_stat, cf_dyn_buf *db)
 	cf_dyn_buf_append_string(db, ":priority=");
 	cf_dyn_buf_append_uint32(db, job_stat->priority);
 
+	cf_dyn_buf_append_string(db, ":rps=");
+	cf_dyn_buf_append_uint32(db, job_stat->rps);
+
 	if (job_stat->status[0]) {
 		cf_dyn_buf_append_string(db, ":status=");
 		cf_dyn_buf_append_string(db, job_stat->status);
@@ -469,6 +522,9 @@ as_mon_info_cmd(const char *module, char *cmd, uint64_t trid, uint32_t value, cf
 	else if (!strcmp(cmd, "set-priority")) {
 		as_mon_set_priority(module, trid, value, db);
 	}
+	else if (!strcmp(cmd, "set-rps")) {
+		as_mon_set_rps(module, trid, value, db);
+	}
 	else {
 		cf_dyn_buf_append_string(db, "ERROR:");
 		cf_dyn_buf_append_int(db, AS_PROTO_RESULT_FAIL_PARAMETER);
@@ -33,6 +33,7 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_hash_math.h"
 
+#include "compression.h"
 #include "dynbuf.h"
 #include "fault.h"
 #include "hist.h"
@@ -43,6 +44,7 @@
 #include "base/datamodel.h"
 #include "base/index.h"
 #include "base/proto.h"
+#include "base/quota.h"
 #include "base/secondary_index.h"
 #include "base/truncate.h"
 #include "fabric/partition.h"
@@ -63,7 +65,7 @@
 // Forward declarations.
 //
 
-static void append_set_props(as_set *p_set, cf_dyn_buf *db);
+static void append_set_props(as_namespace *ns, as_set *p_set, cf_dyn_buf *db);
 
 
 //==========================================================
@@ -164,6 +166,8 @@ as_namespace_create(char *name)
 	ns->tree_shared.n_sprigs = 64;
 	ns->write_commit_level = AS_WRITE_COMMIT_LEVEL_PROTO;
 
+	as_hot_keys_init(&ns->hot_keys);
+
 	ns->storage_type = AS_STORAGE_ENGINE_MEMORY;
 	ns->storage_data_in_memory = true;
 	// Note - default true is consistent with AS_STORAGE_ENGINE_MEMORY, but
@@ -179,7 +183,9 @@ as_namespace_create(char *name)
 	ns->storage_max_write_cache = 1024 * 1024 * 64;
 	ns->storage_min_avail_pct = 5; // stop writes when < 5% disk is writable
 	ns->storage_post_write_queue = 256; // number of wblocks per device used as post-write cache
+	ns->storage_shadow_max_write_cache = 1024 * 1024 * 256; // lag allowed before shadowed device writes fail
 	ns->storage_tomb_raider_sleep = 1000; // sleep this many microseconds between each device read
+	ns->storage_write_shards = 1;
 	ns->storage_write_threads = 1;
 
 	ns->sindex_num_partitions = DEFAULT_PARTITIONS_PER_INDEX;
@@ -216,6 +222,10 @@ as_namespaces_init(bool cold_start_cmd, uint32_t instance)
 
 		as_truncate_init(ns);
 		as_sindex_init(ns);
+
+		if (ns->cdc_ring_size != 0) {
+			as_cdc_init(ns);
+		}
 	}
 
 	as_truncate_init_smd();
@@ -244,6 +254,35 @@ as_namespace_configure_sets(as_namespace *ns)
 			p_set->stop_writes_count = ns->sets_cfg_array[i].stop_writes_count;
 			p_set->disable_eviction = ns->sets_cfg_array[i].disable_eviction;
 			p_set->enable_xdr = ns->sets_cfg_array[i].enable_xdr;
+			as_quota_set_rate(&p_set->quota.ops,
+					ns->sets_cfg_array[i].quota.ops.rate);
+			as_quota_set_rate(&p_set->quota.bytes,
+					ns->sets_cfg_array[i].quota.bytes.rate);
+
+			// Not transferred to the vmap, which may outlive the config - the
+			// trees' shared bits are authoritative.
+			if (ns->sets_cfg_array[i].enable_index) {
+				uint16_t set_id = (uint16_t)(idx + 1);
+
+				ns->tree_shared.listed_sets[set_id >> 6] |= 1UL << (set_id & 63);
+				ns->tree_shared.set_lists = true;
+			}
+
+			// Dictionaries aren't persisted - they're reloaded on every start.
+			if (ns->sets_cfg_dict_files && ns->sets_cfg_dict_files[i]) {
+				if (ns->storage_compression == CF_COMPRESSION_NONE) {
+					cf_warning(AS_NAMESPACE, "{%s} set %s has compression dictionary but compression is none",
+							ns->name, p_set->name);
+					return false;
+				}
+
+				if (! (ns->compression_dicts[idx + 1] =
+						cf_compression_dict_load(ns->sets_cfg_dict_files[i],
+								ns->storage_compression,
+								ns->storage_compression_level))) {
+					return false;
+				}
+			}
 		}
 		else {
 			// Maybe exceeded max sets allowed, but try failing gracefully.
@@ -527,7 +566,7 @@ as_namespace_get_set_info(as_namespace *ns, const char *set_name,
 	if (set_name) {
 		if (cf_vmapx_get_by_name(ns->p_sets_vmap, set_name, (void**)&p_set) ==
 				CF_VMAPX_OK) {
-			append_set_props(p_set, db);
+			append_set_props(ns, p_set, db);
 		}
 
 		return;
@@ -542,7 +581,7 @@ as_namespace_get_set_info(as_namespace *ns, const char *set_name,
 			cf_dyn_buf_append_string(db, "set=");
 			cf_dyn_buf_append_string(db, p_set->name);
 			cf_dyn_buf_append_char(db, ':');
-			append_set_props(p_set, db);
+			append_set_props(ns, p_set, db);
 		}
 	}
 }
@@ -696,7 +735,7 @@ as_namespace_get_hist_info(as_namespace *ns, char *set_name, char *hist_name,
 //
 
 static void
-append_set_props(as_set *p_set, cf_dyn_buf *db)
+append_set_props(as_namespace *ns, as_set *p_set, cf_dyn_buf *db)
 {
 	// Statistics:
 
@@ -716,12 +755,24 @@ append_set_props(as_set *p_set, cf_dyn_buf *db)
 	cf_dyn_buf_append_uint64(db, p_set->truncate_lut);
 	cf_dyn_buf_append_char(db, ':');
 
+	cf_dyn_buf_append_string(db, "quota_rejected=");
+	cf_dyn_buf_append_uint64(db, as_quota_n_rejected(&p_set->quota));
+	cf_dyn_buf_append_char(db, ':');
+
 	// Configuration:
 
 	cf_dyn_buf_append_string(db, "stop-writes-count=");
 	cf_dyn_buf_append_uint64(db, cf_atomic64_get(p_set->stop_writes_count));
 	cf_dyn_buf_append_char(db, ':');
 
+	cf_dyn_buf_append_string(db, "set-quota-ops-per-sec=");
+	cf_dyn_buf_append_uint64(db, as_quota_get_rate(&p_set->quota.ops));
+	cf_dyn_buf_append_char(db, ':');
+
+	cf_dyn_buf_append_string(db, "set-quota-bytes-per-sec=");
+	cf_dyn_buf_append_uint64(db, as_quota_get_rate(&p_set->quota.bytes));
+	cf_dyn_buf_append_char(db, ':');
+
 	cf_dyn_buf_append_string(db, "set-enable-xdr=");
 
 	if (cf_atomic32_get(p_set->enable_xdr) == AS_SET_ENABLE_XDR_TRUE) {
@@ -741,5 +792,10 @@ append_set_props(as_set *p_set, cf_dyn_buf *db)
 
 	cf_dyn_buf_append_string(db, "disable-eviction=");
 	cf_dyn_buf_append_bool(db, IS_SET_EVICTION_DISABLED(p_set));
+	cf_dyn_buf_append_char(db, ':');
+
+	cf_dyn_buf_append_string(db, "enable-index=");
+	cf_dyn_buf_append_bool(db, as_index_set_is_listed(&ns->tree_shared,
+			as_namespace_get_set_id(ns, p_set->name)));
 	cf_dyn_buf_append_char(db, ';');
 }
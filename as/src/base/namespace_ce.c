@@ -20,8 +20,16 @@
  * along with this program.  If not, see http://www.gnu.org/licenses/
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #include "citrusleaf/alloc.h"
 
@@ -88,9 +96,283 @@ as_mem_check()
 	return capacity;
 }
 
+//------------------------------------------------
+// Index snapshot - lets a community edition
+// data-not-in-memory namespace skip the device
+// sweep after a clean shutdown.
+//
+// File layout:
+//	header
+//	arena struct
+//	sets vmap
+//	bins vmap (if not single-bin)
+//	tree roots
+//	arena stages (from SNAPSHOT_ALIGN boundary)
+//
+
+#define SNAPSHOT_MAGIC 0x534E415053484F54UL // "SNAPSHOT"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_ALIGN (64 * 1024UL)
+
+typedef struct snapshot_header_s {
+	uint64_t magic;
+	uint32_t version;
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	uint64_t device_random;
+	uint32_t n_sprigs;
+	uint32_t index_size;
+	bool single_bin;
+
+	uint64_t sets_offset;
+	uint64_t bins_offset;
+	uint64_t roots_offset;
+	uint64_t stages_offset;
+} snapshot_header;
+
+static inline uint32_t
+arena_stage_flags(const as_namespace* ns)
+{
+	return (ns->index_huge_pages ? CF_ARENAX_HUGE_PAGES : 0) |
+			(ns->index_numa_interleave ? CF_ARENAX_INTERLEAVE : 0);
+}
+
+static inline uint64_t
+snapshot_sets_size()
+{
+	return cf_vmapx_sizeof(sizeof(as_set), AS_SET_MAX_COUNT);
+}
+
+static inline uint64_t
+snapshot_bins_size()
+{
+	return cf_vmapx_sizeof(VMAP_BIN_NAME_MAX_SZ, MAX_BIN_NAMES);
+}
+
+static inline uint64_t
+snapshot_roots_size(const as_namespace* ns)
+{
+	return (uint64_t)AS_PARTITIONS * ns->tree_shared.n_sprigs *
+			sizeof(as_treex);
+}
+
+static bool
+snapshot_read(int fd, void* buf, size_t size, off_t offset)
+{
+	uint8_t* p = (uint8_t*)buf;
+
+	while (size != 0) {
+		ssize_t rv = pread(fd, p, size, offset);
+
+		if (rv <= 0) {
+			return false;
+		}
+
+		p += rv;
+		offset += rv;
+		size -= (size_t)rv;
+	}
+
+	return true;
+}
+
+static bool
+snapshot_write(int fd, const void* buf, size_t size, off_t offset)
+{
+	const uint8_t* p = (const uint8_t*)buf;
+
+	while (size != 0) {
+		ssize_t rv = pwrite(fd, p, size, offset);
+
+		if (rv <= 0) {
+			return false;
+		}
+
+		p += rv;
+		offset += rv;
+		size -= (size_t)rv;
+	}
+
+	return true;
+}
+
+static void
+snapshot_discard_resume(as_namespace* ns)
+{
+	if (ns->p_sets_vmap) {
+		cf_free(ns->p_sets_vmap);
+		ns->p_sets_vmap = NULL;
+	}
+
+	if (ns->p_bin_name_vmap) {
+		cf_free(ns->p_bin_name_vmap);
+		ns->p_bin_name_vmap = NULL;
+	}
+
+	if (ns->xmem_roots) {
+		cf_free(ns->xmem_roots);
+		ns->xmem_roots = NULL;
+	}
+
+	if (ns->arena) {
+		cf_free(ns->arena);
+		ns->arena = NULL;
+	}
+}
+
+// Note - vmaps' hashes are leaked if we fail after resuming them, but we only
+// fail after that if the file is corrupt, which won't happen in practice.
+static bool
+resume_namespace(as_namespace* ns)
+{
+	const char* path = ns->index_snapshot_file;
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1) {
+		if (errno != ENOENT) {
+			cf_warning(AS_NAMESPACE, "{%s} can't open index snapshot %s: %s",
+					ns->name, path, cf_strerror(errno));
+		}
+
+		return false;
+	}
+
+	// Never resume from the same snapshot twice - if we crash from here on, the
+	// next start will be cold.
+	if (unlink(path) != 0) {
+		cf_warning(AS_NAMESPACE, "{%s} can't remove index snapshot %s: %s",
+				ns->name, path, cf_strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	snapshot_header header;
+	struct stat st;
+
+	if (! snapshot_read(fd, &header, sizeof(header), 0) ||
+			fstat(fd, &st) != 0) {
+		cf_warning(AS_NAMESPACE, "{%s} can't read index snapshot %s",
+				ns->name, path);
+		close(fd);
+		return false;
+	}
+
+	if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+			strncmp(header.ns_name, ns->name, AS_ID_NAMESPACE_SZ) != 0 ||
+			header.n_sprigs != ns->tree_shared.n_sprigs ||
+			header.index_size != as_index_size_get(ns) ||
+			header.single_bin != ns->single_bin ||
+			header.stages_offset > (uint64_t)st.st_size) {
+		cf_warning(AS_NAMESPACE, "{%s} index snapshot %s doesn't match configuration",
+				ns->name, path);
+		close(fd);
+		return false;
+	}
+
+	ns->index_snapshot_random = header.device_random;
+
+	ns->arena = (cf_arenax*)cf_malloc(cf_arenax_sizeof());
+	ns->p_sets_vmap = (cf_vmapx*)cf_malloc(snapshot_sets_size());
+	ns->xmem_roots = (as_treex*)cf_malloc(snapshot_roots_size(ns));
+
+	if (! ns->arena || ! ns->p_sets_vmap || ! ns->xmem_roots) {
+		cf_crash(AS_NAMESPACE, "{%s} can't allocate index snapshot structures", ns->name);
+	}
+
+	if (! ns->single_bin &&
+			! (ns->p_bin_name_vmap = (cf_vmapx*)cf_malloc(snapshot_bins_size()))) {
+		cf_crash(AS_NAMESPACE, "{%s} can't allocate bins vmap", ns->name);
+	}
+
+	if (! snapshot_read(fd, ns->arena, cf_arenax_sizeof(), sizeof(header)) ||
+			! snapshot_read(fd, ns->p_sets_vmap, snapshot_sets_size(),
+					(off_t)header.sets_offset) ||
+			(! ns->single_bin &&
+					! snapshot_read(fd, ns->p_bin_name_vmap, snapshot_bins_size(),
+							(off_t)header.bins_offset)) ||
+			! snapshot_read(fd, ns->xmem_roots, snapshot_roots_size(ns),
+					(off_t)header.roots_offset)) {
+		cf_warning(AS_NAMESPACE, "{%s} can't read index snapshot %s",
+				ns->name, path);
+		snapshot_discard_resume(ns);
+		close(fd);
+		return false;
+	}
+
+	if (ns->arena->element_size != as_index_size_get(ns) ||
+			header.stages_offset + ((uint64_t)ns->arena->stage_count *
+					ns->arena->stage_size) != (uint64_t)st.st_size) {
+		cf_warning(AS_NAMESPACE, "{%s} index snapshot %s has bad arena",
+				ns->name, path);
+		snapshot_discard_resume(ns);
+		close(fd);
+		return false;
+	}
+
+	cf_vmapx_err vmap_result = cf_vmapx_resume(ns->p_sets_vmap, sizeof(as_set),
+			AS_SET_MAX_COUNT, 1024, AS_SET_NAME_MAX_SIZE);
+
+	if (vmap_result == CF_VMAPX_OK && ! ns->single_bin) {
+		vmap_result = cf_vmapx_resume(ns->p_bin_name_vmap, VMAP_BIN_NAME_MAX_SZ,
+				MAX_BIN_NAMES, 4096, VMAP_BIN_NAME_MAX_SZ);
+	}
+
+	if (vmap_result != CF_VMAPX_OK) {
+		cf_warning(AS_NAMESPACE, "{%s} index snapshot %s has bad vmap: %d",
+				ns->name, path, vmap_result);
+		snapshot_discard_resume(ns);
+		close(fd);
+		return false;
+	}
+
+	// Stages added from now on follow the current configuration.
+	ns->arena->flags &= ~(CF_ARENAX_HUGE_PAGES | CF_ARENAX_INTERLEAVE);
+	ns->arena->flags |= arena_stage_flags(ns);
+
+	cf_arenax_err arena_result = cf_arenax_resume_mapped(ns->arena, fd,
+			(off_t)header.stages_offset);
+
+	close(fd); // mapped stages don't need it
+
+	if (arena_result != CF_ARENAX_OK) {
+		cf_warning(AS_NAMESPACE, "{%s} can't resume arena: %s", ns->name,
+				cf_arenax_errstr(arena_result));
+		snapshot_discard_resume(ns);
+		return false;
+	}
+
+	// Transfer configuration file information about sets.
+	if (! as_namespace_configure_sets(ns)) {
+		cf_crash(AS_NAMESPACE, "{%s} can't configure sets", ns->name);
+	}
+
+	return true;
+}
+
 static void
-setup_namespace(as_namespace* ns, uint32_t stage_capacity)
+setup_namespace(as_namespace* ns, uint32_t stage_capacity, bool cold_start_cmd)
 {
+	if (ns->index_snapshot_file) {
+		if (! cold_start_cmd && resume_namespace(ns)) {
+			ns->cold_start = false;
+
+			cf_info(AS_NAMESPACE, "{%s} beginning WARM restart from index snapshot %s",
+					ns->name, ns->index_snapshot_file);
+
+			return;
+		}
+
+		// A snapshot left behind would not match the devices after this start.
+		if (unlink(ns->index_snapshot_file) != 0 && errno != ENOENT) {
+			cf_crash(AS_NAMESPACE, "{%s} can't remove index snapshot %s: %s",
+					ns->name, ns->index_snapshot_file, cf_strerror(errno));
+		}
+
+		// Tree roots are saved here on shutdown.
+		if (! (ns->xmem_roots = (as_treex*)cf_malloc(snapshot_roots_size(ns)))) {
+			cf_crash(AS_NAMESPACE, "{%s} can't allocate tree roots", ns->name);
+		}
+	}
+
 	ns->cold_start = true;
 
 	cf_info(AS_NAMESPACE, "{%s} beginning COLD start", ns->name);
@@ -144,7 +426,7 @@ setup_namespace(as_namespace* ns, uint32_t stage_capacity)
 		cf_crash(AS_NAMESPACE, "{%s} can't allocate index arena", ns->name);
 	}
 
-	cf_arenax_err arena_result = cf_arenax_create(ns->arena, 0, as_index_size_get(ns), stage_capacity, 0, CF_ARENAX_BIGLOCK);
+	cf_arenax_err arena_result = cf_arenax_create(ns->arena, 0, as_index_size_get(ns), stage_capacity, 0, CF_ARENAX_BIGLOCK | CF_ARENAX_THREAD_CACHE | arena_stage_flags(ns));
 
 	if (arena_result != CF_ARENAX_OK) {
 		cf_crash(AS_NAMESPACE, "{%s} can't create arena: %s", ns->name, cf_arenax_errstr(arena_result));
@@ -155,12 +437,82 @@ void
 as_namespaces_setup(bool cold_start_cmd, uint32_t instance, uint32_t stage_capacity)
 {
 	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
-		setup_namespace(g_config.namespaces[i], stage_capacity);
+		setup_namespace(g_config.namespaces[i], stage_capacity, cold_start_cmd);
 	}
 }
 
+// Write the index snapshot, if configured. Written to a temporary file which is
+// renamed into place - the stages may still be mapped from the previous one.
 void
 as_namespace_xmem_trusted(as_namespace *ns)
 {
-	// For enterprise version only.
+	if (! ns->index_snapshot_file) {
+		return;
+	}
+
+	snapshot_header header;
+
+	memset(&header, 0, sizeof(header));
+
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	strcpy(header.ns_name, ns->name);
+	header.device_random = ns->index_snapshot_random;
+	header.n_sprigs = ns->tree_shared.n_sprigs;
+	header.index_size = as_index_size_get(ns);
+	header.single_bin = ns->single_bin;
+
+	header.sets_offset = sizeof(header) + cf_arenax_sizeof();
+	header.bins_offset = header.sets_offset + snapshot_sets_size();
+	header.roots_offset = header.bins_offset +
+			(ns->single_bin ? 0 : snapshot_bins_size());
+
+	uint64_t end = header.roots_offset + snapshot_roots_size(ns);
+
+	header.stages_offset = (end + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1);
+
+	char tmp_path[strlen(ns->index_snapshot_file) + sizeof(".tmp")];
+
+	sprintf(tmp_path, "%s.tmp", ns->index_snapshot_file);
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+	if (fd == -1) {
+		cf_warning(AS_NAMESPACE, "{%s} can't create index snapshot %s: %s",
+				ns->name, tmp_path, cf_strerror(errno));
+		return;
+	}
+
+	cf_info(AS_NAMESPACE, "{%s} writing index snapshot %s ...", ns->name,
+			ns->index_snapshot_file);
+
+	if (! snapshot_write(fd, &header, sizeof(header), 0) ||
+			! snapshot_write(fd, ns->arena, cf_arenax_sizeof(), sizeof(header)) ||
+			! snapshot_write(fd, ns->p_sets_vmap, snapshot_sets_size(),
+					(off_t)header.sets_offset) ||
+			(! ns->single_bin &&
+					! snapshot_write(fd, ns->p_bin_name_vmap,
+							snapshot_bins_size(), (off_t)header.bins_offset)) ||
+			! snapshot_write(fd, ns->xmem_roots, snapshot_roots_size(ns),
+					(off_t)header.roots_offset) ||
+			! cf_arenax_write_stages(ns->arena, fd,
+					(off_t)header.stages_offset) ||
+			fsync(fd) != 0) {
+		cf_warning(AS_NAMESPACE, "{%s} failed writing index snapshot %s: %s",
+				ns->name, tmp_path, cf_strerror(errno));
+		close(fd);
+		unlink(tmp_path);
+		return;
+	}
+
+	close(fd);
+
+	if (rename(tmp_path, ns->index_snapshot_file) != 0) {
+		cf_warning(AS_NAMESPACE, "{%s} can't rename index snapshot %s: %s",
+				ns->name, tmp_path, cf_strerror(errno));
+		unlink(tmp_path);
+		return;
+	}
+
+	cf_info(AS_NAMESPACE, "{%s} wrote index snapshot", ns->name);
 }
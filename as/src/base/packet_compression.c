@@ -26,13 +26,60 @@
 
 #include "citrusleaf/alloc.h"
 
+#include "compression.h"
 #include "fault.h"
+#include "hist.h"
 
+#include "base/datamodel.h"
 #include "base/packet_compression.h"
 #include "base/proto.h"
+#include "base/transaction.h"
 
 #define STACK_BUF_SZ (1024 * 16)
 
+static cf_compression_method
+to_cf_method(compression_type type)
+{
+	switch (type) {
+		case COMPRESSION_ZLIB:
+			return CF_COMPRESSION_ZLIB;
+		case COMPRESSION_LZ4:
+			return CF_COMPRESSION_LZ4;
+		case COMPRESSION_ZSTD:
+			return CF_COMPRESSION_ZSTD;
+		default:
+			return CF_COMPRESSION_NONE;
+	}
+}
+
+static uint8_t
+to_proto_type(compression_type type)
+{
+	switch (type) {
+		case COMPRESSION_LZ4:
+			return PROTO_TYPE_AS_MSG_COMPRESSED_LZ4;
+		case COMPRESSION_ZSTD:
+			return PROTO_TYPE_AS_MSG_COMPRESSED_ZSTD;
+		default:
+			return PROTO_TYPE_AS_MSG_COMPRESSED;
+	}
+}
+
+compression_type
+as_packet_compression_type(uint8_t proto_type)
+{
+	switch (proto_type) {
+		case PROTO_TYPE_AS_MSG_COMPRESSED:
+			return COMPRESSION_ZLIB;
+		case PROTO_TYPE_AS_MSG_COMPRESSED_LZ4:
+			return COMPRESSION_LZ4;
+		case PROTO_TYPE_AS_MSG_COMPRESSED_ZSTD:
+			return COMPRESSION_ZSTD;
+		default:
+			return COMPRESSION_NONE;
+	}
+}
+
 /**
  * Function to decompress the given data
  * Expected arguments
@@ -57,6 +104,12 @@ as_decompress(compression_type type, size_t buf_len, const uint8_t *buf, size_t
 			*out_buf_len = converted_out_buf_len;
 			break;
 		}
+		case COMPRESSION_LZ4:
+		case COMPRESSION_ZSTD:
+			// Their decompressors need the exact original size.
+			ret_value = cf_decompress(to_cf_method(type), NULL, buf, buf_len,
+					out_buf, *out_buf_len) ? 0 : -1;
+			break;
 		default:
 			cf_warning(AS_COMPRESSION, "Unknown as_proto compression type: %d", type);
 			break;
@@ -79,9 +132,11 @@ as_packet_decompression(uint8_t *buf, uint8_t **output_packet, size_t *output_pa
 
 	cf_debug(AS_COMPRESSION, "In as_packet_decompression");
 
-	if (as_comp_protop->proto.type != PROTO_TYPE_AS_MSG_COMPRESSED)	{
-		cf_warning(AS_COMPRESSION, "as_packet_decompression : Invalid input data : type received %d != PROTO_TYPE_AS_MSG_COMPRESSED (%d)",
-				   as_comp_protop->proto.type, PROTO_TYPE_AS_MSG_COMPRESSED);
+	compression_type type = as_packet_compression_type(as_comp_protop->proto.type);
+
+	if (type == COMPRESSION_NONE)	{
+		cf_warning(AS_COMPRESSION, "as_packet_decompression : Invalid input data : type received %d is not a compressed type",
+				   as_comp_protop->proto.type);
 		cf_warning(AS_COMPRESSION, "Returned as_packet_decompression : %d", ret_value);
 		return ret_value;
 	}
@@ -99,7 +154,7 @@ as_packet_decompression(uint8_t *buf, uint8_t **output_packet, size_t *output_pa
 	size_t buf_sz = as_comp_protop->proto.sz - 8;
 	buf += sizeof(as_comp_proto);
 	uint8_t *decompressed_packet = cf_malloc(decompressed_as_packet_sz);
-	ret_value = as_decompress(COMPRESSION_ZLIB, buf_sz, buf, &decompressed_as_packet_sz, decompressed_packet);
+	ret_value = as_decompress(type, buf_sz, buf, &decompressed_as_packet_sz, decompressed_packet);
 	if (ret_value) {
 		cf_free(decompressed_packet);
 	} else {
@@ -232,3 +287,49 @@ as_packet_compression(uint8_t *buf, size_t buf_sz, uint8_t **compressed_packet,
 	cf_debug(AS_COMPRESSION, "Returned as_packet_compression : 0");
 	return 0;
 }
+
+uint8_t *
+as_packet_compress_response(const as_file_handle *fd_h, as_namespace *ns,
+		const uint8_t *packet, size_t packet_sz, size_t *compressed_packet_sz)
+{
+	compression_type type = (compression_type)fd_h->compression;
+
+	if (type == COMPRESSION_NONE || ! ns ||
+			ns->response_compression_threshold == 0 ||
+			packet_sz < ns->response_compression_threshold ||
+			packet_sz <= sizeof(as_comp_proto)) {
+		return NULL;
+	}
+
+	// Anything that doesn't fit in less than the original isn't worth sending.
+	size_t capacity = packet_sz - sizeof(as_comp_proto) - 1;
+	uint8_t *compressed_packet = cf_malloc(sizeof(as_comp_proto) + capacity);
+
+	if (! compressed_packet) {
+		return NULL;
+	}
+
+	size_t compressed_sz = cf_compress(to_cf_method(type), 0, NULL, packet,
+			packet_sz, compressed_packet + sizeof(as_comp_proto), capacity);
+
+	ns->response_compression_hist_active = true;
+	histogram_insert_raw(ns->response_compression_hist,
+			compressed_sz == 0 ? 100 : (compressed_sz * 100) / packet_sz);
+
+	if (compressed_sz == 0) {
+		cf_free(compressed_packet);
+		return NULL;
+	}
+
+	// Same layout the client sends - see as_packet_decompression().
+	as_comp_proto *as_comp_protop = (as_comp_proto *)compressed_packet;
+	as_comp_protop->proto.version = PROTO_VERSION;
+	as_comp_protop->proto.type = to_proto_type(type);
+	as_comp_protop->proto.sz = sizeof(uint64_t) + compressed_sz;
+	as_proto_swap(&as_comp_protop->proto);
+	as_comp_protop->org_sz = packet_sz;
+
+	*compressed_packet_sz = sizeof(as_comp_proto) + compressed_sz;
+
+	return compressed_packet;
+}
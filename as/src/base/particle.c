@@ -31,6 +31,7 @@
 #include "aerospike/as_buffer.h"
 #include "aerospike/as_msgpack.h"
 #include "aerospike/as_serializer.h"
+#include "aerospike/as_string.h"
 #include "aerospike/as_val.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_byte_order.h"
@@ -55,6 +56,7 @@ extern const as_particle_vtable blob_vtable;
 extern const as_particle_vtable map_vtable;
 extern const as_particle_vtable list_vtable;
 extern const as_particle_vtable geojson_vtable;
+extern const as_particle_vtable hll_vtable;
 
 // Array of particle vtable pointers.
 const as_particle_vtable *particle_vtable[] = {
@@ -70,11 +72,22 @@ const as_particle_vtable *particle_vtable[] = {
 		[AS_PARTICLE_TYPE_RUBY_BLOB]	= &blob_vtable,
 		[AS_PARTICLE_TYPE_PHP_BLOB]		= &blob_vtable,
 		[AS_PARTICLE_TYPE_ERLANG_BLOB]	= &blob_vtable,
+		[AS_PARTICLE_TYPE_HLL]			= &hll_vtable,
 		[AS_PARTICLE_TYPE_MAP]			= &map_vtable,
 		[AS_PARTICLE_TYPE_LIST]			= &list_vtable,
 		[AS_PARTICLE_TYPE_GEOJSON]		= &geojson_vtable
 };
 
+COMPILER_ASSERT(sizeof(as_short_string) == sizeof(as_particle *));
+
+// Same layout as the STRING particle, so STRING particle table functions can
+// read a short string through it.
+typedef struct short_string_view_s {
+	uint8_t		type;
+	uint32_t	sz;
+	uint8_t		data[AS_SHORT_STRING_MAX_SZ];
+} __attribute__ ((__packed__)) short_string_view;
+
 
 //==========================================================
 // Local utilities.
@@ -96,6 +109,7 @@ safe_particle_type(uint8_t type)
 	case AS_PARTICLE_TYPE_RUBY_BLOB:
 	case AS_PARTICLE_TYPE_PHP_BLOB:
 	case AS_PARTICLE_TYPE_ERLANG_BLOB:
+	case AS_PARTICLE_TYPE_HLL:
 	case AS_PARTICLE_TYPE_MAP:
 	case AS_PARTICLE_TYPE_LIST:
 	case AS_PARTICLE_TYPE_GEOJSON:
@@ -107,6 +121,44 @@ safe_particle_type(uint8_t type)
 	}
 }
 
+// Particle to pass to particle table functions - a short string is copied into
+// the caller's view.
+static inline as_particle *
+bin_particle(const as_bin *b, short_string_view *view)
+{
+	if (! as_bin_is_short_string(b)) {
+		return b->particle;
+	}
+
+	const as_short_string *ss = (const as_short_string *)&b->particle;
+
+	view->type = AS_PARTICLE_TYPE_STRING;
+	view->sz = ss->sz;
+	memcpy(view->data, ss->data, ss->sz);
+
+	return (as_particle *)view;
+}
+
+// Stores the value in the bin itself if it's a short enough string. Like the
+// allocating paths it replaces, doesn't destroy any existing particle.
+static inline bool
+embed_short_string(as_bin *b, as_particle_type type, const uint8_t *value,
+		uint32_t value_size)
+{
+	if (type != AS_PARTICLE_TYPE_STRING || value_size > AS_SHORT_STRING_MAX_SZ) {
+		return false;
+	}
+
+	as_short_string *ss = (as_short_string *)&b->particle;
+
+	memset(ss, 0, sizeof(as_short_string));
+	ss->sz = (uint8_t)value_size;
+	memcpy(ss->data, value, value_size);
+
+	as_bin_state_set(b, AS_BIN_STATE_INUSE_SHORT_STRING);
+
+	return true;
+}
 
 //==========================================================
 // Particle "class static" functions.
@@ -250,6 +302,10 @@ as_bin_particle_size(as_bin *b)
 		return 0;
 	}
 
+	if (as_bin_is_short_string(b)) {
+		return 0; // lives in the as_bin
+	}
+
 	return particle_vtable[as_bin_get_particle_type(b)]->size_fn(b->particle);
 }
 
@@ -288,6 +344,10 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 			op_value += sizeof(uint64_t);
 		}
 
+		if (embed_short_string(b, op_type, op_value, op_value_size)) {
+			return 0;
+		}
+
 		int32_t mem_size = particle_vtable[op_type]->size_from_wire_fn(op_value, op_value_size);
 
 		if (mem_size < 0) {
@@ -328,6 +388,9 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 	int32_t new_mem_size = 0;
 	as_particle *new_particle = NULL;
 
+	short_string_view view;
+	as_particle *existing = bin_particle(b, &view);
+
 	as_particle *old_particle = b->particle;
 	int result = 0;
 
@@ -348,14 +411,14 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 		}
 		// no break
 	case AS_MSG_OP_APPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return new_mem_size;
 		}
 		if (! (new_particle = cf_malloc_ns((size_t)new_mem_size))) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(new_particle, b->particle, particle_vtable[existing_type]->size_fn(b->particle));
+		memcpy(new_particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		b->particle = new_particle;
 		result = particle_vtable[existing_type]->append_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
@@ -365,14 +428,14 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 		}
 		// no break
 	case AS_MSG_OP_PREPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return new_mem_size;
 		}
 		if (! (new_particle = cf_malloc_ns((size_t)new_mem_size))) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(new_particle, b->particle, particle_vtable[existing_type]->size_fn(b->particle));
+		memcpy(new_particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		b->particle = new_particle;
 		result = particle_vtable[existing_type]->prepend_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
@@ -388,6 +451,10 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 
 		b->particle = old_particle;
 	}
+	else if (new_mem_size != 0) {
+		// Existing particle may have been embedded or packed.
+		as_bin_state_set(b, AS_BIN_STATE_INUSE_OTHER);
+	}
 
 	return result;
 }
@@ -450,6 +517,9 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 	uint8_t existing_type = as_bin_get_particle_type(b);
 	int32_t new_mem_size = 0;
 
+	short_string_view view;
+	as_particle *existing = bin_particle(b, &view);
+
 	as_particle *old_particle = b->particle;
 	int result = 0;
 
@@ -470,14 +540,14 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 		}
 		// no break
 	case AS_MSG_OP_APPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return (int)new_mem_size;
 		}
 		if (0 > cf_ll_buf_reserve(particles_llb, (size_t)new_mem_size, (uint8_t **)&b->particle)) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(b->particle, old_particle, particle_vtable[existing_type]->size_fn(old_particle));
+		memcpy(b->particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		result = particle_vtable[existing_type]->append_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
 	case AS_MSG_OP_MC_PREPEND:
@@ -486,14 +556,14 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 		}
 		// no break
 	case AS_MSG_OP_PREPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return (int)new_mem_size;
 		}
 		if (0 > cf_ll_buf_reserve(particles_llb, (size_t)new_mem_size, (uint8_t **)&b->particle)) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(b->particle, old_particle, particle_vtable[existing_type]->size_fn(old_particle));
+		memcpy(b->particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		result = particle_vtable[existing_type]->prepend_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
 	default:
@@ -504,6 +574,10 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 	if (result < 0) {
 		b->particle = old_particle;
 	}
+	else if (new_mem_size != 0) {
+		// Existing particle may have been embedded or packed.
+		as_bin_state_set(b, AS_BIN_STATE_INUSE_OTHER);
+	}
 
 	return result;
 }
@@ -524,6 +598,11 @@ as_bin_particle_alloc_from_client(as_bin *b, const as_msg_op *op)
 
 	uint32_t value_size = as_msg_op_get_value_sz(op);
 	uint8_t *value = as_msg_op_get_value_p((as_msg_op *)op);
+
+	if (embed_short_string(b, type, value, value_size)) {
+		return 0;
+	}
+
 	int32_t mem_size = particle_vtable[type]->size_from_wire_fn(value, value_size);
 
 	if (mem_size < 0) {
@@ -634,6 +713,10 @@ as_bin_particle_alloc_from_pickled(as_bin *b, const uint8_t **p_pickled, const u
 		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
+	if (embed_short_string(b, type, value, value_size)) {
+		return 0;
+	}
+
 	int32_t mem_size = particle_vtable[type]->size_from_wire_fn(value, value_size);
 
 	if (mem_size < 0) {
@@ -747,7 +830,9 @@ as_bin_particle_compare_from_pickled(const as_bin *b, uint8_t **p_pickled)
 		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
-	return particle_vtable[as_bin_get_particle_type(b)]->compare_from_wire_fn(b->particle, type, value, value_size);
+	short_string_view view;
+
+	return particle_vtable[as_bin_get_particle_type(b)]->compare_from_wire_fn(bin_particle(b, &view), type, value, value_size);
 }
 
 uint32_t
@@ -759,8 +844,9 @@ as_bin_particle_client_value_size(const as_bin *b)
 	}
 
 	uint8_t type = as_bin_get_particle_type(b);
+	short_string_view view;
 
-	return particle_vtable[type]->wire_size_fn(b->particle);
+	return particle_vtable[type]->wire_size_fn(bin_particle(b, &view));
 }
 
 uint32_t
@@ -778,20 +864,47 @@ as_bin_particle_to_client(const as_bin *b, as_msg_op *op)
 	op->particle_type = type;
 
 	uint8_t *value = (uint8_t *)op + sizeof(as_msg_op) + op->name_sz;
-	uint32_t added_size = particle_vtable[type]->to_wire_fn(b->particle, value);
+	short_string_view view;
+	uint32_t added_size = particle_vtable[type]->to_wire_fn(bin_particle(b, &view), value);
 
 	op->op_sz += added_size;
 
 	return added_size;
 }
 
+// Returns the client value's size if it's the particle's own bytes - strings
+// and blobs - and points *p_value at them. Otherwise returns 0.
+uint32_t
+as_bin_particle_client_value_ptr(const as_bin *b, const uint8_t **p_value)
+{
+	if (! as_bin_inuse(b)) {
+		return 0;
+	}
+
+	switch (as_bin_get_particle_type(b)) {
+	case AS_PARTICLE_TYPE_STRING:
+		return as_bin_particle_string_ptr(b, (char **)p_value);
+	case AS_PARTICLE_TYPE_BLOB:
+	case AS_PARTICLE_TYPE_JAVA_BLOB:
+	case AS_PARTICLE_TYPE_CSHARP_BLOB:
+	case AS_PARTICLE_TYPE_PYTHON_BLOB:
+	case AS_PARTICLE_TYPE_RUBY_BLOB:
+	case AS_PARTICLE_TYPE_PHP_BLOB:
+	case AS_PARTICLE_TYPE_ERLANG_BLOB:
+		return as_bin_particle_blob_ptr(b, (uint8_t **)p_value);
+	default:
+		return 0;
+	}
+}
+
 uint32_t
 as_bin_particle_pickled_size(const as_bin *b)
 {
 	uint8_t type = as_bin_get_particle_type(b);
+	short_string_view view;
 
 	// Always a type byte and a 32-bit size.
-	return 1 + 4 + particle_vtable[type]->wire_size_fn(b->particle);
+	return 1 + 4 + particle_vtable[type]->wire_size_fn(bin_particle(b, &view));
 }
 
 uint32_t
@@ -803,7 +916,8 @@ as_bin_particle_to_pickled(const as_bin *b, uint8_t *pickled)
 
 	uint32_t *p_size = (uint32_t *)pickled;
 	uint8_t *value = (uint8_t *)(p_size + 1);
-	uint32_t size = particle_vtable[type]->to_wire_fn(b->particle, value);
+	short_string_view view;
+	uint32_t size = particle_vtable[type]->to_wire_fn(bin_particle(b, &view), value);
 
 	*p_size = cf_swap_to_be32(size);
 
@@ -825,11 +939,26 @@ as_bin_particle_replace_from_asval(as_bin *b, const as_val *val)
 		return 0;
 	}
 
+	bool old_is_external = as_bin_is_external_particle(b);
+	as_particle *old_particle = b->particle;
+
+	if (new_type == AS_PARTICLE_TYPE_STRING) {
+		as_string *string = as_string_fromval(val);
+
+		if (embed_short_string(b, new_type,
+				(const uint8_t *)as_string_tostring(string),
+				(uint32_t)as_string_len(string))) {
+			if (old_is_external) {
+				particle_vtable[old_type]->destructor_fn(old_particle);
+			}
+
+			return 0;
+		}
+	}
+
 	uint32_t new_mem_size = particle_vtable[new_type]->size_from_asval_fn(val);
 	// TODO - could this ever fail?
 
-	as_particle *old_particle = b->particle;
-
 	if (new_mem_size != 0) {
 		b->particle = cf_malloc_ns(new_mem_size);
 
@@ -843,7 +972,7 @@ as_bin_particle_replace_from_asval(as_bin *b, const as_val *val)
 	particle_vtable[new_type]->from_asval_fn(val, &b->particle);
 	// TODO - could this ever fail?
 
-	if (as_bin_inuse(b)) {
+	if (old_is_external) {
 		// Destroy the old particle.
 		particle_vtable[old_type]->destructor_fn(old_particle);
 	}
@@ -888,8 +1017,10 @@ as_bin_particle_to_asval(const as_bin *b)
 {
 	uint8_t type = as_bin_get_particle_type(b);
 
+	short_string_view view;
+
 	// Caller is responsible for freeing as_val returned here.
-	return particle_vtable[type]->to_asval_fn(b->particle);
+	return particle_vtable[type]->to_asval_fn(bin_particle(b, &view));
 }
 
 //------------------------------------------------
@@ -975,10 +1106,17 @@ as_bin_particle_replace_from_flat(as_bin *b, const uint8_t *flat, uint32_t flat_
 	}
 
 	// Just destroy the old particle, if any - we're replacing it.
-	if (as_bin_inuse(b)) {
+	if (as_bin_is_external_particle(b)) {
 		particle_vtable[old_type]->destructor_fn(b->particle);
 	}
 
+	// Flat strings are a type byte, a host-order 32-bit size, then the value.
+	if (new_type == AS_PARTICLE_TYPE_STRING && flat_size >= 1 + 4 &&
+			*(const uint32_t *)(flat + 1) == flat_size - (1 + 4) &&
+			embed_short_string(b, new_type, flat + 1 + 4, flat_size - (1 + 4))) {
+		return 0;
+	}
+
 	// Load the new particle into the bin.
 	int result = particle_vtable[new_type]->from_flat_fn(flat, flat_size, &b->particle);
 
@@ -1003,8 +1141,9 @@ as_bin_particle_flat_size(as_bin *b)
 	}
 
 	uint8_t type = as_bin_get_particle_type(b);
+	short_string_view view;
 
-	return particle_vtable[type]->flat_size_fn(b->particle);
+	return particle_vtable[type]->flat_size_fn(bin_particle(b, &view));
 }
 
 uint32_t
@@ -1020,7 +1159,9 @@ as_bin_particle_to_flat(const as_bin *b, uint8_t *flat)
 
 	*flat = type;
 
-	return particle_vtable[type]->to_flat_fn(b->particle, flat);
+	short_string_view view;
+
+	return particle_vtable[type]->to_flat_fn(bin_particle(b, &view), flat);
 }
 
 
@@ -1039,13 +1180,14 @@ as_bin_cdt_read_from_client(const as_bin *b, as_msg_op *op, as_bin *result)
 }
 
 int
-as_bin_cdt_alloc_modify_from_client(as_bin *b, as_msg_op *op, as_bin *result)
+as_bin_cdt_alloc_modify_from_client(as_bin *b, as_msg_op *op, as_bin *result,
+		cf_ll_buf *results_llb)
 {
-	return as_bin_cdt_packed_modify(b, op, result, NULL);
+	return as_bin_cdt_packed_modify(b, op, result, NULL, results_llb);
 }
 
 int
-as_bin_cdt_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, as_msg_op *op, as_bin *result)
+as_bin_cdt_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, as_msg_op *op, as_bin *result, cf_ll_buf *results_llb)
 {
-	return as_bin_cdt_packed_modify(b, op, result, particles_llb);
+	return as_bin_cdt_packed_modify(b, op, result, particles_llb, results_llb);
 }
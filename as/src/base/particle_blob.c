@@ -23,6 +23,7 @@
 
 #include "base/particle_blob.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -31,6 +32,7 @@
 #include "aerospike/as_msgpack.h"
 #include "aerospike/as_val.h"
 #include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_byte_order.h"
 
 #include "fault.h"
 
@@ -94,12 +96,33 @@ typedef struct blob_flat_s {
 	uint8_t		data[];
 } __attribute__ ((__packed__)) blob_flat;
 
+// Parsed bit op - offset and size always in bits.
+typedef struct bits_op_s {
+	as_bits_optype	type;
+	uint64_t		offset;
+	uint64_t		size;
+	const uint8_t	*args;
+	uint32_t		shift;
+} bits_op;
+
+#define BITS_OP_HEADER_SZ (1 + sizeof(uint32_t) + sizeof(uint32_t))
+
+// Ceiling on growing a blob by bit ops - a bad offset mustn't allocate GBs.
+#define MAX_BITS_BLOB_SZ (128 * 1024 * 1024)
+
 
 //==========================================================
 // Forward declarations.
 //
 
 static inline as_particle_type blob_bytes_type_to_particle_type(as_bytes_type type);
+static bool bits_op_parse(const as_msg_op *op, bits_op *bop);
+static int bits_modify(as_bin *b, cf_ll_buf *particles_llb, const as_msg_op *op, bool in_place);
+static void bits_apply(uint8_t *data, const bits_op *bop);
+static void bits_shift(uint8_t *data, const bits_op *bop);
+static inline uint32_t bits_load(const uint8_t *data, uint64_t pos, uint32_t n_bits);
+static inline uint32_t bits_load_clamped(const uint8_t *data, const bits_op *bop, int64_t pos, uint32_t n_bits);
+static inline void bits_store(uint8_t *data, uint64_t pos, uint32_t n_bits, uint32_t value);
 
 
 //==========================================================
@@ -402,6 +425,158 @@ blob_to_flat(const as_particle *p, uint8_t *flat)
 }
 
 
+//==========================================================
+// as_bin particle functions specific to BLOB.
+//
+
+uint32_t
+as_bin_particle_blob_ptr(const as_bin *b, uint8_t **p_value)
+{
+	// Caller must ensure this is called only for BLOB particles.
+	blob_mem *p_blob_mem = (blob_mem *)b->particle;
+
+	*p_value = p_blob_mem->data;
+
+	return p_blob_mem->sz;
+}
+
+// Appends into the slack of the particle's allocation - its size class - so a
+// growing bin copies only when it crosses a class. Returns 1 if appended, with
+// the old value size to unwind to, 0 if there's no room, or a negative error.
+// Caller guarantees nothing but the bin refers to the particle for the rest of
+// the transaction, and must unwind on failure.
+int
+as_bin_particle_append_in_place(as_bin *b, const as_msg_op *op,
+		uint32_t *p_old_sz)
+{
+	if (! as_bin_inuse(b) || as_bin_is_short_string(b)) {
+		return 0;
+	}
+
+	as_particle_type type = as_bin_get_particle_type(b);
+
+	switch (type) {
+	case AS_PARTICLE_TYPE_STRING:
+	case AS_PARTICLE_TYPE_BLOB:
+	case AS_PARTICLE_TYPE_JAVA_BLOB:
+	case AS_PARTICLE_TYPE_CSHARP_BLOB:
+	case AS_PARTICLE_TYPE_PYTHON_BLOB:
+	case AS_PARTICLE_TYPE_RUBY_BLOB:
+	case AS_PARTICLE_TYPE_PHP_BLOB:
+	case AS_PARTICLE_TYPE_ERLANG_BLOB:
+		break;
+	default:
+		return 0;
+	}
+
+	if (op->particle_type != type) {
+		// Let the normal path fail it.
+		return 0;
+	}
+
+	uint32_t value_size = as_msg_op_get_value_sz(op);
+	blob_mem *p_blob_mem = (blob_mem *)b->particle;
+	size_t new_mem_sz = sizeof(blob_mem) + p_blob_mem->sz + value_size;
+
+	if (new_mem_sz > cf_alloc_usable_size(p_blob_mem)) {
+		return 0;
+	}
+
+	*p_old_sz = p_blob_mem->sz;
+
+	int result = blob_append_from_wire(type,
+			as_msg_op_get_value_p((as_msg_op *)op), value_size, &b->particle);
+
+	return result < 0 ? result : 1;
+}
+
+// Bytes past old_sz were only ever appended - dropping them restores the value.
+void
+as_bin_particle_append_unwind(as_bin *b, uint32_t old_sz)
+{
+	((blob_mem *)b->particle)->sz = old_sz;
+}
+
+int
+as_bin_bits_read_from_client(const as_bin *b, const as_msg_op *op,
+		as_bin *result)
+{
+	bits_op bop;
+
+	if (! bits_op_parse(op, &bop) || bop.type < AS_BITS_OP_GET) {
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (as_bin_get_particle_type(b) != AS_PARTICLE_TYPE_BLOB) {
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	const blob_mem *p_blob_mem = (const blob_mem *)b->particle;
+
+	if (bop.offset + bop.size > (uint64_t)p_blob_mem->sz * 8) {
+		cf_warning(AS_PARTICLE, "bit read past end of blob, size %u",
+				p_blob_mem->sz);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (bop.type == AS_BITS_OP_COUNT) {
+		uint64_t count = 0;
+
+		for (uint64_t k = 0; k < bop.size; k += 8) {
+			uint32_t w = bop.size - k < 8 ? (uint32_t)(bop.size - k) : 8;
+
+			count += (uint64_t)__builtin_popcount(
+					bits_load(p_blob_mem->data, bop.offset + k, w));
+		}
+
+		as_bin_particle_integer_set(result, (int64_t)count);
+		as_bin_state_set_from_type(result, AS_PARTICLE_TYPE_INTEGER);
+
+		return 0;
+	}
+
+	// AS_BITS_OP_GET - result is a blob, left-aligned.
+	uint32_t n_bytes = (uint32_t)((bop.size + 7) / 8);
+	blob_mem *p_result = cf_malloc(sizeof(blob_mem) + n_bytes);
+
+	if (! p_result) {
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	p_result->type = AS_PARTICLE_TYPE_BLOB;
+	p_result->sz = n_bytes;
+
+	for (uint64_t k = 0; k < bop.size; k += 8) {
+		uint32_t w = bop.size - k < 8 ? (uint32_t)(bop.size - k) : 8;
+
+		p_result->data[k / 8] = (uint8_t)
+				(bits_load(p_blob_mem->data, bop.offset + k, w) << (8 - w));
+	}
+
+	result->particle = (as_particle *)p_result;
+	as_bin_state_set_from_type(result, AS_PARTICLE_TYPE_BLOB);
+
+	return 0;
+}
+
+// If in_place is set, caller guarantees nothing else refers to the existing
+// particle (e.g. the previous op in this transaction made it), so it may be
+// changed rather than copied - unless the blob must grow.
+int
+as_bin_bits_alloc_modify_from_client(as_bin *b, const as_msg_op *op,
+		bool in_place)
+{
+	return bits_modify(b, NULL, op, in_place);
+}
+
+int
+as_bin_bits_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb,
+		const as_msg_op *op, bool in_place)
+{
+	return bits_modify(b, particles_llb, op, in_place);
+}
+
+
 //==========================================================
 // Local helpers.
 //
@@ -440,3 +615,250 @@ blob_bytes_type_to_particle_type(as_bytes_type type)
 	// Invalid blob types remain as blobs.
 	return AS_PARTICLE_TYPE_BLOB;
 }
+
+static bool
+bits_op_parse(const as_msg_op *op, bits_op *bop)
+{
+	uint32_t value_size = as_msg_op_get_value_sz(op);
+	const uint8_t *value = as_msg_op_get_value_p((as_msg_op *)op);
+
+	if (value_size < BITS_OP_HEADER_SZ) {
+		cf_warning(AS_PARTICLE, "bit op value too small (%u)", value_size);
+		return false;
+	}
+
+	bop->type = (as_bits_optype)value[0];
+	bop->offset = cf_swap_from_be32(*(const uint32_t *)(value + 1));
+	bop->size = cf_swap_from_be32(*(const uint32_t *)(value + 5));
+	bop->args = value + BITS_OP_HEADER_SZ;
+	bop->shift = 0;
+
+	uint32_t args_sz = value_size - (uint32_t)BITS_OP_HEADER_SZ;
+	uint32_t expected_sz;
+
+	switch (bop->type) {
+	case AS_BITS_OP_WRITE:
+		// A byte-aligned SET.
+		expected_sz = (uint32_t)bop->size;
+		bop->type = AS_BITS_OP_SET;
+		bop->offset *= 8;
+		bop->size *= 8;
+		break;
+	case AS_BITS_OP_SET:
+	case AS_BITS_OP_OR:
+	case AS_BITS_OP_XOR:
+	case AS_BITS_OP_AND:
+		expected_sz = (uint32_t)((bop->size + 7) / 8);
+		break;
+	case AS_BITS_OP_LSHIFT:
+	case AS_BITS_OP_RSHIFT:
+		expected_sz = sizeof(uint32_t);
+
+		if (args_sz == expected_sz) {
+			bop->shift = cf_swap_from_be32(*(const uint32_t *)bop->args);
+		}
+		break;
+	case AS_BITS_OP_GET:
+	case AS_BITS_OP_COUNT:
+		expected_sz = 0;
+		break;
+	default:
+		cf_warning(AS_PARTICLE, "unknown bit op %u", value[0]);
+		return false;
+	}
+
+	if (args_sz != expected_sz || bop->size == 0) {
+		cf_warning(AS_PARTICLE, "bad bit op %u - size %lu, args %u", value[0],
+				bop->size, args_sz);
+		return false;
+	}
+
+	return true;
+}
+
+// Like the particle modify path, doesn't destroy the existing particle, and
+// leaves it intact on failure.
+static int
+bits_modify(as_bin *b, cf_ll_buf *particles_llb, const as_msg_op *op,
+		bool in_place)
+{
+	bits_op bop;
+
+	if (! bits_op_parse(op, &bop) || bop.type >= AS_BITS_OP_GET) {
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	bool exists = as_bin_inuse(b);
+
+	if (exists && as_bin_get_particle_type(b) != AS_PARTICLE_TYPE_BLOB) {
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	blob_mem *p_blob_mem = exists ? (blob_mem *)b->particle : NULL;
+	uint64_t old_sz = exists ? p_blob_mem->sz : 0;
+	uint64_t end_sz = (bop.offset + bop.size + 7) / 8;
+	uint64_t new_sz = old_sz;
+
+	if (end_sz > old_sz) {
+		if (bop.type != AS_BITS_OP_SET) {
+			if (! exists) {
+				return -AS_PROTO_RESULT_FAIL_ELEMENT_NOT_FOUND;
+			}
+
+			cf_warning(AS_PARTICLE, "bit op %u past end of blob, size %lu",
+					bop.type, old_sz);
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		if (end_sz > MAX_BITS_BLOB_SZ) {
+			cf_warning(AS_PARTICLE, "bit op would grow blob to %lu", end_sz);
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		new_sz = end_sz;
+	}
+
+	if (! in_place || new_sz != old_sz) {
+		size_t mem_sz = sizeof(blob_mem) + new_sz;
+		blob_mem *p_new;
+
+		if (particles_llb) {
+			if (0 > cf_ll_buf_reserve(particles_llb, mem_sz,
+					(uint8_t **)&p_new)) {
+				return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+			}
+		}
+		else if (! (p_new = cf_malloc_ns(mem_sz))) {
+			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+
+		p_new->type = AS_PARTICLE_TYPE_BLOB;
+		p_new->sz = (uint32_t)new_sz;
+
+		if (old_sz != 0) {
+			memcpy(p_new->data, p_blob_mem->data, old_sz);
+		}
+
+		memset(p_new->data + old_sz, 0, new_sz - old_sz);
+
+		b->particle = (as_particle *)p_new;
+		as_bin_state_set_from_type(b, AS_PARTICLE_TYPE_BLOB);
+		p_blob_mem = p_new;
+	}
+
+	bits_apply(p_blob_mem->data, &bop);
+
+	return 0;
+}
+
+static void
+bits_apply(uint8_t *data, const bits_op *bop)
+{
+	if (bop->type == AS_BITS_OP_LSHIFT || bop->type == AS_BITS_OP_RSHIFT) {
+		bits_shift(data, bop);
+		return;
+	}
+
+	// Byte-aligned ranged write - no need to go bit by bit.
+	if (bop->type == AS_BITS_OP_SET && (bop->offset & 7) == 0 &&
+			(bop->size & 7) == 0) {
+		memcpy(data + bop->offset / 8, bop->args, bop->size / 8);
+		return;
+	}
+
+	for (uint64_t k = 0; k < bop->size; k += 8) {
+		uint32_t w = bop->size - k < 8 ? (uint32_t)(bop->size - k) : 8;
+		uint32_t arg = bits_load(bop->args, k, w);
+		uint32_t value;
+
+		switch (bop->type) {
+		case AS_BITS_OP_SET:
+			value = arg;
+			break;
+		case AS_BITS_OP_OR:
+			value = bits_load(data, bop->offset + k, w) | arg;
+			break;
+		case AS_BITS_OP_XOR:
+			value = bits_load(data, bop->offset + k, w) ^ arg;
+			break;
+		case AS_BITS_OP_AND:
+			value = bits_load(data, bop->offset + k, w) & arg;
+			break;
+		default:
+			cf_crash(AS_PARTICLE, "unexpected bit op %u", bop->type);
+			return;
+		}
+
+		bits_store(data, bop->offset + k, w, value);
+	}
+}
+
+// Shifts within the op's range. Left moves bits toward the range's start, so
+// goes forward (reads are ahead of writes) - right goes backward.
+static void
+bits_shift(uint8_t *data, const bits_op *bop)
+{
+	uint64_t n_chunks = (bop->size + 7) / 8;
+
+	for (uint64_t i = 0; i < n_chunks; i++) {
+		uint64_t chunk = bop->type == AS_BITS_OP_LSHIFT ? i : n_chunks - 1 - i;
+		uint64_t k = chunk * 8;
+		uint32_t w = bop->size - k < 8 ? (uint32_t)(bop->size - k) : 8;
+		int64_t from = bop->type == AS_BITS_OP_LSHIFT ?
+				(int64_t)k + bop->shift : (int64_t)k - bop->shift;
+
+		bits_store(data, bop->offset + k, w,
+				bits_load_clamped(data, bop, from, w));
+	}
+}
+
+// Returns n_bits (at most 8) starting at bit pos, right-aligned.
+static inline uint32_t
+bits_load(const uint8_t *data, uint64_t pos, uint32_t n_bits)
+{
+	const uint8_t *p = data + (pos >> 3);
+	uint32_t shift = (uint32_t)(pos & 7);
+	uint32_t window = (uint32_t)p[0] << 8;
+
+	if (shift + n_bits > 8) {
+		window |= p[1];
+	}
+
+	return (window >> (16 - shift - n_bits)) & ((1U << n_bits) - 1);
+}
+
+// Like bits_load(), but pos is relative to the op's range, and bits outside the
+// range read as zero.
+static inline uint32_t
+bits_load_clamped(const uint8_t *data, const bits_op *bop, int64_t pos,
+		uint32_t n_bits)
+{
+	int64_t lo = pos < 0 ? 0 : pos;
+	int64_t hi = pos + n_bits > (int64_t)bop->size ?
+			(int64_t)bop->size : pos + n_bits;
+
+	if (lo >= hi) {
+		return 0;
+	}
+
+	uint32_t value = bits_load(data, bop->offset + (uint64_t)lo,
+			(uint32_t)(hi - lo));
+
+	return value << (pos + n_bits - hi);
+}
+
+// Stores the right-aligned value's n_bits (at most 8) starting at bit pos.
+static inline void
+bits_store(uint8_t *data, uint64_t pos, uint32_t n_bits, uint32_t value)
+{
+	uint8_t *p = data + (pos >> 3);
+	uint32_t shift = (uint32_t)(pos & 7);
+	uint32_t mask = ((1U << n_bits) - 1) << (16 - shift - n_bits);
+	uint32_t window = (value << (16 - shift - n_bits)) & mask;
+
+	p[0] = (uint8_t)((p[0] & ~(mask >> 8)) | (window >> 8));
+
+	if (shift + n_bits > 8) {
+		p[1] = (uint8_t)((p[1] & ~mask) | window);
+	}
+}
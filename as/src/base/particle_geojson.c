@@ -462,25 +462,21 @@ as_particle_geojson_match(as_particle *particle, uint64_t query_cellid, geo_regi
 		size_t jsonsz;
 		char const *jsonptr = as_geojson_mem_jsonstr(particle, &jsonsz);
 
-		if (! geo_parse(NULL, jsonptr, jsonsz, &candidate_cellid,
+		// Note - the cache owns the region.
+		if (! geo_parse_cached(jsonptr, jsonsz, &candidate_cellid,
 				&candidate_region)) {
 			cf_warning(AS_PARTICLE, "geo_parse() failed - unexpected");
-			geo_region_destroy(candidate_region);
 			return false;
 		}
 	}
 
-	bool ismatch = geojson_match(
+	return geojson_match(
 			candidate_is_region,
 			candidate_cellid,
 			candidate_region,
 			query_cellid,
 			query_region,
 			is_strict);
-
-	geo_region_destroy(candidate_region);
-
-	return ismatch;
 }
 
 bool
@@ -493,26 +489,22 @@ as_particle_geojson_match_asval(const as_val *val, uint64_t query_cellid, geo_re
 	uint64_t candidate_cellid = 0;
 	geo_region_t candidate_region = NULL;
 
-	if (! geo_parse(NULL, jsonptr, jsonsz, &candidate_cellid,
+	// Note - the cache owns the region.
+	if (! geo_parse_cached(jsonptr, jsonsz, &candidate_cellid,
 			&candidate_region)) {
 		cf_warning(AS_PARTICLE, "geo_parse() failed - unexpected");
-		geo_region_destroy(candidate_region);
 		return false;
 	}
 
 	bool candidate_is_region = candidate_cellid == 0;
 
-	bool ismatch = geojson_match(
+	return geojson_match(
 			candidate_is_region,
 			candidate_cellid,
 			candidate_region,
 			query_cellid,
 			query_region,
 			is_strict);
-
-	geo_region_destroy(candidate_region);
-
-	return ismatch;
 }
 
 char const *
@@ -0,0 +1,520 @@
+/*
+ * particle_hll.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "aerospike/as_val.h"
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_byte_order.h"
+#include "citrusleaf/cf_hash_math.h"
+#include "citrusleaf/cf_ll.h"
+
+#include "fault.h"
+#include "hll.h"
+
+#include "base/datamodel.h"
+#include "base/particle.h"
+#include "base/particle_blob.h"
+#include "base/proto.h"
+
+
+//==========================================================
+// HLL particle interface - function declarations.
+//
+
+// Most HLL particle table functions just use the equivalent BLOB particle
+// functions. Here are the differences...
+
+// Handle "wire" format.
+int32_t hll_concat_size_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp);
+int hll_append_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp);
+int hll_prepend_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp);
+int hll_incr_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp);
+int32_t hll_size_from_wire(const uint8_t *wire_value, uint32_t value_size);
+int hll_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp);
+
+// Handle on-device "flat" format.
+int32_t hll_size_from_flat(const uint8_t *flat, uint32_t flat_size);
+int hll_cast_from_flat(uint8_t *flat, uint32_t flat_size, as_particle **pp);
+int hll_from_flat(const uint8_t *flat, uint32_t flat_size, as_particle **pp);
+
+
+//==========================================================
+// HLL particle interface - vtable.
+//
+
+const as_particle_vtable hll_vtable = {
+		blob_destruct,
+		blob_size,
+
+		hll_concat_size_from_wire,
+		hll_append_from_wire,
+		hll_prepend_from_wire,
+		hll_incr_from_wire,
+		hll_size_from_wire,
+		hll_from_wire,
+		blob_compare_from_wire,
+		blob_wire_size,
+		blob_to_wire,
+
+		// Never reached via an HLL type - UDFs and CDTs see HLLs as bytes.
+		blob_size_from_asval,
+		blob_from_asval,
+		blob_to_asval,
+		blob_asval_wire_size,
+		blob_asval_to_wire,
+
+		blob_size_from_msgpack,
+		blob_from_msgpack,
+
+		hll_size_from_flat,
+		hll_cast_from_flat,
+		hll_from_flat,
+		blob_flat_size,
+		blob_to_flat
+};
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// The HLL particle structs overlay the related BLOB structs. The data is the
+// same in memory, on the wire and on device - an encoding byte, then either
+// sparse entries or all the registers.
+
+typedef struct hll_mem_s {
+	uint8_t		type;	// IMPORTANT: overlay blob_mem!
+	uint32_t	sz;		// IMPORTANT: overlay blob_mem!
+	uint8_t		data[];
+} __attribute__ ((__packed__)) hll_mem;
+
+typedef struct hll_flat_s {
+	uint8_t		type;	// IMPORTANT: overlay blob_flat!
+	uint32_t	size;	// IMPORTANT: overlay blob_flat!
+	uint8_t		data[];
+} __attribute__ ((__packed__)) hll_flat;
+
+#define HLL_ENCODING_SPARSE 0
+#define HLL_ENCODING_DENSE 1
+
+// Sparse entries are non-zero registers in ascending index order.
+typedef struct hll_sparse_entry_s {
+	uint16_t	ix;		// big-endian
+	uint8_t		rank;
+} __attribute__ ((__packed__)) hll_sparse_entry;
+
+#define HLL_DENSE_SZ (1 + CF_HLL_N_REGISTERS)
+
+// Past this many non-zero registers, dense is no bigger than sparse.
+#define HLL_MAX_SPARSE_ENTRIES \
+	((CF_HLL_N_REGISTERS + sizeof(hll_sparse_entry) - 1) / \
+			sizeof(hll_sparse_entry))
+
+#define HLL_MAX_RANK (64 - CF_HLL_BITS + 1)
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool hll_validate(const uint8_t *data, uint32_t sz);
+static bool hll_fold(cf_hll *hll, const uint8_t *data, uint32_t sz);
+static uint32_t hll_encode(const cf_hll *hll, uint8_t *data);
+static uint32_t hll_encoded_size(const cf_hll *hll);
+static int hll_modify(as_bin *b, cf_ll_buf *particles_llb, const as_msg_op *op);
+
+
+//==========================================================
+// HLL particle interface - function definitions.
+//
+
+//------------------------------------------------
+// Handle "wire" format.
+//
+
+int32_t
+hll_concat_size_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp)
+{
+	cf_warning(AS_PARTICLE, "invalid operation on hll particle");
+	return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+}
+
+int
+hll_append_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp)
+{
+	cf_warning(AS_PARTICLE, "invalid operation on hll particle");
+	return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+}
+
+int
+hll_prepend_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp)
+{
+	cf_warning(AS_PARTICLE, "invalid operation on hll particle");
+	return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+}
+
+int
+hll_incr_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp)
+{
+	cf_warning(AS_PARTICLE, "invalid operation on hll particle");
+	return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+}
+
+int32_t
+hll_size_from_wire(const uint8_t *wire_value, uint32_t value_size)
+{
+	if (! hll_validate(wire_value, value_size)) {
+		cf_warning(AS_PARTICLE, "invalid wire hll, size %u", value_size);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	return blob_size_from_wire(wire_value, value_size);
+}
+
+int
+hll_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, as_particle **pp)
+{
+	// Already validated when sized.
+	return blob_from_wire(wire_type, wire_value, value_size, pp);
+}
+
+//------------------------------------------------
+// Handle on-device "flat" format.
+//
+
+int32_t
+hll_size_from_flat(const uint8_t *flat, uint32_t flat_size)
+{
+	int32_t mem_size = blob_size_from_flat(flat, flat_size);
+
+	if (mem_size < 0) {
+		return mem_size;
+	}
+
+	const hll_flat *p_hll_flat = (const hll_flat *)flat;
+
+	if (! hll_validate(p_hll_flat->data, p_hll_flat->size)) {
+		cf_warning(AS_PARTICLE, "invalid flat hll, size %u",
+				p_hll_flat->size);
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	return mem_size;
+}
+
+int
+hll_cast_from_flat(uint8_t *flat, uint32_t flat_size, as_particle **pp)
+{
+	int32_t mem_size = hll_size_from_flat(flat, flat_size);
+
+	if (mem_size < 0) {
+		return mem_size;
+	}
+
+	return blob_cast_from_flat(flat, flat_size, pp);
+}
+
+int
+hll_from_flat(const uint8_t *flat, uint32_t flat_size, as_particle **pp)
+{
+	int32_t mem_size = hll_size_from_flat(flat, flat_size);
+
+	if (mem_size < 0) {
+		return mem_size;
+	}
+
+	return blob_from_flat(flat, flat_size, pp);
+}
+
+
+//==========================================================
+// as_bin particle functions specific to HLL.
+//
+
+// Like CDTs, HLL operations don't go through the particle table functions -
+// they're applied to decoded registers, and the result re-encoded.
+
+int
+as_bin_hll_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
+{
+	return hll_modify(b, NULL, op);
+}
+
+int
+as_bin_hll_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb,
+		const as_msg_op *op)
+{
+	return hll_modify(b, particles_llb, op);
+}
+
+int
+as_bin_hll_read_from_client(const as_bin *b, const as_msg_op *op,
+		as_bin *result)
+{
+	if (op->op != AS_MSG_OP_HLL_COUNT) {
+		cf_warning(AS_PARTICLE, "unexpected hll read op %u", op->op);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (as_bin_get_particle_type(b) != AS_PARTICLE_TYPE_HLL) {
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	const hll_mem *p_hll_mem = (const hll_mem *)b->particle;
+	cf_hll hll;
+
+	cf_hll_init(&hll);
+	hll_fold(&hll, p_hll_mem->data, p_hll_mem->sz);
+
+	as_bin_particle_integer_set(result, (int64_t)cf_hll_estimate(&hll));
+	as_bin_state_set_from_type(result, AS_PARTICLE_TYPE_INTEGER);
+
+	return 0;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+hll_validate(const uint8_t *data, uint32_t sz)
+{
+	if (sz == 0) {
+		return false;
+	}
+
+	if (data[0] == HLL_ENCODING_DENSE) {
+		if (sz != HLL_DENSE_SZ) {
+			return false;
+		}
+
+		for (uint32_t i = 1; i < sz; i++) {
+			if (data[i] > HLL_MAX_RANK) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	if (data[0] != HLL_ENCODING_SPARSE ||
+			(sz - 1) % sizeof(hll_sparse_entry) != 0) {
+		return false;
+	}
+
+	uint32_t n_entries = (sz - 1) / sizeof(hll_sparse_entry);
+
+	if (n_entries > HLL_MAX_SPARSE_ENTRIES) {
+		return false;
+	}
+
+	const hll_sparse_entry *entries = (const hll_sparse_entry *)(data + 1);
+	int32_t prev_ix = -1;
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		int32_t ix = (int32_t)cf_swap_from_be16(entries[i].ix);
+
+		if (ix <= prev_ix || ix >= CF_HLL_N_REGISTERS ||
+				entries[i].rank == 0 || entries[i].rank > HLL_MAX_RANK) {
+			return false;
+		}
+
+		prev_ix = ix;
+	}
+
+	return true;
+}
+
+// Raises registers to those of an (already validated) encoding. Returns true
+// if any register was raised.
+static bool
+hll_fold(cf_hll *hll, const uint8_t *data, uint32_t sz)
+{
+	bool raised = false;
+
+	if (data[0] == HLL_ENCODING_DENSE) {
+		const uint8_t *regs = data + 1;
+
+		for (uint32_t i = 0; i < CF_HLL_N_REGISTERS; i++) {
+			if (regs[i] > hll->regs[i]) {
+				hll->regs[i] = regs[i];
+				raised = true;
+			}
+		}
+
+		return raised;
+	}
+
+	uint32_t n_entries = (sz - 1) / sizeof(hll_sparse_entry);
+	const hll_sparse_entry *entries = (const hll_sparse_entry *)(data + 1);
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		uint32_t ix = cf_swap_from_be16(entries[i].ix);
+
+		if (entries[i].rank > hll->regs[ix]) {
+			hll->regs[ix] = entries[i].rank;
+			raised = true;
+		}
+	}
+
+	return raised;
+}
+
+// Returns the encoded size - caller sizes data via hll_encoded_size().
+static uint32_t
+hll_encode(const cf_hll *hll, uint8_t *data)
+{
+	uint32_t sz = hll_encoded_size(hll);
+
+	if (sz == HLL_DENSE_SZ) {
+		data[0] = HLL_ENCODING_DENSE;
+		memcpy(data + 1, hll->regs, CF_HLL_N_REGISTERS);
+
+		return sz;
+	}
+
+	data[0] = HLL_ENCODING_SPARSE;
+
+	hll_sparse_entry *entry = (hll_sparse_entry *)(data + 1);
+
+	for (uint32_t i = 0; i < CF_HLL_N_REGISTERS; i++) {
+		if (hll->regs[i] != 0) {
+			entry->ix = cf_swap_to_be16((uint16_t)i);
+			entry->rank = hll->regs[i];
+			entry++;
+		}
+	}
+
+	return sz;
+}
+
+static uint32_t
+hll_encoded_size(const cf_hll *hll)
+{
+	uint32_t n_entries = 0;
+
+	for (uint32_t i = 0; i < CF_HLL_N_REGISTERS; i++) {
+		if (hll->regs[i] != 0) {
+			n_entries++;
+		}
+	}
+
+	return n_entries < HLL_MAX_SPARSE_ENTRIES ?
+			1 + (n_entries * (uint32_t)sizeof(hll_sparse_entry)) :
+			HLL_DENSE_SZ;
+}
+
+// Like the particle modify path, doesn't destroy the existing particle, and
+// leaves it intact on failure. If no register is raised, the bin is left as
+// is - caller must check before treating the old particle as garbage.
+static int
+hll_modify(as_bin *b, cf_ll_buf *particles_llb, const as_msg_op *op)
+{
+	bool exists = as_bin_inuse(b);
+
+	if (exists && as_bin_get_particle_type(b) != AS_PARTICLE_TYPE_HLL) {
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	uint32_t value_size = as_msg_op_get_value_sz(op);
+	const uint8_t *value = as_msg_op_get_value_p((as_msg_op *)op);
+
+	cf_hll hll;
+
+	cf_hll_init(&hll);
+
+	if (exists) {
+		const hll_mem *p_hll_mem = (const hll_mem *)b->particle;
+
+		hll_fold(&hll, p_hll_mem->data, p_hll_mem->sz);
+	}
+
+	bool raised = false;
+
+	switch (op->op) {
+	case AS_MSG_OP_HLL_ADD: {
+		if (value_size == 0) {
+			cf_warning(AS_PARTICLE, "hll add with empty value");
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		// Hash includes the type so that e.g. integer 1 and string "1" differ.
+		uint64_t hash = cf_hash_fnv64(value, value_size) ^ op->particle_type;
+		uint32_t ix;
+		uint8_t rank;
+
+		cf_hll_register(hash, &ix, &rank);
+
+		if (rank > hll.regs[ix]) {
+			hll.regs[ix] = rank;
+			raised = true;
+		}
+
+		break;
+	}
+	case AS_MSG_OP_HLL_MERGE:
+		if (op->particle_type != AS_PARTICLE_TYPE_HLL ||
+				! hll_validate(value, value_size)) {
+			cf_warning(AS_PARTICLE, "hll merge with invalid hll, size %u",
+					value_size);
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		raised = hll_fold(&hll, value, value_size);
+		break;
+	default:
+		cf_warning(AS_PARTICLE, "unexpected hll modify op %u", op->op);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (exists && ! raised) {
+		return 0;
+	}
+
+	uint32_t data_sz = hll_encoded_size(&hll);
+	size_t mem_sz = sizeof(hll_mem) + data_sz;
+	hll_mem *p_hll_mem;
+
+	if (particles_llb) {
+		if (0 > cf_ll_buf_reserve(particles_llb, mem_sz,
+				(uint8_t **)&p_hll_mem)) {
+			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+	}
+	else if (! (p_hll_mem = cf_malloc_ns(mem_sz))) {
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	p_hll_mem->type = AS_PARTICLE_TYPE_HLL;
+	p_hll_mem->sz = hll_encode(&hll, p_hll_mem->data);
+
+	b->particle = (as_particle *)p_hll_mem;
+	as_bin_state_set_from_type(b, AS_PARTICLE_TYPE_HLL);
+
+	return 0;
+}
@@ -213,6 +213,7 @@ static int packed_list_set(as_bin *b, rollback_alloc *alloc_buf, const cdt_paylo
 static int packed_list_increment(as_bin *b, rollback_alloc *alloc_buf, int64_t index, cdt_payload *delta_value, as_bin *result);
 static int packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t count, as_bin *result);
 static uint8_t *packed_list_setup_bin(as_bin *b, rollback_alloc *alloc_buf, uint32_t content_sz, uint32_t ele_count, uint32_t idx_trunc, const offset_index *old_offidx);
+static void packed_list_carry_index(as_bin *b, const offset_index *old_offidx, uint32_t new_idx, uint32_t old_idx, uint32_t new_offset, uint32_t old_offset);
 
 // Debugging support
 static void print_cdt_list_particle(const as_particle *p);
@@ -831,7 +832,7 @@ packed_list_op_remove(packed_list_op *op, uint32_t index, uint32_t count)
 		};
 
 		for (uint32_t i = 0; i < count; i++) {
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				return -2 - i;
 			}
 		}
@@ -907,7 +908,7 @@ packed_list_op_find_idx_offset(const packed_list_op *op, uint32_t index)
 
 		for (uint32_t i = 0; i < blocks; i++) {
 			for (uint32_t j = 0; j < PACKED_LIST_INDEX_STEP; j++) {
-				if (as_unpack_size(&pk) < 0) {
+				if (cdt_unpack_size(&pk) < 0) {
 					return 0;
 				}
 			}
@@ -918,7 +919,7 @@ packed_list_op_find_idx_offset(const packed_list_op *op, uint32_t index)
 	}
 
 	for (uint32_t i = 0; i < steps; i++) {
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			return 0;
 		}
 	}
@@ -1201,6 +1202,11 @@ packed_list_remove(as_bin *b, rollback_alloc *alloc_buf, int64_t index,
 		ptr += ret;
 
 		packed_list_op_write_seg2(&op, ptr);
+
+		if (op.seg2_sz != 0) {
+			packed_list_carry_index(b, &op.offidx, uindex, uindex +
+					(uint32_t)count, op.seg1_sz, op.seg2_index);
+		}
 	}
 
 	if (result) {
@@ -1227,8 +1233,22 @@ packed_list_remove(as_bin *b, rollback_alloc *alloc_buf, int64_t index,
 			}
 			else if (result_sz > 0) {
 				cf_assert(count <= 1, AS_PARTICLE, "packed_list_remove() result must be list for count > 1");
-				as_bin_particle_alloc_from_msgpack(result, result_ptr,
-						result_sz);
+
+				if (alloc_result && alloc_result->ll_buf) {
+					cdt_payload seg = {
+							.ptr = result_ptr,
+							.sz = result_sz
+					};
+
+					if (! rollback_alloc_from_msgpack(alloc_result, result,
+							&seg)) {
+						return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+					}
+				}
+				else {
+					as_bin_particle_alloc_from_msgpack(result, result_ptr,
+							result_sz);
+				}
 			}
 			// else - leave result bin empty because result_size is 0.
 		}
@@ -1284,6 +1304,11 @@ packed_list_set(as_bin *b, rollback_alloc *alloc_buf,
 
 	packed_list_op_write_seg2(&op, ptr);
 
+	if (op.seg2_sz != 0) {
+		packed_list_carry_index(b, &op.offidx, uindex + 1, uindex + 1,
+				op.seg1_sz + payload->sz, op.seg2_index);
+	}
+
 	return AS_PROTO_RESULT_OK;
 }
 
@@ -1407,6 +1432,7 @@ packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index,
 	}
 
 	memcpy(ptr, op.contents + offset0, content_sz);
+	packed_list_carry_index(b, &op.offidx, 0, uindex, 0, offset0);
 	as_bin_set_int(result, ele_count - new_count);
 
 	return AS_PROTO_RESULT_OK;
@@ -1446,23 +1472,66 @@ packed_list_setup_bin(as_bin *b, rollback_alloc *alloc_buf, uint32_t content_sz,
 	offset_index offidx;
 
 	list_offset_index_init(&offidx, ptr, ele_count, content_sz);
-	idx_trunc /= PACKED_LIST_INDEX_STEP;
 
-	if (idx_trunc == 0 || offset_index_is_null(old_offidx)) {
+	if (offset_index_is_null(old_offidx)) {
 		offset_index_set_filled(&offidx, 1);
 	}
 	else {
-		if (idx_trunc > offset_index_get_filled(old_offidx)) {
-			idx_trunc = offset_index_get_filled(old_offidx);
+		// Elements up to and including idx_trunc keep their offsets.
+		uint32_t count = idx_trunc / PACKED_LIST_INDEX_STEP + 1;
+
+		if (count > offset_index_get_filled(old_offidx)) {
+			count = offset_index_get_filled(old_offidx);
+		}
+
+		if (count > offidx._.ele_count) {
+			count = offidx._.ele_count;
 		}
 
-		offset_index_copy(&offidx, old_offidx, 0, 0, idx_trunc, 0);
-		offset_index_set_filled(&offidx, idx_trunc);
+		offset_index_copy(&offidx, old_offidx, 0, 0, count, 0);
+		offset_index_set_filled(&offidx, count);
 	}
 
 	return ptr + offset_index_size(&offidx);
 }
 
+// Extend a new list's index past the prefix copied by packed_list_setup_bin(),
+// using old entries for the unchanged tail starting at old_idx (now new_idx).
+// Only possible if the tail moved by whole index steps.
+static void
+packed_list_carry_index(as_bin *b, const offset_index *old_offidx,
+		uint32_t new_idx, uint32_t old_idx, uint32_t new_offset,
+		uint32_t old_offset)
+{
+	if (offset_index_is_null(old_offidx) ||
+			(old_idx - new_idx) % PACKED_LIST_INDEX_STEP != 0) {
+		return;
+	}
+
+	packed_list_op op;
+
+	if (! packed_list_op_init_from_bin(&op, b) ||
+			offset_index_is_null(&op.offidx)) {
+		return;
+	}
+
+	offset_index *offidx = &op.offidx;
+	uint32_t shift = (old_idx - new_idx) / PACKED_LIST_INDEX_STEP;
+	uint32_t old_filled = offset_index_get_filled(old_offidx);
+
+	for (uint32_t i = offset_index_get_filled(offidx);
+			i < offidx->_.ele_count; i++) {
+		if (i * PACKED_LIST_INDEX_STEP < new_idx || i + shift >= old_filled) {
+			break;
+		}
+
+		uint32_t offset = offset_index_get_const(old_offidx, i + shift);
+
+		offset_index_set(offidx, i, offset - old_offset + new_offset);
+		offset_index_set_filled(offidx, i + 1);
+	}
+}
+
 
 //==========================================================
 // cdt_list_builder
@@ -1510,8 +1579,8 @@ cdt_process_state_packed_list_modify_optype(cdt_process_state *state,
 	}
 
 	rollback_alloc_inita(alloc_buf, cdt_udata->alloc_buf, 5, true);
-	// Results always on the heap.
-	rollback_alloc_inita(alloc_result, NULL, 1, false);
+	// Results on the heap unless the caller has an arena for them.
+	rollback_alloc_inita(alloc_result, cdt_udata->result_alloc_buf, 1, false);
 
 	switch (optype) {
 	// Add to list.
@@ -1835,7 +1904,7 @@ cdt_process_state_packed_list_read_optype(cdt_process_state *state,
 				.length = op.content_sz - offset
 		};
 
-		int64_t ele_sz = as_unpack_size(&pk);
+		int64_t ele_sz = cdt_unpack_size(&pk);
 
 		if (ele_sz < 0) {
 			cf_warning(AS_PARTICLE, "OP_LIST_GET: unable to unpack element at %u", uindex);
@@ -1905,7 +1974,7 @@ cdt_process_state_packed_list_read_optype(cdt_process_state *state,
 		uint32_t ele_sz = 0;
 
 		for (uint64_t i = 0; i < count; i++) {
-			int64_t i_sz = as_unpack_size(&pk);
+			int64_t i_sz = cdt_unpack_size(&pk);
 
 			if (i_sz < 0) {
 				cf_warning(AS_PARTICLE, "OP_LIST_GET_RANGE: invalid list element at index %u", uindex + (uint32_t)i);
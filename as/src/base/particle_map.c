@@ -28,6 +28,8 @@
 #include <string.h>
 
 #include "aerospike/as_buffer.h"
+#include "aerospike/as_hashmap.h"
+#include "aerospike/as_map.h"
 #include "aerospike/as_msgpack.h"
 #include "aerospike/as_serializer.h"
 #include "aerospike/as_val.h"
@@ -291,6 +293,20 @@ typedef struct result_data_s {
 	bool is_multi;
 } cdt_result_data;
 
+// Map as_val backed by a copy of the packed map - elements are only unpacked
+// when asked for. Used to hand map bins to UDFs.
+typedef struct map_lazy_s {
+	as_map map; // must be first
+
+	as_hashmap *cache;		// entries handed out before materializing
+	as_map *decoded;		// whole map, once materialized
+	bool has_containers;	// handed out a list or map (which may be modified)
+
+	uint32_t ele_count;
+	uint32_t sz;
+	uint8_t data[];
+} map_lazy;
+
 #define as_bin_create_temp_packed_flagged_map_if_notinuse(__b, __flags) { \
 	if (__flags == 0) { \
 		as_bin_create_temp_packed_map_if_notinuse(__b); \
@@ -559,6 +575,35 @@ static inline bool result_data_is_return_index_range(const cdt_result_data *rd);
 static inline bool result_data_is_return_rank(const cdt_result_data *rd);
 static inline bool result_data_is_return_rank_range(const cdt_result_data *rd);
 
+// map_lazy
+static bool map_lazy_destroy(as_map *map);
+static uint32_t map_lazy_hashcode(const as_map *map);
+static uint32_t map_lazy_size(const as_map *map);
+static int map_lazy_set(as_map *map, const as_val *key, const as_val *val);
+static as_val *map_lazy_get(const as_map *map, const as_val *key);
+static int map_lazy_remove(as_map *map, const as_val *key);
+static int map_lazy_clear(as_map *map);
+static bool map_lazy_foreach(const as_map *map, as_map_foreach_callback callback, void *udata);
+static as_map_iterator *map_lazy_iterator_new(const as_map *map);
+static as_map_iterator *map_lazy_iterator_init(const as_map *map, as_map_iterator *it);
+
+static as_map *map_lazy_materialize(const as_map *map);
+static inline const map_lazy *map_lazy_pristine(const as_val *val);
+static bool map_lazy_keep_cached(const as_val *key, const as_val *val, void *udata);
+
+static const as_map_hooks map_lazy_hooks = {
+		.destroy		= map_lazy_destroy,
+		.hashcode		= map_lazy_hashcode,
+		.size			= map_lazy_size,
+		.set			= map_lazy_set,
+		.get			= map_lazy_get,
+		.remove			= map_lazy_remove,
+		.clear			= map_lazy_clear,
+		.foreach		= map_lazy_foreach,
+		.iterator_new	= map_lazy_iterator_new,
+		.iterator_init	= map_lazy_iterator_init
+};
+
 // Debugging support
 void print_index32(const uint32_t *index, uint32_t ele_count, const char *name);
 void print_vindex(const order_index *index, const char *name);
@@ -753,6 +798,12 @@ map_to_wire(const as_particle *p, uint8_t *wire)
 uint32_t
 map_size_from_asval(const as_val *val)
 {
+	const map_lazy *lazy = map_lazy_pristine(val);
+
+	if (lazy) {
+		return (uint32_t)sizeof(map_mem) + lazy->sz;
+	}
+
 	as_serializer s;
 	as_msgpack_init(&s);
 
@@ -789,6 +840,15 @@ map_from_asval(const as_val *val, as_particle **pp)
 
 	p_map_mem->type = AS_PARTICLE_TYPE_MAP;
 
+	const map_lazy *lazy = map_lazy_pristine(val);
+
+	if (lazy) {
+		// Packed map was valid as a particle - copy it as-is.
+		p_map_mem->sz = lazy->sz;
+		memcpy(p_map_mem->data, lazy->data, lazy->sz);
+		return;
+	}
+
 	as_serializer s;
 	as_msgpack_init(&s);
 
@@ -971,7 +1031,8 @@ map_from_flat(const uint8_t *flat, uint32_t flat_size, as_particle **pp)
 		return -1;
 	}
 
-	if (op.pmi.flags == 0) {
+	// Unordered, or indexes were persisted - use as is.
+	if (op.pmi.flags == map_adjust_incoming_flags(op.pmi.flags)) {
 		// Convert temp buffer from disk to data-in-memory.
 		map_mem *p_map_mem = cf_malloc_ns(sizeof(map_mem) + p_map_flat->sz);
 
@@ -1056,6 +1117,111 @@ map_to_flat(const as_particle *p, uint8_t *flat)
 }
 
 
+//==========================================================
+// as_bin particle functions specific to MAP.
+//
+
+// Flat size when ordered maps keep their indexes on device.
+uint32_t
+as_bin_particle_map_indexed_flat_size(const as_bin *b)
+{
+	packed_map_op op;
+
+	if (! packed_map_op_init_from_bin(&op, b, false)) {
+		cf_crash(AS_PARTICLE, "as_bin_particle_map_indexed_flat_size() invalid packed map");
+	}
+
+	if (op.pmi.flags == 0) {
+		return map_flat_size(b->particle);
+	}
+
+	map_packer mpk;
+
+	map_packer_init(&mpk, op.ele_count,
+			map_adjust_incoming_flags(op.pmi.flags),
+			op.packed_sz - op.ele_start);
+
+	return (uint32_t)sizeof(map_flat) + mpk.ext_sz + mpk.content_sz +
+			as_pack_map_header_get_size(mpk.ele_count + (mpk.flags ? 1 : 0));
+}
+
+// Like map_to_flat(), but ordered maps keep (or gain) their offset and value
+// order indexes, so reads from device needn't rebuild them.
+uint32_t
+as_bin_particle_map_to_indexed_flat(const as_bin *b, uint8_t *flat)
+{
+	*flat = as_bin_get_particle_type(b);
+
+	packed_map_op op;
+
+	if (! packed_map_op_init_from_bin(&op, b, false)) {
+		cf_crash(AS_PARTICLE, "as_bin_particle_map_to_indexed_flat() invalid packed map");
+	}
+
+	if (op.pmi.flags == 0) {
+		return map_to_flat(b->particle, flat);
+	}
+
+	map_flat *p_map_flat = (map_flat *)flat;
+	uint8_t flags = map_adjust_incoming_flags(op.pmi.flags);
+
+	if (flags == op.pmi.flags) {
+		// Indexes already in particle - may be partly filled, which is fine.
+		p_map_flat->sz = op.packed_sz;
+		memcpy(p_map_flat->data, op.packed, op.packed_sz);
+
+		return sizeof(map_flat) + p_map_flat->sz;
+	}
+
+	const uint8_t *content_ptr = op.packed + op.ele_start;
+	uint32_t content_sz = op.packed_sz - op.ele_start;
+	map_packer mpk;
+
+	map_packer_init(&mpk, op.ele_count, flags, content_sz);
+	mpk.write_ptr = p_map_flat->data;
+
+	map_packer_write_hdridx(&mpk);
+	memcpy(mpk.write_ptr, content_ptr, content_sz);
+
+	if (! map_packer_fill_offset_index(&mpk) ||
+			! map_packer_fill_v_index(&mpk, mpk.write_ptr, content_sz)) {
+		cf_crash(AS_PARTICLE, "as_bin_particle_map_to_indexed_flat() failed to fill indexes");
+	}
+
+	p_map_flat->sz = (uint32_t)(mpk.write_ptr + content_sz - p_map_flat->data);
+
+	return sizeof(map_flat) + p_map_flat->sz;
+}
+
+// Like as_bin_particle_to_asval(), but elements are only unpacked as they're
+// looked up - the whole map is unpacked only if modified or iterated.
+as_val *
+as_bin_particle_map_to_lazy_asval(const as_bin *b)
+{
+	const map_mem *p_map_mem = (const map_mem *)b->particle;
+	packed_map_op op;
+
+	if (! packed_map_op_init(&op, p_map_mem->data, p_map_mem->sz, false)) {
+		cf_warning(AS_PARTICLE, "as_bin_particle_map_to_lazy_asval() invalid packed map");
+		return map_to_asval(b->particle);
+	}
+
+	// Copy, since the bin's particle may be replaced while the UDF runs.
+	map_lazy *lazy = cf_malloc(sizeof(map_lazy) + p_map_mem->sz);
+
+	as_map_cons(&lazy->map, true, (uint32_t)op.pmi.flags, &map_lazy_hooks);
+
+	lazy->cache = NULL;
+	lazy->decoded = NULL;
+	lazy->has_containers = false;
+	lazy->ele_count = op.ele_count;
+	lazy->sz = p_map_mem->sz;
+	memcpy(lazy->data, p_map_mem->data, p_map_mem->sz);
+
+	return (as_val *)lazy;
+}
+
+
 //==========================================================
 // Local helpers.
 //
@@ -1153,11 +1319,11 @@ op_fill_offidx(const packed_map_op *op)
 static inline bool
 skip_map_pair(as_unpacker *pk)
 {
-	if (as_unpack_size(pk) < 0) {
+	if (cdt_unpack_size(pk) < 0) {
 		return false;
 	}
 
-	if (as_unpack_size(pk) < 0) {
+	if (cdt_unpack_size(pk) < 0) {
 		return false;
 	}
 
@@ -1421,12 +1587,12 @@ map_packer_fill_index_sort_compare(const void *x, const void *y, void *p)
 
 	if (udata->sort_by == SORT_BY_VALUE) {
 		// Skip keys.
-		if (as_unpack_size(&x_pk) < 0) {
+		if (cdt_unpack_size(&x_pk) < 0) {
 			udata->error = true;
 			return 0;
 		}
 
-		if (as_unpack_size(&y_pk) < 0) {
+		if (cdt_unpack_size(&y_pk) < 0) {
 			udata->error = true;
 			return 0;
 		}
@@ -1697,6 +1863,31 @@ packed_map_increment(as_bin *b, rollback_alloc *alloc_buf,
 
 	cdt_calc_delta_pack_and_result(&calc_delta, &value, result);
 
+	if (find_key.found_key && ! (op.pmi.flags & AS_PACKED_MAP_FLAG_ORD_IDX) &&
+			find_key.key_offset + find_key.sz - find_key.value_offset ==
+					value.sz) {
+		// Same size value and no value index - copy and patch value in place,
+		// avoiding a repack. Existing particle may be shared, so don't write
+		// to it directly.
+		const map_mem *old_p = (const map_mem *)b->particle;
+		size_t sz = sizeof(map_mem) + old_p->sz;
+		map_mem *p_map_mem = (map_mem *)(alloc_buf
+				? rollback_alloc_reserve(alloc_buf, sz)
+				: cf_malloc(sz)); // response, so not cf_malloc_ns()
+
+		if (! p_map_mem) {
+			cf_warning(AS_PARTICLE, "packed_map_increment() failed to alloc map particle");
+			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+
+		memcpy(p_map_mem, old_p, sz);
+		memcpy(p_map_mem->data + op.ele_start + find_key.value_offset,
+				value.ptr, value.sz);
+		b->particle = (as_particle *)p_map_mem;
+
+		return AS_PROTO_RESULT_OK;
+	}
+
 	map_add_control control = {
 			.allow_overwrite = true,
 			.allow_create = true,
@@ -1845,7 +2036,7 @@ packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf,
 				.sz = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_add_items() invalid parameter");
 			ret = -AS_PROTO_RESULT_FAIL_PARAMETER;
 			break;
@@ -1858,7 +2049,7 @@ packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf,
 				.sz = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_add_items() invalid parameter");
 			ret = -AS_PROTO_RESULT_FAIL_PARAMETER;
 			break;
@@ -2149,7 +2340,7 @@ packed_map_remove_all_key_items(as_bin *b, rollback_alloc *alloc_buf,
 				.sz = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_remove_all_key_items() invalid parameter");
 			return -AS_PROTO_RESULT_FAIL_PARAMETER;
 		}
@@ -2387,7 +2578,7 @@ packed_map_remove_all_value_items(as_bin *b, rollback_alloc *alloc_buf,
 				.sz = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_remove_all_value_items() invalid parameter");
 			return -AS_PROTO_RESULT_FAIL_PARAMETER;
 		}
@@ -2756,7 +2947,7 @@ packed_map_op_unpack_hdridx(packed_map_op *op, bool fill_idxs)
 			return false;
 		}
 
-		if (as_unpack_size(&pk) < 0) {	// skip the packed nil
+		if (cdt_unpack_size(&pk) < 0) {	// skip the packed nil
 			return false;
 		}
 
@@ -2893,7 +3084,7 @@ packed_map_op_find_index_by_key_unordered(const packed_map_op *op,
 			index++;
 		}
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			return op->ele_count;
 		}
 	}
@@ -2965,7 +3156,7 @@ packed_map_op_find_rank_indexed(const packed_map_op *op, map_ele_find *find)
 				.length = (int)op->packed_sz
 		};
 
-		if (as_unpack_size(&pk_buf) < 0) {	// skip key
+		if (cdt_unpack_size(&pk_buf) < 0) {	// skip key
 			cf_warning(AS_PARTICLE, "packed_map_op_find_rank_indexed() unpack key failed at rank=%u", rank);
 			return false;
 		}
@@ -3054,7 +3245,7 @@ packed_map_op_find_rank_by_value_indexed(const packed_map_op *op,
 				.length = (int)len
 		};
 
-		if (as_unpack_size(&pk_buf) < 0) {	// skip key
+		if (cdt_unpack_size(&pk_buf) < 0) {	// skip key
 			return false;
 		}
 
@@ -3193,14 +3384,14 @@ packed_map_op_find_rank_range_by_value_interval_unordered(
 	};
 
 	// Pre-check parameters.
-	if (as_unpack_size(&pk_start) < 0) {
+	if (cdt_unpack_size(&pk_start) < 0) {
 		cf_warning(AS_PARTICLE, "packed_map_op_find_rank_range_by_value_interval_unordered() invalid start value");
 		return false;
 	}
 
 	if (value_end != value_start) {
 		// Pre-check parameters.
-		if (value_end && as_unpack_size(&pk_end) < 0) {
+		if (value_end && cdt_unpack_size(&pk_end) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_op_find_rank_range_by_value_interval_unordered() invalid end value");
 			return false;
 		}
@@ -3216,7 +3407,7 @@ packed_map_op_find_rank_range_by_value_interval_unordered(
 	for (uint32_t i = 0; i < op->ele_count; i++) {
 		offset_index_set(offidx, i, (uint32_t)pk.offset);
 
-		if (as_unpack_size(&pk) < 0) {	// skip key
+		if (cdt_unpack_size(&pk) < 0) {	// skip key
 			cf_warning(AS_PARTICLE, "packed_map_op_find_rank_range_by_value_interval_unordered() invalid packed map at index %u", i);
 			return false;
 		}
@@ -3353,7 +3544,7 @@ packed_map_op_find_key_indexed(const packed_map_op *op, map_ele_find *find,
 							.length = (int)len
 					};
 
-					if (as_unpack_size(&pk) < 0) {
+					if (cdt_unpack_size(&pk) < 0) {
 						cf_warning(AS_PARTICLE, "packed_map_op_find_key_indexed() invalid packed map");
 						return false;
 					}
@@ -3482,7 +3673,7 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find,
 			}
 			else {
 				// Skip value.
-				if (as_unpack_size(&pk) < 0) {
+				if (cdt_unpack_size(&pk) < 0) {
 					return false;
 				}
 
@@ -3517,14 +3708,14 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find,
 			find->key_offset = (uint32_t)pk.offset;
 
 			// Skip key.
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				return false;
 			}
 
 			find->value_offset = (uint32_t)pk.offset;
 
 			// Skip value.
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				return false;
 			}
 
@@ -3564,7 +3755,7 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find,
 				}
 				else {
 					// Skip value.
-					if (as_unpack_size(&pk) < 0) {
+					if (cdt_unpack_size(&pk) < 0) {
 						return false;
 					}
 				}
@@ -3604,7 +3795,7 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find,
 				return true;
 			}
 			// Skip value.
-			else if (as_unpack_size(&pk) < 0) {
+			else if (cdt_unpack_size(&pk) < 0) {
 				return false;
 			}
 
@@ -4271,14 +4462,14 @@ packed_map_op_get_range_by_key_interval_unordered(packed_map_op *op,
 	};
 
 	// Pre-check parameters.
-	if (as_unpack_size(&pk_start) < 0) {
+	if (cdt_unpack_size(&pk_start) < 0) {
 		cf_warning(AS_PARTICLE, "packed_map_op_get_range_by_key_interval_unordered() invalid start key");
 		return false;
 	}
 
 	if (key_end) {
 		// Pre-check parameters.
-		if (key_end && as_unpack_size(&pk_end) < 0) {
+		if (key_end && cdt_unpack_size(&pk_end) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_op_get_range_by_key_interval_unordered() invalid end key");
 			return false;
 		}
@@ -4325,7 +4516,7 @@ packed_map_op_get_range_by_key_interval_unordered(packed_map_op *op,
 		}
 
 		// Skip value.
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_op_get_range_by_key_interval_unordered() invalid packed map at index %u", i);
 			return false;
 		}
@@ -4482,7 +4673,7 @@ packed_map_op_get_key_by_idx(const packed_map_op *op, cdt_payload *key,
 			.length = (int)(op->packed_sz - pk_offset)
 	};
 
-	if (as_unpack_size(&pk) < 0) { // read key
+	if (cdt_unpack_size(&pk) < 0) { // read key
 		cf_warning(AS_PARTICLE, "packed_map_op_get_key_by_idx() read key failed");
 		return false;
 	}
@@ -4507,7 +4698,7 @@ packed_map_op_get_value_by_idx(const packed_map_op *op, cdt_payload *value,
 			.length = (int)(op->packed_sz - pk_offset)
 	};
 
-	if (as_unpack_size(&pk) < 0) { // read key
+	if (cdt_unpack_size(&pk) < 0) { // read key
 		cf_warning(AS_PARTICLE, "packed_map_op_get_value_by_idx() read key failed");
 		return false;
 	}
@@ -5262,7 +5453,7 @@ packed_map_strip_indexes(uint8_t *dest, const as_particle *p, bool remove_flags)
 		}
 
 		// Skip nil val.
-		if (as_unpack_size(&upk) < 0) {
+		if (cdt_unpack_size(&upk) < 0) {
 			return -3;
 		}
 
@@ -5349,7 +5540,7 @@ map_ele_find_init_from_idx(map_ele_find *find, const packed_map_op *op,
 			.length = op->packed_sz - op->ele_start
 	};
 
-	as_unpack_size(&pk);
+	cdt_unpack_size(&pk);
 	find->value_offset = pk.offset;
 	find->sz = offset_index_get_const(&op->pmi.offset_idx, idx + 1) -
 			find->key_offset;
@@ -5376,22 +5567,22 @@ offset_index_map_fill(offset_index *offidx, uint32_t index)
 	pk.offset = (int)offset_index_get_const(offidx, ele_filled - 1);
 
 	for (uint32_t i = ele_filled; i < index; i++) {
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			return false;
 		}
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			return false;
 		}
 
 		offset_index_set(offidx, i, (uint32_t)pk.offset);
 	}
 
-	if (as_unpack_size(&pk) < 0) {
+	if (cdt_unpack_size(&pk) < 0) {
 		return false;
 	}
 
-	if (as_unpack_size(&pk) < 0) {
+	if (cdt_unpack_size(&pk) < 0) {
 		return false;
 	}
 
@@ -6653,8 +6844,8 @@ cdt_process_state_packed_map_modify_optype(cdt_process_state *state,
 	}
 
 	rollback_alloc_inita(alloc_buf, cdt_udata->alloc_buf, 1, true);
-	// Results always on the heap.
-	rollback_alloc_inita(alloc_result, NULL, 1, false);
+	// Results on the heap unless the caller has an arena for them.
+	rollback_alloc_inita(alloc_result, cdt_udata->result_alloc_buf, 1, false);
 
 	cdt_result_data result_data = {
 			.result = result,
@@ -7556,6 +7747,255 @@ cdt_process_state_packed_map_read_optype(cdt_process_state *state,
 }
 
 
+//------------------------------------------------
+// map_lazy
+
+static bool
+map_lazy_destroy(as_map *map)
+{
+	map_lazy *lazy = (map_lazy *)map;
+
+	if (lazy->cache) {
+		as_val_destroy(lazy->cache);
+	}
+
+	if (lazy->decoded) {
+		as_val_destroy(lazy->decoded);
+	}
+
+	return true;
+}
+
+static uint32_t
+map_lazy_hashcode(const as_map *map)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_val_hashcode(decoded) : 0;
+}
+
+static uint32_t
+map_lazy_size(const as_map *map)
+{
+	const map_lazy *lazy = (const map_lazy *)map;
+
+	return lazy->decoded ? as_map_size(lazy->decoded) : lazy->ele_count;
+}
+
+static int
+map_lazy_set(as_map *map, const as_val *key, const as_val *val)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_map_set(decoded, key, val) : -1;
+}
+
+static as_val *
+map_lazy_get(const as_map *map, const as_val *key)
+{
+	map_lazy *lazy = (map_lazy *)map; // cache is mutable
+
+	if (lazy->decoded) {
+		return as_map_get(lazy->decoded, key);
+	}
+
+	as_val *val;
+
+	if (lazy->cache && (val = as_map_get((as_map *)lazy->cache, key))) {
+		return val;
+	}
+
+	as_serializer s;
+	as_msgpack_init(&s);
+
+	uint32_t key_sz = as_serializer_serialize_getsize(&s, (as_val *)key);
+	uint8_t *key_mem = key_sz < CDT_MAX_STACK_OBJ_SZ ?
+			alloca(key_sz) : cf_malloc(key_sz);
+
+	as_serializer_serialize_presized(&s, key, key_mem);
+
+	cdt_payload key_payload = {
+			.ptr = key_mem,
+			.sz = key_sz
+	};
+
+	packed_map_op op;
+	map_ele_find find;
+
+	packed_map_op_init(&op, lazy->data, lazy->sz, false);
+	map_ele_find_init(&find, &op);
+
+	bool success = packed_map_op_find_key(&op, &find, &key_payload, NULL);
+
+	if (key_sz >= CDT_MAX_STACK_OBJ_SZ) {
+		cf_free(key_mem);
+	}
+
+	if (! success) {
+		as_serializer_destroy(&s);
+		cf_warning(AS_PARTICLE, "map_lazy_get() invalid packed map");
+		return NULL;
+	}
+
+	if (! find.found_key) {
+		as_serializer_destroy(&s);
+		return NULL;
+	}
+
+	// Cache a key unpacked from our own copy - the caller's may not outlive
+	// the lookup.
+	const uint8_t *ele_ptr = op.packed + op.ele_start;
+
+	as_buffer key_buf = {
+			.capacity = find.value_offset - find.key_offset,
+			.size = find.value_offset - find.key_offset,
+			.data = (uint8_t *)ele_ptr + find.key_offset
+	};
+
+	as_buffer val_buf = {
+			.capacity = find.key_offset + find.sz - find.value_offset,
+			.size = find.key_offset + find.sz - find.value_offset,
+			.data = (uint8_t *)ele_ptr + find.value_offset
+	};
+
+	as_val *cache_key = NULL;
+
+	val = NULL;
+	as_serializer_deserialize(&s, &key_buf, &cache_key);
+	as_serializer_deserialize(&s, &val_buf, &val);
+	as_serializer_destroy(&s);
+
+	if (! cache_key || ! val) {
+		as_val_destroy(cache_key);
+		as_val_destroy(val);
+		cf_warning(AS_PARTICLE, "map_lazy_get() invalid packed element");
+		return NULL;
+	}
+
+	as_val_t type = as_val_type(val);
+
+	if (type == AS_LIST || type == AS_MAP) {
+		lazy->has_containers = true;
+	}
+
+	if (! lazy->cache) {
+		lazy->cache = as_hashmap_new(32);
+	}
+
+	as_map_set((as_map *)lazy->cache, cache_key, val);
+
+	return val;
+}
+
+static int
+map_lazy_remove(as_map *map, const as_val *key)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_map_remove(decoded, key) : -1;
+}
+
+static int
+map_lazy_clear(as_map *map)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_map_clear(decoded) : -1;
+}
+
+static bool
+map_lazy_foreach(const as_map *map, as_map_foreach_callback callback,
+		void *udata)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_map_foreach(decoded, callback, udata) : false;
+}
+
+static as_map_iterator *
+map_lazy_iterator_new(const as_map *map)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_map_iterator_new(decoded) : NULL;
+}
+
+static as_map_iterator *
+map_lazy_iterator_init(const as_map *map, as_map_iterator *it)
+{
+	as_map *decoded = map_lazy_materialize(map);
+
+	return decoded ? as_map_iterator_init(it, decoded) : NULL;
+}
+
+// Unpack the whole map - from here on, the lazy map just forwards to it.
+static as_map *
+map_lazy_materialize(const as_map *map)
+{
+	map_lazy *lazy = (map_lazy *)map; // decoded is mutable
+
+	if (lazy->decoded) {
+		return lazy->decoded;
+	}
+
+	as_buffer buf = {
+			.capacity = lazy->sz,
+			.size = lazy->sz,
+			.data = lazy->data
+	};
+
+	as_serializer s;
+	as_msgpack_init(&s);
+
+	as_val *val = NULL;
+
+	as_serializer_deserialize(&s, &buf, &val);
+	as_serializer_destroy(&s);
+
+	if (! val || as_val_type(val) != AS_MAP) {
+		as_val_destroy(val);
+		cf_warning(AS_PARTICLE, "map_lazy_materialize() invalid packed map");
+		return NULL;
+	}
+
+	lazy->decoded = (as_map *)val;
+	lazy->decoded->flags = lazy->map.flags;
+
+	if (lazy->cache) {
+		// Values already handed out may be held (and modified) by the caller -
+		// keep them in place of their freshly unpacked copies.
+		as_map_foreach((as_map *)lazy->cache, map_lazy_keep_cached,
+				lazy->decoded);
+		as_val_destroy(lazy->cache);
+		lazy->cache = NULL;
+	}
+
+	return lazy->decoded;
+}
+
+// Returns the lazy map if it can be used as-is, otherwise NULL.
+static inline const map_lazy *
+map_lazy_pristine(const as_val *val)
+{
+	const map_lazy *lazy = (const map_lazy *)val;
+
+	if (lazy->map.hooks != &map_lazy_hooks || lazy->decoded ||
+			lazy->has_containers) {
+		return NULL;
+	}
+
+	return lazy;
+}
+
+static bool
+map_lazy_keep_cached(const as_val *key, const as_val *val, void *udata)
+{
+	as_map_set((as_map *)udata, as_val_reserve(key), as_val_reserve(val));
+
+	return true;
+}
+
+
 //==========================================================
 // Debugging support.
 //
@@ -7666,14 +8106,14 @@ as_bin_verify(const as_bin *b)
 
 		offset = (uint32_t)pk.offset;
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "as_bin_verify() i=%u offset=%u pk.offset=%d invalid key", i, offset, pk.offset);
 			return false;
 		}
 
 		offset = (uint32_t)pk.offset;
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "as_bin_verify() i=%u offset=%u pk.offset=%d invalid value", i, offset, pk.offset);
 			return false;
 		}
@@ -7712,7 +8152,7 @@ as_bin_verify(const as_bin *b)
 
 			pk_key.offset = offset;
 
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				cf_warning(AS_PARTICLE, "as_bin_verify() i=%u offset=%u pk.offset=%d invalid value", i, offset, pk.offset);
 				return false;
 			}
@@ -7748,7 +8188,7 @@ as_bin_verify(const as_bin *b)
 
 		prev_value.offset = offset_index_get_const(offidx, index);
 
-		if (as_unpack_size(&prev_value) < 0) {
+		if (cdt_unpack_size(&prev_value) < 0) {
 			cf_warning(AS_PARTICLE, "as_bin_verify() index=%u pk.offset=%d invalid key", index, pk.offset);
 			return false;
 		}
@@ -7757,7 +8197,7 @@ as_bin_verify(const as_bin *b)
 			index = order_index_get(ordidx, i);
 			pk.offset = offset_index_get_const(offidx, index);
 
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				cf_warning(AS_PARTICLE, "as_bin_verify() i=%u index=%u pk.offset=%d invalid key", i, index, pk.offset);
 				return false;
 			}
@@ -169,6 +169,14 @@ uint32_t
 as_bin_particle_string_ptr(const as_bin *b, char **p_value)
 {
 	// Caller must ensure this is called only for STRING particles.
+	if (as_bin_is_short_string(b)) {
+		as_short_string *ss = (as_short_string *)&b->particle;
+
+		*p_value = (char *)ss->data;
+
+		return ss->sz;
+	}
+
 	string_mem *p_string_mem = (string_mem *)b->particle;
 
 	*p_value = (char *)p_string_mem->data;
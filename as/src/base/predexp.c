@@ -64,6 +64,7 @@ typedef predexp_retval_t (*predexp_eval_eval_fn)(predexp_eval_t* bp,
 
 #define PREDEXP_VALUE_NODE			0x01	// represents a value
 #define PREDEXP_IMMEDIATE_NODE		0x02	// constant per-query value
+#define PREDEXP_RECORD_NODE			0x04	// root only - some node needs bins
 
 struct predexp_eval_base_s {
 	predexp_eval_t*			next;
@@ -504,9 +505,14 @@ typedef struct predexp_eval_compare_s {
 	union {
 		predexp_eval_geojson_state_t	geojson;
 		predexp_eval_regex_state_t		regex;
+		int64_t							ival;	// immediate right child
 	} state;
 } predexp_eval_compare_t;
 
+// Regex subjects shorter than this are terminated on the stack rather than in
+// an allocation.
+#define REGEX_STACK_BUF_SZ 1024
+
 static void
 destroy_compare(predexp_eval_t* bp)
 {
@@ -609,9 +615,15 @@ eval_compare(predexp_eval_t* bp,
 						 dp->tag);
 			}
 		case AS_PREDEXP_STRING_REGEX: {
-			char* tmpstr = cf_strndup(lptr, llen);
+			char stackbuf[REGEX_STACK_BUF_SZ];
+			char* tmpstr = llen < sizeof(stackbuf) ?
+					stackbuf : cf_malloc(llen + 1);
+			memcpy(tmpstr, lptr, llen);
+			tmpstr[llen] = '\0';
 			int rv = regexec(&dp->state.regex.regex, tmpstr, 0, NULL, 0);
-			cf_free(tmpstr);
+			if (tmpstr != stackbuf) {
+				cf_free(tmpstr);
+			}
 			retval = rv == 0;
 			goto Cleanup;
 		}
@@ -653,6 +665,49 @@ eval_compare(predexp_eval_t* bp,
 	return retval;
 }
 
+// Integer comparison against an immediate value (by far the most common) -
+// the right child was evaluated once at build time.
+static predexp_retval_t
+eval_compare_integer_imm(predexp_eval_t* bp,
+						 predexp_args_t* argsp,
+						 wrapped_as_bin_t* wbinp)
+{
+	predexp_eval_compare_t* dp = (predexp_eval_compare_t *) bp;
+
+	wrapped_as_bin_t lwbin;
+	lwbin.must_free = false;
+
+	if ((*dp->lchild->eval_fn)(dp->lchild, argsp, &lwbin) ==
+		PREDEXP_NOVALUE) {
+		return argsp->rd ? PREDEXP_FALSE : PREDEXP_UNKNOWN;
+	}
+
+	if (lwbin.must_free) {
+		cf_crash(AS_PREDEXP, "eval_compare need bin cleanup, didn't before");
+	}
+
+	int64_t lval = as_bin_particle_integer_value(&lwbin.bin);
+	int64_t rval = dp->state.ival;
+
+	switch (dp->tag) {
+	case AS_PREDEXP_INTEGER_EQUAL:
+		return PREDEXP_RETVAL(lval == rval);
+	case AS_PREDEXP_INTEGER_UNEQUAL:
+		return PREDEXP_RETVAL(lval != rval);
+	case AS_PREDEXP_INTEGER_GREATER:
+		return PREDEXP_RETVAL(lval >  rval);
+	case AS_PREDEXP_INTEGER_GREATEREQ:
+		return PREDEXP_RETVAL(lval >= rval);
+	case AS_PREDEXP_INTEGER_LESS:
+		return PREDEXP_RETVAL(lval <  rval);
+	case AS_PREDEXP_INTEGER_LESSEQ:
+		return PREDEXP_RETVAL(lval <= rval);
+	default:
+		cf_crash(AS_PREDEXP, "eval_compare integer unknown tag %d", dp->tag);
+		return PREDEXP_FALSE;	// makes compiler happy
+	}
+}
+
 static bool
 build_compare(predexp_eval_t** stackpp,
 					  uint32_t len,
@@ -771,6 +826,28 @@ build_compare(predexp_eval_t** stackpp,
 	}
 
 	switch (tag) {
+	case AS_PREDEXP_INTEGER_EQUAL:
+	case AS_PREDEXP_INTEGER_UNEQUAL:
+	case AS_PREDEXP_INTEGER_GREATER:
+	case AS_PREDEXP_INTEGER_GREATEREQ:
+	case AS_PREDEXP_INTEGER_LESS:
+	case AS_PREDEXP_INTEGER_LESSEQ:
+		// If the right child is an immediate value, fetch it once now.
+		if ((dp->rchild->flags & PREDEXP_IMMEDIATE_NODE) != 0) {
+			predexp_args_t* argsp3 = NULL; // immediate values don't need args
+			wrapped_as_bin_t rwbin3;
+			rwbin3.must_free = false;
+			if ((*dp->rchild->eval_fn)(dp->rchild, argsp3, &rwbin3) ==
+				PREDEXP_VALUE) {
+				if (rwbin3.must_free) {
+					cf_crash(AS_PREDEXP,
+							 "predexp compare now needs bin destructor");
+				}
+				dp->state.ival = as_bin_particle_integer_value(&rwbin3.bin);
+				dp->base.eval_fn = eval_compare_integer_imm;
+			}
+		}
+		break;
 	case AS_PREDEXP_GEOJSON_WITHIN:
 	case AS_PREDEXP_GEOJSON_CONTAINS:
 		// The right child needs to be an immediate value.
@@ -1314,6 +1391,11 @@ eval_rec_device_size(predexp_eval_t* bp,
 	// predexp_eval_rec_device_size_t* dp =
 	//     (predexp_eval_rec_device_size_t *) bp;
 
+	// We require the index entry to operate.
+	if (! argsp->md) {
+		return PREDEXP_NOVALUE;
+	}
+
 	int64_t rec_device_size = argsp->md->n_rblocks * 128;
 
 	as_bin_state_set_from_type(&wbinp->bin, AS_PARTICLE_TYPE_INTEGER);
@@ -1382,6 +1464,11 @@ eval_rec_last_update(predexp_eval_t* bp,
 	// predexp_eval_rec_last_update_t* dp =
 	//     (predexp_eval_rec_last_update_t *) bp;
 
+	// We require the index entry to operate.
+	if (! argsp->md) {
+		return PREDEXP_NOVALUE;
+	}
+
 	int64_t rec_last_update_ns =
 		(int64_t) cf_utc_ns_from_clepoch_ms(argsp->md->last_update_time);
 
@@ -1449,6 +1536,11 @@ eval_rec_void_time(predexp_eval_t* bp,
 
 	// predexp_eval_rec_void_time_t* dp = (predexp_eval_rec_void_time_t *) bp;
 
+	// We require the index entry to operate.
+	if (! argsp->md) {
+		return PREDEXP_NOVALUE;
+	}
+
 	int64_t rec_void_time_ns =
 			(int64_t) cf_utc_ns_from_clepoch_sec(argsp->md->void_time);
 
@@ -1526,8 +1618,11 @@ eval_rec_digest_modulo(predexp_eval_t* bp,
 	predexp_eval_rec_digest_modulo_t* dp =
 		(predexp_eval_rec_digest_modulo_t *) bp;
 
+	// During the digest phase there's no index entry, just the digest.
+	const cf_digest* keyd = argsp->md ? &argsp->md->keyd : argsp->keyd;
+
 	// We point at the last 4 bytes of the digest.
-	uint32_t* valp = (uint32_t*) &argsp->md->keyd.digest[16];
+	uint32_t* valp = (uint32_t*) &keyd->digest[16];
 	int64_t digest_modulo = *valp % dp->mod;
 
 	as_bin_state_set_from_type(&wbinp->bin, AS_PARTICLE_TYPE_INTEGER);
@@ -2057,6 +2152,7 @@ predexp_eval_t*
 predexp_build(as_msg_field* pfp)
 {
 	predexp_eval_t* stackp = NULL;
+	bool needs_record = false;
 
 	cf_debug(AS_PREDEXP, "%p: predexp_build starting", &stackp);
 
@@ -2077,6 +2173,13 @@ predexp_build(as_msg_field* pfp)
 			goto FAILED;
 		}
 
+		// Bins, and variables (bound only by iterators over bins).
+		if ((tag >= AS_PREDEXP_INTEGER_BIN && tag <= AS_PREDEXP_GEOJSON_VAR) ||
+				(tag >= AS_PREDEXP_LIST_ITERATE_OR &&
+						tag <= AS_PREDEXP_MAPVAL_ITERATE_AND)) {
+			needs_record = true;
+		}
+
 		if (!build(&stackp, tag, len, pp)) {
 			// Warning should already have happened
 			goto FAILED;
@@ -2106,6 +2209,10 @@ predexp_build(as_msg_field* pfp)
 		goto FAILED;
 	}
 
+	if (needs_record) {
+		stackp->flags |= PREDEXP_RECORD_NODE;
+	}
+
 	cf_debug(AS_PREDEXP, "%p: predexp_build finished", &stackp);
 
 	// Return the root of the predicate expression tree.
@@ -2117,6 +2224,20 @@ predexp_build(as_msg_field* pfp)
 	return NULL;
 }
 
+bool
+predexp_matches_digest(predexp_eval_t* bp, as_namespace* ns,
+					   const cf_digest* keyd)
+{
+	if (! bp) {
+		return true;
+	}
+
+	predexp_args_t args = { .ns = ns, .md = NULL, .vl = NULL, .rd = NULL,
+							.keyd = keyd };
+
+	return ((*bp->eval_fn)(bp, &args, NULL) != PREDEXP_FALSE);
+}
+
 bool
 predexp_matches_metadata(predexp_eval_t* bp, predexp_args_t* argsp)
 {
@@ -2127,6 +2248,12 @@ predexp_matches_metadata(predexp_eval_t* bp, predexp_args_t* argsp)
 	return ((*bp->eval_fn)(bp, argsp, NULL) != PREDEXP_FALSE);
 }
 
+bool
+predexp_needs_record(predexp_eval_t* bp)
+{
+	return bp && (bp->flags & PREDEXP_RECORD_NODE) != 0;
+}
+
 bool
 predexp_matches_record(predexp_eval_t* bp, predexp_args_t* argsp)
 {
@@ -46,6 +46,7 @@
 #include "base/as_stap.h"
 #include "base/datamodel.h"
 #include "base/index.h"
+#include "base/packet_compression.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
 #include "storage/storage.h"
@@ -74,9 +75,13 @@ static cf_queue g_netio_slow_queue;
 // Forward declarations.
 //
 
+static size_t response_op_name_sz(as_msg_op **ops, as_bin **bins, uint16_t i, as_namespace *ns);
+static uint8_t *write_response_header(uint8_t *buf, size_t msg_sz, uint32_t result_code, uint32_t generation, uint32_t void_time, uint16_t bin_count, uint64_t trid);
+static as_msg_op *write_response_op_name(uint8_t *buf, as_msg_op **ops, as_bin **bins, uint16_t i, as_namespace *ns);
+static uint32_t in_place_value_sz(const as_bin *b, uint32_t n_iovs, const uint8_t **p_value);
 static int send_reply_buf(as_file_handle *fd_h, uint8_t *msgp, size_t msg_sz);
 void *run_netio(void *q_to_wait_on);
-int netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offset, bool blocking);
+int netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offset, bool blocking, bool compressed);
 
 
 //==========================================================
@@ -209,16 +214,7 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 	msg_sz += sizeof(as_msg_op) * bin_count;
 
 	for (uint16_t i = 0; i < bin_count; i++) {
-		if (ops) {
-			msg_sz += ops[i]->name_sz;
-		}
-		else if (bins[i]) {
-			msg_sz += ns->single_bin ?
-					0 : strlen(as_bin_get_name_from_id(ns, bins[i]->id));
-		}
-		else {
-			cf_crash(AS_PROTO, "making response message with null bin and op");
-		}
+		msg_sz += response_op_name_sz(ops, bins, i, ns);
 
 		if (bins[i]) {
 			msg_sz += as_bin_particle_client_value_size(bins[i]);
@@ -243,66 +239,109 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 
 	cl_msg *msgp = (cl_msg *)buf;
 
-	msgp->proto.version = PROTO_VERSION;
-	msgp->proto.type = PROTO_TYPE_AS_MSG;
-	msgp->proto.sz = msg_sz - sizeof(as_proto);
-	as_proto_swap(&msgp->proto);
+	buf = write_response_header(buf, msg_sz, result_code, generation, void_time,
+			bin_count, trid);
 
-	as_msg *m = &msgp->msg;
+	for (uint16_t i = 0; i < bin_count; i++) {
+		as_msg_op *op = write_response_op_name(buf, ops, bins, i, ns);
 
-	m->header_sz = sizeof(as_msg);
-	m->info1 = 0;
-	m->info2 = 0;
-	m->info3 = 0;
-	m->unused = 0;
-	m->result_code = result_code;
-	m->generation = generation;
-	m->record_ttl = void_time;
-	m->transaction_ttl = 0;
-	m->n_ops = bin_count;
-	m->n_fields = 0;
+		buf += sizeof(as_msg_op) + op->name_sz;
+		buf += as_bin_particle_to_client(bins[i], op);
 
-	buf += sizeof(cl_msg);
+		as_msg_swap_op(op);
+	}
 
-	if (trid != 0) {
-		m->n_fields++;
+	return msgp;
+}
 
-		as_msg_field *trfield = (as_msg_field *)buf;
 
-		trfield->field_sz = 1 + sizeof(uint64_t);
-		trfield->type = AS_MSG_FIELD_TYPE_TRID;
-		*(uint64_t *)trfield->data = cf_swap_to_be64(trid);
+// Like as_msg_make_response_msg(), but big string and blob values are not
+// copied - iovecs interleave them with runs of a header buffer. Caller must
+// keep the bins' particles valid until the reply is sent, then free reply->buf.
+// Returns false, allocating nothing, if no value is worth sending in place.
+bool
+as_msg_make_response_iov(as_msg_iov_reply *reply, uint32_t result_code,
+		uint32_t generation, uint32_t void_time, as_msg_op **ops, as_bin **bins,
+		uint16_t bin_count, as_namespace *ns, uint64_t trid)
+{
+	size_t msg_sz = sizeof(cl_msg);
+	size_t in_place_sz = 0;
+	uint32_t n_iovs = 1;
 
-		buf += sizeof(as_msg_field) + sizeof(uint64_t);
-		as_msg_swap_field(trfield);
+	msg_sz += sizeof(as_msg_op) * bin_count;
+
+	for (uint16_t i = 0; i < bin_count; i++) {
+		msg_sz += response_op_name_sz(ops, bins, i, ns);
+
+		if (bins[i]) {
+			const uint8_t *value;
+			uint32_t value_sz = in_place_value_sz(bins[i], n_iovs, &value);
+
+			if (value_sz != 0) {
+				in_place_sz += value_sz;
+				n_iovs += 2;
+			}
+
+			msg_sz += as_bin_particle_client_value_size(bins[i]);
+		}
 	}
 
-	as_msg_swap_header(m);
+	if (in_place_sz == 0) {
+		return false;
+	}
+
+	if (trid != 0) {
+		msg_sz += sizeof(as_msg_field) + sizeof(trid);
+	}
+
+	uint8_t *buf = cf_malloc(msg_sz - in_place_sz);
+
+	cf_assert(buf, AS_PROTO, "alloc failed");
+
+	reply->buf = buf;
+
+	struct iovec *iov = reply->iovs;
+
+	iov->iov_base = buf;
+	n_iovs = 1;
+
+	buf = write_response_header(buf, msg_sz, result_code, generation, void_time,
+			bin_count, trid);
 
 	for (uint16_t i = 0; i < bin_count; i++) {
-		as_msg_op *op = (as_msg_op *)buf;
+		as_msg_op *op = write_response_op_name(buf, ops, bins, i, ns);
 
-		op->version = 0;
+		buf += sizeof(as_msg_op) + op->name_sz;
 
-		if (ops) {
-			op->op = ops[i]->op;
-			memcpy(op->name, ops[i]->name, ops[i]->name_sz);
-			op->name_sz = ops[i]->name_sz;
+		const uint8_t *value;
+		uint32_t value_sz = bins[i] ?
+				in_place_value_sz(bins[i], n_iovs, &value) : 0;
+
+		if (value_sz != 0) {
+			op->particle_type = as_bin_get_particle_type(bins[i]);
+			op->op_sz += value_sz;
+
+			iov->iov_len = buf - (uint8_t *)iov->iov_base;
+			iov++;
+			iov->iov_base = (void *)value;
+			iov->iov_len = value_sz;
+			iov++;
+			iov->iov_base = buf;
+			n_iovs += 2;
 		}
 		else {
-			op->op = AS_MSG_OP_READ;
-			op->name_sz = as_bin_memcpy_name(ns, op->name, bins[i]);
+			buf += as_bin_particle_to_client(bins[i], op);
 		}
 
-		op->op_sz = 4 + op->name_sz;
-
-		buf += sizeof(as_msg_op) + op->name_sz;
-		buf += as_bin_particle_to_client(bins[i], op);
-
 		as_msg_swap_op(op);
 	}
 
-	return msgp;
+	iov->iov_len = buf - (uint8_t *)iov->iov_base;
+
+	// The last run is empty if the last op's value was sent in place.
+	reply->n_iovs = iov->iov_len == 0 ? n_iovs - 1 : n_iovs;
+
+	return true;
 }
 
 
@@ -324,8 +363,9 @@ as_msg_make_response_bufbuilder(cf_buf_builder **bb_r, as_storage_rd *rd,
 	uint8_t* key = NULL;
 	uint32_t key_size = 0;
 
+	// Note - the key may already be in rd, e.g. from a sindex covering copy.
 	if (include_key && r->key_stored == 1) {
-		if (! as_storage_record_get_key(rd)) {
+		if (! rd->key && ! as_storage_record_get_key(rd)) {
 			cf_warning(AS_PROTO, "can't get key - skipping record");
 			return -1;
 		}
@@ -648,6 +688,50 @@ as_msg_make_val_response_bufbuilder(const as_val *val, cf_buf_builder **bb_r,
 }
 
 
+// Tells a partition-targeted scan how far a partition got - the pid goes in
+// the generation. With no resume digest, the partition is done.
+void
+as_msg_make_pid_status_bufbuilder(cf_buf_builder **bb_r, uint32_t pid,
+		const cf_digest *resume_keyd, uint32_t result_code)
+{
+	size_t msg_sz = sizeof(as_msg);
+
+	if (resume_keyd) {
+		msg_sz += sizeof(as_msg_field) + sizeof(cf_digest);
+	}
+
+	uint8_t *buf;
+
+	cf_buf_builder_reserve(bb_r, (int)msg_sz, &buf);
+
+	as_msg *msgp = (as_msg *)buf;
+
+	msgp->header_sz = sizeof(as_msg);
+	msgp->info1 = 0;
+	msgp->info2 = 0;
+	msgp->info3 = resume_keyd ?
+			AS_MSG_INFO3_SCAN_RESUME : AS_MSG_INFO3_PARTITION_DONE;
+	msgp->unused = 0;
+	msgp->result_code = result_code;
+	msgp->generation = pid;
+	msgp->record_ttl = 0;
+	msgp->transaction_ttl = 0;
+	msgp->n_fields = resume_keyd ? 1 : 0;
+	msgp->n_ops = 0;
+
+	as_msg_swap_header(msgp);
+
+	if (resume_keyd) {
+		as_msg_field *mf = (as_msg_field *)(buf + sizeof(as_msg));
+
+		mf->field_sz = sizeof(cf_digest) + 1;
+		mf->type = AS_MSG_FIELD_TYPE_DIGEST_RIPE;
+		memcpy(mf->data, resume_keyd, sizeof(cf_digest));
+		as_msg_swap_field(mf);
+	}
+}
+
+
 //==========================================================
 // Public API - sending responses to client.
 //
@@ -682,6 +766,34 @@ as_msg_send_ops_reply(as_file_handle *fd_h, cf_dyn_buf *db)
 }
 
 
+// Send a response made by as_msg_make_response_iov(), and free its buffer.
+int
+as_msg_send_iov_reply(as_file_handle *fd_h, as_msg_iov_reply *reply)
+{
+	cf_assert(cf_socket_exists(&fd_h->sock), AS_PROTO, "fd is invalid");
+
+	int rv = 0;
+
+	if (cf_socket_send_iov_all(&fd_h->sock, reply->iovs, reply->n_iovs,
+			MSG_NOSIGNAL, CF_SOCKET_TIMEOUT) < 0) {
+		// Common when a client aborts.
+		cf_debug(AS_PROTO, "protocol write fail: fd %d iovs %u errno %d",
+				CSFD(&fd_h->sock), reply->n_iovs, errno);
+
+		as_end_of_transaction_force_close(fd_h);
+		rv = -1;
+	}
+	else {
+		as_end_of_transaction_ok(fd_h);
+	}
+
+	cf_free(reply->buf);
+	reply->buf = NULL;
+
+	return rv;
+}
+
+
 // Send a blocking "fin" message with default timeout.
 bool
 as_msg_send_fin(cf_socket *sock, uint32_t result_code)
@@ -780,6 +892,36 @@ as_netio_init()
 // to qtr. In case of AS_NETIO_CONTINUE: this function also consumes bb_r and
 // ref for fd_h. The background thread is responsible for freeing up bb_r and
 // releasing ref to fd_h.
+// Compress bb_r in place, if the client negotiated it. Call before the first
+// as_netio_send().
+void
+as_netio_compress(as_netio *io, as_namespace *ns)
+{
+	cf_buf_builder *bb_r = io->bb_r;
+	as_proto *proto = (as_proto *)bb_r->buf;
+
+	proto->version = PROTO_VERSION;
+	proto->type = PROTO_TYPE_AS_MSG;
+	proto->sz = bb_r->used_sz - sizeof(as_proto);
+	as_proto_swap(proto);
+
+	size_t compressed_sz;
+	uint8_t *compressed = as_packet_compress_response(io->fd_h, ns, bb_r->buf,
+			bb_r->used_sz, &compressed_sz);
+
+	if (! compressed) {
+		return;
+	}
+
+	// Always smaller than the original - fits in bb_r.
+	memcpy(bb_r->buf, compressed, compressed_sz);
+	bb_r->used_sz = (uint32_t)compressed_sz;
+	io->compressed = true;
+
+	cf_free(compressed);
+}
+
+
 int
 as_netio_send(as_netio *io, bool slow, bool blocking)
 {
@@ -787,7 +929,7 @@ as_netio_send(as_netio *io, bool slow, bool blocking)
 
 	if (ret == AS_NETIO_OK) {
 		ret = io->finish_cb(io, netio_send_packet(io->fd_h, io->bb_r,
-				&io->offset, blocking));
+				&io->offset, blocking, io->compressed));
 	} 
 	else {
 		ret = io->finish_cb(io, ret);
@@ -817,6 +959,111 @@ as_netio_send(as_netio *io, bool slow, bool blocking)
 // Local helpers.
 //
 
+static size_t
+response_op_name_sz(as_msg_op **ops, as_bin **bins, uint16_t i,
+		as_namespace *ns)
+{
+	if (ops) {
+		return ops[i]->name_sz;
+	}
+
+	if (bins[i]) {
+		return ns->single_bin ?
+				0 : strlen(as_bin_get_name_from_id(ns, bins[i]->id));
+	}
+
+	cf_crash(AS_PROTO, "making response message with null bin and op");
+	return 0;
+}
+
+
+// Returns pointer past the header (and fields).
+static uint8_t *
+write_response_header(uint8_t *buf, size_t msg_sz, uint32_t result_code,
+		uint32_t generation, uint32_t void_time, uint16_t bin_count,
+		uint64_t trid)
+{
+	cl_msg *msgp = (cl_msg *)buf;
+
+	msgp->proto.version = PROTO_VERSION;
+	msgp->proto.type = PROTO_TYPE_AS_MSG;
+	msgp->proto.sz = msg_sz - sizeof(as_proto);
+	as_proto_swap(&msgp->proto);
+
+	as_msg *m = &msgp->msg;
+
+	m->header_sz = sizeof(as_msg);
+	m->info1 = 0;
+	m->info2 = 0;
+	m->info3 = 0;
+	m->unused = 0;
+	m->result_code = result_code;
+	m->generation = generation;
+	m->record_ttl = void_time;
+	m->transaction_ttl = 0;
+	m->n_ops = bin_count;
+	m->n_fields = 0;
+
+	buf += sizeof(cl_msg);
+
+	if (trid != 0) {
+		m->n_fields++;
+
+		as_msg_field *trfield = (as_msg_field *)buf;
+
+		trfield->field_sz = 1 + sizeof(uint64_t);
+		trfield->type = AS_MSG_FIELD_TYPE_TRID;
+		*(uint64_t *)trfield->data = cf_swap_to_be64(trid);
+
+		buf += sizeof(as_msg_field) + sizeof(uint64_t);
+		as_msg_swap_field(trfield);
+	}
+
+	as_msg_swap_header(m);
+
+	return buf;
+}
+
+
+// Writes everything but the value - op_sz doesn't yet include it.
+static as_msg_op *
+write_response_op_name(uint8_t *buf, as_msg_op **ops, as_bin **bins,
+		uint16_t i, as_namespace *ns)
+{
+	as_msg_op *op = (as_msg_op *)buf;
+
+	op->version = 0;
+
+	if (ops) {
+		op->op = ops[i]->op;
+		memcpy(op->name, ops[i]->name, ops[i]->name_sz);
+		op->name_sz = ops[i]->name_sz;
+	}
+	else {
+		op->op = AS_MSG_OP_READ;
+		op->name_sz = as_bin_memcpy_name(ns, op->name, bins[i]);
+	}
+
+	op->op_sz = 4 + op->name_sz;
+
+	return op;
+}
+
+
+// Returns value size if it's big enough to send in place and there are iovecs
+// left for it and the run after it, otherwise 0.
+static uint32_t
+in_place_value_sz(const as_bin *b, uint32_t n_iovs, const uint8_t **p_value)
+{
+	if (n_iovs + 2 > AS_MSG_MAX_IOVS ||
+			as_bin_particle_client_value_size(b) < AS_MSG_IN_PLACE_MIN_SZ) {
+		return 0;
+	}
+
+	return as_bin_particle_client_value_ptr(b, p_value);
+}
+
+
 static int
 send_reply_buf(as_file_handle *fd_h, uint8_t *msgp, size_t msg_sz)
 {
@@ -862,7 +1109,7 @@ run_netio(void *q_to_wait_on)
 
 int
 netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offset,
-		bool blocking)
+		bool blocking, bool compressed)
 {
 #if defined(USE_SYSTEMTAP)
 	uint64_t nodeid = g_config.self_node;
@@ -871,13 +1118,15 @@ netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offset,
 	uint32_t len = bb_r->used_sz;
 	uint8_t *buf = bb_r->buf;
 
-	as_proto proto;
-	proto.version = PROTO_VERSION;
-	proto.type = PROTO_TYPE_AS_MSG;
-	proto.sz = len - 8;
-	as_proto_swap(&proto);
+	if (! compressed) {
+		as_proto proto;
+		proto.version = PROTO_VERSION;
+		proto.type = PROTO_TYPE_AS_MSG;
+		proto.sz = len - 8;
+		as_proto_swap(&proto);
 
-	memcpy(bb_r->buf, &proto, 8);
+		memcpy(bb_r->buf, &proto, 8);
+	}
 
 	uint32_t pos = *offset;
 
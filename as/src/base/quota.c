@@ -0,0 +1,210 @@
+/*
+ * quota.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+//==========================================================
+// Includes.
+//
+
+#include "base/quota.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_clock.h"
+
+#include "fault.h"
+#include "vmapx.h"
+
+#include "base/datamodel.h"
+#include "base/proto.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// An idle bucket refills to (at most) one second's worth of tokens.
+#define MAX_REFILL_MS 1000
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static as_set* admit_set(as_namespace* ns, const as_transaction* tr);
+static bool bucket_take(as_quota_bucket* b, uint64_t now, uint64_t cost);
+static void bucket_refund(as_quota_bucket* b, uint64_t cost);
+static bool quota_take(as_quota* q, uint64_t now, uint64_t n_bytes);
+static void quota_refund(as_quota* q, uint64_t n_bytes);
+
+
+//==========================================================
+// Public API.
+//
+
+// Triggered via configuration - a changed rate starts with a full bucket.
+void
+as_quota_set_rate(as_quota_bucket* b, uint64_t rate)
+{
+	__atomic_store_n(&b->milli_tokens, (int64_t)(rate * 1000),
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&b->last_ms, cf_getms(), __ATOMIC_RELAXED);
+	__atomic_store_n(&b->rate, rate, __ATOMIC_RELEASE);
+}
+
+// Charges the transaction against its set's quota, then its namespace's. On
+// rejection, nothing stays charged and the rejecting quota counts it.
+bool
+as_quota_admit(as_namespace* ns, const as_transaction* tr)
+{
+	uint64_t now = cf_getms();
+	uint64_t n_bytes = (uint64_t)tr->msgp->proto.sz;
+	as_set* p_set = admit_set(ns, tr);
+
+	if (p_set && ! quota_take(&p_set->quota, now, n_bytes)) {
+		return false;
+	}
+
+	if (! quota_take(&ns->quota, now, n_bytes)) {
+		if (p_set) {
+			quota_refund(&p_set->quota, n_bytes);
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Only returns sets that have a quota.
+static as_set*
+admit_set(as_namespace* ns, const as_transaction* tr)
+{
+	if (! as_transaction_has_set(tr)) {
+		return NULL;
+	}
+
+	as_msg_field* sf = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET);
+	uint32_t set_sz = as_msg_field_get_value_sz(sf);
+	uint32_t idx;
+
+	if (set_sz == 0 || cf_vmapx_get_index_w_len(ns->p_sets_vmap,
+			(const char*)sf->data, set_sz, &idx) != CF_VMAPX_OK) {
+		return NULL;
+	}
+
+	as_set* p_set;
+
+	if (cf_vmapx_get_by_index(ns->p_sets_vmap, idx, (void**)&p_set) !=
+			CF_VMAPX_OK) {
+		// Should be impossible - just verified idx.
+		cf_crash(AS_TSVC, "unexpected vmap error");
+	}
+
+	as_quota* q = &p_set->quota;
+
+	return as_quota_get_rate(&q->ops) == 0 &&
+			as_quota_get_rate(&q->bytes) == 0 ? NULL : p_set;
+}
+
+// Lock-free - whichever thread advances last_ms adds the elapsed refill. The
+// one second cap is applied loosely, good enough for admission control.
+static bool
+bucket_take(as_quota_bucket* b, uint64_t now, uint64_t cost)
+{
+	uint64_t rate = __atomic_load_n(&b->rate, __ATOMIC_ACQUIRE);
+
+	if (rate == 0) {
+		return true;
+	}
+
+	uint64_t last_ms = __atomic_load_n(&b->last_ms, __ATOMIC_RELAXED);
+
+	if (now > last_ms && __atomic_compare_exchange_n(&b->last_ms, &last_ms,
+			now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		uint64_t elapsed_ms = now - last_ms;
+
+		if (elapsed_ms > MAX_REFILL_MS) {
+			elapsed_ms = MAX_REFILL_MS;
+		}
+
+		int64_t max_tokens = (int64_t)(rate * 1000);
+		int64_t tokens = __atomic_add_fetch(&b->milli_tokens,
+				(int64_t)(elapsed_ms * rate), __ATOMIC_RELAXED);
+
+		if (tokens > max_tokens) {
+			__atomic_sub_fetch(&b->milli_tokens, tokens - max_tokens,
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	int64_t milli_cost = (int64_t)(cost * 1000);
+
+	if (__atomic_sub_fetch(&b->milli_tokens, milli_cost, __ATOMIC_RELAXED) <
+			0) {
+		__atomic_add_fetch(&b->milli_tokens, milli_cost, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+bucket_refund(as_quota_bucket* b, uint64_t cost)
+{
+	if (__atomic_load_n(&b->rate, __ATOMIC_RELAXED) != 0) {
+		__atomic_add_fetch(&b->milli_tokens, (int64_t)(cost * 1000),
+				__ATOMIC_RELAXED);
+	}
+}
+
+static bool
+quota_take(as_quota* q, uint64_t now, uint64_t n_bytes)
+{
+	if (! bucket_take(&q->ops, now, 1)) {
+		__atomic_add_fetch(&q->n_rejected, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	if (! bucket_take(&q->bytes, now, n_bytes)) {
+		bucket_refund(&q->ops, 1);
+		__atomic_add_fetch(&q->n_rejected, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+quota_refund(as_quota* q, uint64_t n_bytes)
+{
+	bucket_refund(&q->ops, 1);
+	bucket_refund(&q->bytes, n_bytes);
+}
@@ -233,6 +233,12 @@ as_record_destroy(as_record *r, as_namespace *ns)
 
 	as_record_drop_stats(r, ns);
 
+	// Entries may be left behind (e.g. data-not-in-memory deletes) - tell
+	// sindex gc it has work.
+	if (record_has_sindex(r, ns)) {
+		cf_atomic64_incr(&ns->n_sindex_gc_pending);
+	}
+
 	// Dereference record's storage used-size.
 	as_storage_record_destroy(ns, r);
 
@@ -413,6 +419,8 @@ as_record_replace_if_better(as_remote_record *rr,
 			return -result;
 		}
 
+		as_index_set_list_add(tree, &r_ref);
+
 		r->last_update_time = rr->last_update_time;
 
 		// Don't write record if it would be truncated.
@@ -665,7 +673,10 @@ record_apply_dim(as_remote_record *rr, as_storage_rd *rd, bool skip_sindex,
 	// Fill out new_bin_space.
 	as_bin_space* new_bin_space = NULL;
 
-	if (n_new_bins != 0) {
+	if (n_new_bins != 0 && ns->contiguous_records) {
+		new_bin_space = as_bin_space_pack(new_bins, n_new_bins);
+	}
+	else if (n_new_bins != 0) {
 		new_bin_space = (as_bin_space*)
 				cf_malloc_ns(sizeof(as_bin_space) + sizeof(new_bins));
 
@@ -36,19 +36,24 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "aerospike/as_hashmap.h"
 #include "aerospike/as_list.h"
 #include "aerospike/as_module.h"
 #include "aerospike/as_string.h"
+#include "aerospike/as_stringmap.h"
 #include "aerospike/as_val.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
+#include "citrusleaf/cf_hash_math.h"
 #include "citrusleaf/cf_ll.h"
 #include "citrusleaf/cf_vector.h"
 
 #include "dynbuf.h"
 #include "fault.h"
+#include "hll.h"
+#include "olock.h"
 #include "socket.h"
 
 #include "base/aggr.h"
@@ -57,14 +62,19 @@
 #include "base/index.h"
 #include "base/job_manager.h"
 #include "base/monitor.h"
+#include "base/packet_compression.h"
 #include "base/predexp.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
 #include "base/udf_memtracker.h"
+#include "base/xdr_serverside.h"
 #include "fabric/exchange.h"
 #include "fabric/partition.h"
+#include "storage/storage.h"
+#include "transaction/replica_write.h"
+#include "transaction/rw_utils.h"
 #include "transaction/udf.h"
 
 
@@ -81,6 +91,9 @@ typedef enum {
 	SCAN_TYPE_BASIC		= 0,
 	SCAN_TYPE_AGGR		= 1,
 	SCAN_TYPE_UDF_BG	= 2,
+	SCAN_TYPE_VERIFY	= 3, // started by info command, not client
+	SCAN_TYPE_COUNT		= 4,
+	SCAN_TYPE_DELETE	= 5,
 
 	SCAN_TYPE_UNKNOWN	= -1
 } scan_type;
@@ -95,6 +108,12 @@ scan_type_str(scan_type type)
 		return "aggregation";
 	case SCAN_TYPE_UDF_BG:
 		return "background-udf";
+	case SCAN_TYPE_VERIFY:
+		return "storage-verify";
+	case SCAN_TYPE_COUNT:
+		return "count";
+	case SCAN_TYPE_DELETE:
+		return "delete";
 	default:
 		return "?";
 	}
@@ -108,6 +127,11 @@ int basic_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id);
 int aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id);
 int udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns,
 		uint16_t set_id);
+int verify_scan_job_start(as_namespace* ns, uint16_t set_id, uint32_t rps,
+		uint64_t* p_trid);
+int count_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id);
+int delete_scan_job_start(as_transaction* tr, as_namespace* ns,
+		uint16_t set_id);
 
 //----------------------------------------------------------
 // Non-class-specific utilities.
@@ -116,16 +140,32 @@ int udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns,
 typedef struct scan_options_s {
 	int			priority;
 	bool		fail_on_cluster_change;
+	bool		storage_order;
+	bool		shared;
 	uint32_t	sample_pct;
+	uint64_t	sample_count; // 0 unless sampling by count
 } scan_options;
 
+// A partition, or a digest range within one, of a partition-targeted scan.
+typedef struct scan_partition_s {
+	uint32_t	pid;
+	bool		has_high;
+	bool		has_low;
+	cf_digest	high; // resume below this
+	cf_digest	low; // stop after this
+} scan_partition;
+
 int get_scan_set_id(as_transaction* tr, as_namespace* ns, uint16_t* p_set_id);
 scan_type get_scan_type(as_transaction* tr);
 bool get_scan_options(as_transaction* tr, scan_options* options);
 bool get_scan_socket_timeout(as_transaction* tr, uint32_t* timeout);
 bool get_scan_predexp(as_transaction* tr, predexp_eval_t** p_predexp);
-size_t send_blocking_response_chunk(cf_socket* sock, uint8_t* buf, size_t size, int32_t timeout);
+bool get_scan_partitions(as_transaction* tr, scan_partition** p_partitions, uint32_t* p_n_partitions);
 static inline bool excluded_set(as_index* r, uint16_t set_id);
+static inline void scan_reduce(as_index_tree* tree, uint16_t set_id, as_index_reduce_fn cb, void* udata);
+static inline uint64_t scan_sample_size(as_index_tree* tree, uint32_t sample_pct, uint64_t sample_count);
+
+extern void as_nsup_queue_delete(as_namespace* ns, cf_digest* p_digest);
 
 
 
@@ -136,6 +176,12 @@ static inline bool excluded_set(as_index* r, uint16_t set_id);
 const size_t INIT_BUF_BUILDER_SIZE = 1024 * 1024 * 2;
 const size_t SCAN_CHUNK_LIMIT = 1024 * 1024;
 
+// Chunks queued for the network beyond which a job stops taking new slices,
+// and beyond which a running slice waits.
+const uint32_t SCAN_MAX_OUTSTANDING_CHUNKS = 2;
+const uint32_t SCAN_MAX_QUEUED_CHUNKS = 8;
+const useconds_t SCAN_QUEUED_CHUNKS_WAIT_US = 1000;
+
 
 
 //==============================================================================
@@ -177,6 +223,12 @@ as_scan(as_transaction* tr, as_namespace* ns)
 	case SCAN_TYPE_UDF_BG:
 		result = udf_bg_scan_job_start(tr, ns, set_id);
 		break;
+	case SCAN_TYPE_COUNT:
+		result = count_scan_job_start(tr, ns, set_id);
+		break;
+	case SCAN_TYPE_DELETE:
+		result = delete_scan_job_start(tr, ns, set_id);
+		break;
 	default:
 		cf_warning(AS_SCAN, "can't identify scan type");
 		result = AS_PROTO_RESULT_FAIL_PARAMETER;
@@ -186,6 +238,28 @@ as_scan(as_transaction* tr, as_namespace* ns)
 	return result;
 }
 
+int
+as_scan_verify(as_namespace* ns, const char* set_name, uint32_t rps,
+		uint64_t* p_trid)
+{
+	if (ns->storage_type != AS_STORAGE_ENGINE_SSD) {
+		cf_warning(AS_SCAN, "{%s} storage-verify scan needs device storage",
+				ns->name);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	uint16_t set_id = INVALID_SET_ID;
+
+	if (set_name && (set_id = as_namespace_get_set_id(ns, set_name)) ==
+			INVALID_SET_ID) {
+		cf_warning(AS_SCAN, "{%s} storage-verify scan has unrecognized set %s",
+				ns->name, set_name);
+		return AS_PROTO_RESULT_FAIL_NOT_FOUND;
+	}
+
+	return verify_scan_job_start(ns, set_id, rps, p_trid);
+}
+
 void
 as_scan_limit_active_jobs(uint32_t max_active)
 {
@@ -248,6 +322,12 @@ as_scan_change_job_priority(uint64_t trid, uint32_t priority)
 			(int)priority) ? 0 : -1;
 }
 
+int
+as_scan_change_job_rps(uint64_t trid, uint32_t rps)
+{
+	return as_job_manager_change_job_rps(&g_scan_manager, trid, rps) ? 0 : -1;
+}
+
 
 //==============================================================================
 // Non-class-specific utilities.
@@ -258,7 +338,7 @@ get_scan_set_id(as_transaction* tr, as_namespace* ns, uint16_t* p_set_id)
 {
 	uint16_t set_id = INVALID_SET_ID;
 	as_msg_field* f = as_transaction_has_set(tr) ?
-			as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_SET) : NULL;
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET) : NULL;
 
 	if (f && as_msg_field_get_value_sz(f) != 0) {
 		uint32_t set_name_len = as_msg_field_get_value_sz(f);
@@ -284,10 +364,20 @@ scan_type
 get_scan_type(as_transaction* tr)
 {
 	if (! as_transaction_is_udf(tr)) {
-		return SCAN_TYPE_BASIC;
+		if (as_transaction_is_delete(tr)) {
+			return as_transaction_has_scan_count(tr) ?
+					SCAN_TYPE_UNKNOWN : SCAN_TYPE_DELETE;
+		}
+
+		return as_transaction_has_scan_count(tr) ?
+				SCAN_TYPE_COUNT : SCAN_TYPE_BASIC;
+	}
+
+	if (as_transaction_has_scan_count(tr)) {
+		return SCAN_TYPE_UNKNOWN;
 	}
 
-	as_msg_field* udf_op_f = as_msg_field_get(&tr->msgp->msg,
+	as_msg_field* udf_op_f = as_transaction_field_get(tr,
 			AS_MSG_FIELD_TYPE_UDF_OP);
 
 	if (udf_op_f && *udf_op_f->data == (uint8_t)AS_UDF_OP_AGGREGATE) {
@@ -304,11 +394,23 @@ get_scan_type(as_transaction* tr)
 bool
 get_scan_options(as_transaction* tr, scan_options* options)
 {
+	if (as_transaction_has_scan_sample_count(tr)) {
+		as_msg_field* f = as_transaction_field_get(tr,
+				AS_MSG_FIELD_TYPE_SCAN_SAMPLE_COUNT);
+
+		if (as_msg_field_get_value_sz(f) != 8) {
+			cf_warning(AS_SCAN, "scan msg sample count field size not 8");
+			return false;
+		}
+
+		options->sample_count = cf_swap_from_be64(*(uint64_t*)f->data);
+	}
+
 	if (! as_transaction_has_scan_options(tr)) {
 		return true;
 	}
 
-	as_msg_field* f = as_msg_field_get(&tr->msgp->msg,
+	as_msg_field* f = as_transaction_field_get(tr,
 			AS_MSG_FIELD_TYPE_SCAN_OPTIONS);
 
 	if (as_msg_field_get_value_sz(f) != 2) {
@@ -319,6 +421,9 @@ get_scan_options(as_transaction* tr, scan_options* options)
 	options->priority = AS_MSG_FIELD_SCAN_PRIORITY(f->data[0]);
 	options->fail_on_cluster_change =
 			(AS_MSG_FIELD_SCAN_FAIL_ON_CLUSTER_CHANGE & f->data[0]) != 0;
+	options->storage_order =
+			(AS_MSG_FIELD_SCAN_STORAGE_ORDER & f->data[0]) != 0;
+	options->shared = (AS_MSG_FIELD_SCAN_SHARED & f->data[0]) != 0;
 	options->sample_pct = f->data[1];
 
 	return true;
@@ -331,7 +436,7 @@ get_scan_socket_timeout(as_transaction* tr, uint32_t* timeout)
 		return true;
 	}
 
-	as_msg_field* f = as_msg_field_get(&tr->msgp->msg,
+	as_msg_field* f = as_transaction_field_get(tr,
 			AS_MSG_FIELD_TYPE_SOCKET_TIMEOUT);
 
 	if (as_msg_field_get_value_sz(f) != 4) {
@@ -351,39 +456,90 @@ get_scan_predexp(as_transaction* tr, predexp_eval_t** p_predexp)
 		return true;
 	}
 
-	as_msg_field* f = as_msg_field_get(&tr->msgp->msg,
-			AS_MSG_FIELD_TYPE_PREDEXP);
+	as_msg_field* f = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_PREDEXP);
 
 	*p_predexp = predexp_build(f);
 
 	return *p_predexp != NULL;
 }
 
-size_t
-send_blocking_response_chunk(cf_socket* sock, uint8_t* buf, size_t size,
-		int32_t timeout)
+// Parse the list of partitions to scan, if any - returns false if it's bad.
+bool
+get_scan_partitions(as_transaction* tr, scan_partition** p_partitions,
+		uint32_t* p_n_partitions)
 {
-	as_proto proto;
+	*p_partitions = NULL;
+	*p_n_partitions = 0;
 
-	proto.version = PROTO_VERSION;
-	proto.type = PROTO_TYPE_AS_MSG;
-	proto.sz = size;
-	as_proto_swap(&proto);
+	if (! as_transaction_has_scan_partitions(tr)) {
+		return true;
+	}
+
+	as_msg_field* f = as_transaction_field_get(tr,
+			AS_MSG_FIELD_TYPE_SCAN_PARTITIONS);
+	uint32_t size = as_msg_field_get_value_sz(f);
+	const uint8_t* data = f->data;
+	const uint8_t* end = data + size;
+
+	// Every entry is at least 3 bytes.
+	scan_partition* partitions = size < 3 ?
+			NULL : cf_malloc(sizeof(scan_partition) * (size / 3));
 
-	if (cf_socket_send_all(sock, (uint8_t*)&proto, sizeof(as_proto),
-			MSG_NOSIGNAL | MSG_MORE, timeout) < 0) {
-		cf_warning(AS_SCAN, "send error - fd %d %s", CSFD(sock),
-				cf_strerror(errno));
-		return 0;
+	if (! partitions) {
+		cf_warning(AS_SCAN, "scan msg partitions field empty or failed alloc");
+		return false;
 	}
 
-	if (cf_socket_send_all(sock, buf, size, MSG_NOSIGNAL, timeout) < 0) {
-		cf_warning(AS_SCAN, "send error - fd %d sz %lu %s", CSFD(sock),
-				size, cf_strerror(errno));
-		return 0;
+	uint32_t n_partitions = 0;
+
+	while (data < end) {
+		if (data + 3 > end) {
+			cf_warning(AS_SCAN, "scan msg partitions field truncated");
+			cf_free(partitions);
+			return false;
+		}
+
+		scan_partition* sp = &partitions[n_partitions++];
+
+		sp->pid = cf_swap_from_be16(*(uint16_t*)data);
+
+		uint8_t flags = data[2];
+
+		data += 3;
+
+		sp->has_high = (flags & AS_MSG_SCAN_PARTITION_HIGH) != 0;
+		sp->has_low = (flags & AS_MSG_SCAN_PARTITION_LOW) != 0;
+
+		if (data + ((sp->has_high ? 1 : 0) + (sp->has_low ? 1 : 0)) *
+				sizeof(cf_digest) > end) {
+			cf_warning(AS_SCAN, "scan msg partitions field truncated");
+			cf_free(partitions);
+			return false;
+		}
+
+		if (sp->has_high) {
+			memcpy(&sp->high, data, sizeof(cf_digest));
+			data += sizeof(cf_digest);
+		}
+
+		if (sp->has_low) {
+			memcpy(&sp->low, data, sizeof(cf_digest));
+			data += sizeof(cf_digest);
+		}
+
+		if (sp->pid >= AS_PARTITIONS ||
+				(sp->has_high && as_partition_getid(&sp->high) != sp->pid) ||
+				(sp->has_low && as_partition_getid(&sp->low) != sp->pid)) {
+			cf_warning(AS_SCAN, "scan msg partitions field bad pid or digest");
+			cf_free(partitions);
+			return false;
+		}
 	}
 
-	return sizeof(as_proto) + size;
+	*p_partitions = partitions;
+	*p_n_partitions = n_partitions;
+
+	return true;
 }
 
 static inline bool
@@ -392,6 +548,38 @@ excluded_set(as_index* r, uint16_t set_id)
 	return set_id != INVALID_SET_ID && set_id != as_index_get_set_id(r);
 }
 
+// A listed set's records are reduced directly - other scans walk the tree.
+// Either way, reduce callbacks must still check excluded_set().
+static inline void
+scan_reduce(as_index_tree* tree, uint16_t set_id, as_index_reduce_fn cb,
+		void* udata)
+{
+	if (! as_index_reduce_set_live(tree, set_id, cb, udata)) {
+		as_index_reduce_live(tree, cb, udata);
+	}
+}
+
+// Records to sample from a partition - AS_REDUCE_ALL if not sampling. Sampling
+// by count spreads the count evenly, so each partition is a stratum.
+static inline uint64_t
+scan_sample_size(as_index_tree* tree, uint32_t sample_pct,
+		uint64_t sample_count)
+{
+	uint64_t n_sample;
+
+	if (sample_count != 0) {
+		n_sample = (sample_count + AS_PARTITIONS - 1) / AS_PARTITIONS;
+	}
+	else if (sample_pct == 100) {
+		return AS_REDUCE_ALL;
+	}
+	else {
+		return (as_index_tree_size(tree) * sample_pct) / 100;
+	}
+
+	return n_sample < as_index_tree_size(tree) ? n_sample : AS_REDUCE_ALL;
+}
+
 
 
 //==============================================================================
@@ -411,7 +599,12 @@ typedef struct conn_scan_job_s {
 	as_file_handle*	fd_h;
 	int32_t			fd_timeout;
 
-	uint64_t		net_io_bytes;
+	cf_atomic64		net_io_bytes;
+
+	// Chunks queued for netio, sent strictly in order:
+	cf_atomic32		n_io_outstanding;
+	uint32_t		netio_push_seq; // protected by fd_lock
+	cf_atomic32		netio_pop_seq;
 } conn_scan_job;
 
 void conn_scan_job_own_fd(conn_scan_job* job, as_file_handle* fd_h, uint32_t timeout);
@@ -420,6 +613,9 @@ void conn_scan_job_finish(conn_scan_job* job);
 bool conn_scan_job_send_response(conn_scan_job* job, uint8_t* buf, size_t size);
 void conn_scan_job_release_fd(conn_scan_job* job, bool force_close);
 void conn_scan_job_info(conn_scan_job* job, as_mon_jobstat* stat);
+bool conn_scan_job_busy(as_job* _job);
+int conn_scan_job_netio_start_cb(void* udata, int seq);
+int conn_scan_job_netio_finish_cb(void* udata, int retcode);
 
 //----------------------------------------------------------
 // conn_scan_job API.
@@ -435,6 +631,10 @@ conn_scan_job_own_fd(conn_scan_job* job, as_file_handle* fd_h, uint32_t timeout)
 	job->fd_timeout = timeout == 0 ? -1 : (int32_t)timeout;
 
 	job->net_io_bytes = 0;
+
+	job->n_io_outstanding = 0;
+	job->netio_push_seq = 0;
+	job->netio_pop_seq = 0;
 }
 
 void
@@ -457,13 +657,16 @@ conn_scan_job_finish(conn_scan_job* job)
 		size_t size_sent = as_msg_send_fin_timeout(&job->fd_h->sock,
 				_job->abandoned, job->fd_timeout);
 
-		job->net_io_bytes += size_sent;
+		cf_atomic64_add(&job->net_io_bytes, size_sent);
 		conn_scan_job_release_fd(job, size_sent == 0);
 	}
 
 	pthread_mutex_destroy(&job->fd_lock);
 }
 
+// Queues the chunk for netio rather than blocking this pool thread on the
+// socket. A job whose client falls behind is busy, so it takes no new slices
+// until the backlog drains.
 bool
 conn_scan_job_send_response(conn_scan_job* job, uint8_t* buf, size_t size)
 {
@@ -477,23 +680,46 @@ conn_scan_job_send_response(conn_scan_job* job, uint8_t* buf, size_t size)
 		return false;
 	}
 
-	size_t size_sent = send_blocking_response_chunk(&job->fd_h->sock, buf,
-			size, job->fd_timeout);
+	// Leave room for the proto header - netio fills it in.
+	cf_buf_builder* bb = cf_buf_builder_create_size(sizeof(as_proto) + size);
 
-	if (size_sent == 0) {
-		int reason = errno == ETIMEDOUT ?
-				AS_JOB_FAIL_RESPONSE_TIMEOUT : AS_JOB_FAIL_RESPONSE_ERROR;
+	cf_buf_builder_reserve(&bb, sizeof(as_proto), NULL);
+	cf_buf_builder_append_buf(&bb, buf, size);
 
-		conn_scan_job_release_fd(job, true);
-		pthread_mutex_unlock(&job->fd_lock);
-		as_job_manager_abandon_job(_job->mgr, _job, reason);
-		return false;
-	}
+	as_netio io;
+
+	io.finish_cb = conn_scan_job_netio_finish_cb;
+	io.start_cb = conn_scan_job_netio_start_cb;
+	io.data = job;
+
+	io.bb_r = bb;
 
-	job->net_io_bytes += size_sent;
+	cf_rc_reserve(job->fd_h);
+	io.fd_h = job->fd_h;
+
+	io.offset = 0;
+	io.seq = job->netio_push_seq++;
+	io.slow = false;
+	io.compressed = false;
+	io.start_time = cf_getns();
 
 	pthread_mutex_unlock(&job->fd_lock);
-	return true;
+
+	as_netio_compress(&io, _job->ns);
+
+	// Each queued chunk keeps the job active - fin goes after the last one.
+	as_job_active_reserve(_job);
+	cf_atomic32_incr(&job->n_io_outstanding);
+
+	as_netio_send(&io, false, false);
+
+	// Being busy stops new slices - this stops a running slice racing ahead.
+	while (cf_atomic32_get(job->n_io_outstanding) > SCAN_MAX_QUEUED_CHUNKS &&
+			_job->abandoned == 0) {
+		usleep(SCAN_QUEUED_CHUNKS_WAIT_US);
+	}
+
+	return _job->abandoned == 0;
 }
 
 void
@@ -508,7 +734,85 @@ conn_scan_job_release_fd(conn_scan_job* job, bool force_close)
 void
 conn_scan_job_info(conn_scan_job* job, as_mon_jobstat* stat)
 {
-	stat->net_io_bytes = job->net_io_bytes;
+	stat->net_io_bytes = cf_atomic64_get(job->net_io_bytes);
+}
+
+bool
+conn_scan_job_busy(as_job* _job)
+{
+	conn_scan_job* job = (conn_scan_job*)_job;
+
+	return cf_atomic32_get(job->n_io_outstanding) > SCAN_MAX_OUTSTANDING_CHUNKS;
+}
+
+int
+conn_scan_job_netio_start_cb(void* udata, int seq)
+{
+	as_netio* io = (as_netio*)udata;
+	conn_scan_job* job = (conn_scan_job*)io->data;
+
+	// Chunks from concurrent slices must go out whole and in order.
+	if ((uint32_t)seq != cf_atomic32_get(job->netio_pop_seq)) {
+		return AS_NETIO_CONTINUE;
+	}
+
+	if (((as_job*)job)->abandoned != 0) {
+		return AS_NETIO_ERR;
+	}
+
+	return AS_NETIO_OK;
+}
+
+int
+conn_scan_job_netio_finish_cb(void* udata, int retcode)
+{
+	as_netio* io = (as_netio*)udata;
+	conn_scan_job* job = (conn_scan_job*)io->data;
+	as_job* _job = (as_job*)job;
+
+	if (retcode == AS_NETIO_CONTINUE) {
+		if (job->fd_timeout < 0 || cf_getns() - io->start_time <
+				(uint64_t)job->fd_timeout * 1000000) {
+			return AS_NETIO_CONTINUE;
+		}
+
+		errno = ETIMEDOUT;
+		retcode = AS_NETIO_IO_ERR;
+	}
+
+	if (retcode == AS_NETIO_OK) {
+		cf_atomic64_add(&job->net_io_bytes, io->bb_r->used_sz);
+	}
+	else if (_job->abandoned == 0) {
+		int reason = errno == ETIMEDOUT ?
+				AS_JOB_FAIL_RESPONSE_TIMEOUT : AS_JOB_FAIL_RESPONSE_ERROR;
+
+		cf_warning(AS_SCAN, "send error - fd %d sz %u %s",
+				CSFD(&io->fd_h->sock), io->bb_r->used_sz, cf_strerror(errno));
+
+		pthread_mutex_lock(&job->fd_lock);
+
+		if (job->fd_h) {
+			conn_scan_job_release_fd(job, true);
+		}
+
+		pthread_mutex_unlock(&job->fd_lock);
+		as_job_manager_abandon_job(_job->mgr, _job, reason);
+	}
+
+	cf_rc_release(io->fd_h);
+	io->fd_h = NULL;
+	cf_buf_builder_free(io->bb_r);
+	io->bb_r = NULL;
+
+	cf_atomic32_incr(&job->netio_pop_seq);
+
+	cf_atomic32_decr(&job->n_io_outstanding);
+	as_job_resume(_job);
+
+	as_job_active_release(_job);
+
+	return retcode == AS_NETIO_OK ? AS_NETIO_OK : AS_NETIO_ERR;
 }
 
 
@@ -530,28 +834,107 @@ typedef struct basic_scan_job_s {
 	bool			fail_on_cluster_change;
 	bool			no_bin_data;
 	uint32_t		sample_pct;
+	uint64_t		sample_count;
 	predexp_eval_t*	predexp;
 	cf_vector*		bin_names;
+	scan_partition*	partitions; // NULL unless partition-targeted
+
+	// Shared scans only:
+	struct scan_share_s* share;
+	uint32_t		share_start_pid;
+	bool			share_started; // others may reduce for job once started
+	bool*			share_claimed; // per pid - protected by g_share_lock
 } basic_scan_job;
 
 void basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
 void basic_scan_job_finish(as_job* _job);
 void basic_scan_job_destroy(as_job* _job);
 void basic_scan_job_info(as_job* _job, as_mon_jobstat* stat);
+void basic_scan_job_indexed_slice(as_job* _job, uint32_t slice_ix);
 
 const as_job_vtable basic_scan_job_vtable = {
 		basic_scan_job_slice,
 		basic_scan_job_finish,
 		basic_scan_job_destroy,
-		basic_scan_job_info
+		basic_scan_job_info,
+		basic_scan_job_indexed_slice,
+		conn_scan_job_busy
 };
 
+// Records needing device reads are read in batches this size, so records near
+// each other on device share reads.
+#define SCAN_READ_BATCH_SIZE 64
+
+// A record awaiting its batched read, and its version when it was filtered -
+// if that's unchanged after the read, the filter needn't be run again.
+typedef struct scan_pending_s {
+	as_index_ref		r_ref;
+	uint64_t			last_update_time;
+	uint16_t			generation;
+} scan_pending;
+
 typedef struct basic_scan_slice_s {
 	basic_scan_job*		job;
 	cf_buf_builder**	bb_r;
+	uint32_t			n_pending;
+	scan_pending		pending[SCAN_READ_BATCH_SIZE];
+
+	// Partition-targeted scans only - where to resume after this chunk:
+	const scan_partition* partition;
+	bool				has_last;
+	cf_digest			last_keyd;
+
+	// Shared scans only - other members' slices fed by this traversal:
+	struct basic_scan_slice_s* sharers;
+	uint32_t			n_sharers;
 } basic_scan_slice;
 
+// Concurrent shared scans of the same set attach to one group. Whichever
+// member reaches a partition first reduces it for every member still needing
+// it. Members join at the group's cursor and wrap around, so late joiners
+// share the rest of the traversal before finishing their beginning alone.
+#define MAX_SCAN_SHARERS 16
+
+typedef struct scan_share_s {
+	struct scan_share_s* next;
+	as_namespace*		ns;
+	uint16_t			set_id;
+	bool				no_bin_data;
+	uint32_t			cursor; // last pid claimed
+	uint32_t			n_members;
+	basic_scan_job*		members[MAX_SCAN_SHARERS];
+} scan_share;
+
+static pthread_mutex_t g_share_lock = PTHREAD_MUTEX_INITIALIZER;
+static scan_share* g_shares = NULL;
+
+// Storage-order slices reserve partitions as their records turn up.
+typedef enum {
+	SWEEP_RSV_UNTRIED = 0,
+	SWEEP_RSV_RESERVED,
+	SWEEP_RSV_UNAVAILABLE
+} sweep_rsv_state;
+
+typedef struct basic_scan_sweep_s {
+	basic_scan_slice			slice;
+	as_partition_reservation	rsvs[AS_PARTITIONS];
+	uint8_t						rsv_states[AS_PARTITIONS];
+} basic_scan_sweep;
+
+void basic_scan_job_device_slice(basic_scan_job* job, uint32_t device_ix);
+void basic_scan_job_partition_slice(basic_scan_job* job, const scan_partition* sp);
+bool basic_scan_job_share_join(basic_scan_job* job);
+void basic_scan_job_share_leave(basic_scan_job* job);
+void basic_scan_job_shared_slice(basic_scan_job* job, uint32_t pid);
+static inline basic_scan_slice* basic_scan_slice_target(basic_scan_slice* slice, uint32_t i);
+bool basic_scan_slice_live(basic_scan_slice* slice);
+void basic_scan_slice_check_chunk(basic_scan_slice* slice);
 void basic_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+as_index_tree* basic_scan_sweep_tree_cb(void* udata, uint32_t pid);
+bool basic_scan_sweep_record_cb(void* udata, as_index_ref* r_ref, as_storage_rd* rd);
+bool basic_scan_job_skip_record(basic_scan_job* job, as_index* r);
+void basic_scan_job_flush_pending(basic_scan_slice* slice);
+void basic_scan_job_send_record(basic_scan_slice* slice, as_index_ref* r_ref, as_storage_rd* rd);
 cf_vector* bin_names_from_op(as_msg* m, int* result);
 
 //----------------------------------------------------------
@@ -572,23 +955,51 @@ basic_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 	scan_options options = { .sample_pct = 100 };
 	uint32_t timeout = CF_SOCKET_TIMEOUT;
 	predexp_eval_t* predexp = NULL;
+	scan_partition* partitions = NULL;
+	uint32_t n_partitions = 0;
 
 	if (! get_scan_options(tr, &options) ||
 			! get_scan_socket_timeout(tr, &timeout) ||
+			! get_scan_partitions(tr, &partitions, &n_partitions) ||
 			! get_scan_predexp(tr, &predexp)) {
 		cf_warning(AS_SCAN, "basic scan job failed msg field processing");
+
+		if (partitions) {
+			cf_free(partitions);
+		}
+
 		cf_free(job);
 		return AS_PROTO_RESULT_FAIL_PARAMETER;
 	}
 
-	as_job_init(_job, &basic_scan_job_vtable, &g_scan_manager, RSV_WRITE,
+	bool no_bin_data = (tr->msgp->msg.info1 & AS_MSG_INFO1_GET_NO_BINS) != 0;
+
+	// Sweeping devices only pays when all the data must be read from them.
+	bool sampled = options.sample_pct != 100 || options.sample_count != 0;
+	bool storage_order = options.storage_order && ! partitions &&
+			! no_bin_data && ! sampled && as_storage_n_devices(ns) != 0;
+
+	// Sharing only pays when all members reduce exactly the same records.
+	bool shared = options.shared && ! partitions && ! storage_order &&
+			! sampled && ! predexp;
+
+	as_job_init(_job, &basic_scan_job_vtable, &g_scan_manager,
+			partitions || shared ?
+					RSV_LISTED : (storage_order ? RSV_DEVICE : RSV_WRITE),
 			as_transaction_trid(tr), ns, set_id, options.priority);
 
+	_job->n_listed = shared ? AS_PARTITIONS : n_partitions;
+
+	job->partitions = partitions;
 	job->cluster_key = as_exchange_cluster_key();
 	job->fail_on_cluster_change = options.fail_on_cluster_change;
-	job->no_bin_data = (tr->msgp->msg.info1 & AS_MSG_INFO1_GET_NO_BINS) != 0;
+	job->no_bin_data = no_bin_data;
 	job->sample_pct = options.sample_pct;
+	job->sample_count = options.sample_count;
 	job->predexp = predexp;
+	job->share = NULL;
+	job->share_started = false;
+	job->share_claimed = NULL;
 
 	int result;
 
@@ -608,23 +1019,43 @@ basic_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 		return AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH;
 	}
 
+	if (shared && ! basic_scan_job_share_join(job)) {
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
 	// Take ownership of socket from transaction.
 	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h, timeout);
 
-	cf_info(AS_SCAN, "starting basic scan job %lu {%s:%s} priority %u, sample-pct %u%s%s",
+	cf_info(AS_SCAN, "starting basic scan job %lu {%s:%s} priority %u, sample-pct %u%s%s%s%s, partitions %u",
 			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
 			_job->priority, job->sample_pct,
 			job->no_bin_data ? ", metadata-only" : "",
-			job->fail_on_cluster_change ? ", fail-on-cluster-change" : "");
+			job->fail_on_cluster_change ? ", fail-on-cluster-change" : "",
+			storage_order ? ", storage-order" : "",
+			shared ? ", shared" : "",
+			partitions ? n_partitions : AS_PARTITIONS);
 
 	if ((result = as_job_manager_start_job(_job->mgr, _job)) != 0) {
 		cf_warning(AS_SCAN, "basic scan job %lu failed to start (%d)",
 				_job->trid, result);
 		conn_scan_job_disown_fd((conn_scan_job*)job);
+
+		if (job->share) {
+			basic_scan_job_share_leave(job);
+		}
+
 		as_job_destroy(_job);
 		return result;
 	}
 
+	// Until now, other members mustn't take active references on the job.
+	if (job->share) {
+		pthread_mutex_lock(&g_share_lock);
+		job->share_started = true;
+		pthread_mutex_unlock(&g_share_lock);
+	}
+
 	return AS_PROTO_RESULT_OK;
 }
 
@@ -646,19 +1077,24 @@ basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
 	}
 
 	uint64_t slice_start = cf_getms();
-	basic_scan_slice slice = { job, &bb };
+	basic_scan_slice slice = { job, &bb, 0 };
 
-	if (job->sample_pct == 100) {
-		as_index_reduce_live(tree, basic_scan_job_reduce_cb, (void*)&slice);
+	uint64_t sample_count = scan_sample_size(tree, job->sample_pct,
+			job->sample_count);
+
+	if (sample_count == AS_REDUCE_ALL) {
+		scan_reduce(tree, _job->set_id, basic_scan_job_reduce_cb,
+				(void*)&slice);
 	}
 	else {
-		uint64_t sample_count =
-				((as_index_tree_size(tree) * job->sample_pct) / 100);
-
 		as_index_reduce_partial_live(tree, sample_count,
 				basic_scan_job_reduce_cb, (void*)&slice);
 	}
 
+	if (slice.n_pending != 0) {
+		basic_scan_job_flush_pending(&slice);
+	}
+
 	if (bb->used_sz != 0) {
 		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
 	}
@@ -671,9 +1107,32 @@ basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
 			cf_getms() - slice_start);
 }
 
+void
+basic_scan_job_indexed_slice(as_job* _job, uint32_t slice_ix)
+{
+	basic_scan_job* job = (basic_scan_job*)_job;
+
+	if (job->share) {
+		basic_scan_job_shared_slice(job,
+				(job->share_start_pid + slice_ix) % AS_PARTITIONS);
+	}
+	else if (_job->rsv_type == RSV_DEVICE) {
+		basic_scan_job_device_slice(job, slice_ix);
+	}
+	else {
+		basic_scan_job_partition_slice(job, &job->partitions[slice_ix]);
+	}
+}
+
 void
 basic_scan_job_finish(as_job* _job)
 {
+	basic_scan_job* job = (basic_scan_job*)_job;
+
+	if (job->share) {
+		basic_scan_job_share_leave(job);
+	}
+
 	conn_scan_job_finish((conn_scan_job*)_job);
 
 	switch (_job->abandoned) {
@@ -708,6 +1167,14 @@ basic_scan_job_destroy(as_job* _job)
 	if (job->predexp) {
 		predexp_destroy(job->predexp);
 	}
+
+	if (job->partitions) {
+		cf_free(job->partitions);
+	}
+
+	if (job->share_claimed) {
+		cf_free(job->share_claimed);
+	}
 }
 
 void
@@ -722,372 +1189,1903 @@ basic_scan_job_info(as_job* _job, as_mon_jobstat* stat)
 //
 
 void
-basic_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+basic_scan_job_device_slice(basic_scan_job* job, uint32_t device_ix)
 {
-	basic_scan_slice* slice = (basic_scan_slice*)udata;
-	basic_scan_job* job = slice->job;
 	as_job* _job = (as_job*)job;
 	as_namespace* ns = _job->ns;
+	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
+	basic_scan_sweep* sweep = cf_malloc(sizeof(basic_scan_sweep));
 
-	if (_job->abandoned != 0) {
-		as_record_done(r_ref, ns);
-		return;
-	}
+	if (! bb || ! sweep) {
+		if (bb) {
+			cf_buf_builder_free(bb);
+		}
+
+		if (sweep) {
+			cf_free(sweep);
+		}
 
-	if (job->fail_on_cluster_change &&
-			job->cluster_key != as_exchange_cluster_key()) {
-		as_record_done(r_ref, ns);
 		as_job_manager_abandon_job(_job->mgr, _job,
-				AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
 		return;
 	}
 
-	as_index* r = r_ref->r;
+	uint64_t slice_start = cf_getms();
 
-	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
-		as_record_done(r_ref, ns);
-		return;
+	sweep->slice = (basic_scan_slice){ job, &bb, 0 };
+	memset(sweep->rsv_states, SWEEP_RSV_UNTRIED, sizeof(sweep->rsv_states));
+
+	if (! as_storage_sweep_device(ns, device_ix, basic_scan_sweep_tree_cb,
+			basic_scan_sweep_record_cb, (void*)sweep) &&
+					_job->abandoned == 0) {
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
 	}
 
-	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = NULL };
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		if (sweep->rsv_states[pid] == SWEEP_RSV_RESERVED) {
+			as_partition_release(&sweep->rsvs[pid]);
+		}
+	}
 
-	if (job->predexp && ! predexp_matches_metadata(job->predexp, &predargs)) {
-		as_record_done(r_ref, ns);
-		return;
+	cf_free(sweep);
+
+	if (bb->used_sz != 0) {
+		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
 	}
 
-	as_storage_rd rd;
+	cf_buf_builder_free(bb);
 
-	as_storage_record_open(ns, r, &rd);
+	cf_detail(AS_SCAN, "%s device %u basic scan job %lu in thread %lu took %lu ms",
+			ns->name, device_ix, _job->trid, pthread_self(),
+			cf_getms() - slice_start);
+}
 
-	if (job->no_bin_data) {
-		// TODO - suppose the predexp needs bin values???
+void
+basic_scan_job_partition_slice(basic_scan_job* job, const scan_partition* sp)
+{
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
+
+	if (! bb) {
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+		return;
+	}
+
+	uint64_t slice_start = cf_getms();
+	as_partition_reservation rsv;
 
-		as_msg_make_response_bufbuilder(slice->bb_r, &rd, true, true, true,
-				NULL);
+	if (as_partition_reserve_write(ns, sp->pid, &rsv, NULL) != 0) {
+		// Not ours (any more) - client must look for it elsewhere.
+		as_msg_make_pid_status_bufbuilder(&bb, sp->pid, NULL,
+				AS_PROTO_RESULT_FAIL_UNAVAILABLE);
 	}
 	else {
-		as_storage_rd_load_n_bins(&rd); // TODO - handle error returned
+		basic_scan_slice slice = { job, &bb, 0 };
 
-		as_bin stack_bins[rd.ns->storage_data_in_memory ? 0 : rd.n_bins];
+		slice.partition = sp;
 
-		as_storage_rd_load_bins(&rd, stack_bins); // TODO - handle error returned
+		as_index_reduce_range_live(rsv.tree, sp->has_high ? &sp->high : NULL,
+				sp->has_low ? &sp->low : NULL, basic_scan_job_reduce_cb,
+				(void*)&slice);
 
-		predargs.rd = &rd;
+		if (slice.n_pending != 0) {
+			basic_scan_job_flush_pending(&slice);
+		}
 
-		if (job->predexp && ! predexp_matches_record(job->predexp, &predargs)) {
-			as_storage_record_close(&rd);
-			as_record_done(r_ref, ns);
-			return;
+		as_partition_release(&rsv);
+
+		if (_job->abandoned == 0) {
+			as_msg_make_pid_status_bufbuilder(&bb, sp->pid, NULL,
+					AS_PROTO_RESULT_OK);
 		}
+	}
 
-		as_msg_make_response_bufbuilder(slice->bb_r, &rd, false, true, true,
-				job->bin_names);
+	if (bb->used_sz != 0) {
+		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
 	}
 
-	as_storage_record_close(&rd);
-	as_record_done(r_ref, ns);
+	cf_buf_builder_free(bb);
 
-	cf_atomic64_incr(&_job->n_records_read);
+	cf_detail(AS_SCAN, "%s:%u basic scan job %lu in thread %lu took %lu ms",
+			ns->name, sp->pid, _job->trid, pthread_self(),
+			cf_getms() - slice_start);
+}
 
-	cf_buf_builder* bb = *slice->bb_r;
+bool
+basic_scan_job_share_join(basic_scan_job* job)
+{
+	as_job* _job = (as_job*)job;
 
-	// If we exceed the proto size limit, send accumulated data back to client
-	// and reset the buf-builder to start a new proto.
-	if (bb->used_sz > SCAN_CHUNK_LIMIT) {
-		if (! conn_scan_job_send_response((conn_scan_job*)job, bb->buf,
-				bb->used_sz)) {
-			return;
-		}
+	if (! (job->share_claimed = cf_calloc(AS_PARTITIONS, sizeof(bool)))) {
+		cf_warning(AS_SCAN, "basic scan job failed alloc");
+		return false;
+	}
 
-		cf_buf_builder_reset(bb);
+	pthread_mutex_lock(&g_share_lock);
+
+	scan_share* share = g_shares;
+
+	while (share && ! (share->ns == _job->ns &&
+			share->set_id == _job->set_id &&
+			share->no_bin_data == job->no_bin_data &&
+			share->n_members < MAX_SCAN_SHARERS)) {
+		share = share->next;
 	}
-}
 
-cf_vector*
+	if (! share) {
+		if (! (share = cf_malloc(sizeof(scan_share)))) {
+			pthread_mutex_unlock(&g_share_lock);
+			cf_warning(AS_SCAN, "basic scan job failed alloc");
+			return false;
+		}
+
+		share->ns = _job->ns;
+		share->set_id = _job->set_id;
+		share->no_bin_data = job->no_bin_data;
+		share->cursor = AS_PARTITIONS - 1;
+		share->n_members = 0;
+
+		share->next = g_shares;
+		g_shares = share;
+	}
+
+	share->members[share->n_members++] = job;
+
+	job->share = share;
+	job->share_start_pid = (share->cursor + 1) % AS_PARTITIONS;
+
+	pthread_mutex_unlock(&g_share_lock);
+
+	return true;
+}
+
+void
+basic_scan_job_share_leave(basic_scan_job* job)
+{
+	scan_share* share = job->share;
+
+	pthread_mutex_lock(&g_share_lock);
+
+	for (uint32_t i = 0; i < share->n_members; i++) {
+		if (share->members[i] == job) {
+			share->members[i] = share->members[--share->n_members];
+			break;
+		}
+	}
+
+	if (share->n_members == 0) {
+		scan_share** p_share = &g_shares;
+
+		while (*p_share != share) {
+			p_share = &(*p_share)->next;
+		}
+
+		*p_share = share->next;
+		cf_free(share);
+	}
+
+	job->share = NULL;
+
+	pthread_mutex_unlock(&g_share_lock);
+}
+
+void
+basic_scan_job_shared_slice(basic_scan_job* job, uint32_t pid)
+{
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+	scan_share* share = job->share;
+	basic_scan_job* sharers[MAX_SCAN_SHARERS];
+	uint32_t n_sharers = 0;
+
+	pthread_mutex_lock(&g_share_lock);
+
+	// Another member's traversal already fed (or is feeding) us this one.
+	if (job->share_claimed[pid]) {
+		pthread_mutex_unlock(&g_share_lock);
+		return;
+	}
+
+	job->share_claimed[pid] = true;
+	share->cursor = pid;
+
+	for (uint32_t i = 0; i < share->n_members; i++) {
+		basic_scan_job* member = share->members[i];
+		as_job* _member = (as_job*)member;
+
+		if (member == job || ! member->share_started ||
+				member->share_claimed[pid]) {
+			continue;
+		}
+
+		// An unabandoned member with an unclaimed pid still has that slice
+		// to run, so it's still active - safe to take a reference.
+		pthread_mutex_lock(&_member->requeue_lock);
+
+		if (_member->abandoned == 0) {
+			as_job_active_reserve(_member);
+			member->share_claimed[pid] = true;
+			sharers[n_sharers++] = member;
+		}
+
+		pthread_mutex_unlock(&_member->requeue_lock);
+	}
+
+	pthread_mutex_unlock(&g_share_lock);
+
+	cf_buf_builder* bbs[n_sharers + 1];
+	basic_scan_slice sharer_slices[n_sharers];
+	uint32_t n_bbs = 0;
+
+	for ( ; n_bbs <= n_sharers; n_bbs++) {
+		if (! (bbs[n_bbs] = cf_buf_builder_create_size(
+				INIT_BUF_BUILDER_SIZE))) {
+			break;
+		}
+	}
+
+	uint64_t slice_start = cf_getms();
+	as_partition_reservation rsv;
+
+	if (n_bbs <= n_sharers) {
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+	}
+	else if (as_partition_reserve_write(ns, pid, &rsv, NULL) == 0) {
+		basic_scan_slice slice = { job, &bbs[0], 0 };
+
+		for (uint32_t i = 0; i < n_sharers; i++) {
+			sharer_slices[i] = (basic_scan_slice){ sharers[i], &bbs[i + 1],
+					0 };
+		}
+
+		slice.sharers = sharer_slices;
+		slice.n_sharers = n_sharers;
+
+		scan_reduce(rsv.tree, _job->set_id, basic_scan_job_reduce_cb,
+				(void*)&slice);
+
+		if (slice.n_pending != 0) {
+			basic_scan_job_flush_pending(&slice);
+		}
+
+		as_partition_release(&rsv);
+
+		for (uint32_t i = 0; i <= n_sharers; i++) {
+			basic_scan_job* target = i == 0 ? job : sharers[i - 1];
+			cf_buf_builder* bb = bbs[i];
+
+			if (bb->used_sz != 0) {
+				conn_scan_job_send_response((conn_scan_job*)target, bb->buf,
+						bb->used_sz);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < n_bbs; i++) {
+		cf_buf_builder_free(bbs[i]);
+	}
+
+	for (uint32_t i = 0; i < n_sharers; i++) {
+		as_job_active_release((as_job*)sharers[i]);
+	}
+
+	cf_detail(AS_SCAN, "%s:%u basic scan job %lu shared with %u in thread %lu took %lu ms",
+			ns->name, pid, _job->trid, n_sharers, pthread_self(),
+			cf_getms() - slice_start);
+}
+
+void
+basic_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	basic_scan_slice* slice = (basic_scan_slice*)udata;
+	basic_scan_job* job = slice->job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+
+	if (! basic_scan_slice_live(slice)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	as_index* r = r_ref->r;
+
+	if (basic_scan_job_skip_record(job, r)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	// Defer reading from device - keep the record reserved but unlocked.
+	if (! job->no_bin_data && ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! ns->storage_data_in_memory) {
+		scan_pending* p = &slice->pending[slice->n_pending++];
+
+		p->r_ref = *r_ref;
+		p->last_update_time = r->last_update_time;
+		p->generation = r->generation;
+
+		pthread_mutex_unlock(r_ref->olock);
+
+		if (slice->n_pending == SCAN_READ_BATCH_SIZE) {
+			basic_scan_job_flush_pending(slice);
+		}
+
+		return;
+	}
+
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r, &rd);
+	basic_scan_job_send_record(slice, r_ref, &rd);
+}
+
+as_index_tree*
+basic_scan_sweep_tree_cb(void* udata, uint32_t pid)
+{
+	basic_scan_sweep* sweep = (basic_scan_sweep*)udata;
+
+	if (sweep->rsv_states[pid] == SWEEP_RSV_UNTRIED) {
+		as_namespace* ns = ((as_job*)sweep->slice.job)->ns;
+
+		// Same partitions a partition-order scan would reduce.
+		sweep->rsv_states[pid] = as_partition_reserve_write(ns, pid,
+				&sweep->rsvs[pid], NULL) == 0 ?
+						SWEEP_RSV_RESERVED : SWEEP_RSV_UNAVAILABLE;
+	}
+
+	return sweep->rsv_states[pid] == SWEEP_RSV_RESERVED ?
+			sweep->rsvs[pid].tree : NULL;
+}
+
+bool
+basic_scan_sweep_record_cb(void* udata, as_index_ref* r_ref, as_storage_rd* rd)
+{
+	basic_scan_sweep* sweep = (basic_scan_sweep*)udata;
+	basic_scan_job* job = sweep->slice.job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+
+	if (_job->abandoned != 0) {
+		as_storage_record_close(rd);
+		as_record_done(r_ref, ns);
+		return false;
+	}
+
+	if (job->fail_on_cluster_change &&
+			job->cluster_key != as_exchange_cluster_key()) {
+		as_storage_record_close(rd);
+		as_record_done(r_ref, ns);
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
+		return false;
+	}
+
+	as_index* r = r_ref->r;
+
+	if (! as_record_is_live(r) || basic_scan_job_skip_record(job, r)) {
+		as_storage_record_close(rd);
+		as_record_done(r_ref, ns);
+		return true;
+	}
+
+	basic_scan_job_send_record(&sweep->slice, r_ref, rd);
+
+	return _job->abandoned == 0;
+}
+
+bool
+basic_scan_job_skip_record(basic_scan_job* job, as_index* r)
+{
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
+		return true;
+	}
+
+	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = NULL };
+
+	return job->predexp && ! predexp_matches_metadata(job->predexp, &predargs);
+}
+
+void
+basic_scan_job_flush_pending(basic_scan_slice* slice)
+{
+	as_job* _job = (as_job*)slice->job;
+	as_namespace* ns = _job->ns;
+	uint32_t n_pending = slice->n_pending;
+	as_storage_rd rds[n_pending];
+	as_storage_rd* rd_ptrs[n_pending];
+
+	slice->n_pending = 0;
+
+	// Read all the records' data without their locks, letting storage merge
+	// reads of records that are near each other.
+	for (uint32_t i = 0; i < n_pending; i++) {
+		as_storage_record_open(ns, slice->pending[i].r_ref.r, &rds[i]);
+		rd_ptrs[i] = &rds[i];
+	}
+
+	as_storage_record_load_multi(ns, rd_ptrs, n_pending);
+
+	for (uint32_t i = 0; i < n_pending; i++) {
+		scan_pending* p = &slice->pending[i];
+		as_index_ref* r_ref = &p->r_ref;
+		as_index* r = r_ref->r;
+
+		olock_vlock(g_record_locks, &r->keyd, &r_ref->olock);
+
+		// Things may have changed while the record was unlocked. If it wasn't
+		// written meanwhile, only its liveness can have - it passed the set
+		// and predexp metadata filters already.
+		bool unchanged = r->last_update_time == p->last_update_time &&
+				r->generation == p->generation;
+
+		if (! basic_scan_slice_live(slice) || ! as_index_is_valid_record(r) ||
+				(unchanged ? as_record_is_doomed(r, ns) :
+						basic_scan_job_skip_record(slice->job, r))) {
+			as_storage_record_close(&rds[i]);
+			as_record_done(r_ref, ns);
+			continue;
+		}
+
+		as_storage_record_revalidate(&rds[i]);
+		basic_scan_job_send_record(slice, r_ref, &rds[i]);
+	}
+}
+
+void
+basic_scan_job_send_record(basic_scan_slice* slice, as_index_ref* r_ref,
+		as_storage_rd* rd)
+{
+	basic_scan_job* job = slice->job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+
+	predexp_args_t predargs = { .ns = ns, .md = r_ref->r, .vl = NULL,
+			.rd = NULL };
+
+	// Note - shared scans' members agree on no_bin_data and have no predexp.
+	if (job->no_bin_data) {
+		// TODO - suppose the predexp needs bin values???
+
+		for (uint32_t i = 0; i <= slice->n_sharers; i++) {
+			basic_scan_slice* target = basic_scan_slice_target(slice, i);
+
+			if (((as_job*)target->job)->abandoned == 0) {
+				as_msg_make_response_bufbuilder(target->bb_r, rd, true, true,
+						true, NULL);
+			}
+		}
+	}
+	else {
+		as_storage_rd_load_n_bins(rd); // TODO - handle error returned
+
+		as_bin stack_bins[rd->ns->storage_data_in_memory ? 0 : rd->n_bins];
+
+		// If only the selected bins will be looked at, only unpack those.
+		if (job->bin_names && slice->n_sharers == 0 &&
+				! predexp_needs_record(job->predexp)) {
+			as_storage_rd_load_bins_named(rd, stack_bins, job->bin_names); // TODO - handle error returned
+		}
+		else {
+			as_storage_rd_load_bins(rd, stack_bins); // TODO - handle error returned
+		}
+
+		predargs.rd = rd;
+
+		if (predexp_needs_record(job->predexp) &&
+				! predexp_matches_record(job->predexp, &predargs)) {
+			as_storage_record_close(rd);
+			as_record_done(r_ref, ns);
+			return;
+		}
+
+		for (uint32_t i = 0; i <= slice->n_sharers; i++) {
+			basic_scan_slice* target = basic_scan_slice_target(slice, i);
+
+			if (((as_job*)target->job)->abandoned == 0) {
+				as_msg_make_response_bufbuilder(target->bb_r, rd, false, true,
+						true, target->job->bin_names);
+			}
+		}
+	}
+
+	if (slice->partition) {
+		slice->has_last = true;
+		slice->last_keyd = r_ref->r->keyd;
+	}
+
+	as_storage_record_close(rd);
+	as_record_done(r_ref, ns);
+
+	for (uint32_t i = 0; i <= slice->n_sharers; i++) {
+		basic_scan_slice* target = basic_scan_slice_target(slice, i);
+
+		cf_atomic64_incr(&((as_job*)target->job)->n_records_read);
+		basic_scan_slice_check_chunk(target);
+	}
+
+	as_job_throttle(_job);
+}
+
+// If we exceed the proto size limit, send accumulated data back to client and
+// reset the buf-builder to start a new proto.
+void
+basic_scan_slice_check_chunk(basic_scan_slice* slice)
+{
+	cf_buf_builder* bb = *slice->bb_r;
+
+	if (bb->used_sz <= SCAN_CHUNK_LIMIT) {
+		return;
+	}
+
+	if (slice->has_last) {
+		as_msg_make_pid_status_bufbuilder(slice->bb_r, slice->partition->pid,
+				&slice->last_keyd, AS_PROTO_RESULT_OK);
+		bb = *slice->bb_r;
+	}
+
+	if (conn_scan_job_send_response((conn_scan_job*)slice->job, bb->buf,
+			bb->used_sz)) {
+		cf_buf_builder_reset(bb);
+	}
+}
+
+static inline basic_scan_slice*
+basic_scan_slice_target(basic_scan_slice* slice, uint32_t i)
+{
+	return i == 0 ? slice : &slice->sharers[i - 1];
+}
+
+// Returns false if no job the slice feeds wants more records.
+bool
+basic_scan_slice_live(basic_scan_slice* slice)
+{
+	bool live = false;
+
+	for (uint32_t i = 0; i <= slice->n_sharers; i++) {
+		basic_scan_job* job = basic_scan_slice_target(slice, i)->job;
+		as_job* _job = (as_job*)job;
+
+		if (_job->abandoned != 0) {
+			continue;
+		}
+
+		if (job->fail_on_cluster_change &&
+				job->cluster_key != as_exchange_cluster_key()) {
+			as_job_manager_abandon_job(_job->mgr, _job,
+					AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
+			continue;
+		}
+
+		live = true;
+	}
+
+	return live;
+}
+
+cf_vector*
 bin_names_from_op(as_msg* m, int* result)
 {
-	*result = AS_PROTO_RESULT_OK;
+	*result = AS_PROTO_RESULT_OK;
+
+	if (m->n_ops == 0) {
+		return NULL;
+	}
+
+	cf_vector* v  = cf_vector_create(AS_ID_BIN_SZ, m->n_ops, 0);
+
+	as_msg_op* op = NULL;
+	int n = 0;
+
+	while ((op = as_msg_op_iterate(m, op, &n)) != NULL) {
+		if (op->name_sz >= AS_ID_BIN_SZ) {
+			cf_warning(AS_SCAN, "basic scan job bin name too long");
+			cf_vector_destroy(v);
+			*result = AS_PROTO_RESULT_FAIL_BIN_NAME;
+			return NULL;
+		}
+
+		char bin_name[AS_ID_BIN_SZ];
+
+		memcpy(bin_name, op->name, op->name_sz);
+		bin_name[op->name_sz] = 0;
+		cf_vector_append_unique(v, (void*)bin_name);
+	}
+
+	return v;
+}
+
+
+
+//==============================================================================
+// count_scan_job derived class implementation.
+//
+
+//----------------------------------------------------------
+// count_scan_job typedefs and forward declarations.
+//
+
+typedef struct count_scan_job_s {
+	// Base object must be first:
+	conn_scan_job	_base;
+
+	// Derived class data:
+	uint32_t		sample_pct;
+	uint64_t		sample_count;
+	predexp_eval_t*	predexp;
+	char			bin_name[AS_BIN_NAME_MAX_SZ]; // empty unless estimating distinct values
+
+	pthread_mutex_t	lock; // protects the results below, as slices merge
+	uint64_t		n_sampled;
+	uint64_t		n_matched;
+	double			estimate;
+	cf_hll*			hll; // NULL unless estimating distinct values
+} count_scan_job;
+
+void count_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void count_scan_job_finish(as_job* _job);
+void count_scan_job_destroy(as_job* _job);
+void count_scan_job_info(as_job* _job, as_mon_jobstat* stat);
+
+const as_job_vtable count_scan_job_vtable = {
+		count_scan_job_slice,
+		count_scan_job_finish,
+		count_scan_job_destroy,
+		count_scan_job_info,
+		NULL,
+		conn_scan_job_busy
+};
+
+typedef struct count_scan_slice_s {
+	count_scan_job*	job;
+	uint64_t		n_sampled;
+	uint64_t		n_matched;
+	cf_hll			hll;
+} count_scan_slice;
+
+bool get_scan_count_bin(as_transaction* tr, char* bin_name);
+void count_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+bool count_scan_job_read_record(count_scan_slice* slice, as_index* r);
+void count_scan_hll_add_bin(cf_hll* hll, as_bin* b);
+void count_scan_job_send_result(count_scan_job* job);
+
+//----------------------------------------------------------
+// count_scan_job public API.
+//
+
+int
+count_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+{
+	count_scan_job* job = cf_malloc(sizeof(count_scan_job));
+	as_job* _job = (as_job*)job;
+
+	if (! job) {
+		cf_warning(AS_SCAN, "count scan job failed alloc");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	scan_options options = { .sample_pct = 100 };
+	uint32_t timeout = CF_SOCKET_TIMEOUT;
+	predexp_eval_t* predexp = NULL;
+
+	if (! get_scan_options(tr, &options) ||
+			! get_scan_socket_timeout(tr, &timeout) ||
+			! get_scan_count_bin(tr, job->bin_name) ||
+			! get_scan_predexp(tr, &predexp)) {
+		cf_warning(AS_SCAN, "count scan job failed msg field processing");
+		cf_free(job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	// Counting records alone is index-only - only reading a bin reads records.
+	if (job->bin_name[0] == '\0' && predexp_needs_record(predexp)) {
+		cf_warning(AS_SCAN, "count scan predexp may only use metadata");
+		predexp_destroy(predexp);
+		cf_free(job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_job_init(_job, &count_scan_job_vtable, &g_scan_manager, RSV_WRITE,
+			as_transaction_trid(tr), ns, set_id, options.priority);
+
+	job->sample_pct = options.sample_pct;
+	job->sample_count = options.sample_count;
+	job->predexp = predexp;
+
+	pthread_mutex_init(&job->lock, NULL);
+	job->n_sampled = 0;
+	job->n_matched = 0;
+	job->estimate = 0;
+	job->hll = NULL;
+
+	if (job->bin_name[0] != '\0') {
+		job->hll = cf_malloc(sizeof(cf_hll));
+		cf_hll_init(job->hll);
+	}
+
+	// Take ownership of socket from transaction.
+	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h, timeout);
+
+	cf_info(AS_SCAN, "starting count scan job %lu {%s:%s} priority %u, sample-pct %u, sample-count %lu%s%s",
+			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
+			_job->priority, job->sample_pct, job->sample_count,
+			job->hll ? ", distinct " : "", job->bin_name);
+
+	int result;
+
+	if ((result = as_job_manager_start_job(_job->mgr, _job)) != 0) {
+		cf_warning(AS_SCAN, "count scan job %lu failed to start (%d)",
+				_job->trid, result);
+		conn_scan_job_disown_fd((conn_scan_job*)job);
+		as_job_destroy(_job);
+		return result;
+	}
+
+	return AS_PROTO_RESULT_OK;
+}
+
+//----------------------------------------------------------
+// count_scan_job mandatory scan_job interface.
+//
+
+void
+count_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+{
+	count_scan_job* job = (count_scan_job*)_job;
+	as_index_tree* tree = rsv->tree;
+	count_scan_slice slice = { .job = job };
+
+	if (job->hll) {
+		cf_hll_init(&slice.hll);
+	}
+
+	uint64_t slice_start = cf_getms();
+	uint64_t sample_count = scan_sample_size(tree, job->sample_pct,
+			job->sample_count);
+
+	if (sample_count == AS_REDUCE_ALL) {
+		scan_reduce(tree, _job->set_id, count_scan_job_reduce_cb,
+				(void*)&slice);
+	}
+	else {
+		as_index_reduce_partial_live(tree, sample_count,
+				count_scan_job_reduce_cb, (void*)&slice);
+	}
+
+	// Scale a sample up to the whole partition - sampled records include those
+	// of other sets, so the ratio is right for set scans too.
+	double estimate = (double)slice.n_matched;
+
+	if (sample_count != AS_REDUCE_ALL && slice.n_sampled != 0) {
+		estimate = estimate * (double)as_index_tree_size(tree) /
+				(double)slice.n_sampled;
+	}
+
+	pthread_mutex_lock(&job->lock);
+
+	job->n_sampled += slice.n_sampled;
+	job->n_matched += slice.n_matched;
+	job->estimate += estimate;
+
+	if (job->hll) {
+		cf_hll_merge(job->hll, &slice.hll);
+	}
+
+	pthread_mutex_unlock(&job->lock);
+
+	cf_detail(AS_SCAN, "%s:%u count scan job %lu in thread %lu took %lu ms",
+			rsv->ns->name, rsv->p->id, _job->trid, pthread_self(),
+			cf_getms() - slice_start);
+}
+
+void
+count_scan_job_finish(as_job* _job)
+{
+	count_scan_job* job = (count_scan_job*)_job;
+
+	// All slices are done - nothing else is sending on the socket.
+	if (_job->abandoned == 0 && ((conn_scan_job*)job)->fd_h) {
+		count_scan_job_send_result(job);
+	}
+
+	conn_scan_job_finish((conn_scan_job*)_job);
+
+	switch (_job->abandoned) {
+	case 0:
+		cf_atomic_int_incr(&_job->ns->n_scan_count_complete);
+		break;
+	case AS_JOB_FAIL_USER_ABORT:
+		cf_atomic_int_incr(&_job->ns->n_scan_count_abort);
+		break;
+	case AS_JOB_FAIL_UNKNOWN:
+	case AS_JOB_FAIL_CLUSTER_KEY:
+	case AS_JOB_FAIL_RESPONSE_ERROR:
+	case AS_JOB_FAIL_RESPONSE_TIMEOUT:
+	default:
+		cf_atomic_int_incr(&_job->ns->n_scan_count_error);
+		break;
+	}
+
+	cf_info(AS_SCAN, "finished count scan job %lu (%d)", _job->trid,
+			_job->abandoned);
+}
+
+void
+count_scan_job_destroy(as_job* _job)
+{
+	count_scan_job* job = (count_scan_job*)_job;
+
+	if (job->predexp) {
+		predexp_destroy(job->predexp);
+	}
+
+	if (job->hll) {
+		cf_free(job->hll);
+	}
+
+	pthread_mutex_destroy(&job->lock);
+}
+
+void
+count_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+{
+	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_COUNT));
+	conn_scan_job_info((conn_scan_job*)_job, stat);
+}
+
+//----------------------------------------------------------
+// count_scan_job utilities.
+//
+
+// Count scan field - empty, or the name of a bin whose distinct values to
+// estimate.
+bool
+get_scan_count_bin(as_transaction* tr, char* bin_name)
+{
+	as_msg_field* f = as_transaction_field_get(tr,
+			AS_MSG_FIELD_TYPE_SCAN_COUNT);
+	uint32_t name_sz = as_msg_field_get_value_sz(f);
+
+	if (name_sz >= AS_BIN_NAME_MAX_SZ) {
+		cf_warning(AS_SCAN, "scan count bin name too long");
+		return false;
+	}
+
+	memcpy(bin_name, f->data, name_sz);
+	bin_name[name_sz] = '\0';
+
+	return true;
+}
+
+void
+count_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	count_scan_slice* slice = (count_scan_slice*)udata;
+	count_scan_job* job = slice->job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+	as_index* r = r_ref->r;
+
+	slice->n_sampled++;
+
+	if (_job->abandoned != 0 || excluded_set(r, _job->set_id) ||
+			as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = NULL };
+
+	if (job->predexp && ! predexp_matches_metadata(job->predexp, &predargs)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	if (! job->hll) {
+		slice->n_matched++;
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	if (count_scan_job_read_record(slice, r)) {
+		slice->n_matched++;
+	}
+
+	as_record_done(r_ref, ns);
+	cf_atomic64_incr(&_job->n_records_read);
+	as_job_throttle(_job);
+}
+
+// Returns false if the record fails the predexp.
+bool
+count_scan_job_read_record(count_scan_slice* slice, as_index* r)
+{
+	count_scan_job* job = slice->job;
+	as_namespace* ns = ((as_job*)job)->ns;
+
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r, &rd);
+	as_storage_rd_load_n_bins(&rd); // TODO - handle error returned
+
+	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
+
+	as_storage_rd_load_bins(&rd, stack_bins); // TODO - handle error returned
+
+	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = &rd };
+
+	if (predexp_needs_record(job->predexp) &&
+			! predexp_matches_record(job->predexp, &predargs)) {
+		as_storage_record_close(&rd);
+		return false;
+	}
+
+	as_bin* b = as_bin_get(&rd, job->bin_name);
+
+	if (b) {
+		count_scan_hll_add_bin(&slice->hll, b);
+	}
+
+	as_storage_record_close(&rd);
+
+	return true;
+}
+
+// Only integer, string and blob values are counted - the particle type is
+// mixed in so equal bytes of different types are distinct.
+void
+count_scan_hll_add_bin(cf_hll* hll, as_bin* b)
+{
+	uint8_t type = as_bin_get_particle_type(b);
+	const uint8_t* buf;
+	uint32_t sz;
+	int64_t i;
+
+	switch (type) {
+	case AS_PARTICLE_TYPE_INTEGER:
+		i = as_bin_particle_integer_value(b);
+		buf = (const uint8_t*)&i;
+		sz = sizeof(i);
+		break;
+	case AS_PARTICLE_TYPE_STRING:
+		sz = as_bin_particle_string_ptr(b, (char**)&buf);
+		break;
+	case AS_PARTICLE_TYPE_BLOB:
+		sz = as_bin_particle_blob_ptr(b, (uint8_t**)&buf);
+		break;
+	default:
+		return;
+	}
+
+	cf_hll_add(hll, cf_hash_fnv64(buf, sz) ^ type);
+}
+
+// Send this node's result as one value response, ahead of the fin.
+void
+count_scan_job_send_result(count_scan_job* job)
+{
+	conn_scan_job* conn_job = (conn_scan_job*)job;
+	as_hashmap map;
+
+	as_hashmap_init(&map, 4);
+	as_stringmap_set_int64((as_map*)&map, "count",
+			(int64_t)(job->estimate + 0.5));
+	as_stringmap_set_int64((as_map*)&map, "matched", (int64_t)job->n_matched);
+	as_stringmap_set_int64((as_map*)&map, "sampled", (int64_t)job->n_sampled);
+
+	if (job->hll) {
+		as_stringmap_set_int64((as_map*)&map, "distinct",
+				(int64_t)cf_hll_estimate(job->hll));
+	}
+
+	uint32_t size = as_particle_asval_client_value_size((as_val*)&map);
+	cf_buf_builder* bb = cf_buf_builder_create_size(sizeof(as_proto) +
+			sizeof(as_msg) + 64 + size);
+
+	cf_buf_builder_reserve(&bb, sizeof(as_proto), NULL);
+	as_msg_make_val_response_bufbuilder((as_val*)&map, &bb, size, true);
+	as_hashmap_destroy(&map);
+
+	as_proto* proto = (as_proto*)bb->buf;
+
+	proto->version = PROTO_VERSION;
+	proto->type = PROTO_TYPE_AS_MSG;
+	proto->sz = bb->used_sz - sizeof(as_proto);
+	as_proto_swap(proto);
+
+	if (cf_socket_send_all(&conn_job->fd_h->sock, bb->buf, bb->used_sz,
+			MSG_NOSIGNAL, conn_job->fd_timeout) < 0) {
+		cf_warning(AS_SCAN, "send error - fd %d %s",
+				CSFD(&conn_job->fd_h->sock), cf_strerror(errno));
+		((as_job*)job)->abandoned = AS_JOB_FAIL_RESPONSE_ERROR;
+	}
+	else {
+		cf_atomic64_add(&conn_job->net_io_bytes, bb->used_sz);
+	}
+
+	cf_buf_builder_free(bb);
+}
+
+
+
+//==============================================================================
+// aggr_scan_job derived class implementation.
+//
+
+//----------------------------------------------------------
+// aggr_scan_job typedefs and forward declarations.
+//
+
+typedef struct aggr_scan_job_s {
+	// Base object must be first:
+	conn_scan_job	_base;
+
+	// Derived class data:
+	as_aggr_call	aggr_call;
+} aggr_scan_job;
+
+void aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void aggr_scan_job_finish(as_job* _job);
+void aggr_scan_job_destroy(as_job* _job);
+void aggr_scan_job_info(as_job* _job, as_mon_jobstat* stat);
+
+const as_job_vtable aggr_scan_job_vtable = {
+		aggr_scan_job_slice,
+		aggr_scan_job_finish,
+		aggr_scan_job_destroy,
+		aggr_scan_job_info,
+		NULL,
+		conn_scan_job_busy
+};
+
+// Per lane - the aggregation hooks' context.
+typedef struct aggr_scan_slice_s {
+	aggr_scan_job*				job;
+	cf_ll*						ll;
+	cf_buf_builder**			bb_r;
+	as_partition_reservation*	rsv;
+} aggr_scan_slice;
+
+// Deals the partition's digests to the lanes, a keys array at a time.
+typedef struct aggr_scan_collect_s {
+	aggr_scan_job*				job;
+	as_aggr_lane*				lanes;
+	uint32_t					n_lanes;
+	uint64_t					n_digests;
+} aggr_scan_collect;
+
+bool aggr_scan_init(as_aggr_call* call, const as_transaction* tr);
+void aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+void aggr_scan_lane_error(aggr_scan_slice* slice, as_aggr_lane* lane);
+bool aggr_scan_add_digest(cf_ll* ll, cf_digest* keyd);
+as_partition_reservation* aggr_scan_ptn_reserve(void* udata, as_namespace* ns,
+		uint32_t pid, as_partition_reservation* rsv);
+as_stream_status aggr_scan_ostream_write(void* udata, as_val* val);
+
+const as_aggr_hooks scan_aggr_hooks = {
+	.ostream_write = aggr_scan_ostream_write,
+	.set_error     = NULL,
+	.ptn_reserve   = aggr_scan_ptn_reserve,
+	.ptn_release   = NULL,
+	.pre_check     = NULL
+};
+
+void aggr_scan_add_val_response(aggr_scan_slice* slice, const as_val* val,
+		bool success);
+
+//----------------------------------------------------------
+// aggr_scan_job public API.
+//
+
+int
+aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+{
+	aggr_scan_job* job = cf_malloc(sizeof(aggr_scan_job));
+	as_job* _job = (as_job*)job;
+
+	if (! job) {
+		cf_warning(AS_SCAN, "aggregation scan job failed alloc");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	scan_options options = { .sample_pct = 100 };
+	uint32_t timeout = CF_SOCKET_TIMEOUT;
+
+	if (! get_scan_options(tr, &options) ||
+			! get_scan_socket_timeout(tr, &timeout)) {
+		cf_warning(AS_SCAN, "aggregation scan job failed msg field processing");
+		cf_free(job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (as_transaction_has_predexp(tr)) {
+		cf_warning(AS_SCAN, "aggregation scans do not support predexp filters");
+		cf_free(job);
+		return AS_PROTO_RESULT_FAIL_UNSUPPORTED_FEATURE;
+	}
+
+	as_job_init(_job, &aggr_scan_job_vtable, &g_scan_manager, RSV_WRITE,
+			as_transaction_trid(tr), ns, set_id, options.priority);
+
+	if (! aggr_scan_init(&job->aggr_call, tr)) {
+		cf_warning(AS_SCAN, "aggregation scan job failed call init");
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	// Take ownership of socket from transaction.
+	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h, timeout);
+
+	cf_info(AS_SCAN, "starting aggregation scan job %lu {%s:%s} priority %u",
+			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
+			_job->priority);
+
+	int result = as_job_manager_start_job(_job->mgr, _job);
+
+	if (result != 0) {
+		cf_warning(AS_SCAN, "aggregation scan job %lu failed to start (%d)",
+				_job->trid, result);
+		conn_scan_job_disown_fd((conn_scan_job*)job);
+		as_job_destroy(_job);
+		return result;
+	}
+
+	return AS_PROTO_RESULT_OK;
+}
+
+//----------------------------------------------------------
+// aggr_scan_job mandatory scan_job interface.
+//
+
+void
+aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+{
+	aggr_scan_job* job = (aggr_scan_job*)_job;
+	uint32_t n_lanes = g_config.scan_aggr_parallelism;
+
+	if (n_lanes == 0 || n_lanes > AS_AGGR_MAX_LANES) {
+		n_lanes = 1;
+	}
+
+	as_aggr_lane lanes[AS_AGGR_MAX_LANES];
+	cf_buf_builder* bbs[AS_AGGR_MAX_LANES] = { NULL };
+	aggr_scan_slice slices[AS_AGGR_MAX_LANES];
+
+	if (! (bbs[0] = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE))) {
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+		return;
+	}
+
+	for (uint32_t i = 0; i < n_lanes; i++) {
+		cf_ll_init(&lanes[i].recl, as_index_keys_ll_destroy_fn, false);
+		as_result_init(&lanes[i].result);
+
+		slices[i] = (aggr_scan_slice){ job, &lanes[i].recl, &bbs[i], rsv };
+		lanes[i].udata = (void*)&slices[i];
+	}
+
+	aggr_scan_collect collect = { job, lanes, n_lanes, 0 };
+
+	scan_reduce(rsv->tree, _job->set_id, aggr_scan_job_reduce_cb,
+			(void*)&collect);
+
+	// Each busy lane gets its own response buffer, so lanes don't contend.
+	for (uint32_t i = 1; i < n_lanes; i++) {
+		if (cf_ll_size(&lanes[i].recl) != 0 &&
+				! (bbs[i] = cf_buf_builder_create_size(
+						INIT_BUF_BUILDER_SIZE))) {
+			cf_ll_reduce(&lanes[i].recl, true, as_index_keys_ll_reduce_fn,
+					NULL);
+			as_job_manager_abandon_job(_job->mgr, _job,
+					AS_PROTO_RESULT_FAIL_UNKNOWN);
+		}
+	}
+
+	as_aggr_process_lanes(_job->ns, &job->aggr_call, lanes, n_lanes);
+
+	// Merge - in lane order, errors included, into lane 0's response. (Lane
+	// responses are partial stream results, like other partitions', and the
+	// client's reduce merges them.)
+	for (uint32_t i = 0; i < n_lanes; i++) {
+		if (lanes[i].ret != 0) {
+			aggr_scan_lane_error(&slices[i], &lanes[i]);
+		}
+
+		as_result_destroy(&lanes[i].result);
+		cf_ll_reduce(&lanes[i].recl, true, as_index_keys_ll_reduce_fn, NULL);
+
+		if (i == 0 || ! bbs[i]) {
+			continue;
+		}
+
+		if (bbs[i]->used_sz != 0) {
+			if (bbs[0]->used_sz + bbs[i]->used_sz > SCAN_CHUNK_LIMIT) {
+				if (bbs[0]->used_sz != 0) {
+					conn_scan_job_send_response((conn_scan_job*)job,
+							bbs[0]->buf, bbs[0]->used_sz);
+					cf_buf_builder_reset(bbs[0]);
+				}
+
+				conn_scan_job_send_response((conn_scan_job*)job, bbs[i]->buf,
+						bbs[i]->used_sz);
+			}
+			else {
+				cf_buf_builder_append_buf(&bbs[0], bbs[i]->buf,
+						bbs[i]->used_sz);
+			}
+		}
+
+		cf_buf_builder_free(bbs[i]);
+	}
+
+	if (bbs[0]->used_sz != 0) {
+		conn_scan_job_send_response((conn_scan_job*)job, bbs[0]->buf,
+				bbs[0]->used_sz);
+	}
+
+	// TODO - guts don't check buf_builder realloc failures rigorously.
+	cf_buf_builder_free(bbs[0]);
+}
+
+void
+aggr_scan_job_finish(as_job* _job)
+{
+	aggr_scan_job* job = (aggr_scan_job*)_job;
+
+	conn_scan_job_finish((conn_scan_job*)job);
+
+	if (job->aggr_call.def.arglist) {
+		as_list_destroy(job->aggr_call.def.arglist);
+		job->aggr_call.def.arglist = NULL;
+	}
+
+	switch (_job->abandoned) {
+	case 0:
+		cf_atomic_int_incr(&_job->ns->n_scan_aggr_complete);
+		break;
+	case AS_JOB_FAIL_USER_ABORT:
+		cf_atomic_int_incr(&_job->ns->n_scan_aggr_abort);
+		break;
+	case AS_JOB_FAIL_UNKNOWN:
+	case AS_JOB_FAIL_CLUSTER_KEY:
+	case AS_JOB_FAIL_RESPONSE_ERROR:
+	case AS_JOB_FAIL_RESPONSE_TIMEOUT:
+	default:
+		cf_atomic_int_incr(&_job->ns->n_scan_aggr_error);
+		break;
+	}
+
+	cf_info(AS_SCAN, "finished aggregation scan job %lu (%d)", _job->trid,
+			_job->abandoned);
+}
+
+void
+aggr_scan_job_destroy(as_job* _job)
+{
+	aggr_scan_job* job = (aggr_scan_job*)_job;
+
+	if (job->aggr_call.def.arglist) {
+		as_list_destroy(job->aggr_call.def.arglist);
+	}
+}
+
+void
+aggr_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+{
+	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_AGGR));
+	conn_scan_job_info((conn_scan_job*)_job, stat);
+}
+
+//----------------------------------------------------------
+// aggr_scan_job utilities.
+//
+
+bool
+aggr_scan_init(as_aggr_call* call, const as_transaction* tr)
+{
+	if (! udf_def_init_from_msg(&call->def, tr)) {
+		return false;
+	}
+
+	call->aggr_hooks = &scan_aggr_hooks;
+
+	return true;
+}
+
+void
+aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	aggr_scan_collect* collect = (aggr_scan_collect*)udata;
+	aggr_scan_job* job = collect->job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+
+	if (_job->abandoned != 0) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	as_index* r = r_ref->r;
+
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	uint32_t lane = (uint32_t)((collect->n_digests++ / AS_INDEX_KEYS_PER_ARR) %
+			collect->n_lanes);
+
+	if (! aggr_scan_add_digest(&collect->lanes[lane].recl, &r->keyd)) {
+		as_record_done(r_ref, ns);
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+		return;
+	}
+
+	cf_atomic64_incr(&_job->n_records_read);
+	as_record_done(r_ref, ns);
+	as_job_throttle(_job);
+}
+
+void
+aggr_scan_lane_error(aggr_scan_slice* slice, as_aggr_lane* lane)
+{
+	aggr_scan_job* job = slice->job;
+	as_job* _job = (as_job*)job;
+	char* rs = as_module_err_string(lane->ret);
+
+	if (lane->result.value) {
+		as_string* lua_s = as_string_fromval(lane->result.value);
+		char* lua_err = (char*)as_string_tostring(lua_s);
+
+		if (lua_err) {
+			int l_rs_len = strlen(rs);
+
+			rs = cf_realloc(rs, l_rs_len + strlen(lua_err) + 4);
+			sprintf(&rs[l_rs_len], " : %s", lua_err);
+		}
+	}
+
+	const as_val* v = (as_val*)as_string_new(rs, false);
+
+	aggr_scan_add_val_response(slice, v, false);
+	as_val_destroy(v);
+	cf_free(rs);
+	as_job_manager_abandon_job(_job->mgr, _job, AS_PROTO_RESULT_FAIL_UNKNOWN);
+}
+
+bool
+aggr_scan_add_digest(cf_ll* ll, cf_digest* keyd)
+{
+	as_index_keys_ll_element* tail_e = (as_index_keys_ll_element*)ll->tail;
+	as_index_keys_arr* keys_arr;
+
+	if (tail_e) {
+		keys_arr = tail_e->keys_arr;
+
+		if (keys_arr->num == AS_INDEX_KEYS_PER_ARR) {
+			tail_e = NULL;
+		}
+	}
+
+	if (! tail_e) {
+		if (! (keys_arr = as_index_get_keys_arr())) {
+			return false;
+		}
+
+		if (! (tail_e = cf_malloc(sizeof(as_index_keys_ll_element)))) {
+			cf_free(keys_arr);
+			return false;
+		}
+
+		tail_e->keys_arr = keys_arr;
+		cf_ll_append(ll, (cf_ll_element*)tail_e);
+	}
+
+	keys_arr->pindex_digs[keys_arr->num] = *keyd;
+	keys_arr->num++;
+
+	return true;
+}
+
+as_partition_reservation*
+aggr_scan_ptn_reserve(void* udata, as_namespace* ns, uint32_t pid,
+		as_partition_reservation* rsv)
+{
+	aggr_scan_slice* slice = (aggr_scan_slice*)udata;
+
+	return slice->rsv;
+}
+
+as_stream_status
+aggr_scan_ostream_write(void* udata, as_val* val)
+{
+	aggr_scan_slice* slice = (aggr_scan_slice*)udata;
+
+	if (val) {
+		aggr_scan_add_val_response(slice, val, true);
+		as_val_destroy(val);
+	}
+
+	return AS_STREAM_OK;
+}
+
+void
+aggr_scan_add_val_response(aggr_scan_slice* slice, const as_val* val,
+		bool success)
+{
+	uint32_t size = as_particle_asval_client_value_size(val);
+
+	as_msg_make_val_response_bufbuilder(val, slice->bb_r, size, success);
+
+	cf_buf_builder* bb = *slice->bb_r;
+	conn_scan_job* conn_job = (conn_scan_job*)slice->job;
+
+	// If we exceed the proto size limit, send accumulated data back to client
+	// and reset the buf-builder to start a new proto.
+	if (bb->used_sz > SCAN_CHUNK_LIMIT) {
+		if (! conn_scan_job_send_response(conn_job, bb->buf, bb->used_sz)) {
+			return;
+		}
+
+		cf_buf_builder_reset(bb);
+	}
+}
+
+
+
+//==============================================================================
+// udf_bg_scan_job derived class implementation.
+//
+
+//----------------------------------------------------------
+// udf_bg_scan_job typedefs and forward declarations.
+//
+
+typedef struct udf_bg_scan_job_s {
+	// Base object must be first:
+	as_job			_base;
+
+	// Derived class data:
+	iudf_origin		origin;
+	bool			is_durable_delete; // enterprise only
+	cf_atomic32		n_active_tr;
+	pthread_mutex_t	tr_lock; // changes to n_active_tr are made under this
+	pthread_cond_t	tr_cond; // signaled as transactions complete
+
+	cf_atomic64		n_successful_tr;
+	cf_atomic64		n_failed_tr;
+} udf_bg_scan_job;
+
+void udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void udf_bg_scan_job_finish(as_job* _job);
+void udf_bg_scan_job_destroy(as_job* _job);
+void udf_bg_scan_job_info(as_job* _job, as_mon_jobstat* stat);
+
+const as_job_vtable udf_bg_scan_job_vtable = {
+		udf_bg_scan_job_slice,
+		udf_bg_scan_job_finish,
+		udf_bg_scan_job_destroy,
+		udf_bg_scan_job_info
+};
+
+void udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+int udf_bg_scan_tr_complete(void* udata, int retcode);
+
+//----------------------------------------------------------
+// udf_bg_scan_job public API.
+//
+
+int
+udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+{
+	udf_bg_scan_job* job = cf_malloc(sizeof(udf_bg_scan_job));
+	as_job* _job = (as_job*)job;
+
+	if (! job) {
+		cf_warning(AS_SCAN, "udf-bg scan job failed alloc");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	scan_options options = { .sample_pct = 100 };
+	predexp_eval_t* predexp = NULL;
+
+	if (! get_scan_options(tr, &options) || ! get_scan_predexp(tr, &predexp)) {
+		cf_warning(AS_SCAN, "udf-bg scan job failed msg field processing");
+		cf_free(job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_job_init(_job, &udf_bg_scan_job_vtable, &g_scan_manager, RSV_WRITE,
+			as_transaction_trid(tr), ns, set_id, options.priority);
+
+	job->origin.predexp = predexp;
+	job->is_durable_delete = as_transaction_is_durable_delete(tr);
+	job->n_active_tr = 0;
+	pthread_mutex_init(&job->tr_lock, NULL);
+	pthread_cond_init(&job->tr_cond, NULL);
+	job->n_successful_tr = 0;
+	job->n_failed_tr = 0;
+
+	if (! udf_def_init_from_msg(&job->origin.def, tr)) {
+		cf_warning(AS_SCAN, "udf-bg scan job failed def init");
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	job->origin.cb = udf_bg_scan_tr_complete;
+	job->origin.udata = (void*)job;
+
+	cf_info(AS_SCAN, "starting udf-bg scan job %lu {%s:%s} priority %u",
+			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
+			_job->priority);
+
+	int result = as_job_manager_start_job(_job->mgr, _job);
+
+	if (result != 0) {
+		cf_warning(AS_SCAN, "udf-bg scan job %lu failed to start (%d)",
+				_job->trid, result);
+		as_job_destroy(_job);
+		return result;
+	}
+
+	if (as_msg_send_fin(&tr->from.proto_fd_h->sock, AS_PROTO_RESULT_OK)) {
+		tr->from.proto_fd_h->last_used = cf_getms();
+		as_end_of_transaction_ok(tr->from.proto_fd_h);
+	}
+	else {
+		cf_warning(AS_SCAN, "udf-bg scan job error sending fin");
+		as_end_of_transaction_force_close(tr->from.proto_fd_h);
+		// No point returning an error - it can't be reported on this socket.
+	}
+
+	tr->from.proto_fd_h = NULL;
+
+	return AS_PROTO_RESULT_OK;
+}
+
+//----------------------------------------------------------
+// udf_bg_scan_job mandatory scan_job interface.
+//
+
+void
+udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+{
+	scan_reduce(rsv->tree, _job->set_id, udf_bg_scan_job_reduce_cb,
+			(void*)_job);
+}
+
+void
+udf_bg_scan_job_finish(as_job* _job)
+{
+	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
 
-	if (m->n_ops == 0) {
-		return NULL;
+	pthread_mutex_lock(&job->tr_lock);
+
+	while (cf_atomic32_get(job->n_active_tr) != 0) {
+		pthread_cond_wait(&job->tr_cond, &job->tr_lock);
 	}
 
-	cf_vector* v  = cf_vector_create(AS_ID_BIN_SZ, m->n_ops, 0);
+	pthread_mutex_unlock(&job->tr_lock);
 
-	as_msg_op* op = NULL;
-	int n = 0;
+	switch (_job->abandoned) {
+	case 0:
+		cf_atomic_int_incr(&_job->ns->n_scan_udf_bg_complete);
+		break;
+	case AS_JOB_FAIL_USER_ABORT:
+		cf_atomic_int_incr(&_job->ns->n_scan_udf_bg_abort);
+		break;
+	case AS_JOB_FAIL_UNKNOWN:
+	case AS_JOB_FAIL_CLUSTER_KEY:
+	default:
+		cf_atomic_int_incr(&_job->ns->n_scan_udf_bg_error);
+		break;
+	}
 
-	while ((op = as_msg_op_iterate(m, op, &n)) != NULL) {
-		if (op->name_sz >= AS_ID_BIN_SZ) {
-			cf_warning(AS_SCAN, "basic scan job bin name too long");
-			cf_vector_destroy(v);
-			*result = AS_PROTO_RESULT_FAIL_BIN_NAME;
-			return NULL;
-		}
+	cf_info(AS_SCAN, "finished udf-bg scan job %lu (%d)", _job->trid,
+			_job->abandoned);
+}
 
-		char bin_name[AS_ID_BIN_SZ];
+void
+udf_bg_scan_job_destroy(as_job* _job)
+{
+	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
 
-		memcpy(bin_name, op->name, op->name_sz);
-		bin_name[op->name_sz] = 0;
-		cf_vector_append_unique(v, (void*)bin_name);
+	iudf_origin_destroy(&job->origin);
+	pthread_cond_destroy(&job->tr_cond);
+	pthread_mutex_destroy(&job->tr_lock);
+}
+
+void
+udf_bg_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+{
+	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_UDF_BG));
+	stat->net_io_bytes = sizeof(cl_msg); // size of original synchronous fin
+
+	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
+	char* extra = stat->jdata + strlen(stat->jdata);
+
+	sprintf(extra, ":udf-filename=%s:udf-function=%s:udf-active=%u:udf-success=%lu:udf-failed=%lu",
+			job->origin.def.filename, job->origin.def.function,
+			cf_atomic32_get(job->n_active_tr),
+			cf_atomic64_get(job->n_successful_tr),
+			cf_atomic64_get(job->n_failed_tr));
+}
+
+//----------------------------------------------------------
+// udf_bg_scan_job utilities.
+//
+
+void
+udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	as_job* _job = (as_job*)udata;
+	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
+	as_namespace* ns = _job->ns;
+
+	if (_job->abandoned != 0) {
+		as_record_done(r_ref, ns);
+		return;
 	}
 
-	return v;
+	as_index* r = r_ref->r;
+
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = NULL };
+
+	if (job->origin.predexp &&
+			! predexp_matches_metadata(job->origin.predexp, &predargs)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	// Save this before releasing record.
+	cf_digest d = r->keyd;
+
+	// Release record lock before enqueuing transaction.
+	as_record_done(r_ref, ns);
+
+	as_transaction tr;
+
+	if (as_transaction_init_iudf(&tr, ns, &d, &job->origin,
+			job->is_durable_delete) != 0) {
+		as_job_manager_abandon_job(_job->mgr, _job, AS_JOB_FAIL_UNKNOWN);
+		return;
+	}
+
+	// Wake as soon as a slot frees up, rather than polling - polling capped
+	// throughput well below what the in-flight limit allows.
+	pthread_mutex_lock(&job->tr_lock);
+
+	while (cf_atomic32_get(job->n_active_tr) >
+			g_config.scan_max_udf_transactions) {
+		pthread_cond_wait(&job->tr_cond, &job->tr_lock);
+	}
+
+	cf_atomic32_incr(&job->n_active_tr);
+	pthread_mutex_unlock(&job->tr_lock);
+
+	cf_atomic64_incr(&_job->n_records_read);
+
+	as_tsvc_enqueue(&tr);
+	as_job_throttle(_job);
+}
+
+int
+udf_bg_scan_tr_complete(void* udata, int retcode)
+{
+	udf_bg_scan_job* job = (udf_bg_scan_job*)udata;
+
+	cf_atomic64_incr(retcode == 0 ? &job->n_successful_tr : &job->n_failed_tr);
+
+	// Job may be destroyed as soon as the lock is released.
+	pthread_mutex_lock(&job->tr_lock);
+	cf_atomic32_decr(&job->n_active_tr);
+	pthread_cond_signal(&job->tr_cond);
+	pthread_mutex_unlock(&job->tr_lock);
+
+	return 0;
 }
 
 
 
 //==============================================================================
-// aggr_scan_job derived class implementation.
+// delete_scan_job derived class implementation.
 //
 
 //----------------------------------------------------------
-// aggr_scan_job typedefs and forward declarations.
+// delete_scan_job typedefs and forward declarations.
 //
 
-typedef struct aggr_scan_job_s {
+// Digests per replica drop message - 10K of digests.
+#define DELETE_SCAN_BATCH_SIZE 512
+
+typedef struct delete_scan_job_s {
 	// Base object must be first:
-	conn_scan_job	_base;
+	as_job			_base;
 
 	// Derived class data:
-	as_aggr_call	aggr_call;
-} aggr_scan_job;
-
-void aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
-void aggr_scan_job_finish(as_job* _job);
-void aggr_scan_job_destroy(as_job* _job);
-void aggr_scan_job_info(as_job* _job, as_mon_jobstat* stat);
-
-const as_job_vtable aggr_scan_job_vtable = {
-		aggr_scan_job_slice,
-		aggr_scan_job_finish,
-		aggr_scan_job_destroy,
-		aggr_scan_job_info
+	predexp_eval_t*	predexp;
+	cf_atomic64		n_deleted;
+	cf_atomic64		n_queued; // handed to nsup - partition needed dup-res
+} delete_scan_job;
+
+void delete_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void delete_scan_job_finish(as_job* _job);
+void delete_scan_job_destroy(as_job* _job);
+void delete_scan_job_info(as_job* _job, as_mon_jobstat* stat);
+
+const as_job_vtable delete_scan_job_vtable = {
+		delete_scan_job_slice,
+		delete_scan_job_finish,
+		delete_scan_job_destroy,
+		delete_scan_job_info
 };
 
-typedef struct aggr_scan_slice_s {
-	aggr_scan_job*				job;
-	cf_ll*						ll;
-	cf_buf_builder**			bb_r;
+typedef struct delete_scan_slice_s {
+	delete_scan_job*			job;
 	as_partition_reservation*	rsv;
-} aggr_scan_slice;
-
-bool aggr_scan_init(as_aggr_call* call, const as_transaction* tr);
-void aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
-bool aggr_scan_add_digest(cf_ll* ll, cf_digest* keyd);
-as_partition_reservation* aggr_scan_ptn_reserve(void* udata, as_namespace* ns,
-		uint32_t pid, as_partition_reservation* rsv);
-as_stream_status aggr_scan_ostream_write(void* udata, as_val* val);
-
-const as_aggr_hooks scan_aggr_hooks = {
-	.ostream_write = aggr_scan_ostream_write,
-	.set_error     = NULL,
-	.ptn_reserve   = aggr_scan_ptn_reserve,
-	.ptn_release   = NULL,
-	.pre_check     = NULL
-};
+	uint32_t					n_keyds;
+	cf_digest					keyds[DELETE_SCAN_BATCH_SIZE];
+} delete_scan_slice;
 
-void aggr_scan_add_val_response(aggr_scan_slice* slice, const as_val* val,
-		bool success);
+void delete_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+bool delete_scan_job_matches_record(delete_scan_job* job, as_index* r);
+void delete_scan_job_drop(delete_scan_slice* slice, as_index_ref* r_ref);
+void delete_scan_job_flush_drops(delete_scan_slice* slice);
 
 //----------------------------------------------------------
-// aggr_scan_job public API.
+// delete_scan_job public API.
 //
 
 int
-aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+delete_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 {
-	aggr_scan_job* job = cf_malloc(sizeof(aggr_scan_job));
+	if (as_transaction_is_durable_delete(tr)) {
+		cf_warning(AS_SCAN, "durable delete is an enterprise feature");
+		return AS_PROTO_RESULT_FAIL_ENTERPRISE_ONLY;
+	}
+
+	delete_scan_job* job = cf_malloc(sizeof(delete_scan_job));
 	as_job* _job = (as_job*)job;
 
 	if (! job) {
-		cf_warning(AS_SCAN, "aggregation scan job failed alloc");
+		cf_warning(AS_SCAN, "delete scan job failed alloc");
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
 	scan_options options = { .sample_pct = 100 };
-	uint32_t timeout = CF_SOCKET_TIMEOUT;
+	predexp_eval_t* predexp = NULL;
 
-	if (! get_scan_options(tr, &options) ||
-			! get_scan_socket_timeout(tr, &timeout)) {
-		cf_warning(AS_SCAN, "aggregation scan job failed msg field processing");
+	if (! get_scan_options(tr, &options) || ! get_scan_predexp(tr, &predexp)) {
+		cf_warning(AS_SCAN, "delete scan job failed msg field processing");
 		cf_free(job);
 		return AS_PROTO_RESULT_FAIL_PARAMETER;
 	}
 
-	if (as_transaction_has_predexp(tr)) {
-		cf_warning(AS_SCAN, "aggregation scans do not support predexp filters");
-		cf_free(job);
-		return AS_PROTO_RESULT_FAIL_UNSUPPORTED_FEATURE;
-	}
-
-	as_job_init(_job, &aggr_scan_job_vtable, &g_scan_manager, RSV_WRITE,
+	as_job_init(_job, &delete_scan_job_vtable, &g_scan_manager, RSV_WRITE,
 			as_transaction_trid(tr), ns, set_id, options.priority);
 
-	if (! aggr_scan_init(&job->aggr_call, tr)) {
-		cf_warning(AS_SCAN, "aggregation scan job failed call init");
-		as_job_destroy(_job);
-		return AS_PROTO_RESULT_FAIL_PARAMETER;
-	}
-
-	// Take ownership of socket from transaction.
-	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h, timeout);
+	job->predexp = predexp;
+	job->n_deleted = 0;
+	job->n_queued = 0;
 
-	cf_info(AS_SCAN, "starting aggregation scan job %lu {%s:%s} priority %u",
+	cf_info(AS_SCAN, "starting delete scan job %lu {%s:%s} priority %u",
 			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
 			_job->priority);
 
 	int result = as_job_manager_start_job(_job->mgr, _job);
 
 	if (result != 0) {
-		cf_warning(AS_SCAN, "aggregation scan job %lu failed to start (%d)",
+		cf_warning(AS_SCAN, "delete scan job %lu failed to start (%d)",
 				_job->trid, result);
-		conn_scan_job_disown_fd((conn_scan_job*)job);
 		as_job_destroy(_job);
 		return result;
 	}
 
+	if (as_msg_send_fin(&tr->from.proto_fd_h->sock, AS_PROTO_RESULT_OK)) {
+		tr->from.proto_fd_h->last_used = cf_getms();
+		as_end_of_transaction_ok(tr->from.proto_fd_h);
+	}
+	else {
+		cf_warning(AS_SCAN, "delete scan job error sending fin");
+		as_end_of_transaction_force_close(tr->from.proto_fd_h);
+		// No point returning an error - it can't be reported on this socket.
+	}
+
+	tr->from.proto_fd_h = NULL;
+
 	return AS_PROTO_RESULT_OK;
 }
 
 //----------------------------------------------------------
-// aggr_scan_job mandatory scan_job interface.
+// delete_scan_job mandatory scan_job interface.
 //
 
 void
-aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+delete_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
 {
-	aggr_scan_job* job = (aggr_scan_job*)_job;
-	cf_ll ll;
-	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
-
-	if (! bb) {
-		as_job_manager_abandon_job(_job->mgr, _job,
-				AS_PROTO_RESULT_FAIL_UNKNOWN);
-		return;
-	}
-
-	cf_ll_init(&ll, as_index_keys_ll_destroy_fn, false);
-
-	aggr_scan_slice slice = { job, &ll, &bb, rsv };
-
-	as_index_reduce_live(rsv->tree, aggr_scan_job_reduce_cb, (void*)&slice);
-
-	if (cf_ll_size(&ll) != 0) {
-		as_result result;
-		as_result_init(&result);
+	delete_scan_slice* slice = cf_malloc(sizeof(delete_scan_slice));
 
-		int ret = as_aggr_process(_job->ns, &job->aggr_call, &ll, (void*)&slice,
-				&result);
+	cf_assert(slice, AS_SCAN, "failed delete scan slice alloc");
 
-		if (ret != 0) {
-			char* rs = as_module_err_string(ret);
+	slice->job = (delete_scan_job*)_job;
+	slice->rsv = rsv;
+	slice->n_keyds = 0;
 
-			if (result.value) {
-				as_string* lua_s = as_string_fromval(result.value);
-				char* lua_err = (char*)as_string_tostring(lua_s);
+	scan_reduce(rsv->tree, _job->set_id, delete_scan_job_reduce_cb,
+			(void*)slice);
 
-				if (lua_err) {
-					int l_rs_len = strlen(rs);
-
-					rs = cf_realloc(rs, l_rs_len + strlen(lua_err) + 4);
-					sprintf(&rs[l_rs_len], " : %s", lua_err);
-				}
-			}
-
-			const as_val* v = (as_val*)as_string_new(rs, false);
-
-			aggr_scan_add_val_response(&slice, v, false);
-			as_val_destroy(v);
-			cf_free(rs);
-			as_job_manager_abandon_job(_job->mgr, _job,
-					AS_PROTO_RESULT_FAIL_UNKNOWN);
-		}
-
-		as_result_destroy(&result);
-	}
-
-	cf_ll_reduce(&ll, true, as_index_keys_ll_reduce_fn, NULL);
-
-	if (bb->used_sz != 0) {
-		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
-	}
-
-	// TODO - guts don't check buf_builder realloc failures rigorously.
-	cf_buf_builder_free(bb);
+	delete_scan_job_flush_drops(slice);
+	cf_free(slice);
 }
 
 void
-aggr_scan_job_finish(as_job* _job)
+delete_scan_job_finish(as_job* _job)
 {
-	aggr_scan_job* job = (aggr_scan_job*)_job;
-
-	conn_scan_job_finish((conn_scan_job*)job);
-
-	if (job->aggr_call.def.arglist) {
-		as_list_destroy(job->aggr_call.def.arglist);
-		job->aggr_call.def.arglist = NULL;
-	}
-
 	switch (_job->abandoned) {
 	case 0:
-		cf_atomic_int_incr(&_job->ns->n_scan_aggr_complete);
+		cf_atomic_int_incr(&_job->ns->n_scan_delete_complete);
 		break;
 	case AS_JOB_FAIL_USER_ABORT:
-		cf_atomic_int_incr(&_job->ns->n_scan_aggr_abort);
+		cf_atomic_int_incr(&_job->ns->n_scan_delete_abort);
 		break;
 	case AS_JOB_FAIL_UNKNOWN:
 	case AS_JOB_FAIL_CLUSTER_KEY:
-	case AS_JOB_FAIL_RESPONSE_ERROR:
-	case AS_JOB_FAIL_RESPONSE_TIMEOUT:
 	default:
-		cf_atomic_int_incr(&_job->ns->n_scan_aggr_error);
+		cf_atomic_int_incr(&_job->ns->n_scan_delete_error);
 		break;
 	}
 
-	cf_info(AS_SCAN, "finished aggregation scan job %lu (%d)", _job->trid,
-			_job->abandoned);
+	delete_scan_job* job = (delete_scan_job*)_job;
+
+	cf_info(AS_SCAN, "finished delete scan job %lu (%d) deleted %lu queued %lu",
+			_job->trid, _job->abandoned, cf_atomic64_get(job->n_deleted),
+			cf_atomic64_get(job->n_queued));
 }
 
 void
-aggr_scan_job_destroy(as_job* _job)
+delete_scan_job_destroy(as_job* _job)
 {
-	aggr_scan_job* job = (aggr_scan_job*)_job;
+	delete_scan_job* job = (delete_scan_job*)_job;
 
-	if (job->aggr_call.def.arglist) {
-		as_list_destroy(job->aggr_call.def.arglist);
+	if (job->predexp) {
+		predexp_destroy(job->predexp);
 	}
 }
 
 void
-aggr_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+delete_scan_job_info(as_job* _job, as_mon_jobstat* stat)
 {
-	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_AGGR));
-	conn_scan_job_info((conn_scan_job*)_job, stat);
+	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_DELETE));
+	stat->net_io_bytes = sizeof(cl_msg); // size of original synchronous fin
+
+	delete_scan_job* job = (delete_scan_job*)_job;
+	char* extra = stat->jdata + strlen(stat->jdata);
+
+	sprintf(extra, ":deleted=%lu:queued=%lu", cf_atomic64_get(job->n_deleted),
+			cf_atomic64_get(job->n_queued));
 }
 
 //----------------------------------------------------------
-// aggr_scan_job utilities.
+// delete_scan_job utilities.
 //
 
-bool
-aggr_scan_init(as_aggr_call* call, const as_transaction* tr)
-{
-	if (! udf_def_init_from_msg(&call->def, tr)) {
-		return false;
-	}
-
-	call->aggr_hooks = &scan_aggr_hooks;
-
-	return true;
-}
-
 void
-aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+delete_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 {
-	aggr_scan_slice* slice = (aggr_scan_slice*)udata;
-	aggr_scan_job* job = slice->job;
+	delete_scan_slice* slice = (delete_scan_slice*)udata;
+	delete_scan_job* job = slice->job;
 	as_job* _job = (as_job*)job;
 	as_namespace* ns = _job->ns;
 
@@ -1103,273 +3101,222 @@ aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 		return;
 	}
 
-	if (! aggr_scan_add_digest(slice->ll, &r->keyd)) {
+	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = NULL };
+
+	if (job->predexp && (! predexp_matches_metadata(job->predexp, &predargs) ||
+			! delete_scan_job_matches_record(job, r))) {
 		as_record_done(r_ref, ns);
-		as_job_manager_abandon_job(_job->mgr, _job,
-				AS_PROTO_RESULT_FAIL_UNKNOWN);
 		return;
 	}
 
 	cf_atomic64_incr(&_job->n_records_read);
-	as_record_done(r_ref, ns);
+
+	// Records of a partition awaiting duplicate resolution may have newer
+	// versions elsewhere - delete these by transaction, as nsup does.
+	if (slice->rsv->n_dupl != 0) {
+		cf_digest keyd = r->keyd;
+
+		as_record_done(r_ref, ns);
+		as_nsup_queue_delete(ns, &keyd);
+		cf_atomic64_incr(&job->n_queued);
+		as_job_throttle(_job);
+		return;
+	}
+
+	delete_scan_job_drop(slice, r_ref);
+	cf_atomic64_incr(&job->n_deleted);
+	as_job_throttle(_job);
 }
 
+// Returns true if the predexp needs no bins, or matches them.
 bool
-aggr_scan_add_digest(cf_ll* ll, cf_digest* keyd)
+delete_scan_job_matches_record(delete_scan_job* job, as_index* r)
 {
-	as_index_keys_ll_element* tail_e = (as_index_keys_ll_element*)ll->tail;
-	as_index_keys_arr* keys_arr;
-
-	if (tail_e) {
-		keys_arr = tail_e->keys_arr;
-
-		if (keys_arr->num == AS_INDEX_KEYS_PER_ARR) {
-			tail_e = NULL;
-		}
+	if (! predexp_needs_record(job->predexp)) {
+		return true;
 	}
 
-	if (! tail_e) {
-		if (! (keys_arr = as_index_get_keys_arr())) {
-			return false;
-		}
+	as_namespace* ns = ((as_job*)job)->ns;
+	as_storage_rd rd;
 
-		if (! (tail_e = cf_malloc(sizeof(as_index_keys_ll_element)))) {
-			cf_free(keys_arr);
-			return false;
-		}
+	as_storage_record_open(ns, r, &rd);
+	as_storage_rd_load_n_bins(&rd); // TODO - handle error returned
 
-		tail_e->keys_arr = keys_arr;
-		cf_ll_append(ll, (cf_ll_element*)tail_e);
-	}
+	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
 
-	keys_arr->pindex_digs[keys_arr->num] = *keyd;
-	keys_arr->num++;
+	as_storage_rd_load_bins(&rd, stack_bins); // TODO - handle error returned
 
-	return true;
-}
+	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = &rd };
+	bool matches = predexp_matches_record(job->predexp, &predargs);
 
-as_partition_reservation*
-aggr_scan_ptn_reserve(void* udata, as_namespace* ns, uint32_t pid,
-		as_partition_reservation* rsv)
-{
-	aggr_scan_slice* slice = (aggr_scan_slice*)udata;
+	as_storage_record_close(&rd);
 
-	return slice->rsv;
+	return matches;
 }
 
-as_stream_status
-aggr_scan_ostream_write(void* udata, as_val* val)
+// Drops the record on master, like a client delete - replicas are told in
+// batches.
+void
+delete_scan_job_drop(delete_scan_slice* slice, as_index_ref* r_ref)
 {
-	aggr_scan_slice* slice = (aggr_scan_slice*)udata;
+	as_namespace* ns = slice->rsv->ns;
+	as_index* r = r_ref->r;
 
-	if (val) {
-		aggr_scan_add_val_response(slice, val, true);
-		as_val_destroy(val);
+	if (ns->storage_data_in_memory) {
+		record_delete_adjust_sindex(r, ns);
 	}
 
-	return AS_STREAM_OK;
-}
+	// Save these for XDR and the replicas.
+	cf_digest keyd = r->keyd;
+	uint16_t set_id = as_index_get_set_id(r);
 
-void
-aggr_scan_add_val_response(aggr_scan_slice* slice, const as_val* val,
-		bool success)
-{
-	uint32_t size = as_particle_asval_client_value_size(val);
+	as_index_delete(slice->rsv->tree, &keyd);
+	as_record_done(r_ref, ns);
 
-	as_msg_make_val_response_bufbuilder(val, slice->bb_r, size, success);
+	as_cdc_write(ns, slice->rsv->p->id, &keyd, 0, cf_clepoch_milliseconds(),
+			AS_CDC_OP_DELETE);
 
-	cf_buf_builder* bb = *slice->bb_r;
-	conn_scan_job* conn_job = (conn_scan_job*)slice->job;
+	if (xdr_must_ship_delete(ns, false, false)) {
+		xdr_write(ns, &keyd, 0, 0, XDR_OP_TYPE_DROP, set_id, NULL);
+	}
 
-	// If we exceed the proto size limit, send accumulated data back to client
-	// and reset the buf-builder to start a new proto.
-	if (bb->used_sz > SCAN_CHUNK_LIMIT) {
-		if (! conn_scan_job_send_response(conn_job, bb->buf, bb->used_sz)) {
-			return;
-		}
+	slice->keyds[slice->n_keyds++] = keyd;
 
-		cf_buf_builder_reset(bb);
+	if (slice->n_keyds == DELETE_SCAN_BATCH_SIZE) {
+		delete_scan_job_flush_drops(slice);
+	}
+}
+
+void
+delete_scan_job_flush_drops(delete_scan_slice* slice)
+{
+	if (slice->n_keyds != 0) {
+		repl_write_send_drops(slice->rsv, slice->keyds, slice->n_keyds);
+		slice->n_keyds = 0;
 	}
 }
 
 
 
 //==============================================================================
-// udf_bg_scan_job derived class implementation.
+// verify_scan_job derived class implementation.
 //
 
 //----------------------------------------------------------
-// udf_bg_scan_job typedefs and forward declarations.
+// verify_scan_job typedefs and forward declarations.
 //
 
-typedef struct udf_bg_scan_job_s {
+typedef struct verify_scan_job_s {
 	// Base object must be first:
 	as_job			_base;
 
 	// Derived class data:
-	iudf_origin		origin;
-	bool			is_durable_delete; // enterprise only
-	cf_atomic32		n_active_tr;
-
-	cf_atomic64		n_successful_tr;
-	cf_atomic64		n_failed_tr;
-} udf_bg_scan_job;
-
-void udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
-void udf_bg_scan_job_finish(as_job* _job);
-void udf_bg_scan_job_destroy(as_job* _job);
-void udf_bg_scan_job_info(as_job* _job, as_mon_jobstat* stat);
-
-const as_job_vtable udf_bg_scan_job_vtable = {
-		udf_bg_scan_job_slice,
-		udf_bg_scan_job_finish,
-		udf_bg_scan_job_destroy,
-		udf_bg_scan_job_info
+	cf_atomic64		n_failed;
+} verify_scan_job;
+
+void verify_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void verify_scan_job_finish(as_job* _job);
+void verify_scan_job_destroy(as_job* _job);
+void verify_scan_job_info(as_job* _job, as_mon_jobstat* stat);
+
+const as_job_vtable verify_scan_job_vtable = {
+		verify_scan_job_slice,
+		verify_scan_job_finish,
+		verify_scan_job_destroy,
+		verify_scan_job_info
 };
 
-void udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
-int udf_bg_scan_tr_complete(void* udata, int retcode);
+void verify_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
 
 //----------------------------------------------------------
-// udf_bg_scan_job public API.
+// verify_scan_job public API.
 //
 
 int
-udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+verify_scan_job_start(as_namespace* ns, uint16_t set_id, uint32_t rps,
+		uint64_t* p_trid)
 {
-	udf_bg_scan_job* job = cf_malloc(sizeof(udf_bg_scan_job));
+	verify_scan_job* job = cf_malloc(sizeof(verify_scan_job));
 	as_job* _job = (as_job*)job;
 
 	if (! job) {
-		cf_warning(AS_SCAN, "udf-bg scan job failed alloc");
+		cf_warning(AS_SCAN, "verify scan job failed alloc");
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
-	scan_options options = { .sample_pct = 100 };
-	predexp_eval_t* predexp = NULL;
-
-	if (! get_scan_options(tr, &options) || ! get_scan_predexp(tr, &predexp)) {
-		cf_warning(AS_SCAN, "udf-bg scan job failed msg field processing");
-		cf_free(job);
-		return AS_PROTO_RESULT_FAIL_PARAMETER;
-	}
-
-	as_job_init(_job, &udf_bg_scan_job_vtable, &g_scan_manager, RSV_WRITE,
-			as_transaction_trid(tr), ns, set_id, options.priority);
-
-	job->origin.predexp = predexp;
-	job->is_durable_delete = as_transaction_is_durable_delete(tr);
-	job->n_active_tr = 0;
-	job->n_successful_tr = 0;
-	job->n_failed_tr = 0;
-
-	if (! udf_def_init_from_msg(&job->origin.def, tr)) {
-		cf_warning(AS_SCAN, "udf-bg scan job failed def init");
-		as_job_destroy(_job);
-		return AS_PROTO_RESULT_FAIL_PARAMETER;
-	}
+	// Note - trid 0 makes the job manager assign one.
+	as_job_init(_job, &verify_scan_job_vtable, &g_scan_manager, RSV_WRITE, 0,
+			ns, set_id, AS_JOB_PRIORITY_LOW);
 
-	job->origin.cb = udf_bg_scan_tr_complete;
-	job->origin.udata = (void*)job;
+	as_job_set_rps(_job, rps);
+	job->n_failed = 0;
 
-	cf_info(AS_SCAN, "starting udf-bg scan job %lu {%s:%s} priority %u",
-			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
-			_job->priority);
+	cf_info(AS_SCAN, "starting verify scan job %lu {%s:%s} rps %u",
+			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id), rps);
 
 	int result = as_job_manager_start_job(_job->mgr, _job);
 
 	if (result != 0) {
-		cf_warning(AS_SCAN, "udf-bg scan job %lu failed to start (%d)",
+		cf_warning(AS_SCAN, "verify scan job %lu failed to start (%d)",
 				_job->trid, result);
 		as_job_destroy(_job);
 		return result;
 	}
 
-	if (as_msg_send_fin(&tr->from.proto_fd_h->sock, AS_PROTO_RESULT_OK)) {
-		tr->from.proto_fd_h->last_used = cf_getms();
-		as_end_of_transaction_ok(tr->from.proto_fd_h);
-	}
-	else {
-		cf_warning(AS_SCAN, "udf-bg scan job error sending fin");
-		as_end_of_transaction_force_close(tr->from.proto_fd_h);
-		// No point returning an error - it can't be reported on this socket.
-	}
-
-	tr->from.proto_fd_h = NULL;
+	*p_trid = _job->trid;
 
 	return AS_PROTO_RESULT_OK;
 }
 
 //----------------------------------------------------------
-// udf_bg_scan_job mandatory scan_job interface.
+// verify_scan_job mandatory scan_job interface.
 //
 
 void
-udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+verify_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
 {
-	as_index_reduce_live(rsv->tree, udf_bg_scan_job_reduce_cb, (void*)_job);
+	scan_reduce(rsv->tree, _job->set_id, verify_scan_job_reduce_cb,
+			(void*)_job);
 }
 
 void
-udf_bg_scan_job_finish(as_job* _job)
+verify_scan_job_finish(as_job* _job)
 {
-	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
-
-	while (cf_atomic32_get(job->n_active_tr) != 0) {
-		usleep(100);
-	}
-
-	switch (_job->abandoned) {
-	case 0:
-		cf_atomic_int_incr(&_job->ns->n_scan_udf_bg_complete);
-		break;
-	case AS_JOB_FAIL_USER_ABORT:
-		cf_atomic_int_incr(&_job->ns->n_scan_udf_bg_abort);
-		break;
-	case AS_JOB_FAIL_UNKNOWN:
-	case AS_JOB_FAIL_CLUSTER_KEY:
-	default:
-		cf_atomic_int_incr(&_job->ns->n_scan_udf_bg_error);
-		break;
-	}
+	verify_scan_job* job = (verify_scan_job*)_job;
 
-	cf_info(AS_SCAN, "finished udf-bg scan job %lu (%d)", _job->trid,
-			_job->abandoned);
+	cf_info(AS_SCAN, "finished verify scan job %lu (%d) verified %lu failed %lu",
+			_job->trid, _job->abandoned,
+			cf_atomic64_get(_job->n_records_read),
+			cf_atomic64_get(job->n_failed));
 }
 
 void
-udf_bg_scan_job_destroy(as_job* _job)
+verify_scan_job_destroy(as_job* _job)
 {
-	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
-
-	iudf_origin_destroy(&job->origin);
+	// Nothing to do.
 }
 
 void
-udf_bg_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+verify_scan_job_info(as_job* _job, as_mon_jobstat* stat)
 {
-	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_UDF_BG));
-	stat->net_io_bytes = sizeof(cl_msg); // size of original synchronous fin
+	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_VERIFY));
+	stat->net_io_bytes = 0;
 
-	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
+	verify_scan_job* job = (verify_scan_job*)_job;
 	char* extra = stat->jdata + strlen(stat->jdata);
 
-	sprintf(extra, ":udf-filename=%s:udf-function=%s:udf-active=%u:udf-success=%lu:udf-failed=%lu",
-			job->origin.def.filename, job->origin.def.function,
-			cf_atomic32_get(job->n_active_tr),
-			cf_atomic64_get(job->n_successful_tr),
-			cf_atomic64_get(job->n_failed_tr));
+	sprintf(extra, ":verify-failed=%lu", cf_atomic64_get(job->n_failed));
 }
 
 //----------------------------------------------------------
-// udf_bg_scan_job utilities.
+// verify_scan_job utilities.
 //
 
 void
-udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+verify_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_job* _job = (as_job*)udata;
-	udf_bg_scan_job* job = (udf_bg_scan_job*)_job;
+	verify_scan_job* job = (verify_scan_job*)_job;
 	as_namespace* ns = _job->ns;
 
 	if (_job->abandoned != 0) {
@@ -1384,47 +3331,19 @@ udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 		return;
 	}
 
-	predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = NULL };
-
-	if (job->origin.predexp &&
-			! predexp_matches_metadata(job->origin.predexp, &predargs)) {
-		as_record_done(r_ref, ns);
-		return;
-	}
-
-	// Save this before releasing record.
-	cf_digest d = r->keyd;
+	as_storage_rd rd;
 
-	// Release record lock before enqueuing transaction.
-	as_record_done(r_ref, ns);
+	as_storage_record_open(ns, r, &rd);
 
-	// TODO - replace this mechanism with signal-based counter?
-	while (cf_atomic32_get(job->n_active_tr) >
-			g_config.scan_max_udf_transactions) {
-		usleep(50);
+	if (! as_storage_record_verify(&rd)) {
+		cf_atomic64_incr(&job->n_failed);
+		cf_warning_digest(AS_SCAN, &r->keyd, "{%s} verify scan job %lu failed record ",
+				ns->name, _job->trid);
 	}
 
-	as_transaction tr;
-
-	if (as_transaction_init_iudf(&tr, ns, &d, &job->origin,
-			job->is_durable_delete) != 0) {
-		as_job_manager_abandon_job(_job->mgr, _job, AS_JOB_FAIL_UNKNOWN);
-		return;
-	}
+	as_storage_record_close(&rd);
+	as_record_done(r_ref, ns);
 
 	cf_atomic64_incr(&_job->n_records_read);
-	cf_atomic32_incr(&job->n_active_tr);
-
-	as_tsvc_enqueue(&tr);
-}
-
-int
-udf_bg_scan_tr_complete(void* udata, int retcode)
-{
-	udf_bg_scan_job* job = (udf_bg_scan_job*)udata;
-
-	cf_atomic32_decr(&job->n_active_tr);
-	cf_atomic64_incr(retcode == 0 ? &job->n_successful_tr : &job->n_failed_tr);
-
-	return 0;
+	as_job_throttle(_job);
 }
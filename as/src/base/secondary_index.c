@@ -48,7 +48,7 @@
  *
  * BOOT INDEX
  *
- * as_sindex_boot_populateall --> If fast restart or data in memory and load at start up --> as_sbld_build_all
+ * as_sindex_boot_populateall --> If fast restart --> as_sbld_build_all
  *
  * SBIN creation
  *
@@ -122,6 +122,15 @@
 
 #define AS_SINDEX_PROP_KEY_SIZE (AS_SET_NAME_MAX_SIZE + 20) // setname_binid_typeid
 
+// A write-path op left for a delta worker - see as_sindex_apply_deltas().
+typedef struct sindex_delta_s {
+	as_sindex_op op;
+	cf_digest keyd;
+	as_sindex_key skey;
+} sindex_delta;
+
+static void pimd_apply_deltas(as_sindex *si, as_sindex_pmetadata *pimd, uint32_t max_n);
+
 
 // ************************************************************************************************
 //                                        BINID HAS SINDEX
@@ -299,6 +308,46 @@ as_sindex_pktype(as_sindex_metadata * imd)
 	return AS_SINDEX_ERR_UNKNOWN_KEYTYPE;
 }
 
+/*
+ * Function as_sindex_string_to_ordered_skey
+ *     Makes a string key which the index btree orders as memcmp would order
+ *     the strings. The btree compares uint160 keys from the last byte down, so
+ *     the first AS_SINDEX_STR_PREFIX_SZ bytes of the string go in back to
+ *     front, and byte 0 holds the length - or 0xFF if the string didn't fit,
+ *     in which case the key stands for every string sharing that prefix.
+ */
+void
+as_sindex_string_to_ordered_skey(const char *str, uint32_t len, cf_digest *skey)
+{
+	uint8_t *key = skey->digest;
+	uint32_t n = len < AS_SINDEX_STR_PREFIX_SZ ? len : AS_SINDEX_STR_PREFIX_SZ;
+
+	memset(key, 0, CF_DIGEST_KEY_SZ);
+
+	for (uint32_t i = 0; i < n; i++) {
+		key[CF_DIGEST_KEY_SZ - 1 - i] = (uint8_t)str[i];
+	}
+
+	key[0] = len > AS_SINDEX_STR_PREFIX_SZ ? 0xFF : (uint8_t)len;
+}
+
+/*
+ * Function as_sindex_string_to_skey
+ *     Makes the index key for a string value - a digest, unless the index
+ *     keeps ordered string keys
+ */
+void
+as_sindex_string_to_skey(const as_sindex_metadata *imd, const char *str,
+		uint32_t len, cf_digest *skey)
+{
+	if (imd->str_ordered) {
+		as_sindex_string_to_ordered_skey(str, len, skey);
+	}
+	else {
+		cf_digest_compute(str, len, skey);
+	}
+}
+
 /*
  * Function as_sindex_key_str
  *     Returns a static string representing the key type
@@ -403,6 +452,15 @@ as_sindex__dup_meta(as_sindex_metadata *imd, as_sindex_metadata **qimd)
 	qimdp->sktype       = imd->sktype;
 	qimdp->binid       = imd->binid;
 
+	if (imd->covering_str) {
+		qimdp->covering_str = cf_strdup(imd->covering_str);
+	}
+
+	memcpy(qimdp->covering_binids, imd->covering_binids,
+			sizeof(imd->covering_binids));
+	qimdp->n_covering  = imd->n_covering;
+	qimdp->str_ordered = imd->str_ordered;
+
 	*qimd = qimdp;
 }
 
@@ -480,6 +538,73 @@ as_sindex__populate_binid(as_namespace *ns, as_sindex_metadata *imd)
 	return AS_SINDEX_OK;
 }
 
+// Resolve the comma separated covering bin names to bin ids.
+int
+as_sindex__populate_covering_binids(as_namespace *ns, as_sindex_metadata *imd)
+{
+	imd->n_covering = 0;
+
+	if (! imd->covering_str) {
+		return AS_SINDEX_OK;
+	}
+
+	// Reads of in-memory records are already as cheap as the copy would be.
+	if (ns->storage_data_in_memory || ns->single_bin) {
+		cf_warning(AS_SINDEX, "covering bins not allowed for data-in-memory or single-bin namespace %s",
+				ns->name);
+		return AS_SINDEX_ERR;
+	}
+
+	char names[AS_SINDEX_COVERING_STR_SIZE];
+
+	if (strlen(imd->covering_str) >= sizeof(names)) {
+		cf_warning(AS_SINDEX, "covering bin list %s too long", imd->covering_str);
+		return AS_SINDEX_ERR;
+	}
+
+	strcpy(names, imd->covering_str);
+
+	char *save = NULL;
+
+	for (char *bname = strtok_r(names, ",", &save); bname;
+			bname = strtok_r(NULL, ",", &save)) {
+		if (strlen(bname) >= AS_ID_BIN_SZ) {
+			cf_warning(AS_SINDEX, "covering bin name %s too big. Max size allowed is %d",
+					bname, AS_ID_BIN_SZ - 1);
+			return AS_SINDEX_ERR;
+		}
+
+		if (imd->n_covering == AS_SINDEX_MAX_COVERING_BINS) {
+			cf_warning(AS_SINDEX, "more than %d covering bins",
+					AS_SINDEX_MAX_COVERING_BINS);
+			return AS_SINDEX_ERR;
+		}
+
+		if (! as_bin_name_within_quota(ns, bname)) {
+			cf_warning(AS_SINDEX, "Bin %s not added. Quota is full", bname);
+			return AS_SINDEX_ERR;
+		}
+
+		uint16_t id = as_bin_get_or_assign_id(ns, bname);
+
+		if (id == imd->binid) {
+			cf_warning(AS_SINDEX, "covering bin %s is the indexed bin", bname);
+			return AS_SINDEX_ERR;
+		}
+
+		for (int i = 0; i < imd->n_covering; i++) {
+			if (imd->covering_binids[i] == id) {
+				cf_warning(AS_SINDEX, "duplicate covering bin %s", bname);
+				return AS_SINDEX_ERR;
+			}
+		}
+
+		imd->covering_binids[imd->n_covering++] = id;
+	}
+
+	return AS_SINDEX_OK;
+}
+
 // Free if IMD has allocated the info in it
 int
 as_sindex_imd_free(as_sindex_metadata *imd)
@@ -514,6 +639,11 @@ as_sindex_imd_free(as_sindex_metadata *imd)
 		imd->bname = NULL;
 	}
 
+	if (imd->covering_str) {
+		cf_free(imd->covering_str);
+		imd->covering_str = NULL;
+	}
+
 	return AS_SINDEX_OK;
 }
 //                                           END - UTILITY
@@ -989,6 +1119,8 @@ as_sindex__stats_clear(as_sindex *si) {
 	s->lookup_response_size = 0;
 	s->lookup_num_records   = 0;
 	s->lookup_errs          = 0;
+	// Covering stats - memory used tracks the table, so isn't cleared
+	s->covering_hits        = 0;
 
 	si->enable_histogram = false;
 	if (s->_write_hist) {
@@ -1151,6 +1283,9 @@ as_sindex_stats_str(as_namespace *ns, char * iname, cf_dyn_buf *db)
 	info_append_uint64(db, "query_lookups", lkup);
 	info_append_uint64(db, "query_lookup_avg_rec_count", lkup ? lkup_rec / lkup : 0);
 	info_append_uint64(db, "query_lookup_avg_record_size", lkup_rec ? lkup_size / lkup_rec : 0);
+	// Covering
+	info_append_uint64(db, "covering_hits", cf_atomic64_get(si->stats.covering_hits));
+	info_append_uint64(db, "covering_memory_used", cf_atomic64_get(si->stats.covering_mem_used));
 
 	info_append_bool(db, "histogram", si->enable_histogram);
 
@@ -1235,6 +1370,15 @@ as_sindex_list_str(as_namespace *ns, cf_dyn_buf *db)
 			cf_dyn_buf_append_string(db, ":path=");
 			cf_dyn_buf_append_string(db, si.imd->path_str);
 
+			if (si.imd->str_ordered) {
+				cf_dyn_buf_append_string(db, ":stringkeys=ordered");
+			}
+
+			if (si.imd->covering_str) {
+				cf_dyn_buf_append_string(db, ":covering=");
+				cf_dyn_buf_append_string(db, si.imd->covering_str);
+			}
+
 			// Index State
 			if (si.state == AS_SINDEX_ACTIVE) {
 				if (si.flag & AS_SINDEX_FLAG_RACTIVE) {
@@ -1398,6 +1542,9 @@ as_sindex__create_pmeta(as_sindex *si, int simatch, int nptr)
 			cf_crash(AS_SINDEX,
 					"Could not create secondary index dml mutex ");
 		}
+		if (si->ns->sindex_deferred_updates) {
+			pimd->deltas = cf_queue_create(sizeof(sindex_delta), true);
+		}
 	}
 }
 
@@ -1484,6 +1631,11 @@ sindex_create_lockless(as_namespace *ns, as_sindex_metadata *imd)
 		return AS_SINDEX_ERR_PARAM;
 	}
 
+	if (as_sindex__populate_covering_binids(ns, imd)) {
+		cf_warning(AS_SINDEX, "SINDEX CREATE : Populating covering bin ids failed");
+		return AS_SINDEX_ERR_PARAM;
+	}
+
 	as_sindex_status rv = as_sindex__put_in_set_binid_hash(ns, imd->set, imd->binid, id);
 	if (rv != AS_SINDEX_OK) {
 		cf_warning(AS_SINDEX, "SINDEX CREATE : Put in set_binid hash fails with error %d", rv);
@@ -1504,6 +1656,10 @@ sindex_create_lockless(as_namespace *ns, as_sindex_metadata *imd)
 	si->state       = AS_SINDEX_ACTIVE;
 	si->flag        = AS_SINDEX_FLAG_WACTIVE;
 	si->recreate_imd     = NULL;
+	si->covering    = imd->n_covering == 0 ? NULL :
+			cf_shash_create(cf_shash_fn_u32, CF_DIGEST_KEY_SZ,
+					sizeof(as_sindex_covering_entry *),
+					AS_SINDEX_COVERING_N_BUCKETS, CF_SHASH_MANY_LOCK);
 	as_sindex__config_default(si);
 
 	// Init IMD
@@ -1678,6 +1834,11 @@ as_sindex_destroy_pmetadata(as_sindex *si)
 	for (int i = 0; i < si->imd->nprts; i++) {
 		as_sindex_pmetadata *pimd = &si->imd->pimd[i];
 		pthread_rwlock_destroy(&pimd->slock);
+		// Nothing is waiting on the deltas - the si has no references left.
+		if (pimd->deltas) {
+			cf_queue_destroy(pimd->deltas);
+			pimd->deltas = NULL;
+		}
 	}
 	as_sindex__destroy_histogram(si);
 	cf_free(si->imd->pimd);
@@ -1825,10 +1986,9 @@ as_sindex_boot_populateall()
 			continue;
 		}
 
-		// If FAST START
-		// OR (Data not in memory AND COLD START)
-		if (!ns->cold_start
-			|| (!ns->storage_data_in_memory)) {
+		// Only FAST START needs a scan - cold start populated sindexes as it
+		// loaded records.
+		if (!ns->cold_start) {
 			// reserve all sindexes
 			as_sindex_populator_reserve_all(ns);
 			as_sbld_build_all(ns);
@@ -1852,8 +2012,7 @@ as_sindex_boot_populateall()
 		}
 
 		// If FAST START
-		// OR (Data not in memory AND COLD START)
-		if (!ns->cold_start || (!ns->storage_data_in_memory)) {
+		if (!ns->cold_start) {
 			as_sindex_populator_release_all(ns);
 		}
 	}
@@ -2245,6 +2404,13 @@ as_sindex_from_range(as_namespace *ns, char *set, as_sindex_range *srange)
 			AS_SINDEX_RELEASE(si);
 			return NULL;
 		}
+		if (srange->isrange && srange->start.type == AS_PARTICLE_TYPE_STRING &&
+				! imd->str_ordered) {
+			cf_warning(AS_SINDEX, "String range query needs an ordered string index: "
+					"[index %s]", imd->iname);
+			AS_SINDEX_RELEASE(si);
+			return NULL;
+		}
 	}
 	return si;
 }
@@ -2520,15 +2686,31 @@ as_sindex_range_from_msg(as_namespace *ns, as_msg *msgp, as_sindex_range *srange
 			uint32_t endl	   = ntohl(*((uint32_t *)data));
 			data              += sizeof(uint32_t);
 			char * end_binval        = (char *)data;
-			if (startl != endl && strncmp(start_binval, end_binval, startl)) {
-				cf_warning(AS_SINDEX,
-                           "Only Equality Query Supported in Strings %s-%s",
-                           start_binval, end_binval);
-				goto Cleanup;
+			// Equality unless the ends differ - then it's a range (or
+			// prefix) lookup, which only ordered string indexes can do.
+			if (startl != endl || memcmp(start_binval, end_binval, startl)) {
+				uint32_t minl = startl < endl ? startl : endl;
+				int cmp = memcmp(start_binval, end_binval, minl);
+
+				if (startl > AS_SINDEX_STR_PREFIX_SZ ||
+						endl > AS_SINDEX_STR_PREFIX_SZ) {
+					cf_warning(AS_SINDEX,
+							"String range ends must be at most %d bytes",
+							AS_SINDEX_STR_PREFIX_SZ);
+					goto Cleanup;
+				}
+				if (cmp > 0 || (cmp == 0 && startl > endl)) {
+					cf_warning(AS_SINDEX, "Invalid string range");
+					goto Cleanup;
+				}
+				srange->isrange = true;
 			}
 			cf_digest_compute(start_binval, startl, &(start->digest));
-			cf_debug(AS_SINDEX, "Range is equal %s ,%s",
-					 start_binval, end_binval);
+			as_sindex_string_to_ordered_skey(start_binval, startl,
+					&start->ordered);
+			as_sindex_string_to_ordered_skey(end_binval, endl, &end->ordered);
+			cf_debug(AS_SINDEX, "Range is %.*s - %.*s", startl, start_binval,
+					endl, end_binval);
 		} else if (type == AS_PARTICLE_TYPE_GEOJSON) {
 			// get start point
 			uint32_t startl = ntohl(*((uint32_t *)data));
@@ -2702,6 +2884,13 @@ as_sindex_query(as_sindex *si, as_sindex_range *srange, as_sindex_qctx *qctx)
 		return AS_SINDEX_ERR_NOT_READABLE;
 	}
 
+	// Read through deferred updates - apply what's pending first.
+	if (pimd->deltas && cf_queue_sz(pimd->deltas) != 0) {
+		PIMD_WLOCK(&pimd->slock);
+		pimd_apply_deltas(si, pimd, 0);
+		PIMD_WUNLOCK(&pimd->slock);
+	}
+
 	PIMD_RLOCK(&pimd->slock);
 	int ret = ai_btree_query(imd, srange, qctx);
 	PIMD_RUNLOCK(&pimd->slock);
@@ -2747,6 +2936,77 @@ as_sindex_sbin_freeall(as_sindex_bin *sbin, int numbins)
 	return AS_SINDEX_OK;
 }
 
+// Apply up to max_n deferred ops (0 means all) - caller has the pimd write
+// lock.
+static void
+pimd_apply_deltas(as_sindex *si, as_sindex_pmetadata *pimd, uint32_t max_n)
+{
+	as_sindex_metadata *imd = si->imd;
+	sindex_delta d;
+	uint32_t n = 0;
+
+	while ((max_n == 0 || n++ < max_n) &&
+			cf_queue_pop(pimd->deltas, &d, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
+		int ret = d.op == AS_SINDEX_OP_DELETE ?
+				ai_btree_delete(imd, pimd, &d.skey.key, &d.keyd) :
+				ai_btree_put(imd, pimd, &d.skey.key, &d.keyd);
+
+		as_sindex__process_ret(si, ret, d.op, 0, __LINE__);
+	}
+}
+
+// Queue an op on the pimd, and the pimd for a delta worker if it isn't already.
+static void
+pimd_defer_op(as_sindex *si, uint32_t pimd_ix, as_sindex_op op, void *skey,
+		as_particle_type type, cf_digest *keyd)
+{
+	as_sindex_pmetadata *pimd = &si->imd->pimd[pimd_ix];
+	sindex_delta d;
+
+	d.op = op;
+	d.keyd = *keyd;
+
+	if (type == AS_PARTICLE_TYPE_STRING) {
+		d.skey.key.str_key = *(cf_digest *)skey;
+	}
+	else {
+		d.skey.key.int_key = *(uint64_t *)skey;
+	}
+
+	cf_queue_push(pimd->deltas, &d);
+
+	if (ck_pr_cas_32(&pimd->deltas_queued, 0, 1)) {
+		as_sindex_delta_work work = { .si = si, .pimd_ix = pimd_ix };
+
+		AS_SINDEX_RESERVE(si);
+		cf_queue_push(g_sindex_delta_q, &work);
+	}
+}
+
+// Called by delta workers - applies the pimd's deferred ops in batches, so
+// writers and queries don't wait long on the lock.
+void
+as_sindex_apply_deltas(as_sindex *si, uint32_t pimd_ix)
+{
+	as_sindex_pmetadata *pimd = &si->imd->pimd[pimd_ix];
+
+	while (true) {
+		while (cf_queue_sz(pimd->deltas) != 0) {
+			PIMD_WLOCK(&pimd->slock);
+			pimd_apply_deltas(si, pimd, AS_SINDEX_DELTA_BATCH_SZ);
+			PIMD_WUNLOCK(&pimd->slock);
+		}
+
+		ck_pr_store_32(&pimd->deltas_queued, 0);
+
+		// A writer may have pushed after the last pop but seen the flag set.
+		if (cf_queue_sz(pimd->deltas) == 0 ||
+				! ck_pr_cas_32(&pimd->deltas_queued, 0, 1)) {
+			break;
+		}
+	}
+}
+
 as_sindex_status
 as_sindex__op_by_sbin(as_namespace *ns, const char *set, int numbins, as_sindex_bin *start_sbin, cf_digest * pkey)
 {
@@ -2817,7 +3077,15 @@ as_sindex__op_by_sbin(as_namespace *ns, const char *set, int numbins, as_sindex_
 				goto Cleanup;
 			}
 	//			Get the related pimd
-			pimd = &imd->pimd[ai_btree_key_hash(imd, skey)];
+			int pimd_ix = ai_btree_key_hash(imd, skey);
+			pimd = &imd->pimd[pimd_ix];
+
+	//			If deferring, leave the op for a delta worker
+			if (pimd->deltas && g_sindex_boot_done) {
+				pimd_defer_op(si, pimd_ix, op, skey, sbin->type, pkey);
+				continue;
+			}
+
 			uint64_t starttime = 0;
 			if (si->enable_histogram) {
 				starttime = cf_getns();
@@ -2826,6 +3094,11 @@ as_sindex__op_by_sbin(as_namespace *ns, const char *set, int numbins, as_sindex_
 	//			Get the pimd write lock
 			PIMD_WLOCK(&pimd->slock);
 
+	//			Ops deferred earlier (e.g. before boot finished) go first
+			if (pimd->deltas && cf_queue_sz(pimd->deltas) != 0) {
+				pimd_apply_deltas(si, pimd, 0);
+			}
+
 	//			If op is DELETE delete the value from sindex
 			int ret = AS_SINDEX_OK;
 			if (op == AS_SINDEX_OP_DELETE) {
@@ -2840,6 +3113,11 @@ as_sindex__op_by_sbin(as_namespace *ns, const char *set, int numbins, as_sindex_
 			PIMD_WUNLOCK(&pimd->slock);
 			as_sindex__process_ret(si, ret, op, starttime, __LINE__);
 		}
+
+		// Any copy is stale now - drop it rather than wait for a miss.
+		if (op == AS_SINDEX_OP_DELETE && si->covering) {
+			as_sindex_covering_drop(si, pkey);
+		}
 		cf_debug(AS_SINDEX, " Secondary Index Op Finish------------- ");
 
 	//		Release the imd lock.
@@ -3074,9 +3352,9 @@ as_sindex_add_string_to_sbin(as_sindex_bin * sbin, char * val)
 	if (!val) {
 		return AS_SINDEX_ERR;
 	}
-	// Calculate digest and cal add_digest_to_sbin
+	// Calculate key and call add_digest_to_sbin
 	cf_digest val_dig;
-	cf_digest_compute(val, strlen(val), &val_dig);
+	as_sindex_string_to_skey(sbin->si->imd, val, strlen(val), &val_dig);
 	return as_sindex_add_digest_to_sbin(sbin, val_dig);
 }
 //                                       END - ADD TO SBIN
@@ -3350,7 +3628,8 @@ packed_val_init_unpacker(const cdt_payload *val, as_unpacker *pk)
 }
 
 static bool
-packed_val_make_skey(const cdt_payload *val, as_val_t type, void *skey)
+packed_val_make_skey(const as_sindex_metadata *imd, const cdt_payload *val,
+		as_val_t type, void *skey)
 {
 	as_unpacker pk;
 	packed_val_init_unpacker(val, &pk);
@@ -3372,7 +3651,8 @@ packed_val_make_skey(const cdt_payload *val, as_val_t type, void *skey)
 			return false;
 		}
 
-		cf_digest_compute(pk.buffer + pk.offset, pk.length - pk.offset, (cf_digest *)skey);
+		as_sindex_string_to_skey(imd, (const char *)pk.buffer + pk.offset,
+				pk.length - pk.offset, (cf_digest *)skey);
 	}
 	else if (type == AS_INTEGER) {
 		if (as_unpack_int64(&pk, (int64_t *)skey) < 0) {
@@ -3391,7 +3671,7 @@ packed_val_add_sbin_or_update_shash(cdt_payload *val, as_sindex_bin *sbin, cf_sh
 {
 	uint8_t skey[sizeof(cf_digest)];
 
-	if (! packed_val_make_skey(val, type, skey)) {
+	if (! packed_val_make_skey(sbin->si->imd, val, type, skey)) {
 		// packed_vals that aren't of type are ignored.
 		return true;
 	}
@@ -3414,11 +3694,12 @@ packed_val_add_sbin_or_update_shash(cdt_payload *val, as_sindex_bin *sbin, cf_sh
 }
 
 static void
-shash_add_packed_val(cf_shash *h, const cdt_payload *val, as_val_t type, bool value)
+shash_add_packed_val(const as_sindex_metadata *imd, cf_shash *h,
+		const cdt_payload *val, as_val_t type, bool value)
 {
 	uint8_t skey[sizeof(cf_digest)];
 
-	if (! packed_val_make_skey(val, type, skey)) {
+	if (! packed_val_make_skey(imd, val, type, skey)) {
 		// packed_vals that aren't of type are ignored.
 		return;
 	}
@@ -3552,7 +3833,7 @@ as_sindex_sbins_sindex_list_diff_populate(as_sindex_bin *sbins, as_sindex *si, c
 			// sizeof(cf_digest) is big enough for all key types we support so far.
 			uint8_t skey[sizeof(cf_digest)];
 
-			if (! packed_val_make_skey(&ele, expected_type, skey)) {
+			if (! packed_val_make_skey(si->imd, &ele, expected_type, skey)) {
 				// packed_vals that aren't of type are ignored.
 				continue;
 			}
@@ -3584,7 +3865,7 @@ as_sindex_sbins_sindex_list_diff_populate(as_sindex_bin *sbins, as_sindex *si, c
 		}
 
 		ele.sz = size;
-		shash_add_packed_val(hash, &ele, expected_type, false);
+		shash_add_packed_val(si->imd, hash, &ele, expected_type, false);
 	}
 
 	as_sindex_init_sbin(sbins, old_list_is_short ? AS_SINDEX_OP_INSERT : AS_SINDEX_OP_DELETE, type, si);
@@ -3761,7 +4042,7 @@ as_sindex_sbin_from_sindex(as_sindex * si, const as_bin *b, as_sindex_bin * sbin
 				}
 				else {
 					cf_digest buf_dig;
-					cf_digest_compute(bin_val, valsz, &buf_dig);
+					as_sindex_string_to_skey(imd, bin_val, valsz, &buf_dig);
 
 					if (as_sindex_add_digest_to_sbin(sbin, buf_dig) == AS_SINDEX_OK) {
 						if (sbin->num_values) {
@@ -3955,6 +4236,268 @@ as_sindex_update_by_sbin(as_namespace *ns, const char *set, as_sindex_bin *start
 //                                 END - SBIN INTERFACE FUNCTIONS
 // ************************************************************************************************
 // ************************************************************************************************
+//                                          COVERING BINS
+// Each sindex with covering bins keeps a digest-keyed table of copies of the
+// indexed bin and the covering bins, filled as lookup queries read records
+// from device. A copy is only used while the record's generation and
+// last-update-time still match, so writes never have to touch the table -
+// they just make the copy stale.
+
+struct as_sindex_covering_entry_s {
+	uint64_t last_update_time;
+	uint16_t generation;
+	uint16_t n_bins;
+	uint32_t key_size;
+	uint32_t sz;
+	uint8_t  data[]; // key, then per bin: uint16_t id, uint32_t size, flat
+};
+
+// Can a query with this bin list be answered from the covering table?
+bool
+as_sindex_covers_bins(as_sindex *si, cf_vector *binlist, bool no_bin_data)
+{
+	if (! si->covering) {
+		return false;
+	}
+
+	if (no_bin_data) {
+		return true;
+	}
+
+	// All bins are wanted - only the record has those.
+	if (! binlist) {
+		return false;
+	}
+
+	as_sindex_metadata *imd = si->imd;
+	uint32_t n = cf_vector_size(binlist);
+
+	for (uint32_t i = 0; i < n; i++) {
+		char bname[AS_ID_BIN_SZ];
+
+		cf_vector_get(binlist, i, (void*)&bname);
+
+		int16_t id = as_bin_get_id(si->ns, bname);
+
+		// An unknown bin is in no record, so needs no copy.
+		if (id < 0 || (uint16_t)id == imd->binid) {
+			continue;
+		}
+
+		int j;
+
+		for (j = 0; j < imd->n_covering; j++) {
+			if (imd->covering_binids[j] == (uint16_t)id) {
+				break;
+			}
+		}
+
+		if (j == imd->n_covering) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+covering_entry_release(as_sindex_covering_entry *e)
+{
+	if (cf_rc_release(e) == 0) {
+		cf_rc_free(e);
+	}
+}
+
+// Copy the record's covered bins (and key) - rd must have its bins loaded.
+void
+as_sindex_covering_put(as_sindex *si, as_storage_rd *rd)
+{
+	cf_shash *covering = si->covering;
+	as_sindex_metadata *imd = si->imd;
+
+	if (! covering) {
+		return;
+	}
+
+	as_bin *bins[1 + AS_SINDEX_MAX_COVERING_BINS];
+	uint32_t flat_sizes[1 + AS_SINDEX_MAX_COVERING_BINS];
+	uint16_t n_bins = 0;
+
+	if (rd->r->key_stored == 1 && ! rd->key &&
+			! as_storage_record_get_key(rd)) {
+		return;
+	}
+
+	uint32_t sz = rd->key ? rd->key_size : 0;
+
+	for (int i = -1; i < imd->n_covering; i++) {
+		as_bin *b = as_bin_get_by_id(rd,
+				i < 0 ? imd->binid : imd->covering_binids[i]);
+
+		if (! b) {
+			continue;
+		}
+
+		flat_sizes[n_bins] = as_bin_particle_flat_size(b);
+		sz += sizeof(uint16_t) + sizeof(uint32_t) + flat_sizes[n_bins];
+		bins[n_bins++] = b;
+	}
+
+	if (sizeof(as_sindex_covering_entry) + sz >
+			AS_SINDEX_COVERING_MAX_ENTRY_SZ) {
+		return;
+	}
+
+	as_sindex_covering_entry *e =
+			cf_rc_alloc(sizeof(as_sindex_covering_entry) + sz);
+
+	e->last_update_time = rd->r->last_update_time;
+	e->generation = rd->r->generation;
+	e->n_bins = n_bins;
+	e->key_size = rd->key ? rd->key_size : 0;
+	e->sz = sz;
+
+	uint8_t *p = e->data;
+
+	if (e->key_size != 0) {
+		memcpy(p, rd->key, e->key_size);
+		p += e->key_size;
+	}
+
+	for (uint16_t i = 0; i < n_bins; i++) {
+		*(uint16_t *)p = bins[i]->id;
+		p += sizeof(uint16_t);
+		*(uint32_t *)p = flat_sizes[i];
+		p += sizeof(uint32_t);
+		p += as_bin_particle_to_flat(bins[i], p);
+	}
+
+	as_sindex_covering_entry **pe;
+	pthread_mutex_t *vlock;
+	as_sindex_covering_entry *old = NULL;
+
+	if (cf_shash_get_vlock(covering, &rd->r->keyd, (void **)&pe, &vlock) ==
+			CF_SHASH_OK) {
+		old = *pe;
+		*pe = e;
+		pthread_mutex_unlock(vlock);
+	}
+	else if (cf_shash_put_unique(covering, &rd->r->keyd, &e) != CF_SHASH_OK) {
+		// Lost a race with another query filling the same record.
+		covering_entry_release(e);
+		return;
+	}
+
+	cf_atomic64_add(&si->stats.covering_mem_used, (int64_t)sz);
+	cf_atomic64_add(&si->ns->n_bytes_sindex_memory, (int64_t)sz);
+
+	if (old) {
+		cf_atomic64_sub(&si->stats.covering_mem_used, (int64_t)old->sz);
+		cf_atomic64_sub(&si->ns->n_bytes_sindex_memory, (int64_t)old->sz);
+		covering_entry_release(old);
+	}
+}
+
+// Returns a reserved copy if it's as current as the record, else NULL.
+as_sindex_covering_entry *
+as_sindex_covering_get(as_sindex *si, as_index *r)
+{
+	as_sindex_covering_entry **pe;
+	pthread_mutex_t *vlock;
+
+	if (! si->covering || cf_shash_get_vlock(si->covering, &r->keyd,
+			(void **)&pe, &vlock) != CF_SHASH_OK) {
+		return NULL;
+	}
+
+	as_sindex_covering_entry *e = *pe;
+
+	if (e->generation == r->generation &&
+			e->last_update_time == r->last_update_time) {
+		cf_rc_reserve(e);
+	}
+	else {
+		e = NULL;
+	}
+
+	pthread_mutex_unlock(vlock);
+
+	return e;
+}
+
+// Point rd's bins and key into the copy - e must stay reserved while rd is
+// in use.
+bool
+as_sindex_covering_load_rd(as_sindex_covering_entry *e, as_storage_rd *rd,
+		as_bin *bins)
+{
+	uint8_t *p = e->data;
+
+	rd->key_size = e->key_size;
+	rd->key = e->key_size != 0 ? p : NULL;
+	p += e->key_size;
+
+	for (uint16_t i = 0; i < e->n_bins; i++) {
+		as_bin *b = &bins[i];
+
+		as_bin_set_empty(b);
+		b->id = *(uint16_t *)p;
+		p += sizeof(uint16_t);
+
+		uint32_t flat_size = *(uint32_t *)p;
+
+		p += sizeof(uint32_t);
+
+		if (as_bin_particle_cast_from_flat(b, p, flat_size) != 0) {
+			return false;
+		}
+
+		p += flat_size;
+	}
+
+	rd->bins = bins;
+	rd->n_bins = e->n_bins;
+
+	return true;
+}
+
+void
+as_sindex_covering_release(as_sindex_covering_entry *e)
+{
+	covering_entry_release(e);
+}
+
+void
+as_sindex_covering_drop(as_sindex *si, cf_digest *keyd)
+{
+	cf_shash *covering = si->covering;
+	as_sindex_covering_entry *e;
+
+	if (covering && cf_shash_get_and_delete(covering, keyd, &e) ==
+			CF_SHASH_OK) {
+		cf_atomic64_sub(&si->stats.covering_mem_used, (int64_t)e->sz);
+		cf_atomic64_sub(&si->ns->n_bytes_sindex_memory, (int64_t)e->sz);
+		covering_entry_release(e);
+	}
+}
+
+static int
+covering_destroy_reduce_fn(const void *key, void *value, void *udata)
+{
+	covering_entry_release(*(as_sindex_covering_entry **)value);
+	return CF_SHASH_REDUCE_DELETE;
+}
+
+// Memory accounting is the caller's business - the table is going away.
+void
+as_sindex_covering_destroy(cf_shash *covering)
+{
+	cf_shash_reduce(covering, covering_destroy_reduce_fn, NULL);
+	cf_shash_destroy(covering);
+}
+//                                        END - COVERING BINS
+// ************************************************************************************************
+// ************************************************************************************************
 //                                      PUT RD IN SINDEX
 // Takes a record and tries to populate it in every sindex present in the namespace.
 void
@@ -4234,6 +4777,7 @@ as_sindex_type_to_smd_char(as_sindex_type itype)
 }
 
 #define TOK_CHAR_DELIMITER '|'
+#define SMD_VALUE_ORDERED "ordered"
 
 bool
 smd_key_to_imd(const char *smd_key, as_sindex_metadata *imd)
@@ -4319,8 +4863,36 @@ smd_key_to_imd(const char *smd_key, as_sindex_metadata *imd)
 void
 smd_value_to_imd(const char *smd_value, as_sindex_metadata *imd)
 {
-	// For now, it's only index-name
-	imd->iname = cf_strdup(smd_value);
+	// index-name|<covering-bins>|<ordered>
+
+	const char *read = smd_value;
+	const char *tok = strchr(read, TOK_CHAR_DELIMITER);
+
+	if (! tok) {
+		imd->iname = cf_strdup(read);
+		return;
+	}
+
+	uint32_t iname_len = tok - read;
+
+	imd->iname = cf_malloc(iname_len + 1);
+	memcpy(imd->iname, read, iname_len);
+	imd->iname[iname_len] = 0;
+
+	read = tok + 1;
+	tok = strchr(read, TOK_CHAR_DELIMITER);
+
+	uint32_t covering_len = tok ? (uint32_t)(tok - read) : strlen(read);
+
+	if (covering_len != 0) {
+		imd->covering_str = cf_malloc(covering_len + 1);
+		memcpy(imd->covering_str, read, covering_len);
+		imd->covering_str[covering_len] = 0;
+	}
+
+	if (tok && strcmp(tok + 1, SMD_VALUE_ORDERED) == 0) {
+		imd->str_ordered = true;
+	}
 }
 
 void
@@ -4337,6 +4909,24 @@ as_sindex_imd_to_smd_key(const as_sindex_metadata *imd, char *smd_key)
 			as_sindex_ktype_to_smd_char(imd->sktype));
 }
 
+void
+as_sindex_imd_to_smd_value(const as_sindex_metadata *imd, char *smd_value)
+{
+	// index-name|<covering-bins>|<ordered>
+	// Note - no delimiters without the options, as values were before.
+
+	if (imd->str_ordered) {
+		sprintf(smd_value, "%s|%s|%s", imd->iname,
+				imd->covering_str ? imd->covering_str : "", SMD_VALUE_ORDERED);
+	}
+	else if (imd->covering_str) {
+		sprintf(smd_value, "%s|%s", imd->iname, imd->covering_str);
+	}
+	else {
+		sprintf(smd_value, "%s", imd->iname);
+	}
+}
+
 bool
 as_sindex_delete_imd_to_smd_key(as_namespace *ns, as_sindex_metadata *imd, char *smd_key)
 {
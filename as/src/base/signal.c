@@ -92,6 +92,8 @@ reraise_signal(int sig_num, sighandler_t handler)
 void
 as_sig_handle_abort(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGABRT received, aborting %s build %s os %s",
 			aerospike_build_type, aerospike_build_id, aerospike_build_os);
 
@@ -104,6 +106,8 @@ as_sig_handle_abort(int sig_num)
 void
 as_sig_handle_bus(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGBUS received, aborting %s build %s",
 			aerospike_build_type, aerospike_build_id);
 
@@ -117,6 +121,8 @@ as_sig_handle_bus(int sig_num)
 void
 as_sig_handle_fpe(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGFPE received, aborting %s build %s os %s",
 			aerospike_build_type, aerospike_build_id, aerospike_build_os);
 
@@ -139,6 +145,8 @@ as_sig_handle_hup(int sig_num)
 void
 as_sig_handle_ill(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGILL received, aborting %s build %s os %s",
 			aerospike_build_type, aerospike_build_id, aerospike_build_os);
 
@@ -166,6 +174,8 @@ as_sig_handle_int(int sig_num)
 void
 as_sig_handle_quit(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGQUIT received, aborting %s build %s os %s",
 			aerospike_build_type, aerospike_build_id, aerospike_build_os);
 
@@ -177,6 +187,8 @@ as_sig_handle_quit(int sig_num)
 void
 as_sig_handle_segv(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGSEGV received, aborting %s build %s os %s",
 			aerospike_build_type, aerospike_build_id, aerospike_build_os);
 
@@ -206,6 +218,8 @@ as_sig_handle_term(int sig_num)
 void
 as_sig_handle_usr1(int sig_num)
 {
+	cf_fault_sync();
+
 	cf_warning(AS_AS, "SIGUSR1 received, aborting %s build %s os %s",
 			aerospike_build_type, aerospike_build_id, aerospike_build_os);
 
@@ -248,6 +248,9 @@
 /* Time in milliseconds for System Metadata proxy transactions to the SMD principal. */
 #define AS_SMD_TRANSACT_TIMEOUT_MS  (1000)
 
+/* Maximum time in milliseconds accepted changes stay unpersisted while events keep arriving. */
+#define AS_SMD_PERSIST_MAX_DELAY_MS  (1000)
+
 #define SMD_MAX_STACK_MODULES 128
 #define SMD_MAX_STACK_NUM_ITEMS (1 << 14)
 
@@ -518,6 +521,9 @@ struct as_smd_s {
 	cf_shash *scoreboard;
 
 	cf_queue pending_merge_queue; // elements are (smd_pending_merge)
+
+	// When dirty modules were last persisted.
+	uint64_t last_persist_ms;
 };
 
 /*
@@ -591,6 +597,7 @@ typedef struct as_smd_module_s {
 
 
 static int as_smd_module_persist(as_smd_module_t *module_obj);
+static void as_smd_persist_dirty_modules(as_smd_t *smd);
 void *as_smd_thr(void *arg);
 
 
@@ -1879,6 +1886,29 @@ static int as_smd_module_persist(as_smd_module_t *module_obj)
 	return retval;
 }
 
+/*
+ *  Reduce function to persist one module, if it has unpersisted changes.
+ */
+static int as_smd_persist_dirty_reduce_fn(const void *key, uint32_t keylen, void *object, void *udata)
+{
+	as_smd_module_t *module_obj = (as_smd_module_t *) object;
+
+	if (as_smd_module_persist(module_obj)) {
+		cf_warning(AS_SMD, "failed to persist accepted metadata for module \"%s\"", module_obj->module);
+	}
+
+	return 0;
+}
+
+/*
+ *  Persist all modules with unpersisted changes - each rewritten once, however many changes it accepted.
+ */
+static void as_smd_persist_dirty_modules(as_smd_t *smd)
+{
+	cf_rchash_reduce(smd->modules, as_smd_persist_dirty_reduce_fn, NULL);
+	smd->last_persist_ms = cf_getms();
+}
+
 /*
  *  Create a metadata container for the given module.
  */
@@ -2021,6 +2051,9 @@ static int as_smd_module_destroy(as_smd_t *smd, as_smd_cmd_t *cmd)
 
 	cf_debug(AS_SMD, "System Metadata thread - destroying module \"%s\"", item->module_name);
 
+	// Don't lose changes accepted since the last batch was persisted.
+	as_smd_persist_dirty_modules(smd);
+
 	// Remove the module's object from the hash table.
 	if (CF_RCHASH_OK != (retval = cf_rchash_delete(smd->modules, item->module_name, strlen(item->module_name) + 1))) {
 		cf_warning(AS_SMD, "failed to delete System Metadata module \"%s\" (retval %d)", item->module_name, retval);
@@ -2388,10 +2421,7 @@ static int as_smd_metadata_change(as_smd_t *smd, as_smd_msg_op_t op, as_smd_item
 			(module_obj->accept_cb)(module_obj->module, item_list, module_obj->accept_udata, accept_opt);
 		}
 
-		// Persist the accepted metadata for this module.
-		if (as_smd_module_persist(module_obj)) {
-			cf_warning(AS_SMD, "failed to persist accepted metadata for module \"%s\"", module_obj->module);
-		}
+		// (The accepted metadata is persisted once the event queue drains.)
 
 		cf_rc_release(module_obj);
 
@@ -3288,14 +3318,10 @@ static int as_smd_accept_metadata(as_smd_t *smd, as_smd_module_t *module_obj, as
 		(module_obj->accept_cb)(module_obj->module, smd_msg->items, module_obj->accept_udata, smd_msg->options);
 	}
 
-	// SMD should now be persisted.
+	// SMD should now be persisted - batched with any other accepted changes,
+	// once the event queue drains.
 	module_obj->dirty = true;
 
-	// Persist the accepted metadata for this module.
-	if (as_smd_module_persist(module_obj)) {
-		cf_warning(AS_SMD, "failed to persist accepted metadata for module \"%s\"", module_obj->module);
-	}
-
 	return retval;
 }
 
@@ -3533,8 +3559,17 @@ void *as_smd_thr(void *arg)
 			// Release the event message.
 			as_smd_destroy_event(evt);
 		}
+
+		// Persist accepted changes in batches - when there are no more events
+		// to handle, or if events have kept coming for too long.
+		if (cf_queue_sz(smd->msgq) == 0 ||
+				cf_getms() - smd->last_persist_ms > AS_SMD_PERSIST_MAX_DELAY_MS) {
+			as_smd_persist_dirty_modules(smd);
+		}
 	}
 
+	as_smd_persist_dirty_modules(smd);
+
 	// Release System Metadata resources.
 	as_smd_terminate(smd);
 
@@ -47,6 +47,7 @@
 
 #include "base/as_stap.h"
 #include "base/batch.h"
+#include "base/capture.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/packet_compression.h"
@@ -60,6 +61,10 @@
 
 #define POLL_SZ 1024
 
+// Header reads take whatever else is available too, up to this much, so small
+// requests need only one recv().
+#define READ_AHEAD_SZ (16 * 1024)
+
 #define XDR_WRITE_BUFFER_SIZE (5 * 1024 * 1024)
 #define XDR_READ_BUFFER_SIZE (15 * 1024 * 1024)
 
@@ -73,6 +78,11 @@ typedef struct {
 
 static demarshal_args *g_demarshal_args = 0;
 
+// Event loops ever started - more than num_threads after service-threads was
+// reduced. Loops beyond num_threads get no new connections, and give up their
+// existing ones as they're rearmed.
+static uint32_t g_n_started_threads = 0;
+
 as_info_access g_access = {
 	.service = { .addrs = { .n_addrs = 0 }, .port = 0 },
 	.alt_service = { .addrs = { .n_addrs = 0 }, .port = 0 },
@@ -83,7 +93,9 @@ as_info_access g_access = {
 cf_serv_cfg g_service_bind = { .n_cfgs = 0 };
 cf_tls_info *g_service_tls;
 
-static cf_sockets g_sockets;
+// One set of listeners per accept shard - only [0] unless accept-shards.
+static cf_sockets g_sockets[MAX_DEMARSHAL_THREADS];
+static uint32_t g_n_accept_shards = 1;
 
 //
 // File handle reaper.
@@ -97,18 +109,95 @@ pthread_t		g_demarshal_reaper_th;
 void *thr_demarshal_reaper_fn(void *arg);
 static cf_queue *g_freeslot = 0;
 
+static __thread uint8_t g_read_ahead[READ_AHEAD_SZ];
+
+// If fd_h is on a retired event loop, move it to a live one. Safe since it's
+// disarmed (one-shot) until rearmed. Returns true if moved (and so armed).
+static bool
+demarshal_migrate(as_file_handle *fd_h, uint32_t events)
+{
+	demarshal_args *dm = g_demarshal_args;
+	uint32_t n_threads = dm->num_threads;
+	uint32_t i;
+
+	for (i = n_threads; i < g_n_started_threads; i++) {
+		if (CEFD(dm->polls[i]) == CEFD(fd_h->poll)) {
+			break;
+		}
+	}
+
+	if (i == g_n_started_threads) {
+		return false;
+	}
+
+	static int32_t err_ok[] = { ENOENT };
+
+	if (cf_poll_delete_socket_forgiving(fd_h->poll, &fd_h->sock,
+			sizeof(err_ok) / sizeof(int32_t), err_ok) != 0) {
+		return true; // already cleaned up - nothing to rearm
+	}
+
+	static uint32_t migrate_cntr = 0;
+
+	fd_h->poll = dm->polls[(migrate_cntr++) % n_threads];
+	cf_poll_add_socket(fd_h->poll, &fd_h->sock,
+			events | EPOLLONESHOT | EPOLLRDHUP, fd_h);
+
+	return true;
+}
+
 void
 thr_demarshal_rearm(as_file_handle *fd_h)
 {
 	// This causes ENOENT, when we reached NextEvent_FD_Cleanup (e.g, because
 	// the client disconnected) while the transaction was still ongoing.
 
+	// If a pipelined request was read ahead, the socket may have nothing more
+	// to read - wait for writable instead, which fires right away.
+	uint32_t events = fd_h->stash_sz != 0 ? EPOLLOUT : EPOLLIN;
+
+	if (g_demarshal_args->num_threads < g_n_started_threads &&
+			demarshal_migrate(fd_h, events)) {
+		return;
+	}
+
 	static int32_t err_ok[] = { ENOENT };
 	CF_IGNORE_ERROR(cf_poll_modify_socket_forgiving(fd_h->poll, &fd_h->sock,
-			EPOLLIN | EPOLLONESHOT | EPOLLRDHUP, fd_h,
+			events | EPOLLONESHOT | EPOLLRDHUP, fd_h,
 			sizeof(err_ok) / sizeof(int32_t), err_ok));
 }
 
+// Keep read-ahead bytes not consumed by the current request for the next one.
+// They're either in the thread's read-ahead buffer, or already stashed.
+static void
+stash_read_ahead(as_file_handle *fd_h, const uint8_t *ahead, size_t ahead_sz)
+{
+	if (ahead_sz == 0) {
+		if (fd_h->stash) {
+			cf_free(fd_h->stash);
+			fd_h->stash = NULL;
+			fd_h->stash_off = 0;
+			fd_h->stash_sz = 0;
+		}
+
+		return;
+	}
+
+	if (fd_h->stash) {
+		fd_h->stash_off = (uint32_t)(ahead - fd_h->stash);
+		fd_h->stash_sz = (uint32_t)ahead_sz;
+		return;
+	}
+
+	fd_h->stash = cf_malloc(ahead_sz);
+
+	cf_assert(fd_h->stash, AS_DEMARSHAL, "allocation: %zu", ahead_sz);
+
+	memcpy(fd_h->stash, ahead, ahead_sz);
+	fd_h->stash_off = 0;
+	fd_h->stash_sz = (uint32_t)ahead_sz;
+}
+
 void
 demarshal_file_handle_init()
 {
@@ -374,6 +463,15 @@ peek_data_in_memory(const as_msg *m)
 	return ns && ns->storage_data_in_memory;
 }
 
+// Transactions that may run long even in a data-in-memory namespace - UDFs run
+// Lua, and queries may be configured to run in the transaction thread.
+static bool
+is_long_running(const as_transaction *tr)
+{
+	return as_transaction_is_udf(tr) ||
+			(g_config.query_in_transaction_thr && as_transaction_is_query(tr));
+}
+
 // Set of threads which talk to client over the connection for doing the needful
 // processing. Note that once fd is assigned to a thread all the work on that fd
 // is done by that thread. Fair fd usage is expected of the client. First thread
@@ -386,6 +484,8 @@ thr_demarshal(void *unused)
 	int nevents, i;
 	cf_clock last_fd_print = 0;
 
+	cf_thread_set_role("demarshal");
+
 #if defined(USE_SYSTEMTAP)
 	uint64_t nodeid = g_config.self_node;
 #endif
@@ -410,12 +510,15 @@ thr_demarshal(void *unused)
 
 	cf_poll_create(&poll);
 
-	// First thread accepts new connection at interface socket.
+	// First thread accepts new connection at interface socket. Other accept
+	// shards get their listeners once everything is up.
+	cf_sockets *listen_socks = &g_sockets[thr_id];
+
 	if (thr_id == 0) {
 		demarshal_file_handle_init();
 
-		cf_poll_add_sockets(poll, &g_sockets, EPOLLIN | EPOLLERR | EPOLLHUP);
-		cf_socket_show_server(AS_DEMARSHAL, "client", &g_sockets);
+		cf_poll_add_sockets(poll, listen_socks, EPOLLIN | EPOLLERR | EPOLLHUP);
+		cf_socket_show_server(AS_DEMARSHAL, "client", listen_socks);
 	}
 
 	g_demarshal_args->polls[thr_id] = poll;
@@ -439,7 +542,7 @@ thr_demarshal(void *unused)
 		for (i = 0; i < nevents; i++) {
 			cf_socket *ssock = events[i].data;
 
-			if (cf_sockets_has_socket(&g_sockets, ssock)) {
+			if (cf_sockets_has_socket(listen_socks, ssock)) {
 				// Accept new connections on the service socket.
 				cf_socket csock;
 				cf_sock_addr sa;
@@ -482,6 +585,14 @@ thr_demarshal(void *unused)
 					tls_socket_prepare_server(g_service_tls, &csock);
 				}
 
+				if (g_config.busy_poll_us != 0 &&
+						! cf_socket_set_busy_poll(&csock, (int32_t)g_config.busy_poll_us)) {
+					if ((last_fd_print + 5000L) < cf_getms()) { // no more than 5 secs
+						cf_warning(AS_DEMARSHAL, "can't set busy poll on client connections - needs CAP_NET_ADMIN?");
+						last_fd_print = cf_getms();
+					}
+				}
+
 				// Create as_file_handle and queue it up in epoll_fd for further
 				// communication on one of the demarshal threads.
 				as_file_handle *fd_h = cf_rc_alloc(sizeof(as_file_handle));
@@ -496,6 +607,10 @@ thr_demarshal(void *unused)
 				fd_h->reap_me = false;
 				fd_h->proto = 0;
 				fd_h->proto_unread = (uint64_t)sizeof(as_proto);
+				fd_h->stash = NULL;
+				fd_h->stash_off = 0;
+				fd_h->stash_sz = 0;
+				fd_h->compression = COMPRESSION_NONE;
 				fd_h->fh_info = 0;
 				fd_h->security_filter = as_security_filter_create();
 
@@ -530,8 +645,14 @@ thr_demarshal(void *unused)
 					int32_t id;
 
 					if (g_config.auto_pin == CF_TOPO_AUTO_PIN_NONE) {
-						cf_detail(AS_DEMARSHAL, "no CPU pinning - dispatching incoming connection round-robin");
-						id = (id_cntr++) % g_demarshal_args->num_threads;
+						if (g_n_accept_shards > 1) {
+							// The kernel already spread connections over shards.
+							id = thr_id;
+						}
+						else {
+							cf_detail(AS_DEMARSHAL, "no CPU pinning - dispatching incoming connection round-robin");
+							id = (id_cntr++) % g_demarshal_args->num_threads;
+						}
 					}
 					else {
 						id = cf_topo_socket_cpu(&fd_h->sock);
@@ -583,27 +704,51 @@ thr_demarshal(void *unused)
 					goto NextEvent;
 				}
 
+				// Bytes received but not yet consumed - from a read-ahead by
+				// this event, or stashed by the previous request.
+				const uint8_t *ahead = NULL;
+				size_t ahead_sz = 0;
+
 				// If pointer is NULL, then we need to create a transaction and
 				// store it in the buffer.
 				if (fd_h->proto == NULL) {
-					int32_t recv_sz = cf_socket_recv(sock, (uint8_t *)&fd_h->proto_hdr + sizeof(as_proto) - fd_h->proto_unread,	fd_h->proto_unread, 0);
-
-					if (recv_sz <= 0) {
-						if (recv_sz != 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-							// This can happen because TLS protocol
-							// overhead can trip the epoll but no
-							// application-level bytes are actually
-							// available yet.
-							thr_demarshal_rearm(fd_h);
-							goto NextEvent;
+					if (fd_h->stash_sz != 0) {
+						// Client pipelined this request behind the previous one
+						// - it's served only after that one's response, so
+						// responses stay in request order.
+						ahead = fd_h->stash + fd_h->stash_off;
+						ahead_sz = fd_h->stash_sz;
+						cf_atomic64_incr(&g_stats.proto_pipelined_requests);
+					}
+					else {
+						int32_t recv_sz = cf_socket_recv(sock, g_read_ahead, sizeof(g_read_ahead), 0);
+
+						if (recv_sz <= 0) {
+							if (recv_sz != 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+								// This can happen because TLS protocol
+								// overhead can trip the epoll but no
+								// application-level bytes are actually
+								// available yet.
+								thr_demarshal_rearm(fd_h);
+								goto NextEvent;
+							}
+							cf_detail(AS_DEMARSHAL, "proto socket: read header fail: error: rv %d errno %d", recv_sz, errno);
+							goto NextEvent_FD_Cleanup;
 						}
-						cf_detail(AS_DEMARSHAL, "proto socket: read header fail: error: rv %d errno %d", recv_sz, errno);
-						goto NextEvent_FD_Cleanup;
+
+						ahead = g_read_ahead;
+						ahead_sz = (size_t)recv_sz;
 					}
 
-					fd_h->proto_unread -= recv_sz;
+					size_t hdr_sz = ahead_sz < fd_h->proto_unread ? ahead_sz : fd_h->proto_unread;
+
+					memcpy((uint8_t *)&fd_h->proto_hdr + sizeof(as_proto) - fd_h->proto_unread, ahead, hdr_sz);
+					ahead += hdr_sz;
+					ahead_sz -= hdr_sz;
+					fd_h->proto_unread -= hdr_sz;
 
 					if (fd_h->proto_unread != 0) {
+						stash_read_ahead(fd_h, ahead, ahead_sz); // frees stash
 						tls_socket_must_not_have_data(&fd_h->sock, "partial client read (size)");
 						thr_demarshal_rearm(fd_h);
 						goto NextEvent;
@@ -649,6 +794,20 @@ thr_demarshal(void *unused)
 					fd_h->proto_unread = fd_h->proto->sz;
 				}
 
+				// Take what we can of the body from read-ahead bytes.
+				if (fd_h->proto_unread != 0 && ahead_sz != 0) {
+					size_t body_sz = ahead_sz < fd_h->proto_unread ? ahead_sz : fd_h->proto_unread;
+
+					memcpy(fd_h->proto->data + (fd_h->proto->sz - fd_h->proto_unread), ahead, body_sz);
+					ahead += body_sz;
+					ahead_sz -= body_sz;
+					fd_h->proto_unread -= body_sz;
+				}
+
+				// Anything left over belongs to the next (pipelined) request.
+				// Must be saved before the transaction can rearm fd_h.
+				stash_read_ahead(fd_h, ahead, ahead_sz);
+
 				if (fd_h->proto_unread != 0) {
 					// Read the data.
 					int32_t recv_sz = cf_socket_recv(sock, fd_h->proto->data + (fd_h->proto->sz - fd_h->proto_unread), fd_h->proto_unread, 0);
@@ -714,7 +873,10 @@ thr_demarshal(void *unused)
 				}
 
 				// Check if it's compressed.
-				if (tr.msgp->proto.type == PROTO_TYPE_AS_MSG_COMPRESSED) {
+				compression_type comp_type =
+						as_packet_compression_type(tr.msgp->proto.type);
+
+				if (comp_type != COMPRESSION_NONE) {
 					// Decompress it - allocate buffer to hold decompressed
 					// packet.
 					uint8_t *decompressed_buf = NULL;
@@ -731,6 +893,9 @@ thr_demarshal(void *unused)
 					// decompressed packet from now on.
 					cf_free(proto_p);
 
+					// The client can take responses compressed the same way.
+					fd_h->compression = (uint8_t)comp_type;
+
 					// Get original packet.
 					tr.msgp = (cl_msg *)decompressed_buf;
 					as_proto_swap(&(tr.msgp->proto));
@@ -762,6 +927,8 @@ thr_demarshal(void *unused)
 					goto NextEvent;
 				}
 
+				as_capture_sample(&tr.msgp->proto, now_ns);
+
 				// For now only AS_MSG's contribute to this benchmark.
 				if (g_config.svc_benchmarks_enabled) {
 					tr.benchmark_time = histogram_insert_data_point(g_stats.svc_demarshal_hist, now_ns);
@@ -784,6 +951,8 @@ thr_demarshal(void *unused)
 
 				// Directly process or queue the transaction.
 				if (g_config.n_namespaces_in_memory != 0 &&
+						! is_long_running(&tr) &&
+						! as_tsvc_numa_remote(&tr) &&
 						(g_config.n_namespaces_not_in_memory == 0 ||
 								// Only peek if at least one of each config.
 								peek_data_in_memory(&tr.msgp->msg))) {
@@ -791,7 +960,9 @@ thr_demarshal(void *unused)
 					as_tsvc_process_transaction(&tr);
 				}
 				else {
-					// Data-not-in-memory namespace - process via queues.
+					// Data-not-in-memory namespace, a transaction that would
+					// stall this thread's other connections, or one whose
+					// partition another NUMA node owns - process via queues.
 					as_tsvc_enqueue(&tr);
 				}
 
@@ -865,6 +1036,29 @@ add_local(cf_serv_cfg *serv_cfg, cf_sock_owner owner)
 	}
 }
 
+// With threads pinned, shard k runs on CPU k - have the kernel hand each
+// connection to the shard on the CPU that took its packets.
+static void
+demarshal_steer_accepts()
+{
+	uint16_t os_cpus[g_n_accept_shards];
+	uint32_t n_shards = g_n_accept_shards;
+	uint16_t n_cpus = cf_topo_count_cpus();
+
+	if (n_shards > n_cpus) {
+		n_shards = n_cpus;
+	}
+
+	for (uint32_t i = 0; i < n_shards; i++) {
+		os_cpus[i] = cf_topo_cpu_os_index((cf_topo_cpu_index)i);
+	}
+
+	// Steering applies to a whole reuse-port group - one group per address.
+	for (uint32_t j = 0; j < g_sockets[0].n_socks; j++) {
+		cf_socket_steer_by_cpu(&g_sockets[0].socks[j], os_cpus, n_shards);
+	}
+}
+
 // Initialize the demarshal service, start demarshal threads.
 int
 as_demarshal_start()
@@ -884,8 +1078,21 @@ as_demarshal_start()
 
 	as_xdr_info_port(&g_service_bind);
 
-	if (cf_socket_init_server(&g_service_bind, &g_sockets) < 0) {
-		cf_crash(AS_DEMARSHAL, "Couldn't initialize service socket");
+	dm->num_threads = g_config.n_service_threads;
+
+	if (g_config.accept_shards) {
+		g_n_accept_shards = (uint32_t)dm->num_threads;
+		g_service_bind.reuse_port = true;
+	}
+
+	for (uint32_t i = 0; i < g_n_accept_shards; i++) {
+		if (cf_socket_init_server(&g_service_bind, &g_sockets[i]) < 0) {
+			cf_crash(AS_DEMARSHAL, "Couldn't initialize service socket");
+		}
+	}
+
+	if (g_n_accept_shards > 1 && g_config.auto_pin != CF_TOPO_AUTO_PIN_NONE) {
+		demarshal_steer_accepts();
 	}
 
 	// Create all the epoll_fds and wait for all the threads to come up.
@@ -893,8 +1100,6 @@ as_demarshal_start()
 	cf_info(AS_DEMARSHAL, "starting %u demarshal threads",
 			g_config.n_service_threads);
 
-	dm->num_threads = g_config.n_service_threads;
-
 	for (int32_t i = 1; i < dm->num_threads; ++i) {
 		if (pthread_create(&dm->dm_th[i], NULL, thr_demarshal, NULL) != 0) {
 			cf_crash(AS_DEMARSHAL, "Can't create demarshal threads");
@@ -907,6 +1112,8 @@ as_demarshal_start()
 		}
 	}
 
+	g_n_started_threads = dm->num_threads;
+
 	// Create first thread which is the listener. We do this one last, as it
 	// requires the other threads' epoll instances.
 	if (pthread_create(&dm->dm_th[0], NULL, thr_demarshal, NULL) != 0) {
@@ -918,5 +1125,53 @@ as_demarshal_start()
 		usleep(1000);
 	}
 
+	// Remaining accept shards start listening now that every thread (and the
+	// file handle table) is ready for their connections.
+	for (uint32_t i = 1; i < g_n_accept_shards; i++) {
+		cf_poll_add_sockets(dm->polls[i], &g_sockets[i],
+				EPOLLIN | EPOLLERR | EPOLLHUP);
+	}
+
+	if (g_n_accept_shards > 1) {
+		cf_info(AS_DEMARSHAL, "accepting on %u listener shards",
+				g_n_accept_shards);
+	}
+
 	return 0;
 }
+
+// Triggered via dynamic configuration change. Not possible when event loops
+// are tied to CPUs or to listener shards. Added loops start getting new
+// connections once they're up. Removed loops keep running, but get no new
+// connections, and each existing one moves to a live loop when next rearmed.
+// Removed loops are reused if loops are added again.
+bool
+as_demarshal_set_threads(uint32_t n_threads)
+{
+	if (g_config.auto_pin != CF_TOPO_AUTO_PIN_NONE || g_n_accept_shards > 1) {
+		cf_warning(AS_DEMARSHAL, "can't change service-threads with auto-pin or accept-shards");
+		return false;
+	}
+
+	demarshal_args *dm = g_demarshal_args;
+
+	for (uint32_t i = g_n_started_threads; i < n_threads; i++) {
+		if (pthread_create(&dm->dm_th[i], NULL, thr_demarshal, NULL) != 0) {
+			cf_warning(AS_DEMARSHAL, "can't create demarshal thread");
+			return false;
+		}
+
+		while (CEFD(dm->polls[i]) == 0) {
+			usleep(1000);
+		}
+
+		g_n_started_threads = i + 1;
+	}
+
+	dm->num_threads = n_threads;
+	g_config.n_service_threads = n_threads;
+
+	cf_info(AS_DEMARSHAL, "now using %u demarshal threads", n_threads);
+
+	return true;
+}
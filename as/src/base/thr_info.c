@@ -43,20 +43,27 @@
 #include "citrusleaf/cf_vector.h"
 
 #include "cf_str.h"
+#include "compression.h"
 #include "dynbuf.h"
 #include "fault.h"
+#include "hardware.h"
 #include "meminfo.h"
+#include "obj_pool.h"
 #include "shash.h"
 #include "socket.h"
 
 #include "ai_obj.h"
 #include "ai_btree.h"
 
+#include "base/aggr.h"
 #include "base/batch.h"
+#include "base/capture.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
+#include "base/index_compact.h"
 #include "base/monitor.h"
+#include "base/quota.h"
 #include "base/scan.h"
 #include "base/thr_batch.h"
 #include "base/thr_demarshal.h"
@@ -95,6 +102,10 @@
 #define STR_ITYPE_MAPKEYS   "MAPKEYS"
 #define STR_ITYPE_MAPVALUES "MAPVALUES"
 #define STR_BINTYPE         "bintype"
+#define STR_COVERING        "covering"
+#define STR_STRINGKEYS      "stringkeys"
+#define STR_STRINGKEYS_ORD  "ordered"
+#define STR_STRINGKEYS_DG   "digest"
 
 extern int as_nsup_queue_get_size();
 
@@ -114,6 +125,37 @@ uint64_t g_start_ms; // start time of the server
 
 static cf_queue *g_info_work_q = 0;
 
+// Requests made up only of these go to a separate queue, so they aren't stuck
+// behind expensive diagnostics. Keep to items that don't walk records, sets,
+// bins or indexes.
+static cf_queue *g_info_fast_work_q = 0;
+
+static const char *FAST_INFO_NAMES[] = {
+		"build", "cluster-generation", "cluster-name", "edition", "features",
+		"node", "partition-generation", "partitions", "peers-clear-alt",
+		"peers-clear-std", "peers-generation", "peers-tls-alt", "peers-tls-std",
+		"replicas-all", "replicas-master", "replicas-prole", "service",
+		"service-clear-alt", "service-clear-std", "service-tls-alt",
+		"service-tls-std", "services", "services-alternate", "status",
+		"version"
+};
+
+#define N_FAST_INFO_NAMES (sizeof(FAST_INFO_NAMES) / sizeof(const char *))
+
+// Replica maps are polled constantly by clients but only change with the
+// partition generation - rebuild them only then.
+typedef struct info_cached_s {
+	pthread_mutex_t	lock;
+	bool			valid;
+	uint32_t		generation;
+	uint8_t			*buf;
+	size_t			sz;
+} info_cached;
+
+static info_cached g_replicas_all_cache = { PTHREAD_MUTEX_INITIALIZER };
+static info_cached g_replicas_master_cache = { PTHREAD_MUTEX_INITIALIZER };
+static info_cached g_replicas_prole_cache = { PTHREAD_MUTEX_INITIALIZER };
+
 //
 // Info has its own fabric service
 // which allows it to communicate things like the IP addresses of
@@ -256,14 +298,25 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_append_int(db, "heap_efficiency_pct", (int)(efficiency_pct + 0.5));
 	info_append_uint32(db, "heap_site_count", site_count);
 
+	size_t pool_held_kbytes;
+	size_t pool_depot_kbytes;
+
+	cf_pool_stats(&pool_held_kbytes, &pool_depot_kbytes);
+	info_append_uint64(db, "heap_pool_held_kbytes", pool_held_kbytes);
+	info_append_uint64(db, "heap_pool_depot_kbytes", pool_depot_kbytes);
+
+	info_append_uint64(db, "log_async_dropped", cf_fault_async_n_dropped());
+
 	info_get_aggregated_namespace_stats(db);
 
 	info_append_int(db, "tsvc_queue", as_tsvc_queue_get_size());
+	info_append_uint64(db, "tsvc_queue_steals", g_stats.n_tsvc_steals); // not in ticker
 	info_append_int(db, "info_queue", as_info_queue_get_size());
 	info_append_int(db, "delete_queue", as_nsup_queue_get_size());
 	info_append_uint32(db, "rw_in_progress", rw_request_hash_count());
 	info_append_uint32(db, "proxy_in_progress", as_proxy_hash_count());
 	info_append_int(db, "tree_gc_queue", as_index_tree_gc_queue_size());
+	info_append_uint64(db, "tree_gc_backlog", as_index_tree_gc_backlog());
 
 	info_append_uint64(db, "client_connections", g_stats.proto_connections_opened - g_stats.proto_connections_closed);
 	info_append_uint64(db, "heartbeat_connections", g_stats.heartbeat_connections_opened - g_stats.heartbeat_connections_closed);
@@ -273,6 +326,7 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_append_uint64(db, "heartbeat_received_foreign", g_stats.heartbeat_received_foreign);
 
 	info_append_uint64(db, "reaped_fds", g_stats.reaper_count); // not in ticker
+	info_append_uint64(db, "client_pipelined_requests", g_stats.proto_pipelined_requests); // not in ticker
 
 	info_append_uint64(db, "info_complete", g_stats.info_complete); // not in ticker
 
@@ -299,12 +353,17 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_append_uint64(db, "batch_index_huge_buffers", g_stats.batch_index_huge_buffers);
 	info_append_uint64(db, "batch_index_created_buffers", g_stats.batch_index_created_buffers);
 	info_append_uint64(db, "batch_index_destroyed_buffers", g_stats.batch_index_destroyed_buffers);
+	info_append_uint64(db, "batch_index_adaptive_buffers", g_stats.batch_index_adaptive_buffers);
+	info_append_uint64(db, "batch_index_sent_buffers", g_stats.batch_index_sent_buffers);
 
 	info_append_uint64(db, "batch_initiate", g_stats.batch_initiate);
 	info_append_int(db, "batch_queue", as_batch_direct_queue_size());
 	info_append_uint64(db, "batch_error", g_stats.batch_errors);
 	info_append_uint64(db, "batch_timeout", g_stats.batch_timeout);
 
+	info_append_uint64(db, "udf_lua_in_flight", g_stats.udf_lua_in_flight);
+	info_append_uint64(db, "udf_lua_in_flight_max", g_stats.udf_lua_in_flight_max);
+
 	info_append_int(db, "scans_active", as_scan_get_active_job_count());
 
 	info_append_uint32(db, "query_short_running", g_query_short_running);
@@ -512,10 +571,45 @@ info_get_partition_info(char *name, cf_dyn_buf *db)
 }
 
 // Deprecate in "six months".
+static void
+info_append_cached(info_cached *cache, void (*build_fn)(cf_dyn_buf *db),
+		cf_dyn_buf *db)
+{
+	pthread_mutex_lock(&cache->lock);
+
+	uint32_t generation = cf_atomic32_get(g_partition_generation);
+
+	if (! cache->valid || cache->generation != generation) {
+		cf_dyn_buf_define_size(built, 16 * 1024);
+
+		build_fn(&built);
+
+		if (cache->buf) {
+			cf_free(cache->buf);
+		}
+
+		cache->buf = cf_malloc(built.used_sz);
+		memcpy(cache->buf, built.buf, built.used_sz);
+		cache->sz = built.used_sz;
+
+		// If the map changed while building, the generation has moved on and
+		// the next request rebuilds.
+		cache->generation = generation;
+		cache->valid = true;
+
+		cf_dyn_buf_free(&built);
+	}
+
+	cf_dyn_buf_append_buf(db, cache->buf, cache->sz);
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
 int
 info_get_replicas_prole(char *name, cf_dyn_buf *db)
 {
-	as_partition_get_replicas_prole_str(db);
+	info_append_cached(&g_replicas_prole_cache,
+			as_partition_get_replicas_prole_str, db);
 
 	return(0);
 }
@@ -523,7 +617,8 @@ info_get_replicas_prole(char *name, cf_dyn_buf *db)
 int
 info_get_replicas_master(char *name, cf_dyn_buf *db)
 {
-	as_partition_get_replicas_master_str(db);
+	info_append_cached(&g_replicas_master_cache,
+			as_partition_get_replicas_master_str, db);
 
 	return(0);
 }
@@ -531,11 +626,37 @@ info_get_replicas_master(char *name, cf_dyn_buf *db)
 int
 info_get_replicas_all(char *name, cf_dyn_buf *db)
 {
-	as_partition_get_replicas_all_str(db);
+	info_append_cached(&g_replicas_all_cache,
+			as_partition_get_replicas_all_str, db);
 
 	return(0);
 }
 
+int
+info_command_replicas_delta(char *name, char *params, cf_dyn_buf *db)
+{
+	// Command Format:  "replicas-delta:<seq>"
+	//
+	// Returns the current sequence number and the client replica map changes
+	// since <seq> (0 gets the full map). Clients pass the returned sequence
+	// number on their next request.
+
+	uint64_t since;
+
+	if (cf_str_atoi_u64(params, &since) < 0) {
+		cf_warning(AS_INFO, "invalid replicas-delta sequence %s", params);
+		cf_dyn_buf_append_string(db, "ERROR::bad-sequence");
+		return 0;
+	}
+
+	if (! as_partition_get_replicas_delta_str(db, since)) {
+		info_append_cached(&g_replicas_all_cache,
+				as_partition_get_replicas_all_str, db);
+	}
+
+	return 0;
+}
+
 //
 // COMMANDS
 //
@@ -1208,6 +1329,64 @@ info_command_jem_stats(char *name, char *params, cf_dyn_buf *db)
 	return 0;
 }
 
+static void
+info_append_jem_arena(cf_dyn_buf *db, const char *name, int32_t arena)
+{
+	size_t active_kbytes;
+	size_t dirty_kbytes;
+	size_t mapped_kbytes;
+
+	cf_alloc_arena_stats(arena, &active_kbytes, &dirty_kbytes, &mapped_kbytes);
+
+	cf_dyn_buf_append_string(db, name);
+	cf_dyn_buf_append_string(db, ":arena=");
+	cf_dyn_buf_append_int(db, arena);
+	cf_dyn_buf_append_string(db, ":active-kbytes=");
+	cf_dyn_buf_append_uint64(db, active_kbytes);
+	cf_dyn_buf_append_string(db, ":dirty-kbytes=");
+	cf_dyn_buf_append_uint64(db, dirty_kbytes);
+	cf_dyn_buf_append_string(db, ":mapped-kbytes=");
+	cf_dyn_buf_append_uint64(db, mapped_kbytes);
+	cf_dyn_buf_append_char(db, ';');
+}
+
+/*
+ *  Report per-arena JEMalloc usage for subsystem and namespace arenas.
+ *
+ *  Command Format:  "jem-arenas"
+ */
+int
+info_command_jem_arenas(char *name, char *params, cf_dyn_buf *db)
+{
+	for (int i = 0; i < CF_ALLOC_SUBSYS_MAX; i++) {
+		info_append_jem_arena(db, cf_alloc_subsys_name((cf_alloc_subsys)i),
+				cf_alloc_subsys_arena((cf_alloc_subsys)i));
+	}
+
+	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+		as_namespace *ns = g_config.namespaces[i];
+
+		info_append_jem_arena(db, ns->name, ns->jem_arena);
+	}
+
+	cf_dyn_buf_chomp(db);
+	return 0;
+}
+
+/*
+ *  Report cumulative CPU time per thread role.
+ *
+ *  Command Format:  "thread-cpu"
+ *
+ *  Sample twice and subtract to find which roles are burning CPU.
+ */
+int
+info_command_thread_cpu(char *name, char *params, cf_dyn_buf *db)
+{
+	cf_thread_role_cpu(db);
+	return 0;
+}
+
 /*
  *  Print out System Metadata info.
  */
@@ -1336,6 +1515,7 @@ info_command_mon_cmd(char *name, char *params, cf_dyn_buf *db)
 	 *                   asinfo -v 'jobs:module=query' -> list all jobs for query module
 	 *                   asinfo -v 'jobs:module=query;cmd=kill-job;trid=<trid>'
 	 *                   asinfo -v 'jobs:module=query;cmd=set-priority;trid=<trid>;value=<val>'
+	 *                   asinfo -v 'jobs:module=scan;cmd=set-rps;trid=<trid>;value=<val>'
 	 *
 	 *  where <module> is one of following:
 	 *      - query
@@ -1474,14 +1654,17 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_string_safe(db, "pidfile", g_config.pidfile);
 	info_append_int(db, "proto-fd-max", g_config.n_proto_fd_max);
 
+	info_append_bool(db, "accept-shards", g_config.accept_shards);
 	info_append_bool(db, "advertise-ipv6", cf_socket_advertises_ipv6());
 	info_append_string(db, "auto-pin", auto_pin_string());
 	info_append_int(db, "batch-threads", g_config.n_batch_threads);
 	info_append_uint32(db, "batch-max-buffers-per-queue", g_config.batch_max_buffers_per_queue);
 	info_append_uint32(db, "batch-max-requests", g_config.batch_max_requests);
+	info_append_uint32(db, "batch-max-sub-in-flight", g_config.batch_max_sub_in_flight);
 	info_append_uint32(db, "batch-max-unused-buffers", g_config.batch_max_unused_buffers);
 	info_append_uint32(db, "batch-priority", g_config.batch_priority);
 	info_append_uint32(db, "batch-index-threads", g_config.n_batch_index_threads);
+	info_append_uint32(db, "busy-poll-us", g_config.busy_poll_us);
 	info_append_int(db, "clock-skew-max-ms", g_config.clock_skew_max_ms);
 
 	char cluster_name[AS_CLUSTER_NAME_SZ];
@@ -1495,6 +1678,7 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_uint32(db, "hist-track-slice", g_config.hist_track_slice);
 	info_append_string_safe(db, "hist-track-thresholds", g_config.hist_track_thresholds);
 	info_append_int(db, "info-threads", g_config.n_info_threads);
+	info_append_bool(db, "log-async", cf_fault_is_logging_async());
 	info_append_bool(db, "log-local-time", cf_fault_is_using_local_time());
 	info_append_uint32(db, "migrate-max-num-incoming", g_config.migrate_max_num_incoming);
 	info_append_uint32(db, "migrate-threads", g_config.n_migrate_threads);
@@ -1503,11 +1687,14 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_uint32(db, "nsup-delete-sleep", g_config.nsup_delete_sleep);
 	info_append_uint32(db, "nsup-period", g_config.nsup_period);
 	info_append_bool(db, "nsup-startup-evict", g_config.nsup_startup_evict);
+	info_append_uint32(db, "nsup-threads", g_config.n_nsup_threads);
+	info_append_bool(db, "numa-partitions", g_config.numa_partitions);
 	info_append_int(db, "proto-fd-idle-ms", g_config.proto_fd_idle_ms);
 	info_append_int(db, "proto-slow-netio-sleep-ms", g_config.proto_slow_netio_sleep_ms); // dynamic only
 	info_append_uint32(db, "query-batch-size", g_config.query_bsize);
 	info_append_uint32(db, "query-buf-size", g_config.query_buf_size); // dynamic only
 	info_append_uint32(db, "query-bufpool-size", g_config.query_bufpool_size);
+	info_append_uint32(db, "query-cursor-ttl", g_config.query_cursor_ttl);
 	info_append_bool(db, "query-in-transaction-thread", g_config.query_in_transaction_thr);
 	info_append_uint32(db, "query-long-q-max-size", g_config.query_long_q_max_size);
 	info_append_bool(db, "query-microbenchmark", g_config.query_enable_histogram); // dynamic only
@@ -1522,7 +1709,9 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_uint32(db, "query-threshold", g_config.query_threshold);
 	info_append_uint64(db, "query-untracked-time-ms", g_config.query_untracked_time_ms);
 	info_append_uint32(db, "query-worker-threads", g_config.query_worker_threads);
+	info_append_uint32(db, "record-locks", g_config.n_record_locks);
 	info_append_bool(db, "run-as-daemon", g_config.run_as_daemon);
+	info_append_uint32(db, "scan-aggr-parallelism", g_config.scan_aggr_parallelism);
 	info_append_uint32(db, "scan-max-active", g_config.scan_max_active);
 	info_append_uint32(db, "scan-max-done", g_config.scan_max_done);
 	info_append_uint32(db, "scan-max-udf-transactions", g_config.scan_max_udf_transactions);
@@ -1534,6 +1723,8 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_uint32(db, "ticker-interval", g_config.ticker_interval);
 	info_append_int(db, "transaction-max-ms", (int)(g_config.transaction_max_ns / 1000000));
 	info_append_uint32(db, "transaction-pending-limit", g_config.transaction_pending_limit);
+	info_append_uint32(db, "transaction-queue-batch-ratio", g_config.transaction_queue_batch_ratio);
+	info_append_bool(db, "transaction-queue-stealing", g_config.transaction_queue_stealing);
 	info_append_uint32(db, "transaction-queues", g_config.n_transaction_queues);
 	info_append_uint32(db, "transaction-retry-ms", g_config.transaction_retry_ms);
 	info_append_uint32(db, "transaction-threads-per-queue", g_config.n_transaction_threads_per_queue);
@@ -1669,6 +1860,7 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 	cf_hist_track_get_settings(ns->udf_hist, db);
 	cf_hist_track_get_settings(ns->write_hist, db);
 
+	info_append_uint32(db, "cdc-ring-size", ns->cdc_ring_size);
 	info_append_uint32(db, "cold-start-evict-ttl", ns->cold_start_evict_ttl);
 
 	if (ns->conflict_resolution_policy == AS_NAMESPACE_CONFLICT_RESOLUTION_POLICY_GENERATION) {
@@ -1681,6 +1873,7 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 		info_append_string(db, "conflict-resolution-policy", "undefined");
 	}
 
+	info_append_bool(db, "contiguous-records", ns->contiguous_records);
 	info_append_bool(db, "data-in-index", ns->data_in_index);
 	info_append_bool(db, "disallow-null-setname", ns->disallow_null_setname);
 	info_append_bool(db, "enable-benchmarks-batch-sub", ns->batch_sub_benchmarks_enabled);
@@ -1690,22 +1883,34 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 	info_append_bool(db, "enable-benchmarks-write", ns->write_benchmarks_enabled);
 	info_append_bool(db, "enable-hist-proxy", ns->proxy_hist_enabled);
 	info_append_uint32(db, "evict-hist-buckets", ns->evict_hist_buckets);
+	info_append_bool(db, "evict-lru", ns->evict_lru);
 	info_append_uint32(db, "evict-tenths-pct", ns->evict_tenths_pct);
 	info_append_uint32(db, "high-water-disk-pct", ns->hwm_disk_pct);
 	info_append_uint32(db, "high-water-memory-pct", ns->hwm_memory_pct);
+	info_append_uint32(db, "hot-key-sample-rate", ns->hot_key_sample_rate);
+	info_append_bool(db, "index-huge-pages", ns->index_huge_pages);
+	info_append_bool(db, "index-numa-interleave", ns->index_numa_interleave);
+	info_append_string_safe(db, "index-snapshot-file", ns->index_snapshot_file);
 	info_append_uint64(db, "max-ttl", ns->max_ttl);
 	info_append_uint32(db, "migrate-order", ns->migrate_order);
 	info_append_uint32(db, "migrate-retransmit-ms", ns->migrate_retransmit_ms);
 	info_append_uint32(db, "migrate-sleep", ns->migrate_sleep);
+	info_append_uint32(db, "migrate-target-latency-ms", ns->migrate_target_latency_ms);
 	info_append_uint32(db, "obj-size-hist-max", ns->obj_size_hist_max); // not original, may have been rounded
+	info_append_bool(db, "partition-tree-hash", ns->tree_shared.hash_index);
 	info_append_uint32(db, "partition-tree-locks", ns->tree_shared.n_lock_pairs);
 	info_append_uint32(db, "partition-tree-sprigs", ns->tree_shared.n_sprigs);
+	info_append_uint64(db, "quota-bytes-per-sec", as_quota_get_rate(&ns->quota.bytes));
+	info_append_uint64(db, "quota-ops-per-sec", as_quota_get_rate(&ns->quota.ops));
 	info_append_uint32(db, "rack-id", ns->rack_id);
+	info_append_bool(db, "rack-local-reads", ns->rack_local_reads);
 	info_append_string(db, "read-consistency-level-override", NS_READ_CONSISTENCY_LEVEL_NAME());
+	info_append_uint32(db, "response-compression-threshold", ns->response_compression_threshold);
 	info_append_bool(db, "single-bin", ns->single_bin);
 	info_append_uint32(db, "stop-writes-pct", ns->stop_writes_pct);
 	info_append_uint32(db, "tomb-raider-eligible-age", ns->tomb_raider_eligible_age);
 	info_append_uint32(db, "tomb-raider-period", ns->tomb_raider_period);
+	info_append_uint32(db, "truncate-delete-sleep", ns->truncate_delete_sleep);
 	info_append_string(db, "write-commit-level-override", NS_WRITE_COMMIT_LEVEL_NAME());
 
 	info_append_string(db, "storage-engine",
@@ -1736,6 +1941,11 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 		info_append_uint32(db, "storage-engine.write-block-size", ns->storage_write_block_size);
 		info_append_bool(db, "storage-engine.data-in-memory", ns->storage_data_in_memory);
 		info_append_bool(db, "storage-engine.cold-start-empty", ns->storage_cold_start_empty);
+		info_append_uint32(db, "storage-engine.cold-start-threads", ns->storage_cold_start_threads);
+		info_append_bool(db, "storage-engine.commit-to-device", ns->storage_commit_to_device);
+		info_append_string(db, "storage-engine.compression", cf_compression_method_str(ns->storage_compression));
+		info_append_uint32(db, "storage-engine.compression-level", ns->storage_compression_level);
+		info_append_bool(db, "storage-engine.defrag-adaptive", ns->storage_defrag_adaptive);
 		info_append_uint32(db, "storage-engine.defrag-lwm-pct", ns->storage_defrag_lwm_pct);
 		info_append_uint32(db, "storage-engine.defrag-queue-min", ns->storage_defrag_queue_min);
 		info_append_uint32(db, "storage-engine.defrag-sleep", ns->storage_defrag_sleep);
@@ -1745,14 +1955,24 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 		info_append_bool(db, "storage-engine.enable-osync", ns->storage_enable_osync);
 		info_append_uint64(db, "storage-engine.flush-max-ms", ns->storage_flush_max_us / 1000);
 		info_append_uint64(db, "storage-engine.fsync-max-sec", ns->storage_fsync_max_us / 1000000);
+		info_append_uint32(db, "storage-engine.hot-record-age", ns->storage_hot_record_age);
+		info_append_uint64(db, "storage-engine.hot-tier-size", ns->storage_hot_tier_size);
+		info_append_uint32(db, "storage-engine.io-uring-depth", ns->storage_io_uring_depth);
 		info_append_uint64(db, "storage-engine.max-write-cache", ns->storage_max_write_cache);
 		info_append_uint32(db, "storage-engine.min-avail-pct", ns->storage_min_avail_pct);
+		info_append_bool(db, "storage-engine.persist-map-index", ns->storage_persist_map_index);
+		info_append_bool(db, "storage-engine.persistent-memory", ns->storage_persistent_memory);
 		info_append_uint32(db, "storage-engine.post-write-queue", ns->storage_post_write_queue);
+		info_append_uint64(db, "storage-engine.read-cache-size", ns->storage_read_cache_size);
+		info_append_uint64(db, "storage-engine.shadow-max-write-cache", ns->storage_shadow_max_write_cache);
 		info_append_uint32(db, "storage-engine.tomb-raider-sleep", ns->storage_tomb_raider_sleep);
+		info_append_uint32(db, "storage-engine.write-shards", ns->storage_write_shards);
 		info_append_uint32(db, "storage-engine.write-threads", ns->storage_write_threads);
+		info_append_bool(db, "storage-engine.zoned", ns->storage_zoned);
 	}
 
 	info_append_uint32(db, "sindex.num-partitions", ns->sindex_num_partitions);
+	info_append_bool(db, "sindex.deferred-updates", ns->sindex_deferred_updates);
 
 	info_append_bool(db, "geo2dsphere-within.strict", ns->geo2dsphere_within_strict);
 	info_append_uint32(db, "geo2dsphere-within.min-level", (uint32_t)ns->geo2dsphere_within_min_level);
@@ -1882,6 +2102,45 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of transaction-threads-per-queue from %u to %d ", g_config.n_transaction_threads_per_queue, val);
 			as_tsvc_set_threads_per_queue((uint32_t)val);
 		}
+		else if (0 == as_info_parameter_get(params, "transaction-queues", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val)) {
+				goto Error;
+			}
+			if (val < 1 || val > MAX_TRANSACTION_QUEUES) {
+				cf_warning(AS_INFO, "transaction-queues must be between 1 and %u", MAX_TRANSACTION_QUEUES);
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of transaction-queues from %u to %d ", g_config.n_transaction_queues, val);
+			if (! as_tsvc_set_n_queues((uint32_t)val)) {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "service-threads", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val)) {
+				goto Error;
+			}
+			if (val < 1 || val > MAX_DEMARSHAL_THREADS) {
+				cf_warning(AS_INFO, "service-threads must be between 1 and %u", MAX_DEMARSHAL_THREADS);
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of service-threads from %u to %d ", g_config.n_service_threads, val);
+			if (! as_demarshal_set_threads((uint32_t)val)) {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "transaction-queue-stealing", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of transaction-queue-stealing from %s to %s", bool_val[g_config.transaction_queue_stealing], context);
+				g_config.transaction_queue_stealing = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of transaction-queue-stealing from %s to %s", bool_val[g_config.transaction_queue_stealing], context);
+				g_config.transaction_queue_stealing = false;
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "transaction-retry-ms", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
@@ -1928,6 +2187,15 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			g_config.scan_max_done = val;
 			as_scan_limit_finished_jobs(g_config.scan_max_done);
 		}
+		else if (0 == as_info_parameter_get(params, "scan-aggr-parallelism", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val))
+				goto Error;
+			if (val < 1 || val > AS_AGGR_MAX_LANES) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of scan-aggr-parallelism from %u to %d ", g_config.scan_aggr_parallelism, val);
+			g_config.scan_aggr_parallelism = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "scan-max-udf-transactions", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
@@ -1968,6 +2236,12 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of batch-max-buffers-per-queue from %d to %d ", g_config.batch_max_buffers_per_queue, val);
 			g_config.batch_max_buffers_per_queue = val;
 		}
+		else if (0 == as_info_parameter_get(params, "batch-max-sub-in-flight", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of batch-max-sub-in-flight from %d to %d ", g_config.batch_max_sub_in_flight, val);
+			g_config.batch_max_sub_in_flight = val;
+		}
 		else if (0 == as_info_parameter_get(params, "batch-max-unused-buffers", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
@@ -2010,6 +2284,16 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of nsup-period from %d to %d ", g_config.nsup_period, val);
 			g_config.nsup_period = val;
 		}
+		else if (0 == as_info_parameter_get(params, "nsup-threads", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val))
+				goto Error;
+			if (val < 1 || val > MAX_NSUP_THREADS) {
+				cf_warning(AS_INFO, "nsup-threads %d must be >= 1 and <= %u", val, MAX_NSUP_THREADS);
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of nsup-threads from %u to %d ", g_config.n_nsup_threads, val);
+			g_config.n_nsup_threads = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get( params, "cluster-name", context, &context_len)){
 			if (!as_config_cluster_name_set(context)) {
 				goto Error;
@@ -2196,6 +2480,14 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of query-bufpool-size from %d to %"PRIu64, g_config.query_bufpool_size, val);
 			g_config.query_bufpool_size = val;
 		}
+		else if (0 == as_info_parameter_get(params, "query-cursor-ttl", context, &context_len)) {
+			uint64_t val = atoll(context);
+			if ((int64_t)val <= 0 || val > UINT32_MAX) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of query-cursor-ttl from %u to %"PRIu64, g_config.query_cursor_ttl, val);
+			g_config.query_cursor_ttl = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "query-in-transaction-thread", context, &context_len)) {
 			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
 				cf_info(AS_INFO, "Changing value of query-in-transaction-thread  from %s to %s", bool_val[g_config.query_in_transaction_thr], context);
@@ -2342,6 +2634,13 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 				goto Error;
 			}
 		}
+		else if (0 == as_info_parameter_get(params, "heartbeat.phi-threshold", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val))
+				goto Error;
+			if (as_hb_phi_threshold_set(val) != 0){
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "heartbeat.mtu", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
@@ -2501,6 +2800,22 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 				cf_info(AS_INFO, "Changing value of set-stop-writes-count of ns %s set %s to %lu", ns->name, p_set->name, val);
 				cf_atomic64_set(&p_set->stop_writes_count, val);
 			}
+			else if (0 == as_info_parameter_get(params, "set-quota-ops-per-sec", context, &context_len)) {
+				uint64_t val;
+				if (0 != cf_str_atoi_u64(context, &val)) {
+					goto Error;
+				}
+				cf_info(AS_INFO, "Changing value of set-quota-ops-per-sec of ns %s set %s from %lu to %lu", ns->name, p_set->name, as_quota_get_rate(&p_set->quota.ops), val);
+				as_quota_set_rate(&p_set->quota.ops, val);
+			}
+			else if (0 == as_info_parameter_get(params, "set-quota-bytes-per-sec", context, &context_len)) {
+				uint64_t val;
+				if (0 != cf_str_atoi_u64(context, &val)) {
+					goto Error;
+				}
+				cf_info(AS_INFO, "Changing value of set-quota-bytes-per-sec of ns %s set %s from %lu to %lu", ns->name, p_set->name, as_quota_get_rate(&p_set->quota.bytes), val);
+				as_quota_set_rate(&p_set->quota.bytes, val);
+			}
 			else {
 				goto Error;
 			}
@@ -2534,6 +2849,19 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of high-water-memory-pct memory of ns %s from %u to %d ", ns->name, ns->hwm_memory_pct, val);
 			ns->hwm_memory_pct = (uint32_t)val;
 		}
+		else if (0 == as_info_parameter_get(params, "evict-lru", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of evict-lru of ns %s from %s to %s", ns->name, bool_val[ns->evict_lru], context);
+				ns->evict_lru = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of evict-lru of ns %s from %s to %s", ns->name, bool_val[ns->evict_lru], context);
+				ns->evict_lru = false;
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "evict-tenths-pct", context, &context_len)) {
 			cf_info(AS_INFO, "Changing value of evict-tenths-pct memory of ns %s from %d to %d ", ns->name, ns->evict_tenths_pct, atoi(context));
 			ns->evict_tenths_pct = atoi(context);
@@ -2603,6 +2931,17 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of migrate-sleep of ns %s from %u to %d", ns->name, ns->migrate_sleep, val);
 			ns->migrate_sleep = (uint32_t)val;
 		}
+		else if (0 == as_info_parameter_get(params, "migrate-target-latency-ms", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of migrate-target-latency-ms of ns %s from %u to %d", ns->name, ns->migrate_target_latency_ms, val);
+			ns->migrate_target_latency_ms = (uint32_t)val;
+
+			if (val == 0) {
+				cf_atomic32_set(&ns->migrate_pace_sleep, 0);
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "tomb-raider-eligible-age", context, &context_len)) {
 			uint64_t val;
 			if (cf_str_atoi_seconds(context, &val) != 0) {
@@ -2621,6 +2960,36 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of tomb-raider-period of ns %s from %u to %lu", ns->name, ns->tomb_raider_period, val);
 			ns->tomb_raider_period = (uint32_t)val;
 		}
+		else if (0 == as_info_parameter_get(params, "hot-key-sample-rate", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of hot-key-sample-rate of ns %s from %u to %d", ns->name, ns->hot_key_sample_rate, val);
+			ns->hot_key_sample_rate = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "quota-ops-per-sec", context, &context_len)) {
+			uint64_t val;
+			if (0 != cf_str_atoi_u64(context, &val)) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of quota-ops-per-sec of ns %s from %lu to %lu", ns->name, as_quota_get_rate(&ns->quota.ops), val);
+			as_quota_set_rate(&ns->quota.ops, val);
+		}
+		else if (0 == as_info_parameter_get(params, "quota-bytes-per-sec", context, &context_len)) {
+			uint64_t val;
+			if (0 != cf_str_atoi_u64(context, &val)) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of quota-bytes-per-sec of ns %s from %lu to %lu", ns->name, as_quota_get_rate(&ns->quota.bytes), val);
+			as_quota_set_rate(&ns->quota.bytes, val);
+		}
+		else if (0 == as_info_parameter_get(params, "truncate-delete-sleep", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of truncate-delete-sleep of ns %s from %u to %d", ns->name, ns->truncate_delete_sleep, val);
+			ns->truncate_delete_sleep = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "tomb-raider-sleep", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val)) {
 				goto Error;
@@ -2649,6 +3018,26 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of rack-id of ns %s from %u to %d", ns->name, ns->rack_id, val);
 			ns->rack_id = (uint32_t)val;
 		}
+		else if (0 == as_info_parameter_get(params, "rack-local-reads", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of rack-local-reads of ns %s from %s to %s", ns->name, bool_val[ns->rack_local_reads], context);
+				ns->rack_local_reads = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of rack-local-reads of ns %s from %s to %s", ns->name, bool_val[ns->rack_local_reads], context);
+				ns->rack_local_reads = false;
+			}
+			else {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "response-compression-threshold", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of response-compression-threshold of ns %s from %u to %d", ns->name, ns->response_compression_threshold, val);
+			ns->response_compression_threshold = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "conflict-resolution-policy", context, &context_len)) {
 			if (strncmp(context, "generation", 10) == 0) {
 				cf_info(AS_INFO, "Changing value of conflict-resolution-policy of ns %s from %d to %s", ns->name, ns->conflict_resolution_policy, context);
@@ -2677,6 +3066,19 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 				as_storage_defrag_sweep(ns);
 			}
 		}
+		else if (0 == as_info_parameter_get(params, "defrag-adaptive", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of defrag-adaptive of ns %s from %s to %s", ns->name, bool_val[ns->storage_defrag_adaptive], context);
+				ns->storage_defrag_adaptive = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of defrag-adaptive of ns %s from %s to %s", ns->name, bool_val[ns->storage_defrag_adaptive], context);
+				ns->storage_defrag_adaptive = false;
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "defrag-queue-min", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val)) {
 				goto Error;
@@ -2705,6 +3107,14 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of fsync-max-sec of ns %s from %lu to %d", ns->name, ns->storage_fsync_max_us / 1000000, val);
 			ns->storage_fsync_max_us = (uint64_t)val * 1000000;
 		}
+		else if (0 == as_info_parameter_get(params, "hot-record-age", context, &context_len)) {
+			uint64_t val;
+			if (cf_str_atoi_seconds(context, &val) != 0 || val > UINT32_MAX) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of hot-record-age of ns %s from %u to %lu", ns->name, ns->storage_hot_record_age, val);
+			ns->storage_hot_record_age = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "enable-xdr", context, &context_len)) {
 			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
 				cf_info(AS_INFO, "Changing value of enable-xdr of ns %s from %s to %s", ns->name, bool_val[ns->enable_xdr], context);
@@ -2918,6 +3328,20 @@ info_command_config_set_threadsafe(char *name, char *params, cf_dyn_buf *db)
 			ns->storage_max_write_cache = val_u64;
 			ns->storage_max_write_q = (int)(ns->storage_max_write_cache / ns->storage_write_block_size);
 		}
+		else if (0 == as_info_parameter_get(params, "shadow-max-write-cache", context, &context_len)) {
+			uint64_t val_u64;
+
+			if (0 != cf_str_atoi_u64(context, &val_u64)) {
+				goto Error;
+			}
+			if (val_u64 < ns->storage_write_block_size) {
+				cf_warning(AS_INFO, "can't set shadow-max-write-cache less than write-block-size");
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of shadow-max-write-cache of ns %s from %lu to %lu ", ns->name, ns->storage_shadow_max_write_cache, val_u64);
+			ns->storage_shadow_max_write_cache = val_u64;
+			ns->storage_shadow_max_write_q = (int)(ns->storage_shadow_max_write_cache / ns->storage_write_block_size);
+		}
 		else if (0 == as_info_parameter_get(params, "min-avail-pct", context, &context_len)) {
 			ns->storage_min_avail_pct = atoi(context);
 			cf_info(AS_INFO, "Changing value of min-avail-pct of ns %s from %u to %u ", ns->name, ns->storage_min_avail_pct, atoi(context));
@@ -3336,6 +3760,158 @@ info_command_hist_track(char *name, char *params, cf_dyn_buf *db)
 //	truncate:namespace=<ns-name>;lut=<UTC-nanosec-string>
 //	truncate:namespace=<ns-name>
 //
+int
+info_command_hot_keys(char *name, char *params, cf_dyn_buf *db)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = (int)sizeof(ns_name);
+
+	if (as_info_parameter_get(params, "namespace", ns_name, &ns_name_len) != 0 ||
+			ns_name_len == 0) {
+		cf_warning(AS_INFO, "hot-keys command: missing or invalid namespace name in command");
+		cf_dyn_buf_append_string(db, "ERROR::namespace-name");
+		return 0;
+	}
+
+	as_namespace *ns = as_namespace_get_byname(ns_name);
+
+	if (! ns) {
+		cf_warning(AS_INFO, "hot-keys command: unknown namespace %s", ns_name);
+		cf_dyn_buf_append_string(db, "ERROR::unknown-namespace");
+		return 0;
+	}
+
+	if (ns->hot_key_sample_rate == 0) {
+		cf_dyn_buf_append_string(db, "ERROR::hot-key-sample-rate-not-set");
+		return 0;
+	}
+
+	as_hot_keys_info(ns, db);
+
+	return 0;
+}
+
+//
+// capture-start:file=<path>[;sample-rate=<N>][;hash-keys=<bool>][;max-mb=<N>]
+//
+int
+info_command_capture_start(char *name, char *params, cf_dyn_buf *db)
+{
+	as_capture_start(params, db);
+	return 0;
+}
+
+//
+// capture-stop:
+//
+int
+info_command_capture_stop(char *name, char *params, cf_dyn_buf *db)
+{
+	as_capture_stop(db);
+	return 0;
+}
+
+//
+// cdc:namespace=<ns-name>;pid=<pid>;from=<seq>[;max=<n>]
+//
+int
+info_command_cdc(char *name, char *params, cf_dyn_buf *db)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = (int)sizeof(ns_name);
+
+	if (as_info_parameter_get(params, "namespace", ns_name, &ns_name_len) != 0 ||
+			ns_name_len == 0) {
+		cf_warning(AS_INFO, "cdc command: missing or invalid namespace name in command");
+		cf_dyn_buf_append_string(db, "ERROR::namespace-name");
+		return 0;
+	}
+
+	as_namespace *ns = as_namespace_get_byname(ns_name);
+
+	if (! ns) {
+		cf_warning(AS_INFO, "cdc command: unknown namespace %s", ns_name);
+		cf_dyn_buf_append_string(db, "ERROR::unknown-namespace");
+		return 0;
+	}
+
+	if (! ns->cdc_rings) {
+		cf_dyn_buf_append_string(db, "ERROR::cdc-ring-size-not-set");
+		return 0;
+	}
+
+	char val_str[32];
+	int val_str_len = (int)sizeof(val_str);
+	uint64_t pid;
+
+	if (as_info_parameter_get(params, "pid", val_str, &val_str_len) != 0 ||
+			cf_str_atoi_u64(val_str, &pid) != 0 || pid >= AS_PARTITIONS) {
+		cf_warning(AS_INFO, "cdc command: missing or invalid pid");
+		cf_dyn_buf_append_string(db, "ERROR::pid");
+		return 0;
+	}
+
+	uint64_t from;
+
+	val_str_len = (int)sizeof(val_str);
+
+	if (as_info_parameter_get(params, "from", val_str, &val_str_len) != 0 ||
+			cf_str_atoi_u64(val_str, &from) != 0) {
+		cf_warning(AS_INFO, "cdc command: missing or invalid from");
+		cf_dyn_buf_append_string(db, "ERROR::from");
+		return 0;
+	}
+
+	uint64_t max = 0;
+
+	val_str_len = (int)sizeof(val_str);
+
+	if (as_info_parameter_get(params, "max", val_str, &val_str_len) == 0 &&
+			(cf_str_atoi_u64(val_str, &max) != 0 || max > UINT32_MAX)) {
+		cf_warning(AS_INFO, "cdc command: invalid max");
+		cf_dyn_buf_append_string(db, "ERROR::max");
+		return 0;
+	}
+
+	as_cdc_info(ns, (uint32_t)pid, from, (uint32_t)max, db);
+
+	return 0;
+}
+
+//
+// index-compact:namespace=<ns-name>
+//
+int
+info_command_index_compact(char *name, char *params, cf_dyn_buf *db)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = (int)sizeof(ns_name);
+
+	if (as_info_parameter_get(params, "namespace", ns_name, &ns_name_len) != 0 ||
+			ns_name_len == 0) {
+		cf_warning(AS_INFO, "index-compact command: missing or invalid namespace name in command");
+		cf_dyn_buf_append_string(db, "ERROR::namespace-name");
+		return 0;
+	}
+
+	as_namespace *ns = as_namespace_get_byname(ns_name);
+
+	if (! ns) {
+		cf_warning(AS_INFO, "index-compact command: unknown namespace %s", ns_name);
+		cf_dyn_buf_append_string(db, "ERROR::unknown-namespace");
+		return 0;
+	}
+
+	if (! as_index_compact_start(ns)) {
+		cf_dyn_buf_append_string(db, "ERROR::already-compacting");
+		return 0;
+	}
+
+	cf_dyn_buf_append_string(db, "ok");
+
+	return 0;
+}
+
 int
 info_command_truncate(char *name, char *params, cf_dyn_buf *db)
 {
@@ -3505,8 +4081,21 @@ info_command	*command_head = 0;
 // But only gets 'default' values
 //
 
+// Once the dynbuf holds this much, finished entries move to the spill buffer
+// (if any) - a big response then costs no realloc copies beyond the largest
+// single entry.
+#define INFO_SPILL_SZ (64 * 1024)
+
+static inline void
+info_maybe_spill(cf_dyn_buf *db, cf_chunk_buf *spill)
+{
+	if (spill && db->used_sz >= INFO_SPILL_SZ) {
+		cf_chunk_buf_append_dyn_buf(spill, db);
+	}
+}
+
 int
-info_all(const as_file_handle* fd_h, cf_dyn_buf *db)
+info_all(const as_file_handle* fd_h, cf_dyn_buf *db, cf_chunk_buf *spill)
 {
 	uint8_t auth_result = as_security_check(fd_h, PERM_NONE);
 
@@ -3524,6 +4113,7 @@ info_all(const as_file_handle* fd_h, cf_dyn_buf *db)
 			cf_dyn_buf_append_char( db, SEP );
 			cf_dyn_buf_append_buf( db, (uint8_t *) s->value, s->value_sz);
 			cf_dyn_buf_append_char( db, EOL );
+			info_maybe_spill(db, spill);
 		}
 		s = s->next;
 	}
@@ -3535,6 +4125,7 @@ info_all(const as_file_handle* fd_h, cf_dyn_buf *db)
 			cf_dyn_buf_append_char(db, SEP );
 			d->value_fn(d->name, db);
 			cf_dyn_buf_append_char(db, EOL);
+			info_maybe_spill(db, spill);
 		}
 		d = d->next;
 	}
@@ -3548,7 +4139,8 @@ info_all(const as_file_handle* fd_h, cf_dyn_buf *db)
 // Filling the dynbuf
 
 int
-info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
+info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db,
+		cf_chunk_buf *spill)
 {
 	uint8_t auth_result = as_security_check(fd_h, PERM_NONE);
 
@@ -3681,6 +4273,7 @@ info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
 			tok = c + 1;
 		}
 
+		info_maybe_spill(db, spill);
 		c++;
 
 	}
@@ -3692,10 +4285,11 @@ as_info_buffer(uint8_t *req_buf, size_t req_buf_len, cf_dyn_buf *rsp)
 {
 	// Either we'e doing all, or doing some
 	if (req_buf_len == 0) {
-		info_all(NULL, rsp);
+		info_all(NULL, rsp, NULL);
 	}
 	else {
-		info_some((char *)req_buf, (char *)(req_buf + req_buf_len), NULL, rsp);
+		info_some((char *)req_buf, (char *)(req_buf + req_buf_len), NULL, rsp,
+				NULL);
 	}
 
 	return(0);
@@ -3707,52 +4301,87 @@ as_info_buffer(uint8_t *req_buf, size_t req_buf_len, cf_dyn_buf *rsp)
 // writes and such, don't want to clog up the main queue
 //
 
+// Send at most this many iovecs per call - stays well under IOV_MAX.
+#define INFO_SEND_MAX_IOV 64
+
+// Sends proto header, spilled chunks, then what's left in the dynbuf.
+static bool
+info_send_response(as_file_handle *fd_h, cf_dyn_buf *db, cf_chunk_buf *spill)
+{
+	uint64_t sz = spill->used_sz + db->used_sz;
+	uint8_t hdr[8] = { 2, 1, 0, 0,
+			(sz >> 24) & 0xff, (sz >> 16) & 0xff, (sz >> 8) & 0xff, sz & 0xff };
+
+	uint32_t n_iov = 1 + spill->n_chunks + 1;
+	struct iovec stack_iov[INFO_SEND_MAX_IOV];
+	struct iovec *iov = n_iov <= INFO_SEND_MAX_IOV ?
+			stack_iov : cf_malloc(sizeof(struct iovec) * n_iov);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(hdr);
+	cf_chunk_buf_get_iov(spill, iov + 1, spill->n_chunks);
+	iov[n_iov - 1].iov_base = db->buf;
+	iov[n_iov - 1].iov_len = db->used_sz;
+
+	bool ok = true;
+
+	for (uint32_t i = 0; i < n_iov; i += INFO_SEND_MAX_IOV) {
+		uint32_t n = n_iov - i < INFO_SEND_MAX_IOV ?
+				n_iov - i : INFO_SEND_MAX_IOV;
+
+		if (cf_socket_send_iov_all(&fd_h->sock, iov + i, n, MSG_NOSIGNAL,
+				CF_SOCKET_TIMEOUT) < 0) {
+			ok = false;
+			break;
+		}
+	}
+
+	if (iov != stack_iov) {
+		cf_free(iov);
+	}
+
+	return ok;
+}
+
 void *
-thr_info_fn(void *unused)
+thr_info_fn(void *udata)
 {
+	cf_queue *work_q = (cf_queue *)udata;
+
+	cf_thread_set_role(work_q == g_info_fast_work_q ? "info-fast" : "info");
+
 	for ( ; ; ) {
 
 		as_info_transaction it;
 
-		if (0 != cf_queue_pop(g_info_work_q, &it, CF_QUEUE_FOREVER)) {
+		if (0 != cf_queue_pop(work_q, &it, CF_QUEUE_FOREVER)) {
 			cf_crash(AS_TSVC, "unable to pop from info work queue");
 		}
 
 		as_file_handle *fd_h = it.fd_h;
 		as_proto *pr = it.proto;
 
-		// Allocate an output buffer sufficiently large to avoid ever resizing
+		// Most responses fit here - bigger ones spill into pooled chunks.
 		cf_dyn_buf_define_size(db, 128 * 1024);
-		// write space for the header
-		uint64_t	h = 0;
-		cf_dyn_buf_append_buf(&db, (uint8_t *) &h, sizeof(h));
+		cf_chunk_buf_define(spill);
 
 		// Either we'e doing all, or doing some
 		if (pr->sz == 0) {
-			info_all(fd_h, &db);
+			info_all(fd_h, &db, &spill);
 		}
 		else {
-			info_some((char *)pr->data, (char *)pr->data + pr->sz, fd_h, &db);
+			info_some((char *)pr->data, (char *)pr->data + pr->sz, fd_h, &db,
+					&spill);
 		}
 
-		// write the proto header in the space we pre-wrote
-		db.buf[0] = 2;
-		db.buf[1] = 1;
-		uint64_t	sz = db.used_sz - 8;
-		db.buf[4] = (sz >> 24) & 0xff;
-		db.buf[5] = (sz >> 16) & 0xff;
-		db.buf[6] = (sz >> 8) & 0xff;
-		db.buf[7] = sz & 0xff;
-
-		// write the data buffer
-		if (cf_socket_send_all(&fd_h->sock, db.buf, db.used_sz,
-				MSG_NOSIGNAL, CF_SOCKET_TIMEOUT) < 0) {
+		if (! info_send_response(fd_h, &db, &spill)) {
 			cf_info(AS_INFO, "thr_info: can't write all bytes, fd %d error %d",
 					CSFD(&fd_h->sock), errno);
 			as_end_of_transaction_force_close(fd_h);
 			fd_h = NULL;
 		}
 
+		cf_chunk_buf_free(&spill);
 		cf_dyn_buf_free(&db);
 
 		cf_free(pr);
@@ -3778,10 +4407,55 @@ thr_info_fn(void *unused)
 // Proto will be freed by the caller
 //
 
+static bool
+info_is_fast_request(const as_proto *pr)
+{
+	if (pr->sz == 0) {
+		return false; // info_all
+	}
+
+	const char *c = (const char *)pr->data;
+	const char *end = c + pr->sz;
+
+	while (c < end) {
+		const char *tok = c;
+
+		while (c < end && *c != EOL) {
+			c++;
+		}
+
+		if (c == end) {
+			return false; // unterminated - let the normal path deal with it
+		}
+
+		size_t len = (size_t)(c - tok);
+		bool found = false;
+
+		for (uint32_t i = 0; i < N_FAST_INFO_NAMES; i++) {
+			if (strlen(FAST_INFO_NAMES[i]) == len &&
+					memcmp(FAST_INFO_NAMES[i], tok, len) == 0) {
+				found = true;
+				break;
+			}
+		}
+
+		if (! found) {
+			return false;
+		}
+
+		c++;
+	}
+
+	return true;
+}
+
 void
 as_info(as_info_transaction *it)
 {
-	if (0 != cf_queue_push(g_info_work_q, it)) {
+	cf_queue *work_q = info_is_fast_request(it->proto) ?
+			g_info_fast_work_q : g_info_work_q;
+
+	if (0 != cf_queue_push(work_q, it)) {
 		cf_warning(AS_INFO, "failed info queue push");
 
 		// TODO - bother "handling" this?
@@ -3794,7 +4468,7 @@ as_info(as_info_transaction *it)
 int
 as_info_queue_get_size()
 {
-	return cf_queue_sz(g_info_work_q);
+	return cf_queue_sz(g_info_work_q) + cf_queue_sz(g_info_fast_work_q);
 }
 
 // Registers a dynamic name-value calculator.
@@ -5435,9 +6109,12 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 
 		info_append_uint64(db, "device_free_pct", free_pct);
 		info_append_int(db, "device_available_pct", available_pct);
+		info_append_uint64(db, "device_checksum_errors", cf_atomic64_get(ns->n_device_checksum_errors));
 
 		if (! ns->storage_data_in_memory) {
 			info_append_int(db, "cache_read_pct", (int)(ns->cache_read_pct + 0.5));
+			info_append_uint64(db, "read_cache_used_bytes", cf_atomic64_get(ns->read_cache_used_bytes));
+			info_append_uint64(db, "hot_tier_used_bytes", cf_atomic64_get(ns->hot_tier_used_bytes));
 		}
 	}
 
@@ -5461,6 +6138,7 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "migrate_records_transmitted", ns->migrate_records_transmitted);
 	info_append_uint64(db, "migrate_record_retransmits", ns->migrate_record_retransmits);
 	info_append_uint64(db, "migrate_record_receives", ns->migrate_record_receives);
+	info_append_uint32(db, "migrate_adaptive_sleep", cf_atomic32_get(ns->migrate_pace_sleep));
 
 	info_append_uint64(db, "migrate_signals_active", ns->migrate_signals_active);
 	info_append_uint64(db, "migrate_signals_remaining", ns->migrate_signals_remaining);
@@ -5469,19 +6147,23 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 
 	info_append_uint64(db, "client_tsvc_error", ns->n_client_tsvc_error);
 	info_append_uint64(db, "client_tsvc_timeout", ns->n_client_tsvc_timeout);
+	info_append_uint64(db, "quota_rejected", as_quota_n_rejected(&ns->quota)); // client & batch-sub, namespace quota only
 
 	info_append_uint64(db, "client_proxy_complete", ns->n_client_proxy_complete);
 	info_append_uint64(db, "client_proxy_error", ns->n_client_proxy_error);
 	info_append_uint64(db, "client_proxy_timeout", ns->n_client_proxy_timeout);
 
-	info_append_uint64(db, "client_read_success", ns->n_client_read_success);
-	info_append_uint64(db, "client_read_error", ns->n_client_read_error);
-	info_append_uint64(db, "client_read_timeout", ns->n_client_read_timeout);
-	info_append_uint64(db, "client_read_not_found", ns->n_client_read_not_found);
+	info_append_uint64(db, "client_read_success", cf_counter_get(&ns->n_client_read_success));
+	info_append_uint64(db, "client_read_error", cf_counter_get(&ns->n_client_read_error));
+	info_append_uint64(db, "client_read_timeout", cf_counter_get(&ns->n_client_read_timeout));
+	info_append_uint64(db, "client_read_not_found", cf_counter_get(&ns->n_client_read_not_found));
+	info_append_uint64(db, "client_read_prole", ns->n_client_read_prole);
+	info_append_uint64(db, "client_proxy_read_rack_local", ns->n_client_proxy_read_rack_local);
+	info_append_uint64(db, "client_proxy_read_off_rack", ns->n_client_proxy_read_off_rack);
 
-	info_append_uint64(db, "client_write_success", ns->n_client_write_success);
-	info_append_uint64(db, "client_write_error", ns->n_client_write_error);
-	info_append_uint64(db, "client_write_timeout", ns->n_client_write_timeout);
+	info_append_uint64(db, "client_write_success", cf_counter_get(&ns->n_client_write_success));
+	info_append_uint64(db, "client_write_error", cf_counter_get(&ns->n_client_write_error));
+	info_append_uint64(db, "client_write_timeout", cf_counter_get(&ns->n_client_write_timeout));
 
 	// Subset of n_client_write_... above, respectively.
 	info_append_uint64(db, "xdr_write_success", ns->n_xdr_write_success);
@@ -5515,6 +6197,20 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "batch_sub_read_error", ns->n_batch_sub_read_error);
 	info_append_uint64(db, "batch_sub_read_timeout", ns->n_batch_sub_read_timeout);
 	info_append_uint64(db, "batch_sub_read_not_found", ns->n_batch_sub_read_not_found);
+	info_append_uint64(db, "batch_sub_read_filtered_out", ns->n_batch_sub_read_filtered_out);
+
+	info_append_uint64(db, "batch_sub_write_success", ns->n_batch_sub_write_success);
+	info_append_uint64(db, "batch_sub_write_error", ns->n_batch_sub_write_error);
+	info_append_uint64(db, "batch_sub_write_timeout", ns->n_batch_sub_write_timeout);
+
+	info_append_uint64(db, "batch_sub_delete_success", ns->n_batch_sub_delete_success);
+	info_append_uint64(db, "batch_sub_delete_error", ns->n_batch_sub_delete_error);
+	info_append_uint64(db, "batch_sub_delete_timeout", ns->n_batch_sub_delete_timeout);
+	info_append_uint64(db, "batch_sub_delete_not_found", ns->n_batch_sub_delete_not_found);
+
+	info_append_uint64(db, "batch_sub_udf_complete", ns->n_batch_sub_udf_complete);
+	info_append_uint64(db, "batch_sub_udf_error", ns->n_batch_sub_udf_error);
+	info_append_uint64(db, "batch_sub_udf_timeout", ns->n_batch_sub_udf_timeout);
 
 	// Internal-UDF sub-transaction stats.
 
@@ -5564,6 +6260,14 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "scan_udf_bg_error", ns->n_scan_udf_bg_error);
 	info_append_uint64(db, "scan_udf_bg_abort", ns->n_scan_udf_bg_abort);
 
+	info_append_uint64(db, "scan_count_complete", ns->n_scan_count_complete);
+	info_append_uint64(db, "scan_count_error", ns->n_scan_count_error);
+	info_append_uint64(db, "scan_count_abort", ns->n_scan_count_abort);
+
+	info_append_uint64(db, "scan_delete_complete", ns->n_scan_delete_complete);
+	info_append_uint64(db, "scan_delete_error", ns->n_scan_delete_error);
+	info_append_uint64(db, "scan_delete_abort", ns->n_scan_delete_abort);
+
 	// Query stats.
 
 	uint64_t agg			= ns->n_aggregation;
@@ -5610,7 +6314,7 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	// Special errors that deserve their own counters:
 
 	info_append_uint64(db, "fail_xdr_forbidden", ns->n_fail_xdr_forbidden);
-	info_append_uint64(db, "fail_key_busy", ns->n_fail_key_busy);
+	info_append_uint64(db, "fail_key_busy", cf_counter_get(&ns->n_fail_key_busy));
 	info_append_uint64(db, "fail_generation", ns->n_fail_generation);
 	info_append_uint64(db, "fail_record_too_big", ns->n_fail_record_too_big);
 
@@ -6121,9 +6825,58 @@ as_info_parse_params_to_sindex_imd(char* params, as_sindex_metadata *imd, cf_dyn
 	}
 	imd->sktype = ktype;
 
+	cf_vector_destroy(str_v);
 
+	// Stringkeys = digest (default) or ordered - the latter keeps a prefix of
+	// each string, for exact matches and range lookups
+	char stringkeys_str[16];
+	int  stringkeys_len = sizeof(stringkeys_str);
+	ret = as_info_parameter_get(params, STR_STRINGKEYS, stringkeys_str,
+			&stringkeys_len);
+	if (ret == 0) {
+		if (strcasecmp(stringkeys_str, STR_STRINGKEYS_ORD) == 0) {
+			if (ktype != COL_TYPE_DIGEST) {
+				cf_warning(AS_INFO, "%s : Failed. Ordered keys need a string bin type.",
+						cmd);
+				INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
+						"Ordered keys need string bin type");
+				return AS_SINDEX_ERR_PARAM;
+			}
+			imd->str_ordered = true;
+		}
+		else if (strcasecmp(stringkeys_str, STR_STRINGKEYS_DG) != 0) {
+			ret = -2;
+		}
+	}
+	if (ret == -2) {
+		cf_warning(AS_INFO, "%s : Failed. Invalid stringkeys.", cmd);
+		INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
+				"Invalid stringkeys. Should be one of [digest, ordered]");
+		return AS_SINDEX_ERR_PARAM;
+	}
 
-	cf_vector_destroy(str_v);
+	// Covering = bin,bin,... copied into the index for lookup queries
+	char covering_str[AS_SINDEX_COVERING_STR_SIZE];
+	int  covering_len = sizeof(covering_str);
+	ret = as_info_parameter_get(params, STR_COVERING, covering_str,
+			&covering_len);
+	if (ret == -2) {
+		cf_warning(AS_INFO, "%s : Failed. Covering bins longer than allowed %d.",
+				cmd, AS_SINDEX_COVERING_STR_SIZE - 1);
+		INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
+				"Covering bins too long");
+		return AS_SINDEX_ERR_PARAM;
+	}
+	else if (ret == 0 && covering_len != 0) {
+		if (ns->storage_data_in_memory) {
+			cf_warning(AS_INFO, "%s : Failed. Covering bins not allowed on data-in-memory "
+					"namespace '%s'.", cmd, ns_str);
+			INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
+					"Covering bins on data-in-memory namespace");
+			return AS_SINDEX_ERR_PARAM;
+		}
+		imd->covering_str = cf_strdup(covering_str);
+	}
 
 	if (is_create) {
 		imd->ns_name = cf_strdup(ns->name);
@@ -6169,9 +6922,11 @@ int info_command_sindex_create(char *name, char *params, cf_dyn_buf *db)
 		cf_info(AS_INFO, "SINDEX CREATE : Request received for %s:%s via SMD", imd.ns_name, imd.iname);
 
 		char smd_key[SINDEX_SMD_KEY_SIZE];
+		char smd_value[SINDEX_SMD_VALUE_SIZE];
 
 		as_sindex_imd_to_smd_key(&imd, smd_key);
-		res = as_smd_set_metadata(SINDEX_MODULE, smd_key, imd.iname);
+		as_sindex_imd_to_smd_value(&imd, smd_value);
+		res = as_smd_set_metadata(SINDEX_MODULE, smd_key, smd_value);
 
 		if (res != 0) {
 			cf_warning(AS_INFO, "SINDEX CREATE : Queuing the index %s metadata to SMD failed with error %s",
@@ -6349,6 +7104,49 @@ int info_command_abort_all_scans(char *name, char *params, cf_dyn_buf *db) {
 	return 0;
 }
 
+// Format is: scan-verify:ns=<ns>[;set=<set>][;rps=<records-per-sec>]
+int info_command_verify_scan(char *name, char *params, cf_dyn_buf *db) {
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = sizeof(ns_name);
+	as_namespace *ns = NULL;
+
+	if (0 != as_info_parameter_get(params, "ns", ns_name, &ns_name_len) ||
+			! (ns = as_namespace_get_byname(ns_name))) {
+		cf_dyn_buf_append_string(db, "ERROR::bad-namespace");
+		return 0;
+	}
+
+	char set_name[AS_SET_NAME_MAX_SIZE];
+	int set_name_len = sizeof(set_name);
+	bool has_set = 0 == as_info_parameter_get(params, "set", set_name,
+			&set_name_len);
+
+	char rps_str[24];
+	int rps_str_len = sizeof(rps_str);
+	uint32_t rps = 0;
+
+	if (0 == as_info_parameter_get(params, "rps", rps_str, &rps_str_len) &&
+			0 != cf_str_atoi_u32(rps_str, &rps)) {
+		cf_dyn_buf_append_string(db, "ERROR::bad-rps");
+		return 0;
+	}
+
+	uint64_t trid = 0;
+	int rv = as_scan_verify(ns, has_set ? set_name : NULL, rps, &trid);
+
+	if (rv != 0) {
+		cf_dyn_buf_append_string(db, "ERROR:");
+		cf_dyn_buf_append_int(db, rv);
+		cf_dyn_buf_append_string(db, ":failed to start");
+	}
+	else {
+		cf_dyn_buf_append_string(db, "OK:");
+		cf_dyn_buf_append_uint64(db, trid);
+	}
+
+	return 0;
+}
+
 int info_command_query_kill(char *name, char *params, cf_dyn_buf *db) {
 	char context[100];
 	int  context_len = sizeof(context);
@@ -6517,6 +7315,7 @@ as_info_init()
 
 	// create worker threads
 	g_info_work_q = cf_queue_create(sizeof(as_info_transaction), true);
+	g_info_fast_work_q = cf_queue_create(sizeof(as_info_transaction), true);
 
 	char vstr[64];
 	sprintf(vstr, "%s build %s", aerospike_build_type, aerospike_build_id);
@@ -6540,7 +7339,7 @@ as_info_init()
 	as_info_set("name", istr, false);                    // Alias to 'node'.
 	// Returns list of features supported by this server
 	static char features[1024];
-	strcat(features, "peers;cdt-list;cdt-map;pipelining;geo;float;batch-index;replicas-all;replicas-master;replicas-prole;udf");
+	strcat(features, "peers;cdt-list;cdt-map;pipelining;geo;float;batch-index;replicas-all;replicas-delta;replicas-master;replicas-prole;udf");
 	strcat(features, aerospike_build_features);
 	as_info_set("features", features, true);
 	as_hb_mode hb_mode;
@@ -6614,6 +7413,9 @@ as_info_init()
 	as_info_set_tree("statistics", info_get_tree_statistics);
 
 	// Define commands
+	as_info_set_command("capture-start", info_command_capture_start, PERM_SET_CONFIG);        // Start capturing sampled client requests to a trace file.
+	as_info_set_command("capture-stop", info_command_capture_stop, PERM_SET_CONFIG);          // Stop capturing client requests.
+	as_info_set_command("cdc", info_command_cdc, PERM_NONE);                                  // Returns change entries for a partition from a given sequence number.
 	as_info_set_command("config-get", info_command_config_get, PERM_NONE);                    // Returns running config for specified context.
 	as_info_set_command("config-set", info_command_config_set, PERM_SET_CONFIG);              // Set a configuration parameter at run time, configuration parameter must be dynamic.
 	as_info_set_command("dump-cluster", info_command_dump_cluster, PERM_LOGGING_CTRL);        // Print debug information about clustering and exchange to the log file.
@@ -6632,6 +7434,9 @@ as_info_init()
 	as_info_set_command("hist-dump", info_command_hist_dump, PERM_NONE);                      // Returns a histogram snapshot for a particular histogram.
 	as_info_set_command("hist-track-start", info_command_hist_track, PERM_SERVICE_CTRL);      // Start or Restart histogram tracking.
 	as_info_set_command("hist-track-stop", info_command_hist_track, PERM_SERVICE_CTRL);       // Stop histogram tracking.
+	as_info_set_command("hot-keys", info_command_hot_keys, PERM_NONE);                        // Returns the most active keys and sets in a namespace.
+	as_info_set_command("index-compact", info_command_index_compact, PERM_SERVICE_CTRL);      // Release sparse index arena stages in the background.
+	as_info_set_command("jem-arenas", info_command_jem_arenas, PERM_NONE);                    // Returns JEMalloc usage per subsystem and namespace arena.
 	as_info_set_command("jem-stats", info_command_jem_stats, PERM_LOGGING_CTRL);              // Print JEMalloc statistics to the log file.
 	as_info_set_command("latency", info_command_hist_track, PERM_NONE);                       // Returns latency and throughput information.
 	as_info_set_command("log-message", info_command_log_message, PERM_NONE);                  // Log a message.
@@ -6642,9 +7447,11 @@ as_info_init()
 	as_info_set_command("peers-tls-std", info_get_services_tls_std_delta, PERM_NONE);         // The delta update version of "peers-tls-std".
 	as_info_set_command("racks", info_command_racks, PERM_NONE);                              // Rack-aware information.
 	as_info_set_command("recluster", info_command_recluster, PERM_NONE);                      // Force cluster to re-form. FIXME - what permission?
+	as_info_set_command("replicas-delta", info_command_replicas_delta, PERM_NONE);            // Client replica map changes since a given sequence number.
 	as_info_set_command("set-config", info_command_config_set, PERM_SET_CONFIG);              // Set config values.
 	as_info_set_command("set-log", info_command_log_set, PERM_LOGGING_CTRL);                  // Set values in the log system.
 	as_info_set_command("show-devices", info_command_show_devices, PERM_LOGGING_CTRL);        // Print snapshot of wblocks to the log file.
+	as_info_set_command("thread-cpu", info_command_thread_cpu, PERM_NONE);                    // Returns CPU time per thread role.
 	as_info_set_command("throughput", info_command_hist_track, PERM_NONE);                    // Returns throughput info.
 	as_info_set_command("tip", info_command_tip, PERM_SERVICE_CTRL);                          // Add external IP to mesh-mode heartbeats.
 	as_info_set_command("tip-clear", info_command_tip_clear, PERM_SERVICE_CTRL);              // Clear tip list from mesh-mode heartbeats.
@@ -6675,6 +7482,7 @@ as_info_init()
 	as_info_set_command("query-kill", info_command_query_kill, PERM_QUERY_MANAGE);
 	as_info_set_command("scan-abort", info_command_abort_scan, PERM_SCAN_MANAGE);            // Abort a scan with a given id.
 	as_info_set_command("scan-abort-all", info_command_abort_all_scans, PERM_SCAN_MANAGE);   // Abort all scans.
+	as_info_set_command("scan-verify", info_command_verify_scan, PERM_SCAN_MANAGE);          // Start a throttled storage verify scan.
 	as_info_set_dynamic("scan-list", as_scan_list, false);                                   // List info for all scan jobs.
 	as_info_set_command("sindex-stat", info_command_sindex_stat, PERM_NONE);
 	as_info_set_command("sindex-list", info_command_sindex_list, PERM_NONE);
@@ -6690,11 +7498,17 @@ as_info_init()
 
 	for (int i = 0; i < g_config.n_info_threads; i++) {
 		pthread_t tid;
-		if (0 != pthread_create(&tid, &thr_attr, thr_info_fn, (void *) 0 )) {
+		if (0 != pthread_create(&tid, &thr_attr, thr_info_fn, (void *)g_info_work_q)) {
 			cf_crash(AS_INFO, "pthread_create: %s", cf_strerror(errno));
 		}
 	}
 
+	// One thread is plenty for the cheap requests - they never block.
+	pthread_t fast_tid;
+	if (0 != pthread_create(&fast_tid, &thr_attr, thr_info_fn, (void *)g_info_fast_work_q)) {
+		cf_crash(AS_INFO, "pthread_create: %s", cf_strerror(errno));
+	}
+
 	as_fabric_register_msg_fn(M_TYPE_INFO, info_mt, sizeof(info_mt), INFO_MSG_SCRATCH_SIZE, info_msg_fn, 0 /* udata */ );
 
 	as_exchange_register_listener(info_clustering_event_listener, NULL);
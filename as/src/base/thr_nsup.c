@@ -47,6 +47,7 @@
 #include "linear_hist.h"
 #include "vmapx.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
@@ -85,65 +86,55 @@ static bool eval_hwm_breached(as_namespace *ns);
 
 
 //------------------------------------------------
-// Reduce callback prepares for cold-start eviction.
-// - builds cold-start eviction histogram
+// Track void-times of records as they're loaded, so
+// the eviction histogram needs no index pass.
+// Callers don't track records in sets with eviction
+// disabled. A void-time of 0 means 'none'.
 //
-typedef struct cold_start_evict_prep_info_s {
-	as_namespace*		ns;
-	linear_hist*		hist;
-	bool*				sets_not_evicting;
-} cold_start_evict_prep_info;
-
-static void
-cold_start_evict_prep_reduce_cb(as_index_ref* r_ref, void* udata)
+void
+as_cold_start_evict_init(as_namespace* ns)
 {
-	as_index* r = r_ref->r;
-	cold_start_evict_prep_info* p_info = (cold_start_evict_prep_info*)udata;
-	uint32_t set_id = as_index_get_set_id(r);
-	uint32_t void_time = r->void_time;
-
-	if (void_time != 0 &&
-			! p_info->sets_not_evicting[set_id]) {
-		linear_hist_insert_data_point(p_info->hist, void_time);
+	if (! g_config.nsup_startup_evict) {
+		return;
 	}
 
-	as_record_done(r_ref, p_info->ns);
-}
+	uint32_t now = as_record_void_time_get();
+	uint32_t ttl_range = ns->cold_start_max_void_time > now ?
+			ns->cold_start_max_void_time - now : 0;
+	uint32_t n_buckets = MAX(ns->evict_hist_buckets, COLD_START_HIST_MIN_BUCKETS);
 
-//------------------------------------------------
-// Threads prepare for cold-start eviction.
-//
-typedef struct evict_prep_thread_info_s {
-	as_namespace*		ns;
-	cf_atomic32*		p_pid;
-	uint32_t			i_cpu;
-	linear_hist*		hist;
-	bool*				sets_not_evicting;
-} evict_prep_thread_info;
+	ns->cold_start_evict_hist = linear_hist_create("cold-start-hist", now,
+			ttl_range, n_buckets);
+}
 
-void*
-run_cold_start_evict_prep(void* udata)
+void
+as_cold_start_evict_track(as_namespace* ns, uint32_t old_void_time,
+		uint32_t new_void_time)
 {
-	evict_prep_thread_info* p_info = (evict_prep_thread_info*)udata;
-
-	cf_topo_pin_to_cpu((cf_topo_cpu_index)p_info->i_cpu);
+	if (! ns->cold_start_evict_hist || old_void_time == new_void_time) {
+		return;
+	}
 
-	as_namespace *ns = p_info->ns;
+	pthread_mutex_lock(&ns->cold_start_evict_lock);
 
-	cold_start_evict_prep_info cb_info;
+	if (old_void_time != 0) {
+		linear_hist_remove_data_point(ns->cold_start_evict_hist, old_void_time);
+	}
 
-	cb_info.ns = ns;
-	cb_info.hist = p_info->hist;
-	cb_info.sets_not_evicting = p_info->sets_not_evicting;
+	if (new_void_time != 0) {
+		linear_hist_insert_data_point(ns->cold_start_evict_hist, new_void_time);
+	}
 
-	int pid;
+	pthread_mutex_unlock(&ns->cold_start_evict_lock);
+}
 
-	while ((pid = (int)cf_atomic32_incr(p_info->p_pid)) < AS_PARTITIONS) {
-		// Don't bother with partition reservations - it's startup.
-		as_index_reduce_live(ns->partitions[pid].vp, cold_start_evict_prep_reduce_cb, &cb_info);
+void
+as_cold_start_evict_destroy(as_namespace* ns)
+{
+	if (ns->cold_start_evict_hist) {
+		linear_hist_destroy(ns->cold_start_evict_hist);
+		ns->cold_start_evict_hist = NULL;
 	}
-
-	return NULL;
 }
 
 //------------------------------------------------
@@ -226,34 +217,6 @@ run_cold_start_evict(void* udata)
 	return NULL;
 }
 
-//------------------------------------------------
-// Get the cold-start histogram's TTL range.
-//
-// TODO - ttl_range to 32 bits?
-static uint64_t
-get_cold_start_ttl_range(as_namespace* ns, uint32_t now)
-{
-	uint64_t max_void_time = 0;
-
-	for (int n = 0; n < AS_PARTITIONS; n++) {
-		uint64_t partition_max_void_time = cf_atomic64_get(ns->partitions[n].max_void_time);
-
-		if (partition_max_void_time > max_void_time) {
-			max_void_time = partition_max_void_time;
-		}
-	}
-
-	// Use max-ttl to cap the namespace maximum void-time.
-	uint64_t cap = now + ns->max_ttl;
-
-	if (max_void_time > cap) {
-		max_void_time = cap;
-	}
-
-	// Convert to TTL - used for cold-start histogram range.
-	return max_void_time > now ? max_void_time - now : 0;
-}
-
 //------------------------------------------------
 // Set cold-start eviction threshold.
 //
@@ -331,12 +294,6 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 		return true;
 	}
 
-	// We may evict - set up the cold-start eviction histogram.
-	cf_info(AS_NSUP, "{%s} cold-start building eviction histogram ...", ns->name);
-
-	uint32_t ttl_range = (uint32_t)get_cold_start_ttl_range(ns, now);
-	uint32_t n_buckets = MAX(ns->evict_hist_buckets, COLD_START_HIST_MIN_BUCKETS);
-
 	uint32_t num_sets = cf_vmapx_count(ns->p_sets_vmap);
 	bool sets_not_evicting[AS_SET_MAX_COUNT + 1];
 
@@ -355,42 +312,12 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 		}
 	}
 
-	// Split these tasks across multiple threads.
+	// Split eviction across multiple threads.
 	uint32_t n_cpus = cf_topo_count_cpus();
 	pthread_t evict_threads[n_cpus];
 
-	// Reduce all partitions to build the eviction histogram.
-	evict_prep_thread_info prep_thread_infos[n_cpus];
-	cf_atomic32 pid = -1;
-
-	for (uint32_t n = 0; n < n_cpus; n++) {
-		prep_thread_infos[n].ns = ns;
-		prep_thread_infos[n].p_pid = &pid;
-		prep_thread_infos[n].i_cpu = n;
-		prep_thread_infos[n].hist = linear_hist_create("thread-hist", now, ttl_range, n_buckets);
-		prep_thread_infos[n].sets_not_evicting = sets_not_evicting;
-
-		if (pthread_create(&evict_threads[n], NULL, run_cold_start_evict_prep, (void*)&prep_thread_infos[n]) != 0) {
-			cf_crash(AS_NSUP, "{%s} failed to create evict-prep thread %u", ns->name, n);
-		}
-	}
-
-	for (uint32_t n = 0; n < n_cpus; n++) {
-		pthread_join(evict_threads[n], NULL);
-
-		if (n == 0) {
-			continue;
-		}
-
-		linear_hist_merge(prep_thread_infos[0].hist, prep_thread_infos[n].hist);
-		linear_hist_destroy(prep_thread_infos[n].hist);
-	}
-	// Now we're single-threaded again.
-
-	// Calculate the eviction threshold.
-	uint64_t n_evictable = set_cold_start_threshold(ns, prep_thread_infos[0].hist);
-
-	linear_hist_destroy(prep_thread_infos[0].hist);
+	// Calculate the eviction threshold from void-times tracked while loading.
+	uint64_t n_evictable = set_cold_start_threshold(ns, ns->cold_start_evict_hist);
 
 	if (n_evictable == 0) {
 		cf_warning(AS_NSUP, "{%s} hwm breached but no records to evict", ns->name);
@@ -423,6 +350,9 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 
 	cf_info(AS_NSUP, "{%s} cold-start evicted %u records, found %u 0-void-time records", ns->name, thread_info.total_evicted, thread_info.total_0_void_time);
 
+	// Everything tracked below the threshold was just evicted.
+	linear_hist_clear_below(ns->cold_start_evict_hist, cf_atomic32_get(ns->cold_start_threshold_void_time));
+
 	pthread_mutex_unlock(&ns->cold_start_evict_lock);
 	return true;
 }
@@ -622,17 +552,54 @@ queue_for_delete(as_namespace* ns, cf_digest* p_digest)
 	}
 }
 
+//------------------------------------------------
+// Queue a record for deletion on behalf of others
+// - e.g. delete scans, in partitions that need
+// duplicate resolution.
+//
+void
+as_nsup_queue_delete(as_namespace* ns, cf_digest* p_digest)
+{
+	queue_for_delete(ns, p_digest);
+}
+
+//------------------------------------------------
+// Histograms built by an nsup lap. With multiple
+// nsup threads, all but the calling thread build
+// private copies, merged when the reduce is done.
+//
+typedef struct nsup_hists_s {
+	linear_hist*	obj_size_hist;
+	linear_hist*	ttl_hist;
+	linear_hist*	evict_hist;
+	linear_hist*	set_obj_size_hists[AS_SET_MAX_COUNT + 1];
+	linear_hist*	set_ttl_hists[AS_SET_MAX_COUNT + 1];
+} nsup_hists;
+
+//------------------------------------------------
+// Reduce callback state, one per nsup thread. The
+// info is shared, and read-only during a reduce.
+//
+typedef struct nsup_reduce_state_s {
+	void*			info;
+	nsup_hists*		hists;
+	uint64_t		num_deleted;
+	uint64_t		num_0_void_time;
+	uint64_t		num_evictable; // evict-lru only
+	uint64_t		num_not_accessed; // evict-lru only
+} nsup_reduce_state;
+
 //------------------------------------------------
 // Insert data into object size histograms.
 //
 static void
-add_to_obj_size_histograms(as_namespace* ns, as_index* r)
+add_to_obj_size_histograms(nsup_hists* hists, as_index* r)
 {
 	uint32_t set_id = as_index_get_set_id(r);
-	linear_hist* set_obj_size_hist = ns->set_obj_size_hists[set_id];
+	linear_hist* set_obj_size_hist = hists->set_obj_size_hists[set_id];
 	uint64_t n_rblocks = r->n_rblocks;
 
-	linear_hist_insert_data_point(ns->obj_size_hist, n_rblocks);
+	linear_hist_insert_data_point(hists->obj_size_hist, n_rblocks);
 
 	if (set_obj_size_hist) {
 		linear_hist_insert_data_point(set_obj_size_hist, n_rblocks);
@@ -643,13 +610,13 @@ add_to_obj_size_histograms(as_namespace* ns, as_index* r)
 // Insert data into TTL histograms.
 //
 static void
-add_to_ttl_histograms(as_namespace* ns, as_index* r)
+add_to_ttl_histograms(nsup_hists* hists, as_index* r)
 {
 	uint32_t set_id = as_index_get_set_id(r);
-	linear_hist* set_ttl_hist = ns->set_ttl_hists[set_id];
+	linear_hist* set_ttl_hist = hists->set_ttl_hists[set_id];
 	uint32_t void_time = r->void_time;
 
-	linear_hist_insert_data_point(ns->ttl_hist, void_time);
+	linear_hist_insert_data_point(hists->ttl_hist, void_time);
 
 	if (set_ttl_hist) {
 		linear_hist_insert_data_point(set_ttl_hist, void_time);
@@ -664,32 +631,41 @@ add_to_ttl_histograms(as_namespace* ns, as_index* r)
 typedef struct evict_prep_info_s {
 	as_namespace*	ns;
 	bool*			sets_not_evicting;
-	uint64_t		num_0_void_time;
+	bool			lru;
 } evict_prep_info;
 
 static void
 evict_prep_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	evict_prep_info* p_info = (evict_prep_info*)udata;
-	as_namespace* ns = p_info->ns;
+	nsup_reduce_state* p_state = (nsup_reduce_state*)udata;
+	evict_prep_info* p_info = (evict_prep_info*)p_state->info;
+	nsup_hists* hists = p_state->hists;
 	uint32_t set_id = as_index_get_set_id(r);
 	uint32_t void_time = r->void_time;
 
-	add_to_obj_size_histograms(ns, r);
+	add_to_obj_size_histograms(hists, r);
+
+	if (p_info->lru && ! p_info->sets_not_evicting[set_id]) {
+		p_state->num_evictable++;
+
+		if (r->accessed == 0) {
+			p_state->num_not_accessed++;
+		}
+	}
 
 	if (void_time != 0) {
 		if (! p_info->sets_not_evicting[set_id]) {
-			linear_hist_insert_data_point(ns->evict_hist, void_time);
+			linear_hist_insert_data_point(hists->evict_hist, void_time);
 		}
 
-		add_to_ttl_histograms(ns, r);
+		add_to_ttl_histograms(hists, r);
 	}
 	else {
-		p_info->num_0_void_time++;
+		p_state->num_0_void_time++;
 	}
 
-	as_record_done(r_ref, ns);
+	as_record_done(r_ref, p_info->ns);
 }
 
 //------------------------------------------------
@@ -702,14 +678,15 @@ typedef struct evict_info_s {
 	uint32_t		now;
 	bool*			sets_not_evicting;
 	uint32_t		evict_void_time;
-	uint64_t		num_evicted;
+	uint32_t		lru_threshold;
 } evict_info;
 
 static void
 evict_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	evict_info* p_info = (evict_info*)udata;
+	nsup_reduce_state* p_state = (nsup_reduce_state*)udata;
+	evict_info* p_info = (evict_info*)p_state->info;
 	as_namespace* ns = p_info->ns;
 	uint32_t set_id = as_index_get_set_id(r);
 	uint32_t void_time = r->void_time;
@@ -718,12 +695,47 @@ evict_reduce_cb(as_index_ref* r_ref, void* udata)
 		if (p_info->sets_not_evicting[set_id]) {
 			if (p_info->now > void_time) {
 				queue_for_delete(ns, &r->keyd);
-				p_info->num_evicted++;
+				p_state->num_deleted++;
 			}
 		}
 		else if (void_time < p_info->evict_void_time) {
 			queue_for_delete(ns, &r->keyd);
-			p_info->num_evicted++;
+			p_state->num_deleted++;
+		}
+	}
+
+	as_record_done(r_ref, ns);
+}
+
+//------------------------------------------------
+// Reduce callback evicts records, for evict-lru.
+// - "CLOCK" - records accessed since the last lap
+//   get a second chance, i.e. their bit is reset
+// - of the rest, evicts the digest-selected share
+//   needed to meet evict-tenths-pct
+// - does expiration
+//
+static void
+evict_lru_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	as_index* r = r_ref->r;
+	nsup_reduce_state* p_state = (nsup_reduce_state*)udata;
+	evict_info* p_info = (evict_info*)p_state->info;
+	as_namespace* ns = p_info->ns;
+	uint32_t void_time = r->void_time;
+
+	if (void_time != 0 && p_info->now > void_time) {
+		queue_for_delete(ns, &r->keyd);
+		p_state->num_deleted++;
+	}
+	else if (! p_info->sets_not_evicting[as_index_get_set_id(r)]) {
+		if (r->accessed == 1) {
+			r->accessed = 0;
+		}
+		// Digest bits are random - use bits the partition ID doesn't.
+		else if (*(uint32_t*)&r->keyd.digest[8] < p_info->lru_threshold) {
+			queue_for_delete(ns, &r->keyd);
+			p_state->num_deleted++;
 		}
 	}
 
@@ -739,63 +751,215 @@ evict_reduce_cb(as_index_ref* r_ref, void* udata)
 typedef struct expire_info_s {
 	as_namespace*	ns;
 	uint32_t		now;
-	uint64_t		num_expired;
-	uint64_t		num_0_void_time;
 } expire_info;
 
 static void
 expire_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	expire_info* p_info = (expire_info*)udata;
+	nsup_reduce_state* p_state = (nsup_reduce_state*)udata;
+	expire_info* p_info = (expire_info*)p_state->info;
 	as_namespace* ns = p_info->ns;
 	uint32_t void_time = r->void_time;
 
 	if (void_time != 0) {
 		if (p_info->now > void_time) {
 			queue_for_delete(ns, &r->keyd);
-			p_info->num_expired++;
+			p_state->num_deleted++;
 		}
 		else {
-			add_to_obj_size_histograms(ns, r);
-			add_to_ttl_histograms(ns, r);
+			add_to_obj_size_histograms(p_state->hists, r);
+			add_to_ttl_histograms(p_state->hists, r);
 		}
 	}
 	else {
-		add_to_obj_size_histograms(ns, r);
-		p_info->num_0_void_time++;
+		add_to_obj_size_histograms(p_state->hists, r);
+		p_state->num_0_void_time++;
 	}
 
 	as_record_done(r_ref, ns);
 }
 
 //------------------------------------------------
-// Reduce all master partitions, using specified
-// functionality. Throttle to make sure deletions
-// generated by reducing each partition don't blow
-// up the delete queue.
+// Point nsup histograms at the namespace's own.
+//
+static void
+init_ns_hists(as_namespace* ns, nsup_hists* hists)
+{
+	hists->obj_size_hist = ns->obj_size_hist;
+	hists->ttl_hist = ns->ttl_hist;
+	hists->evict_hist = ns->evict_hist;
+
+	memcpy(hists->set_obj_size_hists, ns->set_obj_size_hists, sizeof(hists->set_obj_size_hists));
+	memcpy(hists->set_ttl_hists, ns->set_ttl_hists, sizeof(hists->set_ttl_hists));
+}
+
+//------------------------------------------------
+// Create an nsup thread's private histograms.
+//
+static linear_hist*
+create_similar_hist(const linear_hist* h)
+{
+	return h ? linear_hist_create_similar("nsup-thread-hist", h) : NULL;
+}
+
+static nsup_hists*
+create_thread_hists(const nsup_hists* hists)
+{
+	nsup_hists* thread_hists = cf_malloc(sizeof(nsup_hists));
+
+	cf_assert(thread_hists, AS_NSUP, "malloc failed: %s", cf_strerror(errno));
+
+	thread_hists->obj_size_hist = create_similar_hist(hists->obj_size_hist);
+	thread_hists->ttl_hist = create_similar_hist(hists->ttl_hist);
+	thread_hists->evict_hist = create_similar_hist(hists->evict_hist);
+
+	for (uint32_t set_id = 0; set_id <= AS_SET_MAX_COUNT; set_id++) {
+		thread_hists->set_obj_size_hists[set_id] = create_similar_hist(hists->set_obj_size_hists[set_id]);
+		thread_hists->set_ttl_hists[set_id] = create_similar_hist(hists->set_ttl_hists[set_id]);
+	}
+
+	return thread_hists;
+}
+
+//------------------------------------------------
+// Merge an nsup thread's private histograms, and
+// destroy them.
 //
 static void
-reduce_master_partitions(as_namespace* ns, as_index_reduce_fn cb, void* udata, uint32_t* p_n_waits, const char* tag)
+merge_similar_hist(linear_hist* h, linear_hist* thread_h)
+{
+	if (thread_h) {
+		linear_hist_merge(h, thread_h);
+		linear_hist_destroy(thread_h);
+	}
+}
+
+static void
+merge_thread_hists(nsup_hists* hists, nsup_hists* thread_hists)
+{
+	merge_similar_hist(hists->obj_size_hist, thread_hists->obj_size_hist);
+	merge_similar_hist(hists->ttl_hist, thread_hists->ttl_hist);
+	merge_similar_hist(hists->evict_hist, thread_hists->evict_hist);
+
+	for (uint32_t set_id = 0; set_id <= AS_SET_MAX_COUNT; set_id++) {
+		merge_similar_hist(hists->set_obj_size_hists[set_id], thread_hists->set_obj_size_hists[set_id]);
+		merge_similar_hist(hists->set_ttl_hists[set_id], thread_hists->set_ttl_hists[set_id]);
+	}
+
+	cf_free(thread_hists);
+}
+
+//------------------------------------------------
+// Threads reduce master partitions, each pulling
+// the next partition to reduce. Throttle to make
+// sure deletions generated by reducing each
+// partition don't blow up the delete queue.
+//
+typedef struct nsup_reduce_job_s {
+	as_namespace*		ns;
+	as_index_reduce_fn	cb;
+	const char*			tag;
+	cf_atomic32			pid;
+} nsup_reduce_job;
+
+typedef struct nsup_thread_info_s {
+	nsup_reduce_job*	job;
+	nsup_reduce_state	state;
+	uint32_t			n_waits;
+} nsup_thread_info;
+
+static void*
+run_nsup_reduce(void* udata)
 {
+	nsup_thread_info* p_thread = (nsup_thread_info*)udata;
+	nsup_reduce_job* job = p_thread->job;
+	as_namespace* ns = job->ns;
 	as_partition_reservation rsv;
+	int pid;
 
-	for (int n = 0; n < AS_PARTITIONS; n++) {
-		if (as_partition_reserve_write(ns, n, &rsv, NULL) != 0) {
+	cf_thread_set_role("nsup");
+
+	while ((pid = (int)cf_atomic32_incr(&job->pid)) < AS_PARTITIONS) {
+		if (as_partition_reserve_write(ns, pid, &rsv, NULL) != 0) {
 			continue;
 		}
 
-		as_index_reduce_live(rsv.tree, cb, udata);
+		as_index_reduce_live(rsv.tree, job->cb, &p_thread->state);
 
 		as_partition_release(&rsv);
 
 		while (cf_queue_sz(g_p_nsup_delete_q) > DELETE_Q_SAFETY_THRESHOLD) {
 			usleep(DELETE_Q_SAFETY_SLEEP_us);
-			(*p_n_waits)++;
+			p_thread->n_waits++;
+		}
+
+		cf_debug(AS_NSUP, "{%s} %s done partition index %d, waits %u", ns->name, job->tag, pid, p_thread->n_waits);
+	}
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Reduce all master partitions, using specified
+// functionality, split across nsup-threads
+// threads. Results are accumulated in p_state.
+//
+static void
+reduce_master_partitions(as_namespace* ns, as_index_reduce_fn cb, nsup_reduce_state* p_state, uint32_t* p_n_waits, const char* tag)
+{
+	uint32_t n_threads = g_config.n_nsup_threads;
+	nsup_reduce_job job = { .ns = ns, .cb = cb, .tag = tag, .pid = -1 };
+	nsup_thread_info thread_infos[n_threads];
+	pthread_t threads[n_threads];
+
+	ASD_NSUP_REDUCE_STARTING(g_config.self_node, (uint64_t)ns);
+
+	// The calling thread is thread 0, and works directly on p_state.
+	for (uint32_t n = 0; n < n_threads; n++) {
+		thread_infos[n].job = &job;
+		thread_infos[n].state.info = p_state->info;
+		thread_infos[n].state.hists = p_state->hists;
+		thread_infos[n].state.num_deleted = 0;
+		thread_infos[n].state.num_0_void_time = 0;
+		thread_infos[n].state.num_evictable = 0;
+		thread_infos[n].state.num_not_accessed = 0;
+		thread_infos[n].n_waits = 0;
+
+		if (n == 0) {
+			continue;
+		}
+
+		if (p_state->hists) {
+			thread_infos[n].state.hists = create_thread_hists(p_state->hists);
 		}
 
-		cf_debug(AS_NSUP, "{%s} %s done partition index %d, waits %u", ns->name, tag, n, *p_n_waits);
+		if (pthread_create(&threads[n], NULL, run_nsup_reduce, (void*)&thread_infos[n]) != 0) {
+			cf_crash(AS_NSUP, "{%s} failed to create nsup thread %u", ns->name, n);
+		}
 	}
+
+	run_nsup_reduce((void*)&thread_infos[0]);
+
+	for (uint32_t n = 0; n < n_threads; n++) {
+		if (n != 0) {
+			pthread_join(threads[n], NULL);
+
+			if (p_state->hists) {
+				merge_thread_hists(p_state->hists, thread_infos[n].state.hists);
+			}
+		}
+
+		p_state->num_deleted += thread_infos[n].state.num_deleted;
+		p_state->num_0_void_time += thread_infos[n].state.num_0_void_time;
+		p_state->num_evictable += thread_infos[n].state.num_evictable;
+		p_state->num_not_accessed += thread_infos[n].state.num_not_accessed;
+		*p_n_waits += thread_infos[n].n_waits;
+	}
+	// Now we're single-threaded again.
+
+	ASD_NSUP_REDUCE_FINISHED(g_config.self_node, (uint64_t)ns,
+			p_state->num_deleted);
 }
 
 //------------------------------------------------
@@ -901,6 +1065,33 @@ get_threshold(as_namespace* ns, uint32_t* p_evict_void_time)
 	return true;
 }
 
+//------------------------------------------------
+// Get evict-lru threshold - the share of records
+// not accessed since the last lap to evict, as a
+// fraction of 2^32.
+//
+static bool
+get_lru_threshold(as_namespace* ns, uint64_t n_evictable, uint64_t n_not_accessed, uint32_t* p_lru_threshold)
+{
+	uint64_t target = (n_evictable * ns->evict_tenths_pct) / 1000;
+
+	if (target == 0 || n_not_accessed == 0) {
+		cf_warning(AS_NSUP, "{%s} no records eligible for lru eviction - %lu not accessed of %lu", ns->name, n_not_accessed, n_evictable);
+		return false;
+	}
+
+	if (target >= n_not_accessed) {
+		*p_lru_threshold = 0xFFFFffff;
+	}
+	else {
+		*p_lru_threshold = (uint32_t)(((double)target / (double)n_not_accessed) * (double)0xFFFFffff);
+	}
+
+	cf_info(AS_NSUP, "{%s} lru eviction of ~%lu of %lu records not accessed since last eviction", ns->name, MIN(target, n_not_accessed), n_not_accessed);
+
+	return true;
+}
+
 //------------------------------------------------
 // Stats per namespace at the end of an nsup lap.
 //
@@ -942,6 +1133,8 @@ update_stats(as_namespace* ns, uint64_t n_master, uint64_t n_0_void_time,
 void *
 run_nsup(void *arg)
 {
+	cf_thread_set_role("nsup");
+
 	// Garbage-collect long-expired proles, one partition per loop.
 	int prole_pids[g_config.n_namespaces];
 
@@ -1017,6 +1210,10 @@ run_nsup(void *arg)
 			uint32_t evict_ttl = 0;
 			uint32_t n_general_waits = 0;
 
+			nsup_hists hists;
+
+			init_ns_hists(ns, &hists);
+
 			// Check whether or not we need to do general eviction.
 
 			if (eval_hwm_breached(ns)) {
@@ -1038,12 +1235,15 @@ run_nsup(void *arg)
 				memset(&cb_info1, 0, sizeof(cb_info1));
 				cb_info1.ns = ns;
 				cb_info1.sets_not_evicting = sets_not_evicting;
+				cb_info1.lru = ns->evict_lru;
+
+				nsup_reduce_state state1 = { .info = &cb_info1, .hists = &hists };
 
 				// Reduce master partitions, building histograms to calculate
 				// general eviction threshold.
-				reduce_master_partitions(ns, evict_prep_reduce_cb, &cb_info1, &n_general_waits, "evict-prep");
+				reduce_master_partitions(ns, evict_prep_reduce_cb, &state1, &n_general_waits, "evict-prep");
 
-				n_0_void_time_records = cb_info1.num_0_void_time;
+				n_0_void_time_records = state1.num_0_void_time;
 
 				evict_info cb_info2;
 
@@ -1052,18 +1252,38 @@ run_nsup(void *arg)
 				cb_info2.now = now;
 				cb_info2.sets_not_evicting = sets_not_evicting;
 
+				// No histograms are built while evicting.
+				nsup_reduce_state state2 = { .info = &cb_info2, .hists = NULL };
+
+				if (cb_info1.lru) {
+					// Reduce master partitions, deleting the least recently
+					// accessed records, and expired records.
+					if (get_lru_threshold(ns, state1.num_evictable, state1.num_not_accessed, &cb_info2.lru_threshold)) {
+						reduce_master_partitions(ns, evict_lru_reduce_cb, &state2, &n_general_waits, "evict-lru");
+
+						n_evicted_records = state2.num_deleted;
+					}
+					else {
+						cb_info2.evict_void_time = now;
+
+						// Reduce master partitions, deleting expired records.
+						reduce_master_partitions(ns, evict_reduce_cb, &state2, &n_general_waits, "expire-lru");
+
+						n_expired_records = state2.num_deleted;
+					}
+				}
 				// Determine general eviction threshold.
-				if (get_threshold(ns, &cb_info2.evict_void_time)) {
+				else if (get_threshold(ns, &cb_info2.evict_void_time)) {
 					// Save the eviction depth in the device header(s) so it can
 					// be used to speed up cold start, etc.
 					as_storage_save_evict_void_time(ns, cb_info2.evict_void_time);
 
 					// Reduce master partitions, deleting records up to
 					// threshold. (This automatically deletes expired records.)
-					reduce_master_partitions(ns, evict_reduce_cb, &cb_info2, &n_general_waits, "evict");
+					reduce_master_partitions(ns, evict_reduce_cb, &state2, &n_general_waits, "evict");
 
 					evict_ttl = cb_info2.evict_void_time - now;
-					n_evicted_records = cb_info2.num_evicted;
+					n_evicted_records = state2.num_deleted;
 				}
 				else if (sets_protected || cb_info2.evict_void_time == now) {
 					// Convert eviction into expiration.
@@ -1071,10 +1291,10 @@ run_nsup(void *arg)
 
 					// Reduce master partitions, deleting expired records,
 					// including those in eviction-protected sets.
-					reduce_master_partitions(ns, evict_reduce_cb, &cb_info2, &n_general_waits, "expire-protected-sets");
+					reduce_master_partitions(ns, evict_reduce_cb, &state2, &n_general_waits, "expire-protected-sets");
 
 					// Count these as expired rather than evicted, since we can.
-					n_expired_records = cb_info2.num_evicted;
+					n_expired_records = state2.num_deleted;
 				}
 
 				// For now there's no get_info() call for evict_hist.
@@ -1089,11 +1309,13 @@ run_nsup(void *arg)
 				cb_info.ns = ns;
 				cb_info.now = now;
 
+				nsup_reduce_state state = { .info = &cb_info, .hists = &hists };
+
 				// Reduce master partitions, deleting expired records.
-				reduce_master_partitions(ns, expire_reduce_cb, &cb_info, &n_general_waits, "expire");
+				reduce_master_partitions(ns, expire_reduce_cb, &state, &n_general_waits, "expire");
 
-				n_expired_records = cb_info.num_expired;
-				n_0_void_time_records = cb_info.num_0_void_time;
+				n_expired_records = state.num_deleted;
+				n_0_void_time_records = state.num_0_void_time;
 			}
 
 			linear_hist_dump(ns->obj_size_hist);
@@ -76,6 +76,10 @@
  *
  *  (Releases all the resources qtr and qwork if allocated)
  *
+ *  Long running range queries are instead fanned out by query_fanout into one
+ *  range qwork per physical tree - query_process_rangereq looks up its tree
+ *  batch by batch, passing each batch to one of the above as it's filled.
+ *
  *  A query may be single thread execution or a multi threaded application. In the
  *  single thread execution all the functions are called in the single thread context
  *  and no queue is involved. In case of multi thread context qtr is setup by thr_tsvc
@@ -106,7 +110,10 @@
 #include "aerospike/as_rec.h"
 #include "aerospike/as_val.h"
 #include "aerospike/mod_lua.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_byte_order.h"
 #include "citrusleaf/cf_ll.h"
+#include "citrusleaf/cf_random.h"
 #include "citrusleaf/cf_rchash.h"
 
 #include "ai_btree.h"
@@ -126,8 +133,10 @@
 #include "base/udf_record.h"
 #include "fabric/fabric.h"
 #include "fabric/partition.h"
+#include "fabric/exchange.h"
 #include "geospatial/geospatial.h"
 #include "transaction/udf.h"
+#include "shash.h"
 
 
 /*
@@ -158,6 +167,29 @@ typedef enum {
 
 
 
+/*
+ * Paginated Query Cursor
+ */
+// **************************************************************************************************
+/*
+ * Where a paginated query's last page stopped - held, by token, for the
+ * client to resume from for the next page
+ */
+typedef struct query_cursor_s {
+	as_sindex              * si;          // reserved while the cursor is held
+	uint64_t                 cluster_key; // pages must see the same partitions
+	uint64_t                 expire_ns;
+	int                      range_index;
+	int                      pimd_idx;
+	bool                     new_ibtr;
+	bool                     nbtr_done;
+	cf_digest                bdig;
+	struct ai_obj            bkey;
+} query_cursor;
+// **************************************************************************************************
+
+
+
 /*
  * Query Transaction Structure
  */
@@ -177,6 +209,9 @@ typedef struct as_query_transaction_s {
 	bool                     no_bin_data;
 	predexp_eval_t         * predexp_eval;
 	cf_vector              * binlist;
+	bool                     covered;   // sindex covering copies can answer
+	uint32_t                 max_records; // page size - 0 if not paginated
+	query_cursor           * resume;    // page to resume - consumed at run setup
 	as_file_handle         * fd_h;      // ref counted nonetheless
 	/************************** Run Time Data *********************************/
 	bool                     blocking;
@@ -190,8 +225,6 @@ typedef struct as_query_transaction_s {
  	*/
 	/****************** Stats (only generator) ***********************/
 	uint64_t                 querying_ai_time_ns;  // Time spent by query to run lookup secondary index trees.
-	uint32_t                 n_digests;            // Digests picked by from secondary index
-											   	   // including record read
 	bool                     short_running;
 	bool                     track;
 
@@ -206,6 +239,9 @@ typedef struct as_query_transaction_s {
 												   // being touched.
 	cf_atomic64              net_io_bytes;
 	cf_atomic64              n_read_success;
+	cf_atomic32              n_digests;            // Digests picked by from secondary index
+											   	   // including record read - by range
+											   	   // lookup workers too
 
 	/********************** Query Progress ***********************************/
 	cf_atomic32              n_qwork_active;
@@ -224,6 +260,7 @@ typedef struct as_query_transaction_s {
 	bool                     do_requeue;
 	qtr_state                state;
 	int                      result_code;
+	uint64_t                 cursor_token; // sent with fin - 0 if done
 
     /********************* Fields Not Memzeroed **********************
 	*
@@ -254,6 +291,7 @@ typedef enum {
 	QUERY_WORK_TYPE_LOOKUP =  0, // Request for I/O
 	QUERY_WORK_TYPE_AGG    =  1, // Request for Aggregation
 	QUERY_WORK_TYPE_UDF_BG =  2, // Request for running UDF on query result
+	QUERY_WORK_TYPE_RANGE  =  3, // Request for range lookup in one physical tree
 } query_work_type;
 // **************************************************************************************************
 
@@ -262,10 +300,20 @@ typedef enum {
  * Query Request
  */
 // **************************************************************************************************
+/*
+ * Lookup position of a range request - one physical tree, through all the
+ * query's ranges
+ */
+typedef struct query_range_cursor_s {
+	as_sindex_qctx         qctx;
+	struct ai_obj          bkey;     // qctx.bkey points here
+} query_range_cursor;
+
 typedef struct query_work_s {
 	query_work_type        type;
 	as_query_transaction * qtr;
 	cf_ll                * recl;
+	query_range_cursor   * cursor;   // QUERY_WORK_TYPE_RANGE only
 	uint64_t               queued_time_ns;
 } query_work;
 // **************************************************************************************************
@@ -301,6 +349,9 @@ static int              g_current_queries_count = 0;
 static pthread_rwlock_t g_query_lock
 						= PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
 static cf_rchash      * g_query_job_hash = NULL;
+// Paginated query cursors
+static cf_shash       * g_query_cursor_hash = NULL;
+static uint64_t        g_query_cursor_sweep_ns = 0;
 // Buf Builder Pool
 static cf_queue       * g_query_response_bb_pool  = 0;
 static cf_queue       * g_query_qwork_pool         = 0;
@@ -340,6 +391,9 @@ extern cf_vector * as_sindex_binlist_from_msg(as_namespace *ns, as_msg *msgp, in
 // **************************************************************************************************
 
 static void qtr_finish_work(as_query_transaction *qtr, cf_atomic32 *stat, char *fname, int lineno, bool release);
+static int qwork_process(query_work *qworkp);
+static int query_check_bound(as_query_transaction *qtr);
+static void query_cursor_destroy(query_cursor *cursor);
 
 // **************************************************************************************************
 
@@ -497,8 +551,9 @@ static int
 qwork_poolrelease(query_work *qwork)
 {
 	if (!qwork) return AS_QUERY_OK;
-	qwork->qtr   = 0;
-	qwork->type  = QUERY_WORK_TYPE_NONE;
+	qwork->qtr    = 0;
+	qwork->type   = QUERY_WORK_TYPE_NONE;
+	qwork->cursor = NULL;
 
 	int ret = AS_QUERY_OK;
 	if (cf_queue_sz(g_query_qwork_pool) < AS_QUERY_MAX_QREQ) {
@@ -529,8 +584,9 @@ qwork_poolrequest()
 		cf_warning(AS_QUERY, "Failed to find query work in the pool");
 		return NULL;
 	}
-	qwork->qtr   = 0;
-	qwork->type  = QUERY_WORK_TYPE_NONE;
+	qwork->qtr    = 0;
+	qwork->type   = QUERY_WORK_TYPE_NONE;
+	qwork->cursor = NULL;
 	return qwork;
 };
 // **************************************************************************************************
@@ -806,6 +862,7 @@ query_teardown(as_query_transaction *qtr)
 	if (qtr->binlist)     cf_vector_destroy(qtr->binlist);
 	if (qtr->setname)     cf_free(qtr->setname);
 	if (qtr->predexp_eval) predexp_destroy(qtr->predexp_eval);
+	if (qtr->resume)      query_cursor_destroy(qtr->resume);
 	if (qtr->job_type == QUERY_TYPE_AGGR && qtr->agg_call.def.arglist) {
 		as_list_destroy(qtr->agg_call.def.arglist);
 	}
@@ -988,6 +1045,9 @@ query_netio(as_query_transaction *qtr)
 	io.fd_h        = qtr->fd_h;
 
 	io.offset      = 0;
+	io.compressed  = false;
+
+	as_netio_compress(&io, qtr->ns);
 
 	cf_atomic32_incr(&qtr->n_io_outstanding);
 	io.seq         = cf_atomic32_incr(&qtr->netio_push_seq);
@@ -1137,6 +1197,168 @@ hash_track_qtr(as_query_transaction *qtr)
 
 
 
+/*
+ * Query Cursor Functions
+ */
+// **************************************************************************************************
+static void
+query_cursor_destroy(query_cursor *cursor)
+{
+	AS_SINDEX_RELEASE(cursor->si);
+	cf_free(cursor);
+}
+
+static int
+query_cursor_expire_reduce_fn(const void *key, void *data, void *udata)
+{
+	query_cursor *cursor = *(query_cursor **)data;
+
+	if (cursor->expire_ns <= *(uint64_t *)udata) {
+		query_cursor_destroy(cursor);
+		return CF_SHASH_REDUCE_DELETE;
+	}
+
+	return CF_SHASH_OK;
+}
+
+// Drop expired cursors - at most once a second, as new cursors are held.
+static void
+query_cursor_sweep(uint64_t now_ns)
+{
+	uint64_t last_ns = ck_pr_load_64(&g_query_cursor_sweep_ns);
+
+	if (now_ns - last_ns < 1000000000UL ||
+			! ck_pr_cas_64(&g_query_cursor_sweep_ns, last_ns, now_ns)) {
+		return;
+	}
+
+	cf_shash_reduce(g_query_cursor_hash, query_cursor_expire_reduce_fn,
+			&now_ns);
+}
+
+// Hold the lookup position after a full page - returns the token to resume
+// with.
+static uint64_t
+query_cursor_hold(as_query_transaction *qtr)
+{
+	as_sindex_qctx *qctx   = &qtr->qctx;
+	query_cursor   *cursor = cf_malloc(sizeof(query_cursor));
+	uint64_t        now_ns = cf_getns();
+
+	AS_SINDEX_RESERVE(qtr->si);
+	cursor->si          = qtr->si;
+	cursor->cluster_key = as_exchange_cluster_key();
+	cursor->expire_ns   = now_ns + (uint64_t)g_config.query_cursor_ttl * 1000000000UL;
+	cursor->range_index = qctx->range_index;
+	cursor->pimd_idx    = qctx->pimd_idx;
+	cursor->new_ibtr    = qctx->new_ibtr;
+	cursor->nbtr_done   = qctx->nbtr_done;
+	cursor->bdig        = qctx->bdig;
+	init_ai_obj(&cursor->bkey);
+	ai_objClone(&cursor->bkey, qctx->bkey);
+
+	query_cursor_sweep(now_ns);
+
+	uint64_t token;
+
+	do {
+		token = cf_get_rand64();
+	} while (token == 0 || cf_shash_put_unique(g_query_cursor_hash, &token,
+			&cursor) != CF_SHASH_OK);
+
+	return token;
+}
+
+/*
+ * Pagination fields - a page size, and a token to resume with, absent for the
+ * first page. A cursor is used once - each page that isn't the last gets a
+ * new one.
+ *
+ * Returns AS_QUERY_ERR, with tr->result_code set, if the fields are bad or the
+ * cursor can't be resumed.
+ */
+static int
+query_get_page(as_transaction *tr, as_sindex *si, query_type qtype,
+		uint32_t *p_max_records, query_cursor **p_resume)
+{
+	if (! as_transaction_has_query_max_records(tr)) {
+		if (as_transaction_has_query_cursor(tr)) {
+			cf_warning(AS_QUERY, "query cursor without page size");
+			tr->result_code = AS_PROTO_RESULT_FAIL_PARAMETER;
+			return AS_QUERY_ERR;
+		}
+
+		return AS_QUERY_OK;
+	}
+
+	if (qtype != QUERY_TYPE_LOOKUP) {
+		cf_warning(AS_QUERY, "only lookup queries can be paginated");
+		tr->result_code = AS_PROTO_RESULT_FAIL_UNSUPPORTED_FEATURE;
+		return AS_QUERY_ERR;
+	}
+
+	as_msg_field *f = as_transaction_field_get(tr,
+			AS_MSG_FIELD_TYPE_QUERY_MAX_RECORDS);
+
+	if (as_msg_field_get_value_sz(f) != sizeof(uint32_t) ||
+			(*p_max_records = cf_swap_from_be32(*(uint32_t *)f->data)) == 0) {
+		cf_warning(AS_QUERY, "bad query page size");
+		tr->result_code = AS_PROTO_RESULT_FAIL_PARAMETER;
+		return AS_QUERY_ERR;
+	}
+
+	if (! as_transaction_has_query_cursor(tr)) {
+		return AS_QUERY_OK;
+	}
+
+	f = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_QUERY_CURSOR);
+
+	if (as_msg_field_get_value_sz(f) != sizeof(uint64_t)) {
+		cf_warning(AS_QUERY, "bad query cursor");
+		tr->result_code = AS_PROTO_RESULT_FAIL_PARAMETER;
+		return AS_QUERY_ERR;
+	}
+
+	uint64_t token = cf_swap_from_be64(*(uint64_t *)f->data);
+	query_cursor *cursor;
+
+	if (cf_shash_get_and_delete(g_query_cursor_hash, &token, &cursor) !=
+			CF_SHASH_OK) {
+		cf_debug(AS_QUERY, "query cursor %lx not found", token);
+		tr->result_code = AS_PROTO_RESULT_FAIL_NOTFOUND;
+		return AS_QUERY_ERR;
+	}
+
+	if (cursor->expire_ns <= cf_getns()) {
+		cf_debug(AS_QUERY, "query cursor %lx expired", token);
+		tr->result_code = AS_PROTO_RESULT_FAIL_NOTFOUND;
+		query_cursor_destroy(cursor);
+		return AS_QUERY_ERR;
+	}
+
+	if (cursor->si != si) {
+		cf_warning(AS_QUERY, "query cursor %lx is for another index", token);
+		tr->result_code = AS_PROTO_RESULT_FAIL_PARAMETER;
+		query_cursor_destroy(cursor);
+		return AS_QUERY_ERR;
+	}
+
+	// Partitions may have moved since the last page - records could be missed
+	// or repeated. The client must start again.
+	if (cursor->cluster_key != as_exchange_cluster_key()) {
+		tr->result_code = AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH;
+		query_cursor_destroy(cursor);
+		return AS_QUERY_ERR;
+	}
+
+	*p_resume = cursor;
+
+	return AS_QUERY_OK;
+}
+// **************************************************************************************************
+
+
+
 /*
  * Query Request IO functions
  */
@@ -1210,7 +1432,14 @@ query_add_fin(as_query_transaction *qtr)
 		// Assert that query is aborted if bb_r is found to be null
 		return AS_QUERY_ERR;
 	}
-	cf_buf_builder_reserve(&qtr->bb_r, sizeof(as_msg), &b);
+
+	// A page that isn't the last - the cursor goes with the fin. (If the
+	// query failed the cursor is left to expire.)
+	bool has_cursor = qtr->cursor_token != 0 &&
+			qtr->result_code == AS_PROTO_RESULT_OK;
+
+	cf_buf_builder_reserve(&qtr->bb_r, sizeof(as_msg) + (has_cursor ?
+			sizeof(as_msg_field) + sizeof(uint64_t) : 0), &b);
 
 	ASD_QUERY_ADDFIN(nodeid, qtr->trid);
 	// set up the header
@@ -1224,10 +1453,18 @@ query_add_fin(as_query_transaction *qtr)
 	msgp->result_code = qtr->result_code;
 	msgp->generation  = 0;
 	msgp->record_ttl  = 0;
-	msgp->n_fields    = 0;
+	msgp->n_fields    = has_cursor ? 1 : 0;
 	msgp->n_ops       = 0;
 	msgp->transaction_ttl = 0;
 	as_msg_swap_header(msgp);
+
+	if (has_cursor) {
+		as_msg_field *mf  = (as_msg_field *)(buf + sizeof(as_msg));
+		mf->field_sz      = sizeof(uint64_t) + 1;
+		mf->type          = AS_MSG_FIELD_TYPE_QUERY_CURSOR;
+		*(uint64_t *)mf->data = cf_swap_to_be64(qtr->cursor_token);
+		as_msg_swap_field(mf);
+	}
 	return AS_QUERY_OK;
 }
 
@@ -1275,6 +1512,36 @@ query_match_integer_fromval(as_query_transaction * qtr, as_val *v, as_sindex_key
 	return true;
 }
 
+// The record must still have a value with the index key it was found under.
+// Ordered keys of strings that fit are the strings themselves, so comparing
+// keys is exact - only a truncated key needs the digest of an equality
+// query's value. (String ranges have ends which fit, so never need it.)
+static bool
+query_match_string(as_query_transaction *qtr, const char *str, uint32_t len,
+		as_sindex_key *skey)
+{
+	as_sindex_metadata *imd = qtr->si->imd;
+	cf_digest str_key;
+
+	as_sindex_string_to_skey(imd, str, len, &str_key);
+
+	if (memcmp(&str_key, &skey->key.str_key, AS_DIGEST_KEY_SZ)) {
+		return false;
+	}
+
+	if (! imd->str_ordered || len <= AS_SINDEX_STR_PREFIX_SZ ||
+			qtr->srange->isrange) {
+		return true;
+	}
+
+	cf_digest str_digest;
+
+	cf_digest_compute(str, len, &str_digest);
+
+	return memcmp(&str_digest, &qtr->srange->start.digest,
+			AS_DIGEST_KEY_SZ) == 0;
+}
+
 static bool
 query_match_string_fromval(as_query_transaction * qtr, as_val *v, as_sindex_key *skey)
 {
@@ -1291,13 +1558,8 @@ query_match_string_fromval(as_query_transaction * qtr, as_val *v, as_sindex_key
 	}
 
 	char * str_val = as_string_get(as_string_fromval(v));
-	cf_digest str_digest;
-	cf_digest_compute(str_val, strlen(str_val), &str_digest);
 
-	if (memcmp(&str_digest, &skey->key.str_key, AS_DIGEST_KEY_SZ)) {
-		return false;
-	}
-	return true;
+	return query_match_string(qtr, str_val, strlen(str_val), skey);
 }
 
 static bool
@@ -1448,13 +1710,7 @@ query_record_matches(as_query_transaction *qtr, as_storage_rd *rd, as_sindex_key
 
 			char * buf;
 			uint32_t psz = as_bin_particle_string_ptr(b, &buf);
-			cf_digest bin_digest;
-			cf_digest_compute(buf, psz, &bin_digest);
-			if (memcmp(&skey->key.str_key, &bin_digest, AS_DIGEST_KEY_SZ)) {
-				matches = false;
-				break;
-			}
-			matches = true;
+			matches = query_match_string(qtr, buf, psz, skey);
 			break;
 		}
 		case AS_PARTICLE_TYPE_GEOJSON : {
@@ -1566,6 +1822,47 @@ query_record_matches(as_query_transaction *qtr, as_storage_rd *rd, as_sindex_key
 
 
 
+// Answer from the sindex's copy of the record's bins, if the copy is current.
+// Returns AS_QUERY_CONTINUE if the record must be read instead.
+static int
+query_io_covered(as_query_transaction *qtr, as_index *r, as_sindex_key *skey)
+{
+	as_sindex_covering_entry *e = as_sindex_covering_get(qtr->si, r);
+
+	if (! e) {
+		return AS_QUERY_CONTINUE;
+	}
+
+	as_storage_rd rd;
+	as_bin bins[1 + AS_SINDEX_MAX_COVERING_BINS];
+
+	memset(&rd, 0, sizeof(rd));
+	rd.r  = r;
+	rd.ns = qtr->ns;
+
+	if (! as_sindex_covering_load_rd(e, &rd, bins)) {
+		as_sindex_covering_release(e);
+		return AS_QUERY_CONTINUE;
+	}
+
+	qtr->n_read_success += 1;
+	cf_atomic64_incr(&qtr->si->stats.covering_hits);
+
+	int rv = AS_QUERY_OK;
+
+	if (! query_record_matches(qtr, &rd, skey)) {
+		cf_atomic64_incr(&g_stats.query_false_positives);
+	}
+	else if (query_add_response(qtr, &rd) != 0) {
+		qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_QUERY_CBERROR, __FILE__, __LINE__);
+		rv = AS_QUERY_ERR;
+	}
+
+	as_sindex_covering_release(e);
+
+	return rv;
+}
+
 static int
 query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 {
@@ -1577,6 +1874,13 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 	as_partition_reservation rsv_stack;
 	as_partition_reservation * rsv = &rsv_stack;
 
+	// Digest-only predicates (e.g. digest modulo) can reject the record
+	// before we reserve its partition or look it up.
+	if (qtr->predexp_eval &&
+			! predexp_matches_digest(qtr->predexp_eval, ns, dig)) {
+		return AS_QUERY_OK;
+	}
+
 	// We make sure while making digest list that current partition is query-able
 	// Attempt the query reservation here as well. If this partition is not
 	// query-able anymore then no need to return anything
@@ -1614,6 +1918,17 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 			goto CLEANUP;
 		}
 
+		if (qtr->covered) {
+			int rv = query_io_covered(qtr, r, skey);
+
+			if (rv != AS_QUERY_CONTINUE) {
+				as_record_done(&r_ref, ns);
+				query_release_partition(qtr, rsv);
+				return rv;
+			}
+			// else - no current copy, read the record.
+		}
+
 		// make sure it's brought in from storage if necessary
 		as_storage_rd rd;
 		as_storage_record_open(ns, r, &rd);
@@ -1638,7 +1953,7 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 		// Now we have a record.
 		predargs.rd = &rd;
 
-		if (qtr->predexp_eval &&
+		if (predexp_needs_record(qtr->predexp_eval) &&
 			 ! predexp_matches_record(qtr->predexp_eval, &predargs)) {
 			as_storage_record_close(&rd);
 			as_record_done(&r_ref, ns);
@@ -1664,6 +1979,9 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 			ASD_QUERY_IO_ERROR(nodeid, qtr->trid);
 			return AS_QUERY_ERR;
 		}
+		if (qtr->si->covering) {
+			as_sindex_covering_put(qtr->si, &rd);
+		}
 		as_storage_record_close(&rd);
 		as_record_done(&r_ref, ns);
 	} else {
@@ -1687,24 +2005,18 @@ CLEANUP :
  * Query Aggregation Request Workhorse Function
  */
 // **************************************************************************************************
+// Caller must hold buf_mutex.
 static int
-query_add_val_response(void *void_qtr, const as_val *val, bool success)
+query_add_val_response_locked(as_query_transaction *qtr, const as_val *val, bool success)
 {
-	as_query_transaction *qtr = (as_query_transaction *)void_qtr;
-	if (!qtr) {
-		return AS_QUERY_ERR;
-	}
-
 	uint32_t msg_sz = as_particle_asval_client_value_size(val);
 	if (0 == msg_sz) {
 		cf_warning(AS_PROTO, "particle to buf: could not copy data!");
 	}
 
-	pthread_mutex_lock(&qtr->buf_mutex);
 	cf_buf_builder *bb_r = qtr->bb_r;
 	if (bb_r == NULL) {
 		// Assert that query is aborted if bb_r is found to be null
-		pthread_mutex_unlock(&qtr->buf_mutex);
 		return AS_QUERY_ERR;
 	}
 
@@ -1715,10 +2027,24 @@ query_add_val_response(void *void_qtr, const as_val *val, bool success)
 	as_msg_make_val_response_bufbuilder(val, &qtr->bb_r, msg_sz, success);
 	cf_atomic64_incr(&qtr->n_result_records);
 
-	pthread_mutex_unlock(&qtr->buf_mutex);
 	return 0;
 }
 
+static int
+query_add_val_response(void *void_qtr, const as_val *val, bool success)
+{
+	as_query_transaction *qtr = (as_query_transaction *)void_qtr;
+	if (!qtr) {
+		return AS_QUERY_ERR;
+	}
+
+	pthread_mutex_lock(&qtr->buf_mutex);
+	int ret = query_add_val_response_locked(qtr, val, success);
+	pthread_mutex_unlock(&qtr->buf_mutex);
+
+	return ret;
+}
+
 
 static void
 query_add_result(char *res, as_query_transaction *qtr, bool success)
@@ -1783,6 +2109,27 @@ agg_ostream_write(void *udata, as_val *v)
 	return ret;
 }
 
+as_stream_status
+agg_ostream_write_batch(void *udata, as_val **vals, uint32_t n_vals)
+{
+	as_query_transaction *qtr = (as_query_transaction *)udata;
+	int ret = AS_STREAM_OK;
+
+	pthread_mutex_lock(&qtr->buf_mutex);
+	for (uint32_t i = 0; i < n_vals; i++) {
+		if (ret == AS_STREAM_OK &&
+				query_add_val_response_locked(qtr, vals[i], true)) {
+			ret = AS_STREAM_ERR;
+		}
+	}
+	pthread_mutex_unlock(&qtr->buf_mutex);
+
+	for (uint32_t i = 0; i < n_vals; i++) {
+		as_val_destroy(vals[i]);
+	}
+	return ret;
+}
+
 static as_partition_reservation *
 agg_reserve_partition(void *udata, as_namespace *ns, uint32_t pid, as_partition_reservation *rsv)
 {
@@ -1816,11 +2163,12 @@ agg_record_matches(void *udata, udf_record *urecord, void *key_data)
 }
 
 const as_aggr_hooks query_aggr_hooks = {
-	.ostream_write = agg_ostream_write,
-	.set_error     = agg_set_error,
-	.ptn_reserve   = agg_reserve_partition,
-	.ptn_release   = agg_release_partition,
-	.pre_check     = agg_record_matches
+	.ostream_write       = agg_ostream_write,
+	.ostream_write_batch = agg_ostream_write_batch,
+	.set_error           = agg_set_error,
+	.ptn_reserve         = agg_reserve_partition,
+	.ptn_release         = agg_release_partition,
+	.pre_check           = agg_record_matches
 };
 // **************************************************************************************************
 
@@ -1854,6 +2202,10 @@ int
 query_udf_bg_tr_start(as_query_transaction *qtr, cf_digest *keyd)
 {
 	if (qtr->origin.predexp) {
+		if (! predexp_matches_digest(qtr->origin.predexp, qtr->ns, keyd)) {
+			return AS_QUERY_OK;
+		}
+
 		as_partition_reservation rsv_stack;
 		as_partition_reservation *rsv = &rsv_stack;
 		uint32_t pid = as_partition_getid(keyd);
@@ -2025,6 +2377,124 @@ Cleanup:
 	return AS_QUERY_OK;
 }
 
+static query_work_type
+qwork_type(as_query_transaction *qtr)
+{
+	switch (qtr->job_type) {
+		case QUERY_TYPE_LOOKUP:
+			return QUERY_WORK_TYPE_LOOKUP;
+		case QUERY_TYPE_AGGR:
+			return QUERY_WORK_TYPE_AGG;
+		case QUERY_TYPE_UDF_BG:
+			return QUERY_WORK_TYPE_UDF_BG;
+		default:
+			cf_crash(AS_QUERY, "Unknown Query Type !!");
+	}
+	return QUERY_WORK_TYPE_NONE;
+}
+
+static void
+qwork_free_recl(cf_ll *recl)
+{
+	cf_ll_reduce(recl, true /*forward*/, as_index_keys_ll_reduce_fn, NULL);
+	cf_free(recl);
+}
+
+/*
+ * Hand a range request's filled batch to the job's own request processing,
+ * in this thread
+ */
+static int
+query_process_range_batch(as_query_transaction *qtr, as_sindex_qctx *qctx)
+{
+	query_work qwork;
+	qwork.type           = qwork_type(qtr);
+	qwork.qtr            = qtr;
+	qwork.recl           = qctx->recl;
+	qwork.cursor         = NULL;
+	qwork.queued_time_ns = cf_getns();
+	cf_atomic32_add(&qtr->n_digests, (int32_t)qctx->n_bdigs);
+	qctx->recl           = NULL;
+	qctx->n_bdigs        = 0;
+
+	int ret = qwork_process(&qwork);
+
+	qwork_free_recl(qwork.recl);
+	return ret;
+}
+
+/*
+ * Function query_process_rangereq
+ *
+ * Notes-
+ *		Looks up one physical tree through the remaining ranges, processing
+ *		each batch as soon as it's filled - other trees are looked up in
+ *		parallel by other workers. Only the digests of one batch are held at
+ *		a time.
+ */
+static int
+query_process_rangereq(query_work *qrange)
+{
+	as_query_transaction *qtr  = qrange->qtr;
+	as_sindex_qctx       *qctx = &qrange->cursor->qctx;
+	int                   ret  = AS_QUERY_OK;
+
+	while (ret == AS_QUERY_OK) {
+		if (qtr_failed(qtr)) {
+			return AS_QUERY_ERR;
+		}
+
+		// The generator no longer checks this.
+		if (query_check_bound(qtr)) {
+			qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_QUERY_USERABORT, __FILE__, __LINE__);
+			return AS_QUERY_ERR;
+		}
+
+		if (!qctx->recl) {
+			qctx->recl = cf_malloc(sizeof(cf_ll));
+			if (!qctx->recl) {
+				cf_crash(AS_QUERY, "Allocation Error in Query !!");
+			}
+			cf_ll_init(qctx->recl, as_index_keys_ll_destroy_fn, false /*no lock*/);
+			qctx->n_bdigs = 0;
+		}
+
+		uint64_t time_ns = qtr->si->enable_histogram ? cf_getns() : 0;
+		int      qret    = as_sindex_query(qtr->si, &qtr->srange[qctx->range_index], qctx);
+
+		qctx->new_ibtr   = false;
+		if (qret < 0) {
+			qtr_set_err(qtr, as_sindex_err_to_clienterr(qret, __FILE__, __LINE__), __FILE__, __LINE__);
+			return AS_QUERY_ERR;
+		}
+		SINDEX_HIST_INSERT_DATA_POINT(qtr->si, query_batch_lookup, time_ns);
+
+		bool done = false;
+		if (qctx->n_bdigs < qctx->bsize) {
+			// This tree is finished for this range - as in
+			// query_get_nextbatch(), keep filling the batch from the next
+			// range, if any.
+			qctx->new_ibtr  = true;
+			qctx->nbtr_done = false;
+			if (qctx->range_index == (MAX_REGION_CELLS - 1) ||
+				qtr->srange[qctx->range_index + 1].num_binval == 0) {
+				done = true;
+			} else {
+				qctx->range_index++;
+				continue;
+			}
+		}
+
+		if (qctx->n_bdigs != 0) {
+			ret = query_process_range_batch(qtr, qctx);
+		}
+		if (done) {
+			break;
+		}
+	}
+	return ret;
+}
+
 // **************************************************************************************************
 
 
@@ -2051,6 +2521,9 @@ qwork_process(query_work *qworkp)
 		case QUERY_WORK_TYPE_AGG:
 			ret = query_process_aggreq(qworkp);
 			break;
+		case QUERY_WORK_TYPE_RANGE:
+			ret = query_process_rangereq(qworkp);
+			break;
 		default:
 			cf_warning(AS_QUERY, "Unsupported query type %d.. Dropping it", qworkp->type);
 			break;
@@ -2064,34 +2537,28 @@ qwork_setup(query_work *qworkp, as_query_transaction *qtr)
 	qtr_reserve(qtr, __FILE__, __LINE__);
 	qworkp->qtr               = qtr;
 	qworkp->recl              = qtr->qctx.recl;
+	qworkp->cursor            = NULL;
 	qtr->qctx.recl            = NULL;
 	qworkp->queued_time_ns    = cf_getns();
-	qtr->n_digests          += qtr->qctx.n_bdigs;
+	cf_atomic32_add(&qtr->n_digests, (int32_t)qtr->qctx.n_bdigs);
 	qtr->qctx.n_bdigs        = 0;
-
-	switch (qtr->job_type) {
-		case QUERY_TYPE_LOOKUP:
-			qworkp->type          = QUERY_WORK_TYPE_LOOKUP;
-			break;
-		case QUERY_TYPE_AGGR:
-			qworkp->type          = QUERY_WORK_TYPE_AGG;
-			break;
-		case QUERY_TYPE_UDF_BG:
-			qworkp->type          = QUERY_WORK_TYPE_UDF_BG;
-			break;
-		default:
-			cf_crash(AS_QUERY, "Unknown Query Type !!");
-	}
+	qworkp->type             = qwork_type(qtr);
 }
 
 static void
 qwork_teardown(query_work *qworkp)
 {
 	if (qworkp->recl) {
-		cf_ll_reduce(qworkp->recl, true /*forward*/, as_index_keys_ll_reduce_fn, NULL);
-		cf_free(qworkp->recl);
+		qwork_free_recl(qworkp->recl);
 		qworkp->recl = NULL;
 	}
+	if (qworkp->cursor) {
+		if (qworkp->cursor->qctx.recl) {
+			qwork_free_recl(qworkp->cursor->qctx.recl);
+		}
+		cf_free(qworkp->cursor);
+		qworkp->cursor = NULL;
+	}
 	qtr_release(qworkp->qtr, __FILE__, __LINE__);
 	qworkp->qtr = NULL;
 }
@@ -2285,6 +2752,22 @@ query_run_setup(as_query_transaction *qtr)
 	qtr->qctx.bkey                = &qtr->bkey;
 	init_ai_obj(qtr->qctx.bkey);
 	bzero(&qtr->qctx.bdig, sizeof(cf_digest));
+
+	// A page is one batch - resume where the last page stopped, if any.
+	if (qtr->max_records) {
+		qtr->qctx.bsize           = qtr->max_records;
+	}
+	if (qtr->resume) {
+		query_cursor *cursor      = qtr->resume;
+		qtr->qctx.range_index     = cursor->range_index;
+		qtr->qctx.pimd_idx        = cursor->pimd_idx;
+		qtr->qctx.new_ibtr        = cursor->new_ibtr;
+		qtr->qctx.nbtr_done       = cursor->nbtr_done;
+		qtr->qctx.bdig            = cursor->bdig;
+		ai_objClone(qtr->qctx.bkey, &cursor->bkey);
+		query_cursor_destroy(cursor);
+		qtr->resume               = NULL;
+	}
 	// Populate all the paritions for which this partition is query-able
 	as_query_pre_reserve_partitions(qtr);
 
@@ -2403,8 +2886,11 @@ query_qtr_check_and_requeue(as_query_transaction *qtr)
 	if ((cf_atomic64_get(qtr->n_result_records) >= g_config.query_threshold)
 			&& qtr->short_running) {
 		qtr->short_running       = false;
-		// Change batch size to the long running job batch size value
-		qtr->qctx.bsize          = g_config.query_bsize;
+		// Change batch size to the long running job batch size value - a
+		// page stays one batch
+		if (!qtr->max_records) {
+			qtr->qctx.bsize      = g_config.query_bsize;
+		}
 		cf_atomic32_decr(&g_query_short_running);
 		cf_atomic32_incr(&g_query_long_running);
 		cf_atomic64_incr(&qtr->ns->query_long_reqs);
@@ -2494,6 +2980,105 @@ query_check_bound(as_query_transaction *qtr)
 	}
 	return AS_QUERY_OK;
 }
+
+/*
+ * Long running range queries look up each physical tree in parallel, in range
+ * requests on the worker threads, rather than in the generator one tree after
+ * another
+ */
+static bool
+query_can_fanout(as_query_transaction *qtr)
+{
+	return qtr->srange[0].isrange
+		&& !qtr->max_records
+		&& !qtr->short_running
+		&& !g_config.query_req_in_query_thread
+		&& qtr->si->imd->nprts > 1;
+}
+
+/*
+ * Function query_fanout
+ *
+ * Notes-
+ *		Queues a range request per physical tree, each resuming where the
+ *		generator left off - the generator's current tree mid-range, trees it
+ *		has passed from the next range, and the rest from the current range.
+ *
+ * Returns
+ *		AS_QUERY_OK:  Requests queued. The caller treats the query as done and
+ *			waits for the requests to finish.
+ *
+ *		AS_QUERY_ERR: In case of error
+ */
+static int
+query_fanout(as_query_transaction *qtr)
+{
+	as_sindex_qctx *qctx = &qtr->qctx;
+
+	// Process any batch the generator has partly filled.
+	if (qctx->recl && qctx->n_bdigs != 0 && qtr_process(qtr)) {
+		return AS_QUERY_ERR;
+	}
+
+	for (int i = 0; i < qtr->si->imd->nprts; i++) {
+		int  range_index = qctx->range_index;
+		bool resume      = i == qctx->pimd_idx;
+
+		if (qctx->pimd_idx != -1 && i < qctx->pimd_idx) {
+			if (range_index == (MAX_REGION_CELLS - 1) ||
+				qtr->srange[range_index + 1].num_binval == 0) {
+				continue;
+			}
+			range_index++;
+		}
+
+		query_range_cursor *cursor = cf_malloc(sizeof(query_range_cursor));
+		if (!cursor) {
+			cf_warning(AS_QUERY, "Could not allocate query range cursor .. out of memory .. Aborting !!!");
+			return AS_QUERY_ERR;
+		}
+
+		// Copy to inherit the query-able partitions.
+		cursor->qctx             = *qctx;
+		cursor->qctx.bsize       = g_config.query_bsize;
+		cursor->qctx.recl        = NULL;
+		cursor->qctx.n_bdigs     = 0;
+		cursor->qctx.range_index = range_index;
+		cursor->qctx.pimd_idx    = i;
+		cursor->qctx.bkey        = &cursor->bkey;
+		init_ai_obj(&cursor->bkey);
+
+		if (resume) {
+			ai_objClone(&cursor->bkey, qctx->bkey);
+		} else {
+			cursor->qctx.new_ibtr  = true;
+			cursor->qctx.nbtr_done = false;
+			bzero(&cursor->qctx.bdig, sizeof(cf_digest));
+		}
+
+		query_work *qworkp = qwork_poolrequest();
+		if (!qworkp) {
+			cf_warning(AS_QUERY, "Could not allocate query "
+					"request structure .. out of memory .. Aborting !!!");
+			cf_free(cursor);
+			return AS_QUERY_ERR;
+		}
+
+		qtr_reserve(qtr, __FILE__, __LINE__);
+		qworkp->type           = QUERY_WORK_TYPE_RANGE;
+		qworkp->qtr            = qtr;
+		qworkp->recl           = NULL;
+		qworkp->cursor         = cursor;
+		qworkp->queued_time_ns = cf_getns();
+		cf_atomic32_incr(&qtr->n_qwork_active);
+
+		if (cf_queue_push(g_query_work_queue, &qworkp)) {
+			cf_crash(AS_QUERY, "Push into Query Work Queue fail ... !!!");
+		}
+	}
+
+	return AS_QUERY_OK;
+}
 /*
  * Function query_generator
  *
@@ -2554,7 +3139,17 @@ query_generator(as_query_transaction *qtr)
 			continue;
 		}
 
-		// Step 5: Get Next Batch
+		// Step 5: Hand the rest of a long running range query to the workers,
+		//         or get next batch
+		if (query_can_fanout(qtr)) {
+			if (query_fanout(qtr)) {
+				qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_QUERY_CBERROR, __FILE__, __LINE__);
+				continue;
+			}
+			qtr_set_done(qtr, AS_PROTO_RESULT_OK, __FILE__, __LINE__);
+			continue;
+		}
+
 		loop++;
 		int qret    = query_get_nextbatch(qtr);
 
@@ -2580,6 +3175,11 @@ query_generator(as_query_transaction *qtr)
 #endif
 			qtr_set_done(qtr, AS_PROTO_RESULT_OK, __FILE__, __LINE__);
 		}
+		else if (qtr->max_records) {
+			// A full page - hold where it stopped for the next page.
+			qtr->cursor_token = query_cursor_hold(qtr);
+			qtr_set_done(qtr, AS_PROTO_RESULT_OK, __FILE__, __LINE__);
+		}
 
 		// Step 6: Prepare Query Request either to process inline or for
 		//         queueing up for offline processing
@@ -2654,7 +3254,7 @@ query_get_type(as_transaction* tr)
 	}
 
 	as_msg_field *udf_op_f = as_transaction_has_udf_op(tr) ?
-			as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_UDF_OP) : NULL;
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_UDF_OP) : NULL;
 
 	if (udf_op_f && *udf_op_f->data == (uint8_t)AS_UDF_OP_AGGREGATE) {
 		return QUERY_TYPE_AGGR;
@@ -2760,6 +3360,8 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	as_sindex_range *srange = 0;
 	predexp_eval_t *predexp_eval = NULL;
 	char *setname           = NULL;
+	query_cursor *resume    = NULL;
+	uint32_t max_records    = 0;
 	as_query_transaction *qtr = NULL;
 
 	bool has_sindex   = as_sindex_ns_has_sindex(ns);
@@ -2788,7 +3390,7 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	ASD_SINDEX_MSGRANGE_FINISHED(nodeid, trid);
 	// get optional set
 	as_msg_field *sfp = as_transaction_has_set(tr) ?
-			as_msg_field_get(m, AS_MSG_FIELD_TYPE_SET) : NULL;
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET) : NULL;
 
 	if (sfp) {
 		uint32_t setname_len = as_msg_field_get_value_sz(sfp);
@@ -2818,7 +3420,8 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	}
 
 	if (as_transaction_has_predexp(tr)) {
-		as_msg_field * pfp = as_msg_field_get(m, AS_MSG_FIELD_TYPE_PREDEXP);
+		as_msg_field * pfp = as_transaction_field_get(tr,
+				AS_MSG_FIELD_TYPE_PREDEXP);
 		predexp_eval = predexp_build(pfp);
 		if (! predexp_eval) {
 			cf_warning(AS_QUERY, "Failed to build predicate expression");
@@ -2866,6 +3469,11 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 		goto Cleanup;
 	}
 
+	if (query_get_page(tr, si, qtype, &max_records, &resume)) {
+		rv              = AS_QUERY_ERR;
+		goto Cleanup;
+	}
+
 	ASD_QUERY_QTRSETUP_STARTING(nodeid, trid);
 	qtr = qtr_alloc();
 	if (!qtr) {
@@ -2907,6 +3515,11 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	qtr->si                  = si;
 	qtr->srange              = srange;
 	qtr->binlist             = binlist;
+	qtr->covered             = qtr->job_type == QUERY_TYPE_LOOKUP &&
+			! predexp_needs_record(qtr->predexp_eval) &&
+			as_sindex_covers_bins(si, binlist, qtr->no_bin_data);
+	qtr->max_records         = max_records;
+	qtr->resume              = resume;
 	qtr->start_time          = start_time;
 	qtr->end_time            = tr->end_time;
 	qtr->rsv                 = NULL;
@@ -2928,6 +3541,7 @@ Cleanup:
 	if (predexp_eval) predexp_destroy(predexp_eval);
 	if (srange)      as_sindex_range_free(&srange);
 	if (binlist)     cf_vector_destroy(binlist);
+	if (resume)      query_cursor_destroy(resume);
 	return rv;
 }
 
@@ -3231,6 +3845,7 @@ as_query_gconfig_default(as_config *c)
 	c->query_rec_count_bound     = UINT64_MAX; // Unlimited
 	c->query_req_in_query_thread = 0;
 	c->query_untracked_time_ms   = AS_QUERY_UNTRACKED_TIME;
+	c->query_cursor_ttl          = AS_QUERY_CURSOR_TTL;
 
 	c->partitions_pre_reserved       = false;
 }
@@ -3248,6 +3863,10 @@ as_query_init()
 		cf_crash(AS_QUERY, "Failed to create query job hash");
 	}
 
+	// cursors held between the pages of paginated queries
+	g_query_cursor_hash = cf_shash_create(cf_shash_fn_u32, sizeof(uint64_t),
+			sizeof(query_cursor *), 64, CF_SHASH_MANY_LOCK);
+
 	// I/O threads
 	g_query_qwork_pool = cf_queue_create(sizeof(query_work *), true);
 	if (!g_query_qwork_pool)
@@ -63,6 +63,7 @@
 #include "base/secondary_index.h"
 #include "base/stats.h"
 #include "fabric/partition.h"
+#include "transaction/rw_utils.h"
 
 
 int as_sbld_build(as_sindex* si);
@@ -73,11 +74,13 @@ pthread_rwlock_t g_ai_rwlock     = PTHREAD_RWLOCK_INITIALIZER;
 pthread_t g_sindex_populate_th;
 pthread_t g_sindex_destroy_th;
 pthread_t g_sindex_gc_th;
+pthread_t g_sindex_delta_th[SINDEX_DELTA_THREADS];
 
 cf_queue *g_sindex_populate_q;
 cf_queue *g_sindex_destroy_q;
 cf_queue *g_sindex_populateall_done_q;
 cf_queue *g_q_objs_to_defrag;
+cf_queue *g_sindex_delta_q;
 bool      g_sindex_boot_done;
 
 typedef struct as_sindex_set_s {
@@ -128,6 +131,8 @@ as_sindex_gc_get_defrag_arr(void)
 void *
 as_sindex__populate_fn(void *param)
 {
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_SINDEX);
+
 	while(1) {
 		as_sindex *si;
 		cf_queue_pop(g_sindex_populate_q, &si, CF_QUEUE_FOREVER);
@@ -150,10 +155,27 @@ as_sindex__populate_fn(void *param)
 }
 
 
+// Threads which apply deferred write-path updates, one pimd at a time
+void *
+as_sindex__delta_fn(void *param)
+{
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_SINDEX);
+
+	while (1) {
+		as_sindex_delta_work work;
+		cf_queue_pop(g_sindex_delta_q, &work, CF_QUEUE_FOREVER);
+		as_sindex_apply_deltas(work.si, work.pimd_ix);
+		AS_SINDEX_RELEASE(work.si);
+	}
+	return NULL;
+}
+
 // Main thread which looks at the request of the destroy of index
 void *
 as_sindex__destroy_fn(void *param)
 {
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_SINDEX);
+
 	while(1) {
 		as_sindex *si;
 		cf_queue_pop(g_sindex_destroy_q, &si, CF_QUEUE_FOREVER);
@@ -167,7 +189,11 @@ as_sindex__destroy_fn(void *param)
 		}
 		// Free entire usage counter before tree destroy
 		cf_atomic64_sub(&si->ns->n_bytes_sindex_memory,
-				ai_btree_get_isize(si->imd) + ai_btree_get_nsize(si->imd));
+				ai_btree_get_isize(si->imd) + ai_btree_get_nsize(si->imd) +
+				cf_atomic64_get(si->stats.covering_mem_used));
+
+		cf_shash *covering = si->covering;
+		si->covering = NULL;
 
 		// Cache the ibtr pointers
 		uint16_t nprts = si->imd->nprts;
@@ -219,6 +245,9 @@ as_sindex__destroy_fn(void *param)
 		for (int i = 0; i < imd->nprts; i++) {
 			ai_btree_delete_ibtr(ibtr[i]);
 		}
+		if (covering) {
+			as_sindex_covering_destroy(covering);
+		}
 		as_sindex_imd_free(imd);
 		cf_rc_free(imd);
 
@@ -336,6 +365,10 @@ gc_print_ctx(gc_ctx *ctx)
 #define CREATE_LIST_PER_ITERATION_LIMIT   10000
 #define PROCESS_LIST_PER_ITERATION_LIMIT  10
 
+// Namespaces with no records destroyed since their last gc are skipped, but
+// still swept once in this many gc periods as a consistency check.
+#define FULL_SWEEP_PERIODS                60
+
 // true if tree is done
 // false if more in tree
 static bool
@@ -460,6 +493,8 @@ update_gc_stat(gc_stat *statp)
 void *
 as_sindex__gc_fn(void *udata)
 {
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_SINDEX);
+
 	while (! g_sindex_boot_done) {
 		sleep(10);
 		continue;
@@ -468,6 +503,7 @@ as_sindex__gc_fn(void *udata)
 	cf_debug(AS_SINDEX, "Secondary index gc thread started !!");
 
 	uint64_t last_time = cf_get_seconds();
+	uint32_t n_periods = 0;
 
 	for ( ; ; ) {
 		// Wake up every 1 second to check the gc timeout.
@@ -482,6 +518,8 @@ as_sindex__gc_fn(void *udata)
 
 		last_time = curr_time;
 
+		bool full_sweep = ++n_periods % FULL_SWEEP_PERIODS == 0;
+
 		for (int i = 0; i < g_config.n_namespaces; i++) {
 
 			as_namespace *ns = g_config.namespaces[i];
@@ -490,6 +528,14 @@ as_sindex__gc_fn(void *udata)
 				continue;
 			}
 
+			// Garbage is only made when records go away - if none have since
+			// the last gc, there's nothing to find.
+			uint64_t n_pending = cf_atomic64_get(ns->n_sindex_gc_pending);
+
+			if (n_pending == 0 && ! full_sweep) {
+				continue;
+			}
+
 			cf_info(AS_NSUP, "{%s} sindex-gc start", ns->name);
 
 			uint64_t start_time_ms = cf_getms();
@@ -524,6 +570,10 @@ as_sindex__gc_fn(void *udata)
 					cf_getms() - start_time_ms);
 
 			update_gc_stat(&ctx.stat);
+
+			// Records destroyed during this gc may have been missed - leave
+			// them counted for the next one.
+			cf_atomic64_sub(&ns->n_sindex_gc_pending, n_pending);
 		}
 	}
 }
@@ -583,6 +633,13 @@ as_sindex_thr_init()
 		cf_crash(AS_SINDEX, " Could not create sindex gc thread ");
 	}
 
+	g_sindex_delta_q = cf_queue_create(sizeof(as_sindex_delta_work), true);
+	for (int i = 0; i < SINDEX_DELTA_THREADS; i++) {
+		if (0 != pthread_create(&g_sindex_delta_th[i], 0, as_sindex__delta_fn, 0)) {
+			cf_crash(AS_SINDEX, " Could not create sindex delta thread ");
+		}
+	}
+
 	g_sindex_populateall_done_q = cf_queue_create(sizeof(int), true);
 	// At the beginning it is false. It is set to true when all the sindex
 	// are populated.
@@ -647,6 +704,16 @@ as_sbld_build(as_sindex* si)
 		return -3;
 	}
 
+	// If the set keeps per-partition record lists, only its records will be
+	// visited - make the pending count reflect that.
+	if (set_id != INVALID_SET_ID && as_index_set_is_listed(&ns->tree_shared, set_id)) {
+		as_set* p_set = as_namespace_get_set_by_id(ns, set_id);
+
+		if (p_set) {
+			si->stats.recs_pending = cf_atomic64_get(p_set->n_objects);
+		}
+	}
+
 	sbld_job* job = sbld_job_create(ns, set_id, si);
 
 	if (! job) {
@@ -709,6 +776,12 @@ as_sbld_abort(uint64_t trid)
 	return as_job_manager_abort_job(&g_sbld_manager, trid) ? 0 : -1;
 }
 
+int
+as_sbld_change_job_rps(uint64_t trid, uint32_t rps)
+{
+	return as_job_manager_change_job_rps(&g_sbld_manager, trid, rps) ? 0 : -1;
+}
+
 
 //------------------------------------------------
 // sbld_job derived class implementation.
@@ -758,7 +831,11 @@ sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex* si)
 void
 sbld_job_slice(as_job* _job, as_partition_reservation* rsv)
 {
-	as_index_reduce_live(rsv->tree, sbld_job_reduce_cb, (void*)_job);
+	// Building a set's index only needs that set's records - walk the set's
+	// list if it has one, rather than the whole tree.
+	if (! as_index_reduce_set_live(rsv->tree, _job->set_id, sbld_job_reduce_cb, (void*)_job)) {
+		as_index_reduce_live(rsv->tree, sbld_job_reduce_cb, (void*)_job);
+	}
 }
 
 void
@@ -835,6 +912,12 @@ sbld_job_reduce_cb(as_index_ref* r_ref, void* udata)
 		return;
 	}
 
+	// Building all indexes - don't read records no index can cover.
+	if (! job->si && ! record_has_sindex(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
 	as_storage_rd rd;
 	as_storage_record_open(ns, r, &rd);
 	as_storage_rd_load_n_bins(&rd); // TODO - handle error returned
@@ -856,4 +939,5 @@ sbld_job_reduce_cb(as_index_ref* r_ref, void* udata)
 	as_record_done(r_ref, ns);
 
 	cf_atomic64_incr(&_job->n_records_read);
+	as_job_throttle(_job);
 }
@@ -38,15 +38,19 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
-#include "citrusleaf/cf_queue.h"
 
+#include "coarse_clock.h"
 #include "fault.h"
 #include "hardware.h"
+#include "mpmc_queue.h"
 #include "node.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
+#include "base/batch.h"
 #include "base/datamodel.h"
 #include "base/proto.h"
+#include "base/quota.h"
 #include "base/scan.h"
 #include "base/secondary_index.h"
 #include "base/security.h"
@@ -70,7 +74,14 @@
 // Globals.
 //
 
-static cf_queue* g_transaction_queues[MAX_TRANSACTION_QUEUES] = { NULL };
+static cf_mpmc_queue* g_transaction_queues[MAX_TRANSACTION_QUEUES] = { NULL };
+
+// With transaction-queue-batch-ratio, batch sub-transactions wait on their own
+// queues so a big batch can't starve single-record traffic behind it.
+static cf_mpmc_queue* g_batch_sub_queues[MAX_TRANSACTION_QUEUES] = { NULL };
+
+// Ring slots per queue - beyond this, pushes spill to a locked overflow.
+#define TRANSACTION_QUEUE_CAPACITY (4 * 1024)
 
 // Track number of threads for each queue independently.
 static uint32_t g_queues_n_threads[MAX_TRANSACTION_QUEUES] = { 0 };
@@ -79,14 +90,39 @@ static uint32_t g_queues_n_threads[MAX_TRANSACTION_QUEUES] = { 0 };
 // be cache friendly.
 static uint32_t g_current_q = 0;
 
+// With numa-partitions, each NUMA node (that has CPUs) owns a contiguous range
+// of partitions, and transactions for them run on that node's CPU queues.
+#define MAX_NUMA_PARTITION_NODES 64
+
+static uint32_t g_n_numa_nodes = 0;
+static cf_topo_numa_node_index g_numa_nodes[MAX_NUMA_PARTITION_NODES];
+static uint32_t g_numa_node_n_cpus[MAX_NUMA_PARTITION_NODES] = { 0 };
+static uint32_t g_numa_node_cpus[MAX_NUMA_PARTITION_NODES][MAX_TRANSACTION_QUEUES];
+
+// With queue stealing, how long an idle thread waits on its own queue before
+// looking for work on the others.
+#define STEAL_WAIT_MS 1
+
+// When queues are removed, how long to let enqueuers that already picked one
+// finish pushing, before its threads are told to drain and exit.
+#define RETIRE_GRACE_US (10 * 1000)
+
 
 //==========================================================
 // Forward declarations.
 //
 
+void tsvc_create_queues(uint32_t qid);
+void tsvc_hand_off(uint32_t qid);
+void tsvc_init_numa_partitions();
+bool tsvc_numa_owner(const as_transaction *tr, uint32_t *owner);
 void tsvc_add_threads(uint32_t qid, uint32_t n_threads);
 void tsvc_remove_threads(uint32_t qid, uint32_t n_threads);
 void *run_tsvc(void *arg);
+bool tsvc_pop(uint32_t qid, as_transaction *tr);
+bool tsvc_pop_fair(uint32_t qid, as_transaction *tr);
+bool tsvc_steal(uint32_t qid, as_transaction *tr);
+void tsvc_process_batch_group(as_batch_group *group);
 
 
 //==========================================================
@@ -119,10 +155,11 @@ as_tsvc_init()
 
 	// Create the transaction queues.
 	for (uint32_t qid = 0; qid < g_config.n_transaction_queues; qid++) {
-		g_transaction_queues[qid] =
-				cf_queue_create(AS_TRANSACTION_HEAD_SIZE, true);
+		tsvc_create_queues(qid);
+	}
 
-		cf_assert(g_transaction_queues[qid], AS_TSVC, "failed to create queue");
+	if (g_config.numa_partitions) {
+		tsvc_init_numa_partitions();
 	}
 
 	// Start all the transaction threads.
@@ -132,13 +169,43 @@ as_tsvc_init()
 }
 
 
+// With numa-partitions, is the transaction's partition owned by a NUMA node
+// other than the one we're running on? If so, demarshal must queue it.
+bool
+as_tsvc_numa_remote(const as_transaction *tr)
+{
+	uint32_t owner;
+
+	if (! g_config.numa_partitions || ! tsvc_numa_owner(tr, &owner)) {
+		return false;
+	}
+
+	cf_topo_cpu_index cpu = cf_topo_current_cpu();
+
+	return g_numa_nodes[owner] != cf_topo_cpu_numa_node(cpu);
+}
+
+
 // Decide which queue to use, and enqueue transaction.
 void
 as_tsvc_enqueue(as_transaction *tr)
 {
 	uint32_t qid;
+	uint32_t owner;
+
+	if (g_config.numa_partitions) {
+		qid = cf_topo_current_cpu();
 
-	if (g_config.auto_pin == CF_TOPO_AUTO_PIN_NONE ||
+		// Stay local unless the partition belongs to another node - then pick
+		// one of its CPUs, spreading by our own CPU index.
+		if (tsvc_numa_owner(tr, &owner) &&
+				g_numa_nodes[owner] != cf_topo_cpu_numa_node(qid)) {
+			qid = g_numa_node_cpus[owner][qid % g_numa_node_n_cpus[owner]];
+		}
+
+		cf_debug(AS_TSVC, "numa-partitions - transaction on queue %u", qid);
+	}
+	else if (g_config.auto_pin == CF_TOPO_AUTO_PIN_NONE ||
 			g_config.n_namespaces_not_in_memory == 0) {
 		cf_debug(AS_TSVC, "no CPU pinning - dispatching transaction round-robin");
 		// Transaction can go on any queue - distribute evenly.
@@ -149,9 +216,11 @@ as_tsvc_enqueue(as_transaction *tr)
 		cf_debug(AS_TSVC, "transaction on CPU %u", qid);
 	}
 
-	if (cf_queue_push(g_transaction_queues[qid], tr) != CF_QUEUE_OK) {
-		cf_crash(AS_TSVC, "transaction queue push failed - out of memory?");
-	}
+	cf_mpmc_queue *q = g_config.transaction_queue_batch_ratio != 0 &&
+			as_transaction_is_batch_sub(tr) ?
+					g_batch_sub_queues[qid] : g_transaction_queues[qid];
+
+	cf_mpmc_queue_push(q, tr);
 }
 
 
@@ -174,6 +243,44 @@ as_tsvc_set_threads_per_queue(uint32_t target_n_threads)
 }
 
 
+// Triggered via dynamic configuration change. Not possible when queues are
+// tied to CPUs. Added queues get their threads before any transactions. Removed
+// queues stop getting transactions - their threads drain them, hand off any
+// stragglers to the remaining queues, and exit. Removed queues aren't freed,
+// and are reused if queues are added again.
+bool
+as_tsvc_set_n_queues(uint32_t target_n_queues)
+{
+	if (g_config.auto_pin != CF_TOPO_AUTO_PIN_NONE) {
+		cf_warning(AS_TSVC, "can't change transaction-queues with auto-pin");
+		return false;
+	}
+
+	uint32_t n_queues = g_config.n_transaction_queues;
+
+	if (target_n_queues > n_queues) {
+		for (uint32_t qid = n_queues; qid < target_n_queues; qid++) {
+			tsvc_create_queues(qid);
+			tsvc_add_threads(qid, g_config.n_transaction_threads_per_queue);
+		}
+
+		g_config.n_transaction_queues = target_n_queues;
+
+		return true;
+	}
+
+	g_config.n_transaction_queues = target_n_queues;
+
+	usleep(RETIRE_GRACE_US);
+
+	for (uint32_t qid = target_n_queues; qid < n_queues; qid++) {
+		tsvc_remove_threads(qid, g_queues_n_threads[qid]);
+	}
+
+	return true;
+}
+
+
 // Total transactions currently queued, for ticker and info statistics.
 int
 as_tsvc_queue_get_size()
@@ -181,7 +288,11 @@ as_tsvc_queue_get_size()
 	int current_total = 0;
 
 	for (uint32_t qid = 0; qid < g_config.n_transaction_queues; qid++) {
-		current_total += cf_queue_sz(g_transaction_queues[qid]);
+		current_total += (int)cf_mpmc_queue_sz(g_transaction_queues[qid]);
+
+		if (g_batch_sub_queues[qid]) {
+			current_total += (int)cf_mpmc_queue_sz(g_batch_sub_queues[qid]);
+		}
 	}
 
 	return current_total;
@@ -197,9 +308,18 @@ as_tsvc_process_transaction(as_transaction *tr)
 		return;
 	}
 
+	if (as_transaction_is_batch_group(tr)) {
+		tsvc_process_batch_group(tr->from.batch_group);
+		return;
+	}
+
 	int rv;
 	bool free_msgp = true;
 	cl_msg *msgp = tr->msgp;
+
+	ASD_TRANS_TSVC_STARTING(g_config.self_node, (uint64_t)msgp,
+			as_transaction_trid(tr));
+
 	as_msg *m = &msgp->msg;
 
 	as_transaction_init_body(tr);
@@ -216,7 +336,8 @@ as_tsvc_process_transaction(as_transaction *tr)
 	}
 
 	// All transactions must have a namespace.
-	as_msg_field *nf = as_msg_field_get(m, AS_MSG_FIELD_TYPE_NAMESPACE);
+	as_msg_field *nf = as_transaction_field_get(tr,
+			AS_MSG_FIELD_TYPE_NAMESPACE);
 
 	if (! nf) {
 		cf_warning(AS_TSVC, "no namespace in protocol request");
@@ -318,19 +439,29 @@ as_tsvc_process_transaction(as_transaction *tr)
 		tr->end_time = tr->start_time + g_config.transaction_max_ns;
 	}
 
-	// Did the transaction time out while on the queue?
-	if (cf_getns() > tr->end_time) {
+	// Did the transaction time out while on the queue? (The coarse clock's lag
+	// only lets a marginal transaction through.)
+	if (cf_coarse_getns() > tr->end_time) {
 		cf_debug(AS_TSVC, "transaction timed out in queue");
 		as_transaction_error(tr, ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
 		goto Cleanup;
 	}
 
+	// Charge set & namespace quotas - once, not again on restart.
+	if (should_security_check_data_op(tr) && ! as_transaction_is_restart(tr) &&
+			! as_quota_admit(ns, tr)) {
+		cf_debug(AS_TSVC, "transaction rejected by quota");
+		as_transaction_error(tr, ns, AS_PROTO_RESULT_FAIL_QUOTA_EXCEEDED);
+		goto Cleanup;
+	}
+
 	// All single-record transactions must have a digest, or a key from which
 	// to calculate it.
 	if (as_transaction_has_digest(tr)) {
 		// Modern client - just copy digest into tr.
 
-		as_msg_field *df = as_msg_field_get(m, AS_MSG_FIELD_TYPE_DIGEST_RIPE);
+		as_msg_field *df = as_transaction_field_get(tr,
+				AS_MSG_FIELD_TYPE_DIGEST_RIPE);
 		uint32_t digest_sz = as_msg_field_get_value_sz(df);
 
 		if (digest_sz != sizeof(cf_digest)) {
@@ -344,17 +475,21 @@ as_tsvc_process_transaction(as_transaction *tr)
 	else if (! as_transaction_is_batch_sub(tr)) {
 		// Old client - calculate digest from key & set, directly into tr.
 
-		as_msg_field *kf = as_msg_field_get(m, AS_MSG_FIELD_TYPE_KEY);
+		as_msg_field *kf = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_KEY);
 		uint32_t key_sz = as_msg_field_get_value_sz(kf);
 
 		as_msg_field *sf = as_transaction_has_set(tr) ?
-				as_msg_field_get(m, AS_MSG_FIELD_TYPE_SET) : NULL;
+				as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET) : NULL;
 		uint32_t set_sz = sf ? as_msg_field_get_value_sz(sf) : 0;
 
 		cf_digest_compute2(sf->data, set_sz, kf->data, key_sz, &tr->keyd);
 	}
 	// else - batch sub-transactions already (and only) have digest in tr.
 
+	if (ns->hot_key_sample_rate != 0) {
+		as_hot_keys_sample(ns, tr);
+	}
+
 	// Process the transaction.
 
 	bool is_write = (m->info2 & AS_MSG_INFO2_WRITE) != 0;
@@ -422,6 +557,13 @@ as_tsvc_process_transaction(as_transaction *tr)
 			}
 		}
 		else {
+			// A prole that has everything may serve reads - only masters
+			// have working_master set.
+			if (tr->origin == FROM_CLIENT &&
+					tr->rsv.p->working_master == (cf_node)0) {
+				cf_atomic64_incr(&ns->n_client_read_prole);
+			}
+
 			status = as_read_start(tr);
 		}
 
@@ -451,6 +593,15 @@ as_tsvc_process_transaction(as_transaction *tr)
 		switch (tr->origin) {
 		case FROM_CLIENT:
 		case FROM_BATCH:
+			if (! is_write && ns->rack_local_reads) {
+				if (as_partition_is_rack_local(ns, dest)) {
+					cf_atomic64_incr(&ns->n_client_proxy_read_rack_local);
+				}
+				else {
+					cf_atomic64_incr(&ns->n_client_proxy_read_off_rack);
+				}
+			}
+
 			if (! as_proxy_divert(dest, tr, ns)) {
 				as_transaction_error(tr, ns, AS_PROTO_RESULT_FAIL_UNKNOWN);
 			}
@@ -488,6 +639,120 @@ Cleanup:
 // Local helpers.
 //
 
+// Queues are only ever created, never destroyed - a no-op if they exist.
+void
+tsvc_create_queues(uint32_t qid)
+{
+	if (! g_transaction_queues[qid]) {
+		g_transaction_queues[qid] = cf_mpmc_queue_create(
+				AS_TRANSACTION_HEAD_SIZE, TRANSACTION_QUEUE_CAPACITY);
+
+		cf_assert(g_transaction_queues[qid], AS_TSVC, "failed to create queue");
+	}
+
+	if (g_config.transaction_queue_batch_ratio != 0 &&
+			! g_batch_sub_queues[qid]) {
+		g_batch_sub_queues[qid] = cf_mpmc_queue_create(
+				AS_TRANSACTION_HEAD_SIZE, TRANSACTION_QUEUE_CAPACITY);
+
+		cf_assert(g_batch_sub_queues[qid], AS_TSVC,
+				"failed to create batch queue");
+	}
+}
+
+
+// A thread of a removed queue is exiting - move anything still on the queue to
+// the remaining queues. Stops at a sibling thread's terminator, leaving the
+// rest for that sibling.
+void
+tsvc_hand_off(uint32_t qid)
+{
+	as_transaction tr;
+
+	while (cf_mpmc_queue_pop(g_transaction_queues[qid], &tr,
+			CF_MPMC_QUEUE_NOWAIT)) {
+		if (! tr.msgp) {
+			cf_mpmc_queue_push(g_transaction_queues[qid], &tr);
+			return;
+		}
+
+		as_tsvc_enqueue(&tr);
+	}
+
+	if (g_batch_sub_queues[qid]) {
+		while (cf_mpmc_queue_pop(g_batch_sub_queues[qid], &tr,
+				CF_MPMC_QUEUE_NOWAIT)) {
+			as_tsvc_enqueue(&tr);
+		}
+	}
+}
+
+
+void
+tsvc_init_numa_partitions()
+{
+	// Config guarantees auto-pin cpu, so there's one queue per CPU, and queue
+	// index equals CPU index.
+	for (uint32_t qid = 0; qid < g_config.n_transaction_queues; qid++) {
+		cf_topo_numa_node_index node = cf_topo_cpu_numa_node(
+				(cf_topo_cpu_index)qid);
+		uint32_t n;
+
+		for (n = 0; n < g_n_numa_nodes; n++) {
+			if (g_numa_nodes[n] == node) {
+				break;
+			}
+		}
+
+		if (n == g_n_numa_nodes) {
+			cf_assert(n < MAX_NUMA_PARTITION_NODES, AS_TSVC,
+					"too many NUMA nodes");
+			g_numa_nodes[g_n_numa_nodes++] = node;
+		}
+
+		g_numa_node_cpus[n][g_numa_node_n_cpus[n]++] = qid;
+	}
+
+	for (uint32_t n = 0; n < g_n_numa_nodes; n++) {
+		cf_info(AS_TSVC, "numa-partitions: node %hu owns partitions %u-%u on %u CPUs",
+				g_numa_nodes[n], n * AS_PARTITIONS / g_n_numa_nodes,
+				((n + 1) * AS_PARTITIONS / g_n_numa_nodes) - 1,
+				g_numa_node_n_cpus[n]);
+	}
+}
+
+
+// Returns false if the transaction's partition can't be had cheaply - e.g. no
+// digest yet because one must be computed from the key.
+bool
+tsvc_numa_owner(const as_transaction *tr, uint32_t *owner)
+{
+	const cf_digest *keyd;
+
+	if (as_transaction_is_batch_sub(tr)) {
+		keyd = &tr->keyd;
+	}
+	else if (as_transaction_has_digest(tr)) {
+		as_msg_field *f = as_transaction_field_get(tr,
+				AS_MSG_FIELD_TYPE_DIGEST_RIPE);
+
+		if (! f || as_msg_field_get_value_sz(f) != sizeof(cf_digest)) {
+			return false;
+		}
+
+		keyd = (const cf_digest *)f->data;
+	}
+	else {
+		return false;
+	}
+
+	*owner = (uint32_t)(((uint64_t)as_partition_getid(keyd) * g_n_numa_nodes) /
+			AS_PARTITIONS);
+
+	return true;
+}
+
+
 void
 tsvc_add_threads(uint32_t qid, uint32_t n_threads)
 {
@@ -516,13 +781,8 @@ tsvc_remove_threads(uint32_t qid, uint32_t n_threads)
 
 	for (uint32_t n = 0; n < n_threads; n++) {
 		// Send terminator (transaction with NULL msgp).
-		if (cf_queue_push(g_transaction_queues[qid], &death_tr) ==
-				CF_QUEUE_OK) {
-			g_queues_n_threads[qid]--;
-		}
-		else {
-			cf_warning(AS_TSVC, "tsvc queue %u failed thread termination", qid);
-		}
+		cf_mpmc_queue_push(g_transaction_queues[qid], &death_tr);
+		g_queues_n_threads[qid]--;
 	}
 }
 
@@ -533,22 +793,26 @@ run_tsvc(void *arg)
 {
 	uint32_t qid = (uint32_t)(uint64_t)arg;
 
+	cf_thread_set_role("tsvc");
+
 	if (g_config.auto_pin != CF_TOPO_AUTO_PIN_NONE &&
 			g_config.n_namespaces_not_in_memory != 0) {
 		cf_detail(AS_TSVC, "pinning thread to CPU %u", qid);
 		cf_topo_pin_to_cpu((cf_topo_cpu_index)qid);
 	}
 
-	cf_queue *q = g_transaction_queues[qid];
-
 	while (true) {
 		as_transaction tr;
 
-		if (cf_queue_pop(q, &tr, CF_QUEUE_FOREVER) != CF_QUEUE_OK) {
-			cf_crash(AS_TSVC, "unable to pop from transaction queue");
+		if (! tsvc_pop(qid, &tr)) {
+			continue;
 		}
 
 		if (! tr.msgp) {
+			if (qid >= g_config.n_transaction_queues) {
+				tsvc_hand_off(qid); // queue was removed
+			}
+
 			break; // thread termination via configuration change
 		}
 
@@ -565,3 +829,170 @@ run_tsvc(void *arg)
 
 	return NULL;
 }
+
+
+// Handle a group of batch sub-transactions on one partition - reserve the
+// partition once and read all the records together.
+void
+tsvc_process_batch_group(as_batch_group *group)
+{
+	as_namespace *ns = group->ns;
+	uint32_t n_trs = group->n_trs;
+	as_partition_reservation rsv;
+
+	// Writes hold their reservations until replication completes, so can't
+	// share one - they're just handled back to back. If we can't read the
+	// partition here, handle the sub-transactions one by one too - they'll be
+	// proxied, or get the appropriate error.
+	if ((group->trs[0].msgp->msg.info2 & AS_MSG_INFO2_WRITE) != 0 ||
+			! as_partition_balance_is_init_resolved() ||
+			as_partition_reserve_read(ns, group->pid, &rsv, false, NULL) != 0) {
+		for (uint32_t i = 0; i < n_trs; i++) {
+			as_tsvc_process_transaction(&group->trs[i]);
+		}
+
+		cf_free(group);
+		return;
+	}
+
+	as_transaction *readers[n_trs];
+	uint32_t n_readers = 0;
+	uint64_t now = cf_coarse_getns();
+
+	for (uint32_t i = 0; i < n_trs; i++) {
+		as_transaction *tr = &group->trs[i];
+		as_msg *m = &tr->msgp->msg;
+
+		as_transaction_init_body(tr);
+
+		tr->end_time = tr->start_time + (m->transaction_ttl != 0 ?
+				(uint64_t)m->transaction_ttl * 1000000 :
+				g_config.transaction_max_ns);
+
+		if (now > tr->end_time) {
+			as_transaction_error(tr, ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
+			continue;
+		}
+
+		if (! as_security_check_data_op(tr, ns, PERM_READ)) {
+			as_transaction_error(tr, ns, tr->result_code);
+			continue;
+		}
+
+		// The group reservation ignored duplicates - a read that resolves them
+		// must reserve for itself.
+		if (rsv.n_dupl != 0 && read_would_duplicate_resolve(ns, m)) {
+			as_tsvc_process_transaction(tr);
+			continue;
+		}
+
+		as_partition_reservation_copy(&tr->rsv, &rsv);
+		tr->benchmark_time = 0;
+
+		readers[n_readers++] = tr;
+	}
+
+	if (n_readers != 0) {
+		as_read_start_multi(readers, n_readers);
+	}
+
+	as_partition_release(&rsv);
+	cf_free(group);
+}
+
+
+// Get the next transaction for a thread serviced by queue qid. Own queue
+// first, so CPU affinity is kept whenever there's local work - returns false
+// if there was nothing to do for a while.
+bool
+tsvc_pop(uint32_t qid, as_transaction *tr)
+{
+	cf_mpmc_queue *q = g_transaction_queues[qid];
+
+	if (g_config.transaction_queue_batch_ratio != 0) {
+		return tsvc_pop_fair(qid, tr);
+	}
+
+	if (! g_config.transaction_queue_stealing ||
+			g_config.n_transaction_queues == 1) {
+		return cf_mpmc_queue_pop(q, tr, CF_MPMC_QUEUE_FOREVER);
+	}
+
+	if (cf_mpmc_queue_pop(q, tr, CF_MPMC_QUEUE_NOWAIT)) {
+		return true;
+	}
+
+	// Idle - help out queues that are stuck behind slow transactions.
+	if (tsvc_steal(qid, tr)) {
+		return true;
+	}
+
+	return cf_mpmc_queue_pop(q, tr, STEAL_WAIT_MS);
+}
+
+
+// Like tsvc_pop(), but also serves queue qid's batch sub-transactions - one
+// for every transaction-queue-batch-ratio regular transactions when both have
+// work, otherwise whichever has any.
+bool
+tsvc_pop_fair(uint32_t qid, as_transaction *tr)
+{
+	// Per thread, so no sharing - fairness is per thread, not exact per queue.
+	static __thread uint32_t n_served = 0;
+
+	cf_mpmc_queue *q = g_transaction_queues[qid];
+	cf_mpmc_queue *bq = g_batch_sub_queues[qid];
+
+	if (n_served >= g_config.transaction_queue_batch_ratio &&
+			cf_mpmc_queue_pop(bq, tr, CF_MPMC_QUEUE_NOWAIT)) {
+		n_served = 0;
+		return true;
+	}
+
+	if (cf_mpmc_queue_pop(q, tr, CF_MPMC_QUEUE_NOWAIT)) {
+		n_served++;
+		return true;
+	}
+
+	if (cf_mpmc_queue_pop(bq, tr, CF_MPMC_QUEUE_NOWAIT)) {
+		n_served = 0;
+		return true;
+	}
+
+	if (g_config.transaction_queue_stealing &&
+			g_config.n_transaction_queues != 1 && tsvc_steal(qid, tr)) {
+		return true;
+	}
+
+	// Can't block on two queues - wait briefly on the regular one, then look
+	// at both again.
+	return cf_mpmc_queue_pop(q, tr, STEAL_WAIT_MS);
+}
+
+
+// Take a transaction from some other queue, if any has one.
+bool
+tsvc_steal(uint32_t qid, as_transaction *tr)
+{
+	uint32_t n_queues = g_config.n_transaction_queues;
+
+	for (uint32_t i = 1; i < n_queues; i++) {
+		cf_mpmc_queue *victim_q = g_transaction_queues[(qid + i) % n_queues];
+
+		if (! cf_mpmc_queue_pop(victim_q, tr, CF_MPMC_QUEUE_NOWAIT)) {
+			continue;
+		}
+
+		// Thread terminators belong to the victim queue's own threads.
+		if (! tr->msgp) {
+			cf_mpmc_queue_push(victim_q, tr);
+			continue;
+		}
+
+		cf_atomic64_incr(&g_stats.n_tsvc_steals);
+
+		return true;
+	}
+
+	return false;
+}
@@ -45,6 +45,7 @@
 #include "hist.h"
 #include "hist_track.h"
 #include "meminfo.h"
+#include "obj_pool.h"
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
@@ -204,6 +205,10 @@ log_ticker_frame(uint64_t delta_time)
 		log_line_udf_sub(ns);
 		log_line_retransmits(ns);
 
+		if (ns->hot_key_sample_rate != 0) {
+			as_hot_keys_ticker(ns);
+		}
+
 		dump_namespace_histograms(ns);
 	}
 
@@ -232,12 +237,18 @@ log_line_system_memory()
 	cf_alloc_heap_stats(&allocated_kbytes, &active_kbytes, &mapped_kbytes,
 			&efficiency_pct, NULL);
 
-	cf_info(AS_INFO, "   system-memory: free-kbytes %lu free-pct %d%s heap-kbytes (%lu,%lu,%lu) heap-efficiency-pct %.1lf",
+	size_t pool_held_kbytes;
+	size_t pool_depot_kbytes;
+
+	cf_pool_stats(&pool_held_kbytes, &pool_depot_kbytes);
+
+	cf_info(AS_INFO, "   system-memory: free-kbytes %lu free-pct %d%s heap-kbytes (%lu,%lu,%lu) heap-efficiency-pct %.1lf pool-kbytes (%lu,%lu)",
 			freemem / 1024,
 			freepct,
 			swapping ? " SWAPPING!" : "",
 			allocated_kbytes, active_kbytes, mapped_kbytes,
-			efficiency_pct
+			efficiency_pct,
+			pool_held_kbytes, pool_depot_kbytes
 			);
 }
 
@@ -245,13 +256,14 @@ log_line_system_memory()
 void
 log_line_in_progress()
 {
-	cf_info(AS_INFO, "   in-progress: tsvc-q %d info-q %d nsup-delete-q %d rw-hash %u proxy-hash %u tree-gc-q %d",
+	cf_info(AS_INFO, "   in-progress: tsvc-q %d info-q %d nsup-delete-q %d rw-hash %u proxy-hash %u tree-gc-q %d tree-gc-backlog %lu",
 			as_tsvc_queue_get_size(),
 			as_info_queue_get_size(),
 			as_nsup_queue_get_size(),
 			rw_request_hash_count(),
 			as_proxy_hash_count(),
-			as_index_tree_gc_queue_size()
+			as_index_tree_gc_queue_size(),
+			as_index_tree_gc_backlog()
 			);
 }
 
@@ -493,13 +505,13 @@ log_line_client(as_namespace* ns)
 	uint64_t n_proxy_complete = ns->n_client_proxy_complete;
 	uint64_t n_proxy_error = ns->n_client_proxy_error;
 	uint64_t n_proxy_timeout = ns->n_client_proxy_timeout;
-	uint64_t n_read_success = ns->n_client_read_success;
-	uint64_t n_read_error = ns->n_client_read_error;
-	uint64_t n_read_timeout = ns->n_client_read_timeout;
-	uint64_t n_read_not_found = ns->n_client_read_not_found;
-	uint64_t n_write_success = ns->n_client_write_success;
-	uint64_t n_write_error = ns->n_client_write_error;
-	uint64_t n_write_timeout = ns->n_client_write_timeout;
+	uint64_t n_read_success = cf_counter_get(&ns->n_client_read_success);
+	uint64_t n_read_error = cf_counter_get(&ns->n_client_read_error);
+	uint64_t n_read_timeout = cf_counter_get(&ns->n_client_read_timeout);
+	uint64_t n_read_not_found = cf_counter_get(&ns->n_client_read_not_found);
+	uint64_t n_write_success = cf_counter_get(&ns->n_client_write_success);
+	uint64_t n_write_error = cf_counter_get(&ns->n_client_write_error);
+	uint64_t n_write_timeout = cf_counter_get(&ns->n_client_write_timeout);
 	uint64_t n_delete_success = ns->n_client_delete_success;
 	uint64_t n_delete_error = ns->n_client_delete_error;
 	uint64_t n_delete_timeout = ns->n_client_delete_timeout;
@@ -547,18 +559,34 @@ log_line_batch_sub(as_namespace* ns)
 	uint64_t n_read_error = ns->n_batch_sub_read_error;
 	uint64_t n_read_timeout = ns->n_batch_sub_read_timeout;
 	uint64_t n_read_not_found = ns->n_batch_sub_read_not_found;
+	uint64_t n_write_success = ns->n_batch_sub_write_success;
+	uint64_t n_write_error = ns->n_batch_sub_write_error;
+	uint64_t n_write_timeout = ns->n_batch_sub_write_timeout;
+	uint64_t n_delete_success = ns->n_batch_sub_delete_success;
+	uint64_t n_delete_error = ns->n_batch_sub_delete_error;
+	uint64_t n_delete_timeout = ns->n_batch_sub_delete_timeout;
+	uint64_t n_delete_not_found = ns->n_batch_sub_delete_not_found;
+	uint64_t n_udf_complete = ns->n_batch_sub_udf_complete;
+	uint64_t n_udf_error = ns->n_batch_sub_udf_error;
+	uint64_t n_udf_timeout = ns->n_batch_sub_udf_timeout;
 
 	if ((n_tsvc_error | n_tsvc_timeout |
 			n_proxy_complete | n_proxy_error | n_proxy_timeout |
-			n_read_success | n_read_error | n_read_timeout | n_read_not_found) == 0) {
+			n_read_success | n_read_error | n_read_timeout | n_read_not_found |
+			n_write_success | n_write_error | n_write_timeout |
+			n_delete_success | n_delete_error | n_delete_timeout | n_delete_not_found |
+			n_udf_complete | n_udf_error | n_udf_timeout) == 0) {
 		return;
 	}
 
-	cf_info(AS_INFO, "{%s} batch-sub: tsvc (%lu,%lu) proxy (%lu,%lu,%lu) read (%lu,%lu,%lu,%lu)",
+	cf_info(AS_INFO, "{%s} batch-sub: tsvc (%lu,%lu) proxy (%lu,%lu,%lu) read (%lu,%lu,%lu,%lu) write (%lu,%lu,%lu) delete (%lu,%lu,%lu,%lu) udf (%lu,%lu,%lu)",
 			ns->name,
 			n_tsvc_error, n_tsvc_timeout,
 			n_proxy_complete, n_proxy_error, n_proxy_timeout,
-			n_read_success, n_read_error, n_read_timeout, n_read_not_found
+			n_read_success, n_read_error, n_read_timeout, n_read_not_found,
+			n_write_success, n_write_error, n_write_timeout,
+			n_delete_success, n_delete_error, n_delete_timeout, n_delete_not_found,
+			n_udf_complete, n_udf_error, n_udf_timeout
 			);
 }
 
@@ -692,6 +720,10 @@ dump_global_histograms()
 		histogram_dump(g_stats.batch_index_hist);
 	}
 
+	if (g_stats.batch_index_fill_hist_active) {
+		histogram_dump(g_stats.batch_index_fill_hist);
+	}
+
 	if (g_config.info_hist_enabled) {
 		histogram_dump(g_stats.info_hist);
 	}
@@ -773,6 +805,10 @@ dump_namespace_histograms(as_namespace* ns)
 		histogram_dump(ns->query_rec_count_hist);
 	}
 
+	if (ns->response_compression_hist_active) {
+		histogram_dump(ns->response_compression_hist);
+	}
+
 	if (ns->proxy_hist_enabled) {
 		histogram_dump(ns->proxy_hist);
 	}
@@ -794,9 +830,8 @@ dump_namespace_histograms(as_namespace* ns)
 		histogram_dump(ns->udf_sub_response_hist);
 	}
 
-	if (ns->storage_benchmarks_enabled) {
-		as_storage_ticker_stats(ns);
-	}
+	// Storage engine decides what it has to show, e.g. if benchmarks enabled.
+	as_storage_ticker_stats(ns);
 
 	as_sindex_histogram_dumpall(ns);
 }
@@ -69,6 +69,9 @@ as_transaction_init_head(as_transaction *tr, cf_digest *keyd, cl_msg *msgp)
 
 	tr->start_time			= 0;
 	tr->benchmark_time		= 0;
+
+	// Not part of the head, but stack garbage mustn't pass for a field table.
+	tr->fields_msgp			= NULL;
 }
 
 void
@@ -82,6 +85,8 @@ as_transaction_init_body(as_transaction *tr)
 	tr->generation			= 0;
 	tr->void_time			= 0;
 	tr->last_update_time	= 0;
+
+	as_transaction_decode_fields(tr);
 }
 
 void
@@ -117,6 +122,8 @@ as_transaction_init_from_rw(as_transaction *tr, rw_request *rw)
 	tr->generation = rw->generation;
 	tr->void_time = rw->void_time;
 	tr->last_update_time = rw->last_update_time;
+
+	as_transaction_decode_fields(tr);
 }
 
 void
@@ -132,6 +139,8 @@ as_transaction_init_head_from_rw(as_transaction *tr, rw_request *rw)
 	tr->start_time			= rw->start_time;
 	tr->benchmark_time		= rw->benchmark_time;
 
+	tr->fields_msgp			= NULL;
+
 	rw->from.any = NULL;
 	// Note - we don't clear rw->msgp, destructor will free it.
 }
@@ -139,71 +148,44 @@ as_transaction_init_head_from_rw(as_transaction *tr, rw_request *rw)
 bool
 as_transaction_set_msg_field_flag(as_transaction *tr, uint8_t type)
 {
-	switch (type) {
-	case AS_MSG_FIELD_TYPE_NAMESPACE:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_NAMESPACE;
-		break;
-	case AS_MSG_FIELD_TYPE_SET:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_SET;
-		break;
-	case AS_MSG_FIELD_TYPE_KEY:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_KEY;
-		break;
-	case AS_MSG_FIELD_TYPE_DIGEST_RIPE:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_DIGEST_RIPE;
-		break;
-	case AS_MSG_FIELD_TYPE_DIGEST_RIPE_ARRAY:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_DIGEST_RIPE_ARRAY;
-		break;
-	case AS_MSG_FIELD_TYPE_TRID:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_TRID;
-		break;
-	case AS_MSG_FIELD_TYPE_SCAN_OPTIONS:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_SCAN_OPTIONS;
-		break;
-	case AS_MSG_FIELD_TYPE_SOCKET_TIMEOUT:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_SOCKET_TIMEOUT;
-		break;
-	case AS_MSG_FIELD_TYPE_INDEX_NAME:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_INDEX_NAME;
-		break;
-	case AS_MSG_FIELD_TYPE_INDEX_RANGE:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_INDEX_RANGE;
-		break;
-	case AS_MSG_FIELD_TYPE_INDEX_TYPE:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_INDEX_TYPE;
-		break;
-	case AS_MSG_FIELD_TYPE_UDF_FILENAME:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_UDF_FILENAME;
-		break;
-	case AS_MSG_FIELD_TYPE_UDF_FUNCTION:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_UDF_FUNCTION;
-		break;
-	case AS_MSG_FIELD_TYPE_UDF_ARGLIST:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_UDF_ARGLIST;
-		break;
-	case AS_MSG_FIELD_TYPE_UDF_OP:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_UDF_OP;
-		break;
-	case AS_MSG_FIELD_TYPE_QUERY_BINLIST:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_QUERY_BINLIST;
-		break;
-	case AS_MSG_FIELD_TYPE_BATCH: // shouldn't get here - batch parent handles this
-		tr->msg_fields |= AS_MSG_FIELD_BIT_BATCH;
-		break;
-	case AS_MSG_FIELD_TYPE_BATCH_WITH_SET: // shouldn't get here - batch parent handles this
-		tr->msg_fields |= AS_MSG_FIELD_BIT_BATCH_WITH_SET;
-		break;
-	case AS_MSG_FIELD_TYPE_PREDEXP:
-		tr->msg_fields |= AS_MSG_FIELD_BIT_PREDEXP;
-		break;
-	default:
+	int ix = as_msg_field_type_ix(type);
+
+	if (ix < 0) {
 		return false;
 	}
 
+	tr->msg_fields |= 1U << ix;
+
 	return true;
 }
 
+// One pass over the (already swapped) fields, so lookups needn't walk them.
+void
+as_transaction_decode_fields(as_transaction *tr)
+{
+	tr->fields_msgp = tr->msgp;
+	tr->fields_found = 0;
+
+	if (! tr->msgp) {
+		return;
+	}
+
+	as_msg *m = &tr->msgp->msg;
+	as_msg_field *f = (as_msg_field *)m->data;
+
+	for (uint16_t n = 0; n < m->n_fields; n++) {
+		int ix = as_msg_field_type_ix(f->type);
+
+		// Like as_msg_field_get(), the first field of a type wins.
+		if (ix >= 0 && (tr->fields_found & (1U << ix)) == 0) {
+			tr->fields[ix] = f;
+			tr->fields_found |= 1U << ix;
+		}
+
+		f = as_msg_field_get_next(f);
+	}
+}
+
 // TODO - check m->n_fields against PROTO_NFIELDS_MAX_WARNING?
 bool
 as_transaction_demarshal_prepare(as_transaction *tr)
@@ -472,6 +454,11 @@ as_release_file_handle(as_file_handle *proto_fd_h)
 		}
 	}
 
+	if (proto_fd_h->stash) {
+		cf_free(proto_fd_h->stash);
+		proto_fd_h->stash = NULL;
+	}
+
 	if (proto_fd_h->security_filter) {
 		as_security_filter_destroy(proto_fd_h->security_filter);
 		proto_fd_h->security_filter = NULL;
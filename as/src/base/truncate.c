@@ -97,10 +97,11 @@ int truncate_smd_can_accept_cb(char* module, as_smd_item_t *item, void *udata);
 
 void truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut);
 void truncate_action_undo(as_namespace* ns, const char* set_name);
-void truncate_all(as_namespace* ns);
+void truncate_all(as_namespace* ns, uint16_t set_id);
 void* run_truncate(void* arg);
 void truncate_finish(as_namespace* ns);
 void truncate_reduce_cb(as_index_ref* r_ref, void* udata);
+void truncate_throttle(as_namespace* ns, int64_t n_deleted);
 
 
 //==========================================================
@@ -125,6 +126,8 @@ as_truncate_init(as_namespace* ns)
 
 	ns->truncate.state = TRUNCATE_IDLE;
 	pthread_mutex_init(&ns->truncate.state_lock, 0);
+	ns->truncate.set_id = INVALID_SET_ID;
+	ns->truncate.restart_set_id = INVALID_SET_ID;
 }
 
 
@@ -420,6 +423,8 @@ void
 truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut)
 {
 	uint64_t now = cf_clepoch_milliseconds();
+	// Truncating a listed set needn't walk the whole namespace.
+	uint16_t set_id = INVALID_SET_ID;
 
 	if (lut > now + WARN_CLOCK_SKEW_MS) {
 		cf_warning(AS_TRUNCATE, "lut is %lu ms in the future - clock skew?",
@@ -445,6 +450,12 @@ truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut)
 				lut);
 
 		p_set->truncate_lut = lut;
+
+		uint16_t id = as_namespace_get_set_id(ns, set_name);
+
+		if (as_index_set_is_listed(&ns->tree_shared, id)) {
+			set_id = id;
+		}
 	}
 	else {
 		if (lut <= ns->truncate.lut) {
@@ -465,14 +476,20 @@ truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut)
 	switch (ns->truncate.state) {
 	case TRUNCATE_IDLE:
 		cf_info(AS_TRUNCATE, "{%s} starting truncate", ns->name);
-		truncate_all(ns);
+		truncate_all(ns, set_id);
 		break;
 	case TRUNCATE_RUNNING:
 		cf_info(AS_TRUNCATE, "{%s} flagging truncate to restart", ns->name);
 		ns->truncate.state = TRUNCATE_RESTART;
+		ns->truncate.restart_set_id = set_id;
 		break;
 	case TRUNCATE_RESTART:
 		cf_info(AS_TRUNCATE, "{%s} truncate already will restart", ns->name);
+
+		// Restart for more than one set walks the whole namespace.
+		if (ns->truncate.restart_set_id != set_id) {
+			ns->truncate.restart_set_id = INVALID_SET_ID;
+		}
 		break;
 	default:
 		cf_crash(AS_TRUNCATE, "bad truncate state %d", ns->truncate.state);
@@ -511,12 +528,13 @@ truncate_action_undo(as_namespace* ns, const char* set_name)
 
 // Called under truncate lock.
 void
-truncate_all(as_namespace* ns)
+truncate_all(as_namespace* ns, uint16_t set_id)
 {
 	// TODO - skipping sindex deletion shortcut - can't do that if we want to
 	// keep writing through set truncates. Is this ok?
 
 	ns->truncate.state = TRUNCATE_RUNNING;
+	ns->truncate.set_id = set_id;
 	cf_atomic32_set(&ns->truncate.n_threads_running, NUM_TRUNCATE_THREADS);
 	cf_atomic32_set(&ns->truncate.pid, -1);
 
@@ -550,10 +568,16 @@ run_truncate(void* arg)
 
 		truncate_reduce_cb_info cb_info = { .ns = ns, .tree = rsv.tree };
 
-		as_index_reduce(rsv.tree, truncate_reduce_cb, (void*)&cb_info);
+		if (! as_index_reduce_set(rsv.tree, ns->truncate.set_id,
+				truncate_reduce_cb, (void*)&cb_info)) {
+			as_index_reduce(rsv.tree, truncate_reduce_cb, (void*)&cb_info);
+		}
+
 		as_partition_release(&rsv);
 
 		cf_atomic64_add(&ns->truncate.n_records_this_run, cb_info.n_deleted);
+
+		truncate_throttle(ns, cb_info.n_deleted);
 	}
 
 	truncate_finish(ns);
@@ -580,7 +604,7 @@ truncate_finish(as_namespace* ns)
 			break;
 		case TRUNCATE_RESTART:
 			cf_info(AS_TRUNCATE, "{%s} restarting truncate", ns->name);
-			truncate_all(ns);
+			truncate_all(ns, ns->truncate.restart_set_id);
 			break;
 		case TRUNCATE_IDLE:
 		default:
@@ -619,3 +643,24 @@ truncate_reduce_cb(as_index_ref* r_ref, void* udata)
 
 	as_record_done(r_ref, ns);
 }
+
+
+// Pace background deletion so a big truncate doesn't swamp the device with
+// frees and defrag - we sleep off each partition's deletes once it's done.
+void
+truncate_throttle(as_namespace* ns, int64_t n_deleted)
+{
+	uint32_t sleep_per_delete = ns->truncate_delete_sleep;
+
+	if (sleep_per_delete == 0 || n_deleted <= 0) {
+		return;
+	}
+
+	uint64_t sleep_us = (uint64_t)n_deleted * sleep_per_delete;
+	struct timespec delay = {
+			.tv_sec = (time_t)(sleep_us / 1000000),
+			.tv_nsec = (long)((sleep_us % 1000000) * 1000)
+	};
+
+	nanosleep(&delay, NULL);
+}
@@ -765,6 +765,8 @@ udf_aerospike_rec_create(const as_aerospike * as, const as_rec * rec)
 			return 4;
 		}
 
+		as_index_set_list_add(tree, r_ref);
+
 		// Don't write record if it would be truncated.
 		if (as_truncate_now_is_truncated(tr->rsv.ns, as_index_get_set_id(r_ref->r))) {
 			as_index_delete(tree, &tr->keyd);
@@ -0,0 +1,98 @@
+/*
+ * udf_native.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+#include "base/udf_native.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fault.h"
+
+#include "transaction/udf.h"
+
+
+/*****************************************************************************
+ * GLOBALS
+ *****************************************************************************/
+
+#define MAX_NATIVE_UDFS 64
+
+typedef struct udf_native_s {
+	char          module[UDF_MAX_STRING_SZ];
+	char          function[UDF_MAX_STRING_SZ];
+	udf_native_fn fn;
+} udf_native;
+
+static udf_native g_natives[MAX_NATIVE_UDFS];
+static uint32_t   g_n_natives = 0;
+
+
+/*****************************************************************************
+ * FUNCTIONS
+ *****************************************************************************/
+
+bool
+udf_native_register(const char *module, const char *function, udf_native_fn fn)
+{
+	if (strlen(module) >= UDF_MAX_STRING_SZ ||
+			strlen(function) >= UDF_MAX_STRING_SZ) {
+		cf_warning(AS_UDF, "native UDF %s.%s name too long", module, function);
+		return false;
+	}
+
+	if (udf_native_get(module, function)) {
+		cf_warning(AS_UDF, "native UDF %s.%s already registered", module, function);
+		return false;
+	}
+
+	if (g_n_natives == MAX_NATIVE_UDFS) {
+		cf_warning(AS_UDF, "can't register native UDF %s.%s - limit %d", module, function, MAX_NATIVE_UDFS);
+		return false;
+	}
+
+	udf_native *native = &g_natives[g_n_natives++];
+
+	strcpy(native->module, module);
+	strcpy(native->function, function);
+	native->fn = fn;
+
+	cf_info(AS_UDF, "native UDF %s.%s registered", module, function);
+
+	return true;
+}
+
+udf_native_fn
+udf_native_get(const char *module, const char *function)
+{
+	for (uint32_t i = 0; i < g_n_natives; i++) {
+		udf_native *native = &g_natives[i];
+
+		if (strcmp(native->module, module) == 0 &&
+				strcmp(native->function, function) == 0) {
+			return native->fn;
+		}
+	}
+
+	return NULL;
+}
@@ -473,6 +473,9 @@ udf_record_cache_set(udf_record * urecord, const char * name, as_val * value,
  * 		    lua ... lua has responsibility of garbage collecting it.
  * 		    Hence this function call incurs and malloc cost.
  *
+ * 		    Map bins are wrapped rather than unpacked - elements are
+ * 		    unpacked as the UDF looks them up.
+ *
  * Callers:
  * 		udf_record_get
  */
@@ -490,6 +493,10 @@ udf_record_storage_get(const udf_record *urecord, const char *name)
 		return NULL;
 	}
 
+	if (as_bin_get_particle_type(bb) == AS_PARTICLE_TYPE_MAP) {
+		return as_bin_particle_map_to_lazy_asval(bb);
+	}
+
 	return as_bin_particle_to_asval(bb);
 }
 
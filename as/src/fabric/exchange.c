@@ -32,6 +32,7 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_queue.h"
 
+#include "compression.h"
 #include "dynbuf.h"
 #include "fault.h"
 #include "shash.h"
@@ -84,9 +85,14 @@
  */
 
 /**
- * Exchange protocol version information.
+ * Exchange protocol version information. Builds with a non-default partition
+ * count use a distinct identifier, so they never exchange with default builds.
  */
+#if AS_PARTITION_BITS == 12
 #define AS_EXCHANGE_PROTOCOL_IDENTIFIER 1
+#else
+#define AS_EXCHANGE_PROTOCOL_IDENTIFIER (0x100 | AS_PARTITION_BITS)
+#endif
 
 /**
  * A soft limit for the maximum cluster size. Meant to be optimize hash and list
@@ -118,6 +124,18 @@
  */
 #define AS_EXCHANGE_TRANSACTION_BLOCK_ORPHAN_INTERVALS 5
 
+/**
+ * Features advertised in every exchange message. Older nodes don't send the
+ * features field, so they are only sent the original payload format.
+ */
+#define AS_EXCHANGE_FEATURE_COMPACT_VINFOS 0x1
+#define AS_EXCHANGE_FEATURE_LZ4 0x2
+
+/**
+ * Run vinfo index for partitions with a null vinfo, in the compact payload.
+ */
+#define AS_EXCHANGE_COMPACT_NULL_VINFO_IX UINT16_MAX
+
 /*
  * ----------------------------------------------------------------------------
  * Exchange data format for namespaces payload
@@ -161,6 +179,70 @@ typedef struct as_exchange_ns_vinfos_payload_s
 	as_exchange_vinfo_payload vinfos[];
 }__attribute__((__packed__)) as_exchange_ns_vinfos_payload;
 
+/*
+ * ----------------------------------------------------------------------------
+ * Compact exchange data format for namespaces payload
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * Consecutive partitions sharing a vinfo.
+ */
+typedef struct as_exchange_vinfo_run_s
+{
+	/**
+	 * Index of the vinfo in the payload, or AS_EXCHANGE_COMPACT_NULL_VINFO_IX.
+	 */
+	uint16_t vinfo_ix;
+
+	/**
+	 * Count of partitions in the run.
+	 */
+	uint16_t num_pids;
+}__attribute__((__packed__)) as_exchange_vinfo_run;
+
+/**
+ * Compact information exchanged for a single namespace. The raw data is the
+ * count of unique non null vinfos, the vinfos, the count of runs, and the runs
+ * - which cover all partitions in partition id order. Decoded on receipt into
+ * the as_exchange_ns_vinfos_payload format.
+ */
+typedef struct as_exchange_ns_compact_payload_s
+{
+	/**
+	 * Compression method for the raw data - a cf_compression_method.
+	 */
+	uint8_t method;
+
+	/**
+	 * Size of the raw data before compression.
+	 */
+	uint32_t raw_sz;
+
+	/**
+	 * The (compressed) raw data.
+	 */
+	uint8_t data[];
+}__attribute__((__packed__)) as_exchange_ns_compact_payload;
+
+/**
+ * Upper bound on the raw data size of a compact payload.
+ */
+#define AS_EXCHANGE_COMPACT_RAW_MAX_SIZE (2 * sizeof(uint32_t)				\
+		+ AS_PARTITIONS * (sizeof(as_partition_version)						\
+				+ sizeof(as_exchange_vinfo_run)))
+
+/**
+ * Payload formats self node sends, chosen per destination by its features.
+ */
+typedef enum
+{
+	AS_EXCHANGE_PAYLOAD_FORMAT_ORIGINAL,
+	AS_EXCHANGE_PAYLOAD_FORMAT_COMPACT,
+	AS_EXCHANGE_PAYLOAD_FORMAT_COMPACT_LZ4,
+	AS_EXCHANGE_NUM_PAYLOAD_FORMATS
+} as_exchange_payload_format;
+
 /**
  * Received data stored per node, per namespace, before actual commit.
  */
@@ -348,6 +430,12 @@ typedef struct as_exchange_node_state_s
 	 */
 	bool is_ready_to_commit;
 
+	/**
+	 * Features the peer advertised in its latest exchange message. Kept across
+	 * exchange rounds.
+	 */
+	uint32_t features;
+
 	/**
 	 * Exchange data received from this peer node. Member variables may be heap
 	 * allocated and hence should be freed carefully while discarding this
@@ -452,6 +540,22 @@ typedef struct as_exchange_s
 	 * This node's data payload for current round.
 	 */
 	cf_dyn_buf self_data_dyn_buf[AS_NAMESPACE_SZ];
+
+	/**
+	 * This node's compact data payload for current round, uncompressed.
+	 */
+	cf_dyn_buf self_compact_dyn_buf[AS_NAMESPACE_SZ];
+
+	/**
+	 * This node's compact data payload for current round, LZ4 compressed if
+	 * possible.
+	 */
+	cf_dyn_buf self_lz4_dyn_buf[AS_NAMESPACE_SZ];
+
+	/**
+	 * Indicates if the compact payloads could be encoded for this round.
+	 */
+	bool self_compact_valid;
 } as_exchange;
 
 /**
@@ -545,6 +649,8 @@ typedef enum
 	AS_EXCHANGE_MSG_NAMESPACES,
 	AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS,
 	AS_EXCHANGE_MSG_NS_RACK_IDS,
+	AS_EXCHANGE_MSG_FEATURES,
+	AS_EXCHANGE_MSG_NS_COMPACT_PARTITION_VERSIONS,
 
 	NUM_EXCHANGE_MSG_FIELDS
 } as_exchange_msg_fields;
@@ -558,7 +664,9 @@ static const msg_template exchange_msg_template[] = {
 		{ AS_EXCHANGE_MSG_CLUSTER_KEY, M_FT_UINT64 },
 		{ AS_EXCHANGE_MSG_NAMESPACES, M_FT_MSGPACK },
 		{ AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS, M_FT_MSGPACK },
-		{ AS_EXCHANGE_MSG_NS_RACK_IDS, M_FT_MSGPACK }
+		{ AS_EXCHANGE_MSG_NS_RACK_IDS, M_FT_MSGPACK },
+		{ AS_EXCHANGE_MSG_FEATURES, M_FT_UINT32 },
+		{ AS_EXCHANGE_MSG_NS_COMPACT_PARTITION_VERSIONS, M_FT_MSGPACK }
 };
 
 COMPILER_ASSERT(sizeof(exchange_msg_template) / sizeof(msg_template) ==
@@ -648,6 +756,12 @@ static pthread_mutex_t g_external_event_publisher_lock =
 		* ((AS_EXCHANGE_VINFO_NUM_PIDS_AVG * sizeof(uint16_t))						\
 				+ sizeof(as_partition_version)))
 
+/**
+ * Initial size of the (per-namespace) self compact payload dynamic buffers -
+ * grown on demand, for badly fragmented vinfos.
+ */
+#define AS_EXCHANGE_SELF_COMPACT_DYN_BUF_SIZE() (1024)
+
 /**
  * Scratch size for exchange messages.
  * TODO: Compute this properly.
@@ -1270,6 +1384,40 @@ exchange_node_state_get_safe(cf_node nodeid, as_exchange_node_state* node_state)
 	}
 }
 
+/**
+ * Get the features a node advertised, 0 if the node is unknown.
+ */
+static uint32_t
+exchange_node_features_get(cf_node nodeid)
+{
+	as_exchange_node_state node_state;
+
+	if (cf_shash_get(g_exchange.nodeid_to_node_state, &nodeid, &node_state)
+			!= CF_SHASH_OK) {
+		return 0;
+	}
+
+	return node_state.features;
+}
+
+/**
+ * Choose the payload format to send a node, given the features it advertised.
+ */
+static as_exchange_payload_format
+exchange_node_payload_format(cf_node nodeid)
+{
+	uint32_t features = exchange_node_features_get(nodeid);
+
+	if (!g_exchange.self_compact_valid
+			|| (features & AS_EXCHANGE_FEATURE_COMPACT_VINFOS) == 0) {
+		return AS_EXCHANGE_PAYLOAD_FORMAT_ORIGINAL;
+	}
+
+	return (features & AS_EXCHANGE_FEATURE_LZ4) != 0 ?
+			AS_EXCHANGE_PAYLOAD_FORMAT_COMPACT_LZ4 :
+			AS_EXCHANGE_PAYLOAD_FORMAT_COMPACT;
+}
+
 /*
  * ----------------------------------------------------------------------------
  * Message related
@@ -1282,10 +1430,17 @@ exchange_node_state_get_safe(cf_node nodeid, as_exchange_node_state* node_state)
 static void
 exchange_msg_src_fill(msg* msg, as_exchange_msg_type type)
 {
+	uint32_t features = AS_EXCHANGE_FEATURE_COMPACT_VINFOS;
+
+	if (cf_compression_is_available(CF_COMPRESSION_LZ4)) {
+		features |= AS_EXCHANGE_FEATURE_LZ4;
+	}
+
 	EXCHANGE_LOCK();
 	msg_set_uint32(msg, AS_EXCHANGE_MSG_ID, AS_EXCHANGE_PROTOCOL_IDENTIFIER);
 	msg_set_uint64(msg, AS_EXCHANGE_MSG_CLUSTER_KEY, g_exchange.cluster_key);
 	msg_set_uint32(msg, AS_EXCHANGE_MSG_TYPE, type);
+	msg_set_uint32(msg, AS_EXCHANGE_MSG_FEATURES, features);
 	EXCHANGE_UNLOCK();
 }
 
@@ -1347,10 +1502,10 @@ exchange_msg_cluster_key_get(msg* msg, as_cluster_key* cluster_key)
 }
 
 /**
- * Set data payload for a message.
+ * Set data payload, in the given format, for a message.
  */
 static void
-exchange_msg_data_payload_set(msg* msg)
+exchange_msg_data_payload_set(msg* msg, as_exchange_payload_format format)
 {
 	uint32_t ns_count = g_config.n_namespaces;
 
@@ -1368,9 +1523,16 @@ exchange_msg_data_payload_set(msg* msg)
 			.ptr = (uint8_t*)ns->name
 		};
 
+		cf_dyn_buf* pv_buf =
+				format == AS_EXCHANGE_PAYLOAD_FORMAT_COMPACT_LZ4 ?
+						&g_exchange.self_lz4_dyn_buf[ns_ix] :
+				format == AS_EXCHANGE_PAYLOAD_FORMAT_COMPACT ?
+						&g_exchange.self_compact_dyn_buf[ns_ix] :
+						&g_exchange.self_data_dyn_buf[ns_ix];
+
 		msg_buf_ele pv_ele = {
-			.sz = (uint32_t)g_exchange.self_data_dyn_buf[ns_ix].used_sz,
-			.ptr = g_exchange.self_data_dyn_buf[ns_ix].buf
+			.sz = (uint32_t)pv_buf->used_sz,
+			.ptr = pv_buf->buf
 		};
 
 		cf_vector_append(&namespace_list, &ns_ele);
@@ -1379,7 +1541,10 @@ exchange_msg_data_payload_set(msg* msg)
 	}
 
 	msg_msgpack_list_set_buf(msg, AS_EXCHANGE_MSG_NAMESPACES, &namespace_list);
-	msg_msgpack_list_set_buf(msg, AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS,
+	msg_msgpack_list_set_buf(msg,
+			format == AS_EXCHANGE_PAYLOAD_FORMAT_ORIGINAL ?
+					AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS :
+					AS_EXCHANGE_MSG_NS_COMPACT_PARTITION_VERSIONS,
 			&partition_versions);
 	msg_msgpack_list_set_uint32(msg, AS_EXCHANGE_MSG_NS_RACK_IDS, rack_ids,
 			ns_count);
@@ -1387,6 +1552,30 @@ exchange_msg_data_payload_set(msg* msg)
 	pthread_mutex_unlock(&g_exchanged_info_lock);
 }
 
+/**
+ * Remember the features a node advertised in a message. Messages from older
+ * nodes have no features field - they're recorded as having no features, so a
+ * node that restarts on an older build is sent the original payload format.
+ */
+static void
+exchange_msg_features_record(cf_node source, msg* msg)
+{
+	uint32_t features = 0;
+	msg_get_uint32(msg, AS_EXCHANGE_MSG_FEATURES, &features);
+
+	EXCHANGE_LOCK();
+
+	as_exchange_node_state node_state;
+
+	if (cf_shash_get(g_exchange.nodeid_to_node_state, &source, &node_state)
+			== CF_SHASH_OK && node_state.features != features) {
+		node_state.features = features;
+		exchange_node_state_update(source, &node_state);
+	}
+
+	EXCHANGE_UNLOCK();
+}
+
 /**
  * Check sanity of an incoming message. If this check passes the message is
  * guaranteed to have valid protocol identifier, valid type and valid matching
@@ -1435,6 +1624,8 @@ exchange_msg_is_sane(cf_node source, msg* msg)
 		return false;
 	}
 
+	exchange_msg_features_record(source, msg);
+
 	return true;
 }
 
@@ -1543,15 +1734,33 @@ exchange_data_msg_send_pending_ack()
 		goto Exit;
 	}
 
-	msg* data_msg = exchange_msg_get(AS_EXCHANGE_MSG_TYPE_DATA);
-	exchange_msg_data_payload_set(data_msg);
+	// Group the nodes by the payload format they can parse.
+	cf_node format_nodes[AS_EXCHANGE_NUM_PAYLOAD_FORMATS][num_unacked_nodes];
+	int num_format_nodes[AS_EXCHANGE_NUM_PAYLOAD_FORMATS] = { 0 };
 
-	as_clustering_log_cf_node_array(CF_DEBUG, AS_EXCHANGE,
-			"sending exchange data to nodes:", unacked_nodes,
-			num_unacked_nodes);
+	for (int i = 0; i < num_unacked_nodes; i++) {
+		as_exchange_payload_format format = exchange_node_payload_format(
+				unacked_nodes[i]);
+
+		format_nodes[format][num_format_nodes[format]++] = unacked_nodes[i];
+	}
 
-	exchange_msg_send_list(data_msg, unacked_nodes, num_unacked_nodes,
-			"error sending exchange data");
+	for (int format = 0; format < AS_EXCHANGE_NUM_PAYLOAD_FORMATS; format++) {
+		if (num_format_nodes[format] == 0) {
+			continue;
+		}
+
+		msg* data_msg = exchange_msg_get(AS_EXCHANGE_MSG_TYPE_DATA);
+		exchange_msg_data_payload_set(data_msg,
+				(as_exchange_payload_format)format);
+
+		as_clustering_log_cf_node_array(CF_DEBUG, AS_EXCHANGE,
+				"sending exchange data to nodes:", format_nodes[format],
+				num_format_nodes[format]);
+
+		exchange_msg_send_list(data_msg, format_nodes[format],
+				num_format_nodes[format], "error sending exchange data");
+	}
 Exit:
 	EXCHANGE_UNLOCK();
 }
@@ -1678,6 +1887,126 @@ exchange_data_namespace_payload_add(as_namespace* ns, cf_dyn_buf* dyn_buf)
 	cf_shash_destroy(ns_hash);
 }
 
+/**
+ * Append namespace payload, in as_exchange_ns_compact_payload format, for a
+ * namespace to the dynamic buffers - uncompressed to one, and LZ4 compressed
+ * (when available and smaller) to the other.
+ *
+ * @param ns the namespace.
+ * @param compact_buf the dynamic buffer for the uncompressed payload.
+ * @param lz4_buf the dynamic buffer for the LZ4 compressed payload.
+ * @return true if the namespace's vinfos could be encoded.
+ */
+static bool
+exchange_data_namespace_compact_payload_add(as_namespace* ns,
+		cf_dyn_buf* compact_buf, cf_dyn_buf* lz4_buf)
+{
+	// A hash from each unique non null vinfo to its index in the payload.
+	cf_shash* ns_hash = cf_shash_create(exchange_vinfo_shash,
+			sizeof(as_partition_version), sizeof(uint16_t),
+			AS_EXCHANGE_UNIQUE_VINFO_MAX_SIZE_SOFT, 0);
+
+	as_partition_version* vinfos = cf_malloc(
+			AS_PARTITIONS * sizeof(as_partition_version));
+	as_exchange_vinfo_run* runs = cf_malloc(
+			AS_PARTITIONS * sizeof(as_exchange_vinfo_run));
+	uint32_t num_vinfos = 0;
+	uint32_t num_runs = 0;
+	bool rv = true;
+
+	as_partition* partitions = ns->partitions;
+
+	// Partitions mostly share a few vinfos, in long runs of partition ids.
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		as_partition_version* current_vinfo = &partitions[pid].version;
+		uint16_t vinfo_ix = AS_EXCHANGE_COMPACT_NULL_VINFO_IX;
+
+		if (!as_partition_version_is_null(current_vinfo)
+				&& cf_shash_get(ns_hash, current_vinfo, &vinfo_ix)
+						!= CF_SHASH_OK) {
+			if (num_vinfos == AS_EXCHANGE_COMPACT_NULL_VINFO_IX) {
+				// Only possible with 64K partitions, all on distinct vinfos.
+				rv = false;
+				goto Exit;
+			}
+
+			vinfo_ix = (uint16_t)num_vinfos;
+			vinfos[num_vinfos++] = *current_vinfo;
+			cf_shash_put(ns_hash, current_vinfo, &vinfo_ix);
+		}
+
+		if (num_runs != 0 && runs[num_runs - 1].vinfo_ix == vinfo_ix
+				&& runs[num_runs - 1].num_pids != UINT16_MAX) {
+			runs[num_runs - 1].num_pids++;
+		}
+		else {
+			runs[num_runs].vinfo_ix = vinfo_ix;
+			runs[num_runs].num_pids = 1;
+			num_runs++;
+		}
+	}
+
+	DEBUG("namespace %s has %u unique vinfos in %u runs", ns->name,
+			num_vinfos, num_runs);
+
+	// Header first - filled in once the raw data is appended.
+	cf_dyn_buf_reserve(compact_buf, sizeof(as_exchange_ns_compact_payload),
+			NULL);
+
+	cf_dyn_buf_append_buf(compact_buf, (uint8_t*)&num_vinfos,
+			sizeof(num_vinfos));
+	cf_dyn_buf_append_buf(compact_buf, (uint8_t*)vinfos,
+			num_vinfos * sizeof(as_partition_version));
+	cf_dyn_buf_append_buf(compact_buf, (uint8_t*)&num_runs, sizeof(num_runs));
+	cf_dyn_buf_append_buf(compact_buf, (uint8_t*)runs,
+			num_runs * sizeof(as_exchange_vinfo_run));
+
+	as_exchange_ns_compact_payload* compact =
+			(as_exchange_ns_compact_payload*)compact_buf->buf;
+	uint32_t raw_sz = (uint32_t)(compact_buf->used_sz
+			- sizeof(as_exchange_ns_compact_payload));
+
+	compact->method = CF_COMPRESSION_NONE;
+	compact->raw_sz = raw_sz;
+
+	size_t lz4_sz = 0;
+
+	if (cf_compression_is_available(CF_COMPRESSION_LZ4)) {
+		uint8_t* lz4_ptr;
+
+		cf_dyn_buf_reserve(lz4_buf, sizeof(as_exchange_ns_compact_payload)
+				+ raw_sz, &lz4_ptr);
+
+		// Zero if the compressed data wouldn't be smaller.
+		lz4_sz = cf_compress(CF_COMPRESSION_LZ4, 0, NULL, compact->data,
+				raw_sz, lz4_ptr + sizeof(as_exchange_ns_compact_payload),
+				raw_sz);
+
+		if (lz4_sz != 0) {
+			as_exchange_ns_compact_payload* lz4 =
+					(as_exchange_ns_compact_payload*)lz4_ptr;
+
+			lz4->method = CF_COMPRESSION_LZ4;
+			lz4->raw_sz = raw_sz;
+			lz4_buf->used_sz = sizeof(as_exchange_ns_compact_payload) + lz4_sz;
+		}
+		else {
+			lz4_buf->used_sz = 0;
+		}
+	}
+
+	if (lz4_sz == 0) {
+		cf_dyn_buf_append_buf(lz4_buf, compact_buf->buf, compact_buf->used_sz);
+	}
+
+Exit:
+	cf_free(runs);
+	cf_free(vinfos);
+	cf_shash_destroy(ns_hash);
+
+	return rv;
+}
+
 /**
  * Prepare the exchanged data payloads.
  */
@@ -1690,19 +2019,44 @@ exchange_data_payloads_prepare()
 	as_partition_balance_disallow_migrations();
 	as_partition_balance_synchronize_migrations();
 
+	g_exchange.self_compact_valid = true;
+
 	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
 		// Append payload for each namespace.
 
 		// TODO - add API to reset dynbuf?
 		g_exchange.self_data_dyn_buf[ns_ix].used_sz = 0;
+		g_exchange.self_compact_dyn_buf[ns_ix].used_sz = 0;
+		g_exchange.self_lz4_dyn_buf[ns_ix].used_sz = 0;
 
 		exchange_data_namespace_payload_add(g_config.namespaces[ns_ix],
 				&g_exchange.self_data_dyn_buf[ns_ix]);
+
+		if (g_exchange.self_compact_valid
+				&& !exchange_data_namespace_compact_payload_add(
+						g_config.namespaces[ns_ix],
+						&g_exchange.self_compact_dyn_buf[ns_ix],
+						&g_exchange.self_lz4_dyn_buf[ns_ix])) {
+			// All nodes get the original format this round.
+			g_exchange.self_compact_valid = false;
+		}
 	}
 
 	EXCHANGE_UNLOCK();
 }
 
+/**
+ * The field carrying partition versions in an incoming data message - the
+ * compact field if the sender used it, else the original one.
+ */
+static as_exchange_msg_fields
+exchange_data_msg_partition_versions_field(msg* msg)
+{
+	return msg_is_set(msg, AS_EXCHANGE_MSG_NS_COMPACT_PARTITION_VERSIONS) ?
+			AS_EXCHANGE_MSG_NS_COMPACT_PARTITION_VERSIONS :
+			AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS;
+}
+
 /**
  * Indicates if the per-namespace fields in an incoming data message are valid.
  *
@@ -1723,7 +2077,8 @@ exchange_data_msg_get_num_namespaces(as_exchange_event* msg_event)
 	}
 
 	if (!msg_msgpack_container_get_count(msg_event->msg,
-			AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS, &num_namespace_elements_sent)
+			exchange_data_msg_partition_versions_field(msg_event->msg),
+			&num_namespace_elements_sent)
 			|| num_namespaces_sent != num_namespace_elements_sent) {
 		WARNING("received invalid partition versions from node %"PRIx64,
 				msg_event->msg_source);
@@ -1808,6 +2163,181 @@ exchange_namespace_payload_is_valid(as_exchange_ns_vinfos_payload* ns_payload,
 	return true;
 }
 
+/**
+ * Decode an incoming namespace payload in as_exchange_ns_compact_payload
+ * format into as_exchange_ns_vinfos_payload format. Validates the header, the
+ * vinfo indexes and that the runs cover exactly AS_PARTITIONS partitions.
+ *
+ * @param buf the compact payload.
+ * @param buf_sz the size of the compact payload.
+ * @param ns_payload in/out pointer to the (re)allocated decoded payload.
+ * @return the size of the decoded payload, 0 if the payload is invalid.
+ */
+static uint32_t
+exchange_namespace_compact_payload_decode(const uint8_t* buf, uint32_t buf_sz,
+		as_exchange_ns_vinfos_payload** ns_payload)
+{
+	if (buf_sz < sizeof(as_exchange_ns_compact_payload)) {
+		return 0;
+	}
+
+	const as_exchange_ns_compact_payload* compact =
+			(const as_exchange_ns_compact_payload*)buf;
+	uint32_t raw_sz = compact->raw_sz;
+	uint32_t data_sz = buf_sz - (uint32_t)sizeof(as_exchange_ns_compact_payload);
+
+	if (raw_sz < 2 * sizeof(uint32_t)
+			|| raw_sz > AS_EXCHANGE_COMPACT_RAW_MAX_SIZE) {
+		return 0;
+	}
+
+	uint8_t* raw = NULL;
+	const uint8_t* data;
+
+	switch (compact->method) {
+	case CF_COMPRESSION_NONE:
+		if (data_sz != raw_sz) {
+			return 0;
+		}
+
+		data = compact->data;
+		break;
+	case CF_COMPRESSION_LZ4:
+		raw = cf_malloc(raw_sz);
+
+		if (!cf_decompress(CF_COMPRESSION_LZ4, NULL, compact->data, data_sz,
+				raw, raw_sz)) {
+			cf_free(raw);
+			return 0;
+		}
+
+		data = raw;
+		break;
+	default:
+		return 0;
+	}
+
+	uint32_t rv = 0;
+	const uint8_t* end = data + raw_sz;
+	uint32_t num_vinfos;
+
+	memcpy(&num_vinfos, data, sizeof(num_vinfos));
+
+	if (num_vinfos > AS_PARTITIONS) {
+		goto Exit;
+	}
+
+	const uint8_t* vinfos = data + sizeof(num_vinfos);
+	const uint8_t* runs_start = vinfos
+			+ num_vinfos * sizeof(as_partition_version);
+
+	if (runs_start + sizeof(uint32_t) > end) {
+		goto Exit;
+	}
+
+	uint32_t num_runs;
+
+	memcpy(&num_runs, runs_start, sizeof(num_runs));
+
+	const uint8_t* runs = runs_start + sizeof(num_runs);
+
+	if (num_runs > AS_PARTITIONS
+			|| runs + num_runs * sizeof(as_exchange_vinfo_run) != end) {
+		goto Exit;
+	}
+
+	// Count partitions per vinfo, checking the runs cover every partition.
+	uint32_t vinfo_num_pids[num_vinfos + 1];
+	uint32_t total_pids = 0;
+
+	memset(vinfo_num_pids, 0, sizeof(vinfo_num_pids));
+
+	for (uint32_t i = 0; i < num_runs; i++) {
+		as_exchange_vinfo_run run;
+
+		memcpy(&run, runs + i * sizeof(run), sizeof(run));
+
+		if (run.vinfo_ix != AS_EXCHANGE_COMPACT_NULL_VINFO_IX
+				&& run.vinfo_ix >= num_vinfos) {
+			goto Exit;
+		}
+
+		total_pids += run.num_pids;
+
+		if (total_pids > AS_PARTITIONS) {
+			goto Exit;
+		}
+
+		if (run.vinfo_ix != AS_EXCHANGE_COMPACT_NULL_VINFO_IX) {
+			vinfo_num_pids[run.vinfo_ix] += run.num_pids;
+		}
+	}
+
+	if (total_pids != AS_PARTITIONS) {
+		goto Exit;
+	}
+
+	// Lay out the vinfo entries, as the original format would have them.
+	uint32_t vinfo_offsets[num_vinfos + 1];
+	uint32_t decoded_sz = sizeof(as_exchange_ns_vinfos_payload);
+
+	for (uint32_t i = 0; i < num_vinfos; i++) {
+		vinfo_offsets[i] = decoded_sz;
+		decoded_sz += sizeof(as_exchange_vinfo_payload)
+				+ vinfo_num_pids[i] * sizeof(uint16_t);
+	}
+
+	uint8_t* decoded = cf_realloc(*ns_payload, decoded_sz);
+
+	*ns_payload = (as_exchange_ns_vinfos_payload*)decoded;
+	(*ns_payload)->num_vinfos = num_vinfos;
+
+	for (uint32_t i = 0; i < num_vinfos; i++) {
+		uint8_t* entry = decoded + vinfo_offsets[i];
+
+		memcpy(entry + offsetof(as_exchange_vinfo_payload, vinfo),
+				vinfos + i * sizeof(as_partition_version),
+				sizeof(as_partition_version));
+		memcpy(entry + offsetof(as_exchange_vinfo_payload, num_pids),
+				&vinfo_num_pids[i], sizeof(uint32_t));
+
+		// Reuse the count as the fill position for pids below.
+		vinfo_num_pids[i] = 0;
+	}
+
+	uint16_t pid = 0;
+
+	for (uint32_t i = 0; i < num_runs; i++) {
+		as_exchange_vinfo_run run;
+
+		memcpy(&run, runs + i * sizeof(run), sizeof(run));
+
+		if (run.vinfo_ix == AS_EXCHANGE_COMPACT_NULL_VINFO_IX) {
+			pid += run.num_pids;
+			continue;
+		}
+
+		uint8_t* pids = decoded + vinfo_offsets[run.vinfo_ix]
+				+ offsetof(as_exchange_vinfo_payload, pids)
+				+ vinfo_num_pids[run.vinfo_ix] * sizeof(uint16_t);
+
+		for (uint16_t j = 0; j < run.num_pids; j++, pid++) {
+			memcpy(pids + j * sizeof(uint16_t), &pid, sizeof(uint16_t));
+		}
+
+		vinfo_num_pids[run.vinfo_ix] += run.num_pids;
+	}
+
+	rv = decoded_sz;
+
+Exit:
+	if (raw) {
+		cf_free(raw);
+	}
+
+	return rv;
+}
+
 /*
  * ----------------------------------------------------------------------------
  * Common across all states
@@ -2233,8 +2763,11 @@ exchange_exchanging_data_msg_handle(as_exchange_event* msg_event)
 			goto Exit;
 		}
 
+		as_exchange_msg_fields partition_versions_field =
+				exchange_data_msg_partition_versions_field(msg_event->msg);
+
 		if (!msg_msgpack_list_get_buf_array_presized(msg_event->msg,
-				AS_EXCHANGE_MSG_NS_PARTITION_VERSIONS, &partition_versions)) {
+				partition_versions_field, &partition_versions)) {
 			WARNING("received invalid partition versions from node %"PRIx64,
 					msg_event->msg_source);
 			goto Exit;
@@ -2272,6 +2805,24 @@ exchange_exchanging_data_msg_handle(as_exchange_event* msg_event)
 			msg_buf_ele* partition_versions_element = cf_vector_getp(
 					&partition_versions, i);
 
+			if (partition_versions_field
+					== AS_EXCHANGE_MSG_NS_COMPACT_PARTITION_VERSIONS) {
+				uint32_t decoded_sz = exchange_namespace_compact_payload_decode(
+						partition_versions_element->ptr,
+						partition_versions_element->sz,
+						&namespace_data->partition_versions);
+
+				if (decoded_sz == 0 || !exchange_namespace_payload_is_valid(
+						namespace_data->partition_versions, decoded_sz)) {
+					WARNING(
+							"received invalid compact partition versions for namespace %s from node %"PRIx64,
+							matching_namespace->name, msg_event->msg_source);
+					goto Exit;
+				}
+
+				continue;
+			}
+
 			if (!exchange_namespace_payload_is_valid(
 					(as_exchange_ns_vinfos_payload*)partition_versions_element->ptr,
 					partition_versions_element->sz)) {
@@ -2867,6 +3418,10 @@ exchange_init()
 	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
 		cf_dyn_buf_init_heap(&g_exchange.self_data_dyn_buf[ns_ix],
 			AS_EXCHANGE_SELF_DYN_BUF_SIZE());
+		cf_dyn_buf_init_heap(&g_exchange.self_compact_dyn_buf[ns_ix],
+			AS_EXCHANGE_SELF_COMPACT_DYN_BUF_SIZE());
+		cf_dyn_buf_init_heap(&g_exchange.self_lz4_dyn_buf[ns_ix],
+			AS_EXCHANGE_SELF_COMPACT_DYN_BUF_SIZE());
 	}
 
 	// Initialize external event publishing.
@@ -68,6 +68,7 @@
 #include "citrusleaf/cf_rchash.h"
 
 #include "fault.h"
+#include "hardware.h"
 #include "msg.h"
 #include "node.h"
 #include "shash.h"
@@ -85,6 +86,10 @@
 //
 
 #define FABRIC_BUFFER_MEM_SZ		(1024 * 1024) // bytes
+#define FABRIC_SEND_PACK_SZ			(64 * 1024) // bytes
+#define FABRIC_SEND_PACK_MAX		64 // msgs
+#define FABRIC_SEND_IOV_MAX			16 // pieces of a big msg
+#define FABRIC_SEND_BULK_BURST		16 // msgs per writable event
 #define FABRIC_EPOLL_SEND_EVENTS	16
 #define FABRIC_EPOLL_RECV_EVENTS	1
 
@@ -131,10 +136,24 @@ typedef struct send_entry_s {
 	cf_poll poll;
 } send_entry;
 
+// A msg parsed by a recv thread, queued for its type's dispatch thread. The
+// msg's fields point into buf.
+typedef struct fabric_dispatch_ele_s {
+	cf_node		node;
+	msg			*m;
+	uint8_t		*buf;
+	uint64_t	benchmark_time;
+	uint32_t	ch;
+} fabric_dispatch_ele;
+
 typedef struct fabric_state_s {
 	as_fabric_msg_fn	msg_cb[M_TYPE_MAX];
 	void 				*msg_udata[M_TYPE_MAX];
 
+	// Ctrl and meta channel msgs are handed to one thread per type, so a slow
+	// handler of one type doesn't hold up the others.
+	cf_queue			*dispatch_q[M_TYPE_MAX];
+
 	cf_queue			msg_pool_queue[M_TYPE_MAX]; // a pool of reusable msgs
 	cf_vector			fb_free;
 
@@ -186,6 +205,20 @@ typedef struct fabric_connection_s {
 	msg				*s_msg_in_progress;
 	size_t			s_count;
 
+	// Small msgs queued behind s_msg_in_progress are packed into s_buf with
+	// it, and sent together. If s_n_packed != 0, s_packed[0] is
+	// s_msg_in_progress.
+	msg				*s_packed[FABRIC_SEND_PACK_MAX];
+	uint32_t		s_packed_end[FABRIC_SEND_PACK_MAX]; // offsets in s_buf
+	uint32_t		s_n_packed;
+
+	// Big msgs are sent in gather form - s_buf holds all but their big buffer
+	// fields, which are sent straight from the msg. If s_n_iov != 0,
+	// s_iov[s_iov_ix] onward is left to send.
+	struct iovec	s_iov[FABRIC_SEND_IOV_MAX];
+	uint32_t		s_n_iov;
+	uint32_t		s_iov_ix;
+
 	fabric_buffer	*r_buf_in_progress;
 	uint32_t		r_msg_size;
 	msg_type		r_type;
@@ -287,13 +320,18 @@ static void fabric_connection_disconnect(fabric_connection *fc);
 static void fabric_connection_set_keepalive_options(fabric_connection *fc);
 
 static void fabric_connection_reroute_msg(fabric_connection *fc);
-static void fabric_connection_send_progress(fabric_connection *fc, bool is_last);
+static void fabric_connection_send_pack(fabric_connection *fc, msg **pending);
+inline static bool fabric_connection_packed_sent(const fabric_connection *fc, uint32_t i);
+static bool fabric_connection_send_iov_init(fabric_connection *fc, size_t wire_sz);
+static void fabric_connection_send_iov_progress(fabric_connection *fc, msg **pending);
+static void fabric_connection_send_progress(fabric_connection *fc, msg **pending);
 static bool fabric_connection_process_writable(fabric_connection *fc);
 
 static bool fabric_connection_process_fabric_msg(fabric_connection *fc, const msg *m);
 static bool fabric_connection_read_fabric_msg(fabric_connection *fc);
 
 static bool fabric_connection_process_msg(fabric_connection *fc, bool do_rearm);
+inline static bool fabric_connection_should_dispatch(const fabric_connection *fc);
 static bool fabric_connection_process_readable(fabric_connection *fc);
 
 // fabric_recv_thread_pool
@@ -309,7 +347,9 @@ static bool fabric_connect_endpoint_filter(const as_endpoint *endpoint, void *ud
 static void *run_fabric_recv(void *arg);
 static void run_fabric_recv_cleanup(void *arg);
 static void *run_fabric_send(void *arg);
+static void fabric_send_events_prioritize(cf_poll_event *events, int32_t n);
 static void *run_fabric_accept(void *arg);
+static void *run_fabric_dispatch(void *arg);
 
 // Ticker helpers.
 static int fabric_rate_node_reduce_fn(const void *key, uint32_t keylen, void *data, void *udata);
@@ -488,6 +528,21 @@ as_fabric_start()
 
 	g_fabric.sends[g_config.n_fabric_send_threads - 1].next = NULL;
 
+	// All msg types are registered by now.
+	for (uint32_t type = 0; type < M_TYPE_MAX; type++) {
+		if (! g_fabric.msg_cb[type]) {
+			continue;
+		}
+
+		g_fabric.dispatch_q[type] = cf_queue_create(sizeof(fabric_dispatch_ele),
+				true);
+
+		if (pthread_create(&thread, &attrs, run_fabric_dispatch,
+				(void *)(uint64_t)type) != 0) {
+			cf_crash(AS_FABRIC, "could not create fabric dispatch thread");
+		}
+	}
+
 	for (uint32_t i = 0; i < AS_FABRIC_N_CHANNELS; i++) {
 		cf_info(AS_FABRIC, "starting %u fabric %s channel recv threads", g_config.n_fabric_channel_recv_threads[i], CHANNEL_NAMES[i]);
 
@@ -1444,6 +1499,23 @@ fabric_connection_release(fabric_connection *fc)
 	int cnt = cf_rc_release(fc);
 
 	if (cnt == 0) {
+		// Requeue packed msgs that didn't make it out - never packed if the
+		// initial M_TYPE_FABRIC message is in progress.
+		for (uint32_t i = 0; i < fc->s_n_packed; i++) {
+			if (fabric_connection_packed_sent(fc, i)) {
+				as_fabric_msg_put(fc->s_packed[i]);
+			}
+			else {
+				cf_queue_push(&fc->node->send_queue[fc->pool->pool_id],
+						&fc->s_packed[i]);
+			}
+		}
+
+		if (fc->s_n_packed != 0) {
+			fc->s_n_packed = 0;
+			fc->s_msg_in_progress = NULL;
+		}
+
 		if (fc->s_msg_in_progress) {
 			// First message (s_count == 0) is initial M_TYPE_FABRIC message
 			// and does not need to be saved.
@@ -1645,6 +1717,20 @@ fabric_connection_reroute_msg(fabric_connection *fc)
 		return;
 	}
 
+	if (fc->s_n_packed != 0) {
+		for (uint32_t i = 0; i < fc->s_n_packed; i++) {
+			if (fabric_connection_packed_sent(fc, i) ||
+					fabric_node_send(fc->node, fc->s_packed[i],
+							fc->pool->pool_id) != AS_FABRIC_SUCCESS) {
+				as_fabric_msg_put(fc->s_packed[i]);
+			}
+		}
+
+		fc->s_n_packed = 0;
+		fc->s_msg_in_progress = NULL;
+		return;
+	}
+
 	// Don't reroute initial M_TYPE_FABRIC message.
 	if ((fc->started_via_connect && fc->s_count == 0) ||
 			fabric_node_send(fc->node, fc->s_msg_in_progress,
@@ -1653,11 +1739,155 @@ fabric_connection_reroute_msg(fabric_connection *fc)
 	}
 
 	fc->s_msg_in_progress = NULL;
+	fc->s_n_iov = 0;
+}
+
+// Pack queued msgs behind the one in progress, until the pack is full or the
+// send queue is empty. Saves a send() per small msg, e.g. replica writes.
+static void
+fabric_connection_send_pack(fabric_connection *fc, msg **pending)
+{
+	fabric_buffer *fb = &fc->s_buf;
+	size_t first_sz = fb->end - fb->buf;
+
+	if (! *pending || first_sz > FABRIC_SEND_PACK_SZ ||
+			(fc->started_via_connect && fc->s_count == 0)) {
+		return;
+	}
+
+	fabric_node *node = fc->node;
+	uint32_t pool = fc->pool->pool_id;
+
+	fc->s_packed[0] = fc->s_msg_in_progress;
+	fc->s_packed_end[0] = (uint32_t)first_sz;
+	fc->s_n_packed = 1;
+
+	while (*pending && fc->s_n_packed < FABRIC_SEND_PACK_MAX) {
+		msg *m = *pending;
+		size_t sz = msg_get_wire_size(m);
+
+		if ((size_t)(fb->end - fb->buf) + sz > FABRIC_SEND_PACK_SZ) {
+			break;
+		}
+
+		msg_to_wire(m, (uint8_t *)fb->end);
+		fb->end += sz;
+
+		if (m->benchmark_time != 0) {
+			m->benchmark_time = histogram_insert_data_point(
+					g_stats.fabric_send_init_hists[pool], m->benchmark_time);
+		}
+
+		fc->s_packed[fc->s_n_packed] = m;
+		fc->s_packed_end[fc->s_n_packed] = (uint32_t)(fb->end - fb->buf);
+		fc->s_n_packed++;
+
+		*pending = NULL;
+		cf_queue_pop(&node->send_queue[pool], pending, CF_QUEUE_NOWAIT);
+	}
+
+	if (fc->s_n_packed == 1) {
+		fc->s_n_packed = 0;
+	}
+}
+
+inline static bool
+fabric_connection_packed_sent(const fabric_connection *fc, uint32_t i)
+{
+	return fc->s_buf.buf &&
+			(uint32_t)(fc->s_buf.progress - fc->s_buf.buf) >=
+					fc->s_packed_end[i];
+}
+
+// Set up gather form for a msg too big for s_buf's own memory, unless even the
+// part to copy doesn't fit. Saves allocating and copying in the whole msg.
+static bool
+fabric_connection_send_iov_init(fabric_connection *fc, size_t wire_sz)
+{
+	msg *m = fc->s_msg_in_progress;
+
+	if (wire_sz <= FABRIC_BUFFER_MEM_SZ ||
+			msg_get_wire_iov_copy_size(m, FABRIC_SEND_IOV_MAX) >
+					FABRIC_BUFFER_MEM_SZ) {
+		return false;
+	}
+
+	fabric_buffer *fb = &fc->s_buf;
+
+	fc->s_n_iov = FABRIC_SEND_IOV_MAX;
+
+	fb->buf = fb->membuf;
+	fb->end = fb->buf + msg_to_wire_iov(m, fb->buf, fc->s_iov, &fc->s_n_iov);
+	fb->progress = fb->buf;
+
+	fc->s_iov_ix = 0;
+
+	return true;
 }
 
 static void
-fabric_connection_send_progress(fabric_connection *fc, bool is_last)
+fabric_connection_send_iov_progress(fabric_connection *fc, msg **pending)
 {
+	int32_t flags = MSG_NOSIGNAL | (*pending ? MSG_MORE : 0);
+	int32_t send_sz = cf_socket_send_iov(&fc->sock, &fc->s_iov[fc->s_iov_ix],
+			fc->s_n_iov - fc->s_iov_ix, flags);
+
+	if (send_sz < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			fc->failed = true;
+			cf_socket_write_shutdown(&fc->sock);
+			return;
+		}
+
+		send_sz = 0; // treat as sending 0
+	}
+
+	if (fc->s_msg_in_progress->benchmark_time != 0) {
+		fc->s_msg_in_progress->benchmark_time = histogram_insert_data_point(
+				g_stats.fabric_send_fragment_hists[fc->pool->pool_id],
+				fc->s_msg_in_progress->benchmark_time);
+	}
+
+	fc->s_bytes += send_sz;
+
+	// Skip the pieces that went, and the part of the next that did.
+	size_t left = (size_t)send_sz;
+
+	while (fc->s_iov_ix < fc->s_n_iov &&
+			left >= fc->s_iov[fc->s_iov_ix].iov_len) {
+		left -= fc->s_iov[fc->s_iov_ix].iov_len;
+		fc->s_iov_ix++;
+	}
+
+	if (fc->s_iov_ix == fc->s_n_iov) {
+		// Complete send.
+		as_fabric_msg_put(fc->s_msg_in_progress);
+		fc->s_count++;
+
+		fc->s_msg_in_progress = NULL;
+		fc->s_n_iov = 0;
+		fc->s_buf.buf = NULL;
+	}
+	else {
+		// Partial send.
+		struct iovec *iov = &fc->s_iov[fc->s_iov_ix];
+
+		iov->iov_base = (uint8_t *)iov->iov_base + left;
+		iov->iov_len -= left;
+	}
+}
+
+// Caller's next msg may be packed, in which case it's replaced by the next in
+// the send queue.
+static void
+fabric_connection_send_progress(fabric_connection *fc, msg **pending)
+{
+	if (fc->s_n_iov != 0) {
+		// Partially sent msg in gather form.
+		fabric_connection_send_iov_progress(fc, pending);
+		return;
+	}
+
 	uint8_t *send_progress;
 	size_t send_full;
 
@@ -1671,19 +1901,31 @@ fabric_connection_send_progress(fabric_connection *fc, bool is_last)
 		msg *m = fc->s_msg_in_progress;
 
 		send_full = msg_get_wire_size(m);
-		fabric_buffer_init(&fc->s_buf, send_full);
 
-		send_progress = fc->s_buf.progress;
-		msg_to_wire(m, send_progress);
+		bool is_iov = fabric_connection_send_iov_init(fc, send_full);
+
+		if (! is_iov) {
+			fabric_buffer_init(&fc->s_buf, send_full);
+			msg_to_wire(m, fc->s_buf.progress);
+		}
 
 		if (m->benchmark_time != 0) {
 			m->benchmark_time = histogram_insert_data_point(
 					g_stats.fabric_send_init_hists[fc->pool->pool_id],
 					m->benchmark_time);
 		}
+
+		if (is_iov) {
+			fabric_connection_send_iov_progress(fc, pending);
+			return;
+		}
+
+		send_progress = fc->s_buf.progress;
+		fabric_connection_send_pack(fc, pending);
+		send_full = fc->s_buf.end - send_progress;
 	}
 
-	int32_t flags = MSG_NOSIGNAL | (is_last ? 0 : MSG_MORE);
+	int32_t flags = MSG_NOSIGNAL | (*pending ? MSG_MORE : 0);
 	int32_t send_sz = cf_socket_send(&fc->sock, send_progress, send_full,
 			flags);
 
@@ -1707,11 +1949,22 @@ fabric_connection_send_progress(fabric_connection *fc, bool is_last)
 
 	if ((size_t)send_sz == send_full) {
 		// Complete send.
-		as_fabric_msg_put(fc->s_msg_in_progress);
+		if (fc->s_n_packed == 0) {
+			as_fabric_msg_put(fc->s_msg_in_progress);
+			fc->s_count++;
+		}
+		else {
+			for (uint32_t i = 0; i < fc->s_n_packed; i++) {
+				as_fabric_msg_put(fc->s_packed[i]);
+			}
+
+			fc->s_count += fc->s_n_packed;
+			fc->s_n_packed = 0;
+		}
+
 		fc->s_msg_in_progress = NULL;
 		fabric_buffer_free_extra(&fc->s_buf);
 		fc->s_buf.buf = NULL;
-		fc->s_count++;
 	}
 	else {
 		// Partial send.
@@ -1733,6 +1986,11 @@ fabric_connection_process_writable(fabric_connection *fc)
 	fabric_node *node = fc->node;
 	uint32_t pool = fc->pool->pool_id;
 
+	// Bulk (migration) connections yield after a burst, so they don't hold a
+	// send thread while other channels' connections wait.
+	uint32_t burst = pool == AS_FABRIC_CHANNEL_BULK ?
+			FABRIC_SEND_BULK_BURST : UINT32_MAX;
+
 	// Try first without extra locking.
 	if (! fc->s_msg_in_progress) {
 		cf_queue_pop(&node->send_queue[pool], &fc->s_msg_in_progress,
@@ -1743,9 +2001,9 @@ fabric_connection_process_writable(fabric_connection *fc)
 		msg *pending = NULL;
 
 		cf_queue_pop(&node->send_queue[pool], &pending, CF_QUEUE_NOWAIT);
-		fabric_connection_send_progress(fc, ! pending);
+		fabric_connection_send_progress(fc, &pending);
 
-		if (fc->s_msg_in_progress) {
+		if (fc->s_msg_in_progress || (pending && --burst == 0)) {
 			if (pending) {
 				cf_queue_push_head(&node->send_queue[pool], &pending);
 			}
@@ -1938,10 +2196,23 @@ fabric_connection_process_msg(fabric_connection *fc, bool do_rearm)
 	}
 
 	fabric_buffer *fb = fc->r_buf_in_progress;
+	bool dispatch = fabric_connection_should_dispatch(fc);
+	uint8_t *buf = fb->buf;
 
-	if (msg_parse(m, fb->buf, fc->r_msg_size) != 0) {
+	// A dispatched msg outlives fb - parse it from its own copy.
+	if (dispatch) {
+		buf = cf_malloc(fc->r_msg_size);
+		memcpy(buf, fb->buf, fc->r_msg_size);
+	}
+
+	if (msg_parse(m, buf, fc->r_msg_size) != 0) {
 		cf_warning(AS_FABRIC, "msg_parse failed for fc %p fb %p", fc, fb);
 		as_fabric_msg_put(m);
+
+		if (dispatch) {
+			cf_free(buf);
+		}
+
 		return false;
 	}
 
@@ -1960,7 +2231,18 @@ fabric_connection_process_msg(fabric_connection *fc, bool do_rearm)
 		fabric_connection_recv_rearm(fc); // do not use fc after this point
 	}
 
-	if (g_fabric.msg_cb[m->type]) {
+	if (dispatch) {
+		fabric_dispatch_ele ele = {
+				.node = node,
+				.m = m,
+				.buf = buf,
+				.benchmark_time = bt,
+				.ch = ch
+		};
+
+		cf_queue_push(g_fabric.dispatch_q[m->type], &ele);
+	}
+	else if (g_fabric.msg_cb[m->type]) {
 		(*g_fabric.msg_cb[m->type])(node, m, g_fabric.msg_udata[m->type]);
 
 		if (bt != 0) {
@@ -1979,6 +2261,17 @@ fabric_connection_process_msg(fabric_connection *fc, bool do_rearm)
 	return true;
 }
 
+// RW channel msgs are latency sensitive, and bulk channel msgs rely on their
+// handlers stalling the socket for flow control - both are handled inline.
+inline static bool
+fabric_connection_should_dispatch(const fabric_connection *fc)
+{
+	uint32_t ch = fc->pool->pool_id;
+
+	return (ch == AS_FABRIC_CHANNEL_CTRL || ch == AS_FABRIC_CHANNEL_META) &&
+			g_fabric.dispatch_q[fc->r_type] != NULL;
+}
+
 // Return true on success.
 // Must have re-armed on success.
 static bool
@@ -2179,6 +2472,9 @@ run_fabric_recv(void *arg)
 	int oldstate;
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
 
+	cf_thread_set_role("fabric-recv");
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_FABRIC);
+
 	fabric_recv_thread_pool *pool = (fabric_recv_thread_pool *)arg;
 	static int worker_id_counter = 0;
 	uint64_t worker_id = worker_id_counter++;
@@ -2250,12 +2546,17 @@ run_fabric_send(void *arg)
 	send_entry *se = (send_entry *)arg;
 	cf_poll poll = se->poll;
 
+	cf_thread_set_role("fabric-send");
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_FABRIC);
+
 	cf_detail(AS_FABRIC, "run_fabric_send() fd %d id %u", poll.fd, se->id);
 
 	while (true) {
 		cf_poll_event events[FABRIC_EPOLL_SEND_EVENTS];
 		int32_t n = cf_poll_wait(poll, events, FABRIC_EPOLL_SEND_EVENTS, -1);
 
+		fabric_send_events_prioritize(events, n);
+
 		for (int32_t i = 0; i < n; i++) {
 			fabric_connection *fc = events[i].data;
 
@@ -2308,6 +2609,29 @@ run_fabric_send(void *arg)
 	return 0;
 }
 
+// Serve bulk (migration) connections last - a rebalance then delays replica
+// writes and other channels' msgs by at most one bulk burst per connection.
+static void
+fabric_send_events_prioritize(cf_poll_event *events, int32_t n)
+{
+	cf_poll_event bulk[FABRIC_EPOLL_SEND_EVENTS];
+	int32_t n_bulk = 0;
+	int32_t n_other = 0;
+
+	for (int32_t i = 0; i < n; i++) {
+		fabric_connection *fc = events[i].data;
+
+		if (fc->pool && fc->pool->pool_id == AS_FABRIC_CHANNEL_BULK) {
+			bulk[n_bulk++] = events[i];
+		}
+		else {
+			events[n_other++] = events[i];
+		}
+	}
+
+	memcpy(&events[n_other], bulk, n_bulk * sizeof(cf_poll_event));
+}
+
 static void *
 run_fabric_accept(void *arg)
 {
@@ -2384,6 +2708,36 @@ run_fabric_accept(void *arg)
 	return 0;
 }
 
+static void *
+run_fabric_dispatch(void *arg)
+{
+	msg_type type = (msg_type)(uint64_t)arg;
+	cf_queue *q = g_fabric.dispatch_q[type];
+
+	cf_thread_set_role("fabric-dispatch");
+	cf_alloc_set_thread_arena(CF_ALLOC_SUBSYS_FABRIC);
+
+	while (true) {
+		fabric_dispatch_ele ele;
+
+		if (cf_queue_pop(q, &ele, CF_QUEUE_FOREVER) != CF_QUEUE_OK) {
+			cf_crash(AS_FABRIC, "unable to pop from dispatch queue");
+		}
+
+		(*g_fabric.msg_cb[type])(ele.node, ele.m, g_fabric.msg_udata[type]);
+
+		// Includes time spent queued.
+		if (ele.benchmark_time != 0) {
+			histogram_insert_data_point(g_stats.fabric_recv_cb_hists[ele.ch],
+					ele.benchmark_time);
+		}
+
+		cf_free(ele.buf);
+	}
+
+	return NULL;
+}
+
 static int
 fabric_rate_node_reduce_fn(const void *key, uint32_t keylen, void *data,
 		void *udata)
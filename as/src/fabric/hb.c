@@ -351,6 +351,17 @@
 #define HB_NODE_TIMEOUT()											\
 ((config_max_intervals_missed_get() * config_tx_interval_get()))
 
+/**
+ * Pulse inter-arrival samples needed before the phi-accrual detector is used.
+ */
+#define HB_PHI_MIN_SAMPLES 16
+
+/**
+ * Weight of a new inter-arrival sample in the running mean and variance, as a
+ * reciprocal.
+ */
+#define HB_PHI_SAMPLE_WEIGHT 16
+
 /**
  * Intervals at which heartbeats are send.
  */
@@ -1163,6 +1174,14 @@ typedef struct as_hb_adjacent_node_s
 	 */
 	as_hlc_msg_timestamp last_msg_hlc_ts;
 
+	/**
+	 * Running mean and variance of pulse inter-arrival times in milliseconds,
+	 * and the number of samples, for the phi-accrual detector.
+	 */
+	double arrival_mean;
+	double arrival_var;
+	uint32_t n_arrivals;
+
 	/**
 	 * Track number of consecutive cluster-name mismatches.
 	 */
@@ -1531,6 +1550,8 @@ static uint32_t config_override_mtu_get();
 static void config_override_mtu_set(uint32_t mtu);
 static uint32_t config_max_intervals_missed_get();
 static void config_max_intervals_missed_set(uint32_t new_max);
+static uint32_t config_phi_threshold_get();
+static void config_phi_threshold_set(uint32_t new_threshold);
 static unsigned char config_multicast_ttl_get();
 static as_hb_protocol config_protocol_get();
 static void config_protocol_set(as_hb_protocol new_protocol);
@@ -1981,6 +2002,21 @@ as_hb_max_intervals_missed_set(uint32_t new_max)
 	return (0);
 }
 
+/**
+ * Set the phi-accrual suspicion threshold. Zero disables the detector.
+ */
+int
+as_hb_phi_threshold_set(uint32_t new_threshold)
+{
+	if (new_threshold > AS_HB_PHI_THRESHOLD_MAX) {
+		WARNING("heartbeat phi-threshold must be <= %u - ignoring %u",
+				AS_HB_PHI_THRESHOLD_MAX, new_threshold);
+		return (-1);
+	}
+	config_phi_threshold_set(new_threshold);
+	return (0);
+}
+
 /**
  * Get the timeout interval to consider a node dead / expired in milliseconds if
  * no heartbeat pulse messages are received.
@@ -2023,6 +2059,8 @@ as_hb_info_config_get(cf_dyn_buf* db)
 	info_append_uint32(db, "heartbeat.interval", config_tx_interval_get());
 	info_append_uint32(db, "heartbeat.timeout",
 			config_max_intervals_missed_get());
+	info_append_uint32(db, "heartbeat.phi-threshold",
+			config_phi_threshold_get());
 
 	info_append_int(db, "heartbeat.mtu", hb_mtu());
 
@@ -3110,6 +3148,32 @@ config_max_intervals_missed_set(uint32_t new_max)
 	HB_CONFIG_UNLOCK();
 }
 
+/**
+ * Get the phi-accrual suspicion threshold. Zero means disabled.
+ */
+static uint32_t
+config_phi_threshold_get()
+{
+	uint32_t rv = 0;
+	HB_CONFIG_LOCK();
+	rv = g_config.hb_config.phi_threshold;
+	HB_CONFIG_UNLOCK();
+	return rv;
+}
+
+/**
+ * Set the phi-accrual suspicion threshold. Zero means disabled.
+ */
+static void
+config_phi_threshold_set(uint32_t new_threshold)
+{
+	HB_CONFIG_LOCK();
+	INFO("changing value of phi-threshold from %u to %u ",
+			g_config.hb_config.phi_threshold, new_threshold);
+	g_config.hb_config.phi_threshold = new_threshold;
+	HB_CONFIG_UNLOCK();
+}
+
 /**
  * Return ttl for multicast packets. Set to zero for default TTL.
  */
@@ -8238,6 +8302,60 @@ hb_adjacent_node_plugin_data_get(as_hb_adjacent_node* adjacent_node,
 							% 2].data) : NULL;
 }
 
+/**
+ * Fold a pulse inter-arrival time into the adjacent node's running mean and
+ * variance.
+ */
+static void
+hb_adjacent_node_arrival_add(as_hb_adjacent_node* adjacent_node,
+		cf_clock interval)
+{
+	double sample = (double)interval;
+
+	if (adjacent_node->n_arrivals == 0) {
+		adjacent_node->arrival_mean = sample;
+		adjacent_node->arrival_var = 0.0;
+	}
+	else {
+		double diff = sample - adjacent_node->arrival_mean;
+		double incr = diff / HB_PHI_SAMPLE_WEIGHT;
+
+		adjacent_node->arrival_mean += incr;
+		adjacent_node->arrival_var = (1.0 - 1.0 / HB_PHI_SAMPLE_WEIGHT)
+				* (adjacent_node->arrival_var + diff * incr);
+	}
+
+	if (adjacent_node->n_arrivals < HB_PHI_MIN_SAMPLES) {
+		adjacent_node->n_arrivals++;
+	}
+}
+
+/**
+ * Suspicion level that the adjacent node has failed, given the time since its
+ * last pulse - phi = -log10(P(a pulse arrives this late or later)), assuming
+ * normally distributed inter-arrival times. Uses the logistic approximation of
+ * the normal CDF.
+ */
+static double
+hb_adjacent_node_phi(const as_hb_adjacent_node* adjacent_node,
+		cf_clock elapsed)
+{
+	// Floor the deviation so perfectly regular pulses don't make the detector
+	// hair-triggered.
+	double min_std = (double)config_tx_interval_get() / 4;
+	double std = sqrt(adjacent_node->arrival_var);
+
+	if (std < min_std) {
+		std = min_std;
+	}
+
+	double y = ((double)elapsed - adjacent_node->arrival_mean) / std;
+	double e = exp(-y * (1.5976 + 0.070566 * y * y));
+
+	return (double)elapsed > adjacent_node->arrival_mean ?
+			-log10(e / (1.0 + e)) : -log10(1.0 - 1.0 / (1.0 + e));
+}
+
 /**
  * Indicates if a give node has expired and should be removed from the adjacency
  * list.
@@ -8252,9 +8370,23 @@ hb_node_has_expired(cf_node nodeid, as_hb_adjacent_node* adjacent_node)
 	HB_LOCK();
 
 	cf_clock now = cf_getms();
+	cf_clock elapsed = now - adjacent_node->last_updated_monotonic_ts;
+	uint32_t phi_threshold = config_phi_threshold_get();
 
-	bool expired = adjacent_node->last_updated_monotonic_ts + HB_NODE_TIMEOUT()
-			< now;
+	bool expired;
+
+	if (phi_threshold == 0 || adjacent_node->n_arrivals < HB_PHI_MIN_SAMPLES) {
+		expired = adjacent_node->last_updated_monotonic_ts + HB_NODE_TIMEOUT()
+				< now;
+	}
+	else {
+		// Never expire on less than two missed pulses, and tolerate jitter up
+		// to twice the fixed timeout.
+		expired = elapsed > 2 * HB_NODE_TIMEOUT() ||
+				(elapsed > 2 * PULSE_TRANSMIT_INTERVAL() &&
+						hb_adjacent_node_phi(adjacent_node, elapsed) >
+								(double)phi_threshold);
+	}
 
 	HB_UNLOCK();
 	return expired;
@@ -8646,8 +8778,15 @@ hb_channel_on_pulse(as_hb_channel_event* msg_event)
 	// Populate plugin data.
 	hb_plugin_msg_parse(msg, &adjacent_node, g_hb.plugins, plugin_data_changed);
 
-	// Update the last updated time.
-	adjacent_node.last_updated_monotonic_ts = cf_getms();
+	// Update the last updated time, and the inter-arrival statistics.
+	cf_clock now = cf_getms();
+
+	if (! is_new) {
+		hb_adjacent_node_arrival_add(&adjacent_node,
+				now - adjacent_node.last_updated_monotonic_ts);
+	}
+
+	adjacent_node.last_updated_monotonic_ts = now;
 	memcpy(&adjacent_node.last_msg_hlc_ts, &msg_event->msg_hlc_ts,
 			sizeof(as_hlc_msg_timestamp));
 
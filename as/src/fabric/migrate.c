@@ -47,11 +47,15 @@
 #include "citrusleaf/cf_queue.h"
 #include "citrusleaf/cf_rchash.h"
 
+#include "bits.h"
 #include "fault.h"
+#include "hist.h"
 #include "msg.h"
 #include "node.h"
+#include "olock.h"
 #include "shash.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
@@ -112,6 +116,18 @@ COMPILER_ASSERT(sizeof(migrate_mt) / sizeof(msg_template) == NUM_MIG_FIELDS);
 
 #define IMMIGRATION_DEBOUNCE_MS (60 * 1000) // 1 minute
 
+// Records needing device reads are read in batches this size, so storage can
+// order and merge the reads instead of following the index.
+#define EMIG_READ_BATCH_SIZE 64
+
+// Adaptive pacing - if over 1% of client reads and writes in the last interval
+// missed migrate-target-latency-ms, double the extra per-record sleep, else
+// halve it.
+#define MIGRATE_PACE_INTERVAL_MS 1000
+#define MIGRATE_PACE_MAX_OVER_PCT 1
+#define MIGRATE_PACE_MIN_SLEEP 100 // usec
+#define MIGRATE_PACE_MAX_SLEEP (100 * 1000) // usec
+
 typedef struct pickled_record_s {
 	cf_digest     keyd;
 	uint32_t      generation;
@@ -121,6 +137,14 @@ typedef struct pickled_record_s {
 	size_t        record_len;
 } pickled_record;
 
+// Emigrate tree reduce state - records awaiting their batched read are
+// reserved but unlocked.
+typedef struct emigration_sweep_s {
+	emigration    *emig;
+	uint32_t      n_pending;
+	as_index_ref  pending[EMIG_READ_BATCH_SIZE];
+} emigration_sweep;
+
 typedef enum {
 	EMIG_START_RESULT_OK,
 	EMIG_START_RESULT_ERROR,
@@ -136,6 +160,7 @@ typedef enum {
 
 typedef struct emigration_pop_info_s {
 	uint32_t order;
+	uint32_t heat_class;
 	uint64_t dest_score;
 	uint64_t n_elements;
 
@@ -160,6 +185,7 @@ static uint64_t g_avoid_dest = 0;
 static cf_atomic32 g_emigration_id = 0;
 static cf_queue g_emigration_q;
 static cf_queue g_emigration_slow_q;
+static pthread_mutex_t g_migrate_pace_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 //==========================================================
@@ -187,8 +213,12 @@ bool emigrate_tree(emigration *emig);
 bool emigration_send_done(emigration *emig);
 void *run_emigration_reinserter(void *arg);
 void emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata);
+bool emigrate_tree_check(emigration *emig);
+void emigrate_tree_flush_pending(emigration_sweep *sweep);
+void emigrate_tree_send_record(emigration *emig, as_index_ref *r_ref, as_storage_rd *rd);
 int emigration_reinsert_reduce_fn(const void *key, void *data, void *udata);
 void emigrate_record(emigration *emig, msg *m);
+uint32_t emigrate_pace_sleep(as_namespace *ns);
 
 // Immigration.
 uint32_t immigration_hashfn(const void *value, uint32_t value_len);
@@ -476,6 +506,8 @@ pickled_record_destroy(pickled_record *pr)
 void *
 run_emigration(void *arg)
 {
+	as_storage_set_io_class(AS_STORAGE_IO_MIGRATE);
+
 	while (true) {
 		emigration *emig;
 
@@ -525,6 +557,8 @@ run_emigration(void *arg)
 void *
 run_emigration_slow(void *arg)
 {
+	as_storage_set_io_class(AS_STORAGE_IO_MIGRATE);
+
 	while (true) {
 		emigration *emig;
 
@@ -554,6 +588,7 @@ emigration_pop(emigration **emigp)
 	emigration_pop_info best;
 
 	best.order = 0xFFFFffff;
+	best.heat_class = 0;
 	best.dest_score = 0;
 	best.n_elements = 0xFFFFffffFFFFffff;
 
@@ -593,16 +628,24 @@ emigration_pop_reduce_fn(void *buf, void *udata)
 		best->avoid_dest = g_avoid_dest;
 	}
 
+	// Busier partitions first - compare by power of 2 so we still spread
+	// emigrations across destinations.
+	uint64_t heat = as_partition_heat(emig->rsv.p);
+
 	uint32_t order = emig->rsv.ns->migrate_order;
+	uint32_t heat_class = (uint32_t)(cf_msb(heat) + 1);
 	uint64_t dest_score = (uint64_t)emig->dest - best->avoid_dest;
 	uint64_t n_elements = as_index_tree_size(emig->rsv.tree);
 
 	if (order < best->order ||
 			(order == best->order &&
-					(dest_score > best->dest_score ||
-							(dest_score == best->dest_score &&
-									n_elements < best->n_elements)))) {
+					(heat_class > best->heat_class ||
+							(heat_class == best->heat_class &&
+									(dest_score > best->dest_score ||
+											(dest_score == best->dest_score &&
+													n_elements < best->n_elements)))))) {
 		best->order = order;
+		best->heat_class = heat_class;
 		best->dest_score = dest_score;
 		best->n_elements = n_elements;
 
@@ -838,7 +881,13 @@ emigrate_tree(emigration *emig)
 		cf_crash(AS_MIGRATE, "could not start reinserter thread");
 	}
 
-	as_index_reduce(emig->rsv.tree, emigrate_tree_reduce_fn, emig);
+	emigration_sweep sweep = { .emig = emig };
+
+	as_index_reduce(emig->rsv.tree, emigrate_tree_reduce_fn, &sweep);
+
+	if (sweep.n_pending != 0) {
+		emigrate_tree_flush_pending(&sweep);
+	}
 
 	// Sets EMIG_STATE_FINISHED only if not already EMIG_STATE_ABORTED.
 	cf_atomic32_setmax(&emig->state, EMIG_STATE_FINISHED);
@@ -937,40 +986,118 @@ run_emigration_reinserter(void *arg)
 void
 emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata)
 {
-	emigration *emig = (emigration *)udata;
+	emigration_sweep *sweep = (emigration_sweep *)udata;
+	emigration *emig = sweep->emig;
 	as_namespace *ns = emig->rsv.ns;
 
-	if (emig->aborted) {
+	if (! emigrate_tree_check(emig)) {
 		as_record_done(r_ref, ns);
 		return; // no point continuing to reduce this tree
 	}
 
-	if (emig->cluster_key != as_exchange_cluster_key()) {
+	if (! should_emigrate_record(emig, r_ref)) {
 		as_record_done(r_ref, ns);
+		return;
+	}
+
+	// Defer reading from device - keep the record reserved but unlocked.
+	if (ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! ns->storage_data_in_memory) {
+		sweep->pending[sweep->n_pending++] = *r_ref;
+
+		pthread_mutex_unlock(r_ref->olock);
+
+		if (sweep->n_pending == EMIG_READ_BATCH_SIZE) {
+			emigrate_tree_flush_pending(sweep);
+		}
+
+		return;
+	}
+
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r_ref->r, &rd);
+	emigrate_tree_send_record(emig, r_ref, &rd);
+}
+
+
+// Returns false if the emigration should stop.
+bool
+emigrate_tree_check(emigration *emig)
+{
+	if (emig->aborted) {
+		return false;
+	}
+
+	if (emig->cluster_key != as_exchange_cluster_key()) {
 		emig->aborted = true;
 		cf_atomic32_set(&emig->state, EMIG_STATE_ABORTED);
-		return; // no point continuing to reduce this tree
+		return false;
 	}
 
-	if (! should_emigrate_record(emig, r_ref)) {
-		as_record_done(r_ref, ns);
-		return;
+	return true;
+}
+
+
+void
+emigrate_tree_flush_pending(emigration_sweep *sweep)
+{
+	emigration *emig = sweep->emig;
+	as_namespace *ns = emig->rsv.ns;
+	uint32_t n_pending = sweep->n_pending;
+	as_storage_rd rds[n_pending];
+	as_storage_rd *rd_ptrs[n_pending];
+
+	sweep->n_pending = 0;
+
+	// Read all the records' data without their locks, letting storage order
+	// and merge the reads by device location.
+	for (uint32_t i = 0; i < n_pending; i++) {
+		as_storage_record_open(ns, sweep->pending[i].r, &rds[i]);
+		rd_ptrs[i] = &rds[i];
+	}
+
+	as_storage_record_load_multi(ns, rd_ptrs, n_pending);
+
+	for (uint32_t i = 0; i < n_pending; i++) {
+		as_index_ref *r_ref = &sweep->pending[i];
+		as_record *r = r_ref->r;
+
+		olock_vlock(g_record_locks, &r->keyd, &r_ref->olock);
+
+		// A record replaced meanwhile is still emigrated, as its new version.
+		if (! emigrate_tree_check(emig) || ! as_index_is_valid_record(r)) {
+			as_storage_record_close(&rds[i]);
+			as_record_done(r_ref, ns);
+			continue;
+		}
+
+		as_storage_record_revalidate(&rds[i]);
+		emigrate_tree_send_record(emig, r_ref, &rds[i]);
 	}
+}
+
+
+// Record is locked and its rd open - both are done with here.
+void
+emigrate_tree_send_record(emigration *emig, as_index_ref *r_ref,
+		as_storage_rd *rd)
+{
+	as_namespace *ns = emig->rsv.ns;
+
+	ASD_MIGRATE_RECORD_SEND(g_config.self_node, emig->dest, emig->rsv.p->id);
 
 	//--------------------------------------------
 	// Read the record and pickle it.
 	//
 
 	as_record *r = r_ref->r;
-	as_storage_rd rd;
 
-	as_storage_record_open(ns, r, &rd);
+	as_storage_rd_load_n_bins(rd); // TODO - handle error returned
 
-	as_storage_rd_load_n_bins(&rd); // TODO - handle error returned
+	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd->n_bins];
 
-	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
-
-	as_storage_rd_load_bins(&rd, stack_bins); // TODO - handle error returned
+	as_storage_rd_load_bins(rd, stack_bins); // TODO - handle error returned
 
 	pickled_record pr;
 
@@ -978,21 +1105,21 @@ emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata)
 	pr.generation = r->generation;
 	pr.void_time = r->void_time;
 	pr.last_update_time = r->last_update_time;
-	pr.record_buf = as_record_pickle(&rd, &pr.record_len);
+	pr.record_buf = as_record_pickle(rd, &pr.record_len);
 
-	as_storage_record_get_key(&rd);
+	as_storage_record_get_key(rd);
 
 	const char *set_name = as_index_get_set_name(r, ns);
-	uint32_t key_size = rd.key_size;
+	uint32_t key_size = rd->key_size;
 	uint8_t key[key_size];
 
 	if (key_size != 0) {
-		memcpy(key, rd.key, key_size);
+		memcpy(key, rd->key, key_size);
 	}
 
 	uint32_t info = emigration_pack_info(emig, r);
 
-	as_storage_record_close(&rd);
+	as_storage_record_close(rd);
 	as_record_done(r_ref, ns);
 
 	//--------------------------------------------
@@ -1044,8 +1171,14 @@ emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata)
 
 	cf_atomic_int_incr(&ns->migrate_records_transmitted);
 
-	if (ns->migrate_sleep != 0) {
-		usleep(ns->migrate_sleep);
+	uint32_t sleep_us = ns->migrate_sleep;
+
+	if (ns->migrate_target_latency_ms != 0) {
+		sleep_us += emigrate_pace_sleep(ns);
+	}
+
+	if (sleep_us != 0) {
+		usleep(sleep_us);
 	}
 
 	uint32_t waits = 0;
@@ -1111,6 +1244,74 @@ emigrate_record(emigration *emig, msg *m)
 }
 
 
+// Returns the extra per-record sleep driven by client latency. One emigration
+// thread re-evaluates it each interval, the rest use the current value.
+uint32_t
+emigrate_pace_sleep(as_namespace *ns)
+{
+	uint64_t now = cf_getms();
+
+	if (now < ns->migrate_pace_check_ms + MIGRATE_PACE_INTERVAL_MS ||
+			pthread_mutex_trylock(&g_migrate_pace_lock) != 0) {
+		return cf_atomic32_get(ns->migrate_pace_sleep);
+	}
+
+	if (now < ns->migrate_pace_check_ms + MIGRATE_PACE_INTERVAL_MS) {
+		pthread_mutex_unlock(&g_migrate_pace_lock);
+		return cf_atomic32_get(ns->migrate_pace_sleep);
+	}
+
+	uint64_t target_ms = ns->migrate_target_latency_ms;
+	uint64_t read_over, read_total, write_over, write_total;
+
+	// Note - tracked histograms have a histogram as their base.
+	histogram_get_counts_over((histogram *)ns->read_hist, target_ms,
+			&read_over, &read_total);
+	histogram_get_counts_over((histogram *)ns->write_hist, target_ms,
+			&write_over, &write_total);
+
+	uint64_t n_over = read_over + write_over;
+	uint64_t n_total = read_total + write_total;
+
+	// Histograms may have been cleared - skip an interval if so.
+	bool valid = ns->migrate_pace_check_ms != 0 &&
+			n_total >= ns->migrate_pace_n_total &&
+			n_over >= ns->migrate_pace_n_over;
+
+	uint64_t d_over = n_over - ns->migrate_pace_n_over;
+	uint64_t d_total = n_total - ns->migrate_pace_n_total;
+
+	ns->migrate_pace_n_over = n_over;
+	ns->migrate_pace_n_total = n_total;
+	ns->migrate_pace_check_ms = now;
+
+	uint32_t sleep_us = cf_atomic32_get(ns->migrate_pace_sleep);
+
+	if (valid) {
+		if (d_over * 100 > d_total * MIGRATE_PACE_MAX_OVER_PCT) {
+			sleep_us = sleep_us == 0 ? MIGRATE_PACE_MIN_SLEEP : sleep_us * 2;
+
+			if (sleep_us > MIGRATE_PACE_MAX_SLEEP) {
+				sleep_us = MIGRATE_PACE_MAX_SLEEP;
+			}
+		}
+		else {
+			sleep_us /= 2;
+
+			if (sleep_us < MIGRATE_PACE_MIN_SLEEP) {
+				sleep_us = 0;
+			}
+		}
+
+		cf_atomic32_set(&ns->migrate_pace_sleep, sleep_us);
+	}
+
+	pthread_mutex_unlock(&g_migrate_pace_lock);
+
+	return sleep_us;
+}
+
+
 //==========================================================
 // Local helpers - immigration.
 //
@@ -1440,6 +1641,8 @@ immigration_handle_insert_request(cf_node src, msg *m)
 
 	cf_atomic_int_incr(&immig->rsv.ns->migrate_record_receives);
 
+	ASD_MIGRATE_RECORD_RECEIVE(g_config.self_node, src, immig->rsv.p->id);
+
 	if (immig->cluster_key != as_exchange_cluster_key()) {
 		immigration_release(immig);
 		as_fabric_msg_put(m);
@@ -35,7 +35,9 @@
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_b64.h"
+#include "citrusleaf/cf_clock.h"
 
+#include "dynbuf.h"
 #include "fault.h"
 #include "node.h"
 
@@ -46,16 +48,53 @@
 #include "fabric/partition_balance.h"
 
 
+//==========================================================
+// Typedefs & constants.
+//
+
+// Lock-free reservation attempt lost a race with a routing state change.
+#define RESERVE_CONTENDED 1
+
+// Client replica map changes, kept so clients can fetch deltas. Must be a
+// power of 2 - 16 bytes per entry.
+#define CLIENT_DELTA_JOURNAL_SIZE (64 * 1024)
+
+typedef struct client_delta_s {
+	uint64_t seq;
+	uint16_t pid;
+	uint8_t ns_ix;
+	int8_t replica; // -1 if no longer a replica in the client view
+} client_delta;
+
+
+//==========================================================
+// Globals.
+//
+
+static pthread_mutex_t g_delta_lock = PTHREAD_MUTEX_INITIALIZER;
+static client_delta g_deltas[CLIENT_DELTA_JOURNAL_SIZE];
+
+// Sequence number of the latest change, and the oldest 'since' we can answer.
+// Sequence numbers start from the wall clock so a restarted node won't mistake
+// a client's token from its previous life for one of its own.
+static uint64_t g_delta_seq = 0;
+static uint64_t g_delta_min_since = 0;
+
+
 //==========================================================
 // Forward declarations.
 //
 
-cf_node find_best_node(const as_partition* p, bool is_read);
+cf_node find_best_node(const as_partition* p, const as_namespace* ns, bool is_read);
+bool node_rack_id(const as_namespace* ns, cf_node node, uint32_t* rack_id);
+cf_node find_rack_local_replica(const as_partition* p, const as_namespace* ns, cf_node node);
 void accumulate_replica_stats(const as_partition* p, uint64_t* p_n_objects, uint64_t* p_n_tombstones);
 void partition_reserve_lockfree(as_partition* p, as_namespace* ns, as_partition_reservation* rsv);
+int reserve_without_lock(as_partition* p, as_namespace* ns, bool is_read, bool would_dup_res, as_partition_reservation* rsv, cf_node* node);
 cf_node partition_getreplica_prole(as_namespace* ns, uint32_t pid);
 char partition_descriptor(const as_partition* p);
 int partition_get_replica_self_lockfree(const as_namespace* ns, uint32_t pid);
+void client_delta_add(const as_namespace* ns, uint32_t pid, int replica);
 
 
 //==========================================================
@@ -91,8 +130,14 @@ as_partition_shutdown(as_namespace* ns, uint32_t pid)
 
 	pthread_mutex_lock(&p->lock);
 
-	as_index_tree_shutdown(p->vp,
-			&ns->xmem_roots[pid * ns->tree_shared.n_sprigs]);
+	// Never ended - forces lock-free reservations onto the (held) lock.
+	as_partition_route_change_begin(p);
+
+	// Only needed if the index is to be resumed on restart.
+	if (ns->xmem_roots) {
+		as_index_tree_shutdown(p->vp,
+				&ns->xmem_roots[pid * ns->tree_shared.n_sprigs]);
+	}
 }
 
 
@@ -108,6 +153,7 @@ as_partition_freeze(as_partition* p)
 	memset(p->immigrators, 0, sizeof(p->immigrators));
 
 	p->working_master = (cf_node)0;
+	p->rack_local_node = (cf_node)0;
 
 	p->n_dupl = 0;
 	memset(p->dupls, 0, sizeof(p->dupls));
@@ -155,7 +201,7 @@ as_partition_writable_node(as_namespace* ns, uint32_t pid)
 		return (cf_node)0;
 	}
 
-	cf_node best_node = find_best_node(p, false);
+	cf_node best_node = find_best_node(p, ns, false);
 
 	pthread_mutex_unlock(&p->lock);
 
@@ -163,9 +209,12 @@ as_partition_writable_node(as_namespace* ns, uint32_t pid)
 }
 
 
-// If this node is an eventual master, return the acting master, else return 0.
+// If this node is an eventual master, return the acting master. Otherwise, for
+// rack-local reads, return an in-sync replica in the proxyer's rack, if any.
+// Else return 0.
 cf_node
-as_partition_proxyee_redirect(as_namespace* ns, uint32_t pid)
+as_partition_proxyee_redirect(as_namespace* ns, uint32_t pid, bool is_read,
+		cf_node src)
 {
 	as_partition* p = &ns->partitions[pid];
 
@@ -177,6 +226,9 @@ as_partition_proxyee_redirect(as_namespace* ns, uint32_t pid)
 			g_config.self_node != p->working_master) {
 		node = p->working_master;
 	}
+	else if (is_read && ns->rack_local_reads && p->n_dupl == 0) {
+		node = find_rack_local_replica(p, ns, src);
+	}
 
 	pthread_mutex_unlock(&p->lock);
 
@@ -184,6 +236,19 @@ as_partition_proxyee_redirect(as_namespace* ns, uint32_t pid)
 }
 
 
+// Is node in the same rack as this node? Reads the exchange's succession
+// without its lock - a stale answer only affects stats and routing choices.
+bool
+as_partition_is_rack_local(const as_namespace* ns, cf_node node)
+{
+	uint32_t self_rack_id;
+	uint32_t rack_id;
+
+	return node_rack_id(ns, g_config.self_node, &self_rack_id) &&
+			node_rack_id(ns, node, &rack_id) && rack_id == self_rack_id;
+}
+
+
 // TODO - deprecate in "six months".
 void
 as_partition_get_replicas_prole_str(cf_dyn_buf* db)
@@ -269,6 +334,43 @@ as_partition_get_replicas_all_str(cf_dyn_buf* db)
 }
 
 
+// Appends "<seq>" then ";<ns>:<pid>:<replica>" for each client replica map
+// change after 'since', oldest first. Returns false, having appended only
+// "<seq>;full;", if the journal no longer covers 'since' - caller must then
+// append the full "replicas-all" map.
+bool
+as_partition_get_replicas_delta_str(cf_dyn_buf* db, uint64_t since)
+{
+	pthread_mutex_lock(&g_delta_lock);
+
+	uint64_t seq = g_delta_seq;
+
+	cf_dyn_buf_append_uint64(db, seq);
+
+	if (since < g_delta_min_since || since > seq ||
+			seq - since > CLIENT_DELTA_JOURNAL_SIZE) {
+		pthread_mutex_unlock(&g_delta_lock);
+		cf_dyn_buf_append_string(db, ";full;");
+		return false;
+	}
+
+	for (uint64_t s = since + 1; s <= seq; s++) {
+		const client_delta* d = &g_deltas[s & (CLIENT_DELTA_JOURNAL_SIZE - 1)];
+
+		cf_dyn_buf_append_char(db, ';');
+		cf_dyn_buf_append_string(db, g_config.namespaces[d->ns_ix]->name);
+		cf_dyn_buf_append_char(db, ':');
+		cf_dyn_buf_append_uint32(db, d->pid);
+		cf_dyn_buf_append_char(db, ':');
+		cf_dyn_buf_append_int(db, d->replica);
+	}
+
+	pthread_mutex_unlock(&g_delta_lock);
+
+	return true;
+}
+
+
 void
 as_partition_get_replica_stats(as_namespace* ns, repl_stats* p_stats)
 {
@@ -370,6 +472,14 @@ as_partition_reserve_write(as_namespace* ns, uint32_t pid,
 {
 	as_partition* p = &ns->partitions[pid];
 
+	cf_atomic64_incr(&p->n_tx);
+
+	int result = reserve_without_lock(p, ns, false, false, rsv, node);
+
+	if (result != RESERVE_CONTENDED) {
+		return result;
+	}
+
 	pthread_mutex_lock(&p->lock);
 
 	// If this partition is frozen, return.
@@ -382,7 +492,7 @@ as_partition_reserve_write(as_namespace* ns, uint32_t pid,
 		return -2;
 	}
 
-	cf_node best_node = find_best_node(p, false);
+	cf_node best_node = find_best_node(p, ns, false);
 
 	if (node) {
 		*node = best_node;
@@ -412,6 +522,14 @@ as_partition_reserve_read(as_namespace* ns, uint32_t pid,
 {
 	as_partition* p = &ns->partitions[pid];
 
+	cf_atomic64_incr(&p->n_tx);
+
+	int result = reserve_without_lock(p, ns, true, would_dup_res, rsv, node);
+
+	if (result != RESERVE_CONTENDED) {
+		return result;
+	}
+
 	pthread_mutex_lock(&p->lock);
 
 	// If this partition is frozen, return.
@@ -424,7 +542,8 @@ as_partition_reserve_read(as_namespace* ns, uint32_t pid,
 		return -2;
 	}
 
-	cf_node best_node = find_best_node(p, p->n_dupl == 0 || ! would_dup_res);
+	cf_node best_node = find_best_node(p, ns,
+			p->n_dupl == 0 || ! would_dup_res);
 
 	if (node) {
 		*node = best_node;
@@ -591,6 +710,15 @@ client_replica_maps_create(as_namespace* ns)
 	ns->replica_maps = cf_malloc(size);
 	memset(ns->replica_maps, 0, size);
 
+	pthread_mutex_lock(&g_delta_lock);
+
+	if (g_delta_seq == 0) {
+		g_delta_seq = cf_clock_getabsolute() << 16;
+		g_delta_min_since = g_delta_seq;
+	}
+
+	pthread_mutex_unlock(&g_delta_lock);
+
 	for (uint32_t repl_ix = 0; repl_ix < ns->cfg_replication_factor;
 			repl_ix++) {
 		client_replica_map* repl_map = &ns->replica_maps[repl_ix];
@@ -616,6 +744,13 @@ client_replica_maps_clear(as_namespace* ns)
 		cf_b64_encode((uint8_t*)repl_map->bitmap,
 				(uint32_t)sizeof(repl_map->bitmap), (char*)repl_map->b64map);
 	}
+
+	// Outstanding deltas don't account for the clear - force full maps.
+	pthread_mutex_lock(&g_delta_lock);
+
+	g_delta_min_since = ++g_delta_seq;
+
+	pthread_mutex_unlock(&g_delta_lock);
 }
 
 
@@ -660,6 +795,11 @@ client_replica_maps_update(as_namespace* ns, uint32_t pid)
 		changed = true;
 	}
 
+	if (changed) {
+		client_delta_add(ns, pid,
+				replica < (int)ns->cfg_replication_factor ? replica : -1);
+	}
+
 	return changed;
 }
 
@@ -684,7 +824,7 @@ client_replica_maps_is_partition_queryable(const as_namespace* ns, uint32_t pid)
 
 // Find best node to handle read/write. Called within partition lock.
 cf_node
-find_best_node(const as_partition* p, bool is_read)
+find_best_node(const as_partition* p, const as_namespace* ns, bool is_read)
 {
 	// Working master (final or acting) returns self, eventual master returns
 	// acting master. Others don't have p->working_master set.
@@ -697,10 +837,57 @@ find_best_node(const as_partition* p, bool is_read)
 		return g_config.self_node; // may read from prole that's got everything
 	}
 
+	if (is_read && ns->rack_local_reads && p->rack_local_node != (cf_node)0) {
+		return p->rack_local_node; // same-rack replica that's got everything
+	}
+
 	return p->replicas[0]; // final master as a last resort
 }
 
 
+// Returns false if node isn't in the namespace's succession list.
+bool
+node_rack_id(const as_namespace* ns, cf_node node, uint32_t* rack_id)
+{
+	for (uint32_t n = 0; n < ns->cluster_size; n++) {
+		if (ns->succession[n] == node) {
+			*rack_id = ns->rack_ids[n];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// Find a replica other than self in node's rack that wasn't an immigrator at
+// the last rebalance - i.e. one that has everything. Called within partition
+// lock.
+cf_node
+find_rack_local_replica(const as_partition* p, const as_namespace* ns,
+		cf_node node)
+{
+	uint32_t rack_id;
+
+	if (! node_rack_id(ns, node, &rack_id)) {
+		return (cf_node)0;
+	}
+
+	for (uint32_t repl_ix = 0; repl_ix < p->n_replicas; repl_ix++) {
+		cf_node repl_node = p->replicas[repl_ix];
+		uint32_t repl_rack_id;
+
+		if (repl_node != g_config.self_node && ! p->immigrators[repl_ix] &&
+				node_rack_id(ns, repl_node, &repl_rack_id) &&
+				repl_rack_id == rack_id) {
+			return repl_node;
+		}
+	}
+
+	return (cf_node)0;
+}
+
+
 void
 accumulate_replica_stats(const as_partition* p, uint64_t* p_n_objects,
 		uint64_t* p_n_tombstones)
@@ -730,6 +917,77 @@ partition_reserve_lockfree(as_partition* p, as_namespace* ns,
 }
 
 
+// Same outcomes as the locked paths of as_partition_reserve_write() and
+// as_partition_reserve_read(), or RESERVE_CONTENDED if routing state changed
+// while we looked - caller must then take the partition lock.
+int
+reserve_without_lock(as_partition* p, as_namespace* ns, bool is_read,
+		bool would_dup_res, as_partition_reservation* rsv, cf_node* node)
+{
+	uint32_t seq = __atomic_load_n(&p->route_seq, __ATOMIC_ACQUIRE);
+
+	if ((seq & 1) != 0) {
+		return RESERVE_CONTENDED;
+	}
+
+	int result;
+	cf_node best_node = (cf_node)0;
+	as_index_tree* tree = NULL;
+
+	if (p->n_replicas == 0) {
+		result = -2; // frozen
+	}
+	else {
+		best_node = find_best_node(p, ns,
+				is_read && (p->n_dupl == 0 || ! would_dup_res));
+
+		if (best_node != g_config.self_node) {
+			result = -1;
+		}
+		else {
+			tree = p->vp;
+
+			// The tree may have just been dropped - its memory is still valid
+			// (garbage collection grace period), but it can't be reserved.
+			if (cf_rc_reserve_nonzero(tree) == 0) {
+				return RESERVE_CONTENDED;
+			}
+
+			rsv->n_dupl = p->n_dupl;
+
+			if (rsv->n_dupl != 0) {
+				memcpy(rsv->dupl_nodes, p->dupls,
+						sizeof(cf_node) * rsv->n_dupl);
+			}
+
+			result = 0;
+		}
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(&p->route_seq, __ATOMIC_RELAXED) != seq) {
+		if (tree) {
+			as_index_tree_release(tree);
+		}
+
+		return RESERVE_CONTENDED;
+	}
+
+	if (node) {
+		*node = best_node;
+	}
+
+	if (result == 0) {
+		rsv->ns = ns;
+		rsv->p = p;
+		rsv->tree = tree;
+	}
+
+	return result;
+}
+
+
 // TODO - deprecate in "six months".
 cf_node
 partition_getreplica_prole(as_namespace* ns, uint32_t pid)
@@ -739,7 +997,7 @@ partition_getreplica_prole(as_namespace* ns, uint32_t pid)
 	pthread_mutex_lock(&p->lock);
 
 	// Check is this is a master node.
-	cf_node best_node = find_best_node(p, false);
+	cf_node best_node = find_best_node(p, ns, false);
 
 	if (best_node == g_config.self_node) {
 		// It's a master, return 0.
@@ -747,7 +1005,7 @@ partition_getreplica_prole(as_namespace* ns, uint32_t pid)
 	}
 	else {
 		// Not a master, see if it's a prole.
-		best_node = find_best_node(p, true);
+		best_node = find_best_node(p, ns, true);
 	}
 
 	pthread_mutex_unlock(&p->lock);
@@ -769,6 +1027,22 @@ partition_descriptor(const as_partition* p)
 }
 
 
+void
+client_delta_add(const as_namespace* ns, uint32_t pid, int replica)
+{
+	pthread_mutex_lock(&g_delta_lock);
+
+	client_delta* d = &g_deltas[++g_delta_seq & (CLIENT_DELTA_JOURNAL_SIZE - 1)];
+
+	d->seq = g_delta_seq;
+	d->pid = (uint16_t)pid;
+	d->ns_ix = (uint8_t)(ns->id - 1);
+	d->replica = (int8_t)replica;
+
+	pthread_mutex_unlock(&g_delta_lock);
+}
+
+
 int
 partition_get_replica_self_lockfree(const as_namespace* ns, uint32_t pid)
 {
@@ -61,6 +61,11 @@ COMPILER_ASSERT((AS_CLUSTER_SZ & (AS_CLUSTER_SZ - 1)) == 0);
 
 typedef uint8_t sl_ix_t;
 
+typedef struct balance_job_s {
+	as_namespace* ns;
+	cf_queue* mq;
+} balance_job;
+
 COMPILER_ASSERT(AS_CLUSTER_SZ_MASKN >> (sizeof(sl_ix_t) * 8) == 0);
 
 typedef struct inter_hash_s {
@@ -111,6 +116,8 @@ void drop_trees(as_partition* p, as_namespace* ns);
 // Helpers - balance partitions.
 void fill_global_tables();
 void balance_namespace(as_namespace* ns, cf_queue* mq);
+void balance_namespaces(cf_queue* mq);
+void* run_balance_namespace(void* udata);
 void apply_single_replica_limit(as_namespace* ns);
 uint32_t rack_count(const as_namespace* ns);
 void fill_translation(int translation[], const as_namespace* ns);
@@ -121,6 +128,7 @@ uint32_t find_self(const cf_node* ns_node_seq, const as_namespace* ns);
 int find_working_master(const as_partition* p, const sl_ix_t* ns_sl_ix, const as_namespace* ns);
 uint32_t find_duplicates(const as_partition* p, const cf_node* ns_node_seq, const sl_ix_t* ns_sl_ix, const as_namespace* ns, uint32_t working_master_n, cf_node dupls[]);
 uint32_t fill_immigrators(as_partition* p, const sl_ix_t* ns_sl_ix, as_namespace* ns, uint32_t working_master_n, uint32_t n_dupl);
+cf_node find_rack_local_node(const as_partition* p, const cf_node* ns_node_seq, const sl_ix_t* ns_sl_ix, const as_namespace* ns, uint32_t self_n);
 void advance_version(as_partition* p, const sl_ix_t* ns_sl_ix, as_namespace* ns, uint32_t self_n,	uint32_t working_master_n, uint32_t n_dupl, const cf_node dupls[]);
 uint32_t fill_family_versions(const as_partition* p, const sl_ix_t* ns_sl_ix, const as_namespace* ns, uint32_t working_master_n, uint32_t n_dupl, const cf_node dupls[], as_partition_version family_versions[]);
 bool has_replica_parent(const as_partition* p, const sl_ix_t* ns_sl_ix, const as_namespace* ns, const as_partition_version* subset_version, uint32_t subset_n);
@@ -298,6 +306,7 @@ as_partition_balance_revert_to_orphan()
 			as_partition* p = &ns->partitions[pid];
 
 			pthread_mutex_lock(&p->lock);
+			as_partition_route_change_begin(p);
 
 			as_partition_freeze(p);
 
@@ -306,6 +315,7 @@ as_partition_balance_revert_to_orphan()
 				p->version.subset = 1;
 			}
 
+			as_partition_route_change_end(p);
 			pthread_mutex_unlock(&p->lock);
 		}
 	}
@@ -340,11 +350,9 @@ as_partition_balance()
 	cf_queue mq;
 
 	cf_queue_init(&mq, sizeof(pb_task), g_config.n_namespaces * AS_PARTITIONS,
-			false);
+			g_config.n_namespaces > 1);
 
-	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
-		balance_namespace(g_config.namespaces[ns_ix], &mq);
-	}
+	balance_namespaces(&mq);
 
 	// All partitions now have replicas assigned, ok to allow transactions.
 	g_init_balance_done = true;
@@ -433,8 +441,11 @@ as_partition_emigrate_done(as_namespace* ns, uint32_t pid,
 
 	if (! is_self_final_master(p)) {
 		if ((tx_flags & TX_FLAGS_ACTING_MASTER) != 0) {
+			as_partition_route_change_begin(p);
 			p->working_master = (cf_node)0;
 			p->n_dupl = 0;
+			as_partition_route_change_end(p);
+
 			p->version.master = 0;
 		}
 
@@ -546,7 +557,9 @@ as_partition_immigrate_done(as_namespace* ns, uint32_t pid,
 		return AS_MIGRATE_FAIL;
 	}
 
+	as_partition_route_change_begin(p);
 	p->pending_immigrations--;
+	as_partition_route_change_end(p);
 
 	int64_t migrates_rx_remaining =
 			cf_atomic_int_decr(&ns->migrate_rx_partitions_remaining);
@@ -574,6 +587,8 @@ as_partition_immigrate_done(as_namespace* ns, uint32_t pid,
 
 	// Final master finished an immigration, adjust duplicates.
 
+	as_partition_route_change_begin(p);
+
 	if (source_node == p->working_master) {
 		p->working_master = g_config.self_node;
 
@@ -586,6 +601,8 @@ as_partition_immigrate_done(as_namespace* ns, uint32_t pid,
 		p->n_dupl = remove_node(p->dupls, p->n_dupl, source_node);
 	}
 
+	as_partition_route_change_end(p);
+
 	if (client_replica_maps_update(ns, pid)) {
 		cf_atomic32_incr(&g_partition_generation);
 	}
@@ -655,7 +672,10 @@ as_partition_migrations_all_done(as_namespace* ns, uint32_t pid,
 	if (! is_self_replica(p)) {
 		p->version = ZERO_VERSION;
 		set_partition_storage_info(ns, p, true);
+
+		as_partition_route_change_begin(p);
 		drop_trees(p, ns);
+		as_partition_route_change_end(p);
 	}
 
 	pthread_mutex_unlock(&p->lock);
@@ -693,6 +713,7 @@ pb_task_init(pb_task* task, cf_node dest, as_namespace* ns,
 }
 
 
+// Called within partition lock, as a routing state change.
 void
 drop_trees(as_partition* p, as_namespace* ns)
 {
@@ -859,6 +880,7 @@ balance_namespace(as_namespace* ns, cf_queue* mq)
 		}
 
 		pthread_mutex_lock(&p->lock);
+		as_partition_route_change_begin(p);
 
 		p->n_replicas = ns->replication_factor;
 		memset(p->replicas, 0, sizeof(p->replicas));
@@ -869,6 +891,7 @@ balance_namespace(as_namespace* ns, cf_queue* mq)
 		memset(p->immigrators, 0, sizeof(p->immigrators));
 
 		p->working_master = (cf_node)0;
+		p->rack_local_node = (cf_node)0;
 
 		p->n_dupl = 0;
 		memset(p->dupls, 0, sizeof(p->dupls));
@@ -922,6 +945,9 @@ balance_namespace(as_namespace* ns, cf_queue* mq)
 				advance_version(p, ns_sl_ix, ns, self_n,
 						(uint32_t)working_master_n, n_dupl, dupls);
 
+				p->n_tx_prev_base = p->n_tx_base;
+				p->n_tx_base = (uint64_t)cf_atomic64_get(p->n_tx);
+
 				queue_namespace_migrations(p, ns, self_n,
 						ns_node_seq[working_master_n], n_dupl, dupls, mq);
 
@@ -948,6 +974,11 @@ balance_namespace(as_namespace* ns, cf_queue* mq)
 			p->working_master = ns_node_seq[working_master_n];
 		}
 
+		if (n_racks != 1) {
+			p->rack_local_node = find_rack_local_node(p, ns_node_seq, ns_sl_ix,
+					ns, self_n);
+		}
+
 		if (! as_partition_version_is_null(&p->version)) {
 			set_partition_storage_info(ns, p, false);
 		}
@@ -966,6 +997,7 @@ balance_namespace(as_namespace* ns, cf_queue* mq)
 
 		client_replica_maps_update(ns, pid);
 
+		as_partition_route_change_end(p);
 		pthread_mutex_unlock(&p->lock);
 	}
 
@@ -983,6 +1015,48 @@ balance_namespace(as_namespace* ns, cf_queue* mq)
 }
 
 
+// Namespaces balance independently - do them in parallel, one thread each.
+// Only the (thread safe) migration queue is shared.
+void
+balance_namespaces(cf_queue* mq)
+{
+	uint32_t n_namespaces = g_config.n_namespaces;
+
+	if (n_namespaces == 1) {
+		balance_namespace(g_config.namespaces[0], mq);
+		return;
+	}
+
+	pthread_t threads[n_namespaces];
+	balance_job jobs[n_namespaces];
+
+	for (uint32_t ns_ix = 0; ns_ix < n_namespaces; ns_ix++) {
+		jobs[ns_ix].ns = g_config.namespaces[ns_ix];
+		jobs[ns_ix].mq = mq;
+
+		if (pthread_create(&threads[ns_ix], NULL, run_balance_namespace,
+				&jobs[ns_ix]) != 0) {
+			cf_crash(AS_PARTITION, "failed to create balance thread");
+		}
+	}
+
+	for (uint32_t ns_ix = 0; ns_ix < n_namespaces; ns_ix++) {
+		pthread_join(threads[ns_ix], NULL);
+	}
+}
+
+
+void*
+run_balance_namespace(void* udata)
+{
+	balance_job* job = (balance_job*)udata;
+
+	balance_namespace(job->ns, job->mq);
+
+	return NULL;
+}
+
+
 void
 apply_single_replica_limit(as_namespace* ns)
 {
@@ -1310,6 +1384,27 @@ fill_immigrators(as_partition* p, const sl_ix_t* ns_sl_ix, as_namespace* ns,
 }
 
 
+// Find a replica other than self in self's rack that isn't an immigrator - it
+// has everything, so it may serve reads in place of the master. Immigrators
+// aren't cleared when their migrations finish, so such a replica is only used
+// from the next rebalance on.
+cf_node
+find_rack_local_node(const as_partition* p, const cf_node* ns_node_seq,
+		const sl_ix_t* ns_sl_ix, const as_namespace* ns, uint32_t self_n)
+{
+	uint32_t self_rack_id = RACK_ID(self_n);
+
+	for (uint32_t repl_ix = 0; repl_ix < p->n_replicas; repl_ix++) {
+		if (repl_ix != self_n && ! p->immigrators[repl_ix] &&
+				RACK_ID(repl_ix) == self_rack_id) {
+			return ns_node_seq[repl_ix];
+		}
+	}
+
+	return (cf_node)0;
+}
+
+
 void
 advance_version(as_partition* p, const sl_ix_t* ns_sl_ix, as_namespace* ns,
 		uint32_t self_n, uint32_t working_master_n, uint32_t n_dupl,
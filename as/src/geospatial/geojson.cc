@@ -16,12 +16,14 @@
  * permissions and limitations under the License.
  */
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <iomanip>
 #include <stdexcept>
 
-#include <jansson.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <s2.h>
 #include <s2cap.h>
@@ -30,7 +32,6 @@
 #include <s2regionunion.h>
 #include <s2latlng.h>
 
-#include "geospatial/scoped.h"
 #include "geospatial/throwstream.h"
 #include "geospatial/geojson.h"
 
@@ -38,46 +39,360 @@ using namespace std;
 
 namespace {
 
+// Deeper nesting than this is rejected, as by jansson.
+const int MAX_DEPTH = 2048;
+
+// Reads GeoJSON text in a single pass, without building a DOM - coordinates
+// are converted as they're read and go straight into the S2 builders. Relies
+// on the text being NUL-terminated, as std::string data is.
+class Reader
+{
+public:
+	Reader(char const * i_begin, char const * i_end)
+		: m_begin(i_begin)
+		, m_p(i_begin)
+		, m_end(i_end)
+	{
+	}
+
+	char const * pos() const { return m_p; }
+
+	Reader at(char const * i_pos) const {
+		Reader rd(*this);
+		rd.m_p = i_pos;
+		return rd;
+	}
+
+	// Next non-whitespace character, or 0 at the end.
+	char peek() {
+		while (m_p < m_end &&
+				(*m_p == ' ' || *m_p == '\n' || *m_p == '\r' || *m_p == '\t')) {
+			++m_p;
+		}
+
+		return m_p < m_end ? *m_p : 0;
+	}
+
+	bool consume(char c) {
+		if (peek() != c) {
+			return false;
+		}
+
+		++m_p;
+		return true;
+	}
+
+	void expect(char c) {
+		if (! consume(c)) {
+			fail(string("expected '") + c + "'");
+		}
+	}
+
+	bool at_end() {
+		return peek() == 0 && m_p == m_end;
+	}
+
+	string read_string() {
+		if (! consume('"')) {
+			fail("expected string");
+		}
+
+		string str;
+
+		while (true) {
+			char const * run = m_p;
+
+			while (m_p < m_end && *m_p != '"' && *m_p != '\\' &&
+					(unsigned char)*m_p >= 0x20) {
+				++m_p;
+			}
+
+			str.append(run, m_p - run);
+
+			if (m_p == m_end || (unsigned char)*m_p < 0x20) {
+				fail("unterminated string");
+			}
+
+			if (*m_p++ == '"') {
+				return str;
+			}
+
+			read_escape(str);
+		}
+	}
+
+	// Returns false, consuming nothing, if the next value isn't a number.
+	bool read_number(double * valp) {
+		char c = peek();
+
+		if (c != '-' && (c < '0' || c > '9')) {
+			return false;
+		}
+
+		// Check JSON's grammar, which is stricter than strtod()'s.
+		char const * p = m_p;
+
+		if (*p == '-') {
+			++p;
+		}
+
+		if (*p == '0') {
+			++p;
+		}
+		else if (*p >= '1' && *p <= '9') {
+			p = skip_digits(p);
+		}
+		else {
+			fail("invalid number");
+		}
+
+		if (*p == '.') {
+			if (*++p < '0' || *p > '9') {
+				fail("invalid number");
+			}
+
+			p = skip_digits(p);
+		}
+
+		if (*p == 'e' || *p == 'E') {
+			++p;
+
+			if (*p == '+' || *p == '-') {
+				++p;
+			}
+
+			if (*p < '0' || *p > '9') {
+				fail("invalid number");
+			}
+
+			p = skip_digits(p);
+		}
+
+		char * endp;
+
+		*valp = strtod(m_p, &endp);
+
+		if (endp != p) {
+			fail("invalid number");
+		}
+
+		m_p = p;
+		return true;
+	}
+
+	void skip_value(int depth = 0) {
+		if (depth > MAX_DEPTH) {
+			fail("maximum nesting depth exceeded");
+		}
+
+		double val;
+		char c = peek();
+
+		switch (c) {
+		case '"':
+			read_string();
+			break;
+		case '{':
+			++m_p;
+
+			if (! consume('}')) {
+				do {
+					read_string();
+					expect(':');
+					skip_value(depth + 1);
+				} while (consume(','));
+
+				expect('}');
+			}
+			break;
+		case '[':
+			++m_p;
+
+			if (! consume(']')) {
+				do {
+					skip_value(depth + 1);
+				} while (consume(','));
+
+				expect(']');
+			}
+			break;
+		case 't':
+			skip_literal("true");
+			break;
+		case 'f':
+			skip_literal("false");
+			break;
+		case 'n':
+			skip_literal("null");
+			break;
+		default:
+			if (! read_number(&val)) {
+				fail("invalid value");
+			}
+			break;
+		}
+	}
+
+	void fail(string const & what) const __attribute__ ((noreturn)) {
+		throwstream(runtime_error, "failed to parse geojson: offset "
+					<< (m_p - m_begin) << ": " << what);
+	}
+
+private:
+	static char const * skip_digits(char const * p) {
+		while (*p >= '0' && *p <= '9') {
+			++p;
+		}
+
+		return p;
+	}
+
+	void skip_literal(char const * lit) {
+		size_t len = strlen(lit);
+
+		if (size_t(m_end - m_p) < len || memcmp(m_p, lit, len) != 0) {
+			fail("invalid literal");
+		}
+
+		m_p += len;
+	}
+
+	uint32_t read_hex4() {
+		if (m_end - m_p < 4) {
+			fail("invalid unicode escape");
+		}
+
+		uint32_t cp = 0;
+
+		for (int i = 0; i < 4; ++i) {
+			char c = *m_p++;
+
+			cp <<= 4;
+
+			if (c >= '0' && c <= '9') {
+				cp |= uint32_t(c - '0');
+			}
+			else if (c >= 'a' && c <= 'f') {
+				cp |= uint32_t(c - 'a' + 10);
+			}
+			else if (c >= 'A' && c <= 'F') {
+				cp |= uint32_t(c - 'A' + 10);
+			}
+			else {
+				fail("invalid unicode escape");
+			}
+		}
+
+		return cp;
+	}
+
+	void read_escape(string & str) {
+		if (m_p == m_end) {
+			fail("unterminated string");
+		}
+
+		switch (*m_p++) {
+		case '"':  str += '"'; return;
+		case '\\': str += '\\'; return;
+		case '/':  str += '/'; return;
+		case 'b':  str += '\b'; return;
+		case 'f':  str += '\f'; return;
+		case 'n':  str += '\n'; return;
+		case 'r':  str += '\r'; return;
+		case 't':  str += '\t'; return;
+		case 'u':  break;
+		default:   fail("invalid escape");
+		}
+
+		uint32_t cp = read_hex4();
+
+		if (cp >= 0xD800 && cp <= 0xDBFF) {
+			if (m_end - m_p < 2 || m_p[0] != '\\' || m_p[1] != 'u') {
+				fail("invalid unicode surrogate pair");
+			}
+
+			m_p += 2;
+
+			uint32_t lo = read_hex4();
+
+			if (lo < 0xDC00 || lo > 0xDFFF) {
+				fail("invalid unicode surrogate pair");
+			}
+
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+		}
+		else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+			fail("invalid unicode surrogate pair");
+		}
+
+		// Encode as UTF-8.
+		if (cp < 0x80) {
+			str += char(cp);
+		}
+		else if (cp < 0x800) {
+			str += char(0xC0 | (cp >> 6));
+			str += char(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000) {
+			str += char(0xE0 | (cp >> 12));
+			str += char(0x80 | ((cp >> 6) & 0x3F));
+			str += char(0x80 | (cp & 0x3F));
+		}
+		else {
+			str += char(0xF0 | (cp >> 18));
+			str += char(0x80 | ((cp >> 12) & 0x3F));
+			str += char(0x80 | ((cp >> 6) & 0x3F));
+			str += char(0x80 | (cp & 0x3F));
+		}
+	}
+
+	char const * m_begin;
+	char const * m_p;
+	char const * m_end;
+};
+
 S2Point
-traverse_point(json_t * coord)
+traverse_point(Reader * rd)
 {
-	if (! coord) {
+	if (! rd) {
 		throwstream(runtime_error, "missing coordinates");
-    }
+	}
 
-	if (! json_is_array(coord)) {
+	if (! rd->consume('[')) {
 		throwstream(runtime_error, "coordinates are not array");
-    }
+	}
 
-	if (json_array_size(coord) != 2) {
-		throwstream(runtime_error, "expected 2 coordinates, saw "
-					<< json_array_size(coord));
-    }
+	double vals[2];
+	bool numeric[2] = { false, false };
+	size_t n_vals = 0;
 
-	double lngval;
-	json_t * lng = json_array_get(coord, 0);
-	if (json_is_real(lng)) {
-		lngval = json_real_value(lng);
+	if (! rd->consume(']')) {
+		do {
+			if (n_vals >= 2 || ! (numeric[n_vals] = rd->read_number(&vals[n_vals]))) {
+				rd->skip_value();
+			}
+
+			++n_vals;
+		} while (rd->consume(','));
+
+		rd->expect(']');
 	}
-	else if (json_is_integer(lng)) {
-		lngval = double(json_integer_value(lng));
+
+	if (n_vals != 2) {
+		throwstream(runtime_error, "expected 2 coordinates, saw " << n_vals);
 	}
-	else {
+
+	if (! numeric[0]) {
 		throwstream(runtime_error, "longitude not numeric value");
-    }
-	
-	double latval;
-	json_t * lat = json_array_get(coord, 1);
-	if (json_is_real(lat)) {
-		latval = json_real_value(lat);
-	}
-	else if (json_is_integer(lat)) {
-		latval = double(json_integer_value(lat));
 	}
-	else {
+
+	if (! numeric[1]) {
 		throwstream(runtime_error, "latitude not numeric value");
-    }
-	
+	}
+
+	double lngval = vals[0];
+	double latval = vals[1];
+
 	// cout << setprecision(15) << latval << ", " << lngval << endl;
 
 	S2LatLng latlng = S2LatLng::FromDegrees(latval, lngval).Normalized();
@@ -88,30 +403,29 @@ traverse_point(json_t * coord)
 }
 
 S2Loop *
-traverse_loop(json_t * vertices)
+traverse_loop(Reader * rd)
 {
-	if (! vertices) {
+	if (! rd) {
 		throwstream(runtime_error, "missing vertices");
-    }
+	}
 
-	if (! json_is_array(vertices)) {
+	if (! rd->consume('[')) {
 		throwstream(runtime_error, "vertices are not array");
-    }
+	}
 
 	vector<S2Point> points;
 
-	for (size_t ii = 0; ii < json_array_size(vertices); ++ii) {
-		points.push_back(traverse_point(json_array_get(vertices, ii)));
-    }
+	if (! rd->consume(']')) {
+		do {
+			points.push_back(traverse_point(rd));
+		} while (rd->consume(','));
 
-	// Remove duplicate points.
-	for (size_t ii = 1; ii < points.size(); ++ii) {
-		if (points[ii - 1] == points[ii]) {
-			points.erase(points.begin() + ii);
-			--ii;
-		}
+		rd->expect(']');
 	}
 
+	// Remove duplicate points.
+	points.erase(unique(points.begin(), points.end()), points.end());
+
 	if (points.size() < 4) {
 		throwstream(runtime_error, "loop contains less than 4 points");
 	}
@@ -126,112 +440,121 @@ traverse_loop(json_t * vertices)
 }
 
 S2Polygon *
-traverse_polygon(json_t * loops)
+traverse_polygon(Reader * rd)
 {
-	if (! loops) {
+	if (! rd) {
 		throwstream(runtime_error, "missing polygon body");
-    }
+	}
 
-	if (! json_is_array(loops)) {
+	if (! rd->consume('[')) {
 		throwstream(runtime_error, "polygon body is not array");
-    }
+	}
 
 	vector<S2Loop *> loopv;
 	try
 	{
-		for (size_t ii = 0; ii < json_array_size(loops); ++ii) {
-			loopv.push_back(traverse_loop(json_array_get(loops, ii)));
-        }
-		
+		if (! rd->consume(']')) {
+			do {
+				loopv.push_back(traverse_loop(rd));
+			} while (rd->consume(','));
+
+			rd->expect(']');
+		}
+
 		return new S2Polygon(&loopv);
 	}
 	catch (...)
 	{
 		for (size_t ii = 0; ii < loopv.size(); ++ii) {
 			delete loopv[ii];
-        }
+		}
 		throw;
 	}
 }
 
-void process_point(GeoJSON::GeometryHandler & geohand, json_t * coord)
+void process_point(GeoJSON::GeometryHandler & geohand, Reader * rd)
 {
-	geohand.handle_point(S2CellId::FromPoint(traverse_point(coord)));
+	geohand.handle_point(S2CellId::FromPoint(traverse_point(rd)));
 }
 
 void
-process_polygon(GeoJSON::GeometryHandler & geohand, json_t * coord)
+process_polygon(GeoJSON::GeometryHandler & geohand, Reader * rd)
 {
-	if (! coord) {
+	if (! rd) {
 		throwstream(runtime_error, "missing coordinates");
-    }
+	}
 
-	if (! json_is_array(coord)) {
+	if (rd->peek() != '[') {
 		throwstream(runtime_error, "coordinates are not array");
-    }
+	}
 
-	S2Polygon * poly = traverse_polygon(coord);
+	S2Polygon * poly = traverse_polygon(rd);
 	if (geohand.handle_region(poly)) {
 		delete poly;
-    }
+	}
 }
 
 void
-process_multipolygon(GeoJSON::GeometryHandler & geohand, json_t * coord)
+process_multipolygon(GeoJSON::GeometryHandler & geohand, Reader * rd)
 {
-	if (! coord) {
+	if (! rd) {
 		throwstream(runtime_error, "missing coordinates");
-    }
+	}
 
-	if (! json_is_array(coord)) {
+	if (! rd->consume('[')) {
 		throwstream(runtime_error, "coordinates are not array");
-    }
+	}
 
 	auto_ptr<S2RegionUnion> regionsp(new S2RegionUnion);
 
-	for (size_t ii = 0; ii < json_array_size(coord); ++ii) {
-		regionsp->Add(traverse_polygon(json_array_get(coord, ii)));
-    }
+	if (! rd->consume(']')) {
+		do {
+			regionsp->Add(traverse_polygon(rd));
+		} while (rd->consume(','));
+
+		rd->expect(']');
+	}
 
 	if (! geohand.handle_region(regionsp.get())) {
 		// Handler took ownership.
 		regionsp.release();
-    }
+	}
 }
 
 void
-process_circle(GeoJSON::GeometryHandler & geohand, json_t * coord)
+process_circle(GeoJSON::GeometryHandler & geohand, Reader * rd)
 {
 	// {
 	//	   "type": "AeroCircle",
 	//	   "coordinates": [[-122.097837, 37.421363], 1000.0]
 	// }
 
-	if (! coord) {
+	if (! rd) {
 		throwstream(runtime_error, "missing coordinates");
-    }
+	}
 
-	if (! json_is_array(coord)) {
+	if (! rd->consume('[')) {
 		throwstream(runtime_error, "coordinates are not array");
-    }
+	}
 
-	if (json_array_size(coord) != 2) {
+	if (rd->peek() == ']') {
 		throwstream(runtime_error, "malformed circle coordinate array");
-    }
+	}
 
-	S2Point center = traverse_point(json_array_get(coord, 0));
+	S2Point center = traverse_point(rd);
+
+	if (! rd->consume(',')) {
+		throwstream(runtime_error, "malformed circle coordinate array");
+	}
 
 	double radius;
-	json_t * radiusobj = json_array_get(coord, 1);
-	if (json_is_real(radiusobj)) {
-		radius = json_real_value(radiusobj);
+	if (! rd->read_number(&radius)) {
+		throwstream(runtime_error, "radius not numeric value");
 	}
-	else if (json_is_integer(radiusobj)) {
-		radius = double(json_integer_value(radiusobj));
+
+	if (! rd->consume(']')) {
+		throwstream(runtime_error, "malformed circle coordinate array");
 	}
-	else {
-		throwstream(runtime_error, "radius not numeric value");
-    }
 
 	S1Angle angle = S1Angle::Radians(radius / geohand.earth_radius_meters());
 
@@ -240,44 +563,124 @@ process_circle(GeoJSON::GeometryHandler & geohand, json_t * coord)
 	if (! geohand.handle_region(capp.get())) {
 		// Handler took ownership.
 		capp.release();
-    }
+	}
 }
 
-void traverse_geometry(GeoJSON::GeometryHandler & geohand, json_t * geom)
-{
-	if (! geom) {
-		throwstream(runtime_error, "missing geometry element");
-    }
+void process_object(GeoJSON::GeometryHandler & geohand, Reader & rd,
+		bool top);
 
-	if (! json_is_object(geom)) {
-		throwstream(runtime_error, "geometry is not object");
-    }
+void
+process_typed(GeoJSON::GeometryHandler & geohand, string const & typestr,
+		Reader * rd, bool top)
+{
+	if (top && typestr == "Feature") {
+		if (! rd) {
+			throwstream(runtime_error, "missing geometry element");
+		}
 
-	json_t * type = json_object_get(geom, "type");
-	if (! type) {
-		throwstream(runtime_error, "missing geometry type");
-    }
-	
-	if (! json_is_string(type)) {
-		throwstream(runtime_error, "geometry type is not string");
-    }
-
-	string typestr(json_string_value(type));
-	if (typestr == "Point") {
-		process_point(geohand, json_object_get(geom, "coordinates"));
-    }
+		process_object(geohand, *rd, false);
+	}
+	else if (typestr == "Point") {
+		process_point(geohand, rd);
+	}
 	else if (typestr == "Polygon") {
-		process_polygon(geohand, json_object_get(geom, "coordinates"));
-    }
+		process_polygon(geohand, rd);
+	}
 	else if (typestr == "MultiPolygon") {
-		process_multipolygon(geohand, json_object_get(geom, "coordinates"));
-    }
+		process_multipolygon(geohand, rd);
+	}
 	else if (typestr == "AeroCircle") {
-		process_circle(geohand, json_object_get(geom, "coordinates"));
-    }
+		process_circle(geohand, rd);
+	}
+	else if (top) {
+		throwstream(runtime_error, "unknown top-level type: " << typestr);
+	}
 	else {
 		throwstream(runtime_error, "unknown geometry type: " << typestr);
-    }
+	}
+}
+
+// Members may come in any order. Once the type is known, its body is parsed as
+// it's reached - a body that comes before the type is skipped, and parsed from
+// where it started once the object is read.
+void
+process_object(GeoJSON::GeometryHandler & geohand, Reader & rd, bool top)
+{
+	if (! rd.consume('{')) {
+		if (top) {
+			throwstream(runtime_error, "top level geojson element not object");
+		}
+
+		throwstream(runtime_error, "geometry is not object");
+	}
+
+	string typestr;
+	bool have_type = false;
+	bool done = false;
+	char const * coords_pos = NULL;
+	char const * geometry_pos = NULL;
+
+	if (! rd.consume('}')) {
+		do {
+			string key = rd.read_string();
+
+			rd.expect(':');
+
+			bool is_coords = key == "coordinates";
+			bool is_geometry = top && key == "geometry";
+
+			if (key == "type" && ! have_type) {
+				if (rd.peek() != '"') {
+					if (top) {
+						throwstream(runtime_error, "top-level type is not string");
+					}
+
+					throwstream(runtime_error, "geometry type is not string");
+				}
+
+				typestr = rd.read_string();
+				have_type = true;
+			}
+			else if (! done && have_type && (is_coords || is_geometry) &&
+					is_coords != (top && typestr == "Feature")) {
+				process_typed(geohand, typestr, &rd, top);
+				done = true;
+			}
+			else {
+				if (is_coords && ! coords_pos) {
+					coords_pos = rd.pos();
+				}
+				else if (is_geometry && ! geometry_pos) {
+					geometry_pos = rd.pos();
+				}
+
+				rd.skip_value();
+			}
+		} while (rd.consume(','));
+
+		rd.expect('}');
+	}
+
+	if (! have_type) {
+		if (top) {
+			throwstream(runtime_error, "missing top-level type in geojson element");
+		}
+
+		throwstream(runtime_error, "missing geometry type");
+	}
+
+	if (! done) {
+		char const * body_pos = top && typestr == "Feature" ?
+				geometry_pos : coords_pos;
+
+		if (body_pos) {
+			Reader body = rd.at(body_pos);
+			process_typed(geohand, typestr, &body, top);
+		}
+		else {
+			process_typed(geohand, typestr, NULL, top);
+		}
+	}
 }
 
 } // end namespace
@@ -297,48 +700,13 @@ bool GeometryHandler::handle_region(S2Region * i_regionp)
 
 void parse(GeometryHandler & geohand, string const & geostr)
 {
-	json_error_t err;
-	Scoped<json_t *> geojson(json_loadb(geostr.data(), geostr.size(), 0, &err),
-							 NULL, json_decref);
-	if (! geojson) {
-		throwstream(runtime_error, "failed to parse geojson: "
-					<< err.line << ": " << err.text);
-    }
-
-	geohand.set_json(geojson);
-
-	if (! json_is_object(geojson)) {
-		throwstream(runtime_error, "top level geojson element not object");
-    }
-	
-	json_t * type = json_object_get(geojson, "type");
-	if (! type) {
-		throwstream(runtime_error, "missing top-level type in geojson element");
-    }
-	
-	if (! json_is_string(type)) {
-		throwstream(runtime_error, "top-level type is not string");
-    }
-
-	string typestr(json_string_value(type));
-	if (typestr == "Feature") {
-		traverse_geometry(geohand, json_object_get(geojson, "geometry"));
-    }
-	else if (typestr == "Point") {
-		process_point(geohand, json_object_get(geojson, "coordinates"));
-    }
-	else if (typestr == "Polygon") {
-		process_polygon(geohand, json_object_get(geojson, "coordinates"));
-    }
-	else if (typestr == "MultiPolygon") {
-		process_multipolygon(geohand, json_object_get(geojson, "coordinates"));
-    }
-	else if (typestr == "AeroCircle") {
-		process_circle(geohand, json_object_get(geojson, "coordinates"));
-    }
-	else {
-		throwstream(runtime_error, "unknown top-level type: " << typestr);
-    }
+	Reader rd(geostr.data(), geostr.data() + geostr.size());
+
+	process_object(geohand, rd, true);
+
+	if (! rd.at_end()) {
+		rd.fail("end of input expected");
+	}
 }
 
 } // end namespace GeoJSON
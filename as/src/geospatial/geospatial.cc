@@ -24,7 +24,11 @@
 #include <limits.h>
 #include <string.h>
 
+#include <list>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 #include <s2regioncoverer.h>
 
@@ -38,6 +42,62 @@ extern "C" {
 
 using namespace std;
 
+// Regions parsed from stored GeoJSON, kept per thread so matching the same
+// candidates again (e.g. repeated queries) doesn't re-parse them.
+class RegionCache
+{
+public:
+	// Bound on the JSON held as keys - roughly tracks the regions' size.
+	static const size_t MAX_JSON_SZ = 1024 * 1024;
+
+	RegionCache() : m_json_sz(0) {}
+
+	~RegionCache() {
+		for (Entries::iterator it = m_lru.begin(); it != m_lru.end(); ++it) {
+			delete it->second;
+		}
+	}
+
+	S2Region * find(string const & json) {
+		Index::iterator it = m_index.find(json);
+
+		if (it == m_index.end()) {
+			return NULL;
+		}
+
+		// Move to the front - most recently used.
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+
+		return it->second->second;
+	}
+
+	void insert(string const & json, S2Region * regionp) {
+		m_lru.push_front(make_pair(json, regionp));
+		m_index[json] = m_lru.begin();
+		m_json_sz += json.size();
+
+		// Always keep the newest, it's about to be used.
+		while (m_json_sz > MAX_JSON_SZ && m_lru.size() > 1) {
+			Entries::iterator last = --m_lru.end();
+
+			m_json_sz -= last->first.size();
+			delete last->second;
+			m_index.erase(last->first);
+			m_lru.erase(last);
+		}
+	}
+
+private:
+	typedef list< pair<string, S2Region *> > Entries;
+	typedef unordered_map<string, Entries::iterator> Index;
+
+	Entries m_lru;
+	Index m_index;
+	size_t m_json_sz;
+};
+
+static thread_local RegionCache g_region_cache;
+
 class PointRegionHandler: public GeoJSON::GeometryHandler
 {
 public:
@@ -89,6 +149,32 @@ geo_parse(as_namespace * ns,
 	}
 }
 	
+bool
+geo_parse_cached(const char * buf,
+				 size_t bufsz,
+				 uint64_t * cellidp,
+				 geo_region_t * regionp)
+{
+	string json(buf, bufsz);
+	S2Region * cachedp = g_region_cache.find(json);
+
+	if (cachedp) {
+		*cellidp = 0;
+		*regionp = (geo_region_t) cachedp;
+		return true;
+	}
+
+	if (! geo_parse(NULL, buf, bufsz, cellidp, regionp)) {
+		return false;
+	}
+
+	if (*regionp) {
+		g_region_cache.insert(json, (S2Region *) *regionp);
+	}
+
+	return true;
+}
+
 bool
 geo_region_cover(as_namespace * ns,
 				 geo_region_t region,
@@ -127,9 +213,20 @@ geo_region_cover(as_namespace * ns,
 			return false;
 		}
 	
+		// If only ranges are wanted, merge adjacent ones (the covering is
+		// sorted) so the index is searched fewer times.
+		bool merge = ! cellctrp && cellminp && cellmaxp;
+		int numcells = 0;
+
 		for (size_t ii = 0; ii < covering.size(); ++ii)
 		{
-			if (ii == (size_t) maxnumcells)
+			if (merge && numcells != 0 && covering[ii].range_min() ==
+					S2CellId(cellmaxp[numcells - 1]).next()) {
+				cellmaxp[numcells - 1] = covering[ii].range_max().id();
+				continue;
+			}
+
+			if (numcells == maxnumcells)
 			{
 				cf_warning(AS_GEO, (char *) "region covered with %zu cells, "
 						   "only %d allowed", covering.size(), maxnumcells);
@@ -137,27 +234,32 @@ geo_region_cover(as_namespace * ns,
 			}
 
 			if (cellctrp) {
-				cellctrp[ii] = covering[ii].id();
+				cellctrp[numcells] = covering[ii].id();
 			}
 			if (cellminp) {
-				cellminp[ii] = covering[ii].range_min().id();
+				cellminp[numcells] = covering[ii].range_min().id();
 			}
 			if (cellmaxp) {
-				cellmaxp[ii] = covering[ii].range_max().id();
+				cellmaxp[numcells] = covering[ii].range_max().id();
 			}
 
+			++numcells;
+		}
+
+		for (int ii = 0; ii < numcells; ++ii)
+		{
 			if (cellctrp) {
-				cf_detail(AS_GEO, (char *) "cell[%zu]: 0x%lx",
+				cf_detail(AS_GEO, (char *) "cell[%d]: 0x%lx",
 						  ii, cellctrp[ii]);
 			}
 
 			if (cellminp && cellmaxp) {
-				cf_detail(AS_GEO, (char *) "cell[%zu]: [0x%lx, 0x%lx]",
+				cf_detail(AS_GEO, (char *) "cell[%d]: [0x%lx, 0x%lx]",
 						  ii, cellminp[ii], cellmaxp[ii]);
 			}
 		}
 
-		*numcellsp = covering.size();
+		*numcellsp = numcells;
 		return true;
 	}
 	catch (exception const & ex)
@@ -39,8 +39,13 @@
 #include <unistd.h>
 #include <linux/fs.h> // for BLKGETSIZE64
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/param.h> // for MAX()
 
+#if defined(USE_ZONED)
+#include <linux/blkzoned.h>
+#endif
+
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
@@ -48,10 +53,17 @@
 #include "citrusleaf/cf_queue.h"
 #include "citrusleaf/cf_random.h"
 
+#include "compression.h"
+#include "crc32c.h"
 #include "fault.h"
+#include "hardware.h"
 #include "hist.h"
+#include "io_buf.h"
+#include "mpmc_queue.h"
+#include "uring.h"
 #include "vmapx.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
@@ -60,6 +72,8 @@
 #include "base/secondary_index.h"
 #include "base/truncate.h"
 #include "fabric/partition.h"
+#include "storage/hot_tier.h"
+#include "storage/read_cache.h"
 #include "storage/storage.h"
 #include "transaction/rw_utils.h"
 
@@ -68,7 +82,13 @@
 // Forward declarations.
 //
 
+static drv_ssd_block *ssd_read_head(drv_ssd *ssd, uint64_t rblock_id, uint32_t n_rblocks);
+static drv_ssd_block *ssd_read_chunks(drv_ssds *ssds, const drv_ssd_block *head, uint32_t *p_size);
+
 // Defined in thr_nsup.c, for historical reasons.
+extern void as_cold_start_evict_init(as_namespace* ns);
+extern void as_cold_start_evict_track(as_namespace* ns, uint32_t old_void_time, uint32_t new_void_time);
+extern void as_cold_start_evict_destroy(as_namespace* ns);
 extern bool as_cold_start_evict_if_needed(as_namespace* ns);
 
 
@@ -78,18 +98,55 @@ extern bool as_cold_start_evict_if_needed(as_namespace* ns);
 
 #define MAX_WRITE_BLOCK_SIZE	(1024 * 1024)
 #define LOAD_BUF_SIZE			MAX_WRITE_BLOCK_SIZE // must be multiple of MAX_WRITE_BLOCK_SIZE
+#define LOAD_READ_SIZE			(8 * LOAD_BUF_SIZE) // cold start read-ahead
+#define LOAD_RANGE_SIZE			(256 * LOAD_BUF_SIZE) // must be multiple of LOAD_READ_SIZE
+
+// Records bigger than a wblock are chunked - see ssd_chunk_table.
+#define SSD_MAX_CHUNKS			256
+#define MAX_RECORD_SIZE			(SSD_MAX_CHUNKS * MAX_WRITE_BLOCK_SIZE)
+
+// Chunks are read this many at a time, to bound the buffers in use at once.
+#define CHUNK_READ_BATCH		16
 
 // We round usable device/file size down to SSD_DEFAULT_HEADER_LENGTH plus a
 // multiple of LOAD_BUF_SIZE. If we ever change SSD_DEFAULT_HEADER_LENGTH we
 // may break backward compatibility since an old header with different size
 // could render the rounding ineffective. (There are backward compatibility
 // issues anyway if we think we need to change SSD_DEFAULT_HEADER_LENGTH...)
-#define SSD_DEFAULT_HEADER_LENGTH	(1024 * 1024)
+//
+// The header holds an info slice per partition, so builds with more than 4096
+// partitions have proportionally longer headers.
+#define SSD_DEFAULT_HEADER_LENGTH	(256 * AS_PARTITIONS) // 1M for 4096
 #define SSD_HEADER_INFO_STRIDE		(128)
 
+#define ZONE_REPORT_BATCH		4096
+
+// Ring slots for swb_write_q - deeper queues spill to its locked overflow.
+#define SWB_WRITE_Q_CAPACITY	1024
+
 #define DEFRAG_STARTUP_RESERVE	4
 #define DEFRAG_RUNTIME_RESERVE	4
 
+// Adaptive defrag - rate may range this factor either side of the baseline
+// implied by defrag-sleep, and is re-evaluated at this interval.
+#define DEFRAG_ADAPT_RANGE			16
+#define DEFRAG_ADAPT_INTERVAL_us	(1000 * 250)
+
+// I/O scheduler - a class may start I/O only while the device's in-flight I/O
+// of its own and more urgent classes is under its limit (0 means no limit).
+// Waits are bounded, so background I/O slows under client load but never
+// stops - defrag in particular must keep freeing wblocks.
+static const uint32_t SSD_IO_CLASS_LIMITS[SSD_IO_N_CLASSES] = {
+		0,	// SSD_IO_CLIENT_READ
+		0,	// SSD_IO_FLUSH
+		32,	// SSD_IO_MIGRATE
+		16,	// SSD_IO_SCAN
+		8	// SSD_IO_DEFRAG
+};
+
+#define SSD_IO_WAIT_us		100
+#define SSD_IO_MAX_WAITS	100 // give up waiting after 10 milliseconds
+
 
 //==========================================================
 // Typedefs.
@@ -180,273 +237,843 @@ ssd_get_file_id(drv_ssds *ssds, cf_digest *keyd)
 }
 
 
-// Put a wblock on the free queue for reuse.
-void
-push_wblock_to_free_q(drv_ssd *ssd, uint32_t wblock_id, e_free_to free_to)
+// Every chunk but a record's last fills a wblock.
+static inline uint32_t
+ssd_chunk_data_size(uint32_t write_block_size)
 {
-	if (! ssd->free_wblock_q) { // null until devices are loaded at startup
-		return;
-	}
+	return write_block_size - (uint32_t)sizeof(drv_ssd_block);
+}
 
-	// temp debugging:
-	if (wblock_id >= ssd->alloc_table->n_wblocks) {
-		cf_warning(AS_DRV_SSD, "pushing invalid wblock_id %d to free_wblock_q",
-				(int32_t)wblock_id);
-		return;
-	}
 
-	if (free_to == FREE_TO_HEAD) {
-		cf_queue_push_head(ssd->free_wblock_q, &wblock_id);
+// The biggest record block that can be stored, chunked if necessary - the
+// head's chunk table must fit in a wblock.
+static inline uint32_t
+ssd_max_record_size(uint32_t write_block_size)
+{
+	uint32_t table_size = sizeof(drv_ssd_block) + sizeof(ssd_chunk_table);
+
+	if (write_block_size < table_size + (2 * sizeof(ssd_chunk_ref))) {
+		return write_block_size;
 	}
-	else {
-		cf_queue_push(ssd->free_wblock_q, &wblock_id);
+
+	uint32_t max_chunks = (write_block_size - table_size) /
+			sizeof(ssd_chunk_ref);
+
+	if (max_chunks > SSD_MAX_CHUNKS) {
+		max_chunks = SSD_MAX_CHUNKS;
 	}
+
+	return max_chunks * ssd_chunk_data_size(write_block_size);
 }
 
 
-// Put a wblock on the defrag queue.
-static inline void
-push_wblock_to_defrag_q(drv_ssd *ssd, uint32_t wblock_id)
+//------------------------------------------------
+// I/O scheduler - see SSD_IO_CLASS_LIMITS.
+//
+
+// A thread's reads are classed by what the thread does.
+static inline ssd_io_class
+ssd_read_io_class()
 {
-	if (ssd->defrag_wblock_q) { // null until devices are loaded at startup
-		ssd->alloc_table->wblock_state[wblock_id].state = WBLOCK_STATE_DEFRAG;
-		cf_queue_push(ssd->defrag_wblock_q, &wblock_id);
-		cf_atomic64_incr(&ssd->n_defrag_wblock_reads);
+	switch (as_storage_get_io_class()) {
+	case AS_STORAGE_IO_MIGRATE:
+		return SSD_IO_MIGRATE;
+	case AS_STORAGE_IO_SCAN:
+		return SSD_IO_SCAN;
+	case AS_STORAGE_IO_CLIENT:
+	default:
+		return SSD_IO_CLIENT_READ;
 	}
 }
 
 
-// Available contiguous size.
-static inline uint64_t
-available_size(drv_ssd *ssd)
+static inline bool
+ssd_io_has_room(drv_ssd *ssd, ssd_io_class io_class)
 {
-	return ssd->free_wblock_q ? // null until devices are loaded at startup
-			(uint64_t)cf_queue_sz(ssd->free_wblock_q) * ssd->write_block_size :
-			ssd->file_size;
-
-	// Note - returns 100% available during cold start, to make it irrelevant in
-	// cold-start eviction threshold check.
-}
+	uint32_t limit = SSD_IO_CLASS_LIMITS[io_class];
 
+	if (limit == 0) {
+		return true;
+	}
 
-// Since UDF writes can't yet unwind on failure, we ensure that they'll succeed
-// by checking before writing on all threads that there's at least one wblock
-// per thread. TODO - deprecate this methodology when everything can unwind.
-static inline int
-min_free_wblocks(as_namespace *ns)
-{
-	// Data-in-memory namespaces process transactions in service threads.
-	int n_service_threads = ns->storage_data_in_memory ?
-			(int)g_config.n_service_threads : 0;
+	uint32_t n_ahead = 0;
 
-	int n_transaction_threads = (int)
-			(g_config.n_transaction_queues * g_config.n_transaction_threads_per_queue);
+	for (uint32_t c = 0; c <= (uint32_t)io_class; c++) {
+		n_ahead += (uint32_t)cf_atomic32_get(ssd->io_in_flight[c]);
+	}
 
-	return	n_service_threads +			// client writes
-			n_transaction_threads +		// client writes
-			g_config.n_fabric_channel_recv_threads[AS_FABRIC_CHANNEL_RW] + // prole writes
-			g_config.n_fabric_channel_recv_threads[AS_FABRIC_CHANNEL_BULK] + // migration writes
-			1 +							// always 1 defrag thread
-			DEFRAG_RUNTIME_RESERVE +	// reserve for defrag at runtime
-			DEFRAG_STARTUP_RESERVE;		// reserve for defrag at startup
+	return n_ahead < limit;
 }
 
 
-//------------------------------------------------
-// ssd_write_buf "swb" methods.
-//
-
-static inline ssd_write_buf*
-swb_create(drv_ssd *ssd)
+// Returns false without starting if the class has no room now.
+static inline bool
+ssd_io_try_start(drv_ssd *ssd, ssd_io_class io_class)
 {
-	ssd_write_buf *swb = (ssd_write_buf*)cf_malloc(sizeof(ssd_write_buf));
-
-	if (! swb) {
-		cf_warning(AS_DRV_SSD, "device %s - swb malloc failed", ssd->name);
-		return NULL;
+	if (! ssd_io_has_room(ssd, io_class)) {
+		return false;
 	}
 
-	swb->buf = cf_valloc(ssd->write_block_size);
-
-	if (! swb->buf) {
-		cf_warning(AS_DRV_SSD, "device %s - swb buf valloc failed", ssd->name);
-		cf_free(swb);
-		return NULL;
-	}
+	cf_atomic32_incr(&ssd->io_in_flight[io_class]);
 
-	return swb;
+	return true;
 }
 
-static inline void
-swb_destroy(ssd_write_buf *swb)
+
+static void
+ssd_io_start(drv_ssd *ssd, ssd_io_class io_class)
 {
-	cf_free(swb->buf);
-	cf_free(swb);
+	for (uint32_t n = 0; n < SSD_IO_MAX_WAITS &&
+			! ssd_io_has_room(ssd, io_class); n++) {
+		usleep(SSD_IO_WAIT_us);
+	}
+
+	cf_atomic32_incr(&ssd->io_in_flight[io_class]);
 }
 
+
 static inline void
-swb_reset(ssd_write_buf *swb)
+ssd_io_finish(drv_ssd *ssd, ssd_io_class io_class)
 {
-	swb->skip_post_write_q = false;
-	swb->wblock_id = STORAGE_INVALID_WBLOCK;
-	swb->pos = 0;
+	cf_atomic32_decr(&ssd->io_in_flight[io_class]);
 }
 
-#define swb_reserve(_swb) cf_atomic32_incr(&(_swb)->rc)
 
-static inline void
-swb_check_and_reserve(ssd_wblock_state *wblock_state, ssd_write_buf **p_swb)
+//------------------------------------------------
+// Persistent memory methods.
+//
+// With persistent-memory, each device (or file on a DAX filesystem) is mapped,
+// and wblock data is copied to and from the mapping instead of using pread()
+// and pwrite(). Writes are made durable by flushing the CPU cache lines they
+// touched - or, if the mapping couldn't be made synchronous, with msync().
+// Device headers still go through the fd.
+//
+
+#define PMEM_CACHE_LINE_SIZE 64
+#define PMEM_PAGE_SIZE 4096
+
+#if defined(__x86_64__)
+#define PMEM_CAN_FLUSH true
+#define pmem_flush_line(p) __builtin_ia32_clflush(p)
+#define pmem_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(__aarch64__)
+#define PMEM_CAN_FLUSH true
+#define pmem_flush_line(p) __asm__ volatile("dc cvac, %0" : : "r" (p) : "memory")
+#define pmem_fence() __asm__ volatile("dsb ish" : : : "memory")
+#else
+#define PMEM_CAN_FLUSH false
+#define pmem_flush_line(p)
+#define pmem_fence()
+#endif
+
+static void
+pmem_persist(drv_ssd *ssd, const uint8_t *p, size_t size)
 {
-	pthread_mutex_lock(&wblock_state->LOCK);
+	if (ssd->pmem_sync) {
+		const uint8_t *end = p + size;
 
-	if (wblock_state->swb) {
-		*p_swb = wblock_state->swb;
-		swb_reserve(*p_swb);
-	}
+		p = (const uint8_t *)((uintptr_t)p & ~(uintptr_t)(PMEM_CACHE_LINE_SIZE - 1));
 
-	pthread_mutex_unlock(&wblock_state->LOCK);
-}
+		while (p < end) {
+			pmem_flush_line(p);
+			p += PMEM_CACHE_LINE_SIZE;
+		}
 
-static inline void
-swb_release(ssd_write_buf *swb)
-{
-	if (0 == cf_atomic32_decr(&swb->rc)) {
-		swb_reset(swb);
+		pmem_fence();
+		return;
+	}
 
-		// Put the swb back on the free queue for reuse.
-		cf_queue_push(swb->ssd->swb_free_q, &swb);
+	uintptr_t start = (uintptr_t)p & ~(uintptr_t)(PMEM_PAGE_SIZE - 1);
+
+	if (msync((void *)start, (uintptr_t)p + size - start, MS_SYNC) != 0) {
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED msync: errno %d (%s)",
+				ssd->name, errno, cf_strerror(errno));
 	}
 }
 
-static inline void
-swb_dereference_and_release(drv_ssd *ssd, uint32_t wblock_id,
-		ssd_write_buf *swb)
+// Same contract as pread(), for either kind of device.
+static inline ssize_t
+ssd_pread(drv_ssd *ssd, int fd, void *buf, size_t size, off_t offset)
 {
-	ssd_wblock_state *wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
-
-	pthread_mutex_lock(&wblock_state->LOCK);
+	if (! ssd->pmem_base) {
+		return pread(fd, buf, size, offset);
+	}
 
-	if (swb != wblock_state->swb) {
-		cf_warning(AS_DRV_SSD, "releasing wrong swb! %p (%d) != %p (%d), thread %lu",
-			swb, (int32_t)swb->wblock_id, wblock_state->swb,
-			(int32_t)wblock_state->swb->wblock_id, pthread_self());
+	if (offset < 0 || offset + (off_t)size > ssd->file_size) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	swb_release(wblock_state->swb);
-	wblock_state->swb = 0;
+	memcpy(buf, ssd->pmem_base + offset, size);
 
-	if (wblock_state->state != WBLOCK_STATE_DEFRAG) {
-		uint32_t inuse_sz = cf_atomic32_get(wblock_state->inuse_sz);
+	return (ssize_t)size;
+}
 
-		// Free wblock if all three gating conditions hold.
-		if (inuse_sz == 0) {
-			push_wblock_to_free_q(ssd, wblock_id, FREE_TO_HEAD);
-		}
-		// Queue wblock for defrag if applicable.
-		else if (inuse_sz < ssd->ns->defrag_lwm_size) {
-			push_wblock_to_defrag_q(ssd, wblock_id);
-		}
+// Same contract as pwrite(), for either kind of device. Returns only when the
+// data is durable if the device is mapped.
+static inline ssize_t
+ssd_pwrite(drv_ssd *ssd, int fd, const void *buf, size_t size, off_t offset)
+{
+	if (! ssd->pmem_base) {
+		return pwrite(fd, buf, size, offset);
 	}
-	else {
-		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u state is DEFRAG on swb release",
-				ssd->name, wblock_id);
+
+	if (offset < 0 || offset + (off_t)size > ssd->file_size) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	pthread_mutex_unlock(&wblock_state->LOCK);
+	memcpy(ssd->pmem_base + offset, buf, size);
+	pmem_persist(ssd, ssd->pmem_base + offset, size);
+
+	return (ssize_t)size;
 }
 
-ssd_write_buf *
-swb_get(drv_ssd *ssd)
+static void
+ssd_pmem_init(drv_ssd *ssd)
 {
-	ssd_write_buf *swb;
-
-	if (CF_QUEUE_OK != cf_queue_pop(ssd->swb_free_q, &swb, CF_QUEUE_NOWAIT)) {
-		if (! (swb = swb_create(ssd))) {
-			return NULL;
-		}
+	int fd = open(ssd->name, ssd->open_flag, S_IRUSR | S_IWUSR);
 
-		swb->rc = 0;
-		swb->n_writers = 0;
-		swb->skip_post_write_q = false;
-		swb->ssd = ssd;
-		swb->wblock_id = STORAGE_INVALID_WBLOCK;
-		swb->pos = 0;
+	if (fd == -1) {
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED open: errno %d (%s)",
+				ssd->name, errno, cf_strerror(errno));
 	}
 
-	// Find a device block to write to.
-	if (CF_QUEUE_OK != cf_queue_pop(ssd->free_wblock_q, &swb->wblock_id,
-			CF_QUEUE_NOWAIT)) {
-		cf_queue_push(ssd->swb_free_q, &swb);
-		return NULL;
+	void *base = MAP_FAILED;
+
+#if defined(MAP_SYNC) && defined(MAP_SHARED_VALIDATE)
+	if (PMEM_CAN_FLUSH) {
+		base = mmap(NULL, (size_t)ssd->file_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED_VALIDATE | MAP_SYNC, fd, 0);
 	}
+#endif
 
-	ssd_wblock_state* p_wblock_state =
-			&ssd->alloc_table->wblock_state[swb->wblock_id];
+	ssd->pmem_sync = base != MAP_FAILED;
 
-	// Sanity checks.
-	if (cf_atomic32_get(p_wblock_state->inuse_sz) != 0) {
-		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u inuse-size %u off free-q",
-				ssd->name, swb->wblock_id,
-				cf_atomic32_get(p_wblock_state->inuse_sz));
-	}
-	if (p_wblock_state->swb) {
-		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u swb not null off free-q",
-				ssd->name, swb->wblock_id);
-	}
-	if (p_wblock_state->state != WBLOCK_STATE_NONE) {
-		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u state not NONE off free-q",
-				ssd->name, swb->wblock_id);
-	}
+	if (! ssd->pmem_sync) {
+		base = mmap(NULL, (size_t)ssd->file_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
 
-	pthread_mutex_lock(&p_wblock_state->LOCK);
+		if (base == MAP_FAILED) {
+			cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED mmap: errno %d (%s)",
+					ssd->name, errno, cf_strerror(errno));
+		}
 
-	swb_reserve(swb);
-	p_wblock_state->swb = swb;
+		cf_warning(AS_DRV_SSD, "%s: can't map synchronously (not DAX?) - will persist with msync",
+				ssd->name);
+	}
 
-	pthread_mutex_unlock(&p_wblock_state->LOCK);
+	close(fd);
 
-	return swb;
+	ssd->pmem_base = (uint8_t *)base;
+
+	cf_info(AS_DRV_SSD, "%s: mapped %lu bytes of persistent memory",
+			ssd->name, ssd->file_size);
 }
 
-//
-// END - ssd_write_buf "swb" methods.
+
 //------------------------------------------------
+// Zoned device methods.
+//
+// free_wblock_q holds whole zones, each in wblock order. A stream takes a whole
+// zone at a time, and since one write thread flushes swbs in queue order, each
+// zone is written sequentially. Freed wblocks can't be rewritten until their
+// zone is reset, which happens when the last of them is freed.
+//
 
+static inline uint32_t
+zone_usable_n_wblocks(drv_ssd *ssd, uint32_t zone_id)
+{
+	uint32_t first_id = zone_id * ssd->zone_n_wblocks;
+	uint32_t n_left = ssd->alloc_table->n_wblocks - first_id;
 
-// Reduce wblock's used size, if result is 0 put it in the "free" pool, if it's
-// below the defrag threshold put it in the defrag queue.
-void
-ssd_block_free(drv_ssd *ssd, uint64_t rblock_id, uint64_t n_rblocks, char *msg)
+	return n_left < ssd->zone_capacity ? n_left : ssd->zone_capacity;
+}
+
+#if defined(USE_ZONED)
+
+static void
+zone_reset(drv_ssd *ssd, uint32_t zone_id)
 {
-	if (n_rblocks == 0) {
-		cf_warning(AS_DRV_SSD, "%s: %s: freeing 0 rblocks, rblock_id %lu",
-				ssd->name, msg, rblock_id);
-		return;
-	}
+	uint64_t zone_size = (uint64_t)ssd->zone_n_wblocks * ssd->write_block_size;
+	struct blk_zone_range range = {
+			.sector = (zone_id * zone_size) >> 9,
+			.nr_sectors = zone_size >> 9
+	};
 
-	// Determine which wblock we're reducing used size in.
-	uint64_t start_byte = RBLOCKS_TO_BYTES(rblock_id);
-	uint64_t size = RBLOCKS_TO_BYTES(n_rblocks);
-	uint32_t wblock_id = BYTES_TO_WBLOCK_ID(ssd, start_byte);
-	uint32_t end_wblock_id = BYTES_TO_WBLOCK_ID(ssd, start_byte + size - 1);
-	ssd_alloc_table *at = ssd->alloc_table;
+	int fd = ssd_fd_get(ssd);
 
-	// Sanity-checks.
-	if (! (start_byte >= ssd->header_size && wblock_id < at->n_wblocks &&
-			wblock_id == end_wblock_id)) {
-		cf_warning(AS_DRV_SSD, "%s: %s: invalid range to free, rblock_id %lu, n_rblocks %lu",
-				ssd->name, msg, rblock_id, n_rblocks);
-		return;
+	if (ioctl(fd, BLKRESETZONE, &range) != 0) {
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED zone reset: zone %u: errno %d (%s)",
+				ssd->name, zone_id, errno, cf_strerror(errno));
 	}
 
-	cf_atomic64_sub(&ssd->inuse_size, size);
+	ssd_fd_put(ssd, fd);
+}
 
-	ssd_wblock_state *p_wblock_state = &at->wblock_state[wblock_id];
+#else // ! USE_ZONED
 
-	pthread_mutex_lock(&p_wblock_state->LOCK);
+static void
+zone_reset(drv_ssd *ssd, uint32_t zone_id)
+{
+	// Unreachable - ssd_zone_init() fails.
+}
 
-	int64_t resulting_inuse_sz = cf_atomic32_sub(&p_wblock_state->inuse_sz,
-			(int32_t)size);
+#endif // USE_ZONED
+
+// Call with zone_lock held.
+static void
+zone_push_free_wblocks(drv_ssd *ssd, uint32_t zone_id)
+{
+	uint32_t wblock_id = zone_id * ssd->zone_n_wblocks;
+	uint32_t end_id = wblock_id + zone_usable_n_wblocks(ssd, zone_id);
+
+	for ( ; wblock_id < end_id; wblock_id++) {
+		cf_queue_push(ssd->free_wblock_q, &wblock_id);
+	}
+}
+
+static void
+zone_free_wblock(drv_ssd *ssd, uint32_t wblock_id)
+{
+	uint32_t zone_id = wblock_id / ssd->zone_n_wblocks;
+	uint32_t n_usable = zone_usable_n_wblocks(ssd, zone_id);
+
+	pthread_mutex_lock(&ssd->zone_lock);
+
+	uint32_t n_free = ++ssd->zone_n_free[zone_id];
+
+	if (n_free == n_usable) {
+		ssd->zone_n_free[zone_id] = 0;
+		zone_reset(ssd, zone_id);
+		zone_push_free_wblocks(ssd, zone_id);
+	}
+
+	pthread_mutex_unlock(&ssd->zone_lock);
+
+	// Zone just became less than lwm-pct used - defrag the rest of it. (Caller
+	// holds a wblock lock, so leave that to the maintenance thread.)
+	if (n_usable - n_free ==
+			(n_usable * ssd->ns->storage_defrag_lwm_pct) / 100) {
+		cf_queue_push(ssd->zone_sweep_q, &zone_id);
+	}
+}
+
+// Call with the stream's lock held.
+static bool
+zone_pop_free_wblock(drv_ssd *ssd, e_swb_stream stream, uint32_t *p_wblock_id)
+{
+	ssd_zone_cursor *zc = &ssd->zone_cursors[stream];
+
+	if (zc->n_wblocks_left == 0) {
+		uint32_t first_id;
+
+		pthread_mutex_lock(&ssd->zone_lock);
+
+		if (CF_QUEUE_OK != cf_queue_pop(ssd->free_wblock_q, &first_id,
+				CF_QUEUE_NOWAIT)) {
+			pthread_mutex_unlock(&ssd->zone_lock);
+			return false;
+		}
+
+		uint32_t n_usable = zone_usable_n_wblocks(ssd,
+				first_id / ssd->zone_n_wblocks);
+
+		// The rest of the zone follows in order - take it all.
+		for (uint32_t i = 1; i < n_usable; i++) {
+			uint32_t wblock_id;
+
+			cf_queue_pop(ssd->free_wblock_q, &wblock_id, CF_QUEUE_NOWAIT);
+		}
+
+		pthread_mutex_unlock(&ssd->zone_lock);
+
+		zc->next_wblock_id = first_id;
+		zc->n_wblocks_left = n_usable;
+	}
+
+	*p_wblock_id = zc->next_wblock_id++;
+	zc->n_wblocks_left--;
+
+	return true;
+}
+
+//
+// END - Zoned device methods.
+//------------------------------------------------
+
+
+// Put a wblock on the free queue for reuse.
+void
+push_wblock_to_free_q(drv_ssd *ssd, uint32_t wblock_id, e_free_to free_to)
+{
+	if (! ssd->free_wblock_q) { // null until devices are loaded at startup
+		return;
+	}
+
+	// temp debugging:
+	if (wblock_id >= ssd->alloc_table->n_wblocks) {
+		cf_warning(AS_DRV_SSD, "pushing invalid wblock_id %d to free_wblock_q",
+				(int32_t)wblock_id);
+		return;
+	}
+
+	if (ssd->zone_n_wblocks != 0) {
+		zone_free_wblock(ssd, wblock_id);
+		return;
+	}
+
+	if (free_to == FREE_TO_HEAD) {
+		cf_queue_push_head(ssd->free_wblock_q, &wblock_id);
+	}
+	else {
+		cf_queue_push(ssd->free_wblock_q, &wblock_id);
+	}
+}
+
+
+//------------------------------------------------
+// defrag_q class.
+//
+
+static inline uint32_t
+defrag_bucket(const drv_ssd *ssd, uint32_t inuse_sz)
+{
+	uint32_t bucket = (uint32_t)
+			(((uint64_t)inuse_sz * SSD_DEFRAG_N_BUCKETS) / ssd->write_block_size);
+
+	return bucket < SSD_DEFRAG_N_BUCKETS ? bucket : SSD_DEFRAG_N_BUCKETS - 1;
+}
+
+static ssd_defrag_q *
+defrag_q_create()
+{
+	ssd_defrag_q *dq = cf_malloc(sizeof(ssd_defrag_q));
+
+	if (! dq) {
+		return NULL;
+	}
+
+	memset(dq, 0, sizeof(ssd_defrag_q));
+	pthread_mutex_init(&dq->lock, NULL);
+	pthread_cond_init(&dq->cond, NULL);
+
+	for (uint32_t b = 0; b < SSD_DEFRAG_N_BUCKETS; b++) {
+		// Not thread-safe - always used under the defrag_q lock.
+		if (! (dq->buckets[b] = cf_queue_create(sizeof(uint32_t), false))) {
+			return NULL;
+		}
+	}
+
+	return dq;
+}
+
+// Caller holds the wblock's lock, or is loading queues at startup.
+static void
+defrag_q_push(drv_ssd *ssd, uint32_t wblock_id, bool to_head)
+{
+	ssd_defrag_q *dq = ssd->defrag_q;
+	ssd_wblock_state *wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+	uint32_t bucket = defrag_bucket(ssd,
+			cf_atomic32_get(wblock_state->inuse_sz));
+
+	pthread_mutex_lock(&dq->lock);
+
+	wblock_state->defrag_bucket = (uint8_t)bucket;
+
+	if (to_head) {
+		cf_queue_push_head(dq->buckets[bucket], &wblock_id);
+	}
+	else {
+		cf_queue_push(dq->buckets[bucket], &wblock_id);
+	}
+
+	dq->n_wblocks++;
+	dq->n_bucket_wblocks[bucket]++;
+
+	pthread_cond_signal(&dq->cond);
+	pthread_mutex_unlock(&dq->lock);
+}
+
+// A queued wblock has emptied further - move it to its new bucket. Caller
+// holds the wblock's lock.
+static void
+defrag_q_rebucket(drv_ssd *ssd, uint32_t wblock_id, uint32_t inuse_sz)
+{
+	ssd_defrag_q *dq = ssd->defrag_q;
+
+	if (! dq) { // null until devices are loaded at startup
+		return;
+	}
+
+	ssd_wblock_state *wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+	uint32_t bucket = defrag_bucket(ssd, inuse_sz);
+
+	pthread_mutex_lock(&dq->lock);
+
+	uint32_t old_bucket = wblock_state->defrag_bucket;
+
+	// Note - a wblock being defragged has no bucket.
+	if (old_bucket != SSD_DEFRAG_NO_BUCKET && bucket < old_bucket) {
+		wblock_state->defrag_bucket = (uint8_t)bucket;
+		cf_queue_push(dq->buckets[bucket], &wblock_id);
+
+		dq->n_bucket_wblocks[old_bucket]--;
+		dq->n_bucket_wblocks[bucket]++;
+	}
+
+	pthread_mutex_unlock(&dq->lock);
+}
+
+// Pop the emptiest queued wblock. Returns false if there's none and we're not
+// to wait.
+static bool
+defrag_q_pop(drv_ssd *ssd, uint32_t *p_wblock_id, bool wait)
+{
+	ssd_defrag_q *dq = ssd->defrag_q;
+
+	pthread_mutex_lock(&dq->lock);
+
+	while (dq->n_wblocks == 0) {
+		if (! wait) {
+			pthread_mutex_unlock(&dq->lock);
+			return false;
+		}
+
+		pthread_cond_wait(&dq->cond, &dq->lock);
+	}
+
+	for (uint32_t b = 0; b < SSD_DEFRAG_N_BUCKETS; b++) {
+		uint32_t wblock_id;
+
+		while (cf_queue_pop(dq->buckets[b], &wblock_id, CF_QUEUE_NOWAIT) ==
+				CF_QUEUE_OK) {
+			ssd_wblock_state *wblock_state =
+					&ssd->alloc_table->wblock_state[wblock_id];
+
+			if (wblock_state->defrag_bucket != b) {
+				continue; // stale - wblock moved to an emptier bucket
+			}
+
+			wblock_state->defrag_bucket = SSD_DEFRAG_NO_BUCKET;
+			dq->n_wblocks--;
+			dq->n_bucket_wblocks[b]--;
+
+			pthread_mutex_unlock(&dq->lock);
+
+			*p_wblock_id = wblock_id;
+
+			return true;
+		}
+	}
+
+	cf_crash(AS_DRV_SSD, "%s: defrag queue has %u wblocks but no entries",
+			ssd->name, dq->n_wblocks);
+
+	return false;
+}
+
+static inline uint32_t
+defrag_q_size(const drv_ssd *ssd)
+{
+	return ssd->defrag_q ? ssd->defrag_q->n_wblocks : 0;
+}
+
+// Log queued wblocks per bucket, up to the highest non-empty one.
+static void
+defrag_q_dump(drv_ssd *ssd, const char *tag)
+{
+	ssd_defrag_q *dq = ssd->defrag_q;
+	uint32_t counts[SSD_DEFRAG_N_BUCKETS];
+
+	pthread_mutex_lock(&dq->lock);
+	memcpy(counts, dq->n_bucket_wblocks, sizeof(counts));
+	pthread_mutex_unlock(&dq->lock);
+
+	uint32_t n_buckets = SSD_DEFRAG_N_BUCKETS;
+
+	while (n_buckets > 1 && counts[n_buckets - 1] == 0) {
+		n_buckets--;
+	}
+
+	char buf[SSD_DEFRAG_N_BUCKETS * 11 + 1];
+	int pos = sprintf(buf, "%u", counts[0]);
+
+	for (uint32_t b = 1; b < n_buckets; b++) {
+		pos += sprintf(buf + pos, ",%u", counts[b]);
+	}
+
+	cf_info(AS_DRV_SSD, "{%s} %s: %s defrag profile: %s", ssd->ns->name,
+			ssd->name, tag, buf);
+}
+
+//
+// END - defrag_q class.
+//------------------------------------------------
+
+
+// Put a wblock on the defrag queue.
+static inline void
+push_wblock_to_defrag_q(drv_ssd *ssd, uint32_t wblock_id)
+{
+	if (ssd->defrag_q) { // null until devices are loaded at startup
+		ssd->alloc_table->wblock_state[wblock_id].state = WBLOCK_STATE_DEFRAG;
+		defrag_q_push(ssd, wblock_id, false);
+		cf_atomic64_incr(&ssd->n_defrag_wblock_reads);
+	}
+}
+
+
+// Available contiguous size.
+static inline uint64_t
+available_size(drv_ssd *ssd)
+{
+	return ssd->free_wblock_q ? // null until devices are loaded at startup
+			(uint64_t)cf_queue_sz(ssd->free_wblock_q) * ssd->write_block_size :
+			ssd->file_size;
+
+	// Note - returns 100% available during cold start, to make it irrelevant in
+	// cold-start eviction threshold check.
+}
+
+
+// Since UDF writes can't yet unwind on failure, we ensure that they'll succeed
+// by checking before writing on all threads that there's at least one wblock
+// per thread. TODO - deprecate this methodology when everything can unwind.
+static inline int
+min_free_wblocks(as_namespace *ns)
+{
+	// Data-in-memory namespaces process transactions in service threads.
+	int n_service_threads = ns->storage_data_in_memory ?
+			(int)g_config.n_service_threads : 0;
+
+	int n_transaction_threads = (int)
+			(g_config.n_transaction_queues * g_config.n_transaction_threads_per_queue);
+
+	return	n_service_threads +			// client writes
+			n_transaction_threads +		// client writes
+			g_config.n_fabric_channel_recv_threads[AS_FABRIC_CHANNEL_RW] + // prole writes
+			g_config.n_fabric_channel_recv_threads[AS_FABRIC_CHANNEL_BULK] + // migration writes
+			1 +							// always 1 defrag thread
+			DEFRAG_RUNTIME_RESERVE +	// reserve for defrag at runtime
+			DEFRAG_STARTUP_RESERVE;		// reserve for defrag at startup
+}
+
+
+//------------------------------------------------
+// ssd_write_buf "swb" methods.
+//
+
+static inline ssd_write_buf*
+swb_create(drv_ssd *ssd)
+{
+	ssd_write_buf *swb = (ssd_write_buf*)cf_malloc(sizeof(ssd_write_buf));
+
+	if (! swb) {
+		cf_warning(AS_DRV_SSD, "device %s - swb malloc failed", ssd->name);
+		return NULL;
+	}
+
+	swb->buf = cf_valloc(ssd->write_block_size);
+
+	if (! swb->buf) {
+		cf_warning(AS_DRV_SSD, "device %s - swb buf valloc failed", ssd->name);
+		cf_free(swb);
+		return NULL;
+	}
+
+	return swb;
+}
+
+static inline void
+swb_destroy(ssd_write_buf *swb)
+{
+	cf_free(swb->buf);
+	cf_free(swb);
+}
+
+static inline void
+swb_reset(ssd_write_buf *swb)
+{
+	swb->skip_post_write_q = false;
+	swb->wblock_id = STORAGE_INVALID_WBLOCK;
+	swb->pos = 0;
+	swb->committed_pos = 0;
+	swb->committing = false;
+}
+
+#define swb_reserve(_swb) cf_atomic32_incr(&(_swb)->rc)
+
+static inline void
+swb_check_and_reserve(ssd_wblock_state *wblock_state, ssd_write_buf **p_swb)
+{
+	pthread_mutex_lock(&wblock_state->LOCK);
+
+	if (wblock_state->swb) {
+		*p_swb = wblock_state->swb;
+		swb_reserve(*p_swb);
+	}
+
+	pthread_mutex_unlock(&wblock_state->LOCK);
+}
+
+static inline void
+swb_release(ssd_write_buf *swb)
+{
+	if (0 == cf_atomic32_decr(&swb->rc)) {
+		swb_reset(swb);
+
+		// Put the swb back on the free queue for reuse.
+		cf_queue_push(swb->ssd->swb_free_q, &swb);
+	}
+}
+
+static inline void
+swb_dereference_and_release(drv_ssd *ssd, uint32_t wblock_id,
+		ssd_write_buf *swb)
+{
+	ssd_wblock_state *wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+
+	pthread_mutex_lock(&wblock_state->LOCK);
+
+	if (swb != wblock_state->swb) {
+		cf_warning(AS_DRV_SSD, "releasing wrong swb! %p (%d) != %p (%d), thread %lu",
+			swb, (int32_t)swb->wblock_id, wblock_state->swb,
+			(int32_t)wblock_state->swb->wblock_id, pthread_self());
+	}
+
+	swb_release(wblock_state->swb);
+	wblock_state->swb = 0;
+
+	if (wblock_state->state != WBLOCK_STATE_DEFRAG) {
+		uint32_t inuse_sz = cf_atomic32_get(wblock_state->inuse_sz);
+
+		// Free wblock if all three gating conditions hold.
+		if (inuse_sz == 0) {
+			push_wblock_to_free_q(ssd, wblock_id, FREE_TO_HEAD);
+		}
+		// Queue wblock for defrag if applicable.
+		else if (inuse_sz < ssd->ns->defrag_lwm_size) {
+			push_wblock_to_defrag_q(ssd, wblock_id);
+		}
+	}
+	else {
+		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u state is DEFRAG on swb release",
+				ssd->name, wblock_id);
+	}
+
+	pthread_mutex_unlock(&wblock_state->LOCK);
+}
+
+ssd_write_buf *
+swb_get(drv_ssd *ssd, e_swb_stream stream)
+{
+	ssd_write_buf *swb;
+
+	if (CF_QUEUE_OK != cf_queue_pop(ssd->swb_free_q, &swb, CF_QUEUE_NOWAIT)) {
+		if (! (swb = swb_create(ssd))) {
+			return NULL;
+		}
+
+		swb->rc = 0;
+		swb->n_writers = 0;
+		swb->skip_post_write_q = false;
+		swb->ssd = ssd;
+		swb->wblock_id = STORAGE_INVALID_WBLOCK;
+		swb->pos = 0;
+		swb->committed_pos = 0;
+		swb->committing = false;
+	}
+
+	if (ssd->ns->storage_commit_to_device) {
+		// Partial commits may write the unused end of the last io unit - it
+		// mustn't hold stale records from the buffer's previous use.
+		memset(swb->buf, 0, ssd->write_block_size);
+	}
+
+	// Find a device block to write to.
+	if (ssd->zone_n_wblocks != 0 ?
+			! zone_pop_free_wblock(ssd, stream, &swb->wblock_id) :
+			CF_QUEUE_OK != cf_queue_pop(ssd->free_wblock_q, &swb->wblock_id,
+					CF_QUEUE_NOWAIT)) {
+		cf_queue_push(ssd->swb_free_q, &swb);
+		return NULL;
+	}
+
+	ssd_wblock_state* p_wblock_state =
+			&ssd->alloc_table->wblock_state[swb->wblock_id];
+
+	// Sanity checks.
+	if (cf_atomic32_get(p_wblock_state->inuse_sz) != 0) {
+		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u inuse-size %u off free-q",
+				ssd->name, swb->wblock_id,
+				cf_atomic32_get(p_wblock_state->inuse_sz));
+	}
+	if (p_wblock_state->swb) {
+		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u swb not null off free-q",
+				ssd->name, swb->wblock_id);
+	}
+	if (p_wblock_state->state != WBLOCK_STATE_NONE) {
+		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u state not NONE off free-q",
+				ssd->name, swb->wblock_id);
+	}
+
+	pthread_mutex_lock(&p_wblock_state->LOCK);
+
+	swb_reserve(swb);
+	p_wblock_state->swb = swb;
+	p_wblock_state->write_sec = (uint32_t)cf_get_seconds();
+
+	pthread_mutex_unlock(&p_wblock_state->LOCK);
+
+	return swb;
+}
+
+//
+// END - ssd_write_buf "swb" methods.
+//------------------------------------------------
+
+
+// Reduce wblock's used size, if result is 0 put it in the "free" pool, if it's
+// below the defrag threshold put it in the defrag queue.
+void
+ssd_block_free(drv_ssd *ssd, uint64_t rblock_id, uint64_t n_rblocks, char *msg)
+{
+	if (n_rblocks == 0) {
+		cf_warning(AS_DRV_SSD, "%s: %s: freeing 0 rblocks, rblock_id %lu",
+				ssd->name, msg, rblock_id);
+		return;
+	}
+
+	// Determine which wblock we're reducing used size in.
+	uint64_t start_byte = RBLOCKS_TO_BYTES(rblock_id);
+	uint64_t size = RBLOCKS_TO_BYTES(n_rblocks);
+	uint32_t wblock_id = BYTES_TO_WBLOCK_ID(ssd, start_byte);
+	uint32_t end_wblock_id = BYTES_TO_WBLOCK_ID(ssd, start_byte + size - 1);
+	ssd_alloc_table *at = ssd->alloc_table;
+
+	// Sanity-checks.
+	if (! (start_byte >= ssd->header_size && wblock_id < at->n_wblocks &&
+			wblock_id == end_wblock_id)) {
+		cf_warning(AS_DRV_SSD, "%s: %s: invalid range to free, rblock_id %lu, n_rblocks %lu",
+				ssd->name, msg, rblock_id, n_rblocks);
+		return;
+	}
+
+	cf_atomic64_sub(&ssd->inuse_size, size);
+
+	drv_ssds *ssds = (drv_ssds*)ssd->ns->storage_private;
+
+	if (ssds->read_cache) {
+		read_cache_remove(ssds->read_cache, (uint32_t)ssd->file_id, rblock_id);
+	}
+
+	ssd_wblock_state *p_wblock_state = &at->wblock_state[wblock_id];
+
+	pthread_mutex_lock(&p_wblock_state->LOCK);
+
+	int64_t resulting_inuse_sz = cf_atomic32_sub(&p_wblock_state->inuse_sz,
+			(int32_t)size);
 
 	if (resulting_inuse_sz < 0 ||
 			resulting_inuse_sz >= (int64_t)ssd->write_block_size) {
@@ -455,855 +1082,2250 @@ ssd_block_free(drv_ssd *ssd, uint64_t rblock_id, uint64_t n_rblocks, char *msg)
 				resulting_inuse_sz < 0 ? "over-freed" : "has crazy inuse_sz",
 				(int32_t)size, resulting_inuse_sz);
 
-		// TODO - really?
-		cf_atomic32_set(&p_wblock_state->inuse_sz, ssd->write_block_size);
-	}
-	else if (! p_wblock_state->swb &&
-			p_wblock_state->state != WBLOCK_STATE_DEFRAG) {
-		// Free wblock if all three gating conditions hold.
-		if (resulting_inuse_sz == 0) {
-			push_wblock_to_free_q(ssd, wblock_id, FREE_TO_HEAD);
+		// TODO - really?
+		cf_atomic32_set(&p_wblock_state->inuse_sz, ssd->write_block_size);
+	}
+	else if (! p_wblock_state->swb &&
+			p_wblock_state->state != WBLOCK_STATE_DEFRAG) {
+		// Free wblock if all three gating conditions hold.
+		if (resulting_inuse_sz == 0) {
+			push_wblock_to_free_q(ssd, wblock_id, FREE_TO_HEAD);
+		}
+		// Queue wblock for defrag if appropriate.
+		else if (resulting_inuse_sz < ssd->ns->defrag_lwm_size) {
+			push_wblock_to_defrag_q(ssd, wblock_id);
+		}
+	}
+	else if (p_wblock_state->state == WBLOCK_STATE_DEFRAG) {
+		defrag_q_rebucket(ssd, wblock_id, (uint32_t)resulting_inuse_sz);
+	}
+
+	pthread_mutex_unlock(&p_wblock_state->LOCK);
+}
+
+
+// Free a record's storage - for a chunked record, its head and its chunks.
+static void
+ssd_record_free(drv_ssd *ssd, uint64_t rblock_id, uint32_t n_rblocks,
+		char *msg)
+{
+	if (ssd_n_rblocks_is_chunked(n_rblocks)) {
+		n_rblocks = ssd_head_n_rblocks(n_rblocks);
+
+		drv_ssds *ssds = (drv_ssds*)ssd->ns->storage_private;
+		drv_ssd_block *head = ssd_read_head(ssd, rblock_id, n_rblocks);
+
+		if (head) {
+			const ssd_chunk_table *table = (const ssd_chunk_table*)head->data;
+
+			for (uint32_t i = 0; i < table->n_chunks; i++) {
+				const ssd_chunk_ref *ref = &table->refs[i];
+
+				ssd_block_free(&ssds->ssds[ref->file_id], ref->rblock_id,
+						ref->n_rblocks, msg);
+			}
+
+			cf_free(head);
+		}
+		else {
+			cf_warning(AS_DRV_SSD, "%s: %s: can't read head, leaking chunks of rblock_id %lu",
+					ssd->name, msg, rblock_id);
+		}
+	}
+
+	ssd_block_free(ssd, rblock_id, n_rblocks, msg);
+}
+
+
+static void
+log_bad_record(const char* ns_name, uint32_t n_bins, uint32_t block_bins,
+		const drv_ssd_bin* ssd_bin, const char* tag)
+{
+	cf_info(AS_DRV_SSD, "untrustworthy data from disk [%s], ignoring record", tag);
+	cf_info(AS_DRV_SSD, "   ns->name = %s", ns_name);
+	cf_info(AS_DRV_SSD, "   bin %" PRIu32 " [of %" PRIu32 "]", (block_bins - n_bins) + 1, block_bins);
+
+	if (ssd_bin) {
+		cf_info(AS_DRV_SSD, "   ssd_bin->offset = %" PRIu32, ssd_bin->offset);
+		cf_info(AS_DRV_SSD, "   ssd_bin->len = %" PRIu32, ssd_bin->len);
+		cf_info(AS_DRV_SSD, "   ssd_bin->next = %" PRIu32, ssd_bin->next);
+	}
+}
+
+
+// TODO - sanity-check rec-props?
+static bool
+is_valid_record(const drv_ssd_block* block, const char* ns_name)
+{
+	uint8_t* block_head = (uint8_t*)block;
+	uint64_t size = (uint64_t)(block->length + LENGTH_BASE);
+	drv_ssd_bin* ssd_bin_end = (drv_ssd_bin*)(block_head + size - sizeof(drv_ssd_bin));
+	drv_ssd_bin* ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
+	uint32_t n_bins = block->n_bins;
+
+	if (! ssd_cold_start_is_valid_n_bins(n_bins)) {
+		log_bad_record(ns_name, n_bins, n_bins, NULL, "bins");
+		return false;
+	}
+
+	while (n_bins > 0) {
+		if (ssd_bin > ssd_bin_end) {
+			log_bad_record(ns_name, n_bins, block->n_bins, NULL, "bin ptr");
+			return false;
+		}
+
+		uint64_t data_offset = (uint64_t)((uint8_t*)(ssd_bin + 1) - block_head);
+
+		if ((uint64_t)ssd_bin->offset != data_offset) {
+			log_bad_record(ns_name, n_bins, block->n_bins, ssd_bin, "offset");
+			return false;
+		}
+
+		uint64_t bin_end_offset = data_offset + (uint64_t)ssd_bin->len;
+
+		if (bin_end_offset > size) {
+			log_bad_record(ns_name, n_bins, block->n_bins, ssd_bin, "length");
+			return false;
+		}
+
+		if (n_bins > 1) {
+			if ((uint64_t)ssd_bin->next != bin_end_offset) {
+				log_bad_record(ns_name, n_bins, block->n_bins, ssd_bin, "next ptr");
+				return false;
+			}
+
+			ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
+		}
+
+		n_bins--;
+	}
+
+	return true;
+}
+
+
+// Copy a block into the device's defrag buffer, accounting for its size.
+// Returns false if there's no buffer to copy into.
+static bool
+defrag_write_block(drv_ssd *ssd, const drv_ssd_block *block,
+		uint32_t write_size, uint64_t *p_rblock_id)
+{
+	pthread_mutex_lock(&ssd->defrag_lock);
+
+	ssd_write_buf *swb = ssd->defrag_swb;
+
+	if (! swb) {
+		swb = swb_get(ssd, SWB_STREAM_DEFRAG);
+		ssd->defrag_swb = swb;
+
+		if (! swb) {
+			cf_warning(AS_DRV_SSD, "defrag_move_record: couldn't get swb");
+			pthread_mutex_unlock(&ssd->defrag_lock);
+			return false;
+		}
+	}
+
+	// Check if there's enough space in defrag buffer - if not, free and zero
+	// any remaining unused space, enqueue it to be flushed to device, and grab
+	// a new buffer.
+	if (write_size > ssd->write_block_size - swb->pos) {
+		if (ssd->write_block_size != swb->pos) {
+			// Clean the end of the buffer before pushing to write queue.
+			memset(swb->buf + swb->pos, 0, ssd->write_block_size - swb->pos);
+		}
+
+		// Enqueue the buffer, to be flushed to device.
+		swb->skip_post_write_q = true;
+		cf_mpmc_queue_push(ssd->swb_write_q, &swb);
+		cf_atomic64_incr(&ssd->n_defrag_wblock_writes);
+
+		// Get the new buffer.
+		swb = swb_get(ssd, SWB_STREAM_DEFRAG);
+		ssd->defrag_swb = swb;
+
+		if (! swb) {
+			cf_warning(AS_DRV_SSD, "defrag_move_record: couldn't get swb");
+			pthread_mutex_unlock(&ssd->defrag_lock);
+			return false;
+		}
+	}
+
+	memcpy(swb->buf + swb->pos, (const uint8_t*)block, write_size);
+
+	*p_rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb->pos);
+
+	swb->pos += write_size;
+
+	cf_atomic64_add(&ssd->inuse_size, (int64_t)write_size);
+	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)write_size);
+
+	pthread_mutex_unlock(&ssd->defrag_lock);
+
+	return true;
+}
+
+
+void
+defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
+{
+	drv_ssd *old_ssd = ssd;
+	uint64_t old_rblock_id = r->rblock_id;
+	uint16_t old_n_rblocks = r->n_rblocks;
+
+	drv_ssds *ssds = (drv_ssds*)ssd->ns->storage_private;
+
+	// Figure out which device to write to. When replacing an old record, it's
+	// possible this is different from the old device (e.g. if we've added a
+	// fresh device), so derive it from the digest each time.
+	ssd = &ssds->ssds[ssd_get_file_id(ssds, &block->keyd)];
+
+	if (! ssd) {
+		cf_warning(AS_DRV_SSD, "{%s} defrag_move_record: no drv_ssd for file_id %u",
+				ssds->ns->name, ssd_get_file_id(ssds, &block->keyd));
+		return;
+	}
+
+	uint32_t write_size = block->length + LENGTH_BASE;
+	uint64_t rblock_id;
+
+	if (! defrag_write_block(ssd, block, write_size, &rblock_id)) {
+		return;
+	}
+
+	// A chunked record's head moves alone - its chunks stay where they are.
+	r->file_id = ssd->file_id;
+	r->rblock_id = rblock_id;
+	r->n_rblocks = BYTES_TO_RBLOCKS(write_size) +
+			(ssd_n_rblocks_is_chunked(old_n_rblocks) ?
+					SSD_CHUNKED_N_RBLOCKS : 0);
+
+	ssd_block_free(old_ssd, old_rblock_id, ssd_head_n_rblocks(old_n_rblocks),
+			"defrag-write");
+}
+
+
+// Move a chunk, then rewrite its record's head to point at the new location.
+static void
+defrag_move_chunk(drv_ssd *ssd, drv_ssd_block *chunk, uint64_t rblock_id,
+		uint32_t n_rblocks, drv_ssd_block *head, ssd_chunk_ref *ref,
+		as_index *r)
+{
+	drv_ssds *ssds = (drv_ssds*)ssd->ns->storage_private;
+	drv_ssd *new_ssd = &ssds->ssds[ssd_get_file_id(ssds, &chunk->keyd)];
+	uint32_t chunk_size = (uint32_t)RBLOCKS_TO_BYTES(n_rblocks);
+	uint64_t new_rblock_id;
+
+	if (! defrag_write_block(new_ssd, chunk, chunk_size, &new_rblock_id)) {
+		return;
+	}
+
+	ref->rblock_id = new_rblock_id;
+	ref->file_id = new_ssd->file_id;
+	ssd_block_set_checksum(head);
+
+	drv_ssd *old_head_ssd = &ssds->ssds[r->file_id];
+	uint64_t old_head_rblock_id = r->rblock_id;
+	uint32_t head_n_rblocks = ssd_head_n_rblocks(r->n_rblocks);
+	uint64_t head_rblock_id;
+
+	if (! defrag_write_block(new_ssd, head,
+			(uint32_t)RBLOCKS_TO_BYTES(head_n_rblocks), &head_rblock_id)) {
+		// The old head still points at the old chunk - drop the copy.
+		ssd_block_free(new_ssd, new_rblock_id, n_rblocks, "defrag-undo");
+		return;
+	}
+
+	r->file_id = new_ssd->file_id;
+	r->rblock_id = head_rblock_id;
+
+	ssd_block_free(old_head_ssd, old_head_rblock_id, head_n_rblocks,
+			"defrag-write");
+	ssd_block_free(ssd, rblock_id, n_rblocks, "defrag-write");
+}
+
+
+// As ssd_record_defrag(), for a chunk - current if its record's head lists it.
+static int
+ssd_chunk_defrag(drv_ssd *ssd, drv_ssd_block *chunk, uint64_t rblock_id,
+		uint32_t n_rblocks)
+{
+	as_namespace *ns = ssd->ns;
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	as_partition_reservation rsv;
+	uint32_t pid = as_partition_getid(&chunk->keyd);
+
+	as_partition_reserve(ns, pid, &rsv);
+
+	int rv = -2; // record was not in index tree - presumably was deleted
+	as_index_ref r_ref;
+	r_ref.skip_lock = false;
+
+	if (as_record_get(rsv.tree, &chunk->keyd, &r_ref) == 0) {
+		as_index *r = r_ref.r;
+		drv_ssd_block *head = NULL;
+
+		rv = -1; // record is no longer this chunk's - presumably overwritten
+
+		if (ssd_n_rblocks_is_chunked(r->n_rblocks) &&
+				(head = ssd_read_head(&ssds->ssds[r->file_id], r->rblock_id,
+						ssd_head_n_rblocks(r->n_rblocks)))) {
+			ssd_chunk_table *table = (ssd_chunk_table*)head->data;
+
+			for (uint32_t i = 0; i < table->n_chunks; i++) {
+				ssd_chunk_ref *ref = &table->refs[i];
+
+				if (ref->file_id == ssd->file_id &&
+						ref->rblock_id == rblock_id) {
+					defrag_move_chunk(ssd, chunk, rblock_id, n_rblocks, head,
+							ref, r);
+					rv = 0;
+					break;
+				}
+			}
+
+			cf_free(head);
+		}
+
+		as_record_done(&r_ref, ns);
+	}
+
+	as_partition_release(&rsv);
+
+	return rv;
+}
+
+
+int
+ssd_record_defrag(drv_ssd *ssd, drv_ssd_block *block, uint64_t rblock_id,
+		uint32_t n_rblocks, uint64_t filepos)
+{
+	as_namespace *ns = ssd->ns;
+	as_partition_reservation rsv;
+	uint32_t pid = as_partition_getid(&block->keyd);
+
+	as_partition_reserve(ns, pid, &rsv);
+
+	int rv;
+	as_index_ref r_ref;
+	r_ref.skip_lock = false;
+
+	bool found = 0 == as_record_get(rsv.tree, &block->keyd, &r_ref);
+
+	if (found) {
+		as_index *r = r_ref.r;
+
+		if (r->file_id == ssd->file_id && r->rblock_id == rblock_id) {
+			if (r->generation != block->generation) {
+				cf_warning_digest(AS_DRV_SSD, &r->keyd, "device %s defrag: rblock_id %lu generation mismatch (%u:%u) ",
+						ssd->name, rblock_id, r->generation, block->generation);
+			}
+
+			if (ssd_head_n_rblocks(r->n_rblocks) != n_rblocks) {
+				cf_warning_digest(AS_DRV_SSD, &r->keyd, "device %s defrag: rblock_id %lu n_blocks mismatch (%u:%u) ",
+						ssd->name, rblock_id, ssd_head_n_rblocks(r->n_rblocks),
+						n_rblocks);
+			}
+
+			defrag_move_record(ssd, block, r);
+
+			rv = 0; // record was in index tree and current - moved it
+		}
+		else {
+			rv = -1; // record was in index tree - presumably was overwritten
+		}
+
+		as_record_done(&r_ref, ns);
+	}
+	else {
+		rv = -2; // record was not in index tree - presumably was deleted
+	}
+
+	as_partition_release(&rsv);
+
+	return rv;
+}
+
+
+bool
+ssd_is_full(drv_ssd *ssd, uint32_t wblock_id)
+{
+	if (cf_queue_sz(ssd->free_wblock_q) > DEFRAG_STARTUP_RESERVE) {
+		return false;
+	}
+
+	ssd_wblock_state* p_wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+
+	pthread_mutex_lock(&p_wblock_state->LOCK);
+
+	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0) {
+		// Lucky - wblock is empty, let ssd_defrag_wblock() free it.
+		pthread_mutex_unlock(&p_wblock_state->LOCK);
+
+		return false;
+	}
+
+	cf_warning(AS_DRV_SSD, "{%s}: defrag: drive %s totally full, re-queuing wblock %u",
+			ssd->ns->name, ssd->name, wblock_id);
+
+	// Not using push_wblock_to_defrag_q() - state is already DEFRAG, we
+	// definitely have a queue, and it's better to push back to head.
+	defrag_q_push(ssd, wblock_id, true);
+
+	pthread_mutex_unlock(&p_wblock_state->LOCK);
+
+	// If we got here, we used all our runtime reserve wblocks, but the wblocks
+	// we defragged must still have non-zero inuse_sz. Must wait for those to
+	// become free. Sleep prevents retries from overwhelming the log.
+	sleep(1);
+
+	return true;
+}
+
+
+int
+ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
+{
+	if (ssd_is_full(ssd, wblock_id)) {
+		return 0;
+	}
+
+	int record_count = 0;
+	int num_old_records = 0;
+	int num_deleted_records = 0;
+
+	ssd_wblock_state* p_wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+
+	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0) {
+		goto Finished;
+	}
+
+	int fd = ssd_fd_get(ssd);
+	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+
+	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
+
+	ssd_io_start(ssd, SSD_IO_DEFRAG);
+	ssd_io_depth_add(&ssd->large_read_depth, 1);
+
+	ssize_t rlen = ssd_pread(ssd, fd, read_buf, ssd->write_block_size,
+			(off_t)file_offset);
+
+	ssd_io_depth_sub(&ssd->large_read_depth, 1);
+	ssd_io_finish(ssd, SSD_IO_DEFRAG);
+
+	if (rlen != (ssize_t)ssd->write_block_size) {
+		cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %lu: errno %d (%s)",
+				ssd->name, rlen, file_offset, errno, cf_strerror(errno));
+		close(fd);
+		fd = -1;
+		goto Finished;
+	}
+
+	if (start_ns != 0) {
+		histogram_insert_data_point(ssd->hist_large_block_read, start_ns);
+	}
+
+	ssd_fd_put(ssd, fd);
+
+	size_t wblock_offset = 0; // current offset within the wblock, in bytes
+
+	while (wblock_offset < ssd->write_block_size &&
+			cf_atomic32_get(p_wblock_state->inuse_sz) != 0) {
+		drv_ssd_block *block = (drv_ssd_block*)&read_buf[wblock_offset];
+
+		if (block->magic != SSD_BLOCK_MAGIC &&
+				block->magic != SSD_CHUNK_MAGIC) {
+			// First block must have magic.
+			if (wblock_offset == 0) {
+				cf_warning(AS_DRV_SSD, "BLOCK CORRUPTED: device %s has bad data on wblock %d",
+						ssd->name, wblock_id);
+				break;
+			}
+
+			// Later blocks may have no magic, just skip to next block.
+			wblock_offset += RBLOCK_SIZE;
+			continue;
+		}
+
+		// Note - if block->length is sane, we don't need to round up to a
+		// multiple of RBLOCK_SIZE, but let's do it anyway just to be safe.
+		size_t next_wblock_offset = wblock_offset +
+				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
+
+		if (next_wblock_offset > ssd->write_block_size) {
+			cf_warning(AS_DRV_SSD, "error: block extends over read size: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
+				file_offset, wblock_offset, (uint64_t)block->length);
+			break;
+		}
+
+		uint64_t rblock_id = BYTES_TO_RBLOCKS(file_offset + wblock_offset);
+		uint32_t n_rblocks =
+				(uint32_t)BYTES_TO_RBLOCKS(next_wblock_offset - wblock_offset);
+
+		// Found a good record or chunk, move it if it's current.
+		int rv = block->magic == SSD_CHUNK_MAGIC ?
+				ssd_chunk_defrag(ssd, block, rblock_id, n_rblocks) :
+				ssd_record_defrag(ssd, block, rblock_id, n_rblocks,
+						file_offset + wblock_offset);
+
+		if (rv == 0) {
+			record_count++;
+		}
+		else if (rv == -1) {
+			num_old_records++;
+		}
+		else if (rv == -2) {
+			num_deleted_records++;
+		}
+
+		wblock_offset = next_wblock_offset;
+	}
+
+Finished:
+
+	// Note - usually wblock's inuse_sz is 0 here, but may legitimately be non-0
+	// e.g. if a dropped partition's tree is not done purging. In this case, we
+	// may have found deleted records in the wblock whose used-size contribution
+	// has not yet been subtracted.
+
+	cf_detail(AS_DRV_SSD, "device %s: wblock-id %u defragged, final in-use-sz %d records (%d:%d:%d)",
+			ssd->name, wblock_id, cf_atomic32_get(p_wblock_state->inuse_sz),
+			record_count, num_old_records, num_deleted_records);
+
+	ASD_SSD_DEFRAG_WBLOCK((uint64_t)ssd, wblock_id, (uint32_t)record_count);
+
+	// Sanity checks.
+	if (p_wblock_state->swb) {
+		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u swb not null while defragging",
+				ssd->name, wblock_id);
+	}
+	if (p_wblock_state->state != WBLOCK_STATE_DEFRAG) {
+		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u state not DEFRAG while defragging",
+				ssd->name, wblock_id);
+	}
+
+	pthread_mutex_lock(&p_wblock_state->LOCK);
+
+	p_wblock_state->state = WBLOCK_STATE_NONE;
+
+	// Free the wblock if it's empty.
+	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0 &&
+			! p_wblock_state->swb) {
+		push_wblock_to_free_q(ssd, wblock_id, FREE_TO_HEAD);
+	}
+
+	pthread_mutex_unlock(&p_wblock_state->LOCK);
+
+	cf_atomic64_incr(&ssd->n_defrag_wblocks_done);
+
+	return record_count;
+}
+
+
+// Feedback controller for adaptive defrag - returns wblocks/sec, or 0 to run
+// unthrottled. Speeds up while free wblocks are being lost, backs off while
+// the write queue (and so client write latency) is backing up, and eases off
+// when free wblocks are plentiful.
+static uint32_t
+defrag_adapt_rate(drv_ssd *ssd, int *p_prev_n_free)
+{
+	as_namespace *ns = ssd->ns;
+	uint32_t sleep_us = ns->storage_defrag_sleep;
+
+	// Zero (e.g. while startup defrag catches up) means don't throttle.
+	if (sleep_us == 0) {
+		return 0;
+	}
+
+	uint32_t base_rate = 1000000 / sleep_us;
+
+	if (base_rate == 0) {
+		base_rate = 1;
+	}
+
+	uint32_t min_rate = base_rate / DEFRAG_ADAPT_RANGE;
+	uint32_t max_rate = base_rate * DEFRAG_ADAPT_RANGE;
+
+	if (min_rate == 0) {
+		min_rate = 1;
+	}
+
+	int n_free = cf_queue_sz(ssd->free_wblock_q);
+	bool losing_free = n_free < *p_prev_n_free;
+
+	*p_prev_n_free = n_free;
+
+	// About to run out - defrag as fast as possible regardless of load.
+	if (n_free < 2 * min_free_wblocks(ns)) {
+		return 0;
+	}
+
+	uint32_t rate = ssd->defrag_target_rate;
+
+	if (rate == 0) {
+		rate = max_rate; // coming down from unthrottled
+	}
+
+	bool write_backlog =
+			(int)cf_mpmc_queue_sz(ssd->swb_write_q) > ns->storage_max_write_q / 4;
+	bool plentiful_free = (uint64_t)n_free * 100 >
+			(uint64_t)ssd->alloc_table->n_wblocks * ns->storage_min_avail_pct * 2;
+
+	if (losing_free && ! write_backlog) {
+		rate *= 2;
+	}
+	else if (write_backlog && ! losing_free) {
+		rate /= 2;
+	}
+	else if (! losing_free) {
+		rate = plentiful_free ?
+				rate - (rate / 4) : // idle - spare the device bandwidth
+				(rate + base_rate) / 2; // drift back to baseline
+	}
+	// else - losing free wblocks but writes are backed up, hold steady.
+
+	if (rate < min_rate) {
+		rate = min_rate;
+	}
+	else if (rate > max_rate) {
+		rate = max_rate;
+	}
+
+	return rate;
+}
+
+
+// Thread "run" function to service a device's defrag queue.
+void*
+run_defrag(void *pv_data)
+{
+	drv_ssd *ssd = (drv_ssd*)pv_data;
+	uint32_t wblock_id;
+	uint8_t *read_buf = cf_io_buf_alloc(ssd->write_block_size);
+	uint64_t last_adapt_us = 0;
+	int prev_n_free = cf_queue_sz(ssd->free_wblock_q);
+
+	cf_thread_set_role("ssd-defrag");
+
+	if (! read_buf) {
+		cf_crash(AS_DRV_SSD, "device %s: defrag valloc failed", ssd->name);
+	}
+
+	while (true) {
+		uint32_t q_min = ssd->ns->storage_defrag_queue_min;
+
+		if (q_min != 0) {
+			if (defrag_q_size(ssd) <= q_min ||
+					! defrag_q_pop(ssd, &wblock_id, false)) {
+				usleep(1000 * 50);
+				continue;
+			}
+		}
+		else {
+			defrag_q_pop(ssd, &wblock_id, true);
+		}
+
+		uint64_t start_us = cf_getus();
+
+		ssd_defrag_wblock(ssd, wblock_id, read_buf);
+
+		if (! ssd->ns->storage_defrag_adaptive) {
+			uint32_t sleep_us = ssd->ns->storage_defrag_sleep;
+
+			if (sleep_us != 0) {
+				usleep(sleep_us);
+			}
+
+			continue;
+		}
+
+		uint64_t now_us = cf_getus();
+
+		if (now_us - last_adapt_us >= DEFRAG_ADAPT_INTERVAL_us) {
+			ssd->defrag_target_rate = defrag_adapt_rate(ssd, &prev_n_free);
+			last_adapt_us = now_us;
+		}
+
+		uint32_t rate = ssd->defrag_target_rate;
+
+		if (rate != 0) {
+			// Pace wblocks, allowing for the time spent defragging this one.
+			uint64_t period_us = 1000000 / rate;
+			uint64_t elapsed_us = now_us - start_us;
+
+			if (elapsed_us < period_us) {
+				usleep((uint32_t)(period_us - elapsed_us));
+			}
+		}
+	}
+
+	// Although we ever expect to get here...
+	cf_io_buf_free(read_buf, ssd->write_block_size);
+	cf_warning(AS_DRV_SSD, "device %s: quit defrag - queue error", ssd->name);
+
+	return NULL;
+}
+
+
+void
+ssd_start_defrag_threads(drv_ssds *ssds)
+{
+	cf_info(AS_DRV_SSD, "{%s} starting defrag threads", ssds->ns->name);
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+
+		if (pthread_create(&ssd->defrag_thread, NULL, run_defrag,
+				(void*)ssd) != 0) {
+			cf_crash(AS_DRV_SSD, "%s defrag thread failed", ssd->name);
+		}
+	}
+}
+
+
+// Reset and queue each zone with no used wblocks. Other zones' free wblocks
+// are counted, so they're reset when the last used wblock is freed.
+static void
+zone_load_free_q(drv_ssd *ssd)
+{
+	ssd_alloc_table* at = ssd->alloc_table;
+	uint32_t n_reset = 0;
+
+	for (uint32_t zone_id = ssd->first_zone_id; zone_id < ssd->n_zones;
+			zone_id++) {
+		uint32_t first_id = zone_id * ssd->zone_n_wblocks;
+		uint32_t n_usable = zone_usable_n_wblocks(ssd, zone_id);
+		uint32_t n_free = 0;
+
+		for (uint32_t i = 0; i < n_usable; i++) {
+			if (at->wblock_state[first_id + i].inuse_sz == 0) {
+				n_free++;
+			}
+		}
+
+		if (n_free == n_usable) {
+			// May have been partly written before shutting down.
+			zone_reset(ssd, zone_id);
+			zone_push_free_wblocks(ssd, zone_id);
+			n_reset++;
+			continue;
+		}
+
+		ssd->zone_n_free[zone_id] = n_free;
+
+		if (n_usable - n_free <
+				(n_usable * ssd->ns->storage_defrag_lwm_pct) / 100) {
+			cf_queue_push(ssd->zone_sweep_q, &zone_id);
+		}
+	}
+
+	cf_info(AS_DRV_SSD, "%s reset %u of %u data zones", ssd->name, n_reset,
+			ssd->n_zones - ssd->first_zone_id);
+}
+
+
+// Thread "run" function to create and load a device's (wblock) free & defrag
+// queues at startup. The defrag queue's buckets put the most depleted wblocks
+// first.
+void*
+run_load_queues(void *pv_data)
+{
+	drv_ssd *ssd = (drv_ssd*)pv_data;
+
+	// TODO - would be nice to have a queue create of specified capacity.
+	if (! (ssd->free_wblock_q = cf_queue_create(sizeof(uint32_t), true))) {
+		cf_crash(AS_DRV_SSD, "%s free wblock queue create failed", ssd->name);
+	}
+
+	if (! (ssd->defrag_q = defrag_q_create())) {
+		cf_crash(AS_DRV_SSD, "%s defrag queue create failed", ssd->name);
+	}
+
+	uint32_t lwm_size = ssd->ns->defrag_lwm_size;
+	ssd_alloc_table* at = ssd->alloc_table;
+	uint32_t first_id = BYTES_TO_WBLOCK_ID(ssd, ssd->header_size);
+	uint32_t last_id = at->n_wblocks;
+
+	for (uint32_t wblock_id = first_id; wblock_id < last_id; wblock_id++) {
+		uint32_t inuse_sz = at->wblock_state[wblock_id].inuse_sz;
+
+		if (inuse_sz == 0) {
+			// Zoned devices queue whole free zones below.
+			if (ssd->zone_n_wblocks == 0) {
+				// Faster than using push_wblock_to_free_q() here...
+				cf_queue_push(ssd->free_wblock_q, &wblock_id);
+			}
+		}
+		else if (inuse_sz < lwm_size) {
+			// For speed, not using push_wblock_to_defrag_q() here...
+			at->wblock_state[wblock_id].state = WBLOCK_STATE_DEFRAG;
+			defrag_q_push(ssd, wblock_id, false);
+		}
+	}
+
+	if (ssd->zone_n_wblocks != 0) {
+		zone_load_free_q(ssd);
+	}
+
+	defrag_q_dump(ssd, "init");
+
+	ssd->n_defrag_wblock_reads = (uint64_t)defrag_q_size(ssd);
+
+	return NULL;
+}
+
+
+void
+ssd_load_wblock_queues(drv_ssds *ssds)
+{
+	cf_info(AS_DRV_SSD, "{%s} loading free & defrag queues", ssds->ns->name);
+
+	// Split this task across multiple threads.
+	pthread_t q_load_threads[ssds->n_ssds];
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+
+		if (pthread_create(&q_load_threads[i], NULL, run_load_queues,
+				(void*)ssd) != 0) {
+			cf_crash(AS_DRV_SSD, "%s load queues thread failed", ssd->name);
+		}
+	}
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		pthread_join(q_load_threads[i], NULL);
+	}
+	// Now we're single-threaded again.
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+
+		cf_info(AS_DRV_SSD, "%s init wblock free-q %d, defrag-q %u", ssd->name,
+				cf_queue_sz(ssd->free_wblock_q), defrag_q_size(ssd));
+	}
+}
+
+
+void
+ssd_wblock_init(drv_ssd *ssd)
+{
+	uint32_t n_wblocks = ssd->file_size / ssd->write_block_size;
+
+	cf_info(AS_DRV_SSD, "%s has %u wblocks of size %u", ssd->name, n_wblocks,
+			ssd->write_block_size);
+
+	ssd_alloc_table *at = cf_malloc(sizeof(ssd_alloc_table) + (n_wblocks * sizeof(ssd_wblock_state)));
+
+	at->n_wblocks = n_wblocks;
+
+	// Device header wblocks' inuse_sz will (also) be 0 but that doesn't matter.
+	for (uint32_t i = 0; i < n_wblocks; i++) {
+		pthread_mutex_init(&at->wblock_state[i].LOCK, 0);
+		at->wblock_state[i].state = WBLOCK_STATE_NONE;
+		cf_atomic32_set(&at->wblock_state[i].inuse_sz, 0);
+		at->wblock_state[i].swb = 0;
+		at->wblock_state[i].defrag_bucket = SSD_DEFRAG_NO_BUCKET;
+	}
+
+	ssd->alloc_table = at;
+}
+
+
+//==========================================================
+// Record reading utilities.
+//
+
+// Checks sanity and integrity of a block read from device.
+static bool
+ssd_check_read_block(drv_ssd *ssd, const drv_ssd_block *block,
+		const as_record *r, uint64_t read_offset)
+{
+	if (block->magic != SSD_BLOCK_MAGIC) {
+		cf_warning(AS_DRV_SSD, "read: bad block magic offset %"PRIu64,
+				read_offset);
+		return false;
+	}
+
+	if (0 != cf_digest_compare(&block->keyd, &r->keyd)) {
+		cf_warning(AS_DRV_SSD, "read: read wrong key: expecting %"PRIx64" got %"PRIx64,
+			*(uint64_t*)&r->keyd, *(uint64_t*)&block->keyd);
+		return false;
+	}
+
+	if (! ssd_block_verify_checksum(block,
+			(uint32_t)RBLOCKS_TO_BYTES(ssd_head_n_rblocks(r->n_rblocks)))) {
+		cf_atomic64_incr(&ssd->ns->n_device_checksum_errors);
+		cf_warning_digest(AS_DRV_SSD, &r->keyd, "%s: read: bad checksum offset %lu ",
+				ssd->name, RBLOCKS_TO_BYTES(r->rblock_id));
+		return false;
+	}
+
+	return true;
+}
+
+
+static inline void
+ssd_io_depth_add(ssd_io_depth *depth, uint32_t n)
+{
+	cf_atomic32_setmax(&depth->peak,
+			cf_atomic32_add(&depth->n_in_flight, (int32_t)n));
+}
+
+
+static inline void
+ssd_io_depth_sub(ssd_io_depth *depth, uint32_t n)
+{
+	cf_atomic32_sub(&depth->n_in_flight, (int32_t)n);
+}
+
+
+// Returns a pooled I/O buffer of read_size bytes, or NULL if the read failed.
+static uint8_t *
+ssd_read_device(drv_ssd *ssd, uint64_t read_offset, size_t read_size)
+{
+	uint8_t *read_buf = cf_io_buf_alloc(read_size);
+
+	if (! read_buf) {
+		return NULL;
+	}
+
+	int fd = ssd_fd_get(ssd);
+
+	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
+
+	ssd_io_class io_class = ssd_read_io_class();
+
+	ASD_SSD_READ_STARTING((uint64_t)ssd, read_offset, read_size);
+	ssd_io_start(ssd, io_class);
+	ssd_io_depth_add(&ssd->read_depth, 1);
+
+	ssize_t rv = ssd_pread(ssd, fd, read_buf, read_size, (off_t)read_offset);
+
+	ssd_io_depth_sub(&ssd->read_depth, 1);
+	ssd_io_finish(ssd, io_class);
+	ASD_SSD_READ_FINISHED((uint64_t)ssd, read_offset, (uint64_t)rv);
+
+	if (rv != (ssize_t)read_size) {
+		cf_warning(AS_DRV_SSD, "%s: read failed (%ld): size %lu offset %lu: errno %d (%s)",
+				ssd->name, rv, read_size, read_offset, errno,
+				cf_strerror(errno));
+		cf_io_buf_free(read_buf, read_size);
+		close(fd);
+		return NULL;
+	}
+
+	if (start_ns != 0) {
+		histogram_insert_data_point(ssd->hist_read, start_ns);
+		histogram_insert_raw(ssd->hist_read_size, read_size);
+	}
+
+	ssd_fd_put(ssd, fd);
+
+	return read_buf;
+}
+
+
+// Checks a chunked record's chunk table is sane - the head's length has been
+// checked already.
+static bool
+ssd_check_chunk_table(drv_ssds *ssds, const drv_ssd_block *head)
+{
+	as_namespace *ns = ssds->ns;
+	const ssd_chunk_table *table = (const ssd_chunk_table*)head->data;
+	uint32_t n_chunks = table->n_chunks;
+	uint32_t data_size = ssd_chunk_data_size(ns->storage_write_block_size);
+
+	if (n_chunks == 0 || n_chunks > SSD_MAX_CHUNKS ||
+			sizeof(drv_ssd_block) + sizeof(ssd_chunk_table) +
+					(n_chunks * sizeof(ssd_chunk_ref)) >
+							head->length + LENGTH_BASE ||
+			table->size <= sizeof(drv_ssd_block) ||
+			(table->size + data_size - 1) / data_size != n_chunks) {
+		cf_warning_digest(AS_DRV_SSD, &head->keyd, "{%s} bad chunk table ",
+				ns->name);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		const ssd_chunk_ref *ref = &table->refs[i];
+
+		if (ref->file_id >= (uint32_t)ssds->n_ssds || ref->n_rblocks == 0 ||
+				RBLOCKS_TO_BYTES(ref->n_rblocks) >
+						ns->storage_write_block_size ||
+				RBLOCK_ID_TO_WBLOCK_ID(&ssds->ssds[ref->file_id],
+						ref->rblock_id) >=
+								ssds->ssds[ref->file_id].alloc_table->n_wblocks) {
+			cf_warning_digest(AS_DRV_SSD, &head->keyd, "{%s} bad chunk %u ",
+					ns->name, i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Returns a copy of a chunked record's head, which the caller must free, or
+// NULL if it can't be read or isn't sane. The head may be in a write buffer.
+static drv_ssd_block *
+ssd_read_head(drv_ssd *ssd, uint64_t rblock_id, uint32_t n_rblocks)
+{
+	uint64_t head_offset = RBLOCKS_TO_BYTES(rblock_id);
+	uint32_t head_size = (uint32_t)RBLOCKS_TO_BYTES(n_rblocks);
+	uint32_t wblock_id = RBLOCK_ID_TO_WBLOCK_ID(ssd, rblock_id);
+	drv_ssd_block *head = cf_malloc(head_size);
+
+	if (! head) {
+		return NULL;
+	}
+
+	ssd_write_buf *swb = NULL;
+
+	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock_id], &swb);
+
+	if (swb) {
+		memcpy(head, swb->buf + (head_offset - WBLOCK_ID_TO_BYTES(ssd,
+				wblock_id)), head_size);
+		swb_release(swb);
+	}
+	else {
+		uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, head_offset);
+		size_t read_size = BYTES_UP_TO_IO_MIN(ssd, head_offset + head_size) -
+				read_offset;
+		uint8_t *read_buf = ssd_read_device(ssd, read_offset, read_size);
+
+		if (! read_buf) {
+			cf_free(head);
+			return NULL;
+		}
+
+		memcpy(head, read_buf + (head_offset - read_offset), head_size);
+		cf_io_buf_free(read_buf, read_size);
+	}
+
+	if (head->magic != SSD_BLOCK_MAGIC || ! ssd_block_is_chunked(head) ||
+			! ssd_block_verify_checksum(head, head_size) ||
+			! ssd_check_chunk_table((drv_ssds*)ssd->ns->storage_private,
+					head)) {
+		cf_warning(AS_DRV_SSD, "%s: bad head at rblock_id %lu", ssd->name,
+				rblock_id);
+		cf_free(head);
+		return NULL;
+	}
+
+	return head;
+}
+
+
+// Returns NULL if the record isn't in a write buffer or the read cache.
+// Otherwise, *p_read_buf is set to the allocation to free.
+static drv_ssd_block *
+ssd_read_record_from_memory(as_storage_rd *rd, uint8_t **p_read_buf)
+{
+	as_namespace *ns = rd->ns;
+	as_record *r = rd->r;
+
+	uint64_t record_offset = RBLOCKS_TO_BYTES(r->rblock_id);
+	uint64_t record_size = RBLOCKS_TO_BYTES(ssd_head_n_rblocks(r->n_rblocks));
+
+	drv_ssd *ssd = rd->ssd;
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	ssd_write_buf *swb = 0;
+	uint32_t wblock = RBLOCK_ID_TO_WBLOCK_ID(ssd, r->rblock_id);
+	uint8_t *read_buf;
+
+	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock], &swb);
+
+	if (swb) {
+		// Data is in write buffer, so read it from there.
+		cf_atomic32_incr(&ns->n_reads_from_cache);
+
+		read_buf = cf_malloc(record_size);
+
+		if (! read_buf) {
+			swb_release(swb);
+			return NULL;
+		}
+
+		int swb_offset = record_offset - WBLOCK_ID_TO_BYTES(ssd, wblock);
+		memcpy(read_buf, swb->buf + swb_offset, record_size);
+		swb_release(swb);
+	}
+	else if (ssds->read_cache && (read_buf = read_cache_get(ssds->read_cache,
+			(uint32_t)ssd->file_id, r->rblock_id, (uint32_t)record_size))) {
+		// Data is in read cache - it was checked when first read.
+		cf_atomic32_incr(&ns->n_reads_from_cache);
+	}
+	else {
+		return NULL;
+	}
+
+	*p_read_buf = read_buf;
+
+	return (drv_ssd_block*)read_buf;
+}
+
+
+// Free a read buffer - pooled_size is 0 if it's not from the I/O buffer pool.
+static inline void
+ssd_free_read_buf(uint8_t *read_buf, uint32_t pooled_size)
+{
+	if (pooled_size != 0) {
+		cf_io_buf_free(read_buf, pooled_size);
+	}
+	else {
+		cf_free(read_buf);
+	}
+}
+
+
+// Reassembles and decompresses if necessary and attaches the block to the rd.
+// Takes ownership of read_buf, which contains block.
+static int
+ssd_read_record_done(as_storage_rd *rd, drv_ssd_block *block,
+		uint8_t *read_buf, uint32_t pooled_size)
+{
+	if (ssd_block_is_chunked(block)) {
+		uint32_t size = 0;
+		drv_ssd_block *whole = ssd_read_chunks(
+				(drv_ssds*)rd->ns->storage_private, block, &size);
+
+		ssd_free_read_buf(read_buf, pooled_size);
+
+		if (! whole) {
+			return -1;
 		}
-		// Queue wblock for defrag if appropriate.
-		else if (resulting_inuse_sz < ssd->ns->defrag_lwm_size) {
-			push_wblock_to_defrag_q(ssd, wblock_id);
+
+		block = whole;
+		read_buf = (uint8_t*)whole;
+		pooled_size = size;
+	}
+
+	if (ssd_block_is_compressed(block)) {
+		uint32_t uncompressed_size = 0;
+		drv_ssd_block *uncompressed = ssd_block_decompress(rd->ns, block,
+				&uncompressed_size);
+
+		ssd_free_read_buf(read_buf, pooled_size);
+
+		if (! uncompressed) {
+			return -1;
 		}
+
+		block = uncompressed;
+		read_buf = (uint8_t*)uncompressed;
+		pooled_size = uncompressed_size;
 	}
 
-	pthread_mutex_unlock(&p_wblock_state->LOCK);
+	rd->block = block;
+	rd->must_free_block = read_buf;
+	rd->must_free_size = pooled_size;
+
+	return 0;
 }
 
 
+// Attaches the record's (uncompressed) block to the index, if there's a hot
+// tier. Makes a copy - the rd keeps its own.
 static void
-log_bad_record(const char* ns_name, uint32_t n_bins, uint32_t block_bins,
-		const drv_ssd_bin* ssd_bin, const char* tag)
+ssd_read_record_promote(as_storage_rd *rd)
 {
-	cf_info(AS_DRV_SSD, "untrustworthy data from disk [%s], ignoring record", tag);
-	cf_info(AS_DRV_SSD, "   ns->name = %s", ns_name);
-	cf_info(AS_DRV_SSD, "   bin %" PRIu32 " [of %" PRIu32 "]", (block_bins - n_bins) + 1, block_bins);
+	drv_ssds *ssds = (drv_ssds*)rd->ns->storage_private;
 
-	if (ssd_bin) {
-		cf_info(AS_DRV_SSD, "   ssd_bin->offset = %" PRIu32, ssd_bin->offset);
-		cf_info(AS_DRV_SSD, "   ssd_bin->len = %" PRIu32, ssd_bin->len);
-		cf_info(AS_DRV_SSD, "   ssd_bin->next = %" PRIu32, ssd_bin->next);
+	if (ssds->hot_tier) {
+		hot_tier_put(ssds->hot_tier, rd->r, (const uint8_t*)rd->block,
+				rd->block->length + LENGTH_BASE);
 	}
 }
 
 
-// TODO - sanity-check rec-props?
-static bool
-is_valid_record(const drv_ssd_block* block, const char* ns_name)
+int
+ssd_read_record(as_storage_rd *rd)
 {
-	uint8_t* block_head = (uint8_t*)block;
-	uint64_t size = (uint64_t)(block->length + LENGTH_BASE);
-	drv_ssd_bin* ssd_bin_end = (drv_ssd_bin*)(block_head + size - sizeof(drv_ssd_bin));
-	drv_ssd_bin* ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
-	uint32_t n_bins = block->n_bins;
+	as_namespace *ns = rd->ns;
+	as_record *r = rd->r;
 
-	if (! ssd_cold_start_is_valid_n_bins(n_bins)) {
-		log_bad_record(ns_name, n_bins, n_bins, NULL, "bins");
-		return false;
+	if (STORAGE_RBLOCK_IS_INVALID(r->rblock_id)) {
+		cf_warning_digest(AS_DRV_SSD, &r->keyd, "{%s} read_ssd: invalid rblock_id ",
+				ns->name);
+		return -1;
 	}
 
-	while (n_bins > 0) {
-		if (ssd_bin > ssd_bin_end) {
-			log_bad_record(ns_name, n_bins, block->n_bins, NULL, "bin ptr");
-			return false;
-		}
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	const uint8_t *tier_data;
 
-		uint64_t data_offset = (uint64_t)((uint8_t*)(ssd_bin + 1) - block_head);
+	// Hot record - use its block in place, it lives until the record lock is
+	// released, or until the rd is closed if a write detaches it.
+	if (ssds->hot_tier && (tier_data = hot_tier_get(ssds->hot_tier, r))) {
+		cf_atomic32_incr(&ns->n_reads_from_cache);
 
-		if ((uint64_t)ssd_bin->offset != data_offset) {
-			log_bad_record(ns_name, n_bins, block->n_bins, ssd_bin, "offset");
-			return false;
-		}
+		rd->block = (drv_ssd_block*)tier_data;
+		rd->must_free_block = NULL;
+		rd->must_free_size = 0;
 
-		uint64_t bin_end_offset = data_offset + (uint64_t)ssd_bin->len;
+		return 0;
+	}
 
-		if (bin_end_offset > size) {
-			log_bad_record(ns_name, n_bins, block->n_bins, ssd_bin, "length");
-			return false;
+	uint8_t *read_buf = NULL;
+	drv_ssd_block *block = ssd_read_record_from_memory(rd, &read_buf);
+
+	if (block) {
+		if (ssd_read_record_done(rd, block, read_buf, 0) != 0) {
+			return -1;
 		}
 
-		if (n_bins > 1) {
-			if ((uint64_t)ssd_bin->next != bin_end_offset) {
-				log_bad_record(ns_name, n_bins, block->n_bins, ssd_bin, "next ptr");
-				return false;
-			}
+		ssd_read_record_promote(rd);
 
-			ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
-		}
+		return 0;
+	}
 
-		n_bins--;
+	uint64_t record_offset = RBLOCKS_TO_BYTES(r->rblock_id);
+	uint64_t record_size = RBLOCKS_TO_BYTES(ssd_head_n_rblocks(r->n_rblocks));
+
+	drv_ssd *ssd = rd->ssd;
+
+	// Normal case - data is read from device.
+	cf_atomic32_incr(&ns->n_reads_from_device);
+
+	uint64_t record_end_offset = record_offset + record_size;
+	uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, record_offset);
+	uint64_t read_end_offset = BYTES_UP_TO_IO_MIN(ssd, record_end_offset);
+	size_t read_size = read_end_offset - read_offset;
+	uint64_t record_buf_indent = record_offset - read_offset;
+
+	if (! (read_buf = ssd_read_device(ssd, read_offset, read_size))) {
+		return -1;
 	}
 
-	return true;
+	block = (drv_ssd_block*)(read_buf + record_buf_indent);
+
+	// Sanity checks.
+	if (! ssd_check_read_block(ssd, block, r, read_offset)) {
+		cf_io_buf_free(read_buf, read_size);
+		return -1;
+	}
+
+	if (ns->storage_benchmarks_enabled) {
+		histogram_insert_raw(ns->device_read_size_hist, read_size);
+	}
+
+	if (ssds->read_cache) {
+		read_cache_put(ssds->read_cache, (uint32_t)ssd->file_id,
+				r->rblock_id, (const uint8_t*)block, (uint32_t)record_size);
+	}
+
+	if (ssd_read_record_done(rd, block, read_buf, (uint32_t)read_size) != 0) {
+		return -1;
+	}
+
+	ssd_read_record_promote(rd);
+
+	return 0;
 }
 
 
-void
-defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
+//------------------------------------------------
+// Coalesced reads of many records.
+//
+
+// Records whose aligned extents are no further apart than this are read
+// together - the bytes in between are cheaper than another device request.
+#define MULTI_READ_MAX_GAP_IO_MIN 4
+
+typedef struct ssd_multi_read_s {
+	as_storage_rd *rd;
+	uint64_t record_offset;
+	uint64_t record_size;
+} ssd_multi_read;
+
+// A single device read, covering one or more records in one wblock.
+typedef struct ssd_read_run_s {
+	drv_ssd *ssd;
+	uint64_t read_offset;
+	uint64_t read_size;
+	uint32_t first; // index of first record in sorted ssd_multi_read array
+	uint32_t n_records;
+	uint8_t *read_buf;
+	int fd;
+	int32_t res;
+} ssd_read_run;
+
+// Each reading thread gets its own ring on first use, if configured.
+static __thread cf_uring *g_read_ring = NULL;
+static __thread bool g_read_ring_tried = false;
+
+static int
+ssd_multi_read_compare(const void *pa, const void *pb)
 {
-	drv_ssd *old_ssd = ssd;
-	uint64_t old_rblock_id = r->rblock_id;
-	uint16_t old_n_rblocks = r->n_rblocks;
+	const ssd_multi_read *a = (const ssd_multi_read*)pa;
+	const ssd_multi_read *b = (const ssd_multi_read*)pb;
 
-	drv_ssds *ssds = (drv_ssds*)ssd->ns->storage_private;
+	if (a->rd->ssd != b->rd->ssd) {
+		return a->rd->ssd->file_id < b->rd->ssd->file_id ? -1 : 1;
+	}
 
-	// Figure out which device to write to. When replacing an old record, it's
-	// possible this is different from the old device (e.g. if we've added a
-	// fresh device), so derive it from the digest each time.
-	ssd = &ssds->ssds[ssd_get_file_id(ssds, &block->keyd)];
+	return a->record_offset < b->record_offset ? -1 :
+			(a->record_offset == b->record_offset ? 0 : 1);
+}
 
-	if (! ssd) {
-		cf_warning(AS_DRV_SSD, "{%s} defrag_move_record: no drv_ssd for file_id %u",
-				ssds->ns->name, ssd_get_file_id(ssds, &block->keyd));
-		return;
+
+static cf_uring *
+ssd_get_read_ring(as_namespace *ns)
+{
+	// Mapped devices are read with memcpy() - nothing to submit.
+	if (ns->storage_persistent_memory) {
+		return NULL;
 	}
 
-	uint32_t write_size = block->length + LENGTH_BASE;
+	if (! g_read_ring_tried && ns->storage_io_uring_depth != 0) {
+		g_read_ring_tried = true;
+		g_read_ring = cf_uring_create(ns->storage_io_uring_depth);
+	}
 
-	pthread_mutex_lock(&ssd->defrag_lock);
+	return g_read_ring;
+}
 
-	ssd_write_buf *swb = ssd->defrag_swb;
 
-	if (! swb) {
-		swb = swb_get(ssd);
-		ssd->defrag_swb = swb;
+// Issue device reads for runs [0, n_runs), filling in each run's result. With
+// a ring, up to its depth of reads are in flight at once.
+static void
+ssd_issue_read_runs(as_namespace *ns, ssd_read_run *runs, uint32_t n_runs)
+{
+	cf_uring *ring = ssd_get_read_ring(ns);
+	uint64_t start_ns = ns->storage_benchmarks_enabled ? cf_getns() : 0;
+	ssd_io_class io_class = ssd_read_io_class();
+	uint32_t next = 0;
 
-		if (! swb) {
-			cf_warning(AS_DRV_SSD, "defrag_move_record: couldn't get swb");
-			pthread_mutex_unlock(&ssd->defrag_lock);
-			return;
+	while (next < n_runs) {
+		if (! ring) {
+			ssd_read_run *run = &runs[next++];
+
+			ssd_io_start(run->ssd, io_class);
+			ssd_io_depth_add(&run->ssd->read_depth, 1);
+
+			run->res = (int32_t)ssd_pread(run->ssd, run->fd, run->read_buf,
+					run->read_size, (off_t)run->read_offset);
+
+			ssd_io_depth_sub(&run->ssd->read_depth, 1);
+			ssd_io_finish(run->ssd, io_class);
+
+			if (run->res < 0) {
+				run->res = -errno;
+			}
+
+			continue;
 		}
-	}
 
-	// Check if there's enough space in defrag buffer - if not, free and zero
-	// any remaining unused space, enqueue it to be flushed to device, and grab
-	// a new buffer.
-	if (write_size > ssd->write_block_size - swb->pos) {
-		if (ssd->write_block_size != swb->pos) {
-			// Clean the end of the buffer before pushing to write queue.
-			memset(swb->buf + swb->pos, 0, ssd->write_block_size - swb->pos);
+		uint32_t n_queued = 0;
+
+		// Background reads stop queuing when their class has no room - the
+		// rest then go synchronously, each waiting its turn.
+		while (next < n_runs && cf_uring_n_free(ring) != 0 &&
+				ssd_io_try_start(runs[next].ssd, io_class)) {
+			if (! cf_uring_queue_read(ring, runs[next].fd, runs[next].read_buf,
+					(uint32_t)runs[next].read_size, runs[next].read_offset,
+					&runs[next])) {
+				ssd_io_finish(runs[next].ssd, io_class);
+				break;
+			}
+
+			ssd_io_depth_add(&runs[next].ssd->read_depth, 1);
+			next++;
+			n_queued++;
 		}
 
-		// Enqueue the buffer, to be flushed to device.
-		swb->skip_post_write_q = true;
-		cf_queue_push(ssd->swb_write_q, &swb);
-		cf_atomic64_incr(&ssd->n_defrag_wblock_writes);
+		if (n_queued == 0) {
+			ring = NULL; // finish synchronously
+			continue;
+		}
 
-		// Get the new buffer.
-		swb = swb_get(ssd);
-		ssd->defrag_swb = swb;
+		if (cf_uring_submit(ring, n_queued) < 0) {
+			cf_crash(AS_DRV_SSD, "{%s} DEVICE FAILED io_uring submit",
+					ns->name);
+		}
 
-		if (! swb) {
-			cf_warning(AS_DRV_SSD, "defrag_move_record: couldn't get swb");
-			pthread_mutex_unlock(&ssd->defrag_lock);
-			return;
+		ssd_read_run *run;
+		int32_t res;
+
+		while (cf_uring_reap(ring, (void**)&run, &res)) {
+			ssd_io_depth_sub(&run->ssd->read_depth, 1);
+			ssd_io_finish(run->ssd, io_class);
+			run->res = res;
 		}
 	}
 
-	memcpy(swb->buf + swb->pos, (const uint8_t*)block, write_size);
+	if (start_ns != 0) {
+		for (uint32_t i = 0; i < n_runs; i++) {
+			histogram_insert_data_point(runs[i].ssd->hist_read, start_ns);
+			histogram_insert_raw(runs[i].ssd->hist_read_size,
+					runs[i].read_size);
+			histogram_insert_raw(ns->device_read_size_hist, runs[i].read_size);
+		}
+	}
+}
 
-	r->file_id = ssd->file_id;
-	r->rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb->pos);
-	r->n_rblocks = BYTES_TO_RBLOCKS(write_size);
 
-	swb->pos += write_size;
+// Attach blocks from a completed run to its records' rds.
+static void
+ssd_finish_read_run(as_namespace *ns, ssd_read_run *run,
+		const ssd_multi_read *reads)
+{
+	drv_ssd *ssd = run->ssd;
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
 
-	cf_atomic64_add(&ssd->inuse_size, (int64_t)write_size);
-	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)write_size);
+	if (run->res != (int32_t)run->read_size) {
+		cf_warning(AS_DRV_SSD, "%s: read failed (%d): size %lu offset %lu",
+				ssd->name, run->res, run->read_size, run->read_offset);
+		close(run->fd);
+		cf_io_buf_free(run->read_buf, run->read_size);
+		return;
+	}
 
-	pthread_mutex_unlock(&ssd->defrag_lock);
+	ssd_fd_put(ssd, run->fd);
+
+	for (uint32_t i = run->first; i < run->first + run->n_records; i++) {
+		const ssd_multi_read *read = &reads[i];
+		as_storage_rd *rd = read->rd;
+		uint8_t *src = run->read_buf + (read->record_offset -
+				run->read_offset);
+
+		// Sanity check in place - failed records are simply left unread.
+		if (! ssd_check_read_block(ssd, (const drv_ssd_block*)src, rd->r,
+				run->read_offset)) {
+			continue;
+		}
+
+		if (ssds->read_cache) {
+			read_cache_put(ssds->read_cache, (uint32_t)ssd->file_id,
+					rd->r->rblock_id, src, (uint32_t)read->record_size);
+		}
+
+		// A lone record keeps the run's buffer.
+		if (run->n_records == 1) {
+			ssd_read_record_done(rd, (drv_ssd_block*)src, run->read_buf,
+					(uint32_t)run->read_size);
+			return;
+		}
+
+		uint8_t *read_buf = cf_io_buf_alloc(read->record_size);
+
+		if (! read_buf) {
+			continue;
+		}
+
+		memcpy(read_buf, src, read->record_size);
 
-	ssd_block_free(old_ssd, old_rblock_id, old_n_rblocks, "defrag-write");
+		ssd_read_record_done(rd, (drv_ssd_block*)read_buf, read_buf,
+				(uint32_t)read->record_size);
+	}
+
+	cf_io_buf_free(run->read_buf, run->read_size);
 }
 
 
-int
-ssd_record_defrag(drv_ssd *ssd, drv_ssd_block *block, uint64_t rblock_id,
-		uint32_t n_rblocks, uint64_t filepos)
+//------------------------------------------------
+// Chunked records.
+//
+
+// Checks a chunk belongs to the head, and copies its data into place in the
+// record's block.
+static bool
+ssd_copy_chunk(drv_ssd *ssd, const drv_ssd_block *head, uint32_t ix,
+		const drv_ssd_block *chunk, uint32_t max_size, uint8_t *whole)
 {
-	as_namespace *ns = ssd->ns;
-	as_partition_reservation rsv;
-	uint32_t pid = as_partition_getid(&block->keyd);
+	const ssd_chunk_table *table = (const ssd_chunk_table*)head->data;
+	uint32_t data_size = ssd_chunk_data_size(ssd->write_block_size);
+	uint32_t offset = ix * data_size;
+	uint32_t size = table->size - offset < data_size ?
+			table->size - offset : data_size;
+
+	if (chunk->magic != SSD_CHUNK_MAGIC ||
+			cf_digest_compare(&chunk->keyd, &head->keyd) != 0 ||
+			chunk->generation != head->generation ||
+			chunk->last_update_time != head->last_update_time ||
+			chunk->n_bins != ix || chunk->bins_offset != size ||
+			sizeof(drv_ssd_block) + size > max_size) {
+		cf_warning_digest(AS_DRV_SSD, &head->keyd, "%s: read: bad chunk %u ",
+				ssd->name, ix);
+		return false;
+	}
 
-	as_partition_reserve(ns, pid, &rsv);
+	if (! ssd_block_verify_checksum(chunk, max_size)) {
+		cf_atomic64_incr(&ssd->ns->n_device_checksum_errors);
+		cf_warning_digest(AS_DRV_SSD, &head->keyd, "%s: read: bad checksum chunk %u ",
+				ssd->name, ix);
+		return false;
+	}
 
-	int rv;
-	as_index_ref r_ref;
-	r_ref.skip_lock = false;
+	memcpy(whole + offset, chunk->data, size);
 
-	bool found = 0 == as_record_get(rsv.tree, &block->keyd, &r_ref);
+	return true;
+}
 
-	if (found) {
-		as_index *r = r_ref.r;
 
-		if (r->file_id == ssd->file_id && r->rblock_id == rblock_id) {
-			if (r->generation != block->generation) {
-				cf_warning_digest(AS_DRV_SSD, &r->keyd, "device %s defrag: rblock_id %lu generation mismatch (%u:%u) ",
-						ssd->name, rblock_id, r->generation, block->generation);
+// Reassemble a chunked record's block. Chunks still in write buffers are
+// copied from there, the rest are read from device a batch at a time - in
+// parallel, if the thread has a ring. Returns a pooled I/O buffer - free with
+// cf_io_buf_free(result, *p_size) - or NULL if any chunk can't be read.
+static drv_ssd_block *
+ssd_read_chunks(drv_ssds *ssds, const drv_ssd_block *head, uint32_t *p_size)
+{
+	if (! ssd_check_chunk_table(ssds, head)) {
+		return NULL;
+	}
+
+	as_namespace *ns = ssds->ns;
+	const ssd_chunk_table *table = (const ssd_chunk_table*)head->data;
+	uint8_t *whole = cf_io_buf_alloc(table->size);
+
+	if (! whole) {
+		return NULL;
+	}
+
+	ssd_read_run runs[CHUNK_READ_BATCH];
+	bool ok = true;
+
+	for (uint32_t first = 0; ok && first < table->n_chunks;
+			first += CHUNK_READ_BATCH) {
+		uint32_t end = first + CHUNK_READ_BATCH < table->n_chunks ?
+				first + CHUNK_READ_BATCH : table->n_chunks;
+		uint32_t n_runs = 0;
+
+		for (uint32_t i = first; ok && i < end; i++) {
+			const ssd_chunk_ref *ref = &table->refs[i];
+			drv_ssd *ssd = &ssds->ssds[ref->file_id];
+			uint64_t chunk_offset = RBLOCKS_TO_BYTES(ref->rblock_id);
+			uint64_t chunk_size = RBLOCKS_TO_BYTES(ref->n_rblocks);
+			uint32_t wblock_id = RBLOCK_ID_TO_WBLOCK_ID(ssd, ref->rblock_id);
+			ssd_write_buf *swb = NULL;
+
+			swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock_id],
+					&swb);
+
+			if (swb) {
+				ok = ssd_copy_chunk(ssd, head, i, (const drv_ssd_block*)
+						(swb->buf + (chunk_offset - WBLOCK_ID_TO_BYTES(ssd,
+								wblock_id))), (uint32_t)chunk_size,
+						whole);
+				swb_release(swb);
+				continue;
 			}
 
-			if (r->n_rblocks != n_rblocks) {
-				cf_warning_digest(AS_DRV_SSD, &r->keyd, "device %s defrag: rblock_id %lu n_blocks mismatch (%u:%u) ",
-						ssd->name, rblock_id, r->n_rblocks, n_rblocks);
+			ssd_read_run *run = &runs[n_runs];
+
+			run->ssd = ssd;
+			run->read_offset = BYTES_DOWN_TO_IO_MIN(ssd, chunk_offset);
+			run->read_size = BYTES_UP_TO_IO_MIN(ssd, chunk_offset +
+					chunk_size) - run->read_offset;
+			run->first = i;
+			run->n_records = 1;
+			run->res = 0;
+
+			if (! (run->read_buf = cf_io_buf_alloc(run->read_size))) {
+				ok = false;
+				break;
 			}
 
-			defrag_move_record(ssd, block, r);
+			run->fd = ssd_fd_get(ssd);
+			n_runs++;
+		}
 
-			rv = 0; // record was in index tree and current - moved it
+		if (ok && n_runs != 0) {
+			cf_atomic32_add(&ns->n_reads_from_device, (int32_t)n_runs);
+			ssd_issue_read_runs(ns, runs, n_runs);
 		}
-		else {
-			rv = -1; // record was in index tree - presumably was overwritten
+
+		for (uint32_t i = 0; i < n_runs; i++) {
+			ssd_read_run *run = &runs[i];
+			const ssd_chunk_ref *ref = &table->refs[run->first];
+
+			if (! ok) {
+				ssd_fd_put(run->ssd, run->fd); // never issued
+			}
+			else if (run->res != (int32_t)run->read_size) {
+				cf_warning(AS_DRV_SSD, "%s: read failed (%d): size %lu offset %lu",
+						run->ssd->name, run->res, run->read_size,
+						run->read_offset);
+				close(run->fd);
+				ok = false;
+			}
+			else {
+				ssd_fd_put(run->ssd, run->fd);
+				ok = ssd_copy_chunk(run->ssd, head, run->first,
+						(const drv_ssd_block*)(run->read_buf +
+								(RBLOCKS_TO_BYTES(ref->rblock_id) -
+										run->read_offset)),
+						(uint32_t)RBLOCKS_TO_BYTES(ref->n_rblocks), whole);
+			}
+
+			cf_io_buf_free(run->read_buf, run->read_size);
 		}
+	}
 
-		as_record_done(&r_ref, ns);
+	drv_ssd_block *block = (drv_ssd_block*)whole;
+
+	if (ok && (block->magic != SSD_BLOCK_MAGIC ||
+			cf_digest_compare(&block->keyd, &head->keyd) != 0 ||
+			! ssd_block_verify_checksum(block, table->size))) {
+		cf_atomic64_incr(&ns->n_device_checksum_errors);
+		cf_warning_digest(AS_DRV_SSD, &head->keyd, "{%s} read: bad reassembled block ",
+				ns->name);
+		ok = false;
 	}
-	else {
-		rv = -2; // record was not in index tree - presumably was deleted
+
+	if (! ok) {
+		cf_io_buf_free(whole, table->size);
+		return NULL;
 	}
 
-	as_partition_release(&rsv);
+	*p_size = table->size;
 
-	return rv;
+	return block;
 }
 
 
+// Account for a chunked record's chunks, from its head on device.
 bool
-ssd_is_full(drv_ssd *ssd, uint32_t wblock_id)
+ssd_chunks_add_inuse(drv_ssd *ssd, uint64_t rblock_id, uint32_t n_rblocks)
 {
-	if (cf_queue_sz(ssd->free_wblock_q) > DEFRAG_STARTUP_RESERVE) {
+	drv_ssds *ssds = (drv_ssds*)ssd->ns->storage_private;
+	drv_ssd_block *head = ssd_read_head(ssd, rblock_id,
+			ssd_head_n_rblocks(n_rblocks));
+
+	if (! head) {
 		return false;
 	}
 
-	ssd_wblock_state* p_wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+	const ssd_chunk_table *table = (const ssd_chunk_table*)head->data;
 
-	pthread_mutex_lock(&p_wblock_state->LOCK);
+	for (uint32_t i = 0; i < table->n_chunks; i++) {
+		const ssd_chunk_ref *ref = &table->refs[i];
+		drv_ssd *chunk_ssd = &ssds->ssds[ref->file_id];
+		uint32_t wblock_id = RBLOCK_ID_TO_WBLOCK_ID(chunk_ssd, ref->rblock_id);
+		uint32_t size = (uint32_t)RBLOCKS_TO_BYTES(ref->n_rblocks);
 
-	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0) {
-		// Lucky - wblock is empty, let ssd_defrag_wblock() free it.
-		pthread_mutex_unlock(&p_wblock_state->LOCK);
+		if (wblock_id >= chunk_ssd->alloc_table->n_wblocks) {
+			cf_warning(AS_DRV_SSD, "%s: chunk %u of rblock_id %lu off device",
+					chunk_ssd->name, i, rblock_id);
+			continue;
+		}
 
-		return false;
+		cf_atomic64_add(&chunk_ssd->inuse_size, size);
+		cf_atomic32_add(&chunk_ssd->alloc_table->wblock_state[wblock_id].inuse_sz,
+				(int32_t)size);
 	}
 
-	cf_warning(AS_DRV_SSD, "{%s}: defrag: drive %s totally full, re-queuing wblock %u",
-			ssd->ns->name, ssd->name, wblock_id);
-
-	// Not using push_wblock_to_defrag_q() - state is already DEFRAG, we
-	// definitely have a queue, and it's better to push back to head.
-	cf_queue_push_head(ssd->defrag_wblock_q, &wblock_id);
-
-	pthread_mutex_unlock(&p_wblock_state->LOCK);
-
-	// If we got here, we used all our runtime reserve wblocks, but the wblocks
-	// we defragged must still have non-zero inuse_sz. Must wait for those to
-	// become free. Sleep prevents retries from overwhelming the log.
-	sleep(1);
+	cf_free(head);
 
 	return true;
 }
 
 
-int
-ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
+// Read many records, merging device reads of records near each other in the
+// same wblock. Records that fail to read are left without a block, so callers
+// fall back to (and get errors from) the usual single-record path.
+static void
+ssd_read_records(as_storage_rd **rds, uint32_t n_rds)
 {
-	if (ssd_is_full(ssd, wblock_id)) {
-		return 0;
+	as_namespace *ns = rds[0]->ns;
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	ssd_multi_read *reads = cf_malloc(sizeof(ssd_multi_read) * n_rds);
+
+	if (! reads) {
+		return;
 	}
 
-	int record_count = 0;
-	int num_old_records = 0;
-	int num_deleted_records = 0;
+	uint32_t n_reads = 0;
 
-	ssd_wblock_state* p_wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
+	for (uint32_t i = 0; i < n_rds; i++) {
+		as_storage_rd *rd = rds[i];
+		as_record *r = rd->r;
 
-	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0) {
-		goto Finished;
-	}
+		// Hot records are left for the locked single-record path - their
+		// blocks may be evicted at any time without the record lock. (Reading
+		// r->dim here is racy, but at worst just misjudges the choice.)
+		if (rd->block || ! as_record_is_live(r) ||
+				STORAGE_RBLOCK_IS_INVALID(r->rblock_id) ||
+				(ssds->hot_tier && r->dim)) {
+			continue;
+		}
 
-	int fd = ssd_fd_get(ssd);
-	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+		uint8_t *read_buf = NULL;
+		drv_ssd_block *block = ssd_read_record_from_memory(rd, &read_buf);
 
-	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
+		if (block) {
+			ssd_read_record_done(rd, block, read_buf, 0);
+			continue;
+		}
 
-	if (lseek(fd, (off_t)file_offset, SEEK_SET) != (off_t)file_offset) {
-		cf_warning(AS_DRV_SSD, "%s: seek failed: offset %lu: errno %d (%s)",
-				ssd->name, file_offset, errno, cf_strerror(errno));
-		close(fd);
-		fd = -1;
-		goto Finished;
+		reads[n_reads].rd = rd;
+		reads[n_reads].record_offset = RBLOCKS_TO_BYTES(r->rblock_id);
+		reads[n_reads].record_size =
+				RBLOCKS_TO_BYTES(ssd_head_n_rblocks(r->n_rblocks));
+		n_reads++;
 	}
 
-	ssize_t rlen = read(fd, read_buf, ssd->write_block_size);
-
-	if (rlen != (ssize_t)ssd->write_block_size) {
-		cf_warning(AS_DRV_SSD, "%s: read failed (%ld): errno %d (%s)",
-				ssd->name, rlen, errno, cf_strerror(errno));
-		close(fd);
-		fd = -1;
-		goto Finished;
+	if (n_reads == 0) {
+		cf_free(reads);
+		return;
 	}
 
-	if (start_ns != 0) {
-		histogram_insert_data_point(ssd->hist_large_block_read, start_ns);
+	qsort(reads, n_reads, sizeof(ssd_multi_read), ssd_multi_read_compare);
+
+	ssd_read_run *runs = cf_malloc(sizeof(ssd_read_run) * n_reads);
+
+	if (! runs) {
+		cf_free(reads);
+		return;
 	}
 
-	ssd_fd_put(ssd, fd);
+	uint32_t n_runs = 0;
+	ssd_read_run *run = NULL;
 
-	size_t wblock_offset = 0; // current offset within the wblock, in bytes
+	for (uint32_t i = 0; i < n_reads; i++) {
+		const ssd_multi_read *read = &reads[i];
+		drv_ssd *ssd = read->rd->ssd;
+		uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, read->record_offset);
+		uint64_t read_end_offset = BYTES_UP_TO_IO_MIN(ssd,
+				read->record_offset + read->record_size);
 
-	while (wblock_offset < ssd->write_block_size &&
-			cf_atomic32_get(p_wblock_state->inuse_sz) != 0) {
-		drv_ssd_block *block = (drv_ssd_block*)&read_buf[wblock_offset];
+		cf_atomic32_incr(&ns->n_reads_from_device);
 
-		if (block->magic != SSD_BLOCK_MAGIC) {
-			// First block must have magic.
-			if (wblock_offset == 0) {
-				cf_warning(AS_DRV_SSD, "BLOCK CORRUPTED: device %s has bad data on wblock %d",
-						ssd->name, wblock_id);
-				break;
+		if (run && run->ssd == ssd &&
+				BYTES_TO_WBLOCK_ID(ssd, run->read_offset) ==
+						BYTES_TO_WBLOCK_ID(ssd, read->record_offset) &&
+				read_offset <= run->read_offset + run->read_size +
+						(MULTI_READ_MAX_GAP_IO_MIN * ssd->io_min_size)) {
+			uint64_t run_end_offset = run->read_offset + run->read_size;
+
+			if (read_end_offset > run_end_offset) {
+				run->read_size = read_end_offset - run->read_offset;
 			}
 
-			// Later blocks may have no magic, just skip to next block.
-			wblock_offset += RBLOCK_SIZE;
+			run->n_records++;
 			continue;
 		}
 
-		// Note - if block->length is sane, we don't need to round up to a
-		// multiple of RBLOCK_SIZE, but let's do it anyway just to be safe.
-		size_t next_wblock_offset = wblock_offset +
-				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
+		run = &runs[n_runs++];
 
-		if (next_wblock_offset > ssd->write_block_size) {
-			cf_warning(AS_DRV_SSD, "error: block extends over read size: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
-				file_offset, wblock_offset, (uint64_t)block->length);
-			break;
-		}
+		run->ssd = ssd;
+		run->read_offset = read_offset;
+		run->read_size = read_end_offset - read_offset;
+		run->first = i;
+		run->n_records = 1;
+	}
 
-		// Found a good record, move it if it's current.
-		int rv = ssd_record_defrag(ssd, block,
-				BYTES_TO_RBLOCKS(file_offset + wblock_offset),
-				(uint32_t)BYTES_TO_RBLOCKS(next_wblock_offset - wblock_offset),
-				file_offset + wblock_offset);
+	uint32_t n_bufs = 0;
 
-		if (rv == 0) {
-			record_count++;
-		}
-		else if (rv == -1) {
-			num_old_records++;
-		}
-		else if (rv == -2) {
-			num_deleted_records++;
+	for ( ; n_bufs < n_runs; n_bufs++) {
+		run = &runs[n_bufs];
+
+		if (! (run->read_buf = cf_io_buf_alloc(run->read_size))) {
+			break;
 		}
 
-		wblock_offset = next_wblock_offset;
+		run->fd = ssd_fd_get(run->ssd);
 	}
 
-Finished:
-
-	// Note - usually wblock's inuse_sz is 0 here, but may legitimately be non-0
-	// e.g. if a dropped partition's tree is not done purging. In this case, we
-	// may have found deleted records in the wblock whose used-size contribution
-	// has not yet been subtracted.
-
-	cf_detail(AS_DRV_SSD, "device %s: wblock-id %u defragged, final in-use-sz %d records (%d:%d:%d)",
-			ssd->name, wblock_id, cf_atomic32_get(p_wblock_state->inuse_sz),
-			record_count, num_old_records, num_deleted_records);
+	// If we ran out of memory, the rest are read one-by-one later.
+	ssd_issue_read_runs(ns, runs, n_bufs);
 
-	// Sanity checks.
-	if (p_wblock_state->swb) {
-		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u swb not null while defragging",
-				ssd->name, wblock_id);
-	}
-	if (p_wblock_state->state != WBLOCK_STATE_DEFRAG) {
-		cf_warning(AS_DRV_SSD, "device %s: wblock-id %u state not DEFRAG while defragging",
-				ssd->name, wblock_id);
+	for (uint32_t i = 0; i < n_bufs; i++) {
+		ssd_finish_read_run(ns, &runs[i], reads);
 	}
 
-	pthread_mutex_lock(&p_wblock_state->LOCK);
+	cf_free(runs);
+	cf_free(reads);
+}
 
-	p_wblock_state->state = WBLOCK_STATE_NONE;
 
-	// Free the wblock if it's empty.
-	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0 &&
-			! p_wblock_state->swb) {
-		push_wblock_to_free_q(ssd, wblock_id, FREE_TO_HEAD);
+//==========================================================
+// Storage API implementation: reading records.
+//
+
+int
+as_storage_record_load_n_bins_ssd(as_storage_rd *rd)
+{
+	if (! as_record_is_live(rd->r)) {
+		rd->n_bins = 0;
+		return 0; // no need to read device
 	}
 
-	pthread_mutex_unlock(&p_wblock_state->LOCK);
+	// If the record hasn't been read, read it.
+	if (! rd->block && ssd_read_record(rd) != 0) {
+		cf_warning(AS_DRV_SSD, "load_n_bins: failed ssd_read_record()");
+		return -1;
+	}
 
-	return record_count;
+	rd->n_bins = rd->block->n_bins;
+	return 0;
 }
 
 
-// Thread "run" function to service a device's defrag queue.
-void*
-run_defrag(void *pv_data)
+int
+as_storage_record_load_bins_ssd(as_storage_rd *rd)
 {
-	drv_ssd *ssd = (drv_ssd*)pv_data;
-	uint32_t wblock_id;
-	uint8_t *read_buf = cf_valloc(ssd->write_block_size);
+	if (! as_record_is_live(rd->r)) {
+		return 0; // no need to read device
+	}
 
-	if (! read_buf) {
-		cf_crash(AS_DRV_SSD, "device %s: defrag valloc failed", ssd->name);
+	// If the record hasn't been read, read it.
+	if (! rd->block && ssd_read_record(rd) != 0) {
+		cf_warning(AS_DRV_SSD, "load_bins: failed ssd_read_record()");
+		return -1;
 	}
 
-	while (true) {
-		uint32_t q_min = ssd->ns->storage_defrag_queue_min;
+	drv_ssd_block *block = rd->block;
+	uint8_t *block_head = (uint8_t*)rd->block;
 
-		if (q_min != 0) {
-			if (cf_queue_sz(ssd->defrag_wblock_q) > q_min) {
-				if (CF_QUEUE_OK !=
-						cf_queue_pop(ssd->defrag_wblock_q, &wblock_id,
-								CF_QUEUE_NOWAIT)) {
-					// Should never get here!
-					break;
-				}
-			}
-			else {
-				usleep(1000 * 50);
-				continue;
-			}
-		}
-		else {
-			if (CF_QUEUE_OK !=
-					cf_queue_pop(ssd->defrag_wblock_q, &wblock_id,
-							CF_QUEUE_FOREVER)) {
-				// Should never get here!
-				break;
-			}
-		}
+	drv_ssd_bin *ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
 
-		ssd_defrag_wblock(ssd, wblock_id, read_buf);
+	for (uint16_t i = 0; i < block->n_bins; i++) {
+		as_bin_set_id_from_name(rd->ns, &rd->bins[i], ssd_bin->name);
 
-		uint32_t sleep_us = ssd->ns->storage_defrag_sleep;
+		int rv = as_bin_particle_cast_from_flat(&rd->bins[i],
+				block_head + ssd_bin->offset, ssd_bin->len);
 
-		if (sleep_us != 0) {
-			usleep(sleep_us);
+		if (0 != rv) {
+			return rv;
 		}
-	}
 
-	// Although we ever expect to get here...
-	cf_free(read_buf);
-	cf_warning(AS_DRV_SSD, "device %s: quit defrag - queue error", ssd->name);
+		ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
+	}
 
-	return NULL;
+	return 0;
 }
 
 
-void
-ssd_start_defrag_threads(drv_ssds *ssds)
+// Like as_storage_record_load_bins_ssd(), but bins not named in bin_names are
+// skipped without resolving their names or unpacking them - as if absent.
+int
+as_storage_record_load_bins_named_ssd(as_storage_rd *rd, cf_vector *bin_names)
 {
-	cf_info(AS_DRV_SSD, "{%s} starting defrag threads", ssds->ns->name);
-
-	for (int i = 0; i < ssds->n_ssds; i++) {
-		drv_ssd *ssd = &ssds->ssds[i];
+	if (! as_record_is_live(rd->r)) {
+		return 0; // no need to read device
+	}
 
-		if (pthread_create(&ssd->defrag_thread, NULL, run_defrag,
-				(void*)ssd) != 0) {
-			cf_crash(AS_DRV_SSD, "%s defrag thread failed", ssd->name);
-		}
+	// If the record hasn't been read, read it.
+	if (! rd->block && ssd_read_record(rd) != 0) {
+		cf_warning(AS_DRV_SSD, "load_bins: failed ssd_read_record()");
+		return -1;
 	}
-}
 
+	drv_ssd_block *block = rd->block;
+	uint8_t *block_head = (uint8_t*)rd->block;
+	uint32_t n_names = cf_vector_size(bin_names);
+	uint16_t n_loaded = 0;
 
-//------------------------------------------------
-// defrag_pen class.
-//
+	drv_ssd_bin *ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
 
-#define DEFRAG_PEN_INIT_CAPACITY (8 * 1024)
+	for (uint16_t i = 0; i < block->n_bins && n_loaded < n_names; i++) {
+		for (uint32_t n = 0; n < n_names; n++) {
+			if (strncmp(ssd_bin->name, (const char*)cf_vector_getp(bin_names, n),
+					AS_ID_BIN_SZ) != 0) {
+				continue;
+			}
 
-typedef struct defrag_pen_s {
-	uint32_t n_ids;
-	uint32_t capacity;
-	uint32_t *ids;
-	uint32_t stack_ids[DEFRAG_PEN_INIT_CAPACITY];
-} defrag_pen;
+			as_bin *b = &rd->bins[n_loaded++];
 
-static void
-defrag_pen_init(defrag_pen *pen)
-{
-	pen->n_ids = 0;
-	pen->capacity = DEFRAG_PEN_INIT_CAPACITY;
-	pen->ids = pen->stack_ids;
-}
+			as_bin_set_id_from_name(rd->ns, b, ssd_bin->name);
 
-static void
-defrag_pen_destroy(defrag_pen *pen)
-{
-	if (pen->ids != pen->stack_ids) {
-		cf_free(pen->ids);
-	}
-}
+			int rv = as_bin_particle_cast_from_flat(b,
+					block_head + ssd_bin->offset, ssd_bin->len);
+
+			if (0 != rv) {
+				return rv;
+			}
 
-static void
-defrag_pen_add(defrag_pen *pen, uint32_t wblock_id)
-{
-	if (pen->n_ids == pen->capacity) {
-		if (pen->capacity == DEFRAG_PEN_INIT_CAPACITY) {
-			pen->capacity <<= 2;
-			pen->ids = cf_malloc(pen->capacity * sizeof(uint32_t));
-			memcpy(pen->ids, pen->stack_ids, sizeof(pen->stack_ids));
-		}
-		else {
-			pen->capacity <<= 1;
-			pen->ids = cf_realloc(pen->ids, pen->capacity * sizeof(uint32_t));
+			break;
 		}
+
+		ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
 	}
 
-	pen->ids[pen->n_ids++] = wblock_id;
+	return 0;
 }
 
-static void
-defrag_pen_transfer(defrag_pen *pen, drv_ssd *ssd)
-{
-	// For speed, "customize" instead of using push_wblock_to_defrag_q()...
-	for (uint32_t i = 0; i < pen->n_ids; i++) {
-		uint32_t wblock_id = pen->ids[i];
-
-		ssd->alloc_table->wblock_state[wblock_id].state = WBLOCK_STATE_DEFRAG;
-		cf_queue_push(ssd->defrag_wblock_q, &wblock_id);
-	}
-}
 
-static void
-defrag_pens_dump(defrag_pen pens[], uint32_t n_pens, const char* ssd_name)
+// The records needn't be locked, but if not, as_storage_record_revalidate()
+// must be called for each under its lock before reading its bins.
+int
+as_storage_record_load_multi_ssd(as_storage_rd **rds, uint32_t n_rds)
 {
-	char buf[2048];
-	uint32_t n = 0;
-	int pos = sprintf(buf, "%u", pens[n++].n_ids);
-
-	while (n < n_pens) {
-		pos += sprintf(buf + pos, ",%u", pens[n++].n_ids);
+	if (n_rds != 0) {
+		ssd_read_records(rds, n_rds);
 	}
 
-	cf_info(AS_DRV_SSD, "%s init defrag profile: %s", ssd_name, buf);
+	return 0;
 }
 
-//
-// END - defrag_pen class.
-//------------------------------------------------
-
 
-// Thread "run" function to create and load a device's (wblock) free & defrag
-// queues at startup. Sorts defrag-eligible wblocks so the most depleted ones
-// are at the head of the defrag queue.
-void*
-run_load_queues(void *pv_data)
+void
+as_storage_record_revalidate_ssd(as_storage_rd *rd)
 {
-	drv_ssd *ssd = (drv_ssd*)pv_data;
+	drv_ssd_block *block = rd->block;
+	as_record *r = rd->r;
 
-	// TODO - would be nice to have a queue create of specified capacity.
-	if (! (ssd->free_wblock_q = cf_queue_create(sizeof(uint32_t), true))) {
-		cf_crash(AS_DRV_SSD, "%s free wblock queue create failed", ssd->name);
+	// If the record was replaced after it was read, drop what was read - it
+	// will be read again if needed. (A defrag move doesn't matter.)
+	if (block && (block->generation != r->generation ||
+			block->last_update_time != r->last_update_time)) {
+		as_storage_record_close_ssd(rd);
 	}
+}
 
-	if (! (ssd->defrag_wblock_q = cf_queue_create(sizeof(uint32_t), true))) {
-		cf_crash(AS_DRV_SSD, "%s defrag queue create failed", ssd->name);
-	}
 
-	as_namespace *ns = ssd->ns;
-	uint32_t lwm_pct = ns->storage_defrag_lwm_pct;
-	uint32_t lwm_size = ns->defrag_lwm_size;
-	defrag_pen pens[lwm_pct];
+// Rereads the record from device, whatever is cached, and checks it. Records
+// not yet (or no longer only) on device - in a write buffer - pass.
+bool
+as_storage_record_verify_ssd(as_storage_rd *rd)
+{
+	as_record *r = rd->r;
+	drv_ssd *ssd = rd->ssd;
 
-	for (uint32_t n = 0; n < lwm_pct; n++) {
-		defrag_pen_init(&pens[n]);
+	if (! ssd || STORAGE_RBLOCK_IS_INVALID(r->rblock_id)) {
+		return true;
 	}
 
-	ssd_alloc_table* at = ssd->alloc_table;
-	uint32_t first_id = BYTES_TO_WBLOCK_ID(ssd, ssd->header_size);
-	uint32_t last_id = at->n_wblocks;
+	uint32_t wblock = RBLOCK_ID_TO_WBLOCK_ID(ssd, r->rblock_id);
+	ssd_write_buf *swb = NULL;
 
-	for (uint32_t wblock_id = first_id; wblock_id < last_id; wblock_id++) {
-		uint32_t inuse_sz = at->wblock_state[wblock_id].inuse_sz;
+	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock], &swb);
 
-		if (inuse_sz == 0) {
-			// Faster than using push_wblock_to_free_q() here...
-			cf_queue_push(ssd->free_wblock_q, &wblock_id);
-		}
-		else if (inuse_sz < lwm_size) {
-			defrag_pen_add(&pens[(inuse_sz * lwm_pct) / lwm_size], wblock_id);
-		}
+	if (swb) {
+		swb_release(swb);
+		return true;
 	}
 
-	defrag_pens_dump(pens, lwm_pct, ssd->name);
+	uint64_t record_offset = RBLOCKS_TO_BYTES(r->rblock_id);
+	uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, record_offset);
+	size_t read_size = BYTES_UP_TO_IO_MIN(ssd, record_offset +
+			RBLOCKS_TO_BYTES(ssd_head_n_rblocks(r->n_rblocks))) - read_offset;
+	uint8_t *read_buf = ssd_read_device(ssd, read_offset, read_size);
 
-	for (uint32_t n = 0; n < lwm_pct; n++) {
-		defrag_pen_transfer(&pens[n], ssd);
-		defrag_pen_destroy(&pens[n]);
+	if (! read_buf) {
+		return false;
 	}
 
-	ssd->n_defrag_wblock_reads = (uint64_t)cf_queue_sz(ssd->defrag_wblock_q);
-
-	return NULL;
-}
-
-
-void
-ssd_load_wblock_queues(drv_ssds *ssds)
-{
-	cf_info(AS_DRV_SSD, "{%s} loading free & defrag queues", ssds->ns->name);
-
-	// Split this task across multiple threads.
-	pthread_t q_load_threads[ssds->n_ssds];
+	const drv_ssd_block *block =
+			(const drv_ssd_block*)(read_buf + (record_offset - read_offset));
+	bool ok = ssd_check_read_block(ssd, block, r, read_offset);
 
-	for (int i = 0; i < ssds->n_ssds; i++) {
-		drv_ssd *ssd = &ssds->ssds[i];
+	// A chunked record's chunks are checked too.
+	if (ok && ssd_block_is_chunked(block)) {
+		uint32_t size = 0;
+		drv_ssd_block *whole = ssd_read_chunks(
+				(drv_ssds*)rd->ns->storage_private, block, &size);
 
-		if (pthread_create(&q_load_threads[i], NULL, run_load_queues,
-				(void*)ssd) != 0) {
-			cf_crash(AS_DRV_SSD, "%s load queues thread failed", ssd->name);
+		if (whole) {
+			cf_io_buf_free(whole, size);
+		}
+		else {
+			ok = false;
 		}
 	}
 
-	for (int i = 0; i < ssds->n_ssds; i++) {
-		pthread_join(q_load_threads[i], NULL);
-	}
-	// Now we're single-threaded again.
-
-	for (int i = 0; i < ssds->n_ssds; i++) {
-		drv_ssd *ssd = &ssds->ssds[i];
+	cf_io_buf_free(read_buf, read_size);
 
-		cf_info(AS_DRV_SSD, "%s init wblock free-q %d, defrag-q %d", ssd->name,
-				cf_queue_sz(ssd->free_wblock_q),
-				cf_queue_sz(ssd->defrag_wblock_q));
-	}
+	return ok;
 }
 
 
-void
-ssd_wblock_init(drv_ssd *ssd)
+bool
+as_storage_record_get_key_ssd(as_storage_rd *rd)
 {
-	uint32_t n_wblocks = ssd->file_size / ssd->write_block_size;
-
-	cf_info(AS_DRV_SSD, "%s has %u wblocks of size %u", ssd->name, n_wblocks,
-			ssd->write_block_size);
+	// If the record hasn't been read, read it.
+	if (! rd->block && ssd_read_record(rd) != 0) {
+		cf_warning(AS_DRV_SSD, "get_key: failed ssd_read_record()");
+		return false;
+	}
 
-	ssd_alloc_table *at = cf_malloc(sizeof(ssd_alloc_table) + (n_wblocks * sizeof(ssd_wblock_state)));
+	drv_ssd_block *block = rd->block;
+	as_rec_props props;
 
-	at->n_wblocks = n_wblocks;
+	props.size = block->bins_offset;
 
-	// Device header wblocks' inuse_sz will (also) be 0 but that doesn't matter.
-	for (uint32_t i = 0; i < n_wblocks; i++) {
-		pthread_mutex_init(&at->wblock_state[i].LOCK, 0);
-		at->wblock_state[i].state = WBLOCK_STATE_NONE;
-		cf_atomic32_set(&at->wblock_state[i].inuse_sz, 0);
-		at->wblock_state[i].swb = 0;
+	if (props.size == 0) {
+		return false;
 	}
 
-	ssd->alloc_table = at;
+	props.p_data = block->data;
+
+	return as_rec_props_get_value(&props, CL_REC_PROPS_FIELD_KEY,
+			&rd->key_size, &rd->key) == 0;
 }
 
 
 //==========================================================
-// Record reading utilities.
+// Storage API implementation: device sweeps.
 //
 
-int
-ssd_read_record(as_storage_rd *rd)
+// Sweep reads are this big - a few wblocks per device request.
+#define SWEEP_READ_SIZE (8 * MAX_WRITE_BLOCK_SIZE)
+
+// Returns false if the sweep should stop.
+static bool
+ssd_sweep_record(drv_ssd *ssd, drv_ssd_block *block, uint64_t rblock_id,
+		uint32_t n_rblocks, as_storage_sweep_tree_fn tree_fn,
+		as_storage_sweep_record_fn record_fn, void *udata)
 {
-	as_namespace *ns = rd->ns;
-	as_record *r = rd->r;
+	as_namespace *ns = ssd->ns;
+	as_index_tree *tree = tree_fn(udata, as_partition_getid(&block->keyd));
 
-	if (STORAGE_RBLOCK_IS_INVALID(r->rblock_id)) {
-		cf_warning_digest(AS_DRV_SSD, &r->keyd, "{%s} read_ssd: invalid rblock_id ",
-				ns->name);
-		return -1;
+	if (! tree) {
+		return true;
 	}
 
-	uint64_t record_offset = RBLOCKS_TO_BYTES(r->rblock_id);
-	uint64_t record_size = RBLOCKS_TO_BYTES(r->n_rblocks);
-
-	uint8_t *read_buf = NULL;
-	drv_ssd_block *block = NULL;
+	as_index_ref r_ref;
+	r_ref.skip_lock = false;
 
-	drv_ssd *ssd = rd->ssd;
-	ssd_write_buf *swb = 0;
-	uint32_t wblock = RBLOCK_ID_TO_WBLOCK_ID(ssd, r->rblock_id);
+	if (as_record_get(tree, &block->keyd, &r_ref) != 0) {
+		return true; // presumably deleted
+	}
 
-	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock], &swb);
+	as_index *r = r_ref.r;
 
-	if (swb) {
-		// Data is in write buffer, so read it from there.
-		cf_atomic32_incr(&ns->n_reads_from_cache);
+	// Only the record's current copy counts - others are stale.
+	if (r->file_id != ssd->file_id || r->rblock_id != rblock_id ||
+			ssd_head_n_rblocks(r->n_rblocks) != n_rblocks ||
+			r->generation != block->generation) {
+		as_record_done(&r_ref, ns);
+		return true;
+	}
 
-		read_buf = cf_malloc(record_size);
+	if (! ssd_block_verify_checksum(block,
+			(uint32_t)RBLOCKS_TO_BYTES(n_rblocks))) {
+		cf_atomic64_incr(&ns->n_device_checksum_errors);
+		cf_warning_digest(AS_DRV_SSD, &r->keyd, "%s: sweep: bad checksum offset %lu ",
+				ssd->name, RBLOCKS_TO_BYTES(rblock_id));
+		as_record_done(&r_ref, ns);
+		return true;
+	}
 
-		if (! read_buf) {
-			return -1;
-		}
+	as_storage_rd rd;
 
-		block = (drv_ssd_block*)read_buf;
+	as_storage_record_open(ns, r, &rd);
 
-		int swb_offset = record_offset - WBLOCK_ID_TO_BYTES(ssd, wblock);
-		memcpy(read_buf, swb->buf + swb_offset, record_size);
-		swb_release(swb);
+	// The block lives in the sweep buffer - it's only good during the call.
+	if (ssd_read_record_done(&rd, block, NULL, 0) != 0) {
+		as_storage_record_close(&rd);
+		as_record_done(&r_ref, ns);
+		return true;
 	}
-	else {
-		// Normal case - data is read from device.
-		cf_atomic32_incr(&ns->n_reads_from_device);
-
-		uint64_t record_end_offset = record_offset + record_size;
-		uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, record_offset);
-		uint64_t read_end_offset = BYTES_UP_TO_IO_MIN(ssd, record_end_offset);
-		size_t read_size = read_end_offset - read_offset;
-		uint64_t record_buf_indent = record_offset - read_offset;
 
-		read_buf = cf_valloc(read_size);
+	return record_fn(udata, &r_ref, &rd);
+}
 
-		if (! read_buf) {
-			return -1;
-		}
 
-		int fd = ssd_fd_get(ssd);
+// Returns false if the sweep should stop.
+static bool
+ssd_sweep_wblock(drv_ssd *ssd, uint8_t *buf, uint32_t wblock_id,
+		as_storage_sweep_tree_fn tree_fn, as_storage_sweep_record_fn record_fn,
+		void *udata)
+{
+	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+	size_t wblock_offset = 0;
 
-		uint64_t start_ns = ns->storage_benchmarks_enabled ? cf_getns() : 0;
+	while (wblock_offset < ssd->write_block_size) {
+		drv_ssd_block *block = (drv_ssd_block*)&buf[wblock_offset];
 
-		if (lseek(fd, (off_t)read_offset, SEEK_SET) != (off_t)read_offset) {
-			cf_warning(AS_DRV_SSD, "%s: seek failed: offset %lu: errno %d (%s)",
-					ssd->name, read_offset, errno, cf_strerror(errno));
-			cf_free(read_buf);
-			close(fd);
-			return -1;
+		if (block->magic != SSD_BLOCK_MAGIC &&
+				block->magic != SSD_CHUNK_MAGIC) {
+			// Unused space, or blocks since freed - skip to next block.
+			wblock_offset += RBLOCK_SIZE;
+			continue;
 		}
 
-		ssize_t rv = read(fd, read_buf, read_size);
+		size_t next_wblock_offset = wblock_offset +
+				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
 
-		if (rv != (ssize_t)read_size) {
-			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): size %lu: errno %d (%s)",
-					ssd->name, rv, read_size, errno, cf_strerror(errno));
-			cf_free(read_buf);
-			close(fd);
-			return -1;
+		if (next_wblock_offset > ssd->write_block_size) {
+			cf_warning(AS_DRV_SSD, "%s: sweep: block extends over wblock %u",
+					ssd->name, wblock_id);
+			break;
 		}
 
-		if (start_ns != 0) {
-			histogram_insert_data_point(ssd->hist_read, start_ns);
+		// Chunks are swept with their records' heads.
+		if (block->magic == SSD_CHUNK_MAGIC) {
+			wblock_offset = next_wblock_offset;
+			continue;
 		}
 
-		ssd_fd_put(ssd, fd);
-
-		block = (drv_ssd_block*)(read_buf + record_buf_indent);
-
-		// Sanity checks.
-		if (block->magic != SSD_BLOCK_MAGIC) {
-			cf_warning(AS_DRV_SSD, "read: bad block magic offset %"PRIu64,
-					read_offset);
-			cf_free(read_buf);
-			return -1;
-		}
-		if (0 != cf_digest_compare(&block->keyd, &r->keyd)) {
-			cf_warning(AS_DRV_SSD, "read: read wrong key: expecting %"PRIx64" got %"PRIx64,
-				*(uint64_t*)&r->keyd, *(uint64_t*)&block->keyd);
-			cf_free(read_buf);
-			return -1;
+		if (! ssd_sweep_record(ssd, block,
+				BYTES_TO_RBLOCKS(file_offset + wblock_offset),
+				(uint32_t)BYTES_TO_RBLOCKS(next_wblock_offset - wblock_offset),
+				tree_fn, record_fn, udata)) {
+			return false;
 		}
 
-		if (ns->storage_benchmarks_enabled) {
-			histogram_insert_raw(ns->device_read_size_hist, read_size);
-		}
+		wblock_offset = next_wblock_offset;
 	}
 
-	rd->block = block;
-	rd->must_free_block = read_buf;
-
-	return 0;
+	return true;
 }
 
 
-//==========================================================
-// Storage API implementation: reading records.
-//
-
-int
-as_storage_record_load_n_bins_ssd(as_storage_rd *rd)
+uint32_t
+as_storage_n_devices_ssd(as_namespace *ns)
 {
-	if (! as_record_is_live(rd->r)) {
-		rd->n_bins = 0;
-		return 0; // no need to read device
-	}
-
-	// If the record hasn't been read, read it.
-	if (! rd->block && ssd_read_record(rd) != 0) {
-		cf_warning(AS_DRV_SSD, "load_n_bins: failed ssd_read_record()");
-		return -1;
+	if (ns->storage_data_in_memory) {
+		return 0; // records are read from memory, no point sweeping
 	}
 
-	rd->n_bins = rd->block->n_bins;
-	return 0;
+	return (uint32_t)((drv_ssds*)ns->storage_private)->n_ssds;
 }
 
 
-int
-as_storage_record_load_bins_ssd(as_storage_rd *rd)
+// Like a cold start sweep, reads runs of used wblocks sequentially, except
+// that wblocks still being filled are read from their write buffers. Records
+// moved between wblocks during the sweep may be missed.
+bool
+as_storage_sweep_device_ssd(as_namespace *ns, uint32_t device_ix,
+		as_storage_sweep_tree_fn tree_fn, as_storage_sweep_record_fn record_fn,
+		void *udata)
 {
-	if (! as_record_is_live(rd->r)) {
-		return 0; // no need to read device
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+
+	if (device_ix >= (uint32_t)ssds->n_ssds) {
+		return false;
+	}
+
+	drv_ssd *ssd = &ssds->ssds[device_ix];
+	uint8_t *buf = cf_valloc(SWEEP_READ_SIZE);
+
+	if (! buf) {
+		cf_warning(AS_DRV_SSD, "%s: sweep: failed buffer alloc", ssd->name);
+		return false;
 	}
 
-	// If the record hasn't been read, read it.
-	if (! rd->block && ssd_read_record(rd) != 0) {
-		cf_warning(AS_DRV_SSD, "load_bins: failed ssd_read_record()");
-		return -1;
-	}
+	ssd_alloc_table *at = ssd->alloc_table;
+	uint32_t max_run = SWEEP_READ_SIZE / ssd->write_block_size;
+	uint32_t wblock_id = BYTES_TO_WBLOCK_ID(ssd, ssd->header_size);
+	bool ok = true;
+
+	while (ok && wblock_id < at->n_wblocks) {
+		ssd_wblock_state *p_wblock_state = &at->wblock_state[wblock_id];
+		ssd_write_buf *swb = NULL;
+
+		swb_check_and_reserve(p_wblock_state, &swb);
+
+		if (swb) {
+			memcpy(buf, swb->buf, ssd->write_block_size);
+			swb_release(swb);
+
+			ok = ssd_sweep_wblock(ssd, buf, wblock_id, tree_fn, record_fn,
+					udata);
+			wblock_id++;
+			continue;
+		}
+
+		// Gather a run of used wblocks, all on device.
+		uint32_t n_run = 0;
+
+		while (n_run < max_run && wblock_id + n_run < at->n_wblocks) {
+			ssd_wblock_state *p_state = &at->wblock_state[wblock_id + n_run];
+
+			if (cf_atomic32_get(p_state->inuse_sz) == 0 || p_state->swb) {
+				break;
+			}
+
+			n_run++;
+		}
+
+		if (n_run == 0) {
+			wblock_id++; // empty
+			continue;
+		}
+
+		int fd = ssd_fd_get(ssd);
+		uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+		size_t read_size = (size_t)n_run * ssd->write_block_size;
+
+		uint64_t start_ns = ns->storage_benchmarks_enabled ? cf_getns() : 0;
+
+		ssd_io_start(ssd, SSD_IO_SCAN);
+		ssd_io_depth_add(&ssd->large_read_depth, 1);
 
-	drv_ssd_block *block = rd->block;
-	uint8_t *block_head = (uint8_t*)rd->block;
+		ssize_t rlen = ssd_pread(ssd, fd, buf, read_size, (off_t)file_offset);
 
-	drv_ssd_bin *ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
+		ssd_io_depth_sub(&ssd->large_read_depth, 1);
+		ssd_io_finish(ssd, SSD_IO_SCAN);
 
-	for (uint16_t i = 0; i < block->n_bins; i++) {
-		as_bin_set_id_from_name(rd->ns, &rd->bins[i], ssd_bin->name);
+		if (rlen != (ssize_t)read_size) {
+			cf_warning(AS_DRV_SSD, "%s: sweep: read failed (%ld): size %lu offset %lu: errno %d (%s)",
+					ssd->name, rlen, read_size, file_offset, errno,
+					cf_strerror(errno));
+			close(fd);
+			ok = false;
+			break;
+		}
 
-		int rv = as_bin_particle_cast_from_flat(&rd->bins[i],
-				block_head + ssd_bin->offset, ssd_bin->len);
+		if (start_ns != 0) {
+			histogram_insert_data_point(ssd->hist_large_block_read, start_ns);
+		}
 
-		if (0 != rv) {
-			return rv;
+		ssd_fd_put(ssd, fd);
+
+		for (uint32_t i = 0; ok && i < n_run; i++) {
+			ok = ssd_sweep_wblock(ssd, buf + (i * ssd->write_block_size),
+					wblock_id + i, tree_fn, record_fn, udata);
 		}
 
-		ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
+		wblock_id += n_run;
 	}
 
-	return 0;
+	cf_free(buf);
+
+	return ok;
 }
 
 
-bool
-as_storage_record_get_key_ssd(as_storage_rd *rd)
+//==========================================================
+// Record writing utilities.
+//
+
+// With commit-to-device, only one device write of an swb may be in flight at
+// a time - a full flush must not race a partial commit of the same wblock.
+static inline void
+ssd_commit_lock_swb(drv_ssd *ssd, ssd_write_buf *swb)
 {
-	// If the record hasn't been read, read it.
-	if (! rd->block && ssd_read_record(rd) != 0) {
-		cf_warning(AS_DRV_SSD, "get_key: failed ssd_read_record()");
-		return false;
+	pthread_mutex_lock(&ssd->commit_lock);
+
+	while (swb->committing) {
+		pthread_cond_wait(&ssd->commit_cond, &ssd->commit_lock);
 	}
 
-	drv_ssd_block *block = rd->block;
-	as_rec_props props;
+	swb->committing = true;
 
-	props.size = block->bins_offset;
+	pthread_mutex_unlock(&ssd->commit_lock);
+}
 
-	if (props.size == 0) {
-		return false;
+static inline void
+ssd_commit_unlock_swb(drv_ssd *ssd, ssd_write_buf *swb, uint32_t pos)
+{
+	pthread_mutex_lock(&ssd->commit_lock);
+
+	if (pos > swb->committed_pos) {
+		swb->committed_pos = pos;
 	}
 
-	props.p_data = block->data;
+	swb->committing = false;
 
-	return as_rec_props_get_value(&props, CL_REC_PROPS_FIELD_KEY,
-			&rd->key_size, &rd->key) == 0;
+	// Wake everyone - all writers now covered return together.
+	pthread_cond_broadcast(&ssd->commit_cond);
+	pthread_mutex_unlock(&ssd->commit_lock);
 }
 
 
-//==========================================================
-// Record writing utilities.
-//
-
 void
 ssd_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
 {
+	bool commit = ssd->ns->storage_commit_to_device;
+
+	if (commit) {
+		ssd_commit_lock_swb(ssd, swb);
+	}
+
 	// Wait for all writers to finish.
 	while (cf_atomic32_get(swb->n_writers) != 0) {
 		;
@@ -1314,16 +3336,24 @@ ssd_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
 
 	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
 
-	if (lseek(fd, write_offset, SEEK_SET) != write_offset) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: offset %ld: errno %d (%s)",
-				ssd->name, write_offset, errno, cf_strerror(errno));
-	}
+	ASD_SSD_FLUSH_STARTING((uint64_t)ssd, (uint64_t)write_offset,
+			ssd->write_block_size);
+
+	ssd_io_start(ssd, SSD_IO_FLUSH);
+	ssd_io_depth_add(&ssd->write_depth, 1);
+
+	ssize_t rv_s = ssd_pwrite(ssd, fd, swb->buf, ssd->write_block_size,
+			write_offset);
+
+	ssd_io_depth_sub(&ssd->write_depth, 1);
+	ssd_io_finish(ssd, SSD_IO_FLUSH);
 
-	ssize_t rv_s = write(fd, swb->buf, ssd->write_block_size);
+	ASD_SSD_FLUSH_FINISHED((uint64_t)ssd, (uint64_t)write_offset,
+			(uint64_t)rv_s);
 
 	if (rv_s != (ssize_t)ssd->write_block_size) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
-				ssd->name, errno, cf_strerror(errno));
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %ld: errno %d (%s)",
+				ssd->name, write_offset, errno, cf_strerror(errno));
 	}
 
 	if (start_ns != 0) {
@@ -1331,27 +3361,106 @@ ssd_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
 	}
 
 	ssd_fd_put(ssd, fd);
+
+	if (commit) {
+		ssd_commit_unlock_swb(ssd, swb, swb->pos);
+	}
+}
+
+
+// Group commit - make sure a record written to [0, end_pos) of the swb is on
+// device. Whoever finds no commit in flight writes everything reserved so far,
+// on behalf of all writers waiting on the swb. Caller holds a reference on the
+// swb, so it can't be recycled - even if it's fully flushed meanwhile.
+static void
+ssd_commit_record(drv_ssd *ssd, ssd_write_shard *shard, ssd_write_buf *swb,
+		uint32_t end_pos)
+{
+	pthread_mutex_lock(&ssd->commit_lock);
+
+	while (swb->committed_pos < end_pos) {
+		if (swb->committing) {
+			pthread_cond_wait(&ssd->commit_cond, &ssd->commit_lock);
+			continue;
+		}
+
+		swb->committing = true;
+
+		uint32_t start_pos = swb->committed_pos;
+
+		pthread_mutex_unlock(&ssd->commit_lock);
+
+		// Everyone who reserved space by now is covered by this commit.
+		pthread_mutex_lock(&shard->lock);
+
+		uint32_t pos = swb->pos;
+
+		pthread_mutex_unlock(&shard->lock);
+
+		// Wait for their writes into the buffer to finish.
+		while (cf_atomic32_get(swb->n_writers) != 0) {
+			;
+		}
+
+		uint64_t start = BYTES_DOWN_TO_IO_MIN(ssd, start_pos);
+		size_t size = (size_t)(BYTES_UP_TO_IO_MIN(ssd, pos) - start);
+		off_t write_offset =
+				(off_t)(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + start);
+
+		int fd = ssd_fd_get(ssd);
+
+		uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ?
+				cf_getns() : 0;
+
+		ssd_io_start(ssd, SSD_IO_FLUSH);
+		ssd_io_depth_add(&ssd->write_depth, 1);
+
+		ssize_t rv_s = ssd_pwrite(ssd, fd, swb->buf + start, size,
+				write_offset);
+
+		ssd_io_depth_sub(&ssd->write_depth, 1);
+		ssd_io_finish(ssd, SSD_IO_FLUSH);
+
+		if (rv_s != (ssize_t)size) {
+			cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %ld: errno %d (%s)",
+					ssd->name, write_offset, errno, cf_strerror(errno));
+		}
+
+		// Without O_SYNC the data may still be in a volatile cache.
+		if (! ssd->pmem_base && ! ssd->ns->storage_enable_osync &&
+				fdatasync(fd) != 0) {
+			cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED fdatasync: errno %d (%s)",
+					ssd->name, errno, cf_strerror(errno));
+		}
+
+		if (start_ns != 0) {
+			histogram_insert_data_point(ssd->hist_write, start_ns);
+		}
+
+		ssd_fd_put(ssd, fd);
+
+		ssd_commit_unlock_swb(ssd, swb, pos);
+
+		pthread_mutex_lock(&ssd->commit_lock);
+	}
+
+	pthread_mutex_unlock(&ssd->commit_lock);
 }
 
 
 void
-ssd_shadow_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
+ssd_shadow_flush_buf(drv_ssd *ssd, ssd_shadow_buf *sbuf)
 {
 	int fd = ssd_shadow_fd_get(ssd);
-	off_t write_offset = (off_t)WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id);
+	off_t write_offset = (off_t)WBLOCK_ID_TO_BYTES(ssd, sbuf->wblock_id);
 
 	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
 
-	if (lseek(fd, write_offset, SEEK_SET) != write_offset) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: offset %ld: errno %d (%s)",
-				ssd->shadow_name, write_offset, errno, cf_strerror(errno));
-	}
-
-	ssize_t rv_s = write(fd, swb->buf, ssd->write_block_size);
+	ssize_t rv_s = pwrite(fd, sbuf->buf, ssd->write_block_size, write_offset);
 
 	if (rv_s != (ssize_t)ssd->write_block_size) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
-				ssd->shadow_name, errno, cf_strerror(errno));
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %ld: errno %d (%s)",
+				ssd->shadow_name, write_offset, errno, cf_strerror(errno));
 	}
 
 	if (start_ns != 0) {
@@ -1413,16 +3522,300 @@ ssd_post_write(drv_ssd *ssd, ssd_write_buf *swb)
 }
 
 
+//------------------------------------------------
+// Shadow buffers.
+//
+
+static ssd_shadow_buf *
+shadow_buf_create(drv_ssd *ssd)
+{
+	ssd_shadow_buf *sbuf = (ssd_shadow_buf*)cf_malloc(sizeof(ssd_shadow_buf));
+
+	if (! sbuf) {
+		return NULL;
+	}
+
+	// As for swbs, using valloc for direct I/O.
+	if (! (sbuf->buf = cf_valloc(ssd->write_block_size))) {
+		cf_free(sbuf);
+		return NULL;
+	}
+
+	return sbuf;
+}
+
+static void
+shadow_buf_destroy(ssd_shadow_buf *sbuf)
+{
+	cf_free(sbuf->buf);
+	cf_free(sbuf);
+}
+
+static inline void
+shadow_buf_release(drv_ssd *ssd, ssd_shadow_buf *sbuf)
+{
+	cf_atomic64_set(&ssd->shadow_lag_ns, cf_getns() - sbuf->queued_ns);
+	cf_queue_push(ssd->shadow_buf_free_q, &sbuf);
+}
+
+
+// Copy a wblock just written to device, and queue the copy for the shadow. The
+// swb is then done with - the shadow can fall behind the device without
+// holding swbs or delaying device flushes. (Shadow lag is instead bounded by
+// failing client writes - see as_storage_overloaded_ssd().)
+void
+ssd_shadow_enqueue(drv_ssd *ssd, ssd_write_buf *swb)
+{
+	ssd_shadow_buf *sbuf;
+
+	if (CF_QUEUE_OK != cf_queue_pop(ssd->shadow_buf_free_q, &sbuf,
+			CF_QUEUE_NOWAIT) && ! (sbuf = shadow_buf_create(ssd))) {
+		cf_crash(AS_DRV_SSD, "device %s: can't allocate shadow buffer",
+				ssd->name);
+	}
+
+	memcpy(sbuf->buf, swb->buf, ssd->write_block_size);
+	sbuf->wblock_id = swb->wblock_id;
+	sbuf->queued_ns = cf_getns();
+
+	cf_queue_push(ssd->shadow_buf_q, &sbuf);
+}
+
+
+// Flush swbs using an io_uring, keeping up to the ring's depth of wblock
+// writes in flight on the device. Pops from and pushes to the same queues as
+// the synchronous workers.
+static void
+ssd_uring_write_loop(drv_ssd *ssd, cf_uring *ring)
+{
+	cf_mpmc_queue *swb_q = ssd->swb_write_q;
+	histogram *hist = ssd->hist_write;
+	const char *name = ssd->name;
+	int fd = ssd_fd_get(ssd);
+
+	// Note - keep going after shutdown clears 'running' until in-flight writes
+	// are all complete.
+	while (ssd->running || cf_uring_n_inflight(ring) != 0) {
+		// Fill the ring - only wait for work if nothing is in flight.
+		while (ssd->running && cf_uring_n_free(ring) != 0) {
+			ssd_write_buf *swb;
+			int timeout = cf_uring_n_inflight(ring) == 0 ?
+					100 : CF_MPMC_QUEUE_NOWAIT;
+
+			if (! cf_mpmc_queue_pop(swb_q, &swb, timeout)) {
+				break;
+			}
+
+			// Sanity checks (optional).
+			ssd_write_sanity_checks(ssd, swb);
+
+			// Wait for all writers to finish.
+			while (cf_atomic32_get(swb->n_writers) != 0) {
+				;
+			}
+
+			swb->io_start_ns = ssd->ns->storage_benchmarks_enabled ?
+					cf_getns() : 0;
+
+			cf_uring_queue_write(ring, fd, swb->buf, ssd->write_block_size,
+					WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id), swb);
+			ssd_io_start(ssd, SSD_IO_FLUSH);
+			ssd_io_depth_add(&ssd->write_depth, 1);
+		}
+
+		if (cf_uring_n_inflight(ring) == 0) {
+			continue;
+		}
+
+		// Hand over everything queued, and wait for at least one completion.
+		if (cf_uring_submit(ring, 1) < 0) {
+			cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED io_uring submit", name);
+		}
+
+		ssd_write_buf *swb;
+		int32_t res;
+
+		while (cf_uring_reap(ring, (void**)&swb, &res)) {
+			ssd_io_depth_sub(&ssd->write_depth, 1);
+			ssd_io_finish(ssd, SSD_IO_FLUSH);
+
+			if (res != (int32_t)ssd->write_block_size) {
+				cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %lu: res %d (%s)",
+						name, WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id), res,
+						res < 0 ? cf_strerror(-res) : "short write");
+			}
+
+			if (swb->io_start_ns != 0) {
+				histogram_insert_data_point(hist, swb->io_start_ns);
+			}
+
+			if (ssd->shadow_name) {
+				// Queue copy for shadow device write.
+				ssd_shadow_enqueue(ssd, swb);
+			}
+
+			// Transfer to post-write queue, or release swb, as appropriate.
+			ssd_post_write(ssd, swb);
+		}
+	}
+
+	ssd_fd_put(ssd, fd);
+}
+
+
+// Is a write to this wblock already in flight? If so, a newer copy must wait -
+// the ring may complete writes out of order.
+static bool
+shadow_wblock_in_flight(ssd_shadow_buf **in_flight, uint32_t n_in_flight,
+		uint32_t wblock_id)
+{
+	for (uint32_t i = 0; i < n_in_flight; i++) {
+		if (in_flight[i]->wblock_id == wblock_id) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// Flush shadow bufs using an io_uring, keeping up to the ring's depth of
+// wblock writes in flight on the shadow device.
+static void
+ssd_uring_shadow_loop(drv_ssd *ssd, cf_uring *ring)
+{
+	int fd = ssd_shadow_fd_get(ssd);
+	uint32_t max_in_flight = cf_uring_n_free(ring);
+	ssd_shadow_buf **in_flight = cf_malloc(sizeof(ssd_shadow_buf*) *
+			max_in_flight);
+	uint32_t n_in_flight = 0;
+	ssd_shadow_buf *next_sbuf = NULL; // popped, but must wait
+
+	if (! in_flight) {
+		cf_crash(AS_DRV_SSD, "device %s: can't allocate shadow in-flight array",
+				ssd->name);
+	}
+
+	// Note - keep going after shutdown clears 'running' until in-flight writes
+	// are all complete.
+	while (ssd->running || n_in_flight != 0) {
+		// Fill the ring - only wait for work if nothing is in flight.
+		while (ssd->running && n_in_flight < max_in_flight) {
+			if (! next_sbuf) {
+				int timeout = n_in_flight == 0 ? 100 : CF_QUEUE_NOWAIT;
+
+				if (CF_QUEUE_OK != cf_queue_pop(ssd->shadow_buf_q, &next_sbuf,
+						timeout)) {
+					next_sbuf = NULL;
+					break;
+				}
+			}
+
+			if (shadow_wblock_in_flight(in_flight, n_in_flight,
+					next_sbuf->wblock_id)) {
+				break;
+			}
+
+			ssd_shadow_buf *sbuf = next_sbuf;
+
+			next_sbuf = NULL;
+			in_flight[n_in_flight++] = sbuf;
+
+			sbuf->io_start_ns = ssd->ns->storage_benchmarks_enabled ?
+					cf_getns() : 0;
+
+			cf_uring_queue_write(ring, fd, sbuf->buf, ssd->write_block_size,
+					WBLOCK_ID_TO_BYTES(ssd, sbuf->wblock_id), sbuf);
+		}
+
+		if (n_in_flight == 0) {
+			continue;
+		}
+
+		// Hand over everything queued, and wait for at least one completion.
+		if (cf_uring_submit(ring, 1) < 0) {
+			cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED io_uring submit",
+					ssd->shadow_name);
+		}
+
+		ssd_shadow_buf *sbuf;
+		int32_t res;
+
+		while (cf_uring_reap(ring, (void**)&sbuf, &res)) {
+			if (res != (int32_t)ssd->write_block_size) {
+				cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %lu: res %d (%s)",
+						ssd->shadow_name,
+						WBLOCK_ID_TO_BYTES(ssd, sbuf->wblock_id), res,
+						res < 0 ? cf_strerror(-res) : "short write");
+			}
+
+			if (sbuf->io_start_ns != 0) {
+				histogram_insert_data_point(ssd->hist_shadow_write,
+						sbuf->io_start_ns);
+			}
+
+			for (uint32_t i = 0; i < n_in_flight; i++) {
+				if (in_flight[i] == sbuf) {
+					in_flight[i] = in_flight[--n_in_flight];
+					break;
+				}
+			}
+
+			shadow_buf_release(ssd, sbuf);
+		}
+	}
+
+	// Only at shutdown, after the shadow queue drained - but don't lose it.
+	if (next_sbuf) {
+		ssd_shadow_flush_buf(ssd, next_sbuf);
+		shadow_buf_release(ssd, next_sbuf);
+	}
+
+	cf_free(in_flight);
+	ssd_shadow_fd_put(ssd, fd);
+}
+
+
+static cf_uring *
+ssd_create_write_ring(drv_ssd *ssd)
+{
+	uint32_t depth = ssd->ns->storage_io_uring_depth;
+
+	if (depth == 0) {
+		return NULL;
+	}
+
+	cf_uring *ring = cf_uring_create(depth);
+
+	if (! ring) {
+		cf_warning(AS_DRV_SSD, "device %s: can't create io_uring - using synchronous writes",
+				ssd->name);
+	}
+
+	return ring;
+}
+
+
 // Thread "run" function that flushes write buffers to device.
 void *
 ssd_write_worker(void *arg)
 {
 	drv_ssd *ssd = (drv_ssd*)arg;
 
+	cf_thread_set_role("ssd-write");
+
+	cf_uring *ring = ssd_create_write_ring(ssd);
+
+	if (ring) {
+		ssd_uring_write_loop(ssd, ring);
+		cf_uring_destroy(ring);
+		return NULL;
+	}
+
 	while (ssd->running) {
 		ssd_write_buf *swb;
 
-		if (CF_QUEUE_OK != cf_queue_pop(ssd->swb_write_q, &swb, 100)) {
+		if (! cf_mpmc_queue_pop(ssd->swb_write_q, &swb, 100)) {
 			continue;
 		}
 
@@ -1433,40 +3826,45 @@ ssd_write_worker(void *arg)
 		ssd_flush_swb(ssd, swb);
 
 		if (ssd->shadow_name) {
-			// Queue for shadow device write.
-			cf_queue_push(ssd->swb_shadow_q, &swb);
-		}
-		else {
-			// Transfer to post-write queue, or release swb, as appropriate.
-			ssd_post_write(ssd, swb);
+			// Queue copy for shadow device write.
+			ssd_shadow_enqueue(ssd, swb);
 		}
+
+		// Transfer to post-write queue, or release swb, as appropriate.
+		ssd_post_write(ssd, swb);
 	} // infinite event loop waiting for block to write
 
 	return NULL;
 }
 
 
-// Thread "run" function that flushes write buffers to shadow device.
+// Thread "run" function that flushes shadow buffers to shadow device.
 void *
 ssd_shadow_worker(void *arg)
 {
 	drv_ssd *ssd = (drv_ssd*)arg;
 
+	cf_thread_set_role("ssd-shadow");
+
+	cf_uring *ring = ssd_create_write_ring(ssd);
+
+	if (ring) {
+		ssd_uring_shadow_loop(ssd, ring);
+		cf_uring_destroy(ring);
+		return NULL;
+	}
+
 	while (ssd->running) {
-		ssd_write_buf *swb;
+		ssd_shadow_buf *sbuf;
 
-		if (CF_QUEUE_OK != cf_queue_pop(ssd->swb_shadow_q, &swb, 100)) {
+		if (CF_QUEUE_OK != cf_queue_pop(ssd->shadow_buf_q, &sbuf, 100)) {
 			continue;
 		}
 
-		// Sanity checks (optional).
-		ssd_write_sanity_checks(ssd, swb);
-
 		// Flush to the shadow device.
-		ssd_shadow_flush_swb(ssd, swb);
+		ssd_shadow_flush_buf(ssd, sbuf);
 
-		// Transfer to post-write queue, or release swb, as appropriate.
-		ssd_post_write(ssd, swb);
+		shadow_buf_release(ssd, sbuf);
 	}
 
 	return NULL;
@@ -1515,6 +3913,27 @@ as_storage_record_overhead_size(as_storage_rd *rd)
 }
 
 
+// Ordered maps may keep their indexes on device, if so configured.
+static inline uint32_t
+ssd_bin_flat_size(const as_namespace *ns, as_bin *bin)
+{
+	return ns->storage_persist_map_index &&
+			as_bin_get_particle_type(bin) == AS_PARTICLE_TYPE_MAP ?
+					as_bin_particle_map_indexed_flat_size(bin) :
+					as_bin_particle_flat_size(bin);
+}
+
+
+static inline uint32_t
+ssd_bin_to_flat(const as_namespace *ns, const as_bin *bin, uint8_t *flat)
+{
+	return ns->storage_persist_map_index &&
+			as_bin_get_particle_type(bin) == AS_PARTICLE_TYPE_MAP ?
+					as_bin_particle_map_to_indexed_flat(bin, flat) :
+					as_bin_particle_to_flat(bin, flat);
+}
+
+
 uint32_t
 as_storage_record_size(as_storage_rd *rd)
 {
@@ -1531,7 +3950,7 @@ as_storage_record_size(as_storage_rd *rd)
 
 		// TODO: could factor out sizeof(drv_ssd_bin) and multiply by i, but
 		// for now let's favor the low bin-count case and leave it this way.
-		write_size += sizeof(drv_ssd_bin) + as_bin_particle_flat_size(bin);
+		write_size += sizeof(drv_ssd_bin) + ssd_bin_flat_size(rd->ns, bin);
 	}
 
 	return write_size;
@@ -1548,33 +3967,324 @@ ssd_write_calculate_size(as_storage_rd *rd)
 }
 
 
-int
-ssd_write_bins(as_storage_rd *rd)
+// A record is hot if it's an update, and the version it replaces was written
+// recently. The record's last-update-time has already been advanced for this
+// write, so the old version's age comes from when its wblock was opened.
+static inline bool
+ssd_write_is_hot(as_storage_rd *rd)
 {
 	as_namespace *ns = rd->ns;
 	as_record *r = rd->r;
-	drv_ssd *ssd = rd->ssd;
+	uint32_t hot_age = ns->storage_hot_record_age;
 
-	uint32_t write_size = ssd_write_calculate_size(rd);
+	if (hot_age == 0 || r->generation <= 1 ||
+			! STORAGE_RBLOCK_IS_VALID(r->rblock_id)) {
+		return false;
+	}
 
-	if (write_size > ssd->write_block_size) {
-		cf_warning(AS_DRV_SSD, "write: rejecting %"PRIx64" write size: %u",
-				*(uint64_t*)&r->keyd, write_size);
-		return -AS_PROTO_RESULT_FAIL_RECORD_TOO_BIG;
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	drv_ssd *old_ssd = &ssds->ssds[r->file_id];
+	uint32_t old_wblock_id = RBLOCK_ID_TO_WBLOCK_ID(old_ssd, r->rblock_id);
+	uint32_t old_write_sec =
+			old_ssd->alloc_table->wblock_state[old_wblock_id].write_sec;
+
+	return (uint32_t)cf_get_seconds() - old_write_sec < hot_age;
+}
+
+
+// Flatten the record into buf, which has room for write_size bytes.
+static void
+ssd_flatten_block(as_storage_rd *rd, uint8_t *buf, uint32_t write_size)
+{
+	as_namespace *ns = rd->ns;
+	as_record *r = rd->r;
+
+	uint8_t *buf_start = buf;
+
+	drv_ssd_block *block = (drv_ssd_block*)buf;
+
+	buf += sizeof(drv_ssd_block);
+
+	// Properties list goes just before bins.
+	if (rd->rec_props.p_data) {
+		memcpy(buf, rd->rec_props.p_data, rd->rec_props.size);
+		buf += rd->rec_props.size;
+	}
+
+	uint16_t n_bins_written;
+
+	for (n_bins_written = 0; n_bins_written < rd->n_bins; n_bins_written++) {
+		as_bin *bin = &rd->bins[n_bins_written];
+
+		if (! as_bin_inuse(bin)) {
+			break;
+		}
+
+		drv_ssd_bin *ssd_bin = (drv_ssd_bin*)buf;
+
+		buf += sizeof(drv_ssd_bin);
+
+		ssd_bin->version = 0;
+
+		if (ns->single_bin) {
+			ssd_bin->name[0] = 0;
+		}
+		else {
+			strcpy(ssd_bin->name, as_bin_get_name_from_id(ns, bin->id));
+		}
+
+		ssd_bin->offset = buf - buf_start;
+
+		uint32_t particle_flat_size = ssd_bin_to_flat(ns, bin, buf);
+
+		buf += particle_flat_size;
+		ssd_bin->len = particle_flat_size;
+		ssd_bin->next = buf - buf_start;
+	}
+
+	block->compression = 0;
+	block->data_size = 0;
+	block->length = write_size - LENGTH_BASE;
+	block->magic = SSD_BLOCK_MAGIC;
+	block->keyd = r->keyd;
+	block->generation = r->generation;
+	block->void_time = r->void_time;
+	block->bins_offset = rd->rec_props.p_data ? rd->rec_props.size : 0;
+	block->n_bins = n_bins_written;
+	block->last_update_time = r->last_update_time;
+}
+
+
+// Returns a compressed block the caller must free, and updates *p_write_size,
+// or returns NULL if compression wouldn't save at least one rblock.
+static uint8_t *
+ssd_compress_block(as_storage_rd *rd, uint32_t *p_write_size)
+{
+	as_namespace *ns = rd->ns;
+	uint32_t write_size = *p_write_size;
+
+	// Too small to save an rblock.
+	if (write_size <= RBLOCK_SIZE) {
+		return NULL;
+	}
+
+	uint8_t *flat = cf_malloc(write_size);
+
+	if (! flat) {
+		return NULL;
+	}
+
+	ssd_flatten_block(rd, flat, write_size);
+
+	uint32_t data_size = as_storage_record_size(rd) - sizeof(drv_ssd_block);
+	uint16_t set_id = as_index_get_set_id(rd->r);
+	cf_compression_dict *dict = ns->compression_dicts[set_id];
+
+	// Only accept output that saves at least one rblock.
+	uint32_t max_size = write_size - RBLOCK_SIZE;
+	uint8_t *compressed = cf_malloc(max_size);
+
+	if (! compressed) {
+		cf_free(flat);
+		return NULL;
+	}
+
+	// Room for the compressed size and checksum.
+	uint32_t header_size = sizeof(drv_ssd_block) + (2 * sizeof(uint32_t));
+	drv_ssd_block *block = (drv_ssd_block*)compressed;
+	size_t compressed_size = cf_compress(ns->storage_compression,
+			ns->storage_compression_level, dict,
+			((drv_ssd_block*)flat)->data, data_size, compressed + header_size,
+			max_size - header_size);
+
+	if (compressed_size == 0) {
+		cf_free(compressed);
+		cf_free(flat);
+		return NULL;
+	}
+
+	uint32_t compressed_write_size =
+			BYTES_TO_RBLOCK_BYTES(header_size + compressed_size);
+
+	memcpy(block, flat, sizeof(drv_ssd_block));
+	cf_free(flat);
+
+	block->compression = SSD_COMPRESSION_CRC_TAG |
+			(dict ? (uint32_t)set_id << 8 : 0) |
+			(uint32_t)ns->storage_compression;
+	block->data_size = data_size;
+	block->length = compressed_write_size - LENGTH_BASE;
+	*(uint32_t*)block->data = (uint32_t)compressed_size;
+
+	// Clean the rounding tail.
+	memset(compressed + header_size + compressed_size, 0,
+			compressed_write_size - (header_size + compressed_size));
+
+	*p_write_size = compressed_write_size;
+
+	return compressed;
+}
+
+
+// Returns an uncompressed copy of a compressed block, which the caller must
+// free, or NULL if it can't be decompressed.
+drv_ssd_block *
+ssd_block_decompress(as_namespace *ns, const drv_ssd_block *block,
+		uint32_t *p_size)
+{
+	uint32_t method = SSD_COMPRESSION_METHOD(block->compression);
+	uint32_t set_id = SSD_COMPRESSION_SET_ID(block->compression);
+	uint32_t header_size = ssd_block_compressed_header_size(block);
+	uint32_t compressed_size = *(const uint32_t*)block->data;
+
+	if (method >= CF_COMPRESSION_MAX || set_id > AS_SET_MAX_COUNT ||
+			header_size + compressed_size > block->length + LENGTH_BASE ||
+			block->data_size > MAX_RECORD_SIZE) {
+		cf_warning_digest(AS_DRV_SSD, &block->keyd, "{%s} bad compressed block ",
+				ns->name);
+		return NULL;
+	}
+
+	cf_compression_dict *dict = NULL;
+
+	if (set_id != 0 && ! (dict = ns->compression_dicts[set_id])) {
+		cf_warning_digest(AS_DRV_SSD, &block->keyd, "{%s} missing compression dictionary for set-id %u ",
+				ns->name, set_id);
+		return NULL;
+	}
+
+	uint32_t size = BYTES_TO_RBLOCK_BYTES(sizeof(drv_ssd_block) +
+			block->data_size);
+	drv_ssd_block *out = cf_io_buf_alloc(size);
+
+	if (! out) {
+		return NULL;
+	}
+
+	if (! cf_decompress((cf_compression_method)method, dict,
+			(const uint8_t*)block + header_size, compressed_size, out->data,
+			block->data_size)) {
+		cf_warning_digest(AS_DRV_SSD, &block->keyd, "{%s} failed decompression ",
+				ns->name);
+		cf_io_buf_free(out, size);
+		return NULL;
+	}
+
+	memcpy(out, block, sizeof(drv_ssd_block));
+	memset(out->data + block->data_size, 0,
+			size - (sizeof(drv_ssd_block) + block->data_size));
+
+	out->compression = 0;
+	out->data_size = 0;
+	out->length = size - LENGTH_BASE;
+	*p_size = size;
+
+	return out;
+}
+
+
+// Offset of the block's checksum, or 0 if it was written without one.
+static inline uint32_t
+ssd_block_checksum_offset(const drv_ssd_block *block)
+{
+	switch (block->compression & SSD_COMPRESSION_TAG_MASK) {
+	case SSD_CHECKSUM_TAG:
+	case SSD_CHUNKED_TAG:
+		return offsetof(drv_ssd_block, data_size);
+	case SSD_COMPRESSION_CRC_TAG:
+		return sizeof(drv_ssd_block) + sizeof(uint32_t);
+	default:
+		return 0;
+	}
+}
+
+
+static uint32_t
+ssd_block_checksum(const drv_ssd_block *block, uint32_t crc_offset)
+{
+	const uint8_t *buf = (const uint8_t*)block;
+	uint32_t size = block->length + LENGTH_BASE;
+	uint32_t after = crc_offset + sizeof(uint32_t);
+
+	return cf_crc32c(cf_crc32c(0, buf, crc_offset), buf + after, size - after);
+}
+
+
+// Call once the block is complete - uncompressed blocks get their tag here.
+void
+ssd_block_set_checksum(drv_ssd_block *block)
+{
+	if (! ssd_block_is_compressed(block) && ! ssd_block_is_chunked(block)) {
+		block->compression = SSD_CHECKSUM_TAG;
+	}
+
+	uint32_t crc_offset = ssd_block_checksum_offset(block);
+	uint32_t crc = ssd_block_checksum(block, crc_offset);
+
+	memcpy((uint8_t*)block + crc_offset, &crc, sizeof(crc));
+}
+
+
+// The block must fit in max_size bytes - its length isn't trusted.
+bool
+ssd_block_verify_checksum(const drv_ssd_block *block, uint32_t max_size)
+{
+	uint32_t crc_offset = ssd_block_checksum_offset(block);
+
+	if (crc_offset == 0) {
+		return true;
+	}
+
+	if (block->length > max_size - LENGTH_BASE ||
+			block->length + LENGTH_BASE < crc_offset + sizeof(uint32_t)) {
+		return false;
+	}
+
+	uint32_t crc;
+
+	memcpy(&crc, (const uint8_t*)block + crc_offset, sizeof(crc));
+
+	return crc == ssd_block_checksum(block, crc_offset);
+}
+
+
+// Each writing thread is given a shard index the first time it writes.
+static cf_atomic32 g_write_shard_counter = 0;
+static __thread uint32_t g_write_shard_ix = UINT32_MAX;
+
+static inline ssd_write_shard *
+ssd_get_write_shard(drv_ssd *ssd)
+{
+	if (g_write_shard_ix == UINT32_MAX) {
+		g_write_shard_ix = (uint32_t)cf_atomic32_incr(&g_write_shard_counter);
 	}
 
-	// Reserve the portion of the current swb where this record will be written.
-	pthread_mutex_lock(&ssd->write_lock);
+	return &ssd->write_shards[g_write_shard_ix % ssd->n_write_shards];
+}
+
+
+// Reserve write_size bytes of the shard's open swb for the stream, rolling
+// it over if there's no room. The caller writes at *p_pos of *p_swb, then
+// calls ssd_swb_written().
+static int
+ssd_swb_reserve(drv_ssd *ssd, ssd_write_shard *shard, e_swb_stream stream,
+		uint32_t write_size, ssd_write_buf **p_swb, uint32_t *p_pos)
+{
+	ssd_write_buf **p_open_swb = stream == SWB_STREAM_HOT ?
+			&shard->hot_swb : &shard->current_swb;
+
+	// Reserve the portion of the open swb where this block will be written.
+	pthread_mutex_lock(&shard->lock);
 
-	ssd_write_buf *swb = ssd->current_swb;
+	ssd_write_buf *swb = *p_open_swb;
 
 	if (! swb) {
-		swb = swb_get(ssd);
-		ssd->current_swb = swb;
+		swb = swb_get(ssd, stream);
+		*p_open_swb = swb;
 
 		if (! swb) {
 			cf_warning(AS_DRV_SSD, "write bins: couldn't get swb");
-			pthread_mutex_unlock(&ssd->write_lock);
+			pthread_mutex_unlock(&shard->lock);
 			return -AS_PROTO_RESULT_FAIL_OUT_OF_SPACE;
 		}
 	}
@@ -1588,96 +4298,289 @@ ssd_write_bins(as_storage_rd *rd)
 			memset(&swb->buf[swb->pos], 0, ssd->write_block_size - swb->pos);
 		}
 
-		// Enqueue the buffer, to be flushed to device.
-		cf_queue_push(ssd->swb_write_q, &swb);
-		cf_atomic64_incr(&ssd->n_wblock_writes);
+		// Enqueue the buffer, to be flushed to device.
+		cf_mpmc_queue_push(ssd->swb_write_q, &swb);
+		cf_atomic64_incr(&ssd->n_wblock_writes);
+
+		// Get the new buffer.
+		swb = swb_get(ssd, stream);
+		*p_open_swb = swb;
+
+		if (! swb) {
+			cf_warning(AS_DRV_SSD, "write bins: couldn't get swb");
+			pthread_mutex_unlock(&shard->lock);
+			return -AS_PROTO_RESULT_FAIL_OUT_OF_SPACE;
+		}
+	}
+
+	// There's enough space - save the position where this block will be
+	// written, and advance swb->pos for the next writer.
+	*p_swb = swb;
+	*p_pos = swb->pos;
+
+	swb->pos += write_size;
+	cf_atomic32_incr(&swb->n_writers);
+
+	if (ssd->ns->storage_commit_to_device) {
+		// Keep the swb (and so its commit state) until the block is on device.
+		swb_reserve(swb);
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+	// May now write this block concurrently with others in this swb.
+
+	return 0;
+}
+
+
+// Account for a block written at pos of a reserved swb, and commit it if so
+// configured.
+static void
+ssd_swb_written(drv_ssd *ssd, ssd_write_shard *shard, ssd_write_buf *swb,
+		uint32_t pos, uint32_t write_size)
+{
+	cf_atomic64_add(&ssd->inuse_size, (int64_t)write_size);
+	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)write_size);
+
+	// We are finished writing to the buffer.
+	cf_atomic32_decr(&swb->n_writers);
+
+	if (ssd->ns->storage_commit_to_device) {
+		ssd_commit_record(ssd, shard, swb, pos + write_size);
+		swb_release(swb);
+	}
+}
+
+
+// Write a chunk that fills a wblock - it gets an swb of its own, so the open
+// swbs aren't flushed early to make room.
+static int
+ssd_write_full_chunk(drv_ssd *ssd, ssd_write_shard *shard,
+		const drv_ssd_block *chunk, uint64_t *p_rblock_id)
+{
+	ssd_write_buf *swb = swb_get(ssd, SWB_STREAM_WRITE);
+
+	if (! swb) {
+		cf_warning(AS_DRV_SSD, "write chunk: couldn't get swb");
+		return -AS_PROTO_RESULT_FAIL_OUT_OF_SPACE;
+	}
+
+	memcpy(swb->buf, chunk, ssd->write_block_size);
+	swb->pos = ssd->write_block_size;
+
+	*p_rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id));
+
+	cf_atomic64_add(&ssd->inuse_size, (int64_t)ssd->write_block_size);
+	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)ssd->write_block_size);
+
+	if (ssd->ns->storage_commit_to_device) {
+		swb_reserve(swb);
+	}
+
+	// Flushed by the write threads, in parallel with the record's other chunks.
+	cf_mpmc_queue_push(ssd->swb_write_q, &swb);
+	cf_atomic64_incr(&ssd->n_wblock_writes);
+
+	if (ssd->ns->storage_commit_to_device) {
+		ssd_commit_record(ssd, shard, swb, ssd->write_block_size);
+		swb_release(swb);
+	}
+
+	return 0;
+}
+
+
+// Write a record too big for a wblock as chunks, then its head. The block is
+// the record's flattened (or compressed) block, write_size bytes.
+static int
+ssd_write_chunked(as_storage_rd *rd, uint8_t *block_buf, uint32_t write_size)
+{
+	as_record *r = rd->r;
+	drv_ssd *ssd = rd->ssd;
+	drv_ssd_block *block = (drv_ssd_block*)block_buf;
+
+	ssd_block_set_checksum(block);
+
+	uint32_t data_size = ssd_chunk_data_size(ssd->write_block_size);
+	uint32_t n_chunks = (write_size + data_size - 1) / data_size;
+	uint32_t head_size = BYTES_TO_RBLOCK_BYTES(sizeof(drv_ssd_block) +
+			sizeof(ssd_chunk_table) + (n_chunks * sizeof(ssd_chunk_ref)));
+	drv_ssd_block *head = cf_malloc(head_size);
+	drv_ssd_block *chunk = cf_malloc(ssd->write_block_size);
+
+	if (! head || ! chunk) {
+		cf_free(head);
+		cf_free(chunk);
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	memset(head, 0, head_size);
+	memcpy(head, block, sizeof(drv_ssd_block));
+	head->compression = SSD_CHUNKED_TAG;
+	head->data_size = 0;
+	head->length = head_size - LENGTH_BASE;
+	head->bins_offset = 0;
+	head->n_bins = 0;
+
+	ssd_chunk_table *table = (ssd_chunk_table*)head->data;
+
+	table->size = write_size;
+	table->n_chunks = n_chunks;
+
+	ssd_write_shard *shard = ssd_get_write_shard(ssd);
+	uint32_t n_written = 0;
+	int rv = 0;
+
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		uint32_t offset = i * data_size;
+		uint32_t size = write_size - offset < data_size ?
+				write_size - offset : data_size;
+		uint32_t chunk_size = BYTES_TO_RBLOCK_BYTES(sizeof(drv_ssd_block) +
+				size);
+		ssd_chunk_ref *ref = &table->refs[i];
+
+		memcpy(chunk, block, sizeof(drv_ssd_block));
+		chunk->compression = 0;
+		chunk->data_size = 0;
+		chunk->magic = SSD_CHUNK_MAGIC;
+		chunk->length = chunk_size - LENGTH_BASE;
+		chunk->bins_offset = size;
+		chunk->n_bins = i;
+		memcpy(chunk->data, block_buf + offset, size);
+		memset(chunk->data + size, 0,
+				chunk_size - (sizeof(drv_ssd_block) + size));
+		ssd_block_set_checksum(chunk);
+
+		ref->n_rblocks = (uint32_t)BYTES_TO_RBLOCKS(chunk_size);
+		ref->file_id = ssd->file_id;
+
+		if (chunk_size == ssd->write_block_size) {
+			rv = ssd_write_full_chunk(ssd, shard, chunk, &ref->rblock_id);
+		}
+		else {
+			// The last chunk shares an open swb, like any small record.
+			ssd_write_buf *swb;
+			uint32_t swb_pos;
+
+			if ((rv = ssd_swb_reserve(ssd, shard, SWB_STREAM_WRITE, chunk_size,
+					&swb, &swb_pos)) == 0) {
+				memcpy(&swb->buf[swb_pos], chunk, chunk_size);
+				ref->rblock_id = BYTES_TO_RBLOCKS(
+						WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb_pos);
+				ssd_swb_written(ssd, shard, swb, swb_pos, chunk_size);
+			}
+		}
+
+		if (rv != 0) {
+			break;
+		}
+
+		n_written++;
+	}
 
-		// Get the new buffer.
-		swb = swb_get(ssd);
-		ssd->current_swb = swb;
+	cf_free(chunk);
 
-		if (! swb) {
-			cf_warning(AS_DRV_SSD, "write bins: couldn't get swb");
-			pthread_mutex_unlock(&ssd->write_lock);
-			return -AS_PROTO_RESULT_FAIL_OUT_OF_SPACE;
-		}
-	}
+	ssd_write_buf *swb;
+	uint32_t swb_pos;
 
-	// There's enough space - save the position where this record will be
-	// written, and advance swb->pos for the next writer.
-	uint32_t swb_pos = swb->pos;
+	if (rv == 0 && (rv = ssd_swb_reserve(ssd, shard, SWB_STREAM_WRITE,
+			head_size, &swb, &swb_pos)) == 0) {
+		drv_ssd_block *buf = (drv_ssd_block*)&swb->buf[swb_pos];
 
-	swb->pos += write_size;
-	cf_atomic32_incr(&swb->n_writers);
+		memcpy(buf, head, head_size);
+		ssd_block_set_checksum(buf);
 
-	pthread_mutex_unlock(&ssd->write_lock);
-	// May now write this record concurrently with others in this swb.
+		r->file_id = ssd->file_id;
+		r->rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb_pos);
+		r->n_rblocks = BYTES_TO_RBLOCKS(head_size) + SSD_CHUNKED_N_RBLOCKS;
 
-	// Flatten data into the block.
+		ssd_swb_written(ssd, shard, swb, swb_pos, head_size);
+	}
 
-	uint8_t *buf = &swb->buf[swb_pos];
-	uint8_t *buf_start = buf;
+	if (rv != 0) {
+		// Nothing points at the chunks written so far.
+		for (uint32_t i = 0; i < n_written; i++) {
+			ssd_block_free(ssd, table->refs[i].rblock_id,
+					table->refs[i].n_rblocks, "write-undo");
+		}
+	}
 
-	drv_ssd_block *block = (drv_ssd_block*)buf;
+	cf_free(head);
 
-	buf += sizeof(drv_ssd_block);
+	return rv;
+}
 
-	// Properties list goes just before bins.
-	if (rd->rec_props.p_data) {
-		memcpy(buf, rd->rec_props.p_data, rd->rec_props.size);
-		buf += rd->rec_props.size;
+
+int
+ssd_write_bins(as_storage_rd *rd)
+{
+	as_namespace *ns = rd->ns;
+	as_record *r = rd->r;
+	drv_ssd *ssd = rd->ssd;
+
+	uint32_t write_size = ssd_write_calculate_size(rd);
+
+	if (write_size > ssd_max_record_size(ssd->write_block_size)) {
+		cf_warning(AS_DRV_SSD, "write: rejecting %"PRIx64" write size: %u",
+				*(uint64_t*)&r->keyd, write_size);
+		return -AS_PROTO_RESULT_FAIL_RECORD_TOO_BIG;
 	}
 
-	uint16_t n_bins_written;
+	// Compress outside the write lock - if it doesn't save space, compressed
+	// is NULL and write_size is unchanged.
+	uint8_t *compressed = ns->storage_compression != CF_COMPRESSION_NONE ?
+			ssd_compress_block(rd, &write_size) : NULL;
 
-	for (n_bins_written = 0; n_bins_written < rd->n_bins; n_bins_written++) {
-		as_bin *bin = &rd->bins[n_bins_written];
+	// Too big for a wblock even compressed - write it in chunks.
+	if (write_size > ssd->write_block_size) {
+		uint8_t *flat = compressed;
 
-		if (! as_bin_inuse(bin)) {
-			break;
+		if (! flat && (flat = cf_malloc(write_size))) {
+			ssd_flatten_block(rd, flat, write_size);
 		}
 
-		drv_ssd_bin *ssd_bin = (drv_ssd_bin*)buf;
-
-		buf += sizeof(drv_ssd_bin);
+		int rv = flat ? ssd_write_chunked(rd, flat, write_size) :
+				-AS_PROTO_RESULT_FAIL_UNKNOWN;
 
-		ssd_bin->version = 0;
+		cf_free(flat);
 
-		if (ns->single_bin) {
-			ssd_bin->name[0] = 0;
-		}
-		else {
-			strcpy(ssd_bin->name, as_bin_get_name_from_id(ns, bin->id));
+		if (rv == 0 && ns->storage_benchmarks_enabled) {
+			histogram_insert_raw(ns->device_write_size_hist, write_size);
 		}
 
-		ssd_bin->offset = buf - buf_start;
+		return rv;
+	}
 
-		uint32_t particle_flat_size = as_bin_particle_to_flat(bin, buf);
+	// Keep frequently updated records apart, so their wblocks empty together.
+	e_swb_stream stream = ssd_write_is_hot(rd) ?
+			SWB_STREAM_HOT : SWB_STREAM_WRITE;
+	ssd_write_shard *shard = ssd_get_write_shard(ssd);
+	ssd_write_buf *swb;
+	uint32_t swb_pos;
+	int rv = ssd_swb_reserve(ssd, shard, stream, write_size, &swb, &swb_pos);
 
-		buf += particle_flat_size;
-		ssd_bin->len = particle_flat_size;
-		ssd_bin->next = buf - buf_start;
+	if (rv != 0) {
+		cf_free(compressed);
+		return rv;
 	}
 
-	block->sig = 0; // deprecated
-	block->length = write_size - LENGTH_BASE;
-	block->magic = SSD_BLOCK_MAGIC;
-	block->keyd = r->keyd;
-	block->generation = r->generation;
-	block->void_time = r->void_time;
-	block->bins_offset = rd->rec_props.p_data ? rd->rec_props.size : 0;
-	block->n_bins = n_bins_written;
-	block->last_update_time = r->last_update_time;
+	uint8_t *buf = &swb->buf[swb_pos];
+
+	if (compressed) {
+		memcpy(buf, compressed, write_size);
+		cf_free(compressed);
+	}
+	else {
+		ssd_flatten_block(rd, buf, write_size);
+	}
+
+	ssd_block_set_checksum((drv_ssd_block*)buf);
 
 	r->file_id = ssd->file_id;
 	r->rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb_pos);
 	r->n_rblocks = BYTES_TO_RBLOCKS(write_size);
 
-	cf_atomic64_add(&ssd->inuse_size, (int64_t)write_size);
-	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)write_size);
-
-	// We are finished writing to the buffer.
-	cf_atomic32_decr(&swb->n_writers);
+	ssd_swb_written(ssd, shard, swb, swb_pos, write_size);
 
 	if (ns->storage_benchmarks_enabled) {
 		histogram_insert_raw(ns->device_write_size_hist, write_size);
@@ -1721,7 +4624,22 @@ ssd_write(as_storage_rd *rd)
 	int rv = ssd_write_bins(rd);
 
 	if (rv == 0 && old_ssd) {
-		ssd_block_free(old_ssd, old_rblock_id, old_n_rblocks, "ssd-write");
+		ssd_record_free(old_ssd, old_rblock_id, old_n_rblocks, "ssd-write");
+	}
+
+	if (rv == 0 && ssds->hot_tier) {
+		const uint8_t *tier_data = NULL;
+		uint8_t *detached = (uint8_t*)hot_tier_detach(ssds->hot_tier, r,
+				&tier_data);
+
+		// The rd may still be using the old block - if so, it frees it.
+		if ((const uint8_t*)rd->block == tier_data && detached) {
+			rd->must_free_block = detached;
+			rd->must_free_size = 0;
+		}
+		else {
+			cf_free(detached);
+		}
 	}
 
 	return rv;
@@ -1957,7 +4875,8 @@ as_storage_analyze_wblock(as_namespace* ns, int device_index,
 	while (offset < ssd->write_block_size) {
 		drv_ssd_block* p_block = (drv_ssd_block*)&read_buf[offset];
 
-		if (p_block->magic != SSD_BLOCK_MAGIC) {
+		if (p_block->magic != SSD_BLOCK_MAGIC &&
+				p_block->magic != SSD_CHUNK_MAGIC) {
 			if (offset == 0) {
 				// First block must have magic.
 				cf_warning(AS_DRV_SSD, "analyze wblock ERROR: 1st block has no magic");
@@ -1981,6 +4900,12 @@ as_storage_analyze_wblock(as_namespace* ns, int device_index,
 			return -1;
 		}
 
+		// Chunks are counted with their records' heads.
+		if (p_block->magic == SSD_CHUNK_MAGIC) {
+			offset = next_offset;
+			continue;
+		}
+
 		uint64_t rblock_id = BYTES_TO_RBLOCKS(file_offset + offset);
 		uint32_t n_rblocks = (uint32_t)BYTES_TO_RBLOCKS(next_offset - offset);
 
@@ -1996,7 +4921,8 @@ as_storage_analyze_wblock(as_namespace* ns, int device_index,
 		if (0 == as_record_get(rsv.tree, &p_block->keyd, &r_ref)) {
 			as_index* r = r_ref.r;
 
-			if (r->rblock_id == rblock_id && r->n_rblocks == n_rblocks) {
+			if (r->rblock_id == rblock_id &&
+					ssd_head_n_rblocks(r->n_rblocks) == n_rblocks) {
 				living = true;
 			}
 
@@ -2081,19 +5007,26 @@ ssd_log_stats(drv_ssd *ssd, uint64_t *p_prev_n_total_writes,
 	*shadow_str = 0;
 
 	if (ssd->shadow_name) {
-		sprintf(shadow_str, " shadow-write-q %d",
-				cf_queue_sz(ssd->swb_shadow_q));
+		int shadow_q_sz = cf_queue_sz(ssd->shadow_buf_q);
+
+		sprintf(shadow_str, " shadow-write-q %d shadow-lag-ms %lu", shadow_q_sz,
+				shadow_q_sz == 0 ? 0 :
+						cf_atomic64_get(ssd->shadow_lag_ns) / 1000000);
 	}
 
-	cf_info(AS_DRV_SSD, "{%s} %s: used-bytes %lu free-wblocks %d write-q %d write (%lu,%.1f) defrag-q %d defrag-read (%lu,%.1f) defrag-write (%lu,%.1f)%s%s",
+	cf_info(AS_DRV_SSD, "{%s} %s: used-bytes %lu free-wblocks %d write-q %d write (%lu,%.1f) defrag-q %u defrag-read (%lu,%.1f) defrag-write (%lu,%.1f)%s%s",
 			ssd->ns->name, ssd->name,
 			ssd->inuse_size, cf_queue_sz(ssd->free_wblock_q),
-			cf_queue_sz(ssd->swb_write_q),
+			cf_mpmc_queue_sz(ssd->swb_write_q),
 			n_total_writes, total_write_rate,
-			cf_queue_sz(ssd->defrag_wblock_q), n_defrag_reads, defrag_read_rate,
+			defrag_q_size(ssd), n_defrag_reads, defrag_read_rate,
 			n_defrag_writes, defrag_write_rate,
 			shadow_str, tomb_raider_str);
 
+	if (defrag_q_size(ssd) != 0) {
+		defrag_q_dump(ssd, "queued");
+	}
+
 	*p_prev_n_total_writes = n_total_writes;
 	*p_prev_n_defrag_reads = n_defrag_reads;
 	*p_prev_n_defrag_writes = n_defrag_writes;
@@ -2119,54 +5052,106 @@ ssd_free_swbs(drv_ssd *ssd)
 
 		swb_destroy(swb);
 	}
+
+	if (! ssd->shadow_name) {
+		return;
+	}
+
+	// Likewise shadow buffers, left over from the shadow falling behind.
+	for (int i = 0; i < 16 && cf_queue_sz(ssd->shadow_buf_free_q) > 16; i++) {
+		ssd_shadow_buf* sbuf;
+
+		if (CF_QUEUE_OK !=
+				cf_queue_pop(ssd->shadow_buf_free_q, &sbuf, CF_QUEUE_NOWAIT)) {
+			break;
+		}
+
+		shadow_buf_destroy(sbuf);
+	}
 }
 
 
-void
-ssd_flush_current_swb(drv_ssd *ssd, uint64_t *p_prev_n_writes,
-		uint32_t *p_prev_size)
+static void
+ssd_reset_prev_flush_sizes(drv_ssd *ssd)
 {
-	uint64_t n_writes = cf_atomic64_get(ssd->n_wblock_writes);
-
-	// If there's an active write load, we don't need to flush.
-	if (n_writes != *p_prev_n_writes) {
-		*p_prev_n_writes = n_writes;
-		*p_prev_size = 0;
-		return;
+	for (uint32_t i = 0; i < ssd->n_write_shards; i++) {
+		ssd->write_shards[i].prev_flush_size = 0;
+		ssd->write_shards[i].prev_flush_hot_size = 0;
 	}
+}
+
+
+// Flush a shard's current and hot swbs if they aren't empty, and have been
+// written to since last flushed. Called under the shard's lock.
+static void
+ssd_flush_shard_swbs(drv_ssd *ssd, ssd_write_shard *shard)
+{
+	ssd_write_buf **p_swbs[] = { &shard->current_swb, &shard->hot_swb };
+	uint32_t *p_prev_sizes[] = {
+			&shard->prev_flush_size, &shard->prev_flush_hot_size
+	};
 
-	pthread_mutex_lock(&ssd->write_lock);
+	for (int i = 0; i < 2; i++) {
+		ssd_write_buf *swb = *p_swbs[i];
 
-	n_writes = cf_atomic64_get(ssd->n_wblock_writes);
+		if (swb && swb->pos != *p_prev_sizes[i]) {
+			*p_prev_sizes[i] = swb->pos;
+
+			// Clean the end of the buffer before flushing.
+			if (ssd->write_block_size != swb->pos) {
+				memset(&swb->buf[swb->pos], 0,
+						ssd->write_block_size - swb->pos);
+			}
+
+			if (ssd->zone_n_wblocks != 0) {
+				// Zoned wblocks can only be written once - seal it instead.
+				cf_mpmc_queue_push(ssd->swb_write_q, &swb);
+				cf_atomic64_incr(&ssd->n_wblock_writes);
+				*p_swbs[i] = NULL;
+				*p_prev_sizes[i] = 0;
+				continue;
+			}
+
+			// Flush it.
+			ssd_flush_swb(ssd, swb);
+		}
+	}
+}
 
-	// Must check under the lock, could be racing a current swb just queued.
-	if (n_writes != *p_prev_n_writes) {
 
-		pthread_mutex_unlock(&ssd->write_lock);
+void
+ssd_flush_current_swb(drv_ssd *ssd, uint64_t *p_prev_n_writes)
+{
+	uint64_t n_writes = cf_atomic64_get(ssd->n_wblock_writes);
 
+	// If there's an active write load, we don't need to flush.
+	if (n_writes != *p_prev_n_writes) {
 		*p_prev_n_writes = n_writes;
-		*p_prev_size = 0;
+		ssd_reset_prev_flush_sizes(ssd);
 		return;
 	}
 
-	// Flush the current swb if it isn't empty, and has been written to since
-	// last flushed.
+	for (uint32_t i = 0; i < ssd->n_write_shards; i++) {
+		ssd_write_shard *shard = &ssd->write_shards[i];
 
-	ssd_write_buf *swb = ssd->current_swb;
+		pthread_mutex_lock(&shard->lock);
 
-	if (swb && swb->pos != *p_prev_size) {
-		*p_prev_size = swb->pos;
+		n_writes = cf_atomic64_get(ssd->n_wblock_writes);
 
-		// Clean the end of the buffer before flushing.
-		if (ssd->write_block_size != swb->pos) {
-			memset(&swb->buf[swb->pos], 0, ssd->write_block_size - swb->pos);
+		// Must check under the lock, could be racing a current swb just
+		// queued.
+		if (n_writes != *p_prev_n_writes) {
+			pthread_mutex_unlock(&shard->lock);
+
+			*p_prev_n_writes = n_writes;
+			ssd_reset_prev_flush_sizes(ssd);
+			return;
 		}
 
-		// Flush it.
-		ssd_flush_swb(ssd, swb);
-	}
+		ssd_flush_shard_swbs(ssd, shard);
 
-	pthread_mutex_unlock(&ssd->write_lock);
+		pthread_mutex_unlock(&shard->lock);
+	}
 }
 
 
@@ -2210,8 +5195,17 @@ ssd_flush_defrag_swb(drv_ssd *ssd, uint64_t *p_prev_n_writes,
 			memset(&swb->buf[swb->pos], 0, ssd->write_block_size - swb->pos);
 		}
 
-		// Flush it.
-		ssd_flush_swb(ssd, swb);
+		if (ssd->zone_n_wblocks != 0) {
+			// Zoned wblocks can only be written once - seal it instead.
+			cf_mpmc_queue_push(ssd->swb_write_q, &swb);
+			cf_atomic64_incr(&ssd->n_defrag_wblock_writes);
+			ssd->defrag_swb = NULL;
+			*p_prev_size = 0;
+		}
+		else {
+			// Flush it.
+			ssd_flush_swb(ssd, swb);
+		}
 	}
 
 	pthread_mutex_unlock(&ssd->defrag_lock);
@@ -2268,6 +5262,36 @@ ssd_defrag_sweep(drv_ssd *ssd)
 }
 
 
+// Queue the used wblocks of mostly empty zones for defrag, so the zones can be
+// reset.
+static void
+ssd_zone_sweep(drv_ssd *ssd)
+{
+	ssd_alloc_table* at = ssd->alloc_table;
+	uint32_t zone_id;
+
+	while (CF_QUEUE_OK == cf_queue_pop(ssd->zone_sweep_q, &zone_id,
+			CF_QUEUE_NOWAIT)) {
+		uint32_t first_id = zone_id * ssd->zone_n_wblocks;
+		uint32_t end_id = first_id + zone_usable_n_wblocks(ssd, zone_id);
+
+		for (uint32_t wblock_id = first_id; wblock_id < end_id; wblock_id++) {
+			ssd_wblock_state *p_wblock_state = &at->wblock_state[wblock_id];
+
+			pthread_mutex_lock(&p_wblock_state->LOCK);
+
+			if (! p_wblock_state->swb &&
+					p_wblock_state->state != WBLOCK_STATE_DEFRAG &&
+						cf_atomic32_get(p_wblock_state->inuse_sz) != 0) {
+				push_wblock_to_defrag_q(ssd, wblock_id);
+			}
+
+			pthread_mutex_unlock(&p_wblock_state->LOCK);
+		}
+	}
+}
+
+
 static inline uint64_t
 next_time(uint64_t now, uint64_t job_interval, uint64_t next)
 {
@@ -2295,7 +5319,6 @@ run_ssd_maintenance(void *udata)
 	uint64_t prev_n_tomb_raider_reads = 0;
 
 	uint64_t prev_n_writes_flush = 0;
-	uint32_t prev_size_flush = 0;
 	uint64_t prev_n_writes_defrag_flush = 0;
 	uint32_t prev_size_defrag_flush = 0;
 
@@ -2336,7 +5359,7 @@ run_ssd_maintenance(void *udata)
 		uint64_t flush_max_us = ns->storage_flush_max_us;
 
 		if (flush_max_us != 0 && now >= prev_flush + flush_max_us) {
-			ssd_flush_current_swb(ssd, &prev_n_writes_flush, &prev_size_flush);
+			ssd_flush_current_swb(ssd, &prev_n_writes_flush);
 			prev_flush = now;
 			next = next_time(now, flush_max_us, next);
 		}
@@ -2355,6 +5378,10 @@ run_ssd_maintenance(void *udata)
 			next = next_time(now, fsync_max_us, next);
 		}
 
+		if (ssd->zone_n_wblocks != 0) {
+			ssd_zone_sweep(ssd);
+		}
+
 		if (cf_atomic32_get(ssd->defrag_sweep) != 0) {
 			// May take long enough to mess up other jobs' schedules, but it's a
 			// very rare manually-triggered intervention.
@@ -2468,6 +5495,12 @@ ssd_read_header(drv_ssd *ssd, as_namespace *ns, ssd_device_header **header_r)
 		goto Fail;
 	}
 
+	if (header->info_n != AS_PARTITIONS) {
+		cf_warning(AS_DRV_SSD, "read header: device %s has %u partitions, build has %u, erase device",
+				ssd_name, header->info_n, AS_PARTITIONS);
+		goto Fail;
+	}
+
 	size_t h_len = header->header_length;
 
 	cf_free(header);
@@ -2740,6 +5773,43 @@ apply_rec_props(as_record* r, as_namespace* ns, const as_rec_props* p_props)
 }
 
 
+// Data-not-in-memory - index the version just read, casting its bins straight
+// from the block, so there's no need for a separate sindex population pass.
+static void
+ssd_cold_start_sindex_add(as_namespace* ns, as_record* r,
+		drv_ssd_block* block)
+{
+	uint8_t* block_head = (uint8_t*)block;
+	drv_ssd_bin* ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
+	as_bin stack_bins[block->n_bins];
+	as_storage_rd rd;
+
+	memset(stack_bins, 0, sizeof(stack_bins));
+
+	as_storage_record_open(ns, r, &rd);
+
+	rd.n_bins = (uint16_t)block->n_bins;
+	rd.bins = stack_bins;
+
+	for (uint16_t i = 0; i < block->n_bins; i++) {
+		as_bin* b = &stack_bins[i];
+
+		as_bin_set_id_from_name(ns, b, ssd_bin->name);
+
+		if (as_bin_particle_cast_from_flat(b, block_head + ssd_bin->offset,
+				ssd_bin->len) != 0) {
+			cf_warning_digest(AS_DRV_SSD, &block->keyd, "{%s} can't index bin %s ",
+					ns->name, ssd_bin->name);
+		}
+
+		ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
+	}
+
+	as_sindex_putall_rd(ns, &rd);
+	as_storage_record_close(&rd);
+}
+
+
 // Add a record just read from drive to the index, if all is well.
 // Return values:
 //  0 - success, record added or updated
@@ -2813,22 +5883,31 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 		if (prefer_existing_record(ssd, wblock_id, block, r)) {
 			ssd_cold_start_adjust_cenotaph(ns, block, r);
 			as_record_done(&r_ref, ns);
-			ssd->record_add_older_counter++;
+			cf_atomic64_incr(&ssd->record_add_older_counter);
 			return -1;
 		}
 	}
 	// The record we're now reading is the latest version (so far) ...
 
+	// Records whose void-times the eviction histogram tracks.
+	bool evictable = ns->cold_start_evict_hist && is_set_evictable(ns, &props);
+
 	// Skip records that have expired.
 	if (is_record_expired(ns, block, &props)) {
+		if (! is_create && evictable) {
+			as_cold_start_evict_track(ns, r->void_time, 0);
+		}
+
 		as_index_delete(p_partition->vp, &block->keyd);
 		as_record_done(&r_ref, ns);
-		ssd->record_add_expired_counter++;
+		cf_atomic64_incr(&ssd->record_add_expired_counter);
 		return -1;
 	}
 
 	// We'll keep the record we're now reading ...
 
+	uint32_t old_void_time = is_create ? 0 : r->void_time;
+
 	// Set/reset the record's last-update-time and generation.
 	r->last_update_time = block->last_update_time;
 	r->generation = block->generation;
@@ -2839,7 +5918,7 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 				block->void_time, ns->cold_start_max_void_time);
 
 		r->void_time = ns->cold_start_max_void_time;
-		ssd->record_add_max_ttl_counter++;
+		cf_atomic64_incr(&ssd->record_add_max_ttl_counter);
 	}
 	else {
 		r->void_time = block->void_time;
@@ -2848,6 +5927,11 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 	// Update maximum void-time.
 	cf_atomic64_setmax(&p_partition->max_void_time, r->void_time);
 
+	// Keep the eviction histogram current - no index pass needed to build it.
+	if (evictable) {
+		as_cold_start_evict_track(ns, old_void_time, r->void_time);
+	}
+
 	// If data is in memory, load bins and particles, adjust secondary index.
 	if (ns->storage_data_in_memory) {
 		uint8_t* block_head = (uint8_t*)block;
@@ -2948,196 +6032,316 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 		as_storage_record_close(&rd);
 	}
 	else {
+		// Reads the version being replaced, which is still r's on device.
+		if (! is_create && STORAGE_RBLOCK_IS_VALID(r->rblock_id)) {
+			record_delete_adjust_sindex(r, ns);
+		}
+
 		apply_rec_props(r, ns, &props);
 	}
 
+	// If the set-ID was just applied, list the record under its set.
+	as_index_set_list_add(p_partition->vp, &r_ref);
+
 	if (is_create) {
-		ssd->record_add_unique_counter++;
+		cf_atomic64_incr(&ssd->record_add_unique_counter);
 	}
 	else if (STORAGE_RBLOCK_IS_VALID(r->rblock_id)) {
 		// Replacing an existing record, undo its previous storage accounting.
-		ssd_block_free(&ssds->ssds[r->file_id], r->rblock_id, r->n_rblocks,
+		ssd_record_free(&ssds->ssds[r->file_id], r->rblock_id, r->n_rblocks,
 				"record-add");
-		ssd->record_add_replace_counter++;
+		cf_atomic64_incr(&ssd->record_add_replace_counter);
 	}
 	else {
 		cf_warning(AS_DRV_SSD, "replacing record with invalid rblock-id");
 	}
 
-	ssd_cold_start_transition_record(ns, block, r, is_create);
+	ssd_cold_start_transition_record(ns, block, r, is_create);
+
+	// Update storage accounting to include this record.
+	// TODO - pass in size instead of n_rblocks.
+	uint32_t size = (uint32_t)RBLOCKS_TO_BYTES(ssd_head_n_rblocks(n_rblocks));
+
+	// Other loader threads may be adding records in this device and wblock.
+	cf_atomic64_add(&ssd->inuse_size, size);
+	cf_atomic32_add(&ssd->alloc_table->wblock_state[wblock_id].inuse_sz,
+			(int32_t)size);
+
+	// A chunked record's chunks are accounted for from its head.
+	if (ssd_n_rblocks_is_chunked(n_rblocks) &&
+			! ssd_chunks_add_inuse(ssd, rblock_id, n_rblocks)) {
+		cf_warning_digest(AS_DRV_SSD, &block->keyd, "record-add can't account for chunks ");
+	}
+
+	// Set/reset the record's storage information.
+	r->file_id = ssd->file_id;
+	r->rblock_id = rblock_id;
+	r->n_rblocks = n_rblocks;
+
+	if (! ns->storage_data_in_memory && record_has_sindex(r, ns)) {
+		ssd_cold_start_sindex_add(ns, r, block);
+	}
+
+	as_record_done(&r_ref, ns);
+
+	return 0;
+}
+
+
+// Parse records from one LOAD_BUF_SIZE block and add them to the index.
+// Updates the count of consecutive blocks found without records.
+static void
+ssd_load_buf(drv_ssds *ssds, drv_ssd *ssd, uint8_t *buf, uint64_t file_offset,
+		int *error_count)
+{
+	size_t block_offset = 0; // current offset within the 1M block, in bytes
+
+	while (block_offset < LOAD_BUF_SIZE) {
+		drv_ssd_block *block = (drv_ssd_block*)&buf[block_offset];
+
+		// Look for record magic.
+		if (block->magic != SSD_BLOCK_MAGIC &&
+				block->magic != SSD_CHUNK_MAGIC) {
+			// No record found here.
+			// (Includes normal case of nothing ever written here).
+
+			block_offset += RBLOCK_SIZE;
+
+			// We always write some at the start of a 1M block.
+			if (block_offset == RBLOCK_SIZE) {
+				(*error_count)++;
+				return;
+			}
+
+			// Otherwise check the next rblock, looking for magic.
+			continue;
+		}
+
+		// Note - if block->length is sane, we don't need to round up to a
+		// multiple of RBLOCK_SIZE, but let's do it anyway just to be safe.
+		size_t next_block_offset = block_offset +
+				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
+
+		// Sanity-check for 1M block overruns.
+		// TODO - check write_block_size boundaries!
+		if (next_block_offset > LOAD_BUF_SIZE) {
+			cf_warning(AS_DRV_SSD, "error: block extends over read size: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
+				file_offset, block_offset, (uint64_t)block->length);
+
+			(*error_count)++;
+			return;
+		}
+
+		// Chunks are loaded with their records' heads.
+		if (block->magic == SSD_CHUNK_MAGIC) {
+			*error_count = 0;
+			block_offset = next_block_offset;
+			continue;
+		}
+
+		if (! ssd_block_verify_checksum(block,
+				(uint32_t)(next_block_offset - block_offset))) {
+			cf_atomic64_incr(&ssds->ns->n_device_checksum_errors);
+			cf_warning_digest(AS_DRV_SSD, &block->keyd, "%s: bad checksum foff %lu boff %lu ",
+					ssd->name, file_offset, block_offset);
+
+			// Skip it - an older version (if any) may be resurrected.
+			block_offset = next_block_offset;
+			continue;
+		}
+
+		drv_ssd_block *whole = NULL;
+		uint32_t whole_size = 0;
+		uint32_t n_rblocks =
+				(uint32_t)BYTES_TO_RBLOCKS(next_block_offset - block_offset);
+
+		// A stale head's chunks may since have been overwritten.
+		if (ssd_block_is_chunked(block)) {
+			if (! (whole = ssd_read_chunks(ssds, block, &whole_size))) {
+				// Skip it - an older version (if any) may be resurrected.
+				block_offset = next_block_offset;
+				continue;
+			}
+
+			n_rblocks += SSD_CHUNKED_N_RBLOCKS;
+		}
+
+		drv_ssd_block *record = whole ? whole : block;
+		drv_ssd_block *uncompressed = NULL;
+		uint32_t uncompressed_size = 0;
+
+		if (ssd_block_is_compressed(record) && ! (uncompressed =
+				ssd_block_decompress(ssds->ns, record, &uncompressed_size))) {
+			if (whole) {
+				cf_io_buf_free(whole, whole_size);
+			}
 
-	// Update storage accounting to include this record.
-	// TODO - pass in size instead of n_rblocks.
-	uint32_t size = (uint32_t)RBLOCKS_TO_BYTES(n_rblocks);
+			// Skip it - an older version (if any) may be resurrected.
+			block_offset = next_block_offset;
+			continue;
+		}
 
-	ssd->inuse_size += size;
-	ssd->alloc_table->wblock_state[wblock_id].inuse_sz += size;
+		// Found a record - try to add it to the index.
+		int add_rv = ssd_record_add(ssds, ssd,
+				uncompressed ? uncompressed : record,
+				BYTES_TO_RBLOCKS(file_offset + block_offset), n_rblocks);
 
-	// Set/reset the record's storage information.
-	r->file_id = ssd->file_id;
-	r->rblock_id = rblock_id;
-	r->n_rblocks = n_rblocks;
+		if (uncompressed) {
+			cf_io_buf_free(uncompressed, uncompressed_size);
+		}
 
-	as_record_done(&r_ref, ns);
+		if (whole) {
+			cf_io_buf_free(whole, whole_size);
+		}
 
-	return 0;
+		if (add_rv == -2) {
+			cf_crash(AS_DRV_SSD, "hit stop-writes limit before drive scan completed");
+		}
+
+		if (add_rv == -3) {
+			(*error_count)++;
+			return;
+		}
+
+		*error_count = 0;
+		block_offset = next_block_offset;
+	}
 }
 
 
-// Sweep through storage devices and rebuild the index.
-int
-ssd_load_device_sweep(drv_ssds *ssds, drv_ssd *ssd)
+// Sweep through a range of a storage device and rebuild the index. Returns true
+// if the end of the device's data was found in this range.
+static bool
+ssd_load_range_sweep(drv_ssds *ssds, drv_ssd *ssd, uint8_t *buf,
+		uint64_t start_offset, uint64_t end_offset)
 {
-	uint8_t *buf = cf_valloc(LOAD_BUF_SIZE);
-
 	bool read_shadow = ssd->shadow_name;
 	char *read_ssd_name = read_shadow ? ssd->shadow_name : ssd->name;
 	int fd = read_shadow ? ssd_shadow_fd_get(ssd) : ssd_fd_get(ssd);
 	int write_fd = read_shadow ? ssd_fd_get(ssd) : -1;
 
-	// Seek past the header.
-	off_t file_offset = ssds->header->header_length;
-
-	if (lseek(fd, file_offset, SEEK_SET) != file_offset) {
-		cf_warning(AS_DRV_SSD, "%s: seek failed: offset %ld: errno %d (%s)",
-				read_ssd_name, file_offset, errno, cf_strerror(errno));
-		close(fd);
-		fd = -1;
-		goto Finished;
-	}
-
-	if (read_shadow && lseek(write_fd, file_offset, SEEK_SET) != file_offset) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: offset %ld: errno %d (%s)",
-				ssd->name, file_offset, errno, cf_strerror(errno));
-	}
-
 	int error_count = 0;
-
-	ssd->cold_start_block_counter = file_offset / LOAD_BUF_SIZE;
-
-	// Loop over all blocks in device.
-	while (true) {
-		ssize_t rlen = read(fd, buf, LOAD_BUF_SIZE);
-
-		if (rlen != LOAD_BUF_SIZE) {
-			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): errno %d (%s)",
-					read_ssd_name, rlen, errno, cf_strerror(errno));
+	bool found_end = false;
+	uint64_t file_offset = start_offset;
+
+	// Loop over all blocks in range, reading ahead several blocks at a time.
+	while (file_offset < end_offset) {
+		size_t read_size = MIN(LOAD_READ_SIZE, end_offset - file_offset);
+		ssize_t rlen = read_shadow ?
+				pread(fd, buf, read_size, (off_t)file_offset) :
+				ssd_pread(ssd, fd, buf, read_size, (off_t)file_offset);
+
+		if (rlen != (ssize_t)read_size) {
+			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %lu: errno %d (%s)",
+					read_ssd_name, rlen, file_offset, errno,
+					cf_strerror(errno));
 			close(fd);
 			fd = -1;
-			goto Finished;
+			found_end = true;
+			break;
 		}
 
 		if (read_shadow) {
-			// TODO - ok to always write 1Mb blocks?
-			ssize_t sz = write(write_fd, (void*)buf, LOAD_BUF_SIZE);
+			ssize_t sz = ssd_pwrite(ssd, write_fd, buf, read_size,
+					(off_t)file_offset);
 
-			if (sz != LOAD_BUF_SIZE) {
-				cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
-						ssd->name, errno, cf_strerror(errno));
+			if (sz != (ssize_t)read_size) {
+				cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %lu: errno %d (%s)",
+						ssd->name, file_offset, errno, cf_strerror(errno));
 			}
 		}
 
-		size_t block_offset = 0; // current offset within the 1M block, in bytes
-
-		while (block_offset < LOAD_BUF_SIZE) {
-			drv_ssd_block *block = (drv_ssd_block*)&buf[block_offset];
+		for (size_t buf_offset = 0; buf_offset < read_size;
+				buf_offset += LOAD_BUF_SIZE) {
+			ssd_load_buf(ssds, ssd, buf + buf_offset, file_offset + buf_offset,
+					&error_count);
 
-			// Look for record magic.
-			if (block->magic != SSD_BLOCK_MAGIC) {
-				// No record found here.
-				// (Includes normal case of nothing ever written here).
-
-				block_offset += RBLOCK_SIZE;
-
-				// We always write some at the start of a 1M block.
-				if (block_offset == RBLOCK_SIZE) {
-					error_count++;
-					goto NextBlock;
-				}
-				else {
-					// Otherwise check the next rblock, looking for magic.
-					continue;
-				}
+			// If we encounter enough 1M blocks that have no records, assume
+			// we've read all our data and we're done.
+			if (error_count > 10) {
+				found_end = true;
+				break;
 			}
 
-			// Note - if block->length is sane, we don't need to round up to a
-			// multiple of RBLOCK_SIZE, but let's do it anyway just to be safe.
-			size_t next_block_offset = block_offset +
-					BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
+			cf_atomic32_incr(&ssd->cold_start_block_counter);
+		}
 
-			// Sanity-check for 1M block overruns.
-			// TODO - check write_block_size boundaries!
-			if (next_block_offset > LOAD_BUF_SIZE) {
-				cf_warning(AS_DRV_SSD, "error: block extends over read size: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
-					file_offset, block_offset, (uint64_t)block->length);
+		if (found_end) {
+			break;
+		}
 
-				error_count++;
-				goto NextBlock;
-			}
+		file_offset += read_size;
+	}
 
-			// Found a record - try to add it to the index.
-			int add_rv = ssd_record_add(ssds, ssd, block,
-					BYTES_TO_RBLOCKS(file_offset + block_offset),
-					(uint32_t)BYTES_TO_RBLOCKS(next_block_offset - block_offset));
+	if (fd != -1) {
+		if (read_shadow) {
+			ssd_shadow_fd_put(ssd, fd);
+		}
+		else {
+			ssd_fd_put(ssd, fd);
+		}
+	}
 
-			if (add_rv == -2) {
-				cf_crash(AS_DRV_SSD, "hit stop-writes limit before drive scan completed");
-			}
+	if (write_fd != -1) {
+		ssd_fd_put(ssd, write_fd);
+	}
 
-			if (add_rv == -3) {
-				error_count++;
-				goto NextBlock;
-			}
+	return found_end;
+}
 
-			error_count = 0;
-			block_offset = next_block_offset;
-		}
 
-NextBlock:
+// Hand out the next unswept range of a device. Ranges are handed out in order,
+// so we stop as soon as any range finds the end of the device's data.
+static bool
+ssd_load_next_range(drv_ssds *ssds, drv_ssd *ssd, uint64_t *start_offset,
+		uint64_t *end_offset)
+{
+	bool got_range = false;
 
-		// If we encounter enough 1M blocks that have no records, assume we've
-		// read all our data and we're done.
-		if (error_count > 10) {
-			goto Finished;
-		}
+	pthread_mutex_lock(&ssds->load_lock);
 
-		file_offset += LOAD_BUF_SIZE;
-		ssd->cold_start_block_counter++;
+	if (ssd->load_next_offset < ssd->load_end_offset) {
+		*start_offset = ssd->load_next_offset;
+		*end_offset = MIN(*start_offset + LOAD_RANGE_SIZE,
+				ssd->load_end_offset);
+		ssd->load_next_offset = *end_offset;
+		got_range = true;
 	}
 
-Finished:
+	pthread_mutex_unlock(&ssds->load_lock);
 
-	ssd->cold_start_block_counter = ssd->file_size / LOAD_BUF_SIZE;
+	return got_range;
+}
 
-	if (fd != -1) {
-		read_shadow ? ssd_shadow_fd_put(ssd, fd) : ssd_fd_put(ssd, fd);
-	}
 
-	if (write_fd != -1) {
-		ssd_fd_put(ssd, write_fd);
-	}
+static void
+ssd_load_found_end(drv_ssds *ssds, drv_ssd *ssd, uint64_t end_offset)
+{
+	pthread_mutex_lock(&ssds->load_lock);
 
-	cf_free(buf);
+	if (end_offset < ssd->load_end_offset) {
+		ssd->load_end_offset = end_offset;
+	}
 
-	return 0;
+	pthread_mutex_unlock(&ssds->load_lock);
 }
 
 
 typedef struct {
 	drv_ssds *ssds;
-	drv_ssd *ssd;
+	uint32_t thread_ix;
 	cf_queue *complete_q;
 	void *complete_udata;
 	void *complete_rc;
 } ssd_load_devices_data;
 
-// Thread "run" function to read a device and rebuild the index.
+// Thread "run" function to read device ranges and rebuild the index.
 void *
 ssd_load_devices_fn(void *udata)
 {
 	ssd_load_devices_data *ldd = (ssd_load_devices_data*)udata;
-	drv_ssd *ssd = ldd->ssd;
 	drv_ssds *ssds = ldd->ssds;
+	uint32_t thread_ix = ldd->thread_ix;
 	cf_queue *complete_q = ldd->complete_q;
 	void *complete_udata = ldd->complete_udata;
 	void *complete_rc = ldd->complete_rc;
@@ -3147,30 +6351,56 @@ ssd_load_devices_fn(void *udata)
 	cf_free(ldd);
 	ldd = 0;
 
-	cf_info(AS_DRV_SSD, "device %s: reading device to load index", ssd->name);
-
 	CF_ALLOC_SET_NS_ARENA(ns);
 
-	ssd_load_device_sweep(ssds, ssd);
+	uint8_t *buf = cf_valloc(LOAD_READ_SIZE);
 
-	cf_info(AS_DRV_SSD, "device %s: read complete: UNIQUE %"PRIu64" (REPLACED %"PRIu64") (OLDER %"PRIu64") (EXPIRED %"PRIu64") (MAX-TTL %"PRIu64") records",
-		ssd->name, ssd->record_add_unique_counter,
-		ssd->record_add_replace_counter, ssd->record_add_older_counter,
-		ssd->record_add_expired_counter, ssd->record_add_max_ttl_counter);
+	if (! buf) {
+		cf_crash(AS_DRV_SSD, "memory allocation in device load");
+	}
 
-	if (ssd->record_add_sigfail_counter) {
-		cf_warning(AS_DRV_SSD, "device %s: WARNING: %"PRIu64" elements could not be read due to signature failure. Possible hardware errors.",
-			ssd->name, ssd->record_add_sigfail_counter);
+	// Start on a different device per thread, then help out on the others.
+	for (int n = 0; n < ssds->n_ssds; n++) {
+		drv_ssd *ssd = &ssds->ssds[(thread_ix + (uint32_t)n) % ssds->n_ssds];
+		uint64_t start_offset;
+		uint64_t end_offset;
+
+		while (ssd_load_next_range(ssds, ssd, &start_offset, &end_offset)) {
+			if (ssd_load_range_sweep(ssds, ssd, buf, start_offset,
+					end_offset)) {
+				ssd_load_found_end(ssds, ssd, end_offset);
+			}
+		}
 	}
 
+	cf_free(buf);
+
 	if (0 == cf_rc_release(complete_rc)) {
 		// All drives are done reading.
 
+		for (int i = 0; i < ssds->n_ssds; i++) {
+			drv_ssd *ssd = &ssds->ssds[i];
+
+			ssd->cold_start_block_counter = ssd->file_size / LOAD_BUF_SIZE;
+
+			cf_info(AS_DRV_SSD, "device %s: read complete: UNIQUE %"PRIu64" (REPLACED %"PRIu64") (OLDER %"PRIu64") (EXPIRED %"PRIu64") (MAX-TTL %"PRIu64") records",
+				ssd->name, ssd->record_add_unique_counter,
+				ssd->record_add_replace_counter, ssd->record_add_older_counter,
+				ssd->record_add_expired_counter, ssd->record_add_max_ttl_counter);
+
+			if (ssd->record_add_sigfail_counter) {
+				cf_warning(AS_DRV_SSD, "device %s: WARNING: %"PRIu64" elements could not be read due to signature failure. Possible hardware errors.",
+					ssd->name, ssd->record_add_sigfail_counter);
+			}
+		}
+
 		ns->cold_start_loading = false;
 		ssd_cold_start_drop_cenotaphs(ns);
 		ssd_load_wblock_queues(ssds);
 
+		as_cold_start_evict_destroy(ns);
 		pthread_mutex_destroy(&ns->cold_start_evict_lock);
+		pthread_mutex_destroy(&ssds->load_lock);
 
 		cf_queue_push(complete_q, &complete_udata);
 		cf_rc_free(complete_rc);
@@ -3190,16 +6420,46 @@ ssd_load_devices_fn(void *udata)
 void
 ssd_load_devices_load(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 {
-	ssds->ns->cold_start_loading = true;
+	as_namespace *ns = ssds->ns;
 
-	void *p = cf_rc_alloc(1);
+	ns->cold_start_loading = true;
 
-	for (int i = 1; i < ssds->n_ssds; i++) {
-		cf_rc_reserve(p);
+	if (0 != pthread_mutex_init(&ssds->load_lock, NULL)) {
+		cf_crash(AS_DRV_SSD, "failed device load mutex init");
 	}
 
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
+
+		cf_info(AS_DRV_SSD, "device %s: reading device to load index",
+				ssd->name);
+
+		// Start past the header.
+		ssd->load_next_offset = ssds->header->header_length;
+		ssd->load_end_offset = (uint64_t)ssd->file_size;
+		ssd->cold_start_block_counter =
+				(uint32_t)(ssd->load_next_offset / LOAD_BUF_SIZE);
+	}
+
+	// Default is one thread per device, as before ranges were introduced.
+	uint32_t n_threads = ns->storage_cold_start_threads != 0 ?
+			ns->storage_cold_start_threads : (uint32_t)ssds->n_ssds;
+
+	cf_info(AS_DRV_SSD, "{%s} loading devices with %u threads", ns->name,
+			n_threads);
+
+	void *p = cf_rc_alloc(1);
+
+	for (uint32_t i = 1; i < n_threads; i++) {
+		cf_rc_reserve(p);
+	}
+
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	for (uint32_t i = 0; i < n_threads; i++) {
 		ssd_load_devices_data *ldd = cf_malloc(sizeof(ssd_load_devices_data));
 
 		if (! ldd) {
@@ -3207,12 +6467,16 @@ ssd_load_devices_load(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 		}
 
 		ldd->ssds = ssds;
-		ldd->ssd = ssd;
+		ldd->thread_ix = i;
 		ldd->complete_q = complete_q;
 		ldd->complete_udata = udata;
 		ldd->complete_rc = p;
 
-		pthread_create(&ssd->load_device_thread, 0, ssd_load_devices_fn, ldd);
+		pthread_t thread;
+
+		if (0 != pthread_create(&thread, &attrs, ssd_load_devices_fn, ldd)) {
+			cf_crash(AS_DRV_SSD, "failed to create device load thread");
+		}
 	}
 }
 
@@ -3339,6 +6603,14 @@ ssd_load_devices(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 		}
 	}
 
+	// An index snapshot must have been written when these devices were last
+	// shut down - there's no going back to cold start now.
+	if (! ns->cold_start && ns->index_snapshot_file &&
+			headers[first_used]->random != ns->index_snapshot_random) {
+		cf_crash(AS_DRV_SSD, "{%s}: index snapshot %s doesn't match devices - restart will cold start",
+				ns->name, ns->index_snapshot_file);
+	}
+
 	// Drive set OK - fix up header set.
 	ssds->header = headers[first_used];
 	headers[first_used] = 0;
@@ -3400,6 +6672,8 @@ ssd_load_devices(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 
 	ns->cold_start_max_void_time = now + (uint32_t)ns->max_ttl;
 
+	as_cold_start_evict_init(ns);
+
 	// Fire off threads to load in data - will signal completion when threads
 	// are all done.
 	ssd_load_devices_load(ssds, complete_q, udata);
@@ -3559,6 +6833,132 @@ find_io_min_size(int fd, const char *ssd_name)
 }
 
 
+#if defined(USE_ZONED)
+
+// Zones holding the device header must be conventional, since it's rewritten
+// in place. Zones after the last conventional zone must all be sequential.
+static void
+ssd_zone_init(drv_ssd *ssd)
+{
+	int fd = open(ssd->name, O_RDONLY);
+
+	if (fd == -1) {
+		cf_crash(AS_DRV_SSD, "unable to open device %s: %s", ssd->name,
+				cf_strerror(errno));
+	}
+
+	uint32_t zone_sectors = 0;
+
+	if (ioctl(fd, BLKGETZONESZ, &zone_sectors) != 0 || zone_sectors == 0) {
+		cf_crash_nostack(AS_DRV_SSD, "zoned: device %s is not a zoned block device",
+				ssd->name);
+	}
+
+	uint64_t zone_size = (uint64_t)zone_sectors << 9;
+
+	if (zone_size % ssd->write_block_size != 0) {
+		cf_crash_nostack(AS_DRV_SSD, "zoned: device %s zone size %lu not a multiple of write-block-size",
+				ssd->name, zone_size);
+	}
+
+	ssd->zone_n_wblocks = (uint32_t)(zone_size / ssd->write_block_size);
+	ssd->zone_capacity = ssd->zone_n_wblocks;
+	ssd->n_zones = (ssd->alloc_table->n_wblocks + ssd->zone_n_wblocks - 1) /
+			ssd->zone_n_wblocks;
+
+	size_t report_size = sizeof(struct blk_zone_report) +
+			(ZONE_REPORT_BATCH * sizeof(struct blk_zone));
+	struct blk_zone_report *report = cf_malloc(report_size);
+
+	if (! report) {
+		cf_crash(AS_DRV_SSD, "%s: zone report malloc failed", ssd->name);
+	}
+
+	uint32_t n_header_zones = (uint32_t)
+			((SSD_DEFAULT_HEADER_LENGTH + zone_size - 1) / zone_size);
+	uint32_t zone_id = 0;
+	bool found_sequential = false;
+
+	while (zone_id < ssd->n_zones) {
+		memset(report, 0, report_size);
+		report->sector = zone_id * zone_sectors;
+		report->nr_zones = ZONE_REPORT_BATCH;
+
+		if (ioctl(fd, BLKREPORTZONE, report) != 0 || report->nr_zones == 0) {
+			cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED zone report: errno %d (%s)",
+					ssd->name, errno, cf_strerror(errno));
+		}
+
+		for (uint32_t i = 0; i < report->nr_zones && zone_id < ssd->n_zones;
+				i++, zone_id++) {
+			struct blk_zone *zone = &report->zones[i];
+
+			if (zone->type == BLK_ZONE_TYPE_CONVENTIONAL) {
+				if (found_sequential) {
+					cf_crash_nostack(AS_DRV_SSD, "zoned: device %s has conventional zone %u after sequential zones",
+							ssd->name, zone_id);
+				}
+
+				continue;
+			}
+
+			if (zone_id < n_header_zones) {
+				cf_crash_nostack(AS_DRV_SSD, "zoned: device %s needs conventional zones for its header",
+						ssd->name);
+			}
+
+			if (! found_sequential) {
+				found_sequential = true;
+				ssd->first_zone_id = zone_id;
+			}
+
+			if ((report->flags & BLK_ZONE_REP_CAPACITY) != 0) {
+				uint32_t capacity = (uint32_t)
+						((zone->capacity << 9) / ssd->write_block_size);
+
+				if (capacity < ssd->zone_capacity) {
+					ssd->zone_capacity = capacity;
+				}
+			}
+		}
+	}
+
+	cf_free(report);
+	close(fd);
+
+	if (! found_sequential || ssd->zone_capacity == 0) {
+		cf_crash_nostack(AS_DRV_SSD, "zoned: device %s has no usable sequential zones",
+				ssd->name);
+	}
+
+	if (pthread_mutex_init(&ssd->zone_lock, NULL) != 0) {
+		cf_crash(AS_DRV_SSD, "%s: zone lock init failed", ssd->name);
+	}
+
+	if (! (ssd->zone_n_free = cf_calloc(ssd->n_zones, sizeof(uint32_t)))) {
+		cf_crash(AS_DRV_SSD, "%s: zone table calloc failed", ssd->name);
+	}
+
+	if (! (ssd->zone_sweep_q = cf_queue_create(sizeof(uint32_t), true))) {
+		cf_crash(AS_DRV_SSD, "%s: zone sweep queue create failed", ssd->name);
+	}
+
+	cf_info(AS_DRV_SSD, "%s has %u zones of %u wblocks (%u writable), data from zone %u",
+			ssd->name, ssd->n_zones, ssd->zone_n_wblocks, ssd->zone_capacity,
+			ssd->first_zone_id);
+}
+
+#else // ! USE_ZONED
+
+static void
+ssd_zone_init(drv_ssd *ssd)
+{
+	cf_crash_nostack(AS_DRV_SSD, "zoned: server not built with zoned device support (USE_ZONED=1)");
+}
+
+#endif // USE_ZONED
+
+
 int
 ssd_init_devices(as_namespace *ns, drv_ssds **ssds_p)
 {
@@ -3818,6 +7218,74 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 		return -1;
 	}
 
+	if (ns->storage_zoned) {
+		if (! ns->storage_devices[0]) {
+			cf_crash_nostack(AS_DRV_SSD, "{%s} zoned requires devices, not files",
+					ns->name);
+		}
+
+		// Commits rewrite the open wblock - zoned wblocks are written once.
+		if (ns->storage_commit_to_device) {
+			cf_crash_nostack(AS_DRV_SSD, "{%s} zoned can't commit-to-device",
+					ns->name);
+		}
+
+		for (int i = 0; i < ssds->n_ssds; i++) {
+			if (ssds->ssds[i].shadow_name) {
+				cf_crash_nostack(AS_DRV_SSD, "{%s} zoned devices can't have shadows",
+						ns->name);
+			}
+		}
+
+		// Zones must be written in order - only one write can be in flight.
+		if (ns->storage_write_threads != 1) {
+			cf_warning(AS_DRV_SSD, "{%s} zoned - using 1 write thread, not %u",
+					ns->name, ns->storage_write_threads);
+			ns->storage_write_threads = 1;
+		}
+
+		if (ns->storage_io_uring_depth != 0) {
+			cf_warning(AS_DRV_SSD, "{%s} zoned - ignoring io-uring-depth",
+					ns->name);
+			ns->storage_io_uring_depth = 0;
+		}
+
+		// Shards would interleave wblocks within a stream's zone.
+		if (ns->storage_write_shards != 1) {
+			cf_warning(AS_DRV_SSD, "{%s} zoned - using 1 write shard, not %u",
+					ns->name, ns->storage_write_shards);
+			ns->storage_write_shards = 1;
+		}
+	}
+
+	if (ns->storage_persistent_memory) {
+		if (ns->storage_zoned) {
+			cf_crash_nostack(AS_DRV_SSD, "{%s} persistent-memory can't be zoned",
+					ns->name);
+		}
+
+		// Ring writes would bypass the mapping.
+		if (ns->storage_io_uring_depth != 0) {
+			cf_warning(AS_DRV_SSD, "{%s} persistent-memory - ignoring io-uring-depth",
+					ns->name);
+			ns->storage_io_uring_depth = 0;
+		}
+	}
+
+	// Full flushes must exclude commits of the same wblock - the ring's writes
+	// don't go through ssd_flush_swb().
+	if (ns->storage_commit_to_device && ns->storage_io_uring_depth != 0) {
+		cf_warning(AS_DRV_SSD, "{%s} commit-to-device - ignoring io-uring-depth",
+				ns->name);
+		ns->storage_io_uring_depth = 0;
+	}
+
+	if (ns->storage_write_shards == 0 ||
+			ns->storage_write_shards > MAX_SSD_WRITE_SHARDS) {
+		cf_crash_nostack(AS_DRV_SSD, "{%s} write-shards must be 1 to %d",
+				ns->name, MAX_SSD_WRITE_SHARDS);
+	}
+
 	// Allow defrag to go full speed during startup - restore the configured
 	// settings when startup is done.
 	ns->saved_defrag_sleep = ns->storage_defrag_sleep;
@@ -3828,6 +7296,8 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 	// The queue limit is more efficient to work with.
 	ns->storage_max_write_q = (int)
 			(ns->storage_max_write_cache / ns->storage_write_block_size);
+	ns->storage_shadow_max_write_q = (int)
+			(ns->storage_shadow_max_write_cache / ns->storage_write_block_size);
 
 	// Minimize how often we recalculate this.
 	ns->defrag_lwm_size =
@@ -3835,6 +7305,11 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 
 	ns->storage_private = (void*)ssds;
 
+	if (! ns->storage_data_in_memory) {
+		ssds->read_cache = read_cache_create(ns);
+		ssds->hot_tier = hot_tier_create(ns);
+	}
+
 	char histname[HISTOGRAM_NAME_SIZE];
 
 	snprintf(histname, sizeof(histname), "{%s}-device-read-size", ns->name);
@@ -3856,8 +7331,15 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 		ssd->ns = ns;
 		ssd->file_id = i;
 
-		pthread_mutex_init(&ssd->write_lock, 0);
+		ssd->n_write_shards = ns->storage_write_shards;
+
+		for (uint32_t j = 0; j < ssd->n_write_shards; j++) {
+			pthread_mutex_init(&ssd->write_shards[j].lock, 0);
+		}
+
 		pthread_mutex_init(&ssd->defrag_lock, 0);
+		pthread_mutex_init(&ssd->commit_lock, 0);
+		pthread_cond_init(&ssd->commit_cond, 0);
 
 		ssd->running = true;
 
@@ -3866,7 +7348,15 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 
 		ssd_wblock_init(ssd);
 
-		// Note: free_wblock_q, defrag_wblock_q created after loading devices.
+		if (ns->storage_zoned) {
+			ssd_zone_init(ssd);
+		}
+
+		if (ns->storage_persistent_memory) {
+			ssd_pmem_init(ssd);
+		}
+
+		// Note: free_wblock_q, defrag_q created after loading devices.
 
 		if (! (ssd->fd_q = cf_queue_create(sizeof(int), true))) {
 			cf_crash(AS_DRV_SSD, "can't create fd queue");
@@ -3877,13 +7367,20 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 			cf_crash(AS_DRV_SSD, "can't create shadow fd queue");
 		}
 
-		if (! (ssd->swb_write_q = cf_queue_create(sizeof(void*), true))) {
+		if (! (ssd->swb_write_q = cf_mpmc_queue_create(sizeof(void*),
+				SWB_WRITE_Q_CAPACITY))) {
 			cf_crash(AS_DRV_SSD, "can't create swb-write queue");
 		}
 
 		if (ssd->shadow_name &&
-				! (ssd->swb_shadow_q = cf_queue_create(sizeof(void*), true))) {
-			cf_crash(AS_DRV_SSD, "can't create swb-shadow queue");
+				! (ssd->shadow_buf_q = cf_queue_create(sizeof(void*), true))) {
+			cf_crash(AS_DRV_SSD, "can't create shadow-buf queue");
+		}
+
+		if (ssd->shadow_name &&
+				! (ssd->shadow_buf_free_q = cf_queue_create(sizeof(void*),
+						true))) {
+			cf_crash(AS_DRV_SSD, "can't create shadow-buf-free queue");
 		}
 
 		if (! (ssd->swb_free_q = cf_queue_create(sizeof(void*), true))) {
@@ -3927,6 +7424,12 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 		if (! (ssd->hist_fsync = histogram_create(histname, HIST_MILLISECONDS))) {
 			cf_crash(AS_DRV_SSD, "cannot create histogram %s", histname);
 		}
+
+		snprintf(histname, sizeof(histname), "{%s}-%s-read-size", ns->name, ssd->name);
+
+		if (! (ssd->hist_read_size = histogram_create(histname, HIST_SIZE))) {
+			cf_crash(AS_DRV_SSD, "cannot create histogram %s", histname);
+		}
 	}
 
 	// Attempt to load the data.
@@ -3996,11 +7499,16 @@ as_storage_namespace_destroy_ssd(as_namespace *ns)
 int
 as_storage_record_destroy_ssd(as_namespace *ns, as_record *r)
 {
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+
+	if (ssds->hot_tier) {
+		hot_tier_remove(ssds->hot_tier, r);
+	}
+
 	if (STORAGE_RBLOCK_IS_VALID(r->rblock_id) && r->n_rblocks != 0) {
-		drv_ssds *ssds = (drv_ssds*)ns->storage_private;
 		drv_ssd *ssd = &ssds->ssds[r->file_id];
 
-		ssd_block_free(ssd, r->rblock_id, r->n_rblocks, "destroy");
+		ssd_record_free(ssd, r->rblock_id, r->n_rblocks, "destroy");
 
 		r->rblock_id = 0;
 		r->n_rblocks = 0;
@@ -4019,6 +7527,7 @@ as_storage_record_create_ssd(as_storage_rd *rd)
 {
 	rd->block = NULL;
 	rd->must_free_block = NULL;
+	rd->must_free_size = 0;
 	rd->ssd = NULL;
 
 	cf_assert(rd->r->rblock_id == 0, AS_DRV_SSD, "unexpected - uninitialized rblock-id");
@@ -4034,6 +7543,7 @@ as_storage_record_open_ssd(as_storage_rd *rd)
 
 	rd->block = NULL;
 	rd->must_free_block = NULL;
+	rd->must_free_size = 0;
 	rd->ssd = &ssds->ssds[rd->r->file_id];
 
 	return 0;
@@ -4044,8 +7554,9 @@ int
 as_storage_record_close_ssd(as_storage_rd *rd)
 {
 	if (rd->must_free_block) {
-		cf_free(rd->must_free_block);
+		ssd_free_read_buf(rd->must_free_block, rd->must_free_size);
 		rd->must_free_block = NULL;
+		rd->must_free_size = 0;
 		rd->block = NULL;
 	}
 
@@ -4063,7 +7574,8 @@ as_storage_record_close_ssd(as_storage_rd *rd)
 bool
 as_storage_record_size_and_check_ssd(as_storage_rd *rd)
 {
-	return rd->ns->storage_write_block_size >= as_storage_record_size(rd);
+	return ssd_max_record_size(rd->ns->storage_write_block_size) >=
+			as_storage_record_size(rd);
 }
 
 
@@ -4108,7 +7620,7 @@ as_storage_overloaded_ssd(as_namespace *ns)
 	// TODO - would be nice to not do this loop every single write transaction!
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
-		int qsz = cf_queue_sz(ssd->swb_write_q);
+		int qsz = (int)cf_mpmc_queue_sz(ssd->swb_write_q);
 
 		if (qsz > max_write_q) {
 			cf_ticker_warning(AS_DRV_SSD, "{%s} write fail: queue too deep: exceeds max %d",
@@ -4117,11 +7629,11 @@ as_storage_overloaded_ssd(as_namespace *ns)
 		}
 
 		if (ssd->shadow_name) {
-			qsz = cf_queue_sz(ssd->swb_shadow_q);
+			qsz = cf_queue_sz(ssd->shadow_buf_q);
 
-			if (qsz > max_write_q) {
+			if (qsz > ns->storage_shadow_max_write_q) {
 				cf_ticker_warning(AS_DRV_SSD, "{%s} write fail: shadow queue too deep: exceeds max %d",
-						ns->name, max_write_q);
+						ns->name, ns->storage_shadow_max_write_q);
 				return true;
 			}
 		}
@@ -4272,15 +7784,76 @@ as_storage_stats_ssd(as_namespace *ns, int *available_pct,
 int
 as_storage_ticker_stats_ssd(as_namespace *ns)
 {
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+
+	if (ns->storage_defrag_adaptive) {
+		uint64_t now_us = cf_getus();
+
+		for (int i = 0; i < ssds->n_ssds; i++) {
+			drv_ssd *ssd = &ssds->ssds[i];
+			uint64_t n_done = cf_atomic64_get(ssd->n_defrag_wblocks_done);
+			uint64_t delta_us = now_us - ssd->ticker_prev_us;
+
+			double actual_rate = ssd->ticker_prev_us == 0 || delta_us == 0 ?
+					0.0 : (double)(n_done - ssd->ticker_prev_defrag_done) *
+							1000000.0 / (double)delta_us;
+
+			ssd->ticker_prev_defrag_done = n_done;
+			ssd->ticker_prev_us = now_us;
+
+			char target_str[16];
+
+			if (ssd->defrag_target_rate == 0) {
+				strcpy(target_str, "unthrottled");
+			}
+			else {
+				sprintf(target_str, "%u", ssd->defrag_target_rate);
+			}
+
+			cf_info(AS_DRV_SSD, "{%s} %s: defrag-rate target %s actual %.1f free-wblocks %d write-q %d",
+					ns->name, ssd->name, target_str, actual_rate,
+					cf_queue_sz(ssd->free_wblock_q),
+					cf_mpmc_queue_sz(ssd->swb_write_q));
+		}
+	}
+
+	if (! ns->storage_benchmarks_enabled) {
+		return 0;
+	}
+
 	histogram_dump(ns->device_read_size_hist);
 	histogram_dump(ns->device_write_size_hist);
 
-	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
-
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
 
+		// Peaks restart from the current depth for the next ticker interval.
+		cf_info(AS_DRV_SSD, "{%s} %s: in-flight read %d (peak %d) large-block-read %d (peak %d) write %d (peak %d)",
+				ns->name, ssd->name,
+				cf_atomic32_get(ssd->read_depth.n_in_flight),
+				cf_atomic32_get(ssd->read_depth.peak),
+				cf_atomic32_get(ssd->large_read_depth.n_in_flight),
+				cf_atomic32_get(ssd->large_read_depth.peak),
+				cf_atomic32_get(ssd->write_depth.n_in_flight),
+				cf_atomic32_get(ssd->write_depth.peak));
+
+		cf_atomic32_set(&ssd->read_depth.peak,
+				cf_atomic32_get(ssd->read_depth.n_in_flight));
+		cf_atomic32_set(&ssd->large_read_depth.peak,
+				cf_atomic32_get(ssd->large_read_depth.n_in_flight));
+		cf_atomic32_set(&ssd->write_depth.peak,
+				cf_atomic32_get(ssd->write_depth.n_in_flight));
+
+		cf_info(AS_DRV_SSD, "{%s} %s: io-scheduler in-flight client-read %d flush %d migrate %d scan %d defrag %d",
+				ns->name, ssd->name,
+				cf_atomic32_get(ssd->io_in_flight[SSD_IO_CLIENT_READ]),
+				cf_atomic32_get(ssd->io_in_flight[SSD_IO_FLUSH]),
+				cf_atomic32_get(ssd->io_in_flight[SSD_IO_MIGRATE]),
+				cf_atomic32_get(ssd->io_in_flight[SSD_IO_SCAN]),
+				cf_atomic32_get(ssd->io_in_flight[SSD_IO_DEFRAG]));
+
 		histogram_dump(ssd->hist_read);
+		histogram_dump(ssd->hist_read_size);
 		histogram_dump(ssd->hist_large_block_read);
 		histogram_dump(ssd->hist_write);
 
@@ -4304,6 +7877,7 @@ as_storage_histogram_clear_ssd(as_namespace *ns)
 		drv_ssd *ssd = &ssds->ssds[i];
 
 		histogram_clear(ssd->hist_read);
+		histogram_clear(ssd->hist_read_size);
 		histogram_clear(ssd->hist_large_block_read);
 		histogram_clear(ssd->hist_write);
 
@@ -4331,19 +7905,38 @@ as_storage_shutdown_ssd(as_namespace *ns)
 		drv_ssd *ssd = &ssds->ssds[i];
 
 		// Stop the maintenance thread from (also) flushing the swbs.
-		pthread_mutex_lock(&ssd->write_lock);
+		for (uint32_t j = 0; j < ssd->n_write_shards; j++) {
+			pthread_mutex_lock(&ssd->write_shards[j].lock);
+		}
+
 		pthread_mutex_lock(&ssd->defrag_lock);
 
-		// Flush current swb by pushing it to write-q.
-		if (ssd->current_swb) {
-			// Clean the end of the buffer before pushing to write-q.
-			if (ssd->write_block_size > ssd->current_swb->pos) {
-				memset(&ssd->current_swb->buf[ssd->current_swb->pos], 0,
-						ssd->write_block_size - ssd->current_swb->pos);
+		for (uint32_t j = 0; j < ssd->n_write_shards; j++) {
+			ssd_write_shard *shard = &ssd->write_shards[j];
+
+			// Flush current swb by pushing it to write-q.
+			if (shard->current_swb) {
+				// Clean the end of the buffer before pushing to write-q.
+				if (ssd->write_block_size > shard->current_swb->pos) {
+					memset(&shard->current_swb->buf[shard->current_swb->pos],
+							0, ssd->write_block_size - shard->current_swb->pos);
+				}
+
+				cf_mpmc_queue_push(ssd->swb_write_q, &shard->current_swb);
+				shard->current_swb = NULL;
 			}
 
-			cf_queue_push(ssd->swb_write_q, &ssd->current_swb);
-			ssd->current_swb = NULL;
+			// Flush hot swb by pushing it to write-q.
+			if (shard->hot_swb) {
+				// Clean the end of the buffer before pushing to write-q.
+				if (ssd->write_block_size > shard->hot_swb->pos) {
+					memset(&shard->hot_swb->buf[shard->hot_swb->pos], 0,
+							ssd->write_block_size - shard->hot_swb->pos);
+				}
+
+				cf_mpmc_queue_push(ssd->swb_write_q, &shard->hot_swb);
+				shard->hot_swb = NULL;
+			}
 		}
 
 		// Flush defrag swb by pushing it to write-q.
@@ -4354,7 +7947,7 @@ as_storage_shutdown_ssd(as_namespace *ns)
 						ssd->write_block_size - ssd->defrag_swb->pos);
 			}
 
-			cf_queue_push(ssd->swb_write_q, &ssd->defrag_swb);
+			cf_mpmc_queue_push(ssd->swb_write_q, &ssd->defrag_swb);
 			ssd->defrag_swb = NULL;
 		}
 	}
@@ -4362,12 +7955,12 @@ as_storage_shutdown_ssd(as_namespace *ns)
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
 
-		while (cf_queue_sz(ssd->swb_write_q)) {
+		while (cf_mpmc_queue_sz(ssd->swb_write_q)) {
 			usleep(1000);
 		}
 
 		if (ssd->shadow_name) {
-			while (cf_queue_sz(ssd->swb_shadow_q)) {
+			while (cf_queue_sz(ssd->shadow_buf_q)) {
 				usleep(1000);
 			}
 		}
@@ -4387,4 +7980,7 @@ as_storage_shutdown_ssd(as_namespace *ns)
 			pthread_join(ssd->shadow_worker_thread, &p_void);
 		}
 	}
+
+	// An index snapshot is only good for the devices as they are now.
+	ns->index_snapshot_random = ssds->header->random;
 }
@@ -21,19 +21,139 @@
  */
 
 #include "storage/drv_ssd.h"
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "citrusleaf/cf_atomic.h"
 #include "fault.h"
+#include "hardware.h"
 #include "base/datamodel.h"
+#include "base/index.h"
 #include "base/rec_props.h"
+#include "fabric/partition.h"
 #include "storage/storage.h"
 
 
+typedef struct resume_devices_info_s {
+	drv_ssds* ssds;
+	cf_atomic32 pid;
+	cf_atomic64 n_dropped;
+} resume_devices_info;
+
+typedef struct resume_devices_cb_info_s {
+	drv_ssds* ssds;
+	as_index_tree* tree;
+	bool drop_all;
+	uint64_t n_dropped;
+} resume_devices_cb_info;
+
+
+static void
+resume_devices_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	resume_devices_cb_info* info = (resume_devices_cb_info*)udata;
+	drv_ssds* ssds = info->ssds;
+	as_namespace* ns = ssds->ns;
+	as_record* r = r_ref->r;
+
+	// Hot tier pointers in the snapshot are from the previous process.
+	r->dim = NULL;
+
+	// Counted here so the destructor can undo it if the record is dropped.
+	cf_atomic64_incr(&ns->n_objects);
+
+	bool is_ok = false;
+
+	if (STORAGE_RBLOCK_IS_VALID(r->rblock_id) && r->n_rblocks != 0 &&
+			r->file_id < (uint32_t)ssds->n_ssds) {
+		drv_ssd* ssd = &ssds->ssds[r->file_id];
+		uint32_t wblock_id = RBLOCK_ID_TO_WBLOCK_ID(ssd, r->rblock_id);
+
+		// A chunked record's chunks are accounted for from its head.
+		if (! ssd->started_fresh && wblock_id < ssd->alloc_table->n_wblocks &&
+				(! ssd_n_rblocks_is_chunked(r->n_rblocks) ||
+						ssd_chunks_add_inuse(ssd, r->rblock_id,
+								r->n_rblocks))) {
+			uint32_t size =
+					(uint32_t)RBLOCKS_TO_BYTES(ssd_head_n_rblocks(r->n_rblocks));
+
+			cf_atomic64_add(&ssd->inuse_size, size);
+			cf_atomic32_add(&ssd->alloc_table->wblock_state[wblock_id].inuse_sz,
+					(int32_t)size);
+
+			is_ok = true;
+		}
+	}
+
+	if (! is_ok) {
+		// Don't let the destructor free storage we never accounted for.
+		r->rblock_id = 0;
+		r->n_rblocks = 0;
+	}
+
+	if (! is_ok || info->drop_all) {
+		as_index_delete(info->tree, &r->keyd);
+		info->n_dropped++;
+	}
+
+	as_record_done(r_ref, ns);
+}
+
+
+static void*
+run_resume_devices(void* udata)
+{
+	resume_devices_info* info = (resume_devices_info*)udata;
+	drv_ssds* ssds = info->ssds;
+	as_namespace* ns = ssds->ns;
+	resume_devices_cb_info cb_info = { .ssds = ssds, .n_dropped = 0 };
+	uint32_t pid;
+
+	while ((pid = (uint32_t)cf_atomic32_incr(&info->pid)) < AS_PARTITIONS) {
+		as_partition_reservation rsv;
+
+		as_partition_reserve(ns, pid, &rsv);
+
+		cb_info.tree = rsv.tree;
+		cb_info.drop_all = ! ssds->get_state_from_storage[pid];
+
+		as_index_reduce(rsv.tree, resume_devices_reduce_cb, &cb_info);
+
+		as_partition_release(&rsv);
+	}
+
+	cf_atomic64_add(&info->n_dropped, (int64_t)cb_info.n_dropped);
+
+	return NULL;
+}
+
+
+// Community edition only resumes from an index snapshot - rebuild the storage
+// accounting the cold start device sweep would otherwise have built.
 void
 ssd_resume_devices(drv_ssds* ssds)
 {
-	// Should not get here - for enterprise version only.
-	cf_crash(AS_DRV_SSD, "cold start called ssd_resume_devices()");
+	as_namespace* ns = ssds->ns;
+	resume_devices_info info = { .ssds = ssds, .pid = -1, .n_dropped = 0 };
+
+	// Partitions are independent - split them across multiple threads.
+	uint32_t n_cpus = cf_topo_count_cpus();
+	pthread_t resume_threads[n_cpus];
+
+	for (uint32_t n = 0; n < n_cpus; n++) {
+		if (pthread_create(&resume_threads[n], NULL, run_resume_devices,
+				(void*)&info) != 0) {
+			cf_crash(AS_DRV_SSD, "{%s} failed to create resume thread %u",
+					ns->name, n);
+		}
+	}
+
+	for (uint32_t n = 0; n < n_cpus; n++) {
+		pthread_join(resume_threads[n], NULL);
+	}
+
+	cf_info(AS_DRV_SSD, "{%s} resumed index: %lu records, dropped %lu",
+			ns->name, ns->n_objects, info.n_dropped);
 }
 
 
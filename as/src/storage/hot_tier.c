@@ -0,0 +1,305 @@
+/*
+ * hot_tier.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "storage/hot_tier.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+
+#include "fault.h"
+#include "olock.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Power of 2 - spreads lock contention across service threads.
+#define N_SHARDS 64
+
+typedef struct tier_entry_s {
+	struct tier_entry_s* clock_next; // circular CLOCK list
+	struct tier_entry_s* clock_prev;
+	as_index* r;
+	uint32_t size;
+	bool referenced;
+	uint8_t data[];
+} tier_entry;
+
+typedef struct tier_shard_s {
+	pthread_mutex_t lock;
+	tier_entry* hand; // next eviction candidate, NULL if shard is empty
+	uint64_t n_entries;
+	uint64_t used_size;
+	uint64_t max_size;
+} tier_shard;
+
+struct hot_tier_s {
+	as_namespace* ns;
+	tier_shard shards[N_SHARDS];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void unlink_entry(hot_tier* tier, tier_shard* shard, tier_entry* entry);
+static bool evict(hot_tier* tier, tier_shard* shard, uint64_t size);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline tier_shard*
+get_shard(hot_tier* tier, const as_index* r)
+{
+	// Digest bytes 0-3 pick partitions and record locks - don't reuse them.
+	return &tier->shards[r->keyd.digest[4] & (N_SHARDS - 1)];
+}
+
+
+//==========================================================
+// Public API.
+//
+
+hot_tier*
+hot_tier_create(as_namespace* ns)
+{
+	if (ns->storage_hot_tier_size == 0) {
+		return NULL;
+	}
+
+	hot_tier* tier = cf_malloc(sizeof(hot_tier));
+
+	if (! tier) {
+		cf_crash(AS_DRV_SSD, "{%s} failed hot tier allocation", ns->name);
+	}
+
+	tier->ns = ns;
+
+	for (uint32_t i = 0; i < N_SHARDS; i++) {
+		tier_shard* shard = &tier->shards[i];
+
+		pthread_mutex_init(&shard->lock, NULL);
+		shard->hand = NULL;
+		shard->n_entries = 0;
+		shard->used_size = 0;
+		shard->max_size = ns->storage_hot_tier_size / N_SHARDS;
+	}
+
+	cf_info(AS_DRV_SSD, "{%s} hot tier size %lu", ns->name,
+			ns->storage_hot_tier_size);
+
+	return tier;
+}
+
+
+// Returns the record's device block, or NULL if it's not in the tier. Valid
+// until the record lock is released.
+const uint8_t*
+hot_tier_get(hot_tier* tier, as_index* r)
+{
+	tier_entry* entry = (tier_entry*)r->dim;
+
+	if (! entry) {
+		return NULL;
+	}
+
+	// Benign race with the hand - at worst a second chance is lost or gained.
+	entry->referenced = true;
+
+	return entry->data;
+}
+
+
+// Record must not already be in the tier. Silently declines if the record is
+// too big, or if room can't be made without waiting for record locks.
+void
+hot_tier_put(hot_tier* tier, as_index* r, const uint8_t* data, uint32_t size)
+{
+	tier_shard* shard = get_shard(tier, r);
+	uint64_t entry_size = sizeof(tier_entry) + size;
+
+	// Don't let one big record flush a shard.
+	if (entry_size > shard->max_size / 8) {
+		return;
+	}
+
+	tier_entry* entry = cf_malloc(entry_size);
+
+	if (! entry) {
+		return;
+	}
+
+	entry->r = r;
+	entry->size = size;
+	entry->referenced = false; // must be read again to get a second chance
+	memcpy(entry->data, data, size);
+
+	pthread_mutex_lock(&shard->lock);
+
+	if (! evict(tier, shard, entry_size)) {
+		pthread_mutex_unlock(&shard->lock);
+		cf_free(entry);
+		return;
+	}
+
+	// Insert just behind the hand, so it's the last entry the hand reaches.
+	if (shard->hand) {
+		entry->clock_next = shard->hand;
+		entry->clock_prev = shard->hand->clock_prev;
+		entry->clock_prev->clock_next = entry;
+		shard->hand->clock_prev = entry;
+	}
+	else {
+		entry->clock_next = entry;
+		entry->clock_prev = entry;
+		shard->hand = entry;
+	}
+
+	shard->n_entries++;
+	shard->used_size += entry_size;
+	cf_atomic64_add(&tier->ns->hot_tier_used_bytes, (int64_t)entry_size);
+
+	r->dim = (void*)entry;
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+
+// Takes the record out of the tier, e.g. when it's rewritten. Returns the
+// allocation for the caller to cf_free() once it's done with *p_data (which
+// may still be in use by the caller's rd), or NULL if the record wasn't in the
+// tier.
+void*
+hot_tier_detach(hot_tier* tier, as_index* r, const uint8_t** p_data)
+{
+	tier_shard* shard = get_shard(tier, r);
+
+	pthread_mutex_lock(&shard->lock);
+
+	// Read under the shard lock - the destroy path has no record lock.
+	tier_entry* entry = (tier_entry*)r->dim;
+
+	if (entry) {
+		unlink_entry(tier, shard, entry);
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	if (entry && p_data) {
+		*p_data = entry->data;
+	}
+
+	return entry;
+}
+
+
+void
+hot_tier_remove(hot_tier* tier, as_index* r)
+{
+	cf_free(hot_tier_detach(tier, r, NULL));
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+unlink_entry(hot_tier* tier, tier_shard* shard, tier_entry* entry)
+{
+	if (entry->clock_next == entry) {
+		shard->hand = NULL;
+	}
+	else {
+		if (shard->hand == entry) {
+			shard->hand = entry->clock_next;
+		}
+
+		entry->clock_prev->clock_next = entry->clock_next;
+		entry->clock_next->clock_prev = entry->clock_prev;
+	}
+
+	uint64_t entry_size = sizeof(tier_entry) + entry->size;
+
+	shard->n_entries--;
+	shard->used_size -= entry_size;
+	cf_atomic64_sub(&tier->ns->hot_tier_used_bytes, (int64_t)entry_size);
+
+	entry->r->dim = NULL;
+}
+
+
+// Make room for an entry of the specified size. Entries read since the hand
+// last passed them get a second chance. Entries whose record is locked - in
+// use, or sharing a lock with the caller's record - are passed over. Returns
+// false if enough room wasn't made within two turns of the hand.
+static bool
+evict(hot_tier* tier, tier_shard* shard, uint64_t size)
+{
+	uint64_t n_visits = 2 * shard->n_entries;
+
+	while (shard->hand && shard->used_size + size > shard->max_size) {
+		if (n_visits-- == 0) {
+			return false;
+		}
+
+		tier_entry* entry = shard->hand;
+
+		if (entry->referenced) {
+			entry->referenced = false;
+			shard->hand = entry->clock_next;
+			continue;
+		}
+
+		// The shard lock keeps the record alive - its destroy path must detach
+		// it first - so it's safe to try for its lock.
+		as_index* r = entry->r;
+
+		if (! olock_trylock(g_record_locks, &r->keyd)) {
+			shard->hand = entry->clock_next;
+			continue;
+		}
+
+		unlink_entry(tier, shard, entry);
+		olock_unlock(g_record_locks, &r->keyd);
+		cf_free(entry);
+	}
+
+	return true;
+}
@@ -0,0 +1,330 @@
+/*
+ * read_cache.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "storage/read_cache.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+
+#include "fault.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Power of 2 - spreads lock contention across service threads.
+#define N_SHARDS 64
+#define SHARD_SHIFT (64 - 6)
+
+// Sizes hash buckets per shard, assuming small records.
+#define EXPECTED_ENTRY_SIZE 1024
+#define MIN_BUCKETS_PER_SHARD 256
+#define MAX_BUCKETS_PER_SHARD (1024 * 1024)
+
+typedef struct cache_entry_s {
+	struct cache_entry_s* chain_next; // hash bucket chain
+	struct cache_entry_s* clock_next; // circular CLOCK list
+	struct cache_entry_s* clock_prev;
+	uint64_t key;
+	uint32_t size;
+	bool referenced;
+	uint8_t data[];
+} cache_entry;
+
+typedef struct cache_shard_s {
+	pthread_mutex_t lock;
+	cache_entry** buckets;
+	uint32_t bucket_mask;
+	cache_entry* hand; // next eviction candidate, NULL if shard is empty
+	uint64_t used_size;
+	uint64_t max_size;
+} cache_shard;
+
+struct read_cache_s {
+	as_namespace* ns;
+	cache_shard shards[N_SHARDS];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static cache_entry** find_entry(cache_shard* shard, uint64_t key);
+static void unlink_entry(read_cache* cache, cache_shard* shard, cache_entry** p_entry);
+static void evict(read_cache* cache, cache_shard* shard, uint64_t size);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline uint64_t
+make_key(uint32_t file_id, uint64_t rblock_id)
+{
+	// rblock_id is (far) less than 48 bits, and file_id is small.
+	return ((uint64_t)file_id << 48) | rblock_id;
+}
+
+static inline uint64_t
+hash_key(uint64_t key)
+{
+	// Fibonacci hashing - rblock_ids are sequential within a wblock.
+	return key * 0x9E3779B97F4A7C15UL;
+}
+
+static inline cache_shard*
+get_shard(read_cache* cache, uint64_t key)
+{
+	return &cache->shards[hash_key(key) >> SHARD_SHIFT];
+}
+
+
+//==========================================================
+// Public API.
+//
+
+read_cache*
+read_cache_create(as_namespace* ns)
+{
+	if (ns->storage_read_cache_size == 0) {
+		return NULL;
+	}
+
+	read_cache* cache = cf_malloc(sizeof(read_cache));
+
+	if (! cache) {
+		cf_crash(AS_DRV_SSD, "{%s} failed read cache allocation", ns->name);
+	}
+
+	cache->ns = ns;
+
+	uint64_t max_size = ns->storage_read_cache_size / N_SHARDS;
+	uint64_t n_buckets = MIN_BUCKETS_PER_SHARD;
+
+	while (n_buckets < max_size / EXPECTED_ENTRY_SIZE &&
+			n_buckets < MAX_BUCKETS_PER_SHARD) {
+		n_buckets <<= 1;
+	}
+
+	for (uint32_t i = 0; i < N_SHARDS; i++) {
+		cache_shard* shard = &cache->shards[i];
+
+		pthread_mutex_init(&shard->lock, NULL);
+
+		if (! (shard->buckets = cf_calloc(n_buckets, sizeof(cache_entry*)))) {
+			cf_crash(AS_DRV_SSD, "{%s} failed read cache allocation", ns->name);
+		}
+
+		shard->bucket_mask = (uint32_t)(n_buckets - 1);
+		shard->hand = NULL;
+		shard->used_size = 0;
+		shard->max_size = max_size;
+	}
+
+	cf_info(AS_DRV_SSD, "{%s} read cache size %lu", ns->name,
+			ns->storage_read_cache_size);
+
+	return cache;
+}
+
+
+// Returns a copy the caller must free, or NULL on a miss.
+uint8_t*
+read_cache_get(read_cache* cache, uint32_t file_id, uint64_t rblock_id,
+		uint32_t size)
+{
+	uint64_t key = make_key(file_id, rblock_id);
+	cache_shard* shard = get_shard(cache, key);
+	uint8_t* buf = NULL;
+
+	pthread_mutex_lock(&shard->lock);
+
+	cache_entry* entry = *find_entry(shard, key);
+
+	// Size mismatch shouldn't happen - treat as a miss.
+	if (entry && entry->size == size && (buf = cf_malloc(size)) != NULL) {
+		memcpy(buf, entry->data, size);
+		entry->referenced = true;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return buf;
+}
+
+
+void
+read_cache_put(read_cache* cache, uint32_t file_id, uint64_t rblock_id,
+		const uint8_t* data, uint32_t size)
+{
+	uint64_t key = make_key(file_id, rblock_id);
+	cache_shard* shard = get_shard(cache, key);
+	uint64_t entry_size = sizeof(cache_entry) + size;
+
+	// Don't let one big record flush a shard.
+	if (entry_size > shard->max_size / 8) {
+		return;
+	}
+
+	cache_entry* entry = cf_malloc(entry_size);
+
+	if (! entry) {
+		return;
+	}
+
+	entry->key = key;
+	entry->size = size;
+	entry->referenced = false; // must be read again to get a second chance
+	memcpy(entry->data, data, size);
+
+	pthread_mutex_lock(&shard->lock);
+
+	cache_entry** p_old = find_entry(shard, key);
+
+	if (*p_old) {
+		unlink_entry(cache, shard, p_old);
+	}
+
+	evict(cache, shard, entry_size);
+
+	uint32_t b = (uint32_t)hash_key(key) & shard->bucket_mask;
+
+	entry->chain_next = shard->buckets[b];
+	shard->buckets[b] = entry;
+
+	// Insert just behind the hand, so it's the last entry the hand reaches.
+	if (shard->hand) {
+		entry->clock_next = shard->hand;
+		entry->clock_prev = shard->hand->clock_prev;
+		entry->clock_prev->clock_next = entry;
+		shard->hand->clock_prev = entry;
+	}
+	else {
+		entry->clock_next = entry;
+		entry->clock_prev = entry;
+		shard->hand = entry;
+	}
+
+	shard->used_size += entry_size;
+	cf_atomic64_add(&cache->ns->read_cache_used_bytes, (int64_t)entry_size);
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+
+void
+read_cache_remove(read_cache* cache, uint32_t file_id, uint64_t rblock_id)
+{
+	uint64_t key = make_key(file_id, rblock_id);
+	cache_shard* shard = get_shard(cache, key);
+
+	pthread_mutex_lock(&shard->lock);
+
+	cache_entry** p_entry = find_entry(shard, key);
+
+	if (*p_entry) {
+		unlink_entry(cache, shard, p_entry);
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Returns pointer to the link referring to the entry - the link is NULL if the
+// key isn't found.
+static cache_entry**
+find_entry(cache_shard* shard, uint64_t key)
+{
+	uint32_t b = (uint32_t)hash_key(key) & shard->bucket_mask;
+	cache_entry** p_entry = &shard->buckets[b];
+
+	while (*p_entry && (*p_entry)->key != key) {
+		p_entry = &(*p_entry)->chain_next;
+	}
+
+	return p_entry;
+}
+
+
+static void
+unlink_entry(read_cache* cache, cache_shard* shard, cache_entry** p_entry)
+{
+	cache_entry* entry = *p_entry;
+
+	*p_entry = entry->chain_next;
+
+	if (entry->clock_next == entry) {
+		shard->hand = NULL;
+	}
+	else {
+		if (shard->hand == entry) {
+			shard->hand = entry->clock_next;
+		}
+
+		entry->clock_prev->clock_next = entry->clock_next;
+		entry->clock_next->clock_prev = entry->clock_prev;
+	}
+
+	uint64_t entry_size = sizeof(cache_entry) + entry->size;
+
+	shard->used_size -= entry_size;
+	cf_atomic64_sub(&cache->ns->read_cache_used_bytes, (int64_t)entry_size);
+
+	cf_free(entry);
+}
+
+
+// Make room for an entry of the specified size. Entries read since the hand
+// last passed them get a second chance.
+static void
+evict(read_cache* cache, cache_shard* shard, uint64_t size)
+{
+	while (shard->hand && shard->used_size + size > shard->max_size) {
+		cache_entry* entry = shard->hand;
+
+		if (entry->referenced) {
+			entry->referenced = false;
+			shard->hand = entry->clock_next;
+			continue;
+		}
+
+		unlink_entry(cache, shard, find_entry(shard, entry->key));
+	}
+}
@@ -273,6 +273,84 @@ as_storage_record_load_bins(as_storage_rd *rd)
 	return 0;
 }
 
+//--------------------------------------
+// as_storage_record_load_bins_named
+//
+
+typedef int (*as_storage_record_load_bins_named_fn)(as_storage_rd *rd, cf_vector *bin_names);
+static const as_storage_record_load_bins_named_fn as_storage_record_load_bins_named_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory has no record load bins
+	as_storage_record_load_bins_named_ssd
+};
+
+int
+as_storage_record_load_bins_named(as_storage_rd *rd, cf_vector *bin_names)
+{
+	if (as_storage_record_load_bins_named_table[rd->ns->storage_type]) {
+		return as_storage_record_load_bins_named_table[rd->ns->storage_type](rd, bin_names);
+	}
+
+	return 0;
+}
+
+//--------------------------------------
+// as_storage_record_load_multi
+//
+
+typedef int (*as_storage_record_load_multi_fn)(as_storage_rd **rds, uint32_t n_rds);
+static const as_storage_record_load_multi_fn as_storage_record_load_multi_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory has no record load multi
+	as_storage_record_load_multi_ssd
+};
+
+int
+as_storage_record_load_multi(as_namespace *ns, as_storage_rd **rds, uint32_t n_rds)
+{
+	if (as_storage_record_load_multi_table[ns->storage_type]) {
+		return as_storage_record_load_multi_table[ns->storage_type](rds, n_rds);
+	}
+
+	return 0;
+}
+
+//--------------------------------------
+// as_storage_record_revalidate
+//
+
+typedef void (*as_storage_record_revalidate_fn)(as_storage_rd *rd);
+static const as_storage_record_revalidate_fn as_storage_record_revalidate_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory has no record revalidate
+	as_storage_record_revalidate_ssd
+};
+
+void
+as_storage_record_revalidate(as_storage_rd *rd)
+{
+	if (as_storage_record_revalidate_table[rd->ns->storage_type]) {
+		as_storage_record_revalidate_table[rd->ns->storage_type](rd);
+	}
+}
+
+//--------------------------------------
+// as_storage_record_verify
+//
+
+typedef bool (*as_storage_record_verify_fn)(as_storage_rd *rd);
+static const as_storage_record_verify_fn as_storage_record_verify_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory has no record verify
+	as_storage_record_verify_ssd
+};
+
+bool
+as_storage_record_verify(as_storage_rd *rd)
+{
+	if (as_storage_record_verify_table[rd->ns->storage_type]) {
+		return as_storage_record_verify_table[rd->ns->storage_type](rd);
+	}
+
+	return true;
+}
+
 //--------------------------------------
 // as_storage_record_size_and_check
 //
@@ -355,6 +433,49 @@ as_storage_overloaded(as_namespace *ns)
 	return false;
 }
 
+//--------------------------------------
+// as_storage_n_devices
+//
+
+typedef uint32_t (*as_storage_n_devices_fn)(as_namespace *ns);
+static const as_storage_n_devices_fn as_storage_n_devices_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory has no devices to sweep
+	as_storage_n_devices_ssd
+};
+
+uint32_t
+as_storage_n_devices(as_namespace *ns)
+{
+	if (as_storage_n_devices_table[ns->storage_type]) {
+		return as_storage_n_devices_table[ns->storage_type](ns);
+	}
+
+	return 0;
+}
+
+//--------------------------------------
+// as_storage_sweep_device
+//
+
+typedef bool (*as_storage_sweep_device_fn)(as_namespace *ns, uint32_t device_ix, as_storage_sweep_tree_fn tree_fn, as_storage_sweep_record_fn record_fn, void *udata);
+static const as_storage_sweep_device_fn as_storage_sweep_device_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory has no devices to sweep
+	as_storage_sweep_device_ssd
+};
+
+bool
+as_storage_sweep_device(as_namespace *ns, uint32_t device_ix,
+		as_storage_sweep_tree_fn tree_fn, as_storage_sweep_record_fn record_fn,
+		void *udata)
+{
+	if (as_storage_sweep_device_table[ns->storage_type]) {
+		return as_storage_sweep_device_table[ns->storage_type](ns, device_ix,
+				tree_fn, record_fn, udata);
+	}
+
+	return false;
+}
+
 //--------------------------------------
 // as_storage_has_space
 //
@@ -532,6 +653,8 @@ as_storage_histogram_clear_all(as_namespace *ns)
 // Generic functions that don't use "v-tables".
 //
 
+static __thread as_storage_io_class g_io_class = AS_STORAGE_IO_CLIENT;
+
 // Get size of record's in-memory data - everything except index bytes.
 uint64_t
 as_storage_record_get_n_bytes_memory(as_storage_rd *rd)
@@ -661,7 +784,7 @@ as_storage_shutdown(void)
 	// that each write's record lock scope is either completed or never entered.
 
 	for (uint32_t n = 0; n < g_record_locks->n_locks; n++) {
-		pthread_mutex_lock(&g_record_locks->locks[n]);
+		pthread_mutex_lock(&g_record_locks->locks[n].lock);
 	}
 
 	// Now flush everything outstanding to storage devices.
@@ -685,3 +808,15 @@ as_storage_shutdown(void)
 
   	cf_info(AS_STORAGE, "completed flushing to storage");
 }
+
+void
+as_storage_set_io_class(as_storage_io_class io_class)
+{
+	g_io_class = io_class;
+}
+
+as_storage_io_class
+as_storage_get_io_class()
+{
+	return g_io_class;
+}
@@ -38,6 +38,7 @@
 #include "dynbuf.h"
 #include "fault.h"
 
+#include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
@@ -93,6 +94,25 @@ client_delete_update_stats(as_namespace* ns, uint8_t result_code)
 	}
 }
 
+static inline void
+batch_sub_delete_update_stats(as_namespace* ns, uint8_t result_code)
+{
+	switch (result_code) {
+	case AS_PROTO_RESULT_OK:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_success);
+		break;
+	case AS_PROTO_RESULT_FAIL_TIMEOUT:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_timeout);
+		break;
+	default:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_error);
+		break;
+	case AS_PROTO_RESULT_FAIL_NOT_FOUND:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_not_found);
+		break;
+	}
+}
+
 
 //==========================================================
 // Public API.
@@ -337,6 +357,12 @@ send_delete_response(as_transaction* tr)
 				tr->result_code, 0, 0, NULL, NULL, 0, tr->rsv.ns,
 				as_transaction_trid(tr));
 		break;
+	case FROM_BATCH:
+		tr->generation = 0;
+		tr->void_time = 0;
+		as_batch_add_made_result(tr, NULL);
+		batch_sub_delete_update_stats(tr->rsv.ns, tr->result_code);
+		break;
 	case FROM_NSUP:
 		break;
 	default:
@@ -363,6 +389,11 @@ delete_timeout_cb(rw_request* rw)
 		break;
 	case FROM_PROXY:
 		break;
+	case FROM_BATCH:
+		as_batch_add_error(rw->from.batch_shared, rw->from_data.batch_index,
+				AS_PROTO_RESULT_FAIL_TIMEOUT);
+		batch_sub_delete_update_stats(rw->rsv.ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		break;
 	case FROM_NSUP:
 		break;
 	default:
@@ -432,6 +463,9 @@ drop_master(as_transaction* tr, as_index_ref* r_ref, rw_request* rw)
 	as_index_delete(tree, &tr->keyd);
 	as_record_done(r_ref, ns);
 
+	as_cdc_write(ns, tr->rsv.p->id, &tr->keyd, 0, cf_clepoch_milliseconds(),
+			AS_CDC_OP_DELETE);
+
 	if (xdr_must_ship_delete(ns, as_transaction_is_nsup_delete(tr),
 			as_msg_is_xdr(m))) {
 		xdr_write(ns, &tr->keyd, 0, 0, XDR_OP_TYPE_DROP, set_id, NULL);
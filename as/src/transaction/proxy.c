@@ -308,7 +308,9 @@ as_proxy_return_to_sender(const as_transaction* tr, as_namespace* ns)
 	}
 
 	uint32_t pid = as_partition_getid(&tr->keyd);
-	cf_node redirect_node = as_partition_proxyee_redirect(ns, pid);
+	cf_node redirect_node = as_partition_proxyee_redirect(ns, pid,
+			(tr->msgp->msg.info2 & AS_MSG_INFO2_WRITE) == 0,
+			tr->from.proxy_node);
 
 	msg_set_uint32(m, PROXY_FIELD_OP, PROXY_OP_RETURN_TO_SENDER);
 	msg_set_uint32(m, PROXY_FIELD_TID, tr->from_data.proxy_tid);
@@ -37,11 +37,14 @@
 
 #include "dynbuf.h"
 #include "fault.h"
+#include "olock.h"
 
+#include "base/as_stap.h"
 #include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
+#include "base/predexp.h"
 #include "base/proto.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
@@ -62,9 +65,13 @@ bool read_dup_res_cb(rw_request* rw);
 
 void send_read_response(as_transaction* tr, as_msg_op** ops,
 		as_bin** response_bins, uint16_t n_bins, cf_dyn_buf* db);
+void send_read_iov_response(as_transaction* tr, as_msg_iov_reply* reply);
 void read_timeout_cb(rw_request* rw);
 
+bool read_filtered_by_metadata(as_transaction* tr, as_record* r);
 transaction_status read_local(as_transaction* tr);
+transaction_status read_local_record(as_transaction* tr, as_index_ref* r_ref,
+		as_storage_rd* rd);
 void read_local_done(as_transaction* tr, as_index_ref* r_ref, as_storage_rd* rd,
 		int result_code);
 
@@ -78,16 +85,16 @@ client_read_update_stats(as_namespace* ns, uint8_t result_code)
 {
 	switch (result_code) {
 	case AS_PROTO_RESULT_OK:
-		cf_atomic64_incr(&ns->n_client_read_success);
+		cf_counter_incr(&ns->n_client_read_success);
 		break;
 	case AS_PROTO_RESULT_FAIL_TIMEOUT:
-		cf_atomic64_incr(&ns->n_client_read_timeout);
+		cf_counter_incr(&ns->n_client_read_timeout);
 		break;
 	default:
-		cf_atomic64_incr(&ns->n_client_read_error);
+		cf_counter_incr(&ns->n_client_read_error);
 		break;
 	case AS_PROTO_RESULT_FAIL_NOT_FOUND:
-		cf_atomic64_incr(&ns->n_client_read_not_found);
+		cf_counter_incr(&ns->n_client_read_not_found);
 		break;
 	}
 }
@@ -108,9 +115,20 @@ batch_sub_read_update_stats(as_namespace* ns, uint8_t result_code)
 	case AS_PROTO_RESULT_FAIL_NOT_FOUND:
 		cf_atomic64_incr(&ns->n_batch_sub_read_not_found);
 		break;
+	case AS_PROTO_RESULT_FAIL_FILTERED_OUT:
+		cf_atomic64_incr(&ns->n_batch_sub_read_filtered_out);
+		break;
 	}
 }
 
+// Only batch sub-transactions carry predicate expressions (via their parent).
+static inline predexp_eval_t*
+read_predexp(const as_transaction* tr)
+{
+	return tr->origin == FROM_BATCH && tr->from.batch_shared ?
+			as_batch_get_predexp(tr->from.batch_shared) : NULL;
+}
+
 
 //==========================================================
 // Public API.
@@ -158,6 +176,87 @@ as_read_start(as_transaction* tr)
 }
 
 
+// For batch sub-transactions sharing one partition reservation, none of which
+// must duplicate resolve. Responses are sent to origin no matter what.
+void
+as_read_start_multi(as_transaction** trs, uint32_t n_trs)
+{
+	as_transaction* pending[n_trs];
+	as_index_ref r_refs[n_trs];
+	as_storage_rd rds[n_trs];
+	as_storage_rd* rd_ptrs[n_trs];
+	uint32_t n_pending = 0;
+
+	for (uint32_t i = 0; i < n_trs; i++) {
+		as_transaction* tr = trs[i];
+		as_namespace* ns = tr->rsv.ns;
+
+		BENCHMARK_START(tr, batch_sub, FROM_BATCH);
+
+		// No device read to share - "exists" ops only need the index.
+		if ((tr->msgp->msg.info1 & AS_MSG_INFO1_GET_NO_BINS) != 0) {
+			read_local(tr);
+			continue;
+		}
+
+		as_index_ref* r_ref = &r_refs[n_pending];
+
+		r_ref->skip_lock = false;
+
+		if (as_record_get_live(tr->rsv.tree, &tr->keyd, r_ref, ns) != 0) {
+			read_local_done(tr, NULL, NULL, AS_PROTO_RESULT_FAIL_NOT_FOUND);
+			continue;
+		}
+
+		if (as_record_is_doomed(r_ref->r, ns)) {
+			read_local_done(tr, r_ref, NULL, AS_PROTO_RESULT_FAIL_NOT_FOUND);
+			continue;
+		}
+
+		// Filter on metadata before committing to a device read.
+		if (read_filtered_by_metadata(tr, r_ref->r)) {
+			read_local_done(tr, r_ref, NULL, AS_PROTO_RESULT_FAIL_FILTERED_OUT);
+			continue;
+		}
+
+		r_ref->r->accessed = 1;
+
+		// Defer reading from device - keep the record reserved but unlocked.
+		as_storage_record_open(ns, r_ref->r, &rds[n_pending]);
+		pthread_mutex_unlock(r_ref->olock);
+
+		rd_ptrs[n_pending] = &rds[n_pending];
+		pending[n_pending++] = tr;
+	}
+
+	if (n_pending == 0) {
+		return;
+	}
+
+	// Read all the records' data without their locks, letting storage merge
+	// reads of records that are near each other.
+	as_storage_record_load_multi(pending[0]->rsv.ns, rd_ptrs, n_pending);
+
+	for (uint32_t i = 0; i < n_pending; i++) {
+		as_transaction* tr = pending[i];
+		as_index_ref* r_ref = &r_refs[i];
+		as_index* r = r_ref->r;
+
+		olock_vlock(g_record_locks, &r->keyd, &r_ref->olock);
+
+		// Things may have changed while the record was unlocked.
+		if (! as_index_is_valid_record(r) ||
+				as_record_is_doomed(r, tr->rsv.ns)) {
+			read_local_done(tr, r_ref, &rds[i], AS_PROTO_RESULT_FAIL_NOT_FOUND);
+			continue;
+		}
+
+		as_storage_record_revalidate(&rds[i]);
+		read_local_record(tr, r_ref, &rds[i]);
+	}
+}
+
+
 //==========================================================
 // Local helpers - transaction flow.
 //
@@ -262,6 +361,20 @@ send_read_response(as_transaction* tr, as_msg_op** ops, as_bin** response_bins,
 }
 
 
+// Only for client reads - proxy and batch responses must be contiguous.
+void
+send_read_iov_response(as_transaction* tr, as_msg_iov_reply* reply)
+{
+	BENCHMARK_NEXT_DATA_POINT(tr, read, local);
+	as_msg_send_iov_reply(tr->from.proto_fd_h, reply);
+	BENCHMARK_NEXT_DATA_POINT(tr, read, response);
+	HIST_TRACK_ACTIVATE_INSERT_DATA_POINT(tr, read_hist);
+	client_read_update_stats(tr->rsv.ns, tr->result_code);
+
+	tr->from.any = NULL; // pattern, not needed
+}
+
+
 void
 read_timeout_cb(rw_request* rw)
 {
@@ -303,6 +416,8 @@ read_local(as_transaction* tr)
 	as_msg* m = &tr->msgp->msg;
 	as_namespace* ns = tr->rsv.ns;
 
+	ASD_TRANS_READ_STARTING(g_config.self_node, as_transaction_trid(tr));
+
 	as_index_ref r_ref;
 	r_ref.skip_lock = false;
 
@@ -319,51 +434,93 @@ read_local(as_transaction* tr)
 		return TRANS_DONE_ERROR;
 	}
 
+	// Check a batch row's predicate expression against the index first.
+	if (read_filtered_by_metadata(tr, r)) {
+		read_local_done(tr, &r_ref, NULL, AS_PROTO_RESULT_FAIL_FILTERED_OUT);
+		return TRANS_DONE_ERROR;
+	}
+
+	r->accessed = 1;
+
 	as_storage_rd rd;
 
 	as_storage_record_open(ns, r, &rd);
 
+	return read_local_record(tr, &r_ref, &rd);
+}
+
+
+transaction_status
+read_local_record(as_transaction* tr, as_index_ref* r_ref,
+		as_storage_rd* rd)
+{
+	as_msg* m = &tr->msgp->msg;
+	as_namespace* ns = tr->rsv.ns;
+	as_record* r = r_ref->r;
+
 	// Check the key if required.
 	// Note - for data-not-in-memory "exists" ops, key check is expensive!
 	if (as_transaction_has_key(tr) &&
-			as_storage_record_get_key(&rd) && ! check_msg_key(m, &rd)) {
-		read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_KEY_MISMATCH);
+			as_storage_record_get_key(rd) && ! check_msg_key(m, rd)) {
+		read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_FAIL_KEY_MISMATCH);
 		return TRANS_DONE_ERROR;
 	}
 
-	if ((m->info1 & AS_MSG_INFO1_GET_NO_BINS) != 0) {
+	predexp_eval_t* predexp = read_predexp(tr);
+	bool check_bins = predexp_needs_record(predexp);
+
+	// Note - "exists" ops must still load bins if the predexp needs them.
+	if ((m->info1 & AS_MSG_INFO1_GET_NO_BINS) != 0 && ! check_bins) {
 		tr->generation = r->generation;
 		tr->void_time = r->void_time;
 		tr->last_update_time = r->last_update_time;
 
-		read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_OK);
+		read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_OK);
 		return TRANS_DONE_SUCCESS;
 	}
 
-	int result = as_storage_rd_load_n_bins(&rd);
+	int result = as_storage_rd_load_n_bins(rd);
 
 	if (result < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed as_storage_rd_load_n_bins() ", ns->name);
-		read_local_done(tr, &r_ref, &rd, -result);
+		read_local_done(tr, r_ref, rd, -result);
 		return TRANS_DONE_ERROR;
 	}
 
-	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
+	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd->n_bins];
 
-	if ((result = as_storage_rd_load_bins(&rd, stack_bins)) < 0) {
+	if ((result = as_storage_rd_load_bins(rd, stack_bins)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed as_storage_rd_load_bins() ", ns->name);
-		read_local_done(tr, &r_ref, &rd, -result);
+		read_local_done(tr, r_ref, rd, -result);
 		return TRANS_DONE_ERROR;
 	}
 
-	if (! as_bin_inuse_has(&rd)) {
+	if (! as_bin_inuse_has(rd)) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: found record with no bins ", ns->name);
-		read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_UNKNOWN);
+		read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_FAIL_UNKNOWN);
 		return TRANS_DONE_ERROR;
 	}
 
+	if (check_bins) {
+		predexp_args_t predargs = { .ns = ns, .md = r, .vl = NULL, .rd = rd };
+
+		if (! predexp_matches_record(predexp, &predargs)) {
+			read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_FAIL_FILTERED_OUT);
+			return TRANS_DONE_ERROR;
+		}
+
+		if ((m->info1 & AS_MSG_INFO1_GET_NO_BINS) != 0) {
+			tr->generation = r->generation;
+			tr->void_time = r->void_time;
+			tr->last_update_time = r->last_update_time;
+
+			read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_OK);
+			return TRANS_DONE_SUCCESS;
+		}
+	}
+
 	uint32_t bin_count = (m->info1 & AS_MSG_INFO1_GET_ALL) != 0 ?
-			rd.n_bins : m->n_ops;
+			rd->n_bins : m->n_ops;
 
 	as_msg_op* ops[bin_count];
 	as_msg_op** p_ops = ops;
@@ -375,13 +532,13 @@ read_local(as_transaction* tr)
 
 	if ((m->info1 & AS_MSG_INFO1_GET_ALL) != 0) {
 		p_ops = NULL;
-		n_bins = as_bin_inuse_count(&rd);
-		as_bin_get_all_p(&rd, response_bins);
+		n_bins = as_bin_inuse_count(rd);
+		as_bin_get_all_p(rd, response_bins);
 	}
 	else {
 		if (m->n_ops == 0) {
 			cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: bin op(s) expected, none present ", ns->name);
-			read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_PARAMETER);
+			read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_FAIL_PARAMETER);
 			return TRANS_DONE_ERROR;
 		}
 
@@ -392,7 +549,7 @@ read_local(as_transaction* tr)
 
 		while ((op = as_msg_op_iterate(m, op, &n)) != NULL) {
 			if (op->op == AS_MSG_OP_READ) {
-				as_bin* b = as_bin_get_from_buf(&rd, op->name, op->name_sz);
+				as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
 
 				if (b || respond_all_ops) {
 					ops[n_bins] = op;
@@ -400,7 +557,7 @@ read_local(as_transaction* tr)
 				}
 			}
 			else if (op->op == AS_MSG_OP_CDT_READ) {
-				as_bin* b = as_bin_get_from_buf(&rd, op->name, op->name_sz);
+				as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
 
 				if (b) {
 					as_bin* rb = &result_bins[n_result_bins];
@@ -409,7 +566,7 @@ read_local(as_transaction* tr)
 					if ((result = as_bin_cdt_read_from_client(b, op, rb)) < 0) {
 						cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed as_bin_cdt_read_from_client() ", ns->name);
 						destroy_stack_bins(result_bins, n_result_bins);
-						read_local_done(tr, &r_ref, &rd, -result);
+						read_local_done(tr, r_ref, rd, -result);
 						return TRANS_DONE_ERROR;
 					}
 
@@ -428,15 +585,66 @@ read_local(as_transaction* tr)
 					response_bins[n_bins++] = NULL;
 				}
 			}
+			else if (op->op == AS_MSG_OP_HLL_COUNT ||
+					op->op == AS_MSG_OP_BITS_READ) {
+				as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
+
+				if (b) {
+					as_bin* rb = &result_bins[n_result_bins];
+					as_bin_set_empty(rb);
+
+					if ((result = op->op == AS_MSG_OP_HLL_COUNT ?
+							as_bin_hll_read_from_client(b, op, rb) :
+							as_bin_bits_read_from_client(b, op, rb)) < 0) {
+						cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed hll or bits read ", ns->name);
+						destroy_stack_bins(result_bins, n_result_bins);
+						read_local_done(tr, r_ref, rd, -result);
+						return TRANS_DONE_ERROR;
+					}
+
+					n_result_bins++;
+					ops[n_bins] = op;
+					response_bins[n_bins++] = rb;
+				}
+				else if (respond_all_ops) {
+					ops[n_bins] = op;
+					response_bins[n_bins++] = NULL;
+				}
+			}
 			else {
 				cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: unexpected bin op %u ", ns->name, op->op);
 				destroy_stack_bins(result_bins, n_result_bins);
-				read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_PARAMETER);
+				read_local_done(tr, r_ref, rd, AS_PROTO_RESULT_FAIL_PARAMETER);
 				return TRANS_DONE_ERROR;
 			}
 		}
 	}
 
+	// Bins cast from a block the rd owns outlive the record lock - if there are
+	// big values, send them from the block rather than copying them.
+	if (tr->origin == FROM_CLIENT && ! ns->storage_data_in_memory &&
+			rd->must_free_block) {
+		as_msg_iov_reply reply;
+
+		if (as_msg_make_response_iov(&reply, tr->result_code, r->generation,
+				r->void_time, p_ops, response_bins, n_bins, ns,
+				as_transaction_trid(tr))) {
+			as_record_done(r_ref, ns);
+
+			send_read_iov_response(tr, &reply);
+
+			destroy_stack_bins(result_bins, n_result_bins);
+			as_storage_record_close(rd);
+
+			tr->from.proto_fd_h = NULL;
+
+			ASD_TRANS_READ_FINISHED(g_config.self_node,
+					as_transaction_trid(tr), AS_PROTO_RESULT_OK);
+
+			return TRANS_DONE_SUCCESS;
+		}
+	}
+
 	cf_dyn_buf_define_size(db, 16 * 1024);
 
 	if (tr->origin != FROM_BATCH) {
@@ -459,8 +667,8 @@ read_local(as_transaction* tr)
 	}
 
 	destroy_stack_bins(result_bins, n_result_bins);
-	as_storage_record_close(&rd);
-	as_record_done(&r_ref, ns);
+	as_storage_record_close(rd);
+	as_record_done(r_ref, ns);
 
 	// Now that we're not under the record lock, send the message we just built.
 	if (db.used_sz != 0) {
@@ -470,10 +678,31 @@ read_local(as_transaction* tr)
 		tr->from.proto_fd_h = NULL;
 	}
 
+	ASD_TRANS_READ_FINISHED(g_config.self_node, as_transaction_trid(tr),
+			AS_PROTO_RESULT_OK);
+
 	return TRANS_DONE_SUCCESS;
 }
 
 
+// True if a batch row's predicate expression rejects the record on metadata
+// alone - the record phase, if needed, comes after bins are loaded.
+bool
+read_filtered_by_metadata(as_transaction* tr, as_record* r)
+{
+	predexp_eval_t* predexp = read_predexp(tr);
+
+	if (! predexp) {
+		return false;
+	}
+
+	predexp_args_t predargs = { .ns = tr->rsv.ns, .md = r, .vl = NULL,
+			.rd = NULL };
+
+	return ! predexp_matches_metadata(predexp, &predargs);
+}
+
+
 void
 read_local_done(as_transaction* tr, as_index_ref* r_ref, as_storage_rd* rd,
 		int result_code)
@@ -488,5 +717,8 @@ read_local_done(as_transaction* tr, as_index_ref* r_ref, as_storage_rd* rd,
 
 	tr->result_code = (uint8_t)result_code;
 
+	ASD_TRANS_READ_FINISHED(g_config.self_node, as_transaction_trid(tr),
+			(uint32_t)result_code);
+
 	send_read_response(tr, NULL, NULL, 0, NULL);
 }
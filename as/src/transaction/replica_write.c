@@ -424,6 +424,90 @@ repl_write_handle_ack(cf_node node, msg* m)
 }
 
 
+// Tell the other replicas of a partition to drop records already dropped on
+// master. No ack - like an nsup delete, a lost message leaves a replica to be
+// fixed by the next migration.
+void
+repl_write_send_drops(as_partition_reservation* rsv, const cf_digest* keyds,
+		uint32_t n_keyds)
+{
+	cf_node nodes[AS_CLUSTER_SZ];
+	uint32_t n_nodes = as_partition_get_other_replicas(rsv->p, nodes);
+	as_namespace* ns = rsv->ns;
+
+	for (uint32_t n = 0; n < n_nodes; n++) {
+		msg* m = as_fabric_msg_get(M_TYPE_RW);
+
+		if (! m) {
+			cf_warning(AS_RW, "repl-write drops: failed msg get");
+			return;
+		}
+
+		msg_set_uint32(m, RW_FIELD_OP, RW_OP_DROPS);
+		msg_set_buf(m, RW_FIELD_NAMESPACE, (uint8_t*)ns->name,
+				strlen(ns->name), MSG_SET_COPY);
+		msg_set_uint32(m, RW_FIELD_NS_ID, ns->id);
+		msg_set_buf(m, RW_FIELD_DIGEST, (const uint8_t*)keyds,
+				n_keyds * sizeof(cf_digest), MSG_SET_COPY);
+
+		if (as_fabric_send(nodes[n], m, AS_FABRIC_CHANNEL_RW) !=
+				AS_FABRIC_SUCCESS) {
+			as_fabric_msg_put(m);
+		}
+	}
+}
+
+
+void
+repl_write_handle_drops(cf_node node, msg* m)
+{
+	uint8_t* ns_name;
+	size_t ns_name_len;
+
+	if (msg_get_buf(m, RW_FIELD_NAMESPACE, &ns_name, &ns_name_len,
+			MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_RW, "repl-write drops: no namespace");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	as_namespace* ns = as_namespace_get_bybuf(ns_name, ns_name_len);
+
+	if (! ns) {
+		cf_warning(AS_RW, "repl-write drops: invalid namespace");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	cf_digest* keyds;
+	size_t keyds_sz;
+
+	if (msg_get_buf(m, RW_FIELD_DIGEST, (uint8_t**)&keyds, &keyds_sz,
+			MSG_GET_DIRECT) != 0 || keyds_sz == 0 ||
+			keyds_sz % sizeof(cf_digest) != 0) {
+		cf_warning(AS_RW, "repl-write drops: no or bad digests");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	uint32_t n_keyds = (uint32_t)(keyds_sz / sizeof(cf_digest));
+
+	// A batch comes from one partition - reserve once.
+	as_partition_reservation rsv;
+
+	if (as_partition_reserve_replica(ns, as_partition_getid(&keyds[0]),
+			&rsv) == AS_PROTO_RESULT_OK) {
+		for (uint32_t i = 0; i < n_keyds; i++) {
+			drop_replica(&rsv, &keyds[i], false, false, node);
+		}
+
+		as_partition_release(&rsv);
+	}
+
+	as_fabric_msg_put(m);
+}
+
+
 //==========================================================
 // Local helpers.
 //
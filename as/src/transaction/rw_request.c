@@ -37,6 +37,7 @@
 
 #include "dynbuf.h"
 #include "fault.h"
+#include "obj_pool.h"
 
 #include "base/datamodel.h"
 #include "base/proto.h"
@@ -61,8 +62,7 @@ static cf_atomic32 g_rw_tid = 0;
 rw_request*
 rw_request_create(cf_digest* keyd)
 {
-	rw_request* rw = cf_rc_alloc(sizeof(rw_request));
-	cf_assert(rw, AS_RW, "alloc rw_request");
+	rw_request* rw = cf_pool_rc_alloc(sizeof(rw_request));
 
 	// as_transaction look-alike:
 	rw->msgp				= NULL;
@@ -170,7 +170,7 @@ rw_request_destroy(rw_request* rw)
 		e->tr.from_flags |= FROM_FLAG_RESTART;
 		as_tsvc_enqueue(&e->tr);
 
-		cf_free(e);
+		cf_pool_free(e);
 		e = next;
 	}
 }
@@ -179,8 +179,7 @@ rw_request_destroy(rw_request* rw)
 void
 rw_request_wait_q_push(rw_request* rw, as_transaction* tr)
 {
-	rw_wait_ele* e = cf_malloc(sizeof(rw_wait_ele));
-	cf_assert(e, AS_RW, "alloc rw_wait_ele");
+	rw_wait_ele* e = cf_pool_alloc(sizeof(rw_wait_ele));
 
 	as_transaction_copy_head(&e->tr, tr);
 	tr->from.any = NULL;
@@ -48,6 +48,7 @@
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
 #include "fabric/fabric.h"
+#include "fabric/partition.h"
 #include "transaction/duplicate_resolve.h"
 #include "transaction/replica_write.h"
 #include "transaction/rw_request.h"
@@ -85,18 +86,24 @@ COMPILER_ASSERT(sizeof(rw_mt) / sizeof(msg_template) == NUM_RW_FIELDS);
 
 #define RW_MSG_SCRATCH_SIZE 192
 
+// Shard by partition, to spread contention on each hash's element count and
+// keep each retransmit reduce short.
+#define N_RW_REQUEST_HASHES 64
+#define RW_REQUEST_HASH_N_BUCKETS (32 * 1024 / N_RW_REQUEST_HASHES)
+
 
 //==========================================================
 // Globals.
 //
 
-static cf_rchash* g_rw_request_hash = NULL;
+static cf_rchash* g_rw_request_hashes[N_RW_REQUEST_HASHES];
 
 
 //==========================================================
 // Forward declarations.
 //
 
+static inline cf_rchash* rw_request_hash_shard(const rw_request_hkey* hkey);
 uint32_t rw_request_hash_fn(const void* value, uint32_t value_len);
 transaction_status handle_hot_key(rw_request* rw0, as_transaction* tr);
 
@@ -114,9 +121,11 @@ int rw_msg_cb(cf_node id, msg* m, void* udata);
 void
 as_rw_init()
 {
-	cf_rchash_create(&g_rw_request_hash, rw_request_hash_fn,
-			rw_request_hdestroy, sizeof(rw_request_hkey), 32 * 1024,
-			CF_RCHASH_MANY_LOCK);
+	for (uint32_t i = 0; i < N_RW_REQUEST_HASHES; i++) {
+		cf_rchash_create(&g_rw_request_hashes[i], rw_request_hash_fn,
+				rw_request_hdestroy, sizeof(rw_request_hkey),
+				RW_REQUEST_HASH_N_BUCKETS, CF_RCHASH_MANY_LOCK);
+	}
 
 	pthread_t thread;
 	pthread_attr_t attrs;
@@ -136,7 +145,13 @@ as_rw_init()
 uint32_t
 rw_request_hash_count()
 {
-	return cf_rchash_get_size(g_rw_request_hash);
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < N_RW_REQUEST_HASHES; i++) {
+		count += cf_rchash_get_size(g_rw_request_hashes[i]);
+	}
+
+	return count;
 }
 
 
@@ -144,9 +159,10 @@ transaction_status
 rw_request_hash_insert(rw_request_hkey* hkey, rw_request* rw,
 		as_transaction* tr)
 {
+	cf_rchash* h = rw_request_hash_shard(hkey);
 	int insert_rv;
 
-	while ((insert_rv = cf_rchash_put_unique(g_rw_request_hash, hkey,
+	while ((insert_rv = cf_rchash_put_unique(h, hkey,
 			sizeof(*hkey), rw)) != CF_RCHASH_OK) {
 
 		if (insert_rv != CF_RCHASH_ERR_FOUND) {
@@ -156,7 +172,7 @@ rw_request_hash_insert(rw_request_hkey* hkey, rw_request* rw,
 		// else - rw_request with this digest already in hash - get it.
 
 		rw_request* rw0;
-		int get_rv = cf_rchash_get(g_rw_request_hash, hkey, sizeof(*hkey),
+		int get_rv = cf_rchash_get(h, hkey, sizeof(*hkey),
 				(void**)&rw0);
 
 		if (get_rv == CF_RCHASH_ERR_NOT_FOUND) {
@@ -183,7 +199,8 @@ rw_request_hash_insert(rw_request_hkey* hkey, rw_request* rw,
 void
 rw_request_hash_delete(rw_request_hkey* hkey, rw_request* rw)
 {
-	cf_rchash_delete_object(g_rw_request_hash, hkey, sizeof(*hkey), rw);
+	cf_rchash_delete_object(rw_request_hash_shard(hkey), hkey, sizeof(*hkey),
+			rw);
 }
 
 
@@ -192,7 +209,8 @@ rw_request_hash_get(rw_request_hkey* hkey)
 {
 	rw_request* rw = NULL;
 
-	cf_rchash_get(g_rw_request_hash, hkey, sizeof(*hkey), (void**)&rw);
+	cf_rchash_get(rw_request_hash_shard(hkey), hkey, sizeof(*hkey),
+			(void**)&rw);
 
 	return rw;
 }
@@ -211,6 +229,14 @@ rw_request_hash_dump()
 // Local helpers - hash insertion.
 //
 
+static inline cf_rchash*
+rw_request_hash_shard(const rw_request_hkey* hkey)
+{
+	return g_rw_request_hashes[
+			as_partition_getid(&hkey->keyd) % N_RW_REQUEST_HASHES];
+}
+
+
 uint32_t
 rw_request_hash_fn(const void* key, uint32_t key_size)
 {
@@ -235,7 +261,7 @@ handle_hot_key(rw_request* rw0, as_transaction* tr)
 	else if (g_config.transaction_pending_limit != 0 &&
 			rw0->wait_queue_depth > g_config.transaction_pending_limit) {
 		// If we're over the hot key pending limit, fail this transaction.
-		cf_atomic64_incr(&tr->rsv.ns->n_fail_key_busy);
+		cf_counter_incr(&tr->rsv.ns->n_fail_key_busy);
 		tr->result_code = AS_PROTO_RESULT_FAIL_KEY_BUSY;
 
 		return TRANS_DONE_ERROR;
@@ -265,7 +291,10 @@ run_retransmit(void* arg)
 		now.now_ns = cf_getns();
 		now.now_ms = now.now_ns / 1000000;
 
-		cf_rchash_reduce(g_rw_request_hash, retransmit_reduce_fn, &now);
+		for (uint32_t i = 0; i < N_RW_REQUEST_HASHES; i++) {
+			cf_rchash_reduce(g_rw_request_hashes[i], retransmit_reduce_fn,
+					&now);
+		}
 	}
 
 	return NULL;
@@ -418,6 +447,9 @@ rw_msg_cb(cf_node id, msg* m, void* udata)
 	case RW_OP_WRITE_ACK:
 		repl_write_handle_ack(id, m);
 		break;
+	case RW_OP_DROPS:
+		repl_write_handle_drops(id, m);
+		break;
 
 	default:
 		cf_warning(AS_RW, "got rw msg with unrecognized op %u", op);
@@ -132,7 +132,7 @@ get_msg_key(as_transaction* tr, as_storage_rd* rd)
 		return true;
 	}
 
-	as_msg_field* f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_KEY);
+	as_msg_field* f = as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_KEY);
 
 	if (rd->ns->single_bin && rd->ns->storage_data_in_memory) {
 		cf_warning(AS_RW, "{%s} can't store key if data-in-memory & single-bin",
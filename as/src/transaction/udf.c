@@ -49,15 +49,18 @@
 #include "dynbuf.h"
 #include "fault.h"
 
+#include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
+#include "base/stats.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
 #include "base/udf_aerospike.h"
 #include "base/udf_arglist.h"
 #include "base/udf_cask.h"
+#include "base/udf_native.h"
 #include "base/udf_record.h"
 #include "base/udf_timer.h"
 #include "fabric/partition.h"
@@ -166,6 +169,22 @@ udf_sub_udf_update_stats(as_namespace* ns, uint8_t result_code)
 	}
 }
 
+static inline void
+batch_sub_udf_update_stats(as_namespace* ns, uint8_t result_code)
+{
+	switch (result_code) {
+	case AS_PROTO_RESULT_OK:
+		cf_atomic64_incr(&ns->n_batch_sub_udf_complete);
+		break;
+	case AS_PROTO_RESULT_FAIL_TIMEOUT:
+		cf_atomic64_incr(&ns->n_batch_sub_udf_timeout);
+		break;
+	default:
+		cf_atomic64_incr(&ns->n_batch_sub_udf_error);
+		break;
+	}
+}
+
 static inline bool
 udf_zero_bins_left(udf_record* urecord)
 {
@@ -206,22 +225,22 @@ udf_def_init_from_msg(udf_def* def, const as_transaction* tr)
 {
 	def->arglist = NULL;
 
-	as_msg* m = &tr->msgp->msg;
 	as_msg_field* filename =
-			as_msg_field_get(m, AS_MSG_FIELD_TYPE_UDF_FILENAME);
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_UDF_FILENAME);
 
 	if (! filename) {
 		return NULL;
 	}
 
 	as_msg_field* function =
-			as_msg_field_get(m, AS_MSG_FIELD_TYPE_UDF_FUNCTION);
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_UDF_FUNCTION);
 
 	if (! function) {
 		return NULL;
 	}
 
-	as_msg_field* arglist = as_msg_field_get(m, AS_MSG_FIELD_TYPE_UDF_ARGLIST);
+	as_msg_field* arglist = as_transaction_field_get(tr,
+			AS_MSG_FIELD_TYPE_UDF_ARGLIST);
 
 	if (! arglist) {
 		return NULL;
@@ -246,7 +265,7 @@ udf_def_init_from_msg(udf_def* def, const as_transaction* tr)
 	}
 
 	as_msg_field* op = as_transaction_has_udf_op(tr) ?
-			as_msg_field_get(m, AS_MSG_FIELD_TYPE_UDF_OP) : NULL;
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_UDF_OP) : NULL;
 
 	def->type = op ? *op->data : AS_UDF_OP_KVS;
 
@@ -555,6 +574,10 @@ send_udf_response(as_transaction* tr, cf_dyn_buf* db)
 		BENCHMARK_NEXT_DATA_POINT(tr, udf_sub, response);
 		udf_sub_udf_update_stats(tr->rsv.ns, tr->result_code);
 		break;
+	case FROM_BATCH:
+		as_batch_add_made_result(tr, db);
+		batch_sub_udf_update_stats(tr->rsv.ns, tr->result_code);
+		break;
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", tr->origin);
 		break;
@@ -586,6 +609,12 @@ udf_timeout_cb(rw_request* rw)
 		// Timeouts aren't included in histograms.
 		udf_sub_udf_update_stats(rw->rsv.ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
 		break;
+	case FROM_BATCH:
+		as_batch_add_error(rw->from.batch_shared, rw->from_data.batch_index,
+				AS_PROTO_RESULT_FAIL_TIMEOUT);
+		// Timeouts aren't included in histograms.
+		batch_sub_udf_update_stats(rw->rsv.ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		break;
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", rw->origin);
 		break;
@@ -677,6 +706,22 @@ udf_master_apply(udf_call* call, rw_request* rw)
 	if (get_rv == 0) {
 		urecord.flag |= (UDF_RECORD_FLAG_OPEN | UDF_RECORD_FLAG_PREEXISTS);
 
+		// The record may have changed since the scan or query matched it -
+		// recheck metadata before reading it.
+		if (tr->origin == FROM_IUDF && tr->from.iudf_orig->predexp) {
+			predexp_args_t predargs = {
+					.ns = ns, .md = r_ref.r, .vl = NULL, .rd = NULL
+			};
+
+			if (! predexp_matches_metadata(tr->from.iudf_orig->predexp,
+					&predargs)) {
+				udf_record_close(&urecord);
+				tr->result_code = AS_PROTO_RESULT_FAIL_NOT_FOUND; // not ideal
+				process_failure(call, NULL, &rw->response_db);
+				return UDF_OPTYPE_NONE;
+			}
+		}
+
 		if (udf_storage_record_open(&urecord) != 0) {
 			udf_record_close(&urecord);
 			tr->result_code = AS_PROTO_RESULT_FAIL_BIN_NAME; // overloaded... add bin_count error?
@@ -684,7 +729,8 @@ udf_master_apply(udf_call* call, rw_request* rw)
 			return UDF_OPTYPE_NONE;
 		}
 
-		if (tr->origin == FROM_IUDF && tr->from.iudf_orig->predexp) {
+		if (tr->origin == FROM_IUDF &&
+				predexp_needs_record(tr->from.iudf_orig->predexp)) {
 			predexp_args_t predargs = {
 					.ns = ns, .md = r_ref.r, .vl = NULL, .rd = &rd
 			};
@@ -786,8 +832,21 @@ udf_apply_record(udf_call* call, as_rec* rec, as_result* result)
 		.memtracker	= NULL
 	};
 
-	int apply_rv = as_module_apply_record(&mod_lua, &ctx, call->def->filename,
-			call->def->function, rec, call->def->arglist, result);
+	// Peak concurrency is how many Lua states mod-lua must cache to avoid
+	// creating (and compiling a module into) a state on the fly.
+	int64_t n_in_flight = cf_atomic64_incr(&g_stats.udf_lua_in_flight);
+
+	cf_atomic64_setmax(&g_stats.udf_lua_in_flight_max, n_in_flight);
+
+	udf_native_fn native_fn = udf_native_get(call->def->filename,
+			call->def->function);
+
+	int apply_rv = native_fn ?
+			native_fn(rec, call->def->arglist, result, &timer) :
+			as_module_apply_record(&mod_lua, &ctx, call->def->filename,
+					call->def->function, rec, call->def->arglist, result);
+
+	cf_atomic64_decr(&g_stats.udf_lua_in_flight);
 
 	udf_timer_cleanup();
 
@@ -915,6 +974,15 @@ udf_post_processing(udf_record* urecord, rw_request* rw, udf_optype urecord_op)
 	// Close the record for all the cases.
 	udf_record_close(urecord);
 
+	if (urecord_op == UDF_OPTYPE_WRITE) {
+		as_cdc_write(tr->rsv.ns, tr->rsv.p->id, &tr->keyd, generation,
+				tr->last_update_time, AS_CDC_OP_WRITE);
+	}
+	else if (urecord_op == UDF_OPTYPE_DELETE) {
+		as_cdc_write(tr->rsv.ns, tr->rsv.p->id, &tr->keyd, 0,
+				cf_clepoch_milliseconds(), AS_CDC_OP_DELETE);
+	}
+
 	// Write to XDR pipe.
 	if (urecord_op == UDF_OPTYPE_WRITE) {
 		xdr_write(tr->rsv.ns, &tr->keyd, generation, 0, XDR_OP_TYPE_WRITE,
@@ -956,6 +1024,7 @@ update_lua_complete_stats(uint8_t origin, as_namespace* ns, udf_optype op,
 		}
 		break;
 	case FROM_PROXY:
+	case FROM_BATCH:
 		// TODO?
 		break;
 	case FROM_IUDF:
@@ -977,7 +1046,6 @@ update_lua_complete_stats(uint8_t origin, as_namespace* ns, udf_optype op,
 			cf_atomic_int_incr(&ns->n_udf_sub_lang_error);
 		}
 		break;
-	case FROM_BATCH:
 	case FROM_NSUP:
 	default:
 		cf_crash(AS_UDF, "unexpected transaction origin %u", origin);
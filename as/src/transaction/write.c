@@ -38,6 +38,8 @@
 #include "dynbuf.h"
 #include "fault.h"
 
+#include "base/as_stap.h"
+#include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
@@ -62,6 +64,14 @@
 //
 
 #define STACK_PARTICLES_SIZE (1024 * 1024)
+#define STACK_RESULTS_SIZE (16 * 1024)
+
+// An append done in place, in the existing particle - unwinding restores the
+// value's old size.
+typedef struct append_undo_s {
+	as_bin bin;
+	uint32_t old_sz;
+} append_undo;
 
 
 //==========================================================
@@ -105,15 +115,17 @@ void write_master_update_index_metadata(as_transaction* tr,
 		bool increment_generation, index_metadata* old, as_record* r);
 int write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 		cf_ll_buf* particles_llb, as_bin* cleanup_bins,
-		uint32_t* p_n_cleanup_bins, cf_dyn_buf* db, uint32_t* p_n_final_bins,
-		xdr_dirty_bins* dirty_bins);
+		uint32_t* p_n_cleanup_bins, append_undo* undos, uint32_t* p_n_undos,
+		cf_dyn_buf* db, uint32_t* p_n_final_bins, xdr_dirty_bins* dirty_bins);
 int write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 		as_msg_op** ops, as_bin* response_bins, uint32_t* p_n_response_bins,
 		as_bin* result_bins, uint32_t* p_n_result_bins,
-		cf_ll_buf* particles_llb, as_bin* cleanup_bins,
-		uint32_t* p_n_cleanup_bins, xdr_dirty_bins* dirty_bins);
+		cf_ll_buf* particles_llb, cf_ll_buf* results_llb,
+		as_bin* cleanup_bins, uint32_t* p_n_cleanup_bins,
+		append_undo* undos, uint32_t* p_n_undos, xdr_dirty_bins* dirty_bins);
 
 void write_master_index_metadata_unwind(index_metadata* old, as_record* r);
+void write_master_append_unwind(append_undo* undos, uint32_t n_undos);
 void write_master_dim_single_bin_unwind(as_bin* old_bin, as_bin* new_bin,
 		as_bin* cleanup_bins, uint32_t n_cleanup_bins);
 void write_master_dim_unwind(as_bin* old_bins, uint32_t n_old_bins,
@@ -130,19 +142,19 @@ client_write_update_stats(as_namespace* ns, uint8_t result_code, bool is_xdr_op)
 {
 	switch (result_code) {
 	case AS_PROTO_RESULT_OK:
-		cf_atomic64_incr(&ns->n_client_write_success);
+		cf_counter_incr(&ns->n_client_write_success);
 		if (is_xdr_op) {
 			cf_atomic64_incr(&ns->n_xdr_write_success);
 		}
 		break;
 	case AS_PROTO_RESULT_FAIL_TIMEOUT:
-		cf_atomic64_incr(&ns->n_client_write_timeout);
+		cf_counter_incr(&ns->n_client_write_timeout);
 		if (is_xdr_op) {
 			cf_atomic64_incr(&ns->n_xdr_write_timeout);
 		}
 		break;
 	default:
-		cf_atomic64_incr(&ns->n_client_write_error);
+		cf_counter_incr(&ns->n_client_write_error);
 		if (is_xdr_op) {
 			cf_atomic64_incr(&ns->n_xdr_write_error);
 		}
@@ -150,6 +162,22 @@ client_write_update_stats(as_namespace* ns, uint8_t result_code, bool is_xdr_op)
 	}
 }
 
+static inline void
+batch_sub_write_update_stats(as_namespace* ns, uint8_t result_code)
+{
+	switch (result_code) {
+	case AS_PROTO_RESULT_OK:
+		cf_atomic64_incr(&ns->n_batch_sub_write_success);
+		break;
+	case AS_PROTO_RESULT_FAIL_TIMEOUT:
+		cf_atomic64_incr(&ns->n_batch_sub_write_timeout);
+		break;
+	default:
+		cf_atomic64_incr(&ns->n_batch_sub_write_error);
+		break;
+	}
+}
+
 static inline void
 append_bin_to_destroy(as_bin* b, as_bin* bins, uint32_t* p_n_bins)
 {
@@ -217,8 +245,13 @@ as_write_start(as_transaction* tr)
 	rw->n_dest_nodes = as_partition_get_other_replicas(tr->rsv.p,
 			rw->dest_nodes);
 
+	ASD_TRANS_WRITE_STARTING(g_config.self_node, as_transaction_trid(tr));
+
 	status = write_master(rw, tr);
 
+	ASD_TRANS_WRITE_FINISHED(g_config.self_node, as_transaction_trid(tr),
+			(uint32_t)tr->result_code);
+
 	BENCHMARK_NEXT_DATA_POINT(tr, write, master);
 
 	// If error, transaction is finished.
@@ -425,6 +458,10 @@ send_write_response(as_transaction* tr, cf_dyn_buf* db)
 					0, tr->rsv.ns, as_transaction_trid(tr));
 		}
 		break;
+	case FROM_BATCH:
+		as_batch_add_made_result(tr, db);
+		batch_sub_write_update_stats(tr->rsv.ns, tr->result_code);
+		break;
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", tr->origin);
 		break;
@@ -451,6 +488,12 @@ write_timeout_cb(rw_request* rw)
 		break;
 	case FROM_PROXY:
 		break;
+	case FROM_BATCH:
+		as_batch_add_error(rw->from.batch_shared, rw->from_data.batch_index,
+				AS_PROTO_RESULT_FAIL_TIMEOUT);
+		// Timeouts aren't included in histograms.
+		batch_sub_write_update_stats(rw->rsv.ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		break;
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", rw->origin);
 		break;
@@ -545,6 +588,8 @@ write_master(rw_request* rw, as_transaction* tr)
 		}
 	}
 
+	r->accessed = 1;
+
 	// Enforce record-level create-only existence policy.
 	if (! record_created && ! create_only_check(r, m)) {
 		write_master_failed(tr, &r_ref, record_created, tree, 0, AS_PROTO_RESULT_FAIL_RECORD_EXISTS);
@@ -572,6 +617,8 @@ write_master(rw_request* rw, as_transaction* tr)
 			return TRANS_DONE_ERROR;
 		}
 
+		as_index_set_list_add(tree, &r_ref);
+
 		// Don't write record if it would be truncated.
 		if (as_truncate_now_is_truncated(ns, as_index_get_set_id(r))) {
 			write_master_failed(tr, &r_ref, record_created, tree, 0, AS_PROTO_RESULT_FAIL_FORBIDDEN);
@@ -701,6 +748,10 @@ write_master(rw_request* rw, as_transaction* tr)
 	as_storage_record_close(&rd);
 	as_record_done(&r_ref, ns);
 
+	as_cdc_write(ns, tr->rsv.p->id, &tr->keyd, generation,
+			is_delete ? cf_clepoch_milliseconds() : tr->last_update_time,
+			is_delete ? AS_CDC_OP_DELETE : AS_CDC_OP_WRITE);
+
 	// Don't send an XDR delete if it's disallowed.
 	if (is_delete && ! is_xdr_delete_shipping_enabled()) {
 		return TRANS_IN_PROGRESS;
@@ -777,7 +828,7 @@ write_master_preprocessing(as_transaction* tr)
 	// Fail if disallow_null_setname is true and set name is absent or empty.
 	if (ns->disallow_null_setname) {
 		as_msg_field* f = as_transaction_has_set(tr) ?
-				as_msg_field_get(m, AS_MSG_FIELD_TYPE_SET) : NULL;
+				as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET) : NULL;
 
 		if (! f || as_msg_field_get_value_sz(f) == 0) {
 			cf_warning(AS_RW, "write_master: null/empty set name not allowed for namespace %s", ns->name);
@@ -902,6 +953,30 @@ write_master_policies(as_transaction* tr, bool* p_must_not_create,
 			generates_response_bin = true;
 			must_fetch_data = true;
 		}
+		else if (OP_IS_HLL_MODIFY(op->op)) {
+			if (record_level_replace) {
+				cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: hll modify op can't have record-level replace flag ", ns->name);
+				return AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			must_fetch_data = true;
+		}
+		else if (op->op == AS_MSG_OP_HLL_COUNT) {
+			generates_response_bin = true;
+			must_fetch_data = true;
+		}
+		else if (op->op == AS_MSG_OP_BITS_MODIFY) {
+			if (record_level_replace) {
+				cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: bits modify op can't have record-level replace flag ", ns->name);
+				return AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			must_fetch_data = true;
+		}
+		else if (op->op == AS_MSG_OP_BITS_READ) {
+			generates_response_bin = true;
+			must_fetch_data = true;
+		}
 	}
 
 	if (has_read_all_op && generates_response_bin) {
@@ -927,7 +1002,7 @@ bool
 check_msg_set_name(as_transaction* tr, const char* set_name)
 {
 	as_msg_field* f = as_transaction_has_set(tr) ?
-			as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_SET) : NULL;
+			as_transaction_field_get(tr, AS_MSG_FIELD_TYPE_SET) : NULL;
 
 	if (! f || as_msg_field_get_value_sz(f) == 0) {
 		if (set_name) {
@@ -1001,6 +1076,10 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 	as_bin cleanup_bins[m->n_ops];
 	uint32_t n_cleanup_bins = 0;
 
+	// Collect appends done in place, to undo on unwind.
+	append_undo undos[m->n_ops];
+	uint32_t n_undos = 0;
+
 	//------------------------------------------------------
 	// Apply changes to metadata in as_index needed for
 	// response, pickling, and writing.
@@ -1017,10 +1096,12 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 
 	uint32_t n_new_bins = 0;
 	int result = write_master_bin_ops(tr, rd, NULL, cleanup_bins,
-			&n_cleanup_bins, &rw->response_db, &n_new_bins, dirty_bins);
+			&n_cleanup_bins, undos, &n_undos, &rw->response_db, &n_new_bins,
+			dirty_bins);
 
 	if (result != 0) {
 		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_append_unwind(undos, n_undos);
 		write_master_dim_single_bin_unwind(&old_bin, rd->bins, cleanup_bins, n_cleanup_bins);
 		return result;
 	}
@@ -1032,6 +1113,7 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 	if (n_new_bins == 0) {
 		if (n_old_bins == 0) {
 			write_master_index_metadata_unwind(&old_metadata, r);
+			write_master_append_unwind(undos, n_undos);
 			write_master_dim_single_bin_unwind(&old_bin, rd->bins, cleanup_bins, n_cleanup_bins);
 			return AS_PROTO_RESULT_FAIL_NOT_FOUND;
 		}
@@ -1049,6 +1131,7 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 	if ((result = as_storage_record_write(rd)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_record_write() ", ns->name);
 		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_append_unwind(undos, n_undos);
 		write_master_dim_single_bin_unwind(&old_bin, rd->bins, cleanup_bins, n_cleanup_bins);
 		return -result;
 	}
@@ -1118,6 +1201,14 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	as_bin cleanup_bins[m->n_ops];
 	uint32_t n_cleanup_bins = 0;
 
+	// Collect appends done in place, to undo on unwind. Not with contiguous
+	// records - particles live in the bin space - or with a sindex, which must
+	// see the old values.
+	append_undo undos[m->n_ops];
+	uint32_t n_undos = 0;
+	bool can_append_in_place = ! ns->contiguous_records &&
+			! record_has_sindex(r, ns);
+
 	//------------------------------------------------------
 	// Apply changes to metadata in as_index needed for
 	// response, pickling, and writing.
@@ -1133,10 +1224,12 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	//
 
 	int result = write_master_bin_ops(tr, rd, NULL, cleanup_bins,
-			&n_cleanup_bins, &rw->response_db, &n_new_bins, dirty_bins);
+			&n_cleanup_bins, can_append_in_place ? undos : NULL, &n_undos,
+			&rw->response_db, &n_new_bins, dirty_bins);
 
 	if (result != 0) {
 		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_append_unwind(undos, n_undos);
 		write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 		return result;
 	}
@@ -1145,19 +1238,30 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	// Created the new bins to write.
 	//
 
+	as_bin_space* old_bin_space = as_index_get_bin_space(r);
 	as_bin_space* new_bin_space = NULL;
 
 	// Adjust - the actual number of new bins.
 	rd->n_bins = n_new_bins;
 
-	if (n_new_bins != 0) {
+	if (n_new_bins != 0 && ns->contiguous_records) {
+		// Packed after cleanup, when the final particles are known.
 		new_bins_size = n_new_bins * sizeof(as_bin);
-		new_bin_space = (as_bin_space*)
-				cf_malloc_ns(sizeof(as_bin_space) + new_bins_size);
+	}
+	else if (n_new_bins != 0) {
+		new_bins_size = n_new_bins * sizeof(as_bin);
+
+		// Same number of bins (e.g. counter updates) - reuse the existing
+		// as_bin_space. Not touched until we can no longer unwind.
+		new_bin_space = old_bin_space && n_new_bins == n_old_bins ?
+				old_bin_space :
+				(as_bin_space*)cf_malloc_ns(sizeof(as_bin_space) +
+						new_bins_size);
 
 		if (! new_bin_space) {
 			cf_warning(AS_RW, "write_master: failed alloc new as_bin_space");
 			write_master_index_metadata_unwind(&old_metadata, r);
+			write_master_append_unwind(undos, n_undos);
 			write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 			return AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
@@ -1165,6 +1269,7 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	else {
 		if (n_old_bins == 0) {
 			write_master_index_metadata_unwind(&old_metadata, r);
+			write_master_append_unwind(undos, n_undos);
 			write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 			return AS_PROTO_RESULT_FAIL_NOT_FOUND;
 		}
@@ -1182,11 +1287,12 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	if ((result = as_storage_record_write(rd)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_record_write() ", ns->name);
 
-		if (new_bin_space) {
+		if (new_bin_space && new_bin_space != old_bin_space) {
 			cf_free(new_bin_space);
 		}
 
 		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_append_unwind(undos, n_undos);
 		write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 		return -result;
 	}
@@ -1216,20 +1322,23 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	//
 
 	// Fill out new_bin_space.
-	if (n_new_bins != 0) {
+	if (n_new_bins != 0 && ns->contiguous_records) {
+		new_bin_space = as_bin_space_pack(new_bins, n_new_bins);
+	}
+	else if (n_new_bins != 0) {
 		new_bin_space->n_bins = rd->n_bins;
 		memcpy((void*)new_bin_space->bins, new_bins, new_bins_size);
 	}
 
-	// Swizzle the index element's as_bin_space pointer.
-	as_bin_space* old_bin_space = as_index_get_bin_space(r);
+	// Swizzle the index element's as_bin_space pointer, unless reused.
+	if (new_bin_space != old_bin_space) {
+		if (old_bin_space) {
+			cf_free(old_bin_space);
+		}
 
-	if (old_bin_space) {
-		cf_free(old_bin_space);
+		as_index_set_bin_space(r, new_bin_space);
 	}
 
-	as_index_set_bin_space(r, new_bin_space);
-
 	// Accommodate a new stored key - wasn't needed for pickling and writing.
 	if (r->key_stored == 0 && rd->key) {
 		as_record_allocate_key(r, rd->key, rd->key_size);
@@ -1291,7 +1400,7 @@ write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 	uint32_t n_new_bins = 0;
 
 	if ((result = write_master_bin_ops(tr, rd, &particles_llb, NULL, NULL,
-			&rw->response_db, &n_new_bins, dirty_bins)) != 0) {
+			NULL, NULL, &rw->response_db, &n_new_bins, dirty_bins)) != 0) {
 		cf_ll_buf_free(&particles_llb);
 		write_master_index_metadata_unwind(&old_metadata, r);
 		return result;
@@ -1422,7 +1531,7 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	cf_ll_buf_define(particles_llb, STACK_PARTICLES_SIZE);
 
 	if ((result = write_master_bin_ops(tr, rd, &particles_llb, NULL, NULL,
-			&rw->response_db, &n_new_bins, dirty_bins)) != 0) {
+			NULL, NULL, &rw->response_db, &n_new_bins, dirty_bins)) != 0) {
 		cf_ll_buf_free(&particles_llb);
 		write_master_index_metadata_unwind(&old_metadata, r);
 		return result;
@@ -1503,8 +1612,8 @@ write_master_update_index_metadata(as_transaction* tr,
 int
 write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 		cf_ll_buf* particles_llb, as_bin* cleanup_bins,
-		uint32_t* p_n_cleanup_bins, cf_dyn_buf* db, uint32_t* p_n_final_bins,
-		xdr_dirty_bins* dirty_bins)
+		uint32_t* p_n_cleanup_bins, append_undo* undos, uint32_t* p_n_undos,
+		cf_dyn_buf* db, uint32_t* p_n_final_bins, xdr_dirty_bins* dirty_bins)
 {
 	// Shortcut pointers.
 	as_msg* m = &tr->msgp->msg;
@@ -1519,12 +1628,17 @@ write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 	uint32_t n_response_bins = 0;
 	uint32_t n_result_bins = 0;
 
+	// CDT op results only need to live until the response is built.
+	cf_ll_buf_define(results_llb, STACK_RESULTS_SIZE);
+
 	int result = write_master_bin_ops_loop(tr, rd, ops, response_bins,
 			&n_response_bins, result_bins, &n_result_bins, particles_llb,
-			cleanup_bins, p_n_cleanup_bins, dirty_bins);
+			&results_llb, cleanup_bins, p_n_cleanup_bins, undos, p_n_undos,
+			dirty_bins);
 
 	if (result != 0) {
 		destroy_stack_bins(result_bins, n_result_bins);
+		cf_ll_buf_free(&results_llb);
 		return result;
 	}
 
@@ -1533,6 +1647,7 @@ write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 	if (n_response_bins == 0) {
 		// If 'ordered-ops' flag was not set, and there were no read ops or CDT
 		// ops with results, there's no response to build and send later.
+		cf_ll_buf_free(&results_llb);
 		return 0;
 	}
 
@@ -1560,6 +1675,7 @@ write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 			as_transaction_trid(tr));
 
 	destroy_stack_bins(result_bins, n_result_bins);
+	cf_ll_buf_free(&results_llb);
 
 	// Stash the message, to be sent later.
 	db->buf = msgp;
@@ -1575,8 +1691,9 @@ int
 write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 		as_msg_op** ops, as_bin* response_bins, uint32_t* p_n_response_bins,
 		as_bin* result_bins, uint32_t* p_n_result_bins,
-		cf_ll_buf* particles_llb, as_bin* cleanup_bins,
-		uint32_t* p_n_cleanup_bins, xdr_dirty_bins* dirty_bins)
+		cf_ll_buf* particles_llb, cf_ll_buf* results_llb,
+		as_bin* cleanup_bins, uint32_t* p_n_cleanup_bins,
+		append_undo* undos, uint32_t* p_n_undos, xdr_dirty_bins* dirty_bins)
 {
 	// Shortcut pointers.
 	as_msg* m = &tr->msgp->msg;
@@ -1588,11 +1705,23 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 	as_msg_op* op = NULL;
 	int i = 0;
 
+	// Particle made by the previous op, if it was a data-in-memory CDT modify.
+	as_particle* fresh_cdt_particle = NULL;
+
+	// Particle made or changed by the previous op, if it was a bits modify.
+	as_particle* fresh_bits_particle = NULL;
+
 	while ((op = as_msg_op_iterate(m, op, &i)) != NULL) {
 		if (OP_IS_TOUCH(op->op)) {
 			continue;
 		}
 
+		as_particle* prev_cdt_particle = fresh_cdt_particle;
+		as_particle* prev_bits_particle = fresh_bits_particle;
+
+		fresh_cdt_particle = NULL;
+		fresh_bits_particle = NULL;
+
 		if (op->op == AS_MSG_OP_WRITE) {
 			// AS_PARTICLE_TYPE_NULL means delete the bin.
 			// TODO - should this even be allowed for single-bin?
@@ -1655,7 +1784,22 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				return result;
 			}
 
-			if (ns->storage_data_in_memory) {
+			uint32_t old_sz;
+
+			// Append into the existing particle's slack if it has room. Not
+			// once a response refers to a particle - it may be this one.
+			if (ns->storage_data_in_memory && undos != NULL &&
+					op->op == AS_MSG_OP_APPEND && *p_n_response_bins == 0 &&
+					(result = as_bin_particle_append_in_place(b, op, &old_sz)) != 0) {
+				if (result < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_particle_append_in_place() ", ns->name);
+					return -result;
+				}
+
+				as_bin_copy(ns, &undos[*p_n_undos].bin, b);
+				undos[(*p_n_undos)++].old_sz = old_sz;
+			}
+			else if (ns->storage_data_in_memory) {
 				as_bin cleanup_bin;
 				as_bin_copy(ns, &cleanup_bin, b);
 
@@ -1718,7 +1862,7 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				as_bin cleanup_bin;
 				as_bin_copy(ns, &cleanup_bin, b);
 
-				if ((result = as_bin_cdt_alloc_modify_from_client(b, op, &result_bin)) < 0) {
+				if ((result = as_bin_cdt_alloc_modify_from_client(b, op, &result_bin, results_llb)) < 0) {
 					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_cdt_alloc_modify_from_client() ", ns->name);
 					return -result;
 				}
@@ -1726,11 +1870,24 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				// Account for noop CDT operations. Modifying non-mutable
 				// particle contents in-place is still disallowed.
 				if (cleanup_bin.particle != b->particle) {
-					append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+					// Consecutive CDT ops on a bin - nothing else can refer to
+					// the intermediate particle, so free it now, and the next
+					// op can reuse its memory.
+					if (prev_cdt_particle != NULL &&
+							cleanup_bin.particle == prev_cdt_particle) {
+						as_bin_particle_destroy(&cleanup_bin, true);
+					}
+					else {
+						append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+					}
+
+					if (as_bin_is_external_particle(b)) {
+						fresh_cdt_particle = b->particle;
+					}
 				}
 			}
 			else {
-				if ((result = as_bin_cdt_stack_modify_from_client(b, particles_llb, op, &result_bin)) < 0) {
+				if ((result = as_bin_cdt_stack_modify_from_client(b, particles_llb, op, &result_bin, results_llb)) < 0) {
 					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_cdt_stack_modify_from_client() ", ns->name);
 					return -result;
 				}
@@ -1739,7 +1896,10 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 			if (respond_all_ops || as_bin_inuse(&result_bin)) {
 				ops[*p_n_response_bins] = op;
 				response_bins[(*p_n_response_bins)++] = result_bin;
-				append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+
+				if (! cf_ll_buf_owns(results_llb, result_bin.particle)) {
+					append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+				}
 			}
 
 			if (! as_bin_inuse(b)) {
@@ -1776,6 +1936,130 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
 			}
 		}
+		else if (OP_IS_HLL_MODIFY(op->op)) {
+			as_bin* b = as_bin_get_or_create_from_buf(rd, op->name, op->name_sz, &result);
+
+			if (! b) {
+				return result;
+			}
+
+			if (ns->storage_data_in_memory) {
+				as_bin cleanup_bin;
+				as_bin_copy(ns, &cleanup_bin, b);
+
+				if ((result = as_bin_hll_alloc_modify_from_client(b, op)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_hll_alloc_modify_from_client() ", ns->name);
+					return -result;
+				}
+
+				// An op that raises no register leaves the particle in place.
+				if (cleanup_bin.particle != b->particle) {
+					append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+				}
+			}
+			else {
+				if ((result = as_bin_hll_stack_modify_from_client(b, particles_llb, op)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_hll_stack_modify_from_client() ", ns->name);
+					return -result;
+				}
+			}
+
+			xdr_add_dirty_bin(ns, dirty_bins, (const char*)op->name, op->name_sz);
+
+			if (respond_all_ops) {
+				ops[*p_n_response_bins] = op;
+				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
+			}
+		}
+		else if (op->op == AS_MSG_OP_BITS_MODIFY) {
+			as_bin* b = as_bin_get_or_create_from_buf(rd, op->name, op->name_sz, &result);
+
+			if (! b) {
+				return result;
+			}
+
+			// Consecutive bits ops on a bin - nothing else can refer to the
+			// particle the previous op made, so change it in place.
+			bool in_place = prev_bits_particle != NULL &&
+					b->particle == prev_bits_particle;
+
+			if (ns->storage_data_in_memory) {
+				as_bin cleanup_bin;
+				as_bin_copy(ns, &cleanup_bin, b);
+
+				if ((result = as_bin_bits_alloc_modify_from_client(b, op, in_place)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_bits_alloc_modify_from_client() ", ns->name);
+					return -result;
+				}
+
+				if (cleanup_bin.particle != b->particle) {
+					if (in_place) {
+						// Outgrown intermediate particle - free it now.
+						as_bin_particle_destroy(&cleanup_bin, true);
+					}
+					else {
+						append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+					}
+				}
+			}
+			else {
+				if ((result = as_bin_bits_stack_modify_from_client(b, particles_llb, op, in_place)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_bits_stack_modify_from_client() ", ns->name);
+					return -result;
+				}
+			}
+
+			fresh_bits_particle = b->particle;
+
+			xdr_add_dirty_bin(ns, dirty_bins, (const char*)op->name, op->name_sz);
+
+			if (respond_all_ops) {
+				ops[*p_n_response_bins] = op;
+				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
+			}
+		}
+		else if (op->op == AS_MSG_OP_BITS_READ) {
+			as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
+
+			if (b) {
+				as_bin result_bin;
+				as_bin_set_empty(&result_bin);
+
+				if ((result = as_bin_bits_read_from_client(b, op, &result_bin)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_bits_read_from_client() ", ns->name);
+					return -result;
+				}
+
+				ops[*p_n_response_bins] = op;
+				response_bins[(*p_n_response_bins)++] = result_bin;
+				append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+			}
+			else if (respond_all_ops) {
+				ops[*p_n_response_bins] = op;
+				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
+			}
+		}
+		else if (op->op == AS_MSG_OP_HLL_COUNT) {
+			as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
+
+			if (b) {
+				as_bin result_bin;
+				as_bin_set_empty(&result_bin);
+
+				if ((result = as_bin_hll_read_from_client(b, op, &result_bin)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_hll_read_from_client() ", ns->name);
+					return -result;
+				}
+
+				// Integer result - nothing to destroy.
+				ops[*p_n_response_bins] = op;
+				response_bins[(*p_n_response_bins)++] = result_bin;
+			}
+			else if (respond_all_ops) {
+				ops[*p_n_response_bins] = op;
+				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
+			}
+		}
 		else {
 			cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: unknown bin op %u ", ns->name, op->op);
 			return AS_PROTO_RESULT_FAIL_PARAMETER;
@@ -1799,6 +2083,16 @@ write_master_index_metadata_unwind(index_metadata* old, as_record* r)
 }
 
 
+void
+write_master_append_unwind(append_undo* undos, uint32_t n_undos)
+{
+	// Newest first - the oldest undo of a particle has its original size.
+	for (int32_t i = (int32_t)n_undos - 1; i >= 0; i--) {
+		as_bin_particle_append_unwind(&undos[i].bin, undos[i].old_sz);
+	}
+}
+
+
 void
 write_master_dim_single_bin_unwind(as_bin* old_bin, as_bin* new_bin,
 		as_bin* cleanup_bins, uint32_t n_cleanup_bins)
@@ -43,6 +43,9 @@
 
 #define CF_ARENAX_BIGLOCK	(1 << 0)
 #define CF_ARENAX_CALLOC	(1 << 1)
+#define CF_ARENAX_HUGE_PAGES	(1 << 2) // back stages by huge pages if possible
+#define CF_ARENAX_INTERLEAVE	(1 << 3) // spread stages across NUMA nodes
+#define CF_ARENAX_THREAD_CACHE	(1 << 4) // per-thread free element caches
 
 #ifndef CF_ARENAX_MAX_STAGES
 #define CF_ARENAX_MAX_STAGES 256
@@ -89,6 +92,11 @@ typedef struct cf_arenax_s {
 	uint32_t			at_stage_id;
 	uint32_t			at_element_id;
 
+	// Compaction - stages from fence_stage_id on are being emptied (0 if not
+	// compacting). Thread caches give back their elements when epoch changes.
+	uint32_t			fence_stage_id;
+	uint32_t			epoch;
+
 	// Thread Safety
 	pthread_mutex_t		lock;
 
@@ -103,6 +111,11 @@ typedef struct free_element_s {
 } free_element;
 
 #define FREE_MAGIC 0xff1234ff
+#define RETIRED_MAGIC 0xff4321ff // free, but in a stage being emptied
+
+// Compaction callback - moves a live element elsewhere in the arena, returns
+// true if it did.
+typedef bool (*cf_arenax_compact_fn)(cf_arenax_handle h, void* udata);
 
 
 //==========================================================
@@ -137,6 +150,16 @@ void cf_arenax_free(cf_arenax* _this, cf_arenax_handle h);
 //
 void* cf_arenax_resolve(cf_arenax* _this, cf_arenax_handle h);
 
+//------------------------------------------------
+// Compaction - Empty and Release Tail Stages
+//
+uint32_t cf_arenax_compact_begin(cf_arenax* _this);
+bool cf_arenax_compact_scan(cf_arenax* _this, uint32_t stage_id,
+		cf_arenax_compact_fn cb, void* udata, uint64_t* n_left);
+uint32_t cf_arenax_compact_end(cf_arenax* _this, uint32_t stage_id,
+		bool release);
+bool cf_arenax_is_fenced(cf_arenax* _this, cf_arenax_handle h);
+
 
 //==========================================================
 // Private API - for enterprise separation only
@@ -150,3 +173,8 @@ cf_arenax_set_handle(cf_arenax_handle* h, uint32_t stage_id,
 }
 
 cf_arenax_err cf_arenax_add_stage(cf_arenax* _this);
+void cf_arenax_release_stage(cf_arenax* _this, uint32_t stage_id);
+
+// Community edition index snapshot support.
+bool cf_arenax_write_stages(cf_arenax* _this, int fd, off_t offset);
+cf_arenax_err cf_arenax_resume_mapped(cf_arenax* _this, int fd, off_t offset);
@@ -0,0 +1,71 @@
+/*
+ * coarse_clock.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * A cached monotonic clock, published by a ticker thread every
+ * CF_COARSE_CLOCK_TICK_US. Reading it is a plain load instead of a clock read,
+ * at the cost of lagging cf_getns() by up to one tick. Use it only where that
+ * error is irrelevant - e.g. millisecond-scale latencies and timeouts.
+ *
+ * Until cf_coarse_clock_init() is called, reads fall through to cf_getns().
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "citrusleaf/cf_clock.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CF_COARSE_CLOCK_TICK_US 100
+
+
+//==========================================================
+// Globals.
+//
+
+extern volatile uint64_t g_coarse_ns;
+
+
+//==========================================================
+// Public API.
+//
+
+void cf_coarse_clock_init(void);
+
+static inline uint64_t
+cf_coarse_getns(void)
+{
+	uint64_t now_ns = g_coarse_ns;
+
+	return now_ns != 0 ? now_ns : cf_getns();
+}
+
+static inline uint64_t
+cf_coarse_getms(void)
+{
+	return cf_coarse_getns() / 1000000;
+}
@@ -0,0 +1,68 @@
+/*
+ * compression.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Block compression with a choice of codecs, optionally primed by a
+ * dictionary. Callers must record the method (and dictionary) used for a
+ * block, and the block's uncompressed size - neither is stored by the codecs.
+ *
+ * zlib is always available. LZ4 and Zstandard are only available if the
+ * server is built with USE_LZ4=1 and USE_ZSTD=1 respectively.
+ *
+ * All functions are thread safe - codec state is kept per thread.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Values are stored on device - don't renumber.
+typedef enum {
+	CF_COMPRESSION_NONE = 0,
+	CF_COMPRESSION_LZ4 = 1,
+	CF_COMPRESSION_ZSTD = 2,
+	CF_COMPRESSION_ZLIB = 3,
+
+	CF_COMPRESSION_MAX
+} cf_compression_method;
+
+typedef struct cf_compression_dict_s cf_compression_dict;
+
+
+//==========================================================
+// Public API.
+//
+
+bool cf_compression_is_available(cf_compression_method method);
+const char* cf_compression_method_str(cf_compression_method method);
+
+cf_compression_dict* cf_compression_dict_load(const char* path, cf_compression_method method, uint32_t level);
+
+size_t cf_compress(cf_compression_method method, uint32_t level, const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_capacity);
+bool cf_decompress(cf_compression_method method, const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_sz);
@@ -0,0 +1,90 @@
+/*
+ * counter.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Sharded statistics counters, for counts bumped by every transaction. Each
+ * thread increments its own cache line, so cores don't fight over the line
+ * holding a hot counter. Reads sum all the shards - they're meant for info and
+ * the ticker, not the transaction path.
+ *
+ * Threads are assigned shards round-robin on first use. With more threads
+ * than shards some threads share, so increments stay atomic.
+ *
+ * A zeroed cf_counter is a valid counter of 0.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CF_COUNTER_N_SHARDS 64 // must be power of 2
+#define CF_COUNTER_LINE_SIZE 64
+
+typedef struct cf_counter_shard_s {
+	cf_atomic64 value;
+	uint8_t pad[CF_COUNTER_LINE_SIZE - sizeof(cf_atomic64)];
+} cf_counter_shard;
+
+typedef struct cf_counter_s {
+	cf_counter_shard shards[CF_COUNTER_N_SHARDS];
+} cf_counter;
+
+
+//==========================================================
+// Public API.
+//
+
+uint64_t cf_counter_get(const cf_counter* c);
+
+
+//==========================================================
+// Private API - for the inlines only.
+//
+
+extern __thread uint32_t g_counter_shard_ix;
+
+uint32_t cf_counter_assign_shard(void);
+
+
+//==========================================================
+// Public API - inlines.
+//
+
+static inline void
+cf_counter_incr(cf_counter* c)
+{
+	uint32_t ix = g_counter_shard_ix;
+
+	if (ix == 0) {
+		ix = cf_counter_assign_shard();
+	}
+
+	// Shard indexes are stored +1 so that 0 means unassigned.
+	cf_atomic64_incr(&c->shards[ix - 1].value);
+}
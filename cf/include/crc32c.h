@@ -0,0 +1,40 @@
+/*
+ * crc32c.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * CRC32C (Castagnoli) checksums. Uses the SSE4.2 crc32 instruction when the
+ * CPU has it (checked at run time - the server isn't built for SSE4.2), or
+ * the ARMv8 CRC instructions when built for them, else a table.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Public API.
+//
+
+// Pass 0 as crc to start, or a previous result to continue.
+uint32_t cf_crc32c(uint32_t crc, const void* buf, size_t size);
@@ -32,6 +32,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 typedef struct cf_dyn_buf_s {
 	uint8_t		*buf;
@@ -124,3 +125,30 @@ typedef struct cf_ll_buf_s {
 
 extern int cf_ll_buf_reserve(cf_ll_buf *llb, size_t sz, uint8_t **from);
 extern void cf_ll_buf_free(cf_ll_buf *llb);
+extern bool cf_ll_buf_owns(const cf_ll_buf *llb, const void *p);
+
+// Append-only output buffer made of fixed-size pooled chunks - growing it
+// never copies what's already there. Meant to be sent as iovecs.
+
+// Chunk plus pool header fill an 8K pool size class.
+#define CF_CHUNK_BUF_SZ (8 * 1024 - 32)
+
+typedef struct cf_chunk_buf_chunk_s {
+	struct cf_chunk_buf_chunk_s	*next;
+	size_t						used_sz;
+	uint8_t						buf[CF_CHUNK_BUF_SZ];
+} cf_chunk_buf_chunk;
+
+typedef struct cf_chunk_buf_s {
+	cf_chunk_buf_chunk	*head;
+	cf_chunk_buf_chunk	*tail;
+	size_t				used_sz;
+	uint32_t			n_chunks;
+} cf_chunk_buf;
+
+#define cf_chunk_buf_define(__x)  cf_chunk_buf __x = { NULL, NULL, 0, 0 }
+
+extern int cf_chunk_buf_append_buf(cf_chunk_buf *cb, const uint8_t *buf, size_t sz);
+extern int cf_chunk_buf_append_dyn_buf(cf_chunk_buf *cb, cf_dyn_buf *db);
+extern uint32_t cf_chunk_buf_get_iov(const cf_chunk_buf *cb, struct iovec *iov, uint32_t max_iov);
+extern void cf_chunk_buf_free(cf_chunk_buf *cb);
@@ -42,12 +42,27 @@ typedef enum {
 	CF_ALLOC_DEBUG_ALL
 } cf_alloc_debug;
 
+// Subsystems whose threads get dedicated (transient) arenas, so their churn
+// doesn't fragment arenas shared with everything else.
+typedef enum {
+	CF_ALLOC_SUBSYS_FABRIC,
+	CF_ALLOC_SUBSYS_SINDEX,
+
+	CF_ALLOC_SUBSYS_MAX
+} cf_alloc_subsys;
+
 extern __thread int32_t g_ns_arena;
 
 void cf_alloc_init(void);
 void cf_alloc_set_debug(cf_alloc_debug debug);
 int32_t cf_alloc_create_arena(void);
 
+void cf_alloc_set_thread_arena(cf_alloc_subsys subsys);
+int32_t cf_alloc_subsys_arena(cf_alloc_subsys subsys);
+const char *cf_alloc_subsys_name(cf_alloc_subsys subsys);
+void cf_alloc_set_arena_lg_dirty_mult(int32_t arena, int32_t lg_dirty_mult);
+void cf_alloc_arena_stats(int32_t arena, size_t *active_kbytes, size_t *dirty_kbytes, size_t *mapped_kbytes);
+
 #define CF_ALLOC_SET_NS_ARENA(_ns) \
 	(g_ns_arena = _ns->storage_data_in_memory ? _ns->jem_arena : -1)
 
@@ -70,12 +85,14 @@ void cf_alloc_log_site_infos(const char *file);
 void *cf_alloc_malloc_arena(size_t sz, int32_t arena);
 void *cf_alloc_calloc_arena(size_t n, size_t sz, int32_t arena);
 void *cf_alloc_realloc_arena(void *p, size_t sz, int32_t arena);
+size_t cf_alloc_usable_size(const void *p);
 
 void *cf_rc_alloc(size_t sz);
 void cf_rc_free(void *p);
 
 int32_t cf_rc_count(const void *p);
 int32_t cf_rc_reserve(void *p);
+int32_t cf_rc_reserve_nonzero(void *p);
 int32_t cf_rc_release(void *p);
 int32_t cf_rc_releaseandfree(void *p);
 
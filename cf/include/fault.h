@@ -267,6 +267,12 @@ extern bool cf_fault_is_using_local_time();
 extern void cf_fault_log_millis(bool log_millis);
 extern bool cf_fault_is_logging_millis();
 
+extern void cf_fault_log_async(bool log_async);
+extern bool cf_fault_is_logging_async();
+extern void cf_fault_async_start();
+extern void cf_fault_sync();
+extern uint64_t cf_fault_async_n_dropped();
+
 // TODO: Rework cf_display_type-based logging to have a more useful
 // output format, instead of having this separate function.
 extern void cf_fault_hex_dump(const char *title, const void *data, size_t len);
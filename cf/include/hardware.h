@@ -26,6 +26,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <dynbuf.h>
 #include <socket.h>
 
 typedef enum {
@@ -43,14 +44,21 @@ typedef uint16_t cf_topo_cpu_index;
 void cf_topo_config(cf_topo_auto_pin auto_pin, cf_topo_numa_node_index a_numa_node,
 		const cf_addr_list *addrs);
 void cf_topo_force_map_memory(const uint8_t *from, size_t size);
+void cf_topo_interleave_memory(void *from, size_t size);
 void cf_topo_migrate_memory(void);
 void cf_topo_info(void);
 
 uint16_t cf_topo_count_cores(void);
 uint16_t cf_topo_count_cpus(void);
+uint16_t cf_topo_count_numa_nodes(void);
 
 cf_topo_cpu_index cf_topo_current_cpu(void);
 cf_topo_cpu_index cf_topo_socket_cpu(const cf_socket *sock);
+cf_topo_os_cpu_index cf_topo_cpu_os_index(cf_topo_cpu_index i_cpu);
+cf_topo_numa_node_index cf_topo_cpu_numa_node(cf_topo_cpu_index i_cpu);
 
 void cf_topo_pin_to_core(cf_topo_core_index i_core);
 void cf_topo_pin_to_cpu(cf_topo_cpu_index i_cpu);
+
+void cf_thread_set_role(const char *role);
+void cf_thread_role_cpu(cf_dyn_buf *db);
@@ -35,6 +35,10 @@
 //
 
 #define N_BUCKETS (1 + 64)
+
+// Time histograms also split each bucket into this many equal-width
+// sub-buckets, for percentiles finer than a power of two.
+#define N_SUB_BUCKETS 8
 #define HISTOGRAM_NAME_SIZE 512
 
 typedef enum {
@@ -57,6 +61,7 @@ typedef struct histogram_s {
 	const char* scale_tag;
 	uint32_t time_div;
 	cf_atomic64 counts[N_BUCKETS];
+	cf_atomic64 sub_counts[N_BUCKETS][N_SUB_BUCKETS]; // time scales only
 } histogram;
 
 extern histogram *histogram_create(const char *name, histogram_scale scale);
@@ -65,3 +70,5 @@ extern void histogram_dump(histogram *h );
 
 extern uint64_t histogram_insert_data_point(histogram *h, uint64_t start_ns);
 extern void histogram_insert_raw(histogram *h, uint64_t value);
+extern void histogram_get_counts_over(histogram *h, uint64_t threshold, uint64_t *over_r, uint64_t *total_r);
+extern void histogram_get_percentiles(histogram *h, const double *pcts, uint32_t n_pcts, double *values_r);
@@ -0,0 +1,62 @@
+/*
+ * hll.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * HyperLogLog cardinality estimates - 2^CF_HLL_BITS one byte registers, for a
+ * standard error of about 1.6%. Callers hash the values they add - the hashes
+ * are mixed again here, so hashes with weak low bits are fine.
+ *
+ * An estimate is not thread safe - accumulate per thread and merge.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CF_HLL_BITS 12
+#define CF_HLL_N_REGISTERS (1 << CF_HLL_BITS)
+
+typedef struct cf_hll_s {
+	uint8_t regs[CF_HLL_N_REGISTERS];
+} cf_hll;
+
+
+//==========================================================
+// Public API.
+//
+
+static inline void
+cf_hll_init(cf_hll* hll)
+{
+	memset(hll, 0, sizeof(cf_hll));
+}
+
+void cf_hll_add(cf_hll* hll, uint64_t hash);
+void cf_hll_register(uint64_t hash, uint32_t* p_ix, uint8_t* p_rank);
+void cf_hll_merge(cf_hll* into, const cf_hll* from);
+uint64_t cf_hll_estimate(const cf_hll* hll);
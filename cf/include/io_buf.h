@@ -0,0 +1,51 @@
+/*
+ * io_buf.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Pooled, page-aligned buffers for direct I/O. Sizes are rounded up to a power
+ * of 2 class, from CF_IO_BUF_MIN_SIZE to CF_IO_BUF_MAX_SIZE - bigger requests
+ * bypass the pool.
+ *
+ * Each thread keeps its own free buffers, so there's no locking. A buffer may
+ * be freed by a different thread than allocated it - it joins the freeing
+ * thread's pool. A thread's pool is bounded, and is released when it exits.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CF_IO_BUF_MIN_SIZE (4 * 1024)
+#define CF_IO_BUF_MAX_SIZE (1024 * 1024) // largest device write-block-size
+
+
+//==========================================================
+// Public API.
+//
+
+void* cf_io_buf_alloc(size_t size);
+void cf_io_buf_free(void* buf, size_t size); // size as passed to cf_io_buf_alloc()
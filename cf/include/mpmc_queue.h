@@ -0,0 +1,66 @@
+/*
+ * mpmc_queue.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue of fixed-size
+ * elements - a sequence-numbered ring, so a push or pop is one compare-and-swap
+ * plus a copy. Consumers that find the queue empty park on a futex, and
+ * producers only make a wake syscall if someone is parked.
+ *
+ * The ring never refuses a push - when it's full, elements spill to a locked
+ * overflow cf_queue, drained after the ring. So ordering is FIFO only while
+ * the ring has room, and ring capacity is a tuning choice, not a limit.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define CF_MPMC_QUEUE_FOREVER (-1)
+#define CF_MPMC_QUEUE_NOWAIT 0
+
+typedef struct cf_mpmc_queue_s cf_mpmc_queue;
+
+
+//==========================================================
+// Public API.
+//
+
+cf_mpmc_queue* cf_mpmc_queue_create(uint32_t ele_sz, uint32_t capacity);
+void cf_mpmc_queue_destroy(cf_mpmc_queue* q);
+
+void cf_mpmc_queue_push(cf_mpmc_queue* q, const void* ele);
+bool cf_mpmc_queue_pop(cf_mpmc_queue* q, void* ele, int timeout_ms);
+
+uint32_t cf_mpmc_queue_sz(const cf_mpmc_queue* q);
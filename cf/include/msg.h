@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_vector.h"
@@ -173,6 +174,8 @@ void msg_incr_ref(msg *m);
 size_t msg_get_wire_size(const msg *m);
 size_t msg_get_template_fixed_sz(const msg_template *mt, size_t mt_count);
 size_t msg_to_wire(const msg *m, uint8_t *buf);
+size_t msg_get_wire_iov_copy_size(const msg *m, uint32_t max_iov);
+size_t msg_to_wire_iov(const msg *m, uint8_t *buf, struct iovec *iov, uint32_t *n_iov);
 
 //------------------------------------------------
 // Parse flattened data into messages.
@@ -0,0 +1,92 @@
+/*
+ * oahash.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Open-addressing hash table for small, fixed-size keys and values, tuned for
+ * read-mostly use. Gets are lock-free - they copy the value out under a
+ * sequence count and retry if a writer got in the way. Writers serialize on a
+ * mutex. Slots are grouped sixteen to a cache-friendly block of one-byte tags,
+ * matched with SSE2 where available.
+ *
+ * The table doubles when it gets 7/8 full. Retired tables are kept until
+ * destroy, since lock-free readers may still be probing them - total memory is
+ * bounded by twice the final table.
+ *
+ * Return codes and hash function signature match cf_shash, so read-mostly
+ * cf_shash tables can move over by changing names.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "shash.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Same values as CF_SHASH_... counterparts.
+#define CF_OAHASH_ERR_FOUND CF_SHASH_ERR_FOUND
+#define CF_OAHASH_ERR_NOT_FOUND CF_SHASH_ERR_NOT_FOUND
+#define CF_OAHASH_OK CF_SHASH_OK
+#define CF_OAHASH_REDUCE_DELETE CF_SHASH_REDUCE_DELETE
+
+typedef cf_shash_hash_fn cf_oahash_hash_fn;
+typedef cf_shash_reduce_fn cf_oahash_reduce_fn;
+
+typedef struct cf_oahash_table_s cf_oahash_table;
+
+typedef struct cf_oahash_s {
+	cf_oahash_hash_fn h_fn;
+	uint32_t key_size;
+	uint32_t value_size;
+	uint32_t slot_size;
+	cf_oahash_table* volatile table;
+	cf_oahash_table* retired; // list of outgrown tables
+	pthread_mutex_t lock; // serializes writers
+} cf_oahash;
+
+
+//==========================================================
+// Public API.
+//
+
+cf_oahash* cf_oahash_create(cf_oahash_hash_fn h_fn, uint32_t key_size, uint32_t value_size, uint32_t n_slots);
+void cf_oahash_destroy(cf_oahash* h);
+uint32_t cf_oahash_get_size(cf_oahash* h);
+
+void cf_oahash_put(cf_oahash* h, const void* key, const void* value);
+int cf_oahash_put_unique(cf_oahash* h, const void* key, const void* value);
+
+int cf_oahash_get(cf_oahash* h, const void* key, void* value);
+
+int cf_oahash_delete(cf_oahash* h, const void* key);
+
+int cf_oahash_reduce(cf_oahash* h, cf_oahash_reduce_fn reduce_fn, void* udata);
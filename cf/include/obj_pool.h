@@ -0,0 +1,59 @@
+/*
+ * obj_pool.h
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Per-thread, size-class pool for small objects that live for about one
+ * transaction - msgs, rw_requests and the like. Each thread keeps a short free
+ * list per size class, so most allocs and frees touch no shared state. Frees
+ * that overflow a thread's list move to a global depot in batches - objects
+ * allocated on one thread and freed on another drift back that way, one lock
+ * per batch rather than per object.
+ *
+ * The depot is bounded per size class - beyond that, objects go back to the
+ * heap. Requests bigger than the largest class go straight to the heap too,
+ * but must still be freed through the pool.
+ *
+ * The cf_pool_rc_... variants put a cf_rc_header in front of the object, so
+ * cf_rc_reserve() and cf_rc_release() work on them as usual.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stddef.h>
+
+
+//==========================================================
+// Public API.
+//
+
+void* cf_pool_alloc(size_t sz);
+void cf_pool_free(void* p);
+
+void* cf_pool_rc_alloc(size_t sz);
+void cf_pool_rc_free(void* p);
+
+void cf_pool_stats(size_t* held_kbytes, size_t* depot_kbytes);
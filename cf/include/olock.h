@@ -32,14 +32,23 @@
 #include <citrusleaf/cf_digest.h>
 
 
+// Each lock gets its own cache line, so threads on neighbouring locks don't
+// bounce lines between cores.
+typedef struct olock_slot_s {
+	pthread_mutex_t lock;
+} __attribute__ ((aligned(64))) olock_slot;
+
 typedef struct olock_s {
 	uint32_t n_locks;
 	uint32_t mask;
-	pthread_mutex_t locks[];
+	olock_slot locks[];
 } olock;
 
+#define OLOCK_MAX_LOCKS (4 * 1024 * 1024)
+
 void olock_lock(olock *ol, cf_digest *d);
 void olock_vlock(olock *ol, cf_digest *d, pthread_mutex_t **vlock);
+bool olock_trylock(olock *ol, cf_digest *d);
 void olock_unlock(olock *ol, cf_digest *d);
 olock *olock_create(uint32_t n_locks, bool mutex);
 void olock_destroy(olock *o);
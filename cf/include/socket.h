@@ -30,6 +30,7 @@
 #include <netinet/in.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "fault.h"
 #include "msg.h"
@@ -119,6 +120,7 @@ typedef struct cf_socket_s {
 	cf_socket_state state;
 	void *cfg;
 	struct ssl_st *ssl;
+	bool ktls_send; // TLS sends are encrypted by the kernel (kTLS)
 } cf_socket;
 
 typedef struct cf_sockets_s {
@@ -147,6 +149,7 @@ typedef struct cf_sock_cfg_s {
 typedef struct cf_serv_cfg_s {
 	uint32_t n_cfgs;
 	cf_sock_cfg cfgs[CF_SOCK_CFG_MAX];
+	bool reuse_port; // allow several listeners per address (SO_REUSEPORT)
 } cf_serv_cfg;
 
 typedef struct cf_poll_s {
@@ -245,6 +248,8 @@ void cf_socket_keep_alive(cf_socket *sock, int32_t idle, int32_t interval, int32
 void cf_socket_set_send_buffer(cf_socket *sock, int32_t size);
 void cf_socket_set_receive_buffer(cf_socket *sock, int32_t size);
 void cf_socket_set_window(cf_socket *sock, int32_t size);
+bool cf_socket_set_busy_poll(cf_socket *sock, int32_t us);
+bool cf_socket_steer_by_cpu(cf_socket *sock, const uint16_t *os_cpus, uint32_t n_shards);
 
 void cf_socket_init(cf_socket *sock);
 bool cf_socket_exists(cf_socket *sock);
@@ -270,11 +275,13 @@ CF_MUST_CHECK int32_t cf_socket_recv_from(cf_socket *sock, void *buff, size_t si
 CF_MUST_CHECK int32_t cf_socket_recv(cf_socket *sock, void *buff, size_t size, int32_t flags);
 CF_MUST_CHECK int32_t cf_socket_send_to(cf_socket *sock, const void *buff, size_t size, int32_t flags, const cf_sock_addr *addr);
 CF_MUST_CHECK int32_t cf_socket_send(cf_socket *sock, const void *buff, size_t size, int32_t flags);
+CF_MUST_CHECK int32_t cf_socket_send_iov(cf_socket *sock, const struct iovec *iov, uint32_t n_iov, int32_t flags);
 
 CF_MUST_CHECK int32_t cf_socket_recv_from_all(cf_socket *sock, void *buff, size_t size, int32_t flags, cf_sock_addr *addr, int32_t timeout);
 CF_MUST_CHECK int32_t cf_socket_recv_all(cf_socket *sock, void *buff, size_t size, int32_t flags, int32_t timeout);
 CF_MUST_CHECK int32_t cf_socket_send_to_all(cf_socket *sock, const void *buff, size_t size, int32_t flags, const cf_sock_addr *addr, int32_t timeout);
 CF_MUST_CHECK int32_t cf_socket_send_all(cf_socket *sock, const void *buff, size_t size, int32_t flags, int32_t timeout);
+CF_MUST_CHECK int32_t cf_socket_send_iov_all(cf_socket *sock, struct iovec *iov, uint32_t n_iov, int32_t flags, int32_t timeout);
 
 void cf_socket_write_shutdown(cf_socket *sock);
 void cf_socket_shutdown(cf_socket *sock);
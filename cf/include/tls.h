@@ -59,6 +59,13 @@ static inline bool tls_socket_needs_handshake(cf_socket *sock)
 	return sock->state == CF_SOCKET_STATE_TLS_HANDSHAKE;
 }
 
+// False unless sends must go through the TLS library. Once the kernel owns
+// encryption of sends (kTLS), plain and gather sends on the fd are correct.
+static inline bool tls_socket_owns_send(const cf_socket *sock)
+{
+	return sock->ssl != NULL && ! sock->ktls_send;
+}
+
 void tls_socket_must_not_have_data(cf_socket *sock, const char *caller);
 
 int tls_socket_accept(cf_socket *sock);
@@ -0,0 +1,63 @@
+/*
+ * uring.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * A minimal io_uring wrapper for asynchronous positional reads and writes.
+ *
+ * A ring is owned by a single thread - there's no locking. Requests are queued
+ * with cf_uring_queue_read() or cf_uring_queue_write(), handed to the kernel in
+ * bulk by cf_uring_submit(), and completions are collected by cf_uring_reap().
+ *
+ * Real rings are only available if the server is built with USE_IO_URING=1 (on
+ * a Linux 5.6+ kernel). Otherwise cf_uring_create() always returns NULL, and
+ * callers are expected to fall back to synchronous I/O.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef struct cf_uring_s cf_uring;
+
+#define CF_URING_MAX_DEPTH 4096
+
+
+//==========================================================
+// Public API.
+//
+
+cf_uring* cf_uring_create(uint32_t depth);
+void cf_uring_destroy(cf_uring* ring);
+
+bool cf_uring_queue_read(cf_uring* ring, int fd, void* buf, uint32_t size, uint64_t offset, void* udata);
+bool cf_uring_queue_write(cf_uring* ring, int fd, const void* buf, uint32_t size, uint64_t offset, void* udata);
+int cf_uring_submit(cf_uring* ring, uint32_t min_complete);
+bool cf_uring_reap(cf_uring* ring, void** udata, int32_t* res);
+
+uint32_t cf_uring_n_inflight(const cf_uring* ring);
+uint32_t cf_uring_n_free(const cf_uring* ring);
@@ -82,6 +82,8 @@ cf_vmapx_err cf_vmapx_get_index_w_len(const cf_vmapx* _this, const char* name, s
 cf_vmapx_err cf_vmapx_put_unique(cf_vmapx* _this, const char* name, uint32_t* p_index);
 cf_vmapx_err cf_vmapx_put_unique_w_len(cf_vmapx* _this, const char* name, size_t name_len, uint32_t* p_index);
 
+cf_vmapx_err cf_vmapx_resume(cf_vmapx* _this, uint32_t value_size, uint32_t max_count, uint32_t hash_size, uint32_t max_name_size);
+
 
 //------------------------------------------------
 // Private API - for enterprise separation only.
@@ -92,3 +94,5 @@ void* cf_vmapx_value_ptr(const cf_vmapx* _this, uint32_t index);
 vhash* vhash_create(uint32_t key_size, uint32_t n_rows);
 void vhash_destroy(vhash* h);
 bool vhash_put(vhash* h, const char* key, size_t key_len, uint32_t value);
+bool vhash_load(vhash* h, const char* key, size_t key_len, uint32_t value);
+void vhash_publish(vhash* h);
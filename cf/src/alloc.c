@@ -57,6 +57,14 @@
 #define N_ARENAS 150
 #define PAGE_SZ 4096
 
+// Subsystem arenas are created first, so they're numbered from N_ARENAS.
+// Namespace arenas come after them.
+#define FIRST_NS_ARENA (N_ARENAS + CF_ALLOC_SUBSYS_MAX)
+
+// Subsystem arenas are bursty and transient - purge harder than the default
+// (which keeps dirty pages up to 1/8 of active).
+#define SUBSYS_LG_DIRTY_MULT 5
+
 #define MAX_SITES 4096
 #define MAX_THREADS 256
 
@@ -84,6 +92,13 @@ extern void *je_huge_aalloc(const void *p);
 __thread int32_t g_ns_arena = -1;
 static __thread int32_t g_ns_tcache = -1;
 
+static int32_t g_subsys_arenas[CF_ALLOC_SUBSYS_MAX];
+
+static const char *const SUBSYS_NAMES[CF_ALLOC_SUBSYS_MAX] = {
+		[CF_ALLOC_SUBSYS_FABRIC] = "fabric",
+		[CF_ALLOC_SUBSYS_SINDEX] = "sindex"
+};
+
 static const void *g_site_ras[MAX_SITES];
 static uint32_t g_n_site_ras;
 
@@ -130,13 +145,13 @@ hook_check_arena(const void *p, int32_t arena)
 
 	int32_t arena_p = hook_get_arena(p);
 
-	if (arena < 0 && arena_p < N_ARENAS) {
+	if (arena < 0 && arena_p < FIRST_NS_ARENA) {
 		return;
 	}
 
-	// The "arena" parameter is never < N_ARENAS.
+	// The "arena" parameter is never < FIRST_NS_ARENA.
 
-	if (arena >= N_ARENAS && arena_p >= N_ARENAS) {
+	if (arena >= FIRST_NS_ARENA && arena_p >= FIRST_NS_ARENA) {
 		return;
 	}
 
@@ -405,6 +420,17 @@ cf_alloc_init(void)
 
 		free(p);
 	}
+
+	for (int32_t i = 0; i < CF_ALLOC_SUBSYS_MAX; i++) {
+		int32_t arena = cf_alloc_create_arena();
+
+		if (arena != N_ARENAS + i) {
+			cf_crash(CF_ALLOC, "unexpected subsystem arena: %d vs. %d", arena, N_ARENAS + i);
+		}
+
+		g_subsys_arenas[i] = arena;
+		cf_alloc_set_arena_lg_dirty_mult(arena, SUBSYS_LG_DIRTY_MULT);
+	}
 }
 
 // Restrict memory debugging.
@@ -443,6 +469,82 @@ cf_alloc_create_arena(void)
 	return arena;
 }
 
+// Make the calling thread's plain malloc() and friends use the subsystem's
+// arena. Allocations stay transient - any thread may free or realloc them.
+void
+cf_alloc_set_thread_arena(cf_alloc_subsys subsys)
+{
+	unsigned arena = (unsigned)g_subsys_arenas[subsys];
+	int32_t err = jem_mallctl("thread.arena", NULL, NULL, &arena, sizeof(arena));
+
+	if (err != 0) {
+		cf_crash(CF_ALLOC, "failed to set thread arena %u: %d (%s)", arena, err, cf_strerror(err));
+	}
+}
+
+int32_t
+cf_alloc_subsys_arena(cf_alloc_subsys subsys)
+{
+	return g_subsys_arenas[subsys];
+}
+
+const char *
+cf_alloc_subsys_name(cf_alloc_subsys subsys)
+{
+	return SUBSYS_NAMES[subsys];
+}
+
+// Dirty pages beyond active >> lg_dirty_mult get purged. -1 disables purging.
+void
+cf_alloc_set_arena_lg_dirty_mult(int32_t arena, int32_t lg_dirty_mult)
+{
+	char name[64];
+	ssize_t mult = lg_dirty_mult;
+
+	snprintf(name, sizeof(name), "arena.%d.lg_dirty_mult", arena);
+
+	int32_t err = jem_mallctl(name, NULL, NULL, &mult, sizeof(mult));
+
+	if (err != 0) {
+		cf_warning(CF_ALLOC, "failed to set %s: %d (%s)", name, err, cf_strerror(err));
+	}
+}
+
+void
+cf_alloc_arena_stats(int32_t arena, size_t *active_kbytes, size_t *dirty_kbytes,
+		size_t *mapped_kbytes)
+{
+	uint64_t epoch = 1;
+	size_t len = sizeof(epoch);
+
+	int32_t err = jem_mallctl("epoch", &epoch, &len, &epoch, len);
+
+	if (err != 0) {
+		cf_crash(CF_ALLOC, "failed to retrieve epoch: %d (%s)", err, cf_strerror(err));
+	}
+
+	char name[64];
+	size_t pactive = 0;
+	size_t pdirty = 0;
+	size_t mapped = 0;
+
+	snprintf(name, sizeof(name), "stats.arenas.%d.pactive", arena);
+	len = sizeof(pactive);
+	jem_mallctl(name, &pactive, &len, NULL, 0);
+
+	snprintf(name, sizeof(name), "stats.arenas.%d.pdirty", arena);
+	len = sizeof(pdirty);
+	jem_mallctl(name, &pdirty, &len, NULL, 0);
+
+	snprintf(name, sizeof(name), "stats.arenas.%d.mapped", arena);
+	len = sizeof(mapped);
+	jem_mallctl(name, &mapped, &len, NULL, 0);
+
+	*active_kbytes = pactive * PAGE_SZ / 1024;
+	*dirty_kbytes = pdirty * PAGE_SZ / 1024;
+	*mapped_kbytes = mapped / 1024;
+}
+
 void
 cf_alloc_heap_stats(size_t *allocated_kbytes, size_t *active_kbytes, size_t *mapped_kbytes,
 		double *efficiency_pct, uint32_t *site_count)
@@ -600,9 +702,10 @@ static bool
 is_transient(int32_t arena)
 {
 	// Note that this also considers -1 (i.e., the default thread arena)
-	// to be transient, in addition to arenas 0 .. (N_ARENAS - 1).
+	// to be transient, in addition to arenas 0 .. (N_ARENAS - 1) and the
+	// subsystem arenas.
 
-	return arena < N_ARENAS;
+	return arena < FIRST_NS_ARENA;
 }
 
 static bool
@@ -818,6 +921,18 @@ realloc(void *p, size_t sz)
 	return do_rallocx(p, sz, -1, __builtin_return_address(0));
 }
 
+// Bytes usable at p without reallocating - the size class. Tracked allocations
+// keep site info past the requested size, so report 0 (unknown) for those.
+size_t
+cf_alloc_usable_size(const void *p)
+{
+	if (want_debug(hook_get_arena(p))) {
+		return 0;
+	}
+
+	return jem_sallocx(p, 0);
+}
+
 char *
 strdup(const char *s)
 {
@@ -975,6 +1090,24 @@ cf_rc_reserve(void *p)
 	return cf_atomic32_incr(&head->rc);
 }
 
+// Returns 0 without reserving if the count already reached 0 - for objects
+// whose memory outlives their last release, e.g. index trees.
+int32_t
+cf_rc_reserve_nonzero(void *p)
+{
+	cf_rc_header *head = (cf_rc_header *)p - 1;
+	int32_t rc = (int32_t)__atomic_load_n(&head->rc, __ATOMIC_RELAXED);
+
+	while (rc > 0) {
+		if (__atomic_compare_exchange_n(&head->rc, &rc, rc + 1, true,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return rc + 1;
+		}
+	}
+
+	return 0;
+}
+
 int32_t
 cf_rc_release(void *p)
 {
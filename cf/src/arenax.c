@@ -49,6 +49,19 @@
 // (Probably unnecessary - size_t is 64 bits on our systems.)
 const uint64_t MAX_STAGE_SIZE = 0xFFFFffff;
 
+// Per-thread free element caches move this many elements at a time to and from
+// the arena, and hold at most twice as many.
+#define CACHE_BATCH 32
+#define CACHE_MAX (CACHE_BATCH * 2)
+
+// More arenas than this just don't get per-thread caches.
+#define MAX_CACHED_ARENAS 32
+
+// Compaction filters this many free elements under the lock, then the rest of
+// the free list outside it - giving them back this many at a time.
+#define COMPACT_N_KEEP 4096
+#define COMPACT_BATCH 1024
+
 // Must be in-sync with cf_arenax_err:
 const char* ARENAX_ERR_STRINGS[] = {
 	"ok",
@@ -60,6 +73,52 @@ const char* ARENAX_ERR_STRINGS[] = {
 };
 
 
+//==========================================================
+// Typedefs
+//
+
+typedef struct arenax_cache_s {
+	cf_arenax*			arena;
+	cf_arenax_handle	free_h;
+	uint32_t			n_free;
+	uint32_t			epoch;
+} arenax_cache;
+
+typedef struct arenax_caches_s {
+	uint32_t			n_caches;
+	arenax_cache		caches[MAX_CACHED_ARENAS];
+} arenax_caches;
+
+
+//==========================================================
+// Globals
+//
+
+static __thread arenax_caches g_caches = { 0 };
+
+static pthread_once_t g_cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_cache_key;
+
+
+//==========================================================
+// Forward declarations
+//
+
+static cf_arenax_handle alloc_lockless(cf_arenax* this);
+static arenax_cache* get_cache(cf_arenax* this);
+static cf_arenax_handle cache_alloc(cf_arenax* this, arenax_cache* cache);
+static void cache_free(cf_arenax* this, arenax_cache* cache, cf_arenax_handle h);
+static void cache_flush(cf_arenax* this, arenax_cache* cache, uint32_t n_flush);
+static void cache_resync(cf_arenax* this, arenax_cache* cache);
+static void free_fenced(cf_arenax* this, cf_arenax_handle h);
+static uint32_t pick_fence(cf_arenax* this, uint32_t at_stage_id, uint32_t at_element_id);
+static void filter_free_chain(cf_arenax* this, uint32_t stage_id, cf_arenax_handle h);
+static void restore_retired(cf_arenax* this, uint32_t stage_id);
+static void splice_free(cf_arenax* this, cf_arenax_handle first_h, free_element* p_last);
+static void create_cache_key(void);
+static void flush_thread_caches(void* udata);
+
+
 //==========================================================
 // Public API
 //
@@ -133,6 +192,9 @@ cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
 	this->at_stage_id = 0;
 	this->at_element_id = 1;
 
+	this->fence_stage_id = 0;
+	this->epoch = 0;
+
 	if ((flags & CF_ARENAX_BIGLOCK) &&
 			pthread_mutex_init(&this->lock, 0) != 0) {
 		return CF_ARENAX_ERR_UNKNOWN;
@@ -162,43 +224,29 @@ cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
 cf_arenax_handle
 cf_arenax_alloc(cf_arenax* this)
 {
-	if ((this->flags & CF_ARENAX_BIGLOCK) &&
-			pthread_mutex_lock(&this->lock) != 0) {
-		return 0;
-	}
-
+	arenax_cache* cache = get_cache(this);
 	cf_arenax_handle h;
 
-	// Check free list first.
-	if (this->free_h != 0) {
-		h = this->free_h;
-
-		free_element* p_free_element = cf_arenax_resolve(this, h);
-
-		this->free_h = p_free_element->next_h;
+	if (cache) {
+		if ((h = cache_alloc(this, cache)) == 0) {
+			return 0;
+		}
 	}
-	// Otherwise keep end-allocating.
 	else {
-		if (this->at_element_id >= this->stage_capacity) {
-			if (cf_arenax_add_stage(this) != CF_ARENAX_OK) {
-				if (this->flags & CF_ARENAX_BIGLOCK) {
-					pthread_mutex_unlock(&this->lock);
-				}
-
-				return 0;
-			}
-
-			this->at_stage_id++;
-			this->at_element_id = 0;
+		if ((this->flags & CF_ARENAX_BIGLOCK) &&
+				pthread_mutex_lock(&this->lock) != 0) {
+			return 0;
 		}
 
-		cf_arenax_set_handle(&h, this->at_stage_id, this->at_element_id);
+		h = alloc_lockless(this);
 
-		this->at_element_id++;
-	}
+		if (this->flags & CF_ARENAX_BIGLOCK) {
+			pthread_mutex_unlock(&this->lock);
+		}
 
-	if (this->flags & CF_ARENAX_BIGLOCK) {
-		pthread_mutex_unlock(&this->lock);
+		if (h == 0) {
+			return 0;
+		}
 	}
 
 	if (this->flags & CF_ARENAX_CALLOC) {
@@ -214,6 +262,13 @@ cf_arenax_alloc(cf_arenax* this)
 void
 cf_arenax_free(cf_arenax* this, cf_arenax_handle h)
 {
+	arenax_cache* cache = get_cache(this);
+
+	if (cache) {
+		cache_free(this, cache, h);
+		return;
+	}
+
 	free_element* p_free_element = cf_arenax_resolve(this, h);
 
 	if ((this->flags & CF_ARENAX_BIGLOCK) &&
@@ -222,9 +277,15 @@ cf_arenax_free(cf_arenax* this, cf_arenax_handle h)
 		return;
 	}
 
-	p_free_element->magic = FREE_MAGIC;
-	p_free_element->next_h = this->free_h;
-	this->free_h = h;
+	if (this->fence_stage_id != 0 &&
+			(h >> ELEMENT_ID_NUM_BITS) >= this->fence_stage_id) {
+		p_free_element->magic = RETIRED_MAGIC;
+	}
+	else {
+		p_free_element->magic = FREE_MAGIC;
+		p_free_element->next_h = this->free_h;
+		this->free_h = h;
+	}
 
 	if (this->flags & CF_ARENAX_BIGLOCK) {
 		pthread_mutex_unlock(&this->lock);
@@ -240,3 +301,655 @@ cf_arenax_resolve(cf_arenax* this, cf_arenax_handle h)
 	return this->stages[h >> ELEMENT_ID_NUM_BITS] +
 			((h & ELEMENT_ID_MASK) * this->element_size);
 }
+
+//------------------------------------------------
+// Begin compacting - fence off the lowest tail of
+// stages whose live elements fit in the free ones
+// below it. Until the compaction ends, elements
+// are only allocated below the fence, and fenced
+// elements freed are retired. Returns the first
+// fenced stage, or 0 if there's nothing to gain.
+//
+uint32_t
+cf_arenax_compact_begin(cf_arenax* this)
+{
+	// Thread caches and fenced frees are kept honest via the lock.
+	if ((this->flags & CF_ARENAX_BIGLOCK) == 0) {
+		return 0;
+	}
+
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		return 0;
+	}
+
+	uint32_t at_stage_id = this->at_stage_id;
+	uint32_t at_element_id = this->at_element_id;
+	bool compacting = this->fence_stage_id != 0;
+
+	pthread_mutex_unlock(&this->lock);
+
+	if (compacting || at_stage_id == 0) {
+		return 0;
+	}
+
+	uint32_t stage_id = pick_fence(this, at_stage_id, at_element_id);
+
+	if (stage_id == 0 || pthread_mutex_lock(&this->lock) != 0) {
+		return 0;
+	}
+
+	if (this->fence_stage_id != 0) {
+		pthread_mutex_unlock(&this->lock);
+		return 0;
+	}
+
+	this->fence_stage_id = stage_id;
+	__atomic_store_n(&this->epoch, this->epoch + 1, __ATOMIC_RELEASE);
+
+	// Filter the head of the free list now, so allocation can carry on. Detach
+	// the rest and filter it outside the lock - only we can see it.
+	cf_arenax_handle* p_h = &this->free_h;
+	cf_arenax_handle tail_h = 0;
+	uint32_t n_kept = 0;
+
+	while (*p_h != 0) {
+		free_element* p_free_element = cf_arenax_resolve(this, *p_h);
+
+		if ((*p_h >> ELEMENT_ID_NUM_BITS) >= stage_id) {
+			p_free_element->magic = RETIRED_MAGIC;
+			*p_h = p_free_element->next_h;
+			continue;
+		}
+
+		if (++n_kept == COMPACT_N_KEEP) {
+			tail_h = p_free_element->next_h;
+			p_free_element->next_h = 0;
+			break;
+		}
+
+		p_h = &p_free_element->next_h;
+	}
+
+	pthread_mutex_unlock(&this->lock);
+
+	filter_free_chain(this, stage_id, tail_h);
+
+	return stage_id;
+}
+
+//------------------------------------------------
+// Visit every fenced element not yet retired -
+// make the callback for live ones, and retire
+// those it moves. Sets n_left to the number not
+// retired. Returns false if the compaction was
+// abandoned (the arena ran out of free elements).
+//
+bool
+cf_arenax_compact_scan(cf_arenax* this, uint32_t stage_id,
+		cf_arenax_compact_fn cb, void* udata, uint64_t* n_left)
+{
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		return false;
+	}
+
+	bool fenced = this->fence_stage_id == stage_id;
+	uint32_t at_stage_id = this->at_stage_id;
+	uint32_t at_element_id = this->at_element_id;
+
+	pthread_mutex_unlock(&this->lock);
+
+	*n_left = 0;
+
+	for (uint32_t s = stage_id; fenced && s <= at_stage_id; s++) {
+		uint32_t n_elements = s == at_stage_id ?
+				at_element_id : this->stage_capacity;
+
+		for (uint32_t e = 0; e < n_elements; e++) {
+			cf_arenax_handle h;
+
+			cf_arenax_set_handle(&h, s, e);
+
+			free_element* p_free_element = cf_arenax_resolve(this, h);
+			uint32_t magic = __atomic_load_n(&p_free_element->magic,
+					__ATOMIC_ACQUIRE);
+
+			if (magic == RETIRED_MAGIC) {
+				continue;
+			}
+
+			// Free, but not retired - still in some thread's cache.
+			if (magic == FREE_MAGIC || ! cb(h, udata)) {
+				(*n_left)++;
+				continue;
+			}
+
+			__atomic_store_n(&p_free_element->magic, RETIRED_MAGIC,
+					__ATOMIC_RELEASE);
+		}
+
+		fenced = __atomic_load_n(&this->fence_stage_id, __ATOMIC_ACQUIRE) ==
+				stage_id;
+	}
+
+	return fenced;
+}
+
+//------------------------------------------------
+// End compacting. If release is set and nothing
+// was left by the last scan, release the fenced
+// stages and end-allocate from the fence on.
+// Otherwise put retired elements back on the free
+// list. Returns the number of stages released.
+//
+uint32_t
+cf_arenax_compact_end(cf_arenax* this, uint32_t stage_id, bool release)
+{
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		return 0;
+	}
+
+	if (release && this->fence_stage_id == stage_id) {
+		// Under the lock, since nothing may end-allocate meanwhile.
+		for (uint32_t s = stage_id; s < this->stage_count; s++) {
+			cf_arenax_release_stage(this, s);
+		}
+
+		uint32_t n_released = this->at_stage_id + 1 - stage_id;
+
+		this->at_stage_id = stage_id;
+		this->at_element_id = 0;
+		this->fence_stage_id = 0;
+
+		pthread_mutex_unlock(&this->lock);
+
+		return n_released;
+	}
+
+	this->fence_stage_id = 0;
+
+	pthread_mutex_unlock(&this->lock);
+
+	restore_retired(this, stage_id);
+
+	return 0;
+}
+
+//------------------------------------------------
+// Is an element in a stage being compacted?
+//
+bool
+cf_arenax_is_fenced(cf_arenax* this, cf_arenax_handle h)
+{
+	uint32_t fence_stage_id = __atomic_load_n(&this->fence_stage_id,
+			__ATOMIC_ACQUIRE);
+
+	return fence_stage_id != 0 &&
+			(h >> ELEMENT_ID_NUM_BITS) >= fence_stage_id;
+}
+
+
+//==========================================================
+// Local helpers
+//
+
+//------------------------------------------------
+// Take an element from the free list, else
+// end-allocate one. Returns 0 if the arena is
+// full. Caller holds the lock, if any.
+//
+static cf_arenax_handle
+alloc_lockless(cf_arenax* this)
+{
+	cf_arenax_handle h;
+
+	// Check free list first. Retire fenced stragglers, from caches flushed as
+	// compaction began.
+	while (this->free_h != 0) {
+		h = this->free_h;
+
+		free_element* p_free_element = cf_arenax_resolve(this, h);
+
+		this->free_h = p_free_element->next_h;
+
+		if (this->fence_stage_id == 0 ||
+				(h >> ELEMENT_ID_NUM_BITS) < this->fence_stage_id) {
+			return h;
+		}
+
+		p_free_element->magic = RETIRED_MAGIC;
+	}
+
+	// Otherwise keep end-allocating. If compacting, that would refill the
+	// fenced stages - give up compacting.
+	if (this->fence_stage_id != 0) {
+		cf_warning(CF_ARENAX, "arena out of free elements - abandoning compaction");
+		__atomic_store_n(&this->fence_stage_id, 0, __ATOMIC_RELEASE);
+	}
+
+	if (this->at_element_id >= this->stage_capacity) {
+		// Stages released by compaction are reused before adding more.
+		if (this->at_stage_id + 1 == this->stage_count &&
+				cf_arenax_add_stage(this) != CF_ARENAX_OK) {
+			return 0;
+		}
+
+		this->at_stage_id++;
+		this->at_element_id = 0;
+	}
+
+	cf_arenax_set_handle(&h, this->at_stage_id, this->at_element_id);
+
+	this->at_element_id++;
+
+	return h;
+}
+
+//------------------------------------------------
+// Get the calling thread's cache for an arena,
+// or NULL if the arena doesn't use caches (or
+// the thread has too many).
+//
+static arenax_cache*
+get_cache(cf_arenax* this)
+{
+	// Caches ride on the arena lock - without it there's nothing to gain.
+	if ((this->flags & (CF_ARENAX_BIGLOCK | CF_ARENAX_THREAD_CACHE)) !=
+			(CF_ARENAX_BIGLOCK | CF_ARENAX_THREAD_CACHE)) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < g_caches.n_caches; i++) {
+		if (g_caches.caches[i].arena == this) {
+			return &g_caches.caches[i];
+		}
+	}
+
+	if (g_caches.n_caches == MAX_CACHED_ARENAS) {
+		return NULL;
+	}
+
+	// First cache for this thread - make sure it's flushed when thread exits.
+	if (g_caches.n_caches == 0) {
+		pthread_once(&g_cache_key_once, create_cache_key);
+		pthread_setspecific(g_cache_key, &g_caches);
+	}
+
+	arenax_cache* cache = &g_caches.caches[g_caches.n_caches++];
+
+	cache->arena = this;
+	cache->free_h = 0;
+	cache->n_free = 0;
+	cache->epoch = __atomic_load_n(&this->epoch, __ATOMIC_ACQUIRE);
+
+	return cache;
+}
+
+//------------------------------------------------
+// Allocate from a thread's cache, refilling it
+// with a batch from the arena if it's empty.
+//
+static cf_arenax_handle
+cache_alloc(cf_arenax* this, arenax_cache* cache)
+{
+	if (cache->epoch != __atomic_load_n(&this->epoch, __ATOMIC_ACQUIRE)) {
+		cache_resync(this, cache);
+	}
+
+	if (cache->n_free == 0) {
+		if (pthread_mutex_lock(&this->lock) != 0) {
+			return 0;
+		}
+
+		for (uint32_t i = 0; i < CACHE_BATCH; i++) {
+			cf_arenax_handle h = alloc_lockless(this);
+
+			if (h == 0) {
+				break; // arena full - make do with what we got
+			}
+
+			free_element* p_free_element = cf_arenax_resolve(this, h);
+
+			p_free_element->magic = FREE_MAGIC;
+			p_free_element->next_h = cache->free_h;
+			cache->free_h = h;
+			cache->n_free++;
+		}
+
+		pthread_mutex_unlock(&this->lock);
+
+		if (cache->n_free == 0) {
+			return 0;
+		}
+	}
+
+	cf_arenax_handle h = cache->free_h;
+	free_element* p_free_element = cf_arenax_resolve(this, h);
+
+	cache->free_h = p_free_element->next_h;
+	cache->n_free--;
+
+	return h;
+}
+
+//------------------------------------------------
+// Free to a thread's cache, giving a batch back
+// to the arena if the cache is full.
+//
+static void
+cache_free(cf_arenax* this, arenax_cache* cache, cf_arenax_handle h)
+{
+	if (cache->epoch != __atomic_load_n(&this->epoch, __ATOMIC_ACQUIRE)) {
+		cache_resync(this, cache);
+	}
+
+	// Compacting - fenced elements mustn't be cached for reuse.
+	if (cf_arenax_is_fenced(this, h)) {
+		free_fenced(this, h);
+		return;
+	}
+
+	free_element* p_free_element = cf_arenax_resolve(this, h);
+
+	p_free_element->magic = FREE_MAGIC;
+	p_free_element->next_h = cache->free_h;
+	cache->free_h = h;
+
+	if (++cache->n_free >= CACHE_MAX) {
+		cache_flush(this, cache, CACHE_BATCH);
+	}
+}
+
+//------------------------------------------------
+// Move the first n_flush (most recently freed)
+// elements of a thread's cache to the arena's
+// free list. They're warm, so finding the end
+// of the chain is cheap - splicing is done under
+// the lock.
+//
+static void
+cache_flush(cf_arenax* this, arenax_cache* cache, uint32_t n_flush)
+{
+	if (n_flush == 0) {
+		return;
+	}
+
+	cf_arenax_handle first_h = cache->free_h;
+	free_element* p_last = cf_arenax_resolve(this, first_h);
+
+	for (uint32_t i = 1; i < n_flush; i++) {
+		p_last = cf_arenax_resolve(this, p_last->next_h);
+	}
+
+	cache->free_h = p_last->next_h;
+	cache->n_free -= n_flush;
+
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		// TODO - function doesn't return failure - just press on?
+		return;
+	}
+
+	p_last->next_h = this->free_h;
+	this->free_h = first_h;
+
+	pthread_mutex_unlock(&this->lock);
+}
+
+//------------------------------------------------
+// Compaction began since this cache last looked -
+// give all its elements back, retiring fenced
+// ones, so none linger here.
+//
+static void
+cache_resync(cf_arenax* this, arenax_cache* cache)
+{
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		return;
+	}
+
+	cf_arenax_handle h = cache->free_h;
+
+	while (cache->n_free != 0) {
+		free_element* p_free_element = cf_arenax_resolve(this, h);
+		cf_arenax_handle next_h = p_free_element->next_h;
+
+		if (this->fence_stage_id != 0 &&
+				(h >> ELEMENT_ID_NUM_BITS) >= this->fence_stage_id) {
+			p_free_element->magic = RETIRED_MAGIC;
+		}
+		else {
+			p_free_element->next_h = this->free_h;
+			this->free_h = h;
+		}
+
+		h = next_h;
+		cache->n_free--;
+	}
+
+	cache->free_h = 0;
+	cache->epoch = this->epoch;
+
+	pthread_mutex_unlock(&this->lock);
+}
+
+//------------------------------------------------
+// Free an element that was fenced when we looked
+// - recheck under the lock, as compaction may
+// have ended.
+//
+static void
+free_fenced(cf_arenax* this, cf_arenax_handle h)
+{
+	free_element* p_free_element = cf_arenax_resolve(this, h);
+
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		// TODO - function doesn't return failure - just press on?
+		return;
+	}
+
+	if (this->fence_stage_id != 0 &&
+			(h >> ELEMENT_ID_NUM_BITS) >= this->fence_stage_id) {
+		p_free_element->magic = RETIRED_MAGIC;
+	}
+	else {
+		p_free_element->magic = FREE_MAGIC;
+		p_free_element->next_h = this->free_h;
+		this->free_h = h;
+	}
+
+	pthread_mutex_unlock(&this->lock);
+}
+
+//------------------------------------------------
+// Count free elements per stage, without the lock
+// - close enough to plan by. Pick the lowest stage
+// such that the live elements from it on fit in
+// 3/4 of the free ones below it, leaving room for
+// inserts while compacting.
+//
+static uint32_t
+pick_fence(cf_arenax* this, uint32_t at_stage_id, uint32_t at_element_id)
+{
+	uint64_t n_free[CF_ARENAX_MAX_STAGES];
+	uint64_t n_free_below = 0;
+
+	for (uint32_t s = 0; s <= at_stage_id; s++) {
+		uint32_t n_elements = s == at_stage_id ?
+				at_element_id : this->stage_capacity;
+
+		n_free[s] = 0;
+
+		for (uint32_t e = 0; e < n_elements; e++) {
+			cf_arenax_handle h;
+
+			cf_arenax_set_handle(&h, s, e);
+
+			const free_element* p_free_element = cf_arenax_resolve(this, h);
+
+			if (__atomic_load_n(&p_free_element->magic, __ATOMIC_RELAXED) ==
+					FREE_MAGIC) {
+				n_free[s]++;
+			}
+		}
+
+		n_free_below += n_free[s];
+	}
+
+	uint32_t stage_id = 0;
+	uint64_t n_live_above = 0;
+
+	for (uint32_t s = at_stage_id; s != 0; s--) {
+		uint32_t n_elements = s == at_stage_id ?
+				at_element_id : this->stage_capacity;
+
+		n_live_above += n_elements - n_free[s];
+		n_free_below -= n_free[s];
+
+		if (n_live_above * 4 > n_free_below * 3) {
+			break;
+		}
+
+		stage_id = s;
+	}
+
+	return stage_id;
+}
+
+//------------------------------------------------
+// Walk a detached free chain, retiring fenced
+// elements and giving the others back a batch at
+// a time.
+//
+static void
+filter_free_chain(cf_arenax* this, uint32_t stage_id, cf_arenax_handle h)
+{
+	cf_arenax_handle first_h = 0;
+	free_element* p_last = NULL;
+	uint32_t n_batch = 0;
+
+	while (h != 0) {
+		free_element* p_free_element = cf_arenax_resolve(this, h);
+		cf_arenax_handle next_h = p_free_element->next_h;
+
+		if ((h >> ELEMENT_ID_NUM_BITS) >= stage_id) {
+			p_free_element->magic = RETIRED_MAGIC;
+		}
+		else {
+			if (first_h == 0) {
+				p_last = p_free_element;
+			}
+
+			p_free_element->next_h = first_h;
+			first_h = h;
+
+			if (++n_batch == COMPACT_BATCH) {
+				splice_free(this, first_h, p_last);
+				first_h = 0;
+				n_batch = 0;
+			}
+		}
+
+		h = next_h;
+	}
+
+	if (first_h != 0) {
+		splice_free(this, first_h, p_last);
+	}
+}
+
+//------------------------------------------------
+// Compaction didn't finish - put fenced elements
+// retired along the way back on the free list, a
+// batch at a time. Only we touch retired elements.
+//
+static void
+restore_retired(cf_arenax* this, uint32_t stage_id)
+{
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		return;
+	}
+
+	uint32_t at_stage_id = this->at_stage_id;
+	uint32_t at_element_id = this->at_element_id;
+
+	pthread_mutex_unlock(&this->lock);
+
+	cf_arenax_handle first_h = 0;
+	free_element* p_last = NULL;
+	uint32_t n_batch = 0;
+
+	for (uint32_t s = stage_id; s <= at_stage_id; s++) {
+		uint32_t n_elements = s == at_stage_id ?
+				at_element_id : this->stage_capacity;
+
+		for (uint32_t e = 0; e < n_elements; e++) {
+			cf_arenax_handle h;
+
+			cf_arenax_set_handle(&h, s, e);
+
+			free_element* p_free_element = cf_arenax_resolve(this, h);
+
+			if (p_free_element->magic != RETIRED_MAGIC) {
+				continue;
+			}
+
+			if (first_h == 0) {
+				p_last = p_free_element;
+			}
+
+			p_free_element->magic = FREE_MAGIC;
+			p_free_element->next_h = first_h;
+			first_h = h;
+
+			if (++n_batch == COMPACT_BATCH) {
+				splice_free(this, first_h, p_last);
+				first_h = 0;
+				n_batch = 0;
+			}
+		}
+	}
+
+	if (first_h != 0) {
+		splice_free(this, first_h, p_last);
+	}
+}
+
+static void
+splice_free(cf_arenax* this, cf_arenax_handle first_h, free_element* p_last)
+{
+	if (pthread_mutex_lock(&this->lock) != 0) {
+		// TODO - function doesn't return failure - just press on?
+		return;
+	}
+
+	p_last->next_h = this->free_h;
+	this->free_h = first_h;
+
+	pthread_mutex_unlock(&this->lock);
+}
+
+static void
+create_cache_key(void)
+{
+	if (pthread_key_create(&g_cache_key, flush_thread_caches) != 0) {
+		cf_crash(CF_ARENAX, "failed to create arena cache key");
+	}
+}
+
+//------------------------------------------------
+// Thread exit - give all cached elements back so
+// short-lived threads don't leak them.
+//
+static void
+flush_thread_caches(void* udata)
+{
+	arenax_caches* caches = (arenax_caches*)udata;
+
+	for (uint32_t i = 0; i < caches->n_caches; i++) {
+		arenax_cache* cache = &caches->caches[i];
+
+		// Resync rather than flush - fenced elements mustn't be reused.
+		cache_resync(cache->arena, cache);
+	}
+
+	caches->n_caches = 0;
+}
@@ -22,10 +22,40 @@
 
 #include "arenax.h"
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include "citrusleaf/alloc.h"
 #include "fault.h"
+#include "hardware.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#define HUGE_PAGE_2MB (2UL * 1024 * 1024)
+#define HUGE_PAGE_1GB (1024UL * 1024 * 1024)
+
+
+//==========================================================
+// Forward declarations.
+//
 
+static uint8_t* map_stage(const cf_arenax* this);
+
+
+//==========================================================
+// Public API.
+//
 
 //------------------------------------------------
 // Create and attach a persistent memory block,
@@ -40,7 +70,11 @@ cf_arenax_add_stage(cf_arenax* this)
 		return CF_ARENAX_ERR_STAGE_CREATE;
 	}
 
-	uint8_t* p_stage = (uint8_t*)cf_malloc(this->stage_size);
+	// Page aligned, so elements whose size divides a cache line (or is a
+	// multiple of one) don't straddle cache lines.
+	uint8_t* p_stage = (this->flags &
+			(CF_ARENAX_HUGE_PAGES | CF_ARENAX_INTERLEAVE)) != 0 ?
+					map_stage(this) : (uint8_t*)cf_valloc(this->stage_size);
 
 	if (! p_stage) {
 		cf_warning(CF_ARENAX, "could not allocate %lu-byte arena stage %u",
@@ -52,3 +86,157 @@ cf_arenax_add_stage(cf_arenax* this)
 
 	return CF_ARENAX_OK;
 }
+
+
+//------------------------------------------------
+// Give a compacted stage's memory back to the
+// system. The stage stays mapped - it reads as
+// zeros (or its snapshot file contents) until it
+// is end-allocated from again.
+//
+void
+cf_arenax_release_stage(cf_arenax* this, uint32_t stage_id)
+{
+	// Allocated stages may not end on a page boundary - leave the last part.
+	size_t size = this->stage_size & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+
+	if (madvise(this->stages[stage_id], size, MADV_DONTNEED) != 0) {
+		cf_warning(CF_ARENAX, "can't release arena stage %u: errno %d (%s)",
+				stage_id, errno, cf_strerror(errno));
+	}
+}
+
+
+//------------------------------------------------
+// Write all stages to a file (index snapshot),
+// consecutively from the specified offset.
+//
+bool
+cf_arenax_write_stages(cf_arenax* this, int fd, off_t offset)
+{
+	for (uint32_t i = 0; i < this->stage_count; i++) {
+		const uint8_t* p_stage = this->stages[i];
+		size_t left = this->stage_size;
+
+		while (left != 0) {
+			ssize_t rv = pwrite(fd, p_stage, left, offset);
+
+			if (rv <= 0) {
+				cf_warning(CF_ARENAX, "failed writing arena stage %u: errno %d (%s)",
+						i, errno, cf_strerror(errno));
+				return false;
+			}
+
+			p_stage += rv;
+			offset += rv;
+			left -= (size_t)rv;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Resume an arena whose struct was restored from
+// an index snapshot, by mapping its stages from
+// the snapshot file. Stages are mapped private -
+// changes are never written back to the file.
+//
+cf_arenax_err
+cf_arenax_resume_mapped(cf_arenax* this, int fd, off_t offset)
+{
+	if (this->stage_count == 0 || this->stage_count > this->max_stages ||
+			this->max_stages > CF_ARENAX_MAX_STAGES ||
+			this->stage_size != (size_t)this->stage_capacity *
+					(size_t)this->element_size ||
+			(this->stage_size & (sysconf(_SC_PAGESIZE) - 1)) != 0) {
+		cf_warning(CF_ARENAX, "bad arena in index snapshot");
+		return CF_ARENAX_ERR_BAD_PARAM;
+	}
+
+	memset(this->stages, 0, sizeof(this->stages));
+
+	for (uint32_t i = 0; i < this->stage_count; i++) {
+		void* p_stage = mmap(NULL, this->stage_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd, offset);
+
+		if (p_stage == MAP_FAILED) {
+			cf_warning(CF_ARENAX, "failed mapping arena stage %u: errno %d (%s)",
+					i, errno, cf_strerror(errno));
+
+			for (uint32_t j = 0; j < i; j++) {
+				munmap(this->stages[j], this->stage_size);
+			}
+
+			return CF_ARENAX_ERR_STAGE_ATTACH;
+		}
+
+		this->stages[i] = (uint8_t*)p_stage;
+		offset += (off_t)this->stage_size;
+	}
+
+	if ((this->flags & CF_ARENAX_BIGLOCK) &&
+			pthread_mutex_init(&this->lock, 0) != 0) {
+		return CF_ARENAX_ERR_UNKNOWN;
+	}
+
+	// Elements retired by a compaction in progress at shutdown are lost.
+	this->fence_stage_id = 0;
+
+	return CF_ARENAX_OK;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Map a stage directly so it can use huge pages and a NUMA policy - try
+// explicit (hugetlbfs) pages, largest first, then fall back to transparent
+// huge pages. Mapped stages are never unmapped, like allocated ones.
+static uint8_t*
+map_stage(const cf_arenax* this)
+{
+	void* p_stage = MAP_FAILED;
+
+	if ((this->flags & CF_ARENAX_HUGE_PAGES) != 0) {
+		if (this->stage_size % HUGE_PAGE_1GB == 0) {
+			p_stage = mmap(NULL, this->stage_size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+							(30 << MAP_HUGE_SHIFT), -1, 0);
+		}
+
+		if (p_stage == MAP_FAILED && this->stage_size % HUGE_PAGE_2MB == 0) {
+			p_stage = mmap(NULL, this->stage_size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+							(21 << MAP_HUGE_SHIFT), -1, 0);
+		}
+
+		if (p_stage == MAP_FAILED) {
+			cf_info(CF_ARENAX, "no hugetlb pages for arena stage %u - using transparent huge pages",
+					this->stage_count);
+		}
+	}
+
+	if (p_stage == MAP_FAILED) {
+		p_stage = mmap(NULL, this->stage_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p_stage == MAP_FAILED) {
+			return NULL;
+		}
+
+		if ((this->flags & CF_ARENAX_HUGE_PAGES) != 0 &&
+				madvise(p_stage, this->stage_size, MADV_HUGEPAGE) != 0) {
+			cf_warning(CF_ARENAX, "can't use huge pages for arena stage %u: errno %d (%s)",
+					this->stage_count, errno, cf_strerror(errno));
+		}
+	}
+
+	// Nothing is faulted in yet, so the policy applies to the whole stage.
+	if ((this->flags & CF_ARENAX_INTERLEAVE) != 0) {
+		cf_topo_interleave_memory(p_stage, this->stage_size);
+	}
+
+	return (uint8_t*)p_stage;
+}
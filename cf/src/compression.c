@@ -0,0 +1,409 @@
+/*
+ * compression.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "compression.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#if defined(USE_LZ4)
+#include <lz4.h>
+#endif
+
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "citrusleaf/alloc.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Bigger dictionaries aren't useful for small records.
+#define MAX_DICT_SIZE (1024 * 1024)
+
+struct cf_compression_dict_s {
+	cf_compression_method method;
+	uint8_t* data;
+	uint32_t size;
+
+#if defined(USE_ZSTD)
+	ZSTD_CDict* zstd_cdict;
+	ZSTD_DDict* zstd_ddict;
+#endif
+};
+
+
+//==========================================================
+// Globals.
+//
+
+#if defined(USE_LZ4)
+static __thread LZ4_stream_t* g_lz4_stream = NULL;
+#endif
+
+#if defined(USE_ZSTD)
+static __thread ZSTD_CCtx* g_zstd_cctx = NULL;
+static __thread ZSTD_DCtx* g_zstd_dctx = NULL;
+#endif
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static size_t compress_lz4(uint32_t level, const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_capacity);
+static bool decompress_lz4(const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_sz);
+static size_t compress_zstd(uint32_t level, const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_capacity);
+static bool decompress_zstd(const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_sz);
+static size_t compress_zlib(uint32_t level, const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_capacity);
+static bool decompress_zlib(const cf_compression_dict* dict, const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_sz);
+
+
+//==========================================================
+// Public API.
+//
+
+bool
+cf_compression_is_available(cf_compression_method method)
+{
+	switch (method) {
+	case CF_COMPRESSION_NONE:
+	case CF_COMPRESSION_ZLIB:
+		return true;
+#if defined(USE_LZ4)
+	case CF_COMPRESSION_LZ4:
+		return true;
+#endif
+#if defined(USE_ZSTD)
+	case CF_COMPRESSION_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+
+const char*
+cf_compression_method_str(cf_compression_method method)
+{
+	switch (method) {
+	case CF_COMPRESSION_NONE:
+		return "none";
+	case CF_COMPRESSION_LZ4:
+		return "lz4";
+	case CF_COMPRESSION_ZSTD:
+		return "zstd";
+	case CF_COMPRESSION_ZLIB:
+		return "zlib";
+	default:
+		return "illegal";
+	}
+}
+
+
+// Returns NULL if the file can't be read.
+cf_compression_dict*
+cf_compression_dict_load(const char* path, cf_compression_method method,
+		uint32_t level)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1) {
+		cf_warning(CF_MISC, "can't open compression dictionary %s: %s", path,
+				cf_strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > MAX_DICT_SIZE) {
+		cf_warning(CF_MISC, "compression dictionary %s must be 1 to %d bytes",
+				path, MAX_DICT_SIZE);
+		close(fd);
+		return NULL;
+	}
+
+	cf_compression_dict* dict = cf_malloc(sizeof(cf_compression_dict));
+
+	memset(dict, 0, sizeof(cf_compression_dict));
+
+	dict->method = method;
+	dict->size = (uint32_t)st.st_size;
+	dict->data = cf_malloc(dict->size);
+
+	if (read(fd, dict->data, dict->size) != (ssize_t)dict->size) {
+		cf_warning(CF_MISC, "can't read compression dictionary %s", path);
+		close(fd);
+		cf_free(dict->data);
+		cf_free(dict);
+		return NULL;
+	}
+
+	close(fd);
+
+#if defined(USE_ZSTD)
+	// Always able to decompress - blocks may predate a change of method.
+	if (! (dict->zstd_ddict = ZSTD_createDDict(dict->data, dict->size))) {
+		cf_crash(CF_MISC, "failed zstd dictionary creation");
+	}
+
+	if (method == CF_COMPRESSION_ZSTD && ! (dict->zstd_cdict =
+			ZSTD_createCDict(dict->data, dict->size,
+					level == 0 ? ZSTD_CLEVEL_DEFAULT : (int)level))) {
+		cf_crash(CF_MISC, "failed zstd dictionary creation");
+	}
+#endif
+
+	return dict;
+}
+
+
+// Returns compressed size, or 0 if compression failed or the result wouldn't
+// fit in out_capacity.
+size_t
+cf_compress(cf_compression_method method, uint32_t level,
+		const cf_compression_dict* dict, const uint8_t* in, size_t in_sz,
+		uint8_t* out, size_t out_capacity)
+{
+	switch (method) {
+	case CF_COMPRESSION_LZ4:
+		return compress_lz4(level, dict, in, in_sz, out, out_capacity);
+	case CF_COMPRESSION_ZSTD:
+		return compress_zstd(level, dict, in, in_sz, out, out_capacity);
+	case CF_COMPRESSION_ZLIB:
+		return compress_zlib(level, dict, in, in_sz, out, out_capacity);
+	default:
+		return 0;
+	}
+}
+
+
+// Returns false unless exactly out_sz bytes were recovered.
+bool
+cf_decompress(cf_compression_method method, const cf_compression_dict* dict,
+		const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_sz)
+{
+	switch (method) {
+	case CF_COMPRESSION_LZ4:
+		return decompress_lz4(dict, in, in_sz, out, out_sz);
+	case CF_COMPRESSION_ZSTD:
+		return decompress_zstd(dict, in, in_sz, out, out_sz);
+	case CF_COMPRESSION_ZLIB:
+		return decompress_zlib(dict, in, in_sz, out, out_sz);
+	default:
+		return false;
+	}
+}
+
+
+//==========================================================
+// Local helpers - LZ4.
+//
+
+static size_t
+compress_lz4(uint32_t level, const cf_compression_dict* dict, const uint8_t* in,
+		size_t in_sz, uint8_t* out, size_t out_capacity)
+{
+#if defined(USE_LZ4)
+	// For LZ4, level is the "acceleration" - higher is faster but larger.
+	int accel = level == 0 ? 1 : (int)level;
+	int rv;
+
+	if (dict) {
+		if (! g_lz4_stream && ! (g_lz4_stream = LZ4_createStream())) {
+			return 0;
+		}
+
+		LZ4_resetStream(g_lz4_stream);
+		LZ4_loadDict(g_lz4_stream, (const char*)dict->data, (int)dict->size);
+
+		rv = LZ4_compress_fast_continue(g_lz4_stream, (const char*)in,
+				(char*)out, (int)in_sz, (int)out_capacity, accel);
+	}
+	else {
+		rv = LZ4_compress_fast((const char*)in, (char*)out, (int)in_sz,
+				(int)out_capacity, accel);
+	}
+
+	return rv > 0 ? (size_t)rv : 0;
+#else
+	return 0;
+#endif
+}
+
+
+static bool
+decompress_lz4(const cf_compression_dict* dict, const uint8_t* in, size_t in_sz,
+		uint8_t* out, size_t out_sz)
+{
+#if defined(USE_LZ4)
+	int rv = dict ?
+			LZ4_decompress_safe_usingDict((const char*)in, (char*)out,
+					(int)in_sz, (int)out_sz, (const char*)dict->data,
+					(int)dict->size) :
+			LZ4_decompress_safe((const char*)in, (char*)out, (int)in_sz,
+					(int)out_sz);
+
+	return rv == (int)out_sz;
+#else
+	return false;
+#endif
+}
+
+
+//==========================================================
+// Local helpers - Zstandard.
+//
+
+static size_t
+compress_zstd(uint32_t level, const cf_compression_dict* dict,
+		const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_capacity)
+{
+#if defined(USE_ZSTD)
+	if (! g_zstd_cctx && ! (g_zstd_cctx = ZSTD_createCCtx())) {
+		return 0;
+	}
+
+	// Note - a dictionary's level was fixed when it was loaded.
+	size_t rv = dict && dict->zstd_cdict ?
+			ZSTD_compress_usingCDict(g_zstd_cctx, out, out_capacity, in, in_sz,
+					dict->zstd_cdict) :
+			ZSTD_compressCCtx(g_zstd_cctx, out, out_capacity, in, in_sz,
+					level == 0 ? ZSTD_CLEVEL_DEFAULT : (int)level);
+
+	return ZSTD_isError(rv) ? 0 : rv;
+#else
+	return 0;
+#endif
+}
+
+
+static bool
+decompress_zstd(const cf_compression_dict* dict, const uint8_t* in,
+		size_t in_sz, uint8_t* out, size_t out_sz)
+{
+#if defined(USE_ZSTD)
+	if (! g_zstd_dctx && ! (g_zstd_dctx = ZSTD_createDCtx())) {
+		return false;
+	}
+
+	size_t rv = dict ?
+			ZSTD_decompress_usingDDict(g_zstd_dctx, out, out_sz, in, in_sz,
+					dict->zstd_ddict) :
+			ZSTD_decompressDCtx(g_zstd_dctx, out, out_sz, in, in_sz);
+
+	return ! ZSTD_isError(rv) && rv == out_sz;
+#else
+	return false;
+#endif
+}
+
+
+//==========================================================
+// Local helpers - zlib.
+//
+
+static size_t
+compress_zlib(uint32_t level, const cf_compression_dict* dict,
+		const uint8_t* in, size_t in_sz, uint8_t* out, size_t out_capacity)
+{
+	z_stream strm;
+
+	memset(&strm, 0, sizeof(strm));
+
+	if (deflateInit(&strm, level == 0 ? Z_DEFAULT_COMPRESSION : (int)level) !=
+			Z_OK) {
+		return 0;
+	}
+
+	if (dict && deflateSetDictionary(&strm, dict->data, dict->size) != Z_OK) {
+		deflateEnd(&strm);
+		return 0;
+	}
+
+	strm.next_in = (Bytef*)in;
+	strm.avail_in = (uInt)in_sz;
+	strm.next_out = out;
+	strm.avail_out = (uInt)out_capacity;
+
+	// Anything but Z_STREAM_END means it didn't fit.
+	int rv = deflate(&strm, Z_FINISH);
+	size_t out_sz = strm.total_out;
+
+	deflateEnd(&strm);
+
+	return rv == Z_STREAM_END ? out_sz : 0;
+}
+
+
+static bool
+decompress_zlib(const cf_compression_dict* dict, const uint8_t* in,
+		size_t in_sz, uint8_t* out, size_t out_sz)
+{
+	z_stream strm;
+
+	memset(&strm, 0, sizeof(strm));
+
+	if (inflateInit(&strm) != Z_OK) {
+		return false;
+	}
+
+	strm.next_in = (Bytef*)in;
+	strm.avail_in = (uInt)in_sz;
+	strm.next_out = out;
+	strm.avail_out = (uInt)out_sz;
+
+	int rv = inflate(&strm, Z_FINISH);
+
+	if (rv == Z_NEED_DICT) {
+		if (! dict ||
+				inflateSetDictionary(&strm, dict->data, dict->size) != Z_OK) {
+			inflateEnd(&strm);
+			return false;
+		}
+
+		rv = inflate(&strm, Z_FINISH);
+	}
+
+	bool ok = rv == Z_STREAM_END && strm.total_out == out_sz;
+
+	inflateEnd(&strm);
+
+	return ok;
+}
@@ -0,0 +1,72 @@
+/*
+ * counter.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "counter.h"
+
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+
+//==========================================================
+// Globals.
+//
+
+__thread uint32_t g_counter_shard_ix = 0;
+
+static cf_atomic32 g_next_shard_ix = 0;
+
+
+//==========================================================
+// Public API.
+//
+
+uint64_t
+cf_counter_get(const cf_counter* c)
+{
+	uint64_t sum = 0;
+
+	for (uint32_t i = 0; i < CF_COUNTER_N_SHARDS; i++) {
+		sum += cf_atomic64_get(c->shards[i].value);
+	}
+
+	return sum;
+}
+
+
+//==========================================================
+// Private API - for the inlines only.
+//
+
+uint32_t
+cf_counter_assign_shard(void)
+{
+	uint32_t n = (uint32_t)cf_atomic32_incr(&g_next_shard_ix);
+
+	g_counter_shard_ix = (n & (CF_COUNTER_N_SHARDS - 1)) + 1;
+
+	return g_counter_shard_ix;
+}
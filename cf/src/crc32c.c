@@ -0,0 +1,183 @@
+/*
+ * crc32c.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "crc32c.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define POLY_REFLECTED 0x82F63B78
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const uint8_t* buf, size_t size);
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t crc_resolve(uint32_t crc, const uint8_t* buf, size_t size);
+static uint32_t crc_table(uint32_t crc, const uint8_t* buf, size_t size);
+
+#if defined(__x86_64__)
+static uint32_t crc_sse42(uint32_t crc, const uint8_t* buf, size_t size);
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+static uint32_t crc_armv8(uint32_t crc, const uint8_t* buf, size_t size);
+#endif
+
+
+//==========================================================
+// Globals.
+//
+
+// Resolved on first use - racing threads all resolve the same way.
+static crc_fn g_crc_fn = crc_resolve;
+
+static uint32_t g_table[256];
+
+
+//==========================================================
+// Public API.
+//
+
+uint32_t
+cf_crc32c(uint32_t crc, const void* buf, size_t size)
+{
+	return ~g_crc_fn(~crc, (const uint8_t*)buf, size);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static uint32_t
+crc_resolve(uint32_t crc, const uint8_t* buf, size_t size)
+{
+	crc_fn fn = crc_table;
+
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2")) {
+		fn = crc_sse42;
+	}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	fn = crc_armv8;
+#endif
+
+	if (fn == crc_table) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+
+			for (int b = 0; b < 8; b++) {
+				c = (c >> 1) ^ ((c & 1) != 0 ? POLY_REFLECTED : 0);
+			}
+
+			g_table[i] = c;
+		}
+
+		__sync_synchronize(); // table must be visible before the pointer
+	}
+
+	g_crc_fn = fn;
+
+	return fn(crc, buf, size);
+}
+
+
+static uint32_t
+crc_table(uint32_t crc, const uint8_t* buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		crc = g_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+static uint32_t
+crc_sse42(uint32_t crc, const uint8_t* buf, size_t size)
+{
+	uint64_t crc64 = crc;
+
+	while (size >= sizeof(uint64_t)) {
+		uint64_t v;
+
+		memcpy(&v, buf, sizeof(v));
+		crc64 = __builtin_ia32_crc32di(crc64, v);
+		buf += sizeof(v);
+		size -= sizeof(v);
+	}
+
+	crc = (uint32_t)crc64;
+
+	while (size-- != 0) {
+		crc = __builtin_ia32_crc32qi(crc, *buf++);
+	}
+
+	return crc;
+}
+
+#endif
+
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+static uint32_t
+crc_armv8(uint32_t crc, const uint8_t* buf, size_t size)
+{
+	while (size >= sizeof(uint64_t)) {
+		uint64_t v;
+
+		memcpy(&v, buf, sizeof(v));
+		crc = __crc32cd(crc, v);
+		buf += sizeof(v);
+		size -= sizeof(v);
+	}
+
+	while (size-- != 0) {
+		crc = __crc32cb(crc, *buf++);
+	}
+
+	return crc;
+}
+
+#endif
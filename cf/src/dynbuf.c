@@ -32,6 +32,7 @@
 #include <citrusleaf/alloc.h>
 
 #include "cf_str.h"
+#include "obj_pool.h"
 
 
 #define MAX_BACKOFF (1024 * 256)
@@ -558,3 +559,103 @@ cf_ll_buf_free(cf_ll_buf *llb)
 		cf_free(temp);
 	}
 }
+
+// Is p in memory reserved from llb?
+bool
+cf_ll_buf_owns(const cf_ll_buf *llb, const void *p)
+{
+	const uint8_t *ptr = (const uint8_t *)p;
+
+	for (const cf_ll_buf_stage *cur = llb->head; cur; cur = cur->next) {
+		if (ptr >= cur->buf && ptr < cur->buf + cur->used_sz) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int
+cf_chunk_buf_append_buf(cf_chunk_buf *cb, const uint8_t *buf, size_t sz)
+{
+	while (sz != 0) {
+		cf_chunk_buf_chunk *tail = cb->tail;
+
+		if (! tail || tail->used_sz == CF_CHUNK_BUF_SZ) {
+			tail = cf_pool_alloc(sizeof(cf_chunk_buf_chunk));
+
+			tail->next = NULL;
+			tail->used_sz = 0;
+
+			if (cb->tail) {
+				cb->tail->next = tail;
+			}
+			else {
+				cb->head = tail;
+			}
+
+			cb->tail = tail;
+			cb->n_chunks++;
+		}
+
+		size_t n = CF_CHUNK_BUF_SZ - tail->used_sz;
+
+		if (n > sz) {
+			n = sz;
+		}
+
+		memcpy(tail->buf + tail->used_sz, buf, n);
+		tail->used_sz += n;
+		cb->used_sz += n;
+		buf += n;
+		sz -= n;
+	}
+
+	return 0;
+}
+
+// Moves the dynbuf's contents to the end of the chunk buffer, leaving the
+// dynbuf empty (but with its allocation) for reuse.
+int
+cf_chunk_buf_append_dyn_buf(cf_chunk_buf *cb, cf_dyn_buf *db)
+{
+	cf_chunk_buf_append_buf(cb, db->buf, db->used_sz);
+	db->used_sz = 0;
+
+	return 0;
+}
+
+// Returns the number of iovecs filled - at most one per chunk.
+uint32_t
+cf_chunk_buf_get_iov(const cf_chunk_buf *cb, struct iovec *iov,
+		uint32_t max_iov)
+{
+	uint32_t n_iov = 0;
+
+	for (const cf_chunk_buf_chunk *cur = cb->head; cur && n_iov < max_iov;
+			cur = cur->next) {
+		iov[n_iov].iov_base = (void *)cur->buf;
+		iov[n_iov].iov_len = cur->used_sz;
+		n_iov++;
+	}
+
+	return n_iov;
+}
+
+void
+cf_chunk_buf_free(cf_chunk_buf *cb)
+{
+	cf_chunk_buf_chunk *cur = cb->head;
+
+	while (cur) {
+		cf_chunk_buf_chunk *temp = cur;
+
+		cur = cur->next;
+		cf_pool_free(temp);
+	}
+
+	cb->head = NULL;
+	cb->tail = NULL;
+	cb->used_sz = 0;
+	cb->n_chunks = 0;
+}
@@ -437,6 +437,428 @@ cf_fault_is_logging_millis()
 	return g_log_millis;
 }
 
+
+/*
+ * Async logging - each logging thread has a single-producer ring of formatted
+ * lines, drained by a logger thread which batches writes to the sinks. A
+ * caller never waits on I/O - if its ring is full, or it's a warning whose
+ * call site has warned too often this second, the line is dropped and
+ * counted. Critical messages, and lines too big for a ring, are still written
+ * synchronously. Lines from different threads may be slightly out of order in
+ * the log.
+ */
+
+#define ASYNC_RING_SZ (64 * 1024) // per thread - must be power of 2
+#define ASYNC_MAX_LINE_SZ (4 * 1024)
+#define ASYNC_MAX_RINGS 1024
+#define ASYNC_SITE_SLOTS 4096 // must be power of 2
+#define ASYNC_SITE_MAX_PER_SEC 100
+#define ASYNC_BATCH_SZ (64 * 1024)
+#define ASYNC_IDLE_SLEEP_US 1000
+#define ASYNC_DROP_REPORT_SEC 10
+#define ASYNC_SYNC_WAIT_MS 1000
+
+typedef struct async_ring_s {
+	uint64_t head; // bytes published - only the owning thread writes
+	uint64_t tail __attribute__((aligned(64))); // bytes consumed - logger only
+	uint32_t in_use __attribute__((aligned(64))); // owned by a live thread
+	uint8_t buf[ASYNC_RING_SZ];
+} async_ring;
+
+typedef struct async_rec_hdr_s {
+	uint16_t len;
+	uint8_t context;
+	uint8_t severity;
+} async_rec_hdr;
+
+static bool g_log_async = false; // configured
+static bool g_async_running = false;
+static async_ring *g_async_rings[ASYNC_MAX_RINGS];
+static uint32_t g_n_async_rings = 0;
+static pthread_mutex_t g_async_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_async_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_async_key;
+static uint64_t g_async_sites[ASYNC_SITE_SLOTS]; // second << 32 | count
+static uint64_t g_async_n_dropped = 0;
+static __thread async_ring *t_async_ring = NULL;
+
+static void write_to_sinks(cf_fault_context context, cf_fault_severity severity, const char *mbuf, size_t pos);
+
+void
+cf_fault_log_async(bool log_async)
+{
+	g_log_async = log_async;
+}
+
+bool
+cf_fault_is_logging_async()
+{
+	return g_log_async;
+}
+
+uint64_t
+cf_fault_async_n_dropped()
+{
+	return __atomic_load_n(&g_async_n_dropped, __ATOMIC_RELAXED);
+}
+
+static void
+async_ring_release(void *udata)
+{
+	async_ring *r = (async_ring *)udata;
+
+	// Anything still queued is drained as usual - the next owner appends.
+	__atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+async_key_create()
+{
+	pthread_key_create(&g_async_key, async_ring_release);
+}
+
+static async_ring *
+async_ring_claim()
+{
+	pthread_once(&g_async_key_once, async_key_create);
+
+	uint32_t n_rings = __atomic_load_n(&g_n_async_rings, __ATOMIC_ACQUIRE);
+	async_ring *r = NULL;
+
+	// Reuse a ring whose thread exited.
+	for (uint32_t i = 0; i < n_rings; i++) {
+		async_ring *t = __atomic_load_n(&g_async_rings[i], __ATOMIC_ACQUIRE);
+		uint32_t expected = 0;
+
+		if (t && __atomic_compare_exchange_n(&t->in_use, &expected, 1, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			r = t;
+			break;
+		}
+	}
+
+	if (! r) {
+		uint32_t i = n_rings;
+
+		// Reserve a slot, then publish the ring in it.
+		do {
+			if (i >= ASYNC_MAX_RINGS) {
+				return NULL;
+			}
+		} while (! __atomic_compare_exchange_n(&g_n_async_rings, &i, i + 1,
+				false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+		// Plain malloc - must not recurse into logging allocator paths.
+		if (! (r = (async_ring *)calloc(1, sizeof(async_ring)))) {
+			// Slot stays reserved but empty - the logger skips it.
+			return NULL;
+		}
+
+		r->in_use = 1;
+		__atomic_store_n(&g_async_rings[i], r, __ATOMIC_RELEASE);
+	}
+
+	pthread_setspecific(g_async_key, r);
+	t_async_ring = r;
+
+	return r;
+}
+
+// Returns true if this line should be dropped - allow at most
+// ASYNC_SITE_MAX_PER_SEC per call site (file and line) per second.
+static bool
+async_site_over_rate(const char *file_name, int line)
+{
+	uint64_t h = ((uint64_t)(uintptr_t)file_name * 31 + (uint64_t)line) *
+			0x9E3779B97F4A7C15UL;
+	uint64_t *site = &g_async_sites[(h >> 40) & (ASYNC_SITE_SLOTS - 1)];
+	uint64_t now_sec = (uint64_t)time(NULL) & 0xFFFFffff;
+	uint64_t cur = __atomic_load_n(site, __ATOMIC_RELAXED);
+
+	while (true) {
+		uint64_t next;
+
+		if ((cur >> 32) != now_sec) {
+			next = (now_sec << 32) | 1;
+		}
+		else if ((cur & 0xFFFFffff) >= ASYNC_SITE_MAX_PER_SEC) {
+			return true;
+		}
+		else {
+			next = cur + 1;
+		}
+
+		if (__atomic_compare_exchange_n(site, &cur, next, true,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			return false;
+		}
+	}
+}
+
+// Returns true if the line was queued or dropped - false if caller must write
+// it synchronously.
+static bool
+async_enqueue(cf_fault_context context, cf_fault_severity severity,
+		const char *file_name, int line, const char *mbuf, size_t pos)
+{
+	if (! __atomic_load_n(&g_async_running, __ATOMIC_ACQUIRE) ||
+			pos > ASYNC_MAX_LINE_SZ) {
+		return false;
+	}
+
+	async_ring *r = t_async_ring;
+
+	if (! r && ! (r = async_ring_claim())) {
+		return false;
+	}
+
+	// Only warnings are rate limited - they're what fire per failure in hot
+	// paths. Debug levels are opted into, and must not lose lines this way.
+	if (CF_WARNING == severity && async_site_over_rate(file_name, line)) {
+		__atomic_fetch_add(&g_async_n_dropped, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	uint64_t head = r->head;
+	uint64_t need = sizeof(async_rec_hdr) + pos;
+
+	if (head + need - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >
+			ASYNC_RING_SZ) {
+		__atomic_fetch_add(&g_async_n_dropped, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	async_rec_hdr hdr = {
+			.len = (uint16_t)pos,
+			.context = (uint8_t)context,
+			.severity = (uint8_t)severity
+	};
+
+	const uint8_t *parts[2] = { (const uint8_t *)&hdr, (const uint8_t *)mbuf };
+	size_t part_szs[2] = { sizeof(hdr), pos };
+
+	for (int p = 0; p < 2; p++) {
+		size_t off = (size_t)(head & (ASYNC_RING_SZ - 1));
+		size_t first = ASYNC_RING_SZ - off;
+
+		if (first > part_szs[p]) {
+			first = part_szs[p];
+		}
+
+		memcpy(r->buf + off, parts[p], first);
+		memcpy(r->buf, parts[p] + first, part_szs[p] - first);
+		head += part_szs[p];
+	}
+
+	__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+static void
+ring_copy_out(const async_ring *r, uint64_t tail, uint8_t *out, size_t sz)
+{
+	size_t off = (size_t)(tail & (ASYNC_RING_SZ - 1));
+	size_t first = ASYNC_RING_SZ - off;
+
+	if (first > sz) {
+		first = sz;
+	}
+
+	memcpy(out, r->buf + off, first);
+	memcpy(out + first, r->buf, sz - first);
+}
+
+typedef struct async_batch_s {
+	size_t sz;
+	char buf[ASYNC_BATCH_SZ];
+} async_batch;
+
+static void
+async_batch_flush(async_batch *batches)
+{
+	for (int i = 0; i < cf_fault_sinks_inuse; i++) {
+		async_batch *b = &batches[i];
+
+		if (b->sz != 0 && 0 >= write(cf_fault_sinks[i].fd, b->buf, b->sz)) {
+			fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
+		}
+
+		b->sz = 0;
+	}
+}
+
+// Caller holds g_async_drain_lock. Returns number of lines drained.
+static uint32_t
+async_drain_all(async_batch *batches)
+{
+	uint32_t n_lines = 0;
+	uint32_t n_rings = __atomic_load_n(&g_n_async_rings, __ATOMIC_ACQUIRE);
+
+	for (uint32_t i = 0; i < n_rings; i++) {
+		async_ring *r = __atomic_load_n(&g_async_rings[i], __ATOMIC_ACQUIRE);
+
+		if (! r) {
+			continue;
+		}
+
+		uint64_t tail = r->tail;
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+		while (tail != head) {
+			async_rec_hdr hdr;
+			char line[ASYNC_MAX_LINE_SZ];
+
+			ring_copy_out(r, tail, (uint8_t *)&hdr, sizeof(hdr));
+			ring_copy_out(r, tail + sizeof(hdr), (uint8_t *)line, hdr.len);
+			tail += sizeof(hdr) + hdr.len;
+
+			for (int s = 0; s < cf_fault_sinks_inuse; s++) {
+				if (hdr.severity > cf_fault_sinks[s].limit[hdr.context]) {
+					continue;
+				}
+
+				if (batches[s].sz + hdr.len > ASYNC_BATCH_SZ) {
+					async_batch_flush(batches);
+				}
+
+				memcpy(batches[s].buf + batches[s].sz, line, hdr.len);
+				batches[s].sz += hdr.len;
+			}
+
+			n_lines++;
+		}
+
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	async_batch_flush(batches);
+
+	return n_lines;
+}
+
+static void *
+run_async_logger(void *udata)
+{
+	async_batch *batches = (async_batch *)calloc(CF_FAULT_SINKS_MAX,
+			sizeof(async_batch));
+
+	if (! batches) {
+		cf_crash(CF_MISC, "failed to allocate async log batches");
+	}
+
+	uint64_t n_reported = 0;
+	time_t last_report = time(NULL);
+
+	while (true) {
+		pthread_mutex_lock(&g_async_drain_lock);
+
+		uint32_t n_lines = async_drain_all(batches);
+
+		pthread_mutex_unlock(&g_async_drain_lock);
+
+		uint64_t n_dropped = cf_fault_async_n_dropped();
+		time_t now = time(NULL);
+
+		if (n_dropped != n_reported &&
+				now - last_report >= ASYNC_DROP_REPORT_SEC) {
+			cf_warning(CF_MISC, "async logging dropped %lu lines (%lu total)",
+					n_dropped - n_reported, n_dropped);
+			n_reported = n_dropped;
+			last_report = now;
+		}
+
+		if (n_lines == 0) {
+			usleep(ASYNC_IDLE_SLEEP_US);
+		}
+	}
+
+	return NULL;
+}
+
+/* cf_fault_async_start
+ * If configured, start the async logger thread. Call once startup is complete
+ * - startup's bursts of logging (e.g. echoing config) stay synchronous. */
+void
+cf_fault_async_start()
+{
+	if (! g_log_async) {
+		return;
+	}
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_async_logger, NULL) != 0) {
+		cf_crash(CF_MISC, "failed to create async logger thread");
+	}
+
+	pthread_attr_destroy(&attrs);
+
+	// Queued lines must not be lost on exit.
+	atexit(cf_fault_sync);
+
+	__atomic_store_n(&g_async_running, true, __ATOMIC_RELEASE);
+}
+
+/* cf_fault_sync
+ * Switch to synchronous logging, and write everything queued so far. Call
+ * before the process dies - e.g. from fatal signal handlers. */
+void
+cf_fault_sync()
+{
+	if (! __atomic_exchange_n(&g_async_running, false, __ATOMIC_SEQ_CST)) {
+		return;
+	}
+
+	// The logger may be mid-drain - or this may be the logger thread, dying
+	// while holding the lock. Don't wait forever.
+	for (int i = 0; i < ASYNC_SYNC_WAIT_MS; i++) {
+		if (pthread_mutex_trylock(&g_async_drain_lock) == 0) {
+			static async_batch batches[CF_FAULT_SINKS_MAX];
+
+			async_drain_all(batches);
+			pthread_mutex_unlock(&g_async_drain_lock);
+			return;
+		}
+
+		usleep(1000);
+	}
+}
+
+static void
+route_to_sinks(cf_fault_context context, cf_fault_severity severity,
+		const char *file_name, int line, const char *mbuf, size_t pos)
+{
+	if (CF_CRITICAL == severity) {
+		// Everything queued goes first.
+		cf_fault_sync();
+	}
+	else if (async_enqueue(context, severity, file_name, line, mbuf, pos)) {
+		return;
+	}
+
+	write_to_sinks(context, severity, mbuf, pos);
+}
+
+static void
+write_to_sinks(cf_fault_context context, cf_fault_severity severity,
+		const char *mbuf, size_t pos)
+{
+	for (int i = 0; i < cf_fault_sinks_inuse; i++) {
+		if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
+			if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
+				// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
+				// after the hup. TODO.
+				fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
+			}
+		}
+	}
+}
+
 int
 cf_sprintf_now(char* mbuf, size_t limit)
 {
@@ -534,15 +956,7 @@ cf_fault_event(const cf_fault_context context, const cf_fault_severity severity,
 		if (severity <= NO_SINKS_LIMIT)
 			fprintf(stderr, "%s", mbuf);
 	} else {
-		for (int i = 0; i < cf_fault_sinks_inuse; i++) {
-			if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
-				if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
-					// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
-					// after the hup. TODO.
-					fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
-				}
-			}
-		}
+		route_to_sinks(context, severity, file_name, line, mbuf, pos);
 	}
 
 	/* Critical errors */
@@ -846,15 +1260,7 @@ cf_fault_event2(const cf_fault_context context,
 		if (CF_CRITICAL == severity)
 			fprintf(stderr, "%s", mbuf);
 	} else {
-		for (int i = 0; i < cf_fault_sinks_inuse; i++) {
-			if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
-				if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
-					// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
-					// after the hup. TODO.
-					fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
-				}
-			}
-		}
+		route_to_sinks(context, severity, file_name, line, mbuf, pos);
 	}
 
 	/* Critical errors */
@@ -930,15 +1336,7 @@ cf_fault_event_nostack(const cf_fault_context context,
 		if (severity <= NO_SINKS_LIMIT)
 			fprintf(stderr, "%s", mbuf);
 	} else {
-		for (int i = 0; i < cf_fault_sinks_inuse; i++) {
-			if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
-				if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
-					// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
-					// after the hup. TODO.
-					fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
-				}
-			}
-		}
+		route_to_sinks(context, severity, fn, line, mbuf, pos);
 	}
 
 	/* Critical errors */
@@ -39,6 +39,8 @@
 #include <unistd.h>
 
 #include <sys/ioctl.h>
+#include <sys/param.h> // for MIN()
+#include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -50,6 +52,7 @@
 #include <linux/sockios.h>
 
 #include "daemon.h"
+#include "dynbuf.h"
 #include "fault.h"
 #include "socket.h"
 
@@ -105,6 +108,7 @@ static os_numa_node_index g_numa_node_index_to_os_numa_node_index[CPU_SETSIZE];
 static cf_topo_os_cpu_index g_core_index_to_os_cpu_index[CPU_SETSIZE];
 static cf_topo_os_cpu_index g_cpu_index_to_os_cpu_index[CPU_SETSIZE];
 static cf_topo_cpu_index g_os_cpu_index_to_cpu_index[CPU_SETSIZE];
+static cf_topo_numa_node_index g_cpu_index_to_numa_node_index[CPU_SETSIZE];
 
 static cf_topo_numa_node_index g_i_numa_node;
 
@@ -614,6 +618,7 @@ detect(cf_topo_numa_node_index a_numa_node)
 
 		g_os_cpu_index_to_cpu_index[g_n_os_cpus] = g_n_cpus;
 		g_cpu_index_to_os_cpu_index[g_n_cpus] = g_n_os_cpus;
+		g_cpu_index_to_numa_node_index[g_n_cpus] = i_numa_node;
 
 		cf_detail(CF_HARDWARE, "OS CPU index %hu <-> CPU index %hu", g_n_os_cpus, g_n_cpus);
 		++g_n_cpus;
@@ -733,6 +738,32 @@ cf_topo_current_cpu(void)
 	return os_cpu_index_to_cpu_index((cf_topo_os_cpu_index)os);
 }
 
+uint16_t
+cf_topo_count_numa_nodes(void)
+{
+	return g_n_numa_nodes;
+}
+
+cf_topo_numa_node_index
+cf_topo_cpu_numa_node(cf_topo_cpu_index i_cpu)
+{
+	if (i_cpu >= g_n_cpus) {
+		cf_crash(CF_HARDWARE, "invalid CPU index %hu", i_cpu);
+	}
+
+	return g_cpu_index_to_numa_node_index[i_cpu];
+}
+
+cf_topo_os_cpu_index
+cf_topo_cpu_os_index(cf_topo_cpu_index i_cpu)
+{
+	if (i_cpu >= g_n_cpus) {
+		cf_crash(CF_HARDWARE, "invalid CPU index %hu", i_cpu);
+	}
+
+	return g_cpu_index_to_os_cpu_index[i_cpu];
+}
+
 cf_topo_cpu_index
 cf_topo_socket_cpu(const cf_socket *sock)
 {
@@ -1744,6 +1775,31 @@ cf_topo_force_map_memory(const uint8_t *from, size_t size)
 	}
 }
 
+void
+cf_topo_interleave_memory(void *from, size_t size)
+{
+	// NUMA-pinned processes already bind all their memory to the local node.
+	if (g_i_numa_node != INVALID_INDEX || g_n_numa_nodes < 2 || size == 0) {
+		return;
+	}
+
+	uint64_t mask = 0;
+
+	for (cf_topo_numa_node_index i_numa_node = 0; i_numa_node < g_n_numa_nodes; ++i_numa_node) {
+		os_numa_node_index i_os_numa_node = g_numa_node_index_to_os_numa_node_index[i_numa_node];
+		mask |= 1UL << i_os_numa_node;
+	}
+
+	cf_detail(CF_HARDWARE, "NUMA node mask (interleave): %016" PRIx64, mask);
+
+	// Unlike select(), we have to pass "number of valid bits + 1". Only pages
+	// not yet faulted in are placed - callers pass fresh mappings.
+	if (syscall(__NR_mbind, from, size, MPOL_INTERLEAVE, &mask, 65, 0) < 0) {
+		cf_warning(CF_HARDWARE, "mbind() system call failed: %d (%s)",
+				errno, cf_strerror(errno));
+	}
+}
+
 void
 cf_topo_migrate_memory(void)
 {
@@ -1789,3 +1845,146 @@ cf_topo_info(void)
 				g_n_cpus, g_n_cores, g_i_numa_node, g_n_numa_nodes);
 	}
 }
+
+// Thread names are what /proc, top and perf show - threads doing the same job
+// share a name, so CPU can be attributed per role. Cheap enough to call from
+// pooled task functions, since it only changes the name once per thread.
+void
+cf_thread_set_role(const char *role)
+{
+	static __thread const char *current_role = NULL;
+
+	if (current_role == role) {
+		return;
+	}
+
+	char name[16]; // includes null-terminator - kernel's TASK_COMM_LEN
+
+	strncpy(name, role, sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+
+	prctl(PR_SET_NAME, name, 0, 0, 0);
+	current_role = role;
+}
+
+#define MAX_ROLES 64
+
+typedef struct role_cpu_s {
+	char name[16];
+	uint32_t n_threads;
+	uint64_t ticks;
+} role_cpu;
+
+// Cumulative user + system CPU of all threads, grouped by thread name.
+void
+cf_thread_role_cpu(cf_dyn_buf *db)
+{
+	DIR *dir = opendir("/proc/self/task");
+
+	if (dir == NULL) {
+		cf_warning(CF_HARDWARE, "error while opening /proc/self/task: %d (%s)",
+				errno, cf_strerror(errno));
+		return;
+	}
+
+	role_cpu roles[MAX_ROLES];
+	uint32_t n_roles = 0;
+	struct dirent *ent;
+
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.') {
+			continue;
+		}
+
+		char path[PATH_MAX];
+		char buf[1024];
+
+		snprintf(path, sizeof(path), "/proc/self/task/%s/stat", ent->d_name);
+
+		int fd = open(path, O_RDONLY);
+
+		if (fd < 0) {
+			continue; // thread exited meanwhile
+		}
+
+		ssize_t sz = read(fd, buf, sizeof(buf) - 1);
+
+		close(fd);
+
+		if (sz <= 0) {
+			continue;
+		}
+
+		buf[sz] = '\0';
+
+		// Format is "tid (comm) state ..." - comm may itself contain parens.
+		char *open_paren = strchr(buf, '(');
+		char *close_paren = strrchr(buf, ')');
+
+		if (open_paren == NULL || close_paren == NULL ||
+				close_paren < open_paren) {
+			continue;
+		}
+
+		char name[16];
+		size_t name_len = MIN((size_t)(close_paren - open_paren - 1),
+				sizeof(name) - 1);
+
+		memcpy(name, open_paren + 1, name_len);
+		name[name_len] = '\0';
+
+		// utime and stime are fields 14 and 15, state is field 3.
+		char *p = close_paren + 2;
+
+		for (int field = 3; field < 14 && p != NULL; field++) {
+			p = strchr(p, ' ');
+			p = p != NULL ? p + 1 : NULL;
+		}
+
+		unsigned long long utime;
+		unsigned long long stime;
+
+		if (p == NULL || sscanf(p, "%llu %llu", &utime, &stime) != 2) {
+			continue;
+		}
+
+		uint32_t i;
+
+		for (i = 0; i < n_roles; i++) {
+			if (strcmp(roles[i].name, name) == 0) {
+				break;
+			}
+		}
+
+		if (i == n_roles) {
+			if (n_roles == MAX_ROLES) {
+				continue;
+			}
+
+			strcpy(roles[i].name, name);
+			roles[i].n_threads = 0;
+			roles[i].ticks = 0;
+			n_roles++;
+		}
+
+		roles[i].n_threads++;
+		roles[i].ticks += utime + stime;
+	}
+
+	closedir(dir);
+
+	uint64_t ms_per_tick = 1000 / (uint64_t)sysconf(_SC_CLK_TCK);
+
+	for (uint32_t i = 0; i < n_roles; i++) {
+		cf_dyn_buf_append_string(db, roles[i].name);
+		cf_dyn_buf_append_string(db, ":threads=");
+		cf_dyn_buf_append_uint32(db, roles[i].n_threads);
+		cf_dyn_buf_append_string(db, ":cpu-ms=");
+		cf_dyn_buf_append_uint64(db, roles[i].ticks * ms_per_tick);
+		cf_dyn_buf_append_char(db, ';');
+	}
+
+	if (n_roles != 0) {
+		cf_dyn_buf_chomp(db);
+	}
+}
@@ -32,6 +32,7 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
 
+#include "coarse_clock.h"
 #include "dynbuf.h"
 #include "fault.h"
 
@@ -63,6 +64,7 @@ histogram_create(const char *name, histogram_scale scale)
 
 	strcpy(h->name, name);
 	memset((void *)&h->counts, 0, sizeof(h->counts));
+	memset((void *)&h->sub_counts, 0, sizeof(h->sub_counts));
 
 	// If histogram_insert_data_point() is called for a size or count histogram,
 	// the divide by 0 will crash - consider that a high-performance assert.
@@ -100,6 +102,10 @@ histogram_clear(histogram *h)
 {
 	for (int i = 0; i < N_BUCKETS; i++) {
 		cf_atomic64_set(&h->counts[i], 0);
+
+		for (int s = 0; s < N_SUB_BUCKETS; s++) {
+			cf_atomic64_set(&h->sub_counts[i][s], 0);
+		}
 	}
 }
 
@@ -170,6 +176,18 @@ histogram_dump(histogram *h)
 	if (pos > 0) {
 		cf_info(AS_INFO, "%s", buf);
 	}
+
+	// Separate line, so tools parsing the above are unaffected.
+	if (h->time_div != 0 && total_count != 0) {
+		static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+		double values[4];
+
+		histogram_get_percentiles(h, pcts, 4, values);
+
+		cf_info(AS_INFO, "histogram percentiles: %s p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f %s",
+				h->name, values[0], values[1], values[2], values[3],
+				h->scale_tag);
+	}
 }
 
 //------------------------------------------------
@@ -269,8 +287,18 @@ msb(uint64_t n)
 uint64_t
 histogram_insert_data_point(histogram *h, uint64_t start_ns)
 {
-	uint64_t end_ns = cf_getns();
-	uint64_t delta_t = (end_ns - start_ns) / h->time_div;
+	// Millisecond histograms can't resolve the coarse clock's lag - only pay
+	// for a clock read when it matters.
+	bool coarse = h->time_div == 1000 * 1000;
+	uint64_t end_ns = coarse ? cf_coarse_getns() : cf_getns();
+
+	if (coarse && start_ns > end_ns) {
+		// The coarse clock lags a precise start time by up to one tick.
+		end_ns = start_ns;
+	}
+
+	uint64_t delta_ns = end_ns - start_ns;
+	uint64_t delta_t = delta_ns / h->time_div;
 
 	int bucket = 0;
 
@@ -283,11 +311,23 @@ histogram_insert_data_point(histogram *h, uint64_t start_ns)
 			cf_warning(AS_INFO, "%s - clock went backwards: start %lu end %lu",
 					h->name, start_ns, end_ns);
 			bucket = 0;
+			delta_ns = 0;
 		}
 	}
 
 	cf_atomic64_incr(&h->counts[bucket]);
 
+	// Bucket 0 spans [0, time_div) ns, bucket b spans [lo, 2 * lo) ns.
+	uint64_t lo_ns = bucket == 0 ? 0 : (uint64_t)h->time_div << (bucket - 1);
+	uint64_t width_ns = bucket == 0 ? h->time_div : lo_ns;
+	uint64_t sub = ((delta_ns - lo_ns) * N_SUB_BUCKETS) / width_ns;
+
+	if (sub >= N_SUB_BUCKETS) {
+		sub = N_SUB_BUCKETS - 1;
+	}
+
+	cf_atomic64_incr(&h->sub_counts[bucket][sub]);
+
 	return end_ns;
 }
 
@@ -309,3 +349,76 @@ histogram_insert_raw(histogram *h, uint64_t value)
 {
 	cf_atomic64_incr(&h->counts[msb(value)]);
 }
+
+//------------------------------------------------
+// Get the number of data points above threshold
+// (in the histogram's units - e.g. milliseconds)
+// and the total number of data points. Buckets
+// are powers of two, so in effect the threshold
+// is rounded up to a power of two.
+//
+void
+histogram_get_counts_over(histogram *h, uint64_t threshold, uint64_t *over_r,
+		uint64_t *total_r)
+{
+	int first = msb(threshold) + 1;
+	uint64_t over = 0;
+	uint64_t total = 0;
+
+	for (int b = 0; b < N_BUCKETS; b++) {
+		uint64_t count = cf_atomic64_get(h->counts[b]);
+
+		if (b >= first) {
+			over += count;
+		}
+
+		total += count;
+	}
+
+	*over_r = over;
+	*total_r = total;
+}
+
+//------------------------------------------------
+// Get percentiles of a time histogram, using the
+// sub-buckets. Each value (in the histogram's
+// units) is the upper edge of the sub-bucket the
+// percentile falls in. Percentiles must be given
+// in ascending order.
+//
+void
+histogram_get_percentiles(histogram *h, const double *pcts, uint32_t n_pcts,
+		double *values_r)
+{
+	uint64_t sub_counts[N_BUCKETS][N_SUB_BUCKETS];
+	uint64_t total = 0;
+
+	for (int b = 0; b < N_BUCKETS; b++) {
+		for (int s = 0; s < N_SUB_BUCKETS; s++) {
+			sub_counts[b][s] = cf_atomic64_get(h->sub_counts[b][s]);
+			total += sub_counts[b][s];
+		}
+	}
+
+	uint64_t subtotal = 0;
+	uint32_t p = 0;
+
+	for (int b = 0; b < N_BUCKETS && p < n_pcts; b++) {
+		double lo = b == 0 ? 0.0 : (double)(1UL << (b - 1));
+		double width = b == 0 ? 1.0 : lo;
+
+		for (int s = 0; s < N_SUB_BUCKETS && p < n_pcts; s++) {
+			subtotal += sub_counts[b][s];
+
+			while (p < n_pcts && (double)subtotal * 100.0 >=
+					pcts[p] * (double)total && total != 0) {
+				values_r[p++] = lo + (width * (s + 1)) / N_SUB_BUCKETS;
+			}
+		}
+	}
+
+	// Empty histogram (or percentiles over 100).
+	while (p < n_pcts) {
+		values_r[p++] = 0.0;
+	}
+}
@@ -152,6 +152,7 @@ cf_hist_track_create(const char* name, histogram_scale scale)
 	// Base histogram setup, same as in histogram_create():
 	strcpy(this->hist.name, name);
 	memset((void*)this->hist.counts, 0, sizeof(this->hist.counts));
+	memset((void*)this->hist.sub_counts, 0, sizeof(this->hist.sub_counts));
 
 	// If cf_hist_track_insert_data_point() is called for a size or count
 	// histogram, the divide by 0 will crash - consider that a high-performance
@@ -0,0 +1,126 @@
+/*
+ * hll.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "hll.h"
+
+#include <math.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static inline uint64_t mix64(uint64_t h);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+cf_hll_add(cf_hll* hll, uint64_t hash)
+{
+	uint32_t ix;
+	uint8_t rank;
+
+	cf_hll_register(hash, &ix, &rank);
+
+	if (rank > hll->regs[ix]) {
+		hll->regs[ix] = rank;
+	}
+}
+
+// Which register a hash lands in, and the rank it offers that register - for
+// callers keeping registers in their own (e.g. sparse) encoding.
+void
+cf_hll_register(uint64_t hash, uint32_t* p_ix, uint8_t* p_rank)
+{
+	uint64_t h = mix64(hash);
+
+	*p_ix = (uint32_t)(h >> (64 - CF_HLL_BITS));
+
+	// Rank is the position of the first 1 bit after the index bits - the guard
+	// bit caps it, and keeps clz defined.
+	uint64_t w = (h << CF_HLL_BITS) | (1UL << (CF_HLL_BITS - 1));
+
+	*p_rank = (uint8_t)(__builtin_clzll(w) + 1);
+}
+
+void
+cf_hll_merge(cf_hll* into, const cf_hll* from)
+{
+	for (uint32_t i = 0; i < CF_HLL_N_REGISTERS; i++) {
+		if (from->regs[i] > into->regs[i]) {
+			into->regs[i] = from->regs[i];
+		}
+	}
+}
+
+uint64_t
+cf_hll_estimate(const cf_hll* hll)
+{
+	double m = CF_HLL_N_REGISTERS;
+	double sum = 0;
+	uint32_t n_zeros = 0;
+
+	for (uint32_t i = 0; i < CF_HLL_N_REGISTERS; i++) {
+		sum += ldexp(1.0, -(int)hll->regs[i]);
+
+		if (hll->regs[i] == 0) {
+			n_zeros++;
+		}
+	}
+
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double e = alpha * m * m / sum;
+
+	// Small cardinalities - linear counting is more accurate. (With 64-bit
+	// hashes there's no large range correction.)
+	if (e <= 2.5 * m && n_zeros != 0) {
+		e = m * log(m / n_zeros);
+	}
+
+	return (uint64_t)(e + 0.5);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Murmur3 finalizer.
+static inline uint64_t
+mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53UL;
+	h ^= h >> 33;
+
+	return h;
+}
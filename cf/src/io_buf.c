@@ -0,0 +1,206 @@
+/*
+ * io_buf.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "io_buf.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/alloc.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define MIN_SIZE_SHIFT 12 // log2(CF_IO_BUF_MIN_SIZE)
+#define N_CLASSES 9 // CF_IO_BUF_MIN_SIZE to CF_IO_BUF_MAX_SIZE
+
+// Cache up to this many bytes of free buffers per class per thread, but always
+// at least one buffer.
+#define MAX_CACHED_BYTES_PER_CLASS (256 * 1024)
+
+// Free buffers are linked through their first bytes.
+typedef struct free_buf_s {
+	struct free_buf_s* next;
+} free_buf;
+
+typedef struct io_buf_pool_s {
+	free_buf* heads[N_CLASSES];
+	uint32_t n_free[N_CLASSES];
+} io_buf_pool;
+
+
+//==========================================================
+// Globals.
+//
+
+static __thread io_buf_pool* g_pool = NULL;
+
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t size_class(size_t size);
+static io_buf_pool* get_pool(void);
+static void make_key(void);
+static void destroy_pool(void* udata);
+
+
+//==========================================================
+// Public API.
+//
+
+void*
+cf_io_buf_alloc(size_t size)
+{
+	if (size > CF_IO_BUF_MAX_SIZE) {
+		return cf_valloc(size);
+	}
+
+	uint32_t c = size_class(size);
+	io_buf_pool* pool = get_pool();
+	free_buf* buf;
+
+	if (pool && (buf = pool->heads[c]) != NULL) {
+		pool->heads[c] = buf->next;
+		pool->n_free[c]--;
+
+		return buf;
+	}
+
+	return cf_valloc((size_t)CF_IO_BUF_MIN_SIZE << c);
+}
+
+
+void
+cf_io_buf_free(void* buf, size_t size)
+{
+	if (! buf) {
+		return;
+	}
+
+	if (size > CF_IO_BUF_MAX_SIZE) {
+		cf_free(buf);
+		return;
+	}
+
+	uint32_t c = size_class(size);
+	io_buf_pool* pool = get_pool();
+	uint32_t max_free = MAX_CACHED_BYTES_PER_CLASS >> (MIN_SIZE_SHIFT + c);
+
+	if (! pool || (pool->n_free[c] != 0 && pool->n_free[c] >= max_free)) {
+		cf_free(buf);
+		return;
+	}
+
+	free_buf* fb = (free_buf*)buf;
+
+	fb->next = pool->heads[c];
+	pool->heads[c] = fb;
+	pool->n_free[c]++;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static uint32_t
+size_class(size_t size)
+{
+	uint32_t c = 0;
+
+	while (((size_t)CF_IO_BUF_MIN_SIZE << c) < size) {
+		c++;
+	}
+
+	return c;
+}
+
+
+static io_buf_pool*
+get_pool(void)
+{
+	if (g_pool) {
+		return g_pool;
+	}
+
+	pthread_once(&g_key_once, make_key);
+
+	io_buf_pool* pool = cf_calloc(1, sizeof(io_buf_pool));
+
+	if (! pool) {
+		return NULL;
+	}
+
+	// Registers the pool to be destroyed when the thread exits.
+	if (pthread_setspecific(g_key, pool) != 0) {
+		cf_free(pool);
+		return NULL;
+	}
+
+	g_pool = pool;
+
+	return pool;
+}
+
+
+static void
+make_key(void)
+{
+	if (pthread_key_create(&g_key, destroy_pool) != 0) {
+		cf_crash(CF_MISC, "failed to create io buffer pool key");
+	}
+}
+
+
+static void
+destroy_pool(void* udata)
+{
+	io_buf_pool* pool = (io_buf_pool*)udata;
+
+	for (uint32_t c = 0; c < N_CLASSES; c++) {
+		free_buf* fb = pool->heads[c];
+
+		while (fb) {
+			free_buf* next = fb->next;
+
+			cf_free(fb);
+			fb = next;
+		}
+	}
+
+	g_pool = NULL;
+	cf_free(pool);
+}
@@ -109,6 +109,21 @@ linear_hist_create(const char *name, uint32_t start, uint32_t max_offset,
 	return h;
 }
 
+//------------------------------------------------
+// Create an empty linear histogram with the same
+// scale as h, so that it can later be merged
+// into h.
+//
+linear_hist*
+linear_hist_create_similar(const char *name, const linear_hist *h)
+{
+	linear_hist *h2 = linear_hist_create(name, h->start, 0, h->num_buckets);
+
+	h2->bucket_width = h->bucket_width;
+
+	return h2;
+}
+
 //------------------------------------------------
 // Destroy a linear histogram.
 //
@@ -214,6 +229,50 @@ linear_hist_insert_data_point(linear_hist *h, uint32_t point)
 	h->counts[bucket]++;
 }
 
+//------------------------------------------------
+// Remove a data point previously inserted.
+//
+void
+linear_hist_remove_data_point(linear_hist *h, uint32_t point)
+{
+	int32_t offset = (int32_t)(point - h->start);
+	int32_t bucket = 0;
+
+	if (offset > 0) {
+		bucket = offset / h->bucket_width;
+
+		if (bucket >= (int32_t)h->num_buckets) {
+			bucket = h->num_buckets - 1;
+		}
+	}
+
+	if (h->counts[bucket] != 0) {
+		h->counts[bucket]--;
+	}
+}
+
+//------------------------------------------------
+// Zero the buckets whose range is wholly below
+// point - e.g. a threshold value.
+//
+void
+linear_hist_clear_below(linear_hist *h, uint32_t point)
+{
+	int32_t offset = (int32_t)(point - h->start);
+
+	if (offset <= 0) {
+		return;
+	}
+
+	uint32_t n_below = (uint32_t)offset / h->bucket_width;
+
+	if (n_below > h->num_buckets) {
+		n_below = h->num_buckets;
+	}
+
+	memset((void *)h->counts, 0, sizeof(uint64_t) * n_below);
+}
+
 //------------------------------------------------
 // Get the low edge of the "threshold" bucket -
 // the bucket in which the specified percentage of
@@ -0,0 +1,353 @@
+/*
+ * mpmc_queue.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+
+//==========================================================
+// Includes.
+//
+
+#include "mpmc_queue.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_queue.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define MIN_CAPACITY 2
+#define MAX_CAPACITY (1U << 30)
+
+// A slot's seq is its position when free for a push at that position, and
+// position + 1 when it holds the element pushed there.
+typedef struct slot_s {
+	uint64_t seq;
+	uint8_t ele[];
+} slot;
+
+// Producer and consumer positions, and the parking words, each get their own
+// cache line.
+struct cf_mpmc_queue_s {
+	uint64_t enq_pos __attribute__((aligned(64)));
+	uint64_t deq_pos __attribute__((aligned(64)));
+
+	uint32_t n_waiters __attribute__((aligned(64)));
+	uint32_t wake_seq; // futex word - bumped when waking parked consumers
+
+	uint32_t n_overflow __attribute__((aligned(64)));
+	cf_queue* overflow;
+
+	uint32_t ele_sz;
+	uint32_t slot_sz;
+	uint64_t mask;
+	uint8_t* slots;
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool ring_push(cf_mpmc_queue* q, const void* ele);
+static bool try_pop(cf_mpmc_queue* q, void* ele);
+static bool ring_pop(cf_mpmc_queue* q, void* ele);
+static void wake_one(cf_mpmc_queue* q);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline slot*
+slot_at(const cf_mpmc_queue* q, uint64_t pos)
+{
+	return (slot*)(q->slots + (pos & q->mask) * q->slot_sz);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+// Capacity is rounded up to a power of 2.
+cf_mpmc_queue*
+cf_mpmc_queue_create(uint32_t ele_sz, uint32_t capacity)
+{
+	if (ele_sz == 0 || capacity > MAX_CAPACITY) {
+		return NULL;
+	}
+
+	uint64_t n_slots = MIN_CAPACITY;
+
+	while (n_slots < capacity) {
+		n_slots <<= 1;
+	}
+
+	cf_mpmc_queue* q = cf_valloc(sizeof(cf_mpmc_queue));
+
+	if (! q) {
+		return NULL;
+	}
+
+	memset(q, 0, sizeof(cf_mpmc_queue));
+
+	q->ele_sz = ele_sz;
+	q->slot_sz = (uint32_t)((sizeof(slot) + ele_sz + 7) & ~7UL);
+	q->mask = n_slots - 1;
+
+	if (! (q->slots = cf_malloc(n_slots * q->slot_sz))) {
+		cf_free(q);
+		return NULL;
+	}
+
+	for (uint64_t pos = 0; pos < n_slots; pos++) {
+		slot_at(q, pos)->seq = pos;
+	}
+
+	if (! (q->overflow = cf_queue_create(ele_sz, true))) {
+		cf_free(q->slots);
+		cf_free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+
+// Caller must ensure nobody is using the queue.
+void
+cf_mpmc_queue_destroy(cf_mpmc_queue* q)
+{
+	cf_queue_destroy(q->overflow);
+	cf_free(q->slots);
+	cf_free(q);
+}
+
+
+void
+cf_mpmc_queue_push(cf_mpmc_queue* q, const void* ele)
+{
+	if (! ring_push(q, ele)) {
+		// Count first, so a consumer never misses an overflow element.
+		__atomic_fetch_add(&q->n_overflow, 1, __ATOMIC_SEQ_CST);
+
+		if (cf_queue_push(q->overflow, ele) != CF_QUEUE_OK) {
+			cf_crash(CF_MISC, "mpmc queue overflow push failed");
+		}
+	}
+
+	// Pairs with the fence implied by the waiter's increment - either we see
+	// the waiter, or the waiter sees the element.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&q->n_waiters, __ATOMIC_RELAXED) != 0) {
+		wake_one(q);
+	}
+}
+
+
+// Returns false if nothing arrived within timeout_ms.
+bool
+cf_mpmc_queue_pop(cf_mpmc_queue* q, void* ele, int timeout_ms)
+{
+	if (try_pop(q, ele)) {
+		return true;
+	}
+
+	if (timeout_ms == CF_MPMC_QUEUE_NOWAIT) {
+		return false;
+	}
+
+	uint64_t deadline_ms = timeout_ms > 0 ? cf_getms() + (uint64_t)timeout_ms : 0;
+
+	while (true) {
+		__atomic_fetch_add(&q->n_waiters, 1, __ATOMIC_SEQ_CST);
+
+		uint32_t wake_seq = __atomic_load_n(&q->wake_seq, __ATOMIC_SEQ_CST);
+
+		if (try_pop(q, ele)) {
+			__atomic_fetch_sub(&q->n_waiters, 1, __ATOMIC_RELAXED);
+			return true;
+		}
+
+		struct timespec ts;
+		struct timespec* p_ts = NULL;
+
+		if (timeout_ms > 0) {
+			uint64_t now_ms = cf_getms();
+
+			if (now_ms >= deadline_ms) {
+				__atomic_fetch_sub(&q->n_waiters, 1, __ATOMIC_RELAXED);
+				return false;
+			}
+
+			uint64_t wait_ms = deadline_ms - now_ms;
+
+			ts.tv_sec = (time_t)(wait_ms / 1000);
+			ts.tv_nsec = (long)((wait_ms % 1000) * 1000000);
+			p_ts = &ts;
+		}
+
+		// Returns at once if a push bumped wake_seq since we read it.
+		syscall(SYS_futex, &q->wake_seq, FUTEX_WAIT_PRIVATE, wake_seq, p_ts,
+				NULL, 0);
+
+		__atomic_fetch_sub(&q->n_waiters, 1, __ATOMIC_RELAXED);
+
+		if (try_pop(q, ele)) {
+			return true;
+		}
+	}
+}
+
+
+// Approximate while the queue is in use.
+uint32_t
+cf_mpmc_queue_sz(const cf_mpmc_queue* q)
+{
+	uint64_t deq_pos = __atomic_load_n(&q->deq_pos, __ATOMIC_ACQUIRE);
+	uint64_t enq_pos = __atomic_load_n(&q->enq_pos, __ATOMIC_ACQUIRE);
+	uint64_t n_ring = enq_pos > deq_pos ? enq_pos - deq_pos : 0;
+
+	return (uint32_t)n_ring +
+			__atomic_load_n(&q->n_overflow, __ATOMIC_RELAXED);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+ring_push(cf_mpmc_queue* q, const void* ele)
+{
+	uint64_t pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+	slot* s;
+
+	while (true) {
+		s = slot_at(q, pos);
+
+		int64_t dif = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) -
+				pos);
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+			// else - pos was reloaded by the failed exchange.
+		}
+		else if (dif < 0) {
+			return false; // full - slot not yet consumed a lap ago
+		}
+		else {
+			pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(s->ele, ele, q->ele_sz);
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+static bool
+try_pop(cf_mpmc_queue* q, void* ele)
+{
+	if (ring_pop(q, ele)) {
+		return true;
+	}
+
+	if (__atomic_load_n(&q->n_overflow, __ATOMIC_SEQ_CST) == 0) {
+		return false;
+	}
+
+	// A producer may have counted but not yet pushed - treat it as empty.
+	if (cf_queue_pop(q->overflow, ele, CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
+		return false;
+	}
+
+	__atomic_fetch_sub(&q->n_overflow, 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+
+static bool
+ring_pop(cf_mpmc_queue* q, void* ele)
+{
+	uint64_t pos = __atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+	slot* s;
+
+	while (true) {
+		s = slot_at(q, pos);
+
+		int64_t dif = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) -
+				(pos + 1));
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->deq_pos, &pos, pos + 1, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		}
+		else if (dif < 0) {
+			return false; // empty, or producer hasn't finished its copy
+		}
+		else {
+			pos = __atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(ele, s->ele, q->ele_sz);
+	__atomic_store_n(&s->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+static void
+wake_one(cf_mpmc_queue* q)
+{
+	__atomic_fetch_add(&q->wake_seq, 1, __ATOMIC_SEQ_CST);
+
+	if (syscall(SYS_futex, &q->wake_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL,
+			0) < 0) {
+		cf_crash(CF_MISC, "futex wake failed: %d", errno);
+	}
+}
@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "aerospike/as_msgpack.h"
 #include "citrusleaf/alloc.h"
@@ -41,6 +42,7 @@
 
 #include "dynbuf.h"
 #include "fault.h"
+#include "obj_pool.h"
 
 
 //==========================================================
@@ -60,6 +62,9 @@ typedef struct msg_field_hdr_s {
 	uint8_t content[];
 } __attribute__ ((__packed__)) msg_field_hdr;
 
+// Gather form - buffer fields at least this big are referenced, not copied.
+#define MSG_IOV_MIN_REF_SZ (16 * 1024)
+
 
 //==========================================================
 // Globals.
@@ -84,6 +89,7 @@ static msg_type_entry g_mte[M_TYPE_MAX];
 
 static size_t msg_get_field_wire_size(msg_field_type type, size_t field_sz);
 static uint32_t msg_field_stamp(const msg_field *mf, msg_type mtype, uint8_t *buf);
+static uint32_t msg_field_stamp_hdr(const msg_field *mf, msg_type mtype, uint8_t *buf);
 static void msg_field_save(msg *m, msg_field *mf);
 
 
@@ -97,6 +103,15 @@ mf_type(const msg_field *mf, msg_type type)
 	return g_mte[type].mt[mf->id].type;
 }
 
+// Gather form - is field referenced? Each reference needs two more iovecs.
+static inline bool
+mf_iov_ref(const msg_field *mf, msg_type type, uint32_t n_iov,
+		uint32_t max_iov)
+{
+	return n_iov + 3 <= max_iov && mf->field_sz >= MSG_IOV_MIN_REF_SZ &&
+			mf_type(mf, type) == M_FT_BUF;
+}
+
 static inline void
 mf_destroy(msg_field *mf)
 {
@@ -128,7 +143,7 @@ msg_put(msg *m)
 {
 	cf_atomic_int_decr(&g_num_msgs);
 	cf_atomic_int_decr(&g_num_msgs_by_type[m->type]);
-	cf_rc_free(m);
+	cf_pool_rc_free(m);
 }
 
 
@@ -194,9 +209,7 @@ msg_create(msg_type type)
 	uint16_t mt_count = mte->entry_count;
 	size_t u_sz = sizeof(msg) + (sizeof(msg_field) * mt_count);
 	size_t a_sz = u_sz + (size_t)mte->scratch_sz;
-	msg *m = cf_rc_alloc(a_sz);
-
-	cf_assert(m, CF_MSG, "cf_rc_alloc");
+	msg *m = cf_pool_rc_alloc(a_sz);
 
 	m->n_fields = mt_count;
 	m->bytes_used = (uint32_t)u_sz;
@@ -301,6 +314,88 @@ msg_to_wire(const msg *m, uint8_t *buf)
 	return sizeof(msg_hdr) + body_sz;
 }
 
+// Size of the part of the gather form which msg_to_wire_iov() copies.
+size_t
+msg_get_wire_iov_copy_size(const msg *m, uint32_t max_iov)
+{
+	size_t sz = sizeof(msg_hdr);
+	uint32_t n_iov = 0;
+
+	for (uint16_t i = 0; i < m->n_fields; i++) {
+		const msg_field *mf = &m->f[i];
+
+		if (! mf->is_set) {
+			continue;
+		}
+
+		if (mf_iov_ref(mf, m->type, n_iov, max_iov)) {
+			sz += sizeof(msg_field_hdr) + sizeof(uint32_t);
+			n_iov += 2;
+		}
+		else {
+			sz += msg_get_field_wire_size(mf_type(mf, m->type), mf->field_sz);
+		}
+	}
+
+	return sz;
+}
+
+// Gather form - as msg_to_wire(), but big buffer fields are referenced by
+// iovecs instead of copied into buf. In: *n_iov is the capacity of iov. Out:
+// *n_iov is the number used. The msg must outlive the iovecs. Returns the
+// number of bytes copied into buf.
+size_t
+msg_to_wire_iov(const msg *m, uint8_t *buf, struct iovec *iov, uint32_t *n_iov)
+{
+	uint32_t max_iov = *n_iov;
+	uint32_t n = 0;
+	msg_hdr *hdr = (msg_hdr *)buf;
+
+	hdr->type = cf_swap_to_be16(m->type);
+
+	uint8_t *start = buf;
+	uint8_t *at = buf + sizeof(msg_hdr);
+	uint32_t body_sz = 0;
+
+	for (uint16_t i = 0; i < m->n_fields; i++) {
+		const msg_field *mf = &m->f[i];
+
+		if (! mf->is_set) {
+			continue;
+		}
+
+		if (mf_iov_ref(mf, m->type, n, max_iov)) {
+			uint32_t hdr_sz = msg_field_stamp_hdr(mf, m->type, at);
+
+			at += hdr_sz;
+
+			iov[n].iov_base = start;
+			iov[n++].iov_len = (size_t)(at - start);
+			iov[n].iov_base = mf->u.any_buf;
+			iov[n++].iov_len = mf->field_sz;
+
+			body_sz += hdr_sz + mf->field_sz;
+			start = at;
+		}
+		else {
+			uint32_t sz = msg_field_stamp(mf, m->type, at);
+
+			at += sz;
+			body_sz += sz;
+		}
+	}
+
+	if (at != start) {
+		iov[n].iov_base = start;
+		iov[n++].iov_len = (size_t)(at - start);
+	}
+
+	hdr->size = cf_swap_to_be32(body_sz);
+	*n_iov = n;
+
+	return (size_t)(at - buf);
+}
+
 
 //==========================================================
 // Public API - parse flattened data into messages.
@@ -1216,6 +1311,21 @@ msg_field_stamp(const msg_field *mf, msg_type mtype, uint8_t *buf)
 	return (uint32_t)(sizeof(msg_field_hdr) + sizeof(uint32_t) + fsz);
 }
 
+// Stamp only the header and size of a buffer field - caller sends the
+// contents. Returns the number of bytes written.
+static uint32_t
+msg_field_stamp_hdr(const msg_field *mf, msg_type mtype, uint8_t *buf)
+{
+	msg_field_hdr *hdr = (msg_field_hdr *)buf;
+
+	hdr->id = cf_swap_to_be16((uint16_t)mf->id);
+	hdr->type = (uint8_t)mf_type(mf, mtype);
+
+	*(uint32_t *)(buf + sizeof(msg_field_hdr)) = cf_swap_to_be32(mf->field_sz);
+
+	return (uint32_t)(sizeof(msg_field_hdr) + sizeof(uint32_t));
+}
+
 static void
 msg_field_save(msg *m, msg_field *mf)
 {
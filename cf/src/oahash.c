@@ -0,0 +1,485 @@
+/*
+ * oahash.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+//==========================================================
+// Includes.
+//
+
+#include "oahash.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "citrusleaf/alloc.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define GROUP_SZ 16
+
+#define TAG_EMPTY 0
+#define TAG_DELETED 1
+#define TAG_LIVE_BIT 0x80 // live tags are this bit plus 7 bits of hash
+
+#define MIN_N_GROUPS 1
+
+struct cf_oahash_table_s {
+	uint32_t seq; // odd while a writer is changing slots
+	uint32_t n_groups; // power of 2
+	uint32_t n_elements;
+	uint32_t n_used; // elements plus deleted markers
+	cf_oahash_table* next_retired;
+	uint8_t* tags;
+	uint8_t* slots;
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static cf_oahash_table* table_create(const cf_oahash* h, uint32_t n_groups);
+static void table_destroy(cf_oahash_table* t);
+static uint8_t* table_find(const cf_oahash* h, const cf_oahash_table* t, const void* key, uint32_t hv, uint32_t* p_ix);
+static uint32_t table_free_ix(const cf_oahash_table* t, uint32_t hv);
+static void table_insert(const cf_oahash* h, cf_oahash_table* t, const void* key, const void* value, uint32_t hv);
+static void grow_if_needed(cf_oahash* h);
+static void write_begin(cf_oahash_table* t);
+static void write_end(cf_oahash_table* t);
+
+static inline uint32_t
+mix_hash(uint32_t hv)
+{
+	// Murmur3 finalizer - cf_shash hash functions are often just the key.
+	hv ^= hv >> 16;
+	hv *= 0x85ebca6b;
+	hv ^= hv >> 13;
+	hv *= 0xc2b2ae35;
+	hv ^= hv >> 16;
+
+	return hv;
+}
+
+static inline uint8_t
+hash_tag(uint32_t hv)
+{
+	return (uint8_t)(TAG_LIVE_BIT | (hv >> 25));
+}
+
+static inline uint32_t
+match_tags(const uint8_t* group, uint8_t tag)
+{
+#if defined(__SSE2__)
+	__m128i tags = _mm_loadu_si128((const __m128i*)group);
+
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(tags,
+			_mm_set1_epi8((char)tag)));
+#else
+	uint32_t mask = 0;
+
+	for (uint32_t i = 0; i < GROUP_SZ; i++) {
+		if (group[i] == tag) {
+			mask |= 1u << i;
+		}
+	}
+
+	return mask;
+#endif
+}
+
+static inline uint8_t*
+slot_at(const cf_oahash* h, const cf_oahash_table* t, uint32_t ix)
+{
+	return t->slots + ((size_t)ix * h->slot_size);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+cf_oahash*
+cf_oahash_create(cf_oahash_hash_fn h_fn, uint32_t key_size,
+		uint32_t value_size, uint32_t n_slots)
+{
+	cf_assert(h_fn != NULL && key_size != 0, CF_MISC, "bad oahash params");
+
+	cf_oahash* h = cf_malloc(sizeof(cf_oahash));
+
+	h->h_fn = h_fn;
+	h->key_size = key_size;
+	h->value_size = value_size;
+	h->slot_size = key_size + value_size;
+	h->retired = NULL;
+
+	uint32_t n_groups = MIN_N_GROUPS;
+
+	while (n_groups * GROUP_SZ < n_slots) {
+		n_groups <<= 1;
+	}
+
+	h->table = table_create(h, n_groups);
+
+	pthread_mutex_init(&h->lock, NULL);
+
+	return h;
+}
+
+void
+cf_oahash_destroy(cf_oahash* h)
+{
+	cf_oahash_table* t = h->retired;
+
+	while (t) {
+		cf_oahash_table* next = t->next_retired;
+
+		table_destroy(t);
+		t = next;
+	}
+
+	table_destroy(h->table);
+	pthread_mutex_destroy(&h->lock);
+	cf_free(h);
+}
+
+uint32_t
+cf_oahash_get_size(cf_oahash* h)
+{
+	return __atomic_load_n(&h->table->n_elements, __ATOMIC_RELAXED);
+}
+
+void
+cf_oahash_put(cf_oahash* h, const void* key, const void* value)
+{
+	uint32_t hv = mix_hash(h->h_fn(key));
+
+	pthread_mutex_lock(&h->lock);
+
+	cf_oahash_table* t = h->table;
+	uint8_t* slot = table_find(h, t, key, hv, NULL);
+
+	if (slot) {
+		write_begin(t);
+		memcpy(slot + h->key_size, value, h->value_size);
+		write_end(t);
+	}
+	else {
+		grow_if_needed(h);
+		t = h->table;
+
+		write_begin(t);
+		table_insert(h, t, key, value, hv);
+		write_end(t);
+	}
+
+	pthread_mutex_unlock(&h->lock);
+}
+
+int
+cf_oahash_put_unique(cf_oahash* h, const void* key, const void* value)
+{
+	uint32_t hv = mix_hash(h->h_fn(key));
+
+	pthread_mutex_lock(&h->lock);
+
+	if (table_find(h, h->table, key, hv, NULL)) {
+		pthread_mutex_unlock(&h->lock);
+		return CF_OAHASH_ERR_FOUND;
+	}
+
+	grow_if_needed(h);
+
+	cf_oahash_table* t = h->table;
+
+	write_begin(t);
+	table_insert(h, t, key, value, hv);
+	write_end(t);
+
+	pthread_mutex_unlock(&h->lock);
+
+	return CF_OAHASH_OK;
+}
+
+// Lock-free. If value is NULL, just checks presence.
+int
+cf_oahash_get(cf_oahash* h, const void* key, void* value)
+{
+	uint32_t hv = mix_hash(h->h_fn(key));
+
+	while (true) {
+		cf_oahash_table* t = __atomic_load_n(&h->table, __ATOMIC_ACQUIRE);
+		uint32_t seq = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+
+		if ((seq & 1) != 0) {
+			// Writer active, or table retired - reload and retry.
+			continue;
+		}
+
+		const uint8_t* slot = table_find(h, t, key, hv, NULL);
+
+		if (slot && value) {
+			memcpy(value, slot + h->key_size, h->value_size);
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&t->seq, __ATOMIC_RELAXED) == seq) {
+			return slot ? CF_OAHASH_OK : CF_OAHASH_ERR_NOT_FOUND;
+		}
+	}
+}
+
+int
+cf_oahash_delete(cf_oahash* h, const void* key)
+{
+	uint32_t hv = mix_hash(h->h_fn(key));
+
+	pthread_mutex_lock(&h->lock);
+
+	cf_oahash_table* t = h->table;
+	uint32_t ix;
+
+	if (! table_find(h, t, key, hv, &ix)) {
+		pthread_mutex_unlock(&h->lock);
+		return CF_OAHASH_ERR_NOT_FOUND;
+	}
+
+	write_begin(t);
+	t->tags[ix] = TAG_DELETED;
+	t->n_elements--;
+	write_end(t);
+
+	pthread_mutex_unlock(&h->lock);
+
+	return CF_OAHASH_OK;
+}
+
+// Holds the writer lock, but readers carry on - only a deletion blocks them,
+// and only briefly.
+int
+cf_oahash_reduce(cf_oahash* h, cf_oahash_reduce_fn reduce_fn, void* udata)
+{
+	pthread_mutex_lock(&h->lock);
+
+	cf_oahash_table* t = h->table;
+	uint32_t n_slots = t->n_groups * GROUP_SZ;
+	int rv = CF_OAHASH_OK;
+
+	for (uint32_t ix = 0; ix < n_slots; ix++) {
+		if ((t->tags[ix] & TAG_LIVE_BIT) == 0) {
+			continue;
+		}
+
+		uint8_t* slot = slot_at(h, t, ix);
+		int cb_rv = reduce_fn(slot, slot + h->key_size, udata);
+
+		if (cb_rv == CF_OAHASH_OK) {
+			continue;
+		}
+
+		if (cb_rv == CF_OAHASH_REDUCE_DELETE) {
+			write_begin(t);
+			t->tags[ix] = TAG_DELETED;
+			t->n_elements--;
+			write_end(t);
+			continue;
+		}
+
+		rv = cb_rv;
+		break;
+	}
+
+	pthread_mutex_unlock(&h->lock);
+
+	return rv;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static cf_oahash_table*
+table_create(const cf_oahash* h, uint32_t n_groups)
+{
+	cf_oahash_table* t = cf_malloc(sizeof(cf_oahash_table));
+	uint32_t n_slots = n_groups * GROUP_SZ;
+
+	t->seq = 0;
+	t->n_groups = n_groups;
+	t->n_elements = 0;
+	t->n_used = 0;
+	t->next_retired = NULL;
+	t->tags = cf_malloc(n_slots);
+	t->slots = cf_malloc((size_t)n_slots * h->slot_size);
+
+	memset(t->tags, TAG_EMPTY, n_slots);
+
+	return t;
+}
+
+static void
+table_destroy(cf_oahash_table* t)
+{
+	cf_free(t->tags);
+	cf_free(t->slots);
+	cf_free(t);
+}
+
+// Probes group by group. Readers may see torn tags or keys, so the probe is
+// bounded by the table size and the caller validates with the sequence count.
+static uint8_t*
+table_find(const cf_oahash* h, const cf_oahash_table* t, const void* key,
+		uint32_t hv, uint32_t* p_ix)
+{
+	uint32_t mask = t->n_groups - 1;
+	uint32_t g = hv & mask;
+	uint8_t tag = hash_tag(hv);
+
+	for (uint32_t n = 0; n < t->n_groups; n++) {
+		const uint8_t* group = t->tags + ((size_t)g * GROUP_SZ);
+		uint32_t matches = match_tags(group, tag);
+
+		while (matches != 0) {
+			uint32_t i = (uint32_t)__builtin_ctz(matches);
+			uint32_t ix = g * GROUP_SZ + i;
+			uint8_t* slot = slot_at(h, t, ix);
+
+			if (memcmp(slot, key, h->key_size) == 0) {
+				if (p_ix) {
+					*p_ix = ix;
+				}
+
+				return slot;
+			}
+
+			matches &= matches - 1;
+		}
+
+		// An empty slot means the key was never pushed past this group.
+		if (match_tags(group, TAG_EMPTY) != 0) {
+			return NULL;
+		}
+
+		g = (g + 1) & mask;
+	}
+
+	return NULL;
+}
+
+// Caller guarantees there's room.
+static uint32_t
+table_free_ix(const cf_oahash_table* t, uint32_t hv)
+{
+	uint32_t mask = t->n_groups - 1;
+	uint32_t g = hv & mask;
+
+	while (true) {
+		const uint8_t* group = t->tags + ((size_t)g * GROUP_SZ);
+		uint32_t free_mask = match_tags(group, TAG_EMPTY) |
+				match_tags(group, TAG_DELETED);
+
+		if (free_mask != 0) {
+			return g * GROUP_SZ + (uint32_t)__builtin_ctz(free_mask);
+		}
+
+		g = (g + 1) & mask;
+	}
+}
+
+static void
+table_insert(const cf_oahash* h, cf_oahash_table* t, const void* key,
+		const void* value, uint32_t hv)
+{
+	uint32_t ix = table_free_ix(t, hv);
+	uint8_t* slot = slot_at(h, t, ix);
+
+	if (t->tags[ix] == TAG_EMPTY) {
+		t->n_used++;
+	}
+
+	memcpy(slot, key, h->key_size);
+	memcpy(slot + h->key_size, value, h->value_size);
+	t->tags[ix] = hash_tag(hv);
+	t->n_elements++;
+}
+
+// Caller holds the lock. Rebuilds into a fresh table - bigger, unless it's
+// mostly deleted markers - so existing readers are never disturbed mid-probe.
+static void
+grow_if_needed(cf_oahash* h)
+{
+	cf_oahash_table* t = h->table;
+	uint32_t n_slots = t->n_groups * GROUP_SZ;
+
+	if (t->n_used + 1 <= n_slots - n_slots / 8) {
+		return;
+	}
+
+	uint32_t n_groups = t->n_elements + 1 > n_slots / 2 ?
+			t->n_groups * 2 : t->n_groups;
+	cf_oahash_table* new_t = table_create(h, n_groups);
+
+	for (uint32_t ix = 0; ix < n_slots; ix++) {
+		if ((t->tags[ix] & TAG_LIVE_BIT) == 0) {
+			continue;
+		}
+
+		uint8_t* slot = slot_at(h, t, ix);
+
+		table_insert(h, new_t, slot, slot + h->key_size,
+				mix_hash(h->h_fn(slot)));
+	}
+
+	__atomic_store_n(&h->table, new_t, __ATOMIC_RELEASE);
+
+	// Leave the old table permanently odd - its readers reload the pointer.
+	write_begin(t);
+
+	t->next_retired = h->retired;
+	h->retired = t;
+}
+
+static void
+write_begin(cf_oahash_table* t)
+{
+	__atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+write_end(cf_oahash_table* t)
+{
+	__atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,400 @@
+/*
+ * obj_pool.c
+ *
+ * Copyright (C) 2018 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+//==========================================================
+// Includes.
+//
+
+#include "obj_pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+
+#include "enhanced_alloc.h"
+#include "fault.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Smallest class is 64 bytes, largest 8K - both including the block header.
+#define MIN_CLASS_SHIFT 6
+#define N_CLASSES 8
+#define MAX_CLASS_SZ (1 << (MIN_CLASS_SHIFT + N_CLASSES - 1))
+
+#define NO_CLASS 0xFF // block came straight from the heap
+
+#define BLOCK_MAGIC 0x706F6F6C // "pool"
+
+// Per-thread list length that triggers a move to the depot, and how many
+// objects move.
+#define CACHE_MAX 64
+#define BATCH_SZ 32
+
+// Depot bound per size class.
+#define DEPOT_MAX_BYTES (16 * 1024 * 1024)
+
+// Precedes every object. Keeps the object 16-byte aligned, and leaves room
+// for a cf_rc_header immediately before the object.
+typedef struct block_hdr_s {
+	uint32_t class_ix;
+	uint32_t magic;
+	cf_rc_header rc_hdr; // only used by cf_pool_rc_... objects
+} block_hdr;
+
+// Overlays a free block.
+typedef struct free_block_s {
+	struct free_block_s* next;
+	struct free_block_s* next_batch; // only meaningful at depot
+} free_block;
+
+typedef struct free_list_s {
+	free_block* head;
+	uint32_t n;
+} free_list;
+
+typedef struct thread_cache_s {
+	free_list lists[N_CLASSES];
+	bool registered;
+} thread_cache;
+
+typedef struct depot_s {
+	pthread_mutex_t lock;
+	free_block* batches;
+	uint32_t n_batches;
+} depot;
+
+
+//==========================================================
+// Globals.
+//
+
+static __thread thread_cache g_cache;
+
+static depot g_depots[N_CLASSES] = {
+		[0 ... N_CLASSES - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+
+static cf_atomic64 g_held_bytes = 0;
+static cf_atomic64 g_depot_bytes = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* block_alloc(size_t sz);
+static block_hdr* block_from_obj(void* p);
+static void block_free(block_hdr* b);
+static uint32_t size_to_class(size_t sz);
+static void refill(uint32_t ix);
+static void spill(uint32_t ix, uint32_t n);
+static void key_create(void);
+static void cache_register(void);
+static void cache_flush(void* udata);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline size_t
+class_sz(uint32_t ix)
+{
+	return (size_t)1 << (MIN_CLASS_SHIFT + ix);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+void*
+cf_pool_alloc(size_t sz)
+{
+	return (block_hdr*)block_alloc(sz) + 1;
+}
+
+void
+cf_pool_free(void* p)
+{
+	block_free(block_from_obj(p));
+}
+
+void*
+cf_pool_rc_alloc(size_t sz)
+{
+	block_hdr* b = block_alloc(sz);
+
+	b->rc_hdr.rc = 1;
+	b->rc_hdr.sz = (uint32_t)sz;
+
+	return b + 1;
+}
+
+void
+cf_pool_rc_free(void* p)
+{
+	block_free(block_from_obj(p));
+}
+
+// Held counts everything the pool got from the heap and hasn't returned,
+// including objects in use. Thread lists aren't counted as depot - they're
+// bounded by CACHE_MAX per class per thread.
+void
+cf_pool_stats(size_t* held_kbytes, size_t* depot_kbytes)
+{
+	*held_kbytes = (size_t)cf_atomic64_get(g_held_bytes) / 1024;
+	*depot_kbytes = (size_t)cf_atomic64_get(g_depot_bytes) / 1024;
+}
+
+
+//==========================================================
+// Local helpers - blocks.
+//
+
+static void*
+block_alloc(size_t sz)
+{
+	uint32_t ix = size_to_class(sizeof(block_hdr) + sz);
+	block_hdr* b;
+
+	if (ix == NO_CLASS) {
+		b = cf_malloc(sizeof(block_hdr) + sz);
+		cf_assert(b, CF_ALLOC, "pool alloc %zu failed", sz);
+	}
+	else {
+		free_list* list = &g_cache.lists[ix];
+
+		if (! list->head) {
+			refill(ix);
+		}
+
+		if (list->head) {
+			b = (block_hdr*)list->head;
+			list->head = list->head->next;
+			list->n--;
+		}
+		else {
+			b = cf_malloc(class_sz(ix));
+			cf_assert(b, CF_ALLOC, "pool alloc %zu failed", sz);
+			cf_atomic64_add(&g_held_bytes, (int64_t)class_sz(ix));
+		}
+	}
+
+	b->class_ix = ix;
+	b->magic = BLOCK_MAGIC;
+
+	return b;
+}
+
+static block_hdr*
+block_from_obj(void* p)
+{
+	cf_assert(p, CF_ALLOC, "pool free of null pointer");
+
+	block_hdr* b = (block_hdr*)p - 1;
+
+	cf_assert(b->magic == BLOCK_MAGIC, CF_ALLOC, "pool free of non-pool pointer %p",
+			p);
+
+	return b;
+}
+
+static void
+block_free(block_hdr* b)
+{
+	uint32_t ix = b->class_ix;
+
+	b->magic = 0;
+
+	if (ix == NO_CLASS) {
+		cf_free(b);
+		return;
+	}
+
+	if (! g_cache.registered) {
+		cache_register();
+	}
+
+	free_list* list = &g_cache.lists[ix];
+	free_block* fb = (free_block*)b;
+
+	fb->next = list->head;
+	list->head = fb;
+
+	if (++list->n > CACHE_MAX) {
+		spill(ix, BATCH_SZ);
+	}
+}
+
+static uint32_t
+size_to_class(size_t sz)
+{
+	if (sz > MAX_CLASS_SZ) {
+		return NO_CLASS;
+	}
+
+	uint32_t ix = 0;
+
+	while (class_sz(ix) < sz) {
+		ix++;
+	}
+
+	return ix;
+}
+
+
+//==========================================================
+// Local helpers - depot.
+//
+
+static void
+refill(uint32_t ix)
+{
+	depot* d = &g_depots[ix];
+
+	if (d->n_batches == 0) {
+		return; // unlocked peek - worst case we allocate from the heap
+	}
+
+	pthread_mutex_lock(&d->lock);
+
+	free_block* batch = d->batches;
+
+	if (batch) {
+		d->batches = batch->next_batch;
+		d->n_batches--;
+	}
+
+	pthread_mutex_unlock(&d->lock);
+
+	if (batch) {
+		if (! g_cache.registered) {
+			cache_register();
+		}
+
+		free_list* list = &g_cache.lists[ix];
+
+		list->head = batch;
+		list->n = BATCH_SZ;
+		cf_atomic64_sub(&g_depot_bytes, (int64_t)(BATCH_SZ * class_sz(ix)));
+	}
+}
+
+// Moves n objects (n <= BATCH_SZ) from the thread's list to the depot, or to
+// the heap if the depot is full or n isn't a full batch.
+static void
+spill(uint32_t ix, uint32_t n)
+{
+	free_list* list = &g_cache.lists[ix];
+	free_block* batch = list->head;
+	free_block* last = batch;
+
+	for (uint32_t i = 1; i < n; i++) {
+		last = last->next;
+	}
+
+	list->head = last->next;
+	list->n -= n;
+	last->next = NULL;
+
+	depot* d = &g_depots[ix];
+	size_t batch_bytes = BATCH_SZ * class_sz(ix);
+	bool stored = false;
+
+	if (n == BATCH_SZ) {
+		pthread_mutex_lock(&d->lock);
+
+		if ((d->n_batches + 1) * batch_bytes <= DEPOT_MAX_BYTES) {
+			batch->next_batch = d->batches;
+			d->batches = batch;
+			d->n_batches++;
+			stored = true;
+		}
+
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	if (stored) {
+		cf_atomic64_add(&g_depot_bytes, (int64_t)batch_bytes);
+		return;
+	}
+
+	while (batch) {
+		free_block* next = batch->next;
+
+		cf_free(batch);
+		batch = next;
+	}
+
+	cf_atomic64_sub(&g_held_bytes, (int64_t)(n * class_sz(ix)));
+}
+
+
+//==========================================================
+// Local helpers - thread exit.
+//
+
+static void
+key_create(void)
+{
+	if (pthread_key_create(&g_key, cache_flush) != 0) {
+		cf_crash(CF_ALLOC, "pool failed to create thread key");
+	}
+}
+
+// Only threads that free objects or refill from the depot can be left holding
+// any - register those so their lists are flushed on exit.
+static void
+cache_register(void)
+{
+	pthread_once(&g_key_once, key_create);
+	pthread_setspecific(g_key, &g_cache);
+	g_cache.registered = true;
+}
+
+static void
+cache_flush(void* udata)
+{
+	(void)udata;
+
+	for (uint32_t ix = 0; ix < N_CLASSES; ix++) {
+		free_list* list = &g_cache.lists[ix];
+
+		while (list->n != 0) {
+			spill(ix, list->n < BATCH_SZ ? list->n : BATCH_SZ);
+		}
+	}
+
+	g_cache.registered = false;
+}
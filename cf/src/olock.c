@@ -49,14 +49,15 @@ olock *g_record_locks;
 // ASSUMES d is DIGEST and ol is OLOCK *
 //
 
-#define OLOCK_HASH(__ol, __d) ( ( (__d->digest[2] << 8) | (__d->digest[3]) ) & __ol->mask )
+// Bytes 2 to 5 - allows up to 4G locks, though OLOCK_MAX_LOCKS is plenty.
+#define OLOCK_HASH(__ol, __d) ( ( ((uint32_t)__d->digest[2] << 24) | ((uint32_t)__d->digest[3] << 16) | ((uint32_t)__d->digest[4] << 8) | (uint32_t)__d->digest[5] ) & __ol->mask )
 
 void
 olock_lock(olock *ol, cf_digest *d)
 {
 	uint32_t n = OLOCK_HASH(ol, d);
 
-	pthread_mutex_lock(&ol->locks[n]);
+	pthread_mutex_lock(&ol->locks[n].lock);
 }
 
 void
@@ -64,19 +65,29 @@ olock_vlock(olock *ol, cf_digest *d, pthread_mutex_t **vlock)
 {
 	uint32_t n = OLOCK_HASH(ol, d);
 
-	*vlock = &ol->locks[n];
+	*vlock = &ol->locks[n].lock;
 
 	if (0 != pthread_mutex_lock(*vlock)) {
 		fprintf(stderr, "olock vlock failed\n");
 	}
 }
 
+// Returns false (without waiting) if the lock is held - including by the
+// calling thread, since the mutexes aren't recursive.
+bool
+olock_trylock(olock *ol, cf_digest *d)
+{
+	uint32_t n = OLOCK_HASH(ol, d);
+
+	return pthread_mutex_trylock(&ol->locks[n].lock) == 0;
+}
+
 void
 olock_unlock(olock *ol, cf_digest *d)
 {
 	uint32_t n = OLOCK_HASH(ol, d);
 
-	if (0 != pthread_mutex_unlock(&ol->locks[n])) {
+	if (0 != pthread_mutex_unlock(&ol->locks[n].lock)) {
 		fprintf(stderr, "olock unlock failed %d\n", errno);
 	}
 }
@@ -84,16 +95,16 @@ olock_unlock(olock *ol, cf_digest *d)
 olock *
 olock_create(uint32_t n_locks, bool mutex)
 {
-	olock *ol = cf_malloc(sizeof(olock) + (sizeof(pthread_mutex_t) * n_locks));
+	uint32_t mask = n_locks - 1;
 
-	if (! ol) {
+	if ((mask & n_locks) != 0) {
+		fprintf(stderr, "olock: make sure your number of locks is a power of 2, n_locks aint\n");
 		return 0;
 	}
 
-	uint32_t mask = n_locks - 1;
+	olock *ol = cf_valloc(sizeof(olock) + (sizeof(olock_slot) * n_locks));
 
-	if ((mask & n_locks) != 0) {
-		fprintf(stderr, "olock: make sure your number of locks is a power of 2, n_locks aint\n");
+	if (! ol) {
 		return 0;
 	}
 
@@ -102,7 +113,7 @@ olock_create(uint32_t n_locks, bool mutex)
 
 	for (int i = 0; i < n_locks; i++) {
 		if (mutex) {
-			pthread_mutex_init(&ol->locks[i], 0);
+			pthread_mutex_init(&ol->locks[i].lock, 0);
 		}
 		else {
 			fprintf(stderr, "olock: todo add reader writer locks\n");
@@ -116,7 +127,7 @@ void
 olock_destroy(olock *ol)
 {
 	for (int i = 0; i < ol->n_locks; i++) {
-		pthread_mutex_destroy(&ol->locks[i]);
+		pthread_mutex_destroy(&ol->locks[i].lock);
 	}
 
 	cf_free(ol);
@@ -36,6 +36,7 @@
 #include <unistd.h>
 
 #include <asm/types.h>
+#include <linux/filter.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <net/if.h>
@@ -401,6 +402,7 @@ void
 cf_serv_cfg_init(cf_serv_cfg *cfg)
 {
 	cfg->n_cfgs = 0;
+	cfg->reuse_port = false;
 }
 
 int32_t
@@ -593,6 +595,57 @@ cf_socket_set_window(cf_socket *sock, int32_t size)
 	safe_setsockopt(sock->fd, SOL_TCP, TCP_WINDOW_CLAMP, &size, sizeof(size));
 }
 
+// Spin in the kernel for up to us microseconds waiting for packets when a
+// read would block. Raising it above net.core.busy_read needs CAP_NET_ADMIN,
+// so failure isn't fatal.
+bool
+cf_socket_set_busy_poll(cf_socket *sock, int32_t us)
+{
+	if (setsockopt(sock->fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0) {
+		cf_debug(CF_SOCKET, "can't set SO_BUSY_POLL on FD %d: %d (%s)",
+				sock->fd, errno, cf_strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+// For a SO_REUSEPORT group, hand each new connection to the listener whose
+// index matches the OS CPU that took the connection's packets - listener k
+// for os_cpus[k]. Connections arriving on other CPUs fall back to the
+// kernel's hash. Attach to any one listener of the group.
+bool
+cf_socket_steer_by_cpu(cf_socket *sock, const uint16_t *os_cpus,
+		uint32_t n_shards)
+{
+	uint32_t n_ops = 1 + (2 * n_shards) + 1;
+	struct sock_filter ops[n_ops];
+	uint32_t n = 0;
+
+	ops[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+			(uint32_t)(SKF_AD_OFF + SKF_AD_CPU));
+
+	for (uint32_t i = 0; i < n_shards; i++) {
+		ops[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+				os_cpus[i], 0, 1);
+		ops[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+	}
+
+	// Out of range - the kernel picks by hash.
+	ops[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+	struct sock_fprog prog = { .len = (unsigned short)n, .filter = ops };
+
+	if (setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+			sizeof(prog)) < 0) {
+		cf_warning(CF_SOCKET, "can't attach CPU steering to FD %d: %d (%s)",
+				sock->fd, errno, cf_strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
 void
 cf_socket_init(cf_socket *sock)
 {
@@ -659,6 +712,10 @@ cf_socket_init_server(cf_serv_cfg *cfg, cf_sockets *socks)
 		static const int32_t flag = 1;
 		safe_setsockopt(sock->fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
 
+		if (cfg->reuse_port) {
+			safe_setsockopt(sock->fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+		}
+
 		while (bind(sock->fd, (struct sockaddr *)&sas,
 				cf_socket_addr_len((struct sockaddr *)&sas)) < 0) {
 			if (errno != EADDRINUSE) {
@@ -917,7 +974,7 @@ cf_socket_available(cf_socket *sock)
 int32_t
 cf_socket_send_to(cf_socket *sock, const void *buff, size_t size, int32_t flags, const cf_sock_addr *addr)
 {
-	cf_assert(sock->ssl == NULL, CF_SOCKET, "cannot use cf_socket_send_to() with TLS");
+	cf_assert(! tls_socket_owns_send(sock), CF_SOCKET, "cannot use cf_socket_send_to() with TLS");
 
 	struct sockaddr_storage sas;
 	struct sockaddr *sa = NULL;
@@ -942,7 +999,7 @@ cf_socket_send_to(cf_socket *sock, const void *buff, size_t size, int32_t flags,
 int32_t
 cf_socket_send(cf_socket *sock, const void *buff, size_t size, int32_t flags)
 {
-	if (sock->ssl) {
+	if (tls_socket_owns_send(sock)) {
 		ssize_t rv = tls_socket_send(sock, buff, size, flags, 0);
 		if (rv < 0) {
 			// errno is set by tls_socket_send.
@@ -961,6 +1018,28 @@ cf_socket_send(cf_socket *sock, const void *buff, size_t size, int32_t flags)
 	}
 }
 
+// Non-blocking gather send - may be partial, as for cf_socket_send().
+int32_t
+cf_socket_send_iov(cf_socket *sock, const struct iovec *iov, uint32_t n_iov,
+		int32_t flags)
+{
+	if (tls_socket_owns_send(sock)) {
+		// No gather write with TLS - send the first piece.
+		return cf_socket_send(sock, iov[0].iov_base, iov[0].iov_len, flags);
+	}
+
+	struct msghdr mh = { .msg_iov = (struct iovec *)iov, .msg_iovlen = n_iov };
+	ssize_t res = sendmsg(sock->fd, &mh, flags | MSG_NOSIGNAL);
+
+	if (res < 0) {
+		cf_debug(CF_SOCKET, "Error while sending on FD %d: %d (%s)",
+				sock->fd, errno, cf_strerror(errno));
+		return -1;
+	}
+
+	return (int32_t)res;
+}
+
 int32_t
 cf_socket_recv_from(cf_socket *sock, void *buff, size_t size, int32_t flags, cf_sock_addr *addr)
 {
@@ -1048,7 +1127,7 @@ int32_t
 cf_socket_send_to_all(cf_socket *sock, const void *buffp, size_t size, int32_t flags,
 		const cf_sock_addr *addr, int32_t timeout)
 {
-	cf_assert(sock->ssl == NULL, CF_SOCKET, "cannot use cf_socket_send_to_all() with TLS");
+	cf_assert(! tls_socket_owns_send(sock), CF_SOCKET, "cannot use cf_socket_send_to_all() with TLS");
 
 	uint8_t *buff = (uint8_t *) buffp;
 	cf_detail(CF_SOCKET, "Blocking send on FD %d, size = %zu", sock->fd, size);
@@ -1091,7 +1170,7 @@ int32_t
 cf_socket_send_all(cf_socket *sock, const void *buff, size_t size, int32_t flags,
 		int32_t timeout)
 {
-	if (sock->ssl) {
+	if (tls_socket_owns_send(sock)) {
 		return tls_socket_send(sock, buff, size, flags, timeout);
 	}
 	else {
@@ -1099,6 +1178,71 @@ cf_socket_send_all(cf_socket *sock, const void *buff, size_t size, int32_t flags
 	}
 }
 
+// Note - advances through (and so modifies) the caller's iovecs.
+int32_t
+cf_socket_send_iov_all(cf_socket *sock, struct iovec *iov, uint32_t n_iov,
+		int32_t flags, int32_t timeout)
+{
+	if (tls_socket_owns_send(sock)) {
+		// No gather write with TLS - send the pieces in turn.
+		for (uint32_t i = 0; i < n_iov; i++) {
+			if (tls_socket_send(sock, iov[i].iov_base, iov[i].iov_len, flags,
+					timeout) < 0) {
+				return -1;
+			}
+		}
+
+		return 0;
+	}
+
+	cf_detail(CF_SOCKET, "Blocking gather send on FD %d, %u pieces", sock->fd, n_iov);
+
+	struct msghdr mh = { .msg_iov = iov, .msg_iovlen = n_iov };
+
+	while (mh.msg_iovlen != 0) {
+		ssize_t count = sendmsg(sock->fd, &mh, flags | MSG_NOSIGNAL);
+
+		if (count < 0) {
+			if (errno == EAGAIN) {
+				cf_debug(CF_SOCKET, "FD %d is blocking", sock->fd);
+
+				if (socket_wait(sock, POLLOUT, timeout)) {
+					continue;
+				}
+
+				cf_debug(CF_SOCKET, "Timeout during blocking gather send on FD %d", sock->fd);
+				errno = ETIMEDOUT;
+				return -1;
+			}
+
+			cf_debug(CF_SOCKET, "Error while sending on FD %d: %d (%s)",
+					sock->fd, errno, cf_strerror(errno));
+			return -1;
+		}
+
+		if (count == 0) {
+			cf_warning(CF_SOCKET, "Sent 0 bytes on FD %d", sock->fd);
+			errno = ENOTCONN;
+			return -1;
+		}
+
+		// Skip the pieces that went, and the part of the next that did.
+		while (mh.msg_iovlen != 0 && (size_t)count >= mh.msg_iov->iov_len) {
+			count -= mh.msg_iov->iov_len;
+			mh.msg_iov++;
+			mh.msg_iovlen--;
+		}
+
+		if (count != 0) {
+			mh.msg_iov->iov_base = (uint8_t *)mh.msg_iov->iov_base + count;
+			mh.msg_iov->iov_len -= count;
+		}
+	}
+
+	cf_detail(CF_SOCKET, "Blocking gather send on FD %d complete", sock->fd);
+	return 0;
+}
+
 int32_t
 cf_socket_recv_from_all(cf_socket *sock, void *buffp, size_t size, int32_t flags,
 		cf_sock_addr *addr, int32_t timeout)
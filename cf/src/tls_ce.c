@@ -44,6 +44,7 @@ void
 tls_socket_init(cf_socket *sock)
 {
 	sock->ssl = NULL;
+	sock->ktls_send = false;
 }
 
 void
@@ -0,0 +1,376 @@
+/*
+ * uring.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include "uring.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+
+#include "fault.h"
+
+
+#if defined(USE_IO_URING)
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+struct cf_uring_s {
+	int fd;
+	uint32_t depth;
+
+	uint32_t n_inflight; // queued or submitted, but not yet reaped
+	uint32_t n_unsubmitted;
+
+	// Submission queue.
+	void* sq_map;
+	size_t sq_map_sz;
+	uint32_t* sq_head;
+	uint32_t* sq_tail;
+	uint32_t sq_mask;
+	uint32_t* sq_array;
+
+	struct io_uring_sqe* sqes;
+	size_t sqes_sz;
+
+	// Completion queue.
+	void* cq_map;
+	size_t cq_map_sz;
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe* cqes;
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool queue_op(cf_uring* ring, uint8_t opcode, int fd, const void* buf, uint32_t size, uint64_t offset, void* udata);
+
+
+//==========================================================
+// Public API.
+//
+
+cf_uring*
+cf_uring_create(uint32_t depth)
+{
+	if (depth == 0 || depth > CF_URING_MAX_DEPTH) {
+		cf_warning(CF_MISC, "bad io_uring depth %u", depth);
+		return NULL;
+	}
+
+	struct io_uring_params params;
+
+	memset(&params, 0, sizeof(params));
+
+	int fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+
+	if (fd < 0) {
+		cf_warning(CF_MISC, "io_uring setup failed: errno %d (%s)", errno,
+				cf_strerror(errno));
+		return NULL;
+	}
+
+	cf_uring* ring = cf_malloc(sizeof(cf_uring));
+
+	memset(ring, 0, sizeof(cf_uring));
+
+	ring->fd = fd;
+
+	// Don't let more requests be in flight than we have completion slots for.
+	ring->depth = params.sq_entries < params.cq_entries ?
+			params.sq_entries : params.cq_entries;
+
+	ring->sq_map_sz = params.sq_off.array +
+			(params.sq_entries * sizeof(uint32_t));
+	ring->sq_map = mmap(NULL, ring->sq_map_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+	if (ring->sq_map == MAP_FAILED) {
+		cf_warning(CF_MISC, "io_uring sq map failed: errno %d (%s)", errno,
+				cf_strerror(errno));
+		close(fd);
+		cf_free(ring);
+		return NULL;
+	}
+
+	ring->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+	if (ring->sqes == MAP_FAILED) {
+		cf_warning(CF_MISC, "io_uring sqe map failed: errno %d (%s)", errno,
+				cf_strerror(errno));
+		munmap(ring->sq_map, ring->sq_map_sz);
+		close(fd);
+		cf_free(ring);
+		return NULL;
+	}
+
+	ring->cq_map_sz = params.cq_off.cqes +
+			(params.cq_entries * sizeof(struct io_uring_cqe));
+	ring->cq_map = mmap(NULL, ring->cq_map_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+	if (ring->cq_map == MAP_FAILED) {
+		cf_warning(CF_MISC, "io_uring cq map failed: errno %d (%s)", errno,
+				cf_strerror(errno));
+		munmap(ring->sqes, ring->sqes_sz);
+		munmap(ring->sq_map, ring->sq_map_sz);
+		close(fd);
+		cf_free(ring);
+		return NULL;
+	}
+
+	uint8_t* sq = (uint8_t*)ring->sq_map;
+
+	ring->sq_head = (uint32_t*)(sq + params.sq_off.head);
+	ring->sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+	ring->sq_mask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+
+	uint8_t* cq = (uint8_t*)ring->cq_map;
+
+	ring->cq_head = (uint32_t*)(cq + params.cq_off.head);
+	ring->cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+	ring->cq_mask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return ring;
+}
+
+
+void
+cf_uring_destroy(cf_uring* ring)
+{
+	munmap(ring->cq_map, ring->cq_map_sz);
+	munmap(ring->sqes, ring->sqes_sz);
+	munmap(ring->sq_map, ring->sq_map_sz);
+	close(ring->fd);
+	cf_free(ring);
+}
+
+
+bool
+cf_uring_queue_read(cf_uring* ring, int fd, void* buf, uint32_t size,
+		uint64_t offset, void* udata)
+{
+	return queue_op(ring, IORING_OP_READ, fd, buf, size, offset, udata);
+}
+
+
+bool
+cf_uring_queue_write(cf_uring* ring, int fd, const void* buf, uint32_t size,
+		uint64_t offset, void* udata)
+{
+	return queue_op(ring, IORING_OP_WRITE, fd, buf, size, offset, udata);
+}
+
+
+// Returns number of requests handed to the kernel, or -1 on error. If
+// min_complete is non-zero, blocks until at least that many completions are
+// available to reap.
+int
+cf_uring_submit(cf_uring* ring, uint32_t min_complete)
+{
+	if (ring->n_unsubmitted == 0 && min_complete == 0) {
+		return 0;
+	}
+
+	uint32_t flags = min_complete != 0 ? IORING_ENTER_GETEVENTS : 0;
+
+	while (true) {
+		int rv = (int)syscall(__NR_io_uring_enter, ring->fd,
+				ring->n_unsubmitted, min_complete, flags, NULL, 0);
+
+		if (rv >= 0) {
+			ring->n_unsubmitted -= (uint32_t)rv;
+			return rv;
+		}
+
+		if (errno != EINTR) {
+			cf_warning(CF_MISC, "io_uring enter failed: errno %d (%s)", errno,
+					cf_strerror(errno));
+			return -1;
+		}
+	}
+}
+
+
+// Returns false if there's no completion to reap. The result is as for the
+// synchronous call - bytes transferred, or a negative errno.
+bool
+cf_uring_reap(cf_uring* ring, void** udata, int32_t* res)
+{
+	uint32_t head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+
+	*udata = (void*)cqe->user_data;
+	*res = cqe->res;
+
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	ring->n_inflight--;
+
+	return true;
+}
+
+
+uint32_t
+cf_uring_n_inflight(const cf_uring* ring)
+{
+	return ring->n_inflight;
+}
+
+
+uint32_t
+cf_uring_n_free(const cf_uring* ring)
+{
+	return ring->depth - ring->n_inflight;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+queue_op(cf_uring* ring, uint8_t opcode, int fd, const void* buf,
+		uint32_t size, uint64_t offset, void* udata)
+{
+	if (ring->n_inflight == ring->depth) {
+		return false;
+	}
+
+	uint32_t tail = *ring->sq_tail;
+	uint32_t ix = tail & ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqes[ix];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)buf;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->user_data = (uint64_t)udata;
+
+	ring->sq_array[ix] = ix;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	ring->n_inflight++;
+	ring->n_unsubmitted++;
+
+	return true;
+}
+
+#else // ! USE_IO_URING
+
+//==========================================================
+// Public API - stubs when built without io_uring support.
+//
+
+cf_uring*
+cf_uring_create(uint32_t depth)
+{
+	cf_warning(CF_MISC, "server not built with io_uring support (USE_IO_URING=1)");
+	return NULL;
+}
+
+
+void
+cf_uring_destroy(cf_uring* ring)
+{
+}
+
+
+bool
+cf_uring_queue_read(cf_uring* ring, int fd, void* buf, uint32_t size,
+		uint64_t offset, void* udata)
+{
+	return false;
+}
+
+
+bool
+cf_uring_queue_write(cf_uring* ring, int fd, const void* buf, uint32_t size,
+		uint64_t offset, void* udata)
+{
+	return false;
+}
+
+
+int
+cf_uring_submit(cf_uring* ring, uint32_t min_complete)
+{
+	return -1;
+}
+
+
+bool
+cf_uring_reap(cf_uring* ring, void** udata, int32_t* res)
+{
+	return false;
+}
+
+
+uint32_t
+cf_uring_n_inflight(const cf_uring* ring)
+{
+	return 0;
+}
+
+
+uint32_t
+cf_uring_n_free(const cf_uring* ring)
+{
+	return 0;
+}
+
+#endif // USE_IO_URING
@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_hash_math.h"
 
 
@@ -293,65 +294,138 @@ cf_vmapx_value_ptr(const cf_vmapx* this, uint32_t index)
 
 // Custom hashmap for cf_vmapx usage.
 // - Elements are added but never removed.
-// - It's thread safe yet lockless. (Relies on cf_vmapx's write_lock.)
-// - Element keys are null-terminated strings.
+// - Readers are lockless and never write shared memory. Writers rely on
+//   cf_vmapx's write_lock.
+// - Element keys point at the names in the cf_vmapx vector - not copied.
 // - Element values are uint32_t's.
+//
+// Readers use a perfect-hash snapshot - one hash, and at most one compare.
+// Names added since the snapshot was built go in the snapshot's small
+// insert-only probe table, until it fills and a new snapshot is published.
+// Replaced snapshots are freed once no reader could still be using them.
 
-struct vhash_s {
-	uint32_t key_size;
-	uint32_t ele_size;
-	uint32_t n_rows;
-	uint8_t* table;
-	bool row_usage[];
-};
+#define VHASH_CHUNK_SHIFT		10
+#define VHASH_CHUNK_SIZE		(1 << VHASH_CHUNK_SHIFT)
+#define VHASH_MAX_CHUNKS		1024
+
+// A snapshot takes this many names (or 1/16th of its own count, if more)
+// before it's replaced - rebuild work stays linear in the number of names.
+#define VHASH_MIN_RECENT		16
+#define VHASH_RECENT_SHIFT		4
+
+#define VHASH_MAX_DISP			(64 * 1024)
+#define VHASH_MAX_BUILD_TRIES	32
+
+// Far longer than any lookup holds a snapshot.
+#define VHASH_RETIRE_GRACE_MS	1000
 
 typedef struct vhash_ele_s {
-	struct vhash_ele_s* next;
-	uint8_t data[]; // key_size bytes of key, 4 bytes of value
+	const char* key;
+	uint32_t key_len;
+	uint32_t value;
 } vhash_ele;
 
-#define VHASH_ELE_KEY_PTR(_e)		((char*)_e->data)
-#define VHASH_ELE_VALUE_PTR(_h, _e)	((uint32_t*)(_e->data + _h->key_size))
+typedef struct vsnap_s {
+	struct vsnap_s* next_retired;
+	uint64_t retire_ms;
+
+	uint32_t n_built; // elements in the perfect-hash part
+	uint32_t seed;
+	uint32_t bucket_mask;
+	uint32_t slot_mask;
+	uint16_t* disp; // per bucket
+	uint32_t* slots; // element index + 1, 0 if empty
+
+	// Names added after the build - linear probing, written only under lock.
+	uint32_t n_recent;
+	uint32_t max_recent;
+	uint32_t recent_mask;
+	uint32_t* recent; // element index + 1, 0 if empty
+} vsnap;
+
+struct vhash_s {
+	vsnap* snap; // never null once created
+	vsnap* retired;
+	uint32_t n_eles;
+	vhash_ele* chunks[VHASH_MAX_CHUNKS];
+};
+
+static inline vhash_ele*
+vhash_ele_at(const vhash* h, uint32_t ix)
+{
+	return &h->chunks[ix >> VHASH_CHUNK_SHIFT][ix & (VHASH_CHUNK_SIZE - 1)];
+}
+
+static inline bool
+vhash_ele_match(const vhash_ele* e, const char* key, size_t key_len)
+{
+	return e->key_len == key_len && memcmp(e->key, key, key_len) == 0;
+}
+
+// Elements visible through this snapshot.
+static inline uint32_t
+vsnap_n_eles(const vsnap* s)
+{
+	return s->n_built + s->n_recent;
+}
+
+static inline uint64_t
+vhash_mix(uint64_t hashed_key, uint32_t seed)
+{
+	uint64_t x = hashed_key ^ ((uint64_t)seed * 0x9E3779B97F4A7C15UL);
+
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDUL;
+	x ^= x >> 33;
+
+	return x;
+}
 
-// Copy null-terminated key into hash, then pad with non-null characters.
-// Padding ensures quicker compare in vhash_get() when key in hash is shorter,
-// and prevents accidental match if key param has illegal null character(s).
-static inline void
-vhash_set_ele_key(char* ele_key, size_t key_size, const char* zkey,
-		size_t zkey_size)
+static inline uint32_t
+vsnap_bucket(const vsnap* s, uint64_t x)
 {
-	memcpy((void*)ele_key, (const void*)zkey, zkey_size);
-	memset((void*)(ele_key + zkey_size), 'x', key_size - zkey_size);
+	return (uint32_t)(x >> 32) & s->bucket_mask;
 }
 
+static inline uint32_t
+vsnap_slot(const vsnap* s, uint64_t x, uint32_t disp)
+{
+	uint32_t f1 = (uint32_t)x;
+	uint32_t f2 = (uint32_t)((x * 0xC4CEB9FE1A85EC53UL) >> 32) | 1;
+
+	return (f1 + disp * f2) & s->slot_mask;
+}
+
+static bool vhash_add(vhash* h, const char* key, size_t key_len, uint32_t value);
+static bool vhash_add_recent(vhash* h, uint32_t ele_i, uint64_t hashed_key);
+static vsnap* vsnap_build(const vhash* h, uint32_t n_eles);
+static bool vsnap_try_build(vsnap* s, const uint64_t* hashes, uint32_t* bucket_start, uint32_t* members, uint32_t* order);
+static void vsnap_destroy(vsnap* s);
+
 //------------------------------------------------
-// Create vhash with specified key size (max) and
-// number or rows.
+// Create empty vhash. Tables are sized from the
+// names they hold, so key_size and n_rows are
+// only kept for API compatibility.
 //
 vhash*
 vhash_create(uint32_t key_size, uint32_t n_rows)
 {
-	size_t row_usage_size = n_rows * sizeof(bool);
-	vhash* h = (vhash*)cf_malloc(sizeof(vhash) + row_usage_size);
+	(void)key_size;
+	(void)n_rows;
+
+	vhash* h = (vhash*)cf_malloc(sizeof(vhash));
 
 	if (! h) {
 		return NULL;
 	}
 
-	h->key_size = key_size;
-	h->ele_size = sizeof(vhash_ele) + key_size + sizeof(uint32_t);
-	h->n_rows = n_rows;
-
-	size_t table_size = n_rows * h->ele_size;
+	memset((void*)h, 0, sizeof(vhash));
 
-	if (! (h->table = (uint8_t*)cf_malloc(table_size))) {
+	if (! (h->snap = vsnap_build(h, 0))) {
 		cf_free(h);
 		return NULL;
 	}
 
-	memset((void*)h->row_usage, 0, row_usage_size);
-	memset((void*)h->table, 0, table_size);
-
 	return h;
 }
 
@@ -361,71 +435,101 @@ vhash_create(uint32_t key_size, uint32_t n_rows)
 void
 vhash_destroy(vhash* h)
 {
-	vhash_ele* e_table = (vhash_ele*)h->table;
-
-	for (uint32_t i = 0; i < h->n_rows; i++) {
-		if (e_table->next) {
-			vhash_ele* e = e_table->next;
+	vsnap_destroy(h->snap);
 
-			while (e) {
-				vhash_ele* t = e->next;
+	while (h->retired) {
+		vsnap* s = h->retired;
 
-				cf_free(e);
-				e = t;
-			}
-		}
+		h->retired = s->next_retired;
+		vsnap_destroy(s);
+	}
 
-		e_table = (vhash_ele*)((uint8_t*)e_table + h->ele_size);
+	for (uint32_t i = 0; i < VHASH_MAX_CHUNKS && h->chunks[i]; i++) {
+		cf_free(h->chunks[i]);
 	}
 
-	cf_free(h->table);
 	cf_free(h);
 }
 
 //------------------------------------------------
-// Add element. Key must be null-terminated,
-// although its length is known.
+// Add element. Key must stay valid for the life
+// of the vhash.
 //
 bool
 vhash_put(vhash* h, const char* zkey, size_t key_len, uint32_t value)
 {
-	uint64_t hashed_key = cf_hash_fnv32((const uint8_t*)zkey, key_len);
-	uint32_t row_i = (uint32_t)(hashed_key % h->n_rows);
+	if (! vhash_add(h, zkey, key_len, value)) {
+		return false;
+	}
 
-	vhash_ele* e = (vhash_ele*)(h->table + (h->ele_size * row_i));
+	uint32_t ele_i = h->n_eles - 1;
 
-	if (! h->row_usage[row_i]) {
-		vhash_set_ele_key(VHASH_ELE_KEY_PTR(e), h->key_size, zkey, key_len + 1);
-		*VHASH_ELE_VALUE_PTR(h, e) = value;
-		// TODO - need barrier?
+	if (vsnap_n_eles(h->snap) == ele_i &&
+			vhash_add_recent(h, ele_i,
+					cf_hash_fnv64((const uint8_t*)zkey, key_len))) {
+		return true;
+	}
 
-		h->row_usage[row_i] = true;
+	// Snapshot's probe table is full (or bulk-loaded elements are pending).
+	// If the build fails, the element is still recorded - it will show up
+	// with the next successful publish.
+	vhash_publish(h);
 
-		return true;
+	return true;
+}
+
+//------------------------------------------------
+// Like vhash_put(), but the element isn't visible
+// until vhash_publish() - for bulk loading.
+//
+bool
+vhash_load(vhash* h, const char* zkey, size_t key_len, uint32_t value)
+{
+	return vhash_add(h, zkey, key_len, value);
+}
+
+//------------------------------------------------
+// Index all elements added so far in a new
+// snapshot. If the build fails, the old snapshot
+// stays, and new elements stay invisible.
+//
+void
+vhash_publish(vhash* h)
+{
+	uint32_t n_eles = h->n_eles;
+
+	if (h->snap->n_built == n_eles) {
+		return;
 	}
 
-	vhash_ele* e_head = e;
+	vsnap* s = vsnap_build(h, n_eles);
 
-	// This function is always called under write lock, after get, so we'll
-	// never encounter the key - don't bother checking it.
-	while (e) {
-		e = e->next;
+	if (! s) {
+		return;
 	}
 
-	e = (vhash_ele*)cf_malloc(h->ele_size);
+	vsnap* old = h->snap;
 
-	if (! e) {
-		return false;
+	__atomic_store_n(&h->snap, s, __ATOMIC_RELEASE);
+
+	uint64_t now = cf_getms();
+	vsnap** p_prev = &h->retired;
+
+	// Free snapshots retired long enough ago - the list is newest first.
+	while (*p_prev && now - (*p_prev)->retire_ms < VHASH_RETIRE_GRACE_MS) {
+		p_prev = &(*p_prev)->next_retired;
 	}
 
-	vhash_set_ele_key(VHASH_ELE_KEY_PTR(e), h->key_size, zkey, key_len + 1);
-	*VHASH_ELE_VALUE_PTR(h, e) = value;
-	// TODO - need barrier?
+	while (*p_prev) {
+		vsnap* t = *p_prev;
 
-	e->next = e_head->next;
-	e_head->next = e;
+		*p_prev = t->next_retired;
+		vsnap_destroy(t);
+	}
 
-	return true;
+	old->retire_ms = now;
+	old->next_retired = h->retired;
+	h->retired = old;
 }
 
 //------------------------------------------------
@@ -435,27 +539,278 @@ vhash_put(vhash* h, const char* zkey, size_t key_len, uint32_t value)
 bool
 vhash_get(const vhash* h, const char* key, size_t key_len, uint32_t* p_value)
 {
-	uint64_t hashed_key = cf_hash_fnv32((const uint8_t*)key, key_len);
-	uint32_t row_i = (uint32_t)(hashed_key % h->n_rows);
+	uint64_t hashed_key = cf_hash_fnv64((const uint8_t*)key, key_len);
+	const vsnap* s = __atomic_load_n(&h->snap, __ATOMIC_ACQUIRE);
+	uint64_t x = vhash_mix(hashed_key, s->seed);
+	uint32_t ele_i = s->slots[vsnap_slot(s, x, s->disp[vsnap_bucket(s, x)])];
+
+	if (ele_i == 0 || ! vhash_ele_match(vhash_ele_at(h, ele_i - 1), key,
+			key_len)) {
+		// Not in the perfect-hash part - check names added since the build.
+		uint32_t i = (uint32_t)hashed_key & s->recent_mask;
+
+		while ((ele_i = __atomic_load_n(&s->recent[i], __ATOMIC_ACQUIRE)) !=
+				0 && ! vhash_ele_match(vhash_ele_at(h, ele_i - 1), key,
+						key_len)) {
+			i = (i + 1) & s->recent_mask;
+		}
+
+		if (ele_i == 0) {
+			return false;
+		}
+	}
+
+	if (p_value) {
+		*p_value = vhash_ele_at(h, ele_i - 1)->value;
+	}
+
+	return true;
+}
+
+static bool
+vhash_add(vhash* h, const char* key, size_t key_len, uint32_t value)
+{
+	uint32_t ix = h->n_eles;
+	uint32_t chunk_i = ix >> VHASH_CHUNK_SHIFT;
 
-	if (! h->row_usage[row_i]) {
+	if (chunk_i >= VHASH_MAX_CHUNKS) {
 		return false;
 	}
 
-	vhash_ele* e = (vhash_ele*)(h->table + (h->ele_size * row_i));
+	if (! h->chunks[chunk_i] && ! (h->chunks[chunk_i] =
+			(vhash_ele*)cf_malloc(VHASH_CHUNK_SIZE * sizeof(vhash_ele)))) {
+		return false;
+	}
+
+	vhash_ele* e = vhash_ele_at(h, ix);
+
+	e->key = key;
+	e->key_len = (uint32_t)key_len;
+	e->value = value;
+
+	// Element (and its chunk) must be visible before the count.
+	__atomic_store_n(&h->n_eles, ix + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+// Returns false if the snapshot's probe table is full.
+static bool
+vhash_add_recent(vhash* h, uint32_t ele_i, uint64_t hashed_key)
+{
+	vsnap* s = h->snap;
 
-	while (e) {
-		if (VHASH_ELE_KEY_PTR(e)[key_len] == 0 &&
-				memcmp(VHASH_ELE_KEY_PTR(e), key, key_len) == 0) {
-			if (p_value) {
-				*p_value = *VHASH_ELE_VALUE_PTR(h, e);
+	if (s->n_recent == s->max_recent) {
+		return false;
+	}
+
+	uint32_t i = (uint32_t)hashed_key & s->recent_mask;
+
+	while (s->recent[i] != 0) {
+		i = (i + 1) & s->recent_mask;
+	}
+
+	__atomic_store_n(&s->recent[i], ele_i + 1, __ATOMIC_RELEASE);
+	s->n_recent++;
+
+	return true;
+}
+
+// Hash and displace - hash elements into buckets, then, largest buckets
+// first, find a displacement that puts every element of a bucket in an empty
+// slot. Tables are at most half full, so this rarely needs more than one seed.
+static vsnap*
+vsnap_build(const vhash* h, uint32_t n_eles)
+{
+	uint32_t n_buckets = 1;
+
+	while (n_buckets * 4 < n_eles) {
+		n_buckets <<= 1;
+	}
+
+	uint32_t n_slots = 2;
+
+	while (n_slots < n_eles * 2) {
+		n_slots <<= 1;
+	}
+
+	uint32_t max_recent = n_eles >> VHASH_RECENT_SHIFT;
+
+	if (max_recent < VHASH_MIN_RECENT) {
+		max_recent = VHASH_MIN_RECENT;
+	}
+
+	uint32_t n_recent_slots = 2;
+
+	while (n_recent_slots < max_recent * 2) {
+		n_recent_slots <<= 1;
+	}
+
+	vsnap* s = (vsnap*)cf_malloc(sizeof(vsnap));
+	uint64_t* hashes = (uint64_t*)cf_malloc(sizeof(uint64_t) * (n_eles + 1));
+	uint32_t* bucket_start =
+			(uint32_t*)cf_malloc(sizeof(uint32_t) * (n_buckets + 1));
+	uint32_t* members = (uint32_t*)cf_malloc(sizeof(uint32_t) * (n_eles + 1));
+	uint32_t* order = (uint32_t*)cf_malloc(sizeof(uint32_t) * n_buckets);
+
+	if (s) {
+		memset((void*)s, 0, sizeof(vsnap));
+
+		s->max_recent = max_recent;
+		s->recent_mask = n_recent_slots - 1;
+		s->recent = (uint32_t*)cf_malloc(sizeof(uint32_t) * n_recent_slots);
+
+		if (s->recent) {
+			memset((void*)s->recent, 0, sizeof(uint32_t) * n_recent_slots);
+		}
+	}
+
+	bool ok = s && s->recent && hashes && bucket_start && members && order;
+
+	if (ok) {
+		for (uint32_t i = 0; i < n_eles; i++) {
+			const vhash_ele* e = vhash_ele_at(h, i);
+
+			hashes[i] = cf_hash_fnv64((const uint8_t*)e->key, e->key_len);
+		}
+
+		s->n_built = n_eles;
+		s->bucket_mask = n_buckets - 1;
+		ok = false;
+
+		for (uint32_t t = 0; t < VHASH_MAX_BUILD_TRIES && ! ok; t++) {
+			// Every few failed seeds, try a sparser table.
+			if (t != 0 && t % 8 == 0) {
+				n_slots <<= 1;
+				cf_free(s->slots);
+				s->slots = NULL;
+			}
+
+			s->seed = t;
+			s->slot_mask = n_slots - 1;
+
+			if (! s->disp && ! (s->disp =
+					(uint16_t*)cf_malloc(sizeof(uint16_t) * n_buckets))) {
+				break;
 			}
 
-			return true;
+			if (! s->slots && ! (s->slots =
+					(uint32_t*)cf_malloc(sizeof(uint32_t) * n_slots))) {
+				break;
+			}
+
+			ok = vsnap_try_build(s, hashes, bucket_start, members, order);
 		}
+	}
 
-		e = e->next;
+	cf_free(hashes);
+	cf_free(bucket_start);
+	cf_free(members);
+	cf_free(order);
+
+	if (! ok && s) {
+		vsnap_destroy(s);
+		return NULL;
 	}
 
-	return false;
+	return s;
+}
+
+static bool
+vsnap_try_build(vsnap* s, const uint64_t* hashes, uint32_t* bucket_start,
+		uint32_t* members, uint32_t* order)
+{
+	uint32_t n_eles = s->n_built;
+	uint32_t n_buckets = s->bucket_mask + 1;
+
+	memset((void*)bucket_start, 0, sizeof(uint32_t) * (n_buckets + 1));
+	memset((void*)s->disp, 0, sizeof(uint16_t) * n_buckets);
+	memset((void*)s->slots, 0, sizeof(uint32_t) * (s->slot_mask + 1));
+
+	// Group elements by bucket - counting sort.
+	for (uint32_t i = 0; i < n_eles; i++) {
+		bucket_start[vsnap_bucket(s, vhash_mix(hashes[i], s->seed)) + 1]++;
+	}
+
+	uint32_t max_bucket_sz = 0;
+
+	for (uint32_t b = 0; b < n_buckets; b++) {
+		if (bucket_start[b + 1] > max_bucket_sz) {
+			max_bucket_sz = bucket_start[b + 1];
+		}
+
+		bucket_start[b + 1] += bucket_start[b];
+	}
+
+	// Use order as scratch - next insert position per bucket.
+	memcpy(order, bucket_start, sizeof(uint32_t) * n_buckets);
+
+	for (uint32_t i = 0; i < n_eles; i++) {
+		uint32_t b = vsnap_bucket(s, vhash_mix(hashes[i], s->seed));
+
+		members[order[b]++] = i;
+	}
+
+	// Order buckets biggest first - they're hardest to place.
+	uint32_t n_ordered = 0;
+
+	for (uint32_t sz = max_bucket_sz; sz != 0; sz--) {
+		for (uint32_t b = 0; b < n_buckets; b++) {
+			if (bucket_start[b + 1] - bucket_start[b] == sz) {
+				order[n_ordered++] = b;
+			}
+		}
+	}
+
+	for (uint32_t o = 0; o < n_ordered; o++) {
+		uint32_t b = order[o];
+		uint32_t first = bucket_start[b];
+		uint32_t n = bucket_start[b + 1] - first;
+		uint32_t d;
+
+		for (d = 0; d < VHASH_MAX_DISP; d++) {
+			uint32_t placed = 0;
+
+			for ( ; placed < n; placed++) {
+				uint32_t ele_i = members[first + placed];
+				uint32_t slot_i = vsnap_slot(s,
+						vhash_mix(hashes[ele_i], s->seed), d);
+
+				if (s->slots[slot_i] != 0) {
+					break;
+				}
+
+				s->slots[slot_i] = ele_i + 1;
+			}
+
+			if (placed == n) {
+				break;
+			}
+
+			// Undo partial placement.
+			for (uint32_t j = 0; j < placed; j++) {
+				uint32_t ele_i = members[first + j];
+
+				s->slots[vsnap_slot(s, vhash_mix(hashes[ele_i], s->seed),
+						d)] = 0;
+			}
+		}
+
+		if (d == VHASH_MAX_DISP) {
+			return false;
+		}
+
+		s->disp[b] = (uint16_t)d;
+	}
+
+	return true;
+}
+
+static void
+vsnap_destroy(vsnap* s)
+{
+	cf_free(s->disp);
+	cf_free(s->slots);
+	cf_free(s->recent);
+	cf_free(s);
 }
@@ -0,0 +1,67 @@
+/*
+ * vmapx_ce.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include "vmapx.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fault.h"
+
+
+//------------------------------------------------
+// Resume a cf_vmapx object whose values vector
+// was restored from an index snapshot - rebuild
+// the hash map from the names in the vector.
+//
+cf_vmapx_err
+cf_vmapx_resume(cf_vmapx* this, uint32_t value_size, uint32_t max_count,
+		uint32_t hash_size, uint32_t max_name_size)
+{
+	if (this->value_size != value_size || this->max_count != max_count ||
+			this->key_size != max_name_size || this->count > max_count) {
+		return CF_VMAPX_ERR_BAD_PARAM;
+	}
+
+	if (! (this->p_hash = vhash_create(max_name_size, hash_size))) {
+		return CF_VMAPX_ERR_UNKNOWN;
+	}
+
+	for (uint32_t i = 0; i < this->count; i++) {
+		const char* name = (const char*)cf_vmapx_value_ptr(this, i);
+		size_t name_len = strnlen(name, max_name_size);
+
+		if (name_len == max_name_size ||
+				! vhash_load(this->p_hash, name, name_len, i)) {
+			vhash_destroy(this->p_hash);
+			return CF_VMAPX_ERR_UNKNOWN;
+		}
+	}
+
+	// Index all the names at once, rather than rebuilding as they're added.
+	vhash_publish(this->p_hash);
+
+	pthread_mutex_init(&this->write_lock, 0);
+
+	return CF_VMAPX_OK;
+}